@@ -1,4 +1,4 @@
-common_imx_dirs := libsensors libgps lights wlan libbt-ath3k
+common_imx_dirs := libsensors libgps lights wlan libbt-ath3k libcompose libaudioconv libfbflip libimxtest
 mx5x_dirs := $(common_imx_dirs) mx5x/audio mx5x/libcopybit mx5x/libgralloc  mx5x/hwcomposer mx5x/libcamera mx5x/power
 mx6_dirs := $(common_imx_dirs) alsa mx6/libgralloc_wrapper mx6/hwcomposer mx6/power
 
@@ -21,13 +21,54 @@ LOCAL_PATH := $(call my-dir)
 include $(CLEAR_VARS)
 LOCAL_MODULE := audio.primary.$(TARGET_BOARD_PLATFORM)
 LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
-LOCAL_SRC_FILES := tinyalsa_hal.c
+LOCAL_SRC_FILES := tinyalsa_hal.c pcm_writer.c pcm_reader.c iec61937.c card_monitor.c echo_ref.c
 LOCAL_C_INCLUDES += \
 	external/tinyalsa/include \
 	system/media/audio_utils/include \
-	system/media/audio_effects/include
+	system/media/audio_effects/include \
+	hardware/imx/libaudioconv
 LOCAL_SHARED_LIBRARIES := liblog libcutils libtinyalsa libaudioutils libdl
+LOCAL_STATIC_LIBRARIES := libimxaudioconv
 LOCAL_MODULE_TAGS := optional
 include $(BUILD_SHARED_LIBRARY)
 
+# the IEC 61937 packer against the reference bursts in tests/iec61937,
+# run on the host:
+# out/host/<os>-<arch>/bin/iec61937_test
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := iec61937.c tests/iec61937_test.c
+LOCAL_C_INCLUDES += hardware/imx/libimxtest
+LOCAL_STATIC_LIBRARIES := libimxtest_host liblog
+LOCAL_MODULE := iec61937_test
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
+
+# CPU time, lock waits, xrun recovery and latency of every stream type on
+# a fake tinyalsa with the cards of a udoo board, run on the host:
+# out/host/<os>-<arch>/bin/audio_hal_harness [fixtures] [seconds] [stream]
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := \
+	tinyalsa_hal.c \
+	pcm_writer.c \
+	pcm_reader.c \
+	iec61937.c \
+	card_monitor.c \
+	echo_ref.c \
+	../libaudioconv/tests/pcm_fake.c \
+	../libaudioconv/tests/mixer_fake.c \
+	../libaudioconv/tests/audio_hal_harness.c \
+	tests/harness_alsa.c
+LOCAL_C_INCLUDES += \
+	external/tinyalsa/include \
+	system/media/audio_utils/include \
+	system/media/audio_effects/include \
+	hardware/imx/libaudioconv \
+	hardware/imx/libaudioconv/tests \
+	hardware/imx/libimxtest
+LOCAL_STATIC_LIBRARIES := liblog libcutils libimxaudioconv_host libimxtest_host
+LOCAL_LDLIBS := -lrt -lpthread -lm
+LOCAL_MODULE := audio_hal_harness
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
+
 endif
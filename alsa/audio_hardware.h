@@ -23,6 +23,11 @@
 
 #include <hardware/hardware.h>
 
+#include "audio_conv.h"
+#include "echo_ref.h"
+#include "pcm_reader.h"
+#include "stream_stats.h"
+
 
 #define MIN(x, y) ((x) > (y) ? (y) : (x))
 
@@ -83,10 +88,37 @@ struct audio_card{
 
 #define MAX_AUDIO_CARD_NUM  4
 #define MAX_AUDIO_CARD_SCAN 4
+#define MAX_CAPTURE_CLIENTS 4
 
 #define MAX_SUP_CHANNEL_NUM  20
 #define MAX_SUP_RATE_NUM     20
 
+/* stereo frames of the deep buffer output. While it owns the codec pcm
+ * these are the last it wrote, while the primary output owns it those from
+ * tail to head wait to be mixed. head and tail count frames and wrap around */
+struct out_mix_ring {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int16_t *buf;
+    size_t size;                /* frames, a power of 2 */
+    size_t head;
+    size_t tail;
+    size_t opened;              /* head when the deep buffer pcm opened */
+    bool active;                /* primary output owns the codec pcm */
+};
+
+/* a capture pcm and the reader the inputs capturing from its card share.
+ * They all capture the same device through the same route. */
+struct imx_capture {
+    int card_idx;               /* in card_list */
+    int device;
+    int route;                  /* of the mic inputs, see set_input_route */
+    struct pcm *pcm;
+    struct pcm_reader *reader;  /* NULL while the card does not capture */
+    struct pcm_config config;
+    int clients;
+};
+
 struct imx_audio_device {
     struct audio_hw_device hw_device;
 
@@ -98,11 +130,11 @@ struct imx_audio_device {
     struct pcm *pcm_modem_ul;
     int in_call;
     float voice_volume;
-    struct imx_stream_in  *active_input;                /*1 input stream, 2 outout stream*/
+    struct imx_stream_in  *active_input;                /*the input routing the microphone*/
     struct imx_stream_out *active_output[OUTPUT_TOTAL];
     bool mic_mute;
     int tty_mode;
-    struct echo_reference_itfe *echo_reference;
+    struct echo_ref *echo_reference;
     bool bluetooth_nrec;
     bool device_is_auto;
     int  wb_amr;
@@ -113,18 +145,25 @@ struct imx_audio_device {
     unsigned int default_rate;               /*HAL input samplerate*/
     unsigned int mm_rate;                    /*HAL hardware output samplerate*/
     char usb_card_name[128];
+    struct out_mix_ring mix;
+    struct card_monitor *monitor;            /*cached capabilities of the cards*/
+    struct imx_stream_in *capture_clients[MAX_CAPTURE_CLIENTS];  /*inputs reading a capture*/
+    struct imx_capture captures[MAX_AUDIO_CARD_NUM];             /*one per card capturing*/
+    uint32_t card_generation;                /*of the cache at the last scan*/
 };
 
 struct imx_stream_out {
     struct audio_stream_out stream;
 
     pthread_mutex_t lock;       /* see note below on mutex acquisition order */
+    volatile int32_t control_seq;   /* odd while a control thread waits for lock */
     struct pcm_config config[PCM_TOTAL];
     struct pcm *pcm[PCM_TOTAL];
+    struct pcm_writer *writer[PCM_TOTAL];   /* for all but the first pcm */
     struct resampler_itfe *resampler;
     char *buffer;
     int standby;
-    struct echo_reference_itfe *echo_reference;
+    struct echo_ref *echo_reference;
     struct imx_audio_device *dev;
     int write_threshold[PCM_TOTAL];
     bool low_power;
@@ -134,6 +173,12 @@ struct imx_stream_out {
     audio_channel_mask_t channel_mask;
     audio_channel_mask_t sup_channel_masks[3];
     int sup_rates[MAX_SUP_RATE_NUM];
+    const uint8_t *channel_map;     /* remap of each frame, chosen at start */
+    struct pcm_config *mm_config;   /* codec pcm setup of the mixer outputs */
+    struct iec61937 *iec;           /* compressed passthrough, NULL for PCM */
+    int iec_card;                   /* card_list index carrying it */
+    audio_format_t format;
+    struct stream_stats stats;      /* cost of the writes, for the dump */
 };
 
 #define MAX_PREPROCESSORS 3 /* maximum one AGC + one NS + one AEC per input stream */
@@ -144,7 +189,7 @@ struct effect_info_s {
 };
 
 #define NUM_IN_AUX_CNL_CONFIGS 2
-channel_config_t in_aux_cnl_configs[NUM_IN_AUX_CNL_CONFIGS] = {
+static channel_config_t in_aux_cnl_configs[NUM_IN_AUX_CNL_CONFIGS] = {
     { AUDIO_CHANNEL_IN_FRONT , AUDIO_CHANNEL_IN_BACK},
     { AUDIO_CHANNEL_IN_STEREO , AUDIO_CHANNEL_IN_RIGHT}
 };
@@ -156,7 +201,9 @@ struct imx_stream_in {
 
     pthread_mutex_t lock;       /* see note below on mutex acquisition order */
     struct pcm_config config;
-    struct pcm *pcm;
+    struct pcm *pcm;            /* the capture pcm of the device while started */
+    struct imx_capture *shared; /* which it reads through */
+    struct pcm_reader_client capture;
     int device;
     struct resampler_itfe *resampler;
     struct resampler_buffer_provider buf_provider;
@@ -166,14 +213,16 @@ struct imx_stream_in {
     int32_t *read_tmp_buf;
     size_t read_tmp_buf_size;
     size_t read_tmp_buf_frames;
+    struct audio_conv conv;     /* pcm to requested format, chosen at start */
 
     unsigned int requested_rate;
     unsigned int requested_format;
     unsigned int requested_channel;
     int standby;
     int source;
-    struct echo_reference_itfe *echo_reference;
+    struct echo_ref *echo_reference;
     bool need_echo_reference;
+    bool echo_measure;          /* correlate capture and reference, loopback test */
     struct effect_info_s preprocessors[MAX_PREPROCESSORS];
     int num_preprocessors;
 
@@ -182,9 +231,14 @@ struct imx_stream_in {
     size_t proc_buf_size;
     size_t proc_buf_frames;
 
+    uint64_t proc_frame;        /* captured frames before proc_buf_in */
+    uint64_t ref_frame;         /* captured frames the reference was pushed for */
     int16_t *ref_buf;
     size_t ref_buf_size;
-    size_t ref_frames_in;
+    bool loopback;              /* no card: hears the output through the reference */
+    int64_t loopback_delay_ns;
+    int64_t loopback_start;
+    struct stream_stats stats;  /* cost of the reads, for the dump */
     int read_status;
     size_t mute_500ms;
     struct imx_audio_device *dev;
@@ -0,0 +1,502 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "audio_hw_cards"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cutils/log.h>
+#include <cutils/uevent.h>
+
+#include "card_monitor.h"
+
+#define USB_DRIVER              "USB-Audio"
+#define UEVENT_BUFFER_SIZE      (64 * 1024)
+#define UEVENT_MSG_LEN          2048
+/* quiet time after the last event of a card before it is probed, so
+ * ueventd has created all its device nodes */
+#define SETTLE_MS               200
+/* a pre-opened pcm nobody takes is closed after this, so it does not
+ * keep the device from other users */
+#define PREOPEN_MS              10000
+
+struct card_monitor {
+    pthread_mutex_t lock;       /* guards card, pcm_in and generation */
+    struct card_caps card[CARD_MONITOR_CARDS];
+    struct pcm *pcm_in[CARD_MONITOR_CARDS];
+    struct pcm_config pcm_in_config[CARD_MONITOR_CARDS];
+    int64_t pcm_in_expiry[CARD_MONITOR_CARDS];
+    uint32_t generation;
+    struct pcm_config usb_in;
+
+    /* owned by the thread */
+    int sock;
+    int wake[2];
+    pthread_t thread;
+    int started;
+    uint32_t pending;           /* cards to probe */
+    uint32_t preopen;           /* of those, cards that were added */
+    int hdmi_pending;
+    int64_t settle;             /* when the pending probes run */
+};
+
+static int64_t monotonic_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int is_usb(const struct card_caps *caps)
+{
+    return strstr(caps->driver, USB_DRIVER) != NULL;
+}
+
+static int read_mixer_values(struct mixer *mixer, const char *name, int *values)
+{
+    struct mixer_ctl *ctl;
+    int count;
+    int i;
+
+    ctl = mixer_get_ctl_by_name(mixer, name);
+    if (!ctl)
+        return 0;
+
+    count = mixer_ctl_get_num_values(ctl);
+    if (count > CARD_MONITOR_VALUES)
+        count = CARD_MONITOR_VALUES;
+    for (i = 0; i < count; i++)
+        values[i] = mixer_ctl_get_value(ctl, i);
+    return count;
+}
+
+static void card_monitor_read_hdmi(struct card_caps *caps)
+{
+    if (!caps->mixer)
+        return;
+    caps->hdmi_channel_count = read_mixer_values(caps->mixer, "HDMI Support Channels",
+                                                 caps->hdmi_channels);
+    caps->hdmi_rate_count = read_mixer_values(caps->mixer, "HDMI Support Rates",
+                                              caps->hdmi_rates);
+}
+
+/* runs without the lock, caps->mixer holds the mixer already open for
+ * card. Mixers stay open until the monitor closes, the HAL keeps using
+ * them and the on-chip cards owning one are never unplugged. */
+static void card_monitor_probe(unsigned int card, struct card_caps *caps)
+{
+    struct control *control;
+    struct mixer *mixer = caps->mixer;
+    int rate, channels;
+
+    memset(caps, 0, sizeof(*caps));
+    caps->mixer = mixer;
+    caps->in_format = -1;
+
+    control = control_open(card);
+    if (!control)
+        return;
+    strlcpy(caps->id, control_card_info_get_id(control), sizeof(caps->id));
+    strlcpy(caps->driver, control_card_info_get_driver(control), sizeof(caps->driver));
+    strlcpy(caps->name, control_card_info_get_name(control), sizeof(caps->name));
+    control_close(control);
+    caps->present = 1;
+
+    if (!caps->mixer && !is_usb(caps)) {
+        caps->mixer = mixer_open(card);
+        if (!caps->mixer)
+            ALOGE("card %u: unable to open the mixer", card);
+    }
+
+    rate = 44100;
+    if (pcm_get_near_param(card, 0, PCM_OUT, PCM_HW_PARAM_RATE, &rate) == 0)
+        caps->out_rate = rate;
+
+    rate = 44100;
+    if (pcm_get_near_param(card, 0, PCM_IN, PCM_HW_PARAM_RATE, &rate) == 0)
+        caps->in_rate = rate;
+
+    channels = 1;
+    if (pcm_get_near_param(card, 0, PCM_IN, PCM_HW_PARAM_CHANNELS, &channels) == 0)
+        caps->in_channels = channels;
+
+    if (pcm_check_param_mask(card, 0, PCM_IN, PCM_HW_PARAM_FORMAT, PCM_FORMAT_S16_LE))
+        caps->in_format = PCM_FORMAT_S16_LE;
+    else if (pcm_check_param_mask(card, 0, PCM_IN, PCM_HW_PARAM_FORMAT, PCM_FORMAT_S24_LE))
+        caps->in_format = PCM_FORMAT_S24_LE;
+
+    card_monitor_read_hdmi(caps);
+
+    ALOGI("card %u, id %s, driver %s, name %s: out %u Hz, in %u Hz %d channels format %d",
+          card, caps->id, caps->driver, caps->name, caps->out_rate,
+          caps->in_rate, caps->in_channels, caps->in_format);
+}
+
+static void card_monitor_update(struct card_monitor *m, unsigned int card, int preopen)
+{
+    struct card_caps caps;
+    struct pcm_config config;
+    struct pcm *pcm;
+
+    pthread_mutex_lock(&m->lock);
+    caps.mixer = m->card[card].mixer;
+    pthread_mutex_unlock(&m->lock);
+
+    card_monitor_probe(card, &caps);
+
+    pthread_mutex_lock(&m->lock);
+    caps.preopened = m->pcm_in[card] != NULL;
+    if (caps.present != m->card[card].present)
+        ALOGI("card %u %s", card, caps.present ? "added" : "removed");
+    m->card[card] = caps;
+    m->generation++;
+    pthread_mutex_unlock(&m->lock);
+
+    if (!preopen || !caps.present || !is_usb(&caps) || caps.preopened ||
+            caps.in_rate == 0 || caps.in_channels == 0)
+        return;
+
+    // the first open of a USB device sets up its interface, which the
+    // stream would otherwise wait for
+    config = m->usb_in;
+    config.rate = caps.in_rate;
+    config.channels = caps.in_channels;
+    config.stop_threshold = config.period_size * config.period_count;
+    pcm = pcm_open(card, 0, PCM_IN, &config);
+    if (!pcm_is_ready(pcm)) {
+        ALOGW("card %u: cannot pre-open capture: %s", card, pcm_get_error(pcm));
+        pcm_close(pcm);
+        return;
+    }
+
+    pthread_mutex_lock(&m->lock);
+    m->pcm_in[card] = pcm;
+    m->pcm_in_config[card] = config;
+    m->pcm_in_expiry[card] = monotonic_ms() + PREOPEN_MS;
+    m->card[card].preopened = 1;
+    pthread_mutex_unlock(&m->lock);
+    ALOGI("card %u: capture pre-opened, %u Hz %u channels", card, config.rate, config.channels);
+}
+
+/* closes pre-opened pcms of the cards in mask, or those expired */
+static void card_monitor_release(struct card_monitor *m, uint32_t mask, int64_t now)
+{
+    struct pcm *pcm[CARD_MONITOR_CARDS];
+    unsigned int i;
+
+    pthread_mutex_lock(&m->lock);
+    for (i = 0; i < CARD_MONITOR_CARDS; i++) {
+        pcm[i] = NULL;
+        if (m->pcm_in[i] && ((mask & (1 << i)) || now >= m->pcm_in_expiry[i])) {
+            pcm[i] = m->pcm_in[i];
+            m->pcm_in[i] = NULL;
+            m->card[i].preopened = 0;
+            m->generation++;
+        }
+    }
+    pthread_mutex_unlock(&m->lock);
+
+    for (i = 0; i < CARD_MONITOR_CARDS; i++) {
+        if (pcm[i]) {
+            ALOGV("card %u: pre-opened capture closed", i);
+            pcm_close(pcm[i]);
+        }
+    }
+}
+
+static void card_monitor_refresh_hdmi(struct card_monitor *m)
+{
+    struct card_caps caps;
+    unsigned int i;
+
+    for (i = 0; i < CARD_MONITOR_CARDS; i++) {
+        pthread_mutex_lock(&m->lock);
+        caps = m->card[i];
+        pthread_mutex_unlock(&m->lock);
+        if (!caps.present || !caps.mixer)
+            continue;
+
+        card_monitor_read_hdmi(&caps);
+
+        pthread_mutex_lock(&m->lock);
+        memcpy(m->card[i].hdmi_channels, caps.hdmi_channels, sizeof(caps.hdmi_channels));
+        m->card[i].hdmi_channel_count = caps.hdmi_channel_count;
+        memcpy(m->card[i].hdmi_rates, caps.hdmi_rates, sizeof(caps.hdmi_rates));
+        m->card[i].hdmi_rate_count = caps.hdmi_rate_count;
+        m->generation++;
+        pthread_mutex_unlock(&m->lock);
+    }
+}
+
+/* msg is "action@devpath" followed by KEY=value strings */
+static void card_monitor_event(struct card_monitor *m, const char *msg, int len)
+{
+    const char *end = msg + len;
+    const char *action = NULL;
+    const char *devpath = NULL;
+    const char *subsystem = NULL;
+    const char *s;
+    unsigned int card;
+
+    if (!strncmp(msg, "change@/devices/platform/mxc_hdmi", 33) ||
+            !strncmp(msg, "change@/devices/platform/sii902x", 32)) {
+        m->hdmi_pending = 1;
+        m->settle = monotonic_ms() + SETTLE_MS;
+        return;
+    }
+
+    for (s = msg + strlen(msg) + 1; s < end && *s; s += strlen(s) + 1) {
+        if (!strncmp(s, "ACTION=", 7))
+            action = s + 7;
+        else if (!strncmp(s, "DEVPATH=", 8))
+            devpath = s + 8;
+        else if (!strncmp(s, "SUBSYSTEM=", 10))
+            subsystem = s + 10;
+    }
+    if (!action || !devpath || !subsystem || strcmp(subsystem, "sound"))
+        return;
+
+    s = strstr(devpath, "/sound/card");
+    if (!s)
+        return;
+    card = atoi(s + 11);
+    if (card >= CARD_MONITOR_CARDS)
+        return;
+
+    ALOGV("%s %s", action, devpath);
+    if (!strcmp(action, "remove")) {
+        // the card is freed once its last file is closed
+        card_monitor_release(m, 1 << card, 0);
+    } else if (!strcmp(action, "add")) {
+        m->preopen |= 1 << card;
+    } else if (strcmp(action, "change")) {
+        return;
+    }
+    m->pending |= 1 << card;
+    m->settle = monotonic_ms() + SETTLE_MS;
+}
+
+static void *card_monitor_thread(void *arg)
+{
+    struct card_monitor *m = (struct card_monitor *)arg;
+    char msg[UEVENT_MSG_LEN + 2];
+    struct pollfd fds[2];
+    int64_t now, expiry;
+    int timeout;
+    int len;
+    unsigned int i;
+
+    fds[0].fd = m->sock;
+    fds[0].events = POLLIN;
+    fds[1].fd = m->wake[0];
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        now = monotonic_ms();
+        expiry = -1;
+        if (m->pending || m->hdmi_pending)
+            expiry = m->settle;
+        pthread_mutex_lock(&m->lock);
+        for (i = 0; i < CARD_MONITOR_CARDS; i++) {
+            if (m->pcm_in[i] && (expiry < 0 || m->pcm_in_expiry[i] < expiry))
+                expiry = m->pcm_in_expiry[i];
+        }
+        pthread_mutex_unlock(&m->lock);
+        timeout = expiry < 0 ? -1 : expiry > now ? (int)(expiry - now) : 0;
+
+        if (poll(fds, 2, timeout) < 0 && errno != EINTR) {
+            ALOGE("uevent poll failed: %s", strerror(errno));
+            break;
+        }
+        if (fds[1].revents)
+            break;
+        if (fds[0].revents & POLLIN) {
+            len = uevent_kernel_multicast_recv(m->sock, msg, UEVENT_MSG_LEN);
+            if (len > 0) {
+                msg[len] = '\0';
+                msg[len + 1] = '\0';
+                card_monitor_event(m, msg, len);
+            }
+            continue;
+        }
+
+        now = monotonic_ms();
+        if ((m->pending || m->hdmi_pending) && now >= m->settle) {
+            for (i = 0; i < CARD_MONITOR_CARDS; i++) {
+                if (m->pending & (1 << i))
+                    card_monitor_update(m, i, m->preopen & (1 << i));
+            }
+            if (m->hdmi_pending)
+                card_monitor_refresh_hdmi(m);
+            m->pending = 0;
+            m->preopen = 0;
+            m->hdmi_pending = 0;
+        }
+        card_monitor_release(m, 0, now);
+    }
+
+    return NULL;
+}
+
+struct card_monitor *card_monitor_open(const struct pcm_config *usb_in)
+{
+    struct card_monitor *m;
+    unsigned int i;
+
+    m = (struct card_monitor *)calloc(1, sizeof(struct card_monitor));
+    if (!m)
+        return NULL;
+
+    pthread_mutex_init(&m->lock, NULL);
+    m->usb_in = *usb_in;
+    m->sock = -1;
+    m->wake[0] = m->wake[1] = -1;
+
+    for (i = 0; i < CARD_MONITOR_CARDS; i++)
+        card_monitor_probe(i, &m->card[i]);
+
+    // without uevents the cards seen now are all the HAL will know
+    m->sock = uevent_open_socket(UEVENT_BUFFER_SIZE, true);
+    if (m->sock < 0) {
+        ALOGW("no uevent socket, hotplugged cards will not be seen");
+        return m;
+    }
+    if (pipe(m->wake) != 0) {
+        ALOGW("card monitor pipe failed: %s", strerror(errno));
+        return m;
+    }
+    fcntl(m->wake[0], F_SETFD, FD_CLOEXEC);
+    fcntl(m->wake[1], F_SETFD, FD_CLOEXEC);
+
+    if (pthread_create(&m->thread, NULL, card_monitor_thread, m) != 0) {
+        ALOGW("card monitor thread creation failed: %s", strerror(errno));
+        return m;
+    }
+    m->started = 1;
+
+    return m;
+}
+
+void card_monitor_close(struct card_monitor *m)
+{
+    unsigned int i;
+
+    if (m == NULL)
+        return;
+
+    if (m->started) {
+        write(m->wake[1], "x", 1);
+        pthread_join(m->thread, NULL);
+    }
+    if (m->sock >= 0)
+        close(m->sock);
+    if (m->wake[0] >= 0) {
+        close(m->wake[0]);
+        close(m->wake[1]);
+    }
+
+    for (i = 0; i < CARD_MONITOR_CARDS; i++) {
+        if (m->pcm_in[i])
+            pcm_close(m->pcm_in[i]);
+        if (m->card[i].mixer)
+            mixer_close(m->card[i].mixer);
+    }
+    pthread_mutex_destroy(&m->lock);
+    free(m);
+}
+
+int card_monitor_get(struct card_monitor *m, unsigned int card, struct card_caps *caps)
+{
+    if (card >= CARD_MONITOR_CARDS)
+        return -EINVAL;
+
+    pthread_mutex_lock(&m->lock);
+    *caps = m->card[card];
+    pthread_mutex_unlock(&m->lock);
+
+    return caps->present ? 0 : -ENODEV;
+}
+
+uint32_t card_monitor_generation(struct card_monitor *m)
+{
+    uint32_t generation;
+
+    pthread_mutex_lock(&m->lock);
+    generation = m->generation;
+    pthread_mutex_unlock(&m->lock);
+
+    return generation;
+}
+
+struct pcm *card_monitor_take_pcm(struct card_monitor *m, unsigned int card,
+                                  const struct pcm_config *config)
+{
+    struct pcm *pcm;
+    struct pcm_config *c;
+    int match;
+
+    if (card >= CARD_MONITOR_CARDS)
+        return NULL;
+
+    pthread_mutex_lock(&m->lock);
+    pcm = m->pcm_in[card];
+    c = &m->pcm_in_config[card];
+    match = pcm && c->channels == config->channels && c->rate == config->rate &&
+            c->period_size == config->period_size &&
+            c->period_count == config->period_count &&
+            c->format == config->format &&
+            c->start_threshold == config->start_threshold &&
+            c->stop_threshold == config->stop_threshold;
+    m->pcm_in[card] = NULL;
+    m->card[card].preopened = 0;
+    pthread_mutex_unlock(&m->lock);
+
+    // a pcm set up otherwise would keep the stream from opening its own
+    if (pcm && !match) {
+        ALOGW("card %u: pre-opened capture does not match, closing it", card);
+        pcm_close(pcm);
+        pcm = NULL;
+    }
+
+    return pcm;
+}
+
+void card_monitor_dump(struct card_monitor *m, int fd)
+{
+    char buffer[256];
+    struct card_caps caps;
+    unsigned int i;
+
+    for (i = 0; i < CARD_MONITOR_CARDS; i++) {
+        if (card_monitor_get(m, i, &caps) != 0)
+            continue;
+        snprintf(buffer, sizeof(buffer),
+                 "  card %u %s (%s): out %u Hz, in %u Hz %d channels, hdmi %d rates %d channel sets%s\n",
+                 i, caps.id, caps.driver, caps.out_rate, caps.in_rate, caps.in_channels,
+                 caps.hdmi_rate_count, caps.hdmi_channel_count,
+                 caps.preopened ? ", capture pre-opened" : "");
+        write(fd, buffer, strlen(buffer));
+    }
+}
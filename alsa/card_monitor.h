@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMX_CARD_MONITOR_H
+#define IMX_CARD_MONITOR_H
+
+#include <stdint.h>
+#include <tinyalsa/asoundlib.h>
+
+/*
+ * Keeps what the HAL needs to know of each ALSA card, so opening a
+ * stream or routing never waits on the driver.
+ *
+ * Every card is probed once when the monitor opens. A thread then
+ * listens to kernel uevents and probes again the cards that were added
+ * or changed, and the HDMI capabilities when the cable is plugged. A USB
+ * card that appears gets its capture pcm opened in the background, for
+ * the stream that starts on it next.
+ */
+#define CARD_MONITOR_CARDS      4
+#define CARD_MONITOR_VALUES     20
+
+struct card_caps {
+    int present;
+    char id[16];
+    char driver[16];
+    char name[80];
+    unsigned int out_rate;      /* 0 when the probe failed */
+    unsigned int in_rate;
+    int in_channels;
+    int in_format;
+    int hdmi_channels[CARD_MONITOR_VALUES];    /* "HDMI Support Channels" */
+    int hdmi_channel_count;
+    int hdmi_rates[CARD_MONITOR_VALUES];       /* "HDMI Support Rates" */
+    int hdmi_rate_count;
+    struct mixer *mixer;        /* NULL for USB cards */
+    int preopened;              /* a capture pcm waits to be taken */
+};
+
+struct card_monitor;
+
+/* probes every card and starts the thread. usb_in is the capture setup
+ * pre-opened pcms get, with the rate and channels of the card. */
+struct card_monitor *card_monitor_open(const struct pcm_config *usb_in);
+
+/* stops the thread and closes the mixers and any pcm not taken. */
+void card_monitor_close(struct card_monitor *monitor);
+
+/* copies the capabilities of card. returns 0 if it is present. */
+int card_monitor_get(struct card_monitor *monitor, unsigned int card,
+                     struct card_caps *caps);
+
+/* bumped on every change seen, to skip a rescan when nothing moved. */
+uint32_t card_monitor_generation(struct card_monitor *monitor);
+
+/* hands over the pre-opened capture pcm of card if it was opened with
+ * config, NULL otherwise. The caller then owns it. */
+struct pcm *card_monitor_take_pcm(struct card_monitor *monitor, unsigned int card,
+                                  const struct pcm_config *config);
+
+/* prints the cached cards for the device dump. */
+void card_monitor_dump(struct card_monitor *monitor, int fd);
+
+#endif
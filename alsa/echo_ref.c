@@ -0,0 +1,495 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "audio_hw_echo"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/log.h>
+
+#include "audio_resampler.h"
+#include "echo_ref.h"
+
+/* reference kept for capture frames to catch up with */
+#define ECHO_REF_RING_MS        1000
+/* written frames resampled at a time */
+#define ECHO_REF_WRITE_FRAMES   256
+/* read frames interpolated from one copy of the ring */
+#define ECHO_REF_READ_FRAMES    512
+/* a time stamp this far off the clock restarts it */
+#define ECHO_REF_RESYNC_NS      20000000LL
+/* cards are within this of their nominal rate */
+#define ECHO_REF_MAX_PPM        1000
+/* the clock moves by these parts of each error, on its phase and rate */
+#define ECHO_REF_PHASE_GAIN     (1.0 / 16)
+#define ECHO_REF_FREQ_GAIN      (1.0 / 128)
+/* frames correlated per measure, and lags tried each way */
+#define ECHO_REF_MEASURE_FRAMES 2048
+#define ECHO_REF_MEASURE_LAG_MS 100
+
+/* frame to time of one card, anchored on the last stamp */
+struct echo_clock {
+    int valid;
+    uint64_t frame;
+    double time;                /* ns the anchor frame is rendered or captured */
+    double period;              /* ns per frame */
+    double nominal;
+    double error;               /* of the last stamp, ns */
+    uint32_t resyncs;
+};
+
+struct echo_ref {
+    pthread_mutex_t lock;
+
+    unsigned int write_rate;
+    unsigned int write_channels;
+    unsigned int read_rate;
+    unsigned int read_channels;
+
+    int16_t *ring;              /* at the read rate, write channels */
+    uint32_t ring_frames;
+    uint64_t head;              /* ring frames stored */
+    uint64_t written;           /* frames written, at the write rate */
+
+    /* write to read rate at the nominal ratio, none when they match.
+     * from the output thread only. */
+    struct resampler_itfe *resampler;
+    double delay;               /* of its filter, in written frames */
+    int16_t *resampled;
+    size_t resampled_frames;
+
+    /* ring frames a read interpolates from, input thread only */
+    int16_t *span;
+    size_t span_frames;
+
+    struct echo_clock play;
+    struct echo_clock capture;
+    uint64_t missing;           /* reference frames read as silence */
+
+    /* measure, from the input thread only */
+    int16_t *measure_capture;
+    int16_t *measure_ref;
+    size_t measure_fill;
+    size_t measure_skip;        /* frames left before the next window */
+    int measure_lag;            /* of the last window, capture behind reference */
+    double measure_peak;        /* normalized correlation at that lag */
+    uint32_t measures;
+};
+
+static void echo_clock_init(struct echo_clock *c, unsigned int rate)
+{
+    memset(c, 0, sizeof(*c));
+    c->nominal = 1000000000.0 / rate;
+    c->period = c->nominal;
+}
+
+static void echo_clock_update(struct echo_clock *c, uint64_t frame, int64_t time)
+{
+    double predicted, error, elapsed;
+
+    if (c->valid && frame > c->frame) {
+        elapsed = (double)(frame - c->frame);
+        predicted = c->time + elapsed * c->period;
+        error = (double)time - predicted;
+
+        if (fabs(error) < ECHO_REF_RESYNC_NS) {
+            // stamps jitter by a period or so, only a part of each error
+            // moves the phase and a smaller part the rate
+            c->time = predicted + error * ECHO_REF_PHASE_GAIN;
+            c->frame = frame;
+            c->period += error / elapsed * ECHO_REF_FREQ_GAIN;
+            if (c->period > c->nominal * (1 + ECHO_REF_MAX_PPM / 1e6))
+                c->period = c->nominal * (1 + ECHO_REF_MAX_PPM / 1e6);
+            if (c->period < c->nominal * (1 - ECHO_REF_MAX_PPM / 1e6))
+                c->period = c->nominal * (1 - ECHO_REF_MAX_PPM / 1e6);
+            c->error = error;
+            return;
+        }
+        c->resyncs++;
+    } else if (c->valid && frame == c->frame) {
+        return;
+    }
+
+    // first stamp, a jump or frames counted again: start over, the rate
+    // learnt so far still holds for the same card
+    c->valid = 1;
+    c->frame = frame;
+    c->time = (double)time;
+    c->error = 0;
+}
+
+static double echo_clock_time(const struct echo_clock *c, uint64_t frame)
+{
+    return c->time + (double)(int64_t)(frame - c->frame) * c->period;
+}
+
+static int echo_clock_ppm(const struct echo_clock *c)
+{
+    return (int)lrint((c->nominal / c->period - 1) * 1e6);
+}
+
+struct echo_ref *echo_ref_create(unsigned int write_rate, unsigned int write_channels,
+                                 unsigned int read_rate, unsigned int read_channels)
+{
+    struct echo_ref *ref;
+
+    if (write_rate == 0 || read_rate == 0 ||
+        write_channels < 1 || write_channels > 2 ||
+        read_channels < 1 || read_channels > 2)
+        return NULL;
+
+    ref = (struct echo_ref *)calloc(1, sizeof(struct echo_ref));
+    if (ref == NULL)
+        return NULL;
+
+    ref->write_rate = write_rate;
+    ref->write_channels = write_channels;
+    ref->read_rate = read_rate;
+    ref->read_channels = read_channels;
+    ref->ring_frames = read_rate * ECHO_REF_RING_MS / 1000;
+    ref->ring = (int16_t *)malloc(ref->ring_frames * write_channels * sizeof(int16_t));
+    // the drift makes a read span a little more or less than its frames
+    ref->span_frames = ECHO_REF_READ_FRAMES * 2 + 2;
+    ref->span = (int16_t *)malloc(ref->span_frames * write_channels * sizeof(int16_t));
+    ref->measure_capture = (int16_t *)malloc(ECHO_REF_MEASURE_FRAMES * sizeof(int16_t));
+    ref->measure_ref = (int16_t *)malloc(ECHO_REF_MEASURE_FRAMES * sizeof(int16_t));
+    if (ref->ring == NULL || ref->span == NULL ||
+        ref->measure_capture == NULL || ref->measure_ref == NULL)
+        goto error;
+
+    if (write_rate != read_rate) {
+        struct audio_resampler_stats stats;
+
+        if (audio_resampler_create(write_rate, read_rate, write_channels,
+                                   RESAMPLER_QUALITY_DEFAULT, NULL, &ref->resampler) != 0)
+            goto error;
+        // output frame k is centred on written frame k / ratio - delay
+        audio_resampler_get_stats(ref->resampler, &stats);
+        ref->delay = stats.taps / 2.0 - 1.0 / (2.0 * stats.phases);
+        ref->resampled_frames = (size_t)ECHO_REF_WRITE_FRAMES * read_rate / write_rate + 2;
+        ref->resampled = (int16_t *)malloc(ref->resampled_frames * write_channels *
+                                           sizeof(int16_t));
+        if (ref->resampled == NULL)
+            goto error;
+    }
+
+    echo_clock_init(&ref->play, write_rate);
+    echo_clock_init(&ref->capture, read_rate);
+    pthread_mutex_init(&ref->lock, NULL);
+
+    ALOGV("echo reference %u Hz %u ch to %u Hz %u ch",
+          write_rate, write_channels, read_rate, read_channels);
+    return ref;
+
+error:
+    if (ref->resampler != NULL)
+        audio_resampler_release(ref->resampler);
+    free(ref->resampled);
+    free(ref->ring);
+    free(ref->span);
+    free(ref->measure_capture);
+    free(ref->measure_ref);
+    free(ref);
+    return NULL;
+}
+
+void echo_ref_release(struct echo_ref *ref)
+{
+    if (ref == NULL)
+        return;
+
+    pthread_mutex_destroy(&ref->lock);
+    if (ref->resampler != NULL)
+        audio_resampler_release(ref->resampler);
+    free(ref->resampled);
+    free(ref->ring);
+    free(ref->span);
+    free(ref->measure_capture);
+    free(ref->measure_ref);
+    free(ref);
+}
+
+/* copies frames at the read rate into the ring, with the lock held */
+static void echo_ref_store(struct echo_ref *ref, const int16_t *frames, size_t count)
+{
+    size_t pos, n;
+
+    // only the last ring of a large write is ever read
+    if (count > ref->ring_frames) {
+        frames += (count - ref->ring_frames) * ref->write_channels;
+        ref->head += count - ref->ring_frames;
+        count = ref->ring_frames;
+    }
+    while (count > 0) {
+        pos = ref->head % ref->ring_frames;
+        n = ref->ring_frames - pos;
+        if (n > count)
+            n = count;
+        memcpy(ref->ring + pos * ref->write_channels, frames,
+               n * ref->write_channels * sizeof(int16_t));
+        frames += n * ref->write_channels;
+        ref->head += n;
+        count -= n;
+    }
+}
+
+void echo_ref_write(struct echo_ref *ref, const int16_t *frames, size_t count,
+                    int64_t render_ns)
+{
+    size_t in, out;
+
+    pthread_mutex_lock(&ref->lock);
+    if (render_ns >= 0)
+        echo_clock_update(&ref->play, ref->written, render_ns);
+    ref->written += count;
+    if (ref->resampler == NULL) {
+        echo_ref_store(ref, frames, count);
+        pthread_mutex_unlock(&ref->lock);
+        return;
+    }
+    pthread_mutex_unlock(&ref->lock);
+
+    // the filter runs outside the lock, every frame goes through it so
+    // the ring stays on the written frames
+    while (count > 0) {
+        in = count < ECHO_REF_WRITE_FRAMES ? count : ECHO_REF_WRITE_FRAMES;
+        out = ref->resampled_frames;
+        ref->resampler->resample_from_input(ref->resampler, (int16_t *)frames, &in,
+                                            ref->resampled, &out);
+        frames += in * ref->write_channels;
+        count -= in;
+
+        pthread_mutex_lock(&ref->lock);
+        echo_ref_store(ref, ref->resampled, out);
+        pthread_mutex_unlock(&ref->lock);
+    }
+}
+
+void echo_ref_stop(struct echo_ref *ref)
+{
+    pthread_mutex_lock(&ref->lock);
+    // frames still in the driver are not played, they read as silence
+    // until the next write restarts the clock where the output resumes
+    ref->play.valid = 0;
+    pthread_mutex_unlock(&ref->lock);
+}
+
+void echo_ref_set_capture_time(struct echo_ref *ref, uint64_t frame, int64_t capture_ns)
+{
+    pthread_mutex_lock(&ref->lock);
+    echo_clock_update(&ref->capture, frame, capture_ns);
+    pthread_mutex_unlock(&ref->lock);
+}
+
+/* sample of channel ch of a ring frame, mixed to the read layout */
+static int echo_ref_sample(const struct echo_ref *ref, const int16_t *s, unsigned int ch)
+{
+    if (ref->write_channels == ref->read_channels)
+        return s[ch];
+    if (ref->write_channels == 2)
+        return (s[0] + s[1]) / 2;
+    return s[0];
+}
+
+/* count read frames from ring position pos on. the ring frames they
+ * need are copied with the lock held and interpolated once it is not,
+ * returns how many were played. */
+static size_t echo_ref_block(struct echo_ref *ref, double pos, double step,
+                             int16_t *frames, size_t count)
+{
+    unsigned int channels = ref->write_channels;
+    int64_t first, end, oldest, head, f, p;
+    const int16_t *a, *b;
+    size_t i, n, played = 0;
+    unsigned int ch;
+    double frac;
+
+    // the frame after the last one is needed to interpolate
+    first = (int64_t)floor(pos);
+    end = (int64_t)floor(pos + (count - 1) * step) + 2;
+
+    pthread_mutex_lock(&ref->lock);
+    head = (int64_t)ref->head;
+    oldest = head > ref->ring_frames ? head - ref->ring_frames : 0;
+    if (first < oldest)
+        first = oldest;
+    if (end > head)
+        end = head;
+    if (end > first + (int64_t)ref->span_frames)
+        end = first + ref->span_frames;
+    for (p = first; p < end; p += n) {
+        f = p % ref->ring_frames;
+        n = ref->ring_frames - f;
+        if ((int64_t)n > end - p)
+            n = end - p;
+        memcpy(ref->span + (p - first) * channels, ref->ring + f * channels,
+               n * channels * sizeof(int16_t));
+    }
+    pthread_mutex_unlock(&ref->lock);
+
+    for (i = 0; i < count; i++, pos += step) {
+        f = (int64_t)floor(pos);
+        if (f < first || f + 1 >= end) {
+            for (ch = 0; ch < ref->read_channels; ch++)
+                *frames++ = 0;
+            continue;
+        }
+        frac = pos - (double)f;
+        a = ref->span + (f - first) * channels;
+        b = a + channels;
+        for (ch = 0; ch < ref->read_channels; ch++) {
+            int sa = echo_ref_sample(ref, a, ch);
+            int sb = echo_ref_sample(ref, b, ch);
+            *frames++ = (int16_t)(sa + (int)lrint((sb - sa) * frac));
+        }
+        played++;
+    }
+
+    return played;
+}
+
+size_t echo_ref_read(struct echo_ref *ref, uint64_t frame, int64_t offset_ns,
+                     int16_t *frames, size_t count)
+{
+    double ratio = (double)ref->read_rate / ref->write_rate;
+    double pos, step;
+    size_t i, n, played = 0;
+
+    pthread_mutex_lock(&ref->lock);
+    if (!ref->play.valid || !ref->capture.valid) {
+        ref->missing += count;
+        pthread_mutex_unlock(&ref->lock);
+        memset(frames, 0, count * ref->read_channels * sizeof(int16_t));
+        return 0;
+    }
+
+    // written frame played when the first capture frame was taken: one
+    // division, then a step of the ratio of both clocks. in the ring the
+    // nominal ratio is done, the step only follows the drift.
+    pos = ((double)(int64_t)(ref->play.frame) +
+           (echo_clock_time(&ref->capture, frame) + offset_ns - ref->play.time) /
+           ref->play.period + ref->delay) * ratio;
+    step = ref->capture.period / ref->play.period * ratio;
+    pthread_mutex_unlock(&ref->lock);
+
+    for (i = 0; i < count; i += n) {
+        n = count - i < ECHO_REF_READ_FRAMES ? count - i : ECHO_REF_READ_FRAMES;
+        played += echo_ref_block(ref, pos + i * step, step,
+                                 frames + i * ref->read_channels, n);
+    }
+
+    pthread_mutex_lock(&ref->lock);
+    ref->missing += count - played;
+    pthread_mutex_unlock(&ref->lock);
+
+    return played;
+}
+
+static void echo_ref_correlate(struct echo_ref *ref)
+{
+    int max_lag = ref->read_rate * ECHO_REF_MEASURE_LAG_MS / 1000;
+    int n = ECHO_REF_MEASURE_FRAMES;
+    int lag, best = 0, i;
+    int64_t sum, best_sum = 0;
+    double e_cap = 0, e_ref = 0;
+
+    if (max_lag > n / 2)
+        max_lag = n / 2;
+
+    for (i = 0; i < n; i++) {
+        e_cap += (double)ref->measure_capture[i] * ref->measure_capture[i];
+        e_ref += (double)ref->measure_ref[i] * ref->measure_ref[i];
+    }
+    if (e_cap == 0 || e_ref == 0)
+        return;
+
+    // capture[i] against reference[i - lag], over the part both cover
+    for (lag = -max_lag; lag <= max_lag; lag++) {
+        sum = 0;
+        for (i = lag > 0 ? lag : 0; i < (lag < 0 ? n + lag : n); i++)
+            sum += (int32_t)ref->measure_capture[i] * ref->measure_ref[i - lag];
+        if (llabs(sum) > llabs(best_sum)) {
+            best_sum = sum;
+            best = lag;
+        }
+    }
+
+    ref->measure_lag = best;
+    ref->measure_peak = (double)best_sum / sqrt(e_cap * e_ref);
+    ref->measures++;
+    ALOGI("echo reference: capture %s reference by %d frames (%d us), correlation %.2f",
+          best >= 0 ? "behind" : "ahead of", abs(best),
+          (int)((int64_t)best * 1000000 / ref->read_rate), ref->measure_peak);
+}
+
+void echo_ref_measure(struct echo_ref *ref, const int16_t *capture,
+                      const int16_t *reference, size_t count)
+{
+    unsigned int channels = ref->read_channels;
+    size_t i;
+
+    for (i = 0; i < count; i++, capture += channels, reference += channels) {
+        if (ref->measure_skip > 0) {
+            ref->measure_skip--;
+            continue;
+        }
+        // left channel, or mono: the lag is the same on both
+        ref->measure_capture[ref->measure_fill] = capture[0];
+        ref->measure_ref[ref->measure_fill] = reference[0];
+        if (++ref->measure_fill == ECHO_REF_MEASURE_FRAMES) {
+            echo_ref_correlate(ref);
+            ref->measure_fill = 0;
+            // one window a second keeps it light enough to run in place
+            ref->measure_skip = ref->read_rate > ECHO_REF_MEASURE_FRAMES ?
+                                ref->read_rate - ECHO_REF_MEASURE_FRAMES : 0;
+        }
+    }
+}
+
+void echo_ref_dump(struct echo_ref *ref, int fd)
+{
+    char buffer[512];
+
+    pthread_mutex_lock(&ref->lock);
+    snprintf(buffer, sizeof(buffer),
+             "  echo reference: %u Hz %u ch to %u Hz %u ch, %llu frames written, "
+             "%llu read as silence\n"
+             "    playback: %s, %d ppm, last error %d us, %u resyncs\n"
+             "    capture: %s, %d ppm, last error %d us, %u resyncs\n",
+             ref->write_rate, ref->write_channels, ref->read_rate, ref->read_channels,
+             (unsigned long long)ref->written, (unsigned long long)ref->missing,
+             ref->play.valid ? "running" : "stopped", echo_clock_ppm(&ref->play),
+             (int)(ref->play.error / 1000), ref->play.resyncs,
+             ref->capture.valid ? "running" : "stopped", echo_clock_ppm(&ref->capture),
+             (int)(ref->capture.error / 1000), ref->capture.resyncs);
+    pthread_mutex_unlock(&ref->lock);
+    write(fd, buffer, strlen(buffer));
+
+    if (ref->measures > 0) {
+        snprintf(buffer, sizeof(buffer),
+                 "    measured: capture behind reference by %d us, correlation %.2f, "
+                 "%u windows\n",
+                 (int)((int64_t)ref->measure_lag * 1000000 / ref->read_rate),
+                 ref->measure_peak, ref->measures);
+        write(fd, buffer, strlen(buffer));
+    }
+}
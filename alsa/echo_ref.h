@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMX_ECHO_REF_H
+#define IMX_ECHO_REF_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Echo reference for the AEC, aligned on the time each frame is played
+ * and captured rather than on buffer levels.
+ *
+ * The output gives the time its next frame will be rendered with each
+ * write, the input the time one of its frames was captured. Both come
+ * from pcm time stamps and are smoothed into a clock per side, which
+ * follows the offset and the drift of each card. The written frames are
+ * band limited and brought to the capture rate by the polyphase
+ * resampler at the nominal ratio. A capture frame then gets the
+ * reference played at the same instant, read from that ring at a
+ * fractional position that only follows the drift.
+ *
+ * The reference can be correlated with the capture to measure what is
+ * left of the alignment, with a loopback between the output and the
+ * input. Times are CLOCK_MONOTONIC nanoseconds.
+ */
+
+struct echo_ref;
+
+struct echo_ref *echo_ref_create(unsigned int write_rate, unsigned int write_channels,
+                                 unsigned int read_rate, unsigned int read_channels);
+
+void echo_ref_release(struct echo_ref *ref);
+
+/* queues S16 frames the output is about to play, the first of them
+ * rendered at render_ns, or right after the frames before when it is
+ * negative. */
+void echo_ref_write(struct echo_ref *ref, const int16_t *frames, size_t count,
+                    int64_t render_ns);
+
+/* the output went to standby, its next write starts a new clock. */
+void echo_ref_stop(struct echo_ref *ref);
+
+/* capture frame number frame, counted by the input, was captured at
+ * capture_ns. */
+void echo_ref_set_capture_time(struct echo_ref *ref, uint64_t frame, int64_t capture_ns);
+
+/* fills count frames with the reference heard by capture frames from
+ * frame on, offset_ns later than they were captured. returns how many
+ * were played at that time, the others are silence. */
+size_t echo_ref_read(struct echo_ref *ref, uint64_t frame, int64_t offset_ns,
+                     int16_t *frames, size_t count);
+
+/* correlates capture frames with the reference read for them. About
+ * once a second the lag between them is logged and kept for the dump. */
+void echo_ref_measure(struct echo_ref *ref, const int16_t *capture,
+                      const int16_t *reference, size_t count);
+
+/* prints the clocks and the last measure for the device dump. */
+void echo_ref_dump(struct echo_ref *ref, int fd);
+
+#endif
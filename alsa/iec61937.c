@@ -0,0 +1,367 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "audio_hw_iec61937"
+
+#include <string.h>
+
+#include <cutils/log.h>
+
+#include "iec61937.h"
+
+#define IEC61937_PA             0xF872
+#define IEC61937_PB             0x4E1F
+#define IEC61937_PREAMBLE       8
+/* bytes of a frame needed to find its size */
+#define IEC61937_HEADER         8
+
+#define TYPE_AC3                1
+#define TYPE_PAUSE              3
+#define TYPE_DTS1               11
+#define TYPE_DTS2               12
+#define TYPE_DTS3               13
+#define TYPE_EAC3               21
+
+#define AC3_PERIOD              1536
+#define EAC3_PERIOD             6144
+#define EAC3_BURST_BLOCKS       6
+
+/* kbit/s of the AC3 frmsizecod pairs */
+static const uint16_t ac3_bitrates[19] = {
+    32, 40, 48, 56, 64, 80, 96, 112, 128, 160,
+    192, 224, 256, 320, 384, 448, 512, 576, 640,
+};
+
+static const uint8_t eac3_blocks[4] = { 1, 2, 3, 6 };
+
+struct frame_info {
+    size_t size;
+    unsigned int blocks;        /* E-AC3 audio blocks, 0 for a dependent frame */
+    unsigned int period;
+    uint16_t pc;
+    int swap;
+};
+
+static size_t ac3_frame_size(const uint8_t *h)
+{
+    unsigned int fscod = h[4] >> 6;
+    unsigned int frmsizecod = h[4] & 0x3f;
+    unsigned int bitrate;
+
+    if (fscod == 3 || frmsizecod > 37)
+        return 0;
+
+    bitrate = ac3_bitrates[frmsizecod >> 1];
+    switch (fscod) {
+    case 0:
+        return bitrate * 4;
+    case 1:
+        return (bitrate * 96000 / 44100 + (frmsizecod & 1)) * 2;
+    default:
+        return bitrate * 6;
+    }
+}
+
+/* reads the header at p, returns 0 when p does not start a frame */
+static int iec61937_parse(const struct iec61937 *iec, const uint8_t *p,
+                          struct frame_info *info)
+{
+    uint8_t h[IEC61937_HEADER];
+    unsigned int bsid, strmtyp, fscod, nblks;
+    int le;
+    int i;
+
+    // the stream comes as big endian 16 bit words, or byte swapped
+    if (iec->codec == IEC61937_DTS) {
+        if (p[0] == 0x7f && p[1] == 0xfe && p[2] == 0x80 && p[3] == 0x01)
+            le = 0;
+        else if (p[0] == 0xfe && p[1] == 0x7f && p[2] == 0x01 && p[3] == 0x80)
+            le = 1;
+        else
+            return 0;
+    } else {
+        if (p[0] == 0x0b && p[1] == 0x77)
+            le = 0;
+        else if (p[0] == 0x77 && p[1] == 0x0b)
+            le = 1;
+        else
+            return 0;
+    }
+    for (i = 0; i < IEC61937_HEADER; i++)
+        h[i] = p[le ? i ^ 1 : i];
+    info->swap = !le;
+
+    switch (iec->codec) {
+    case IEC61937_AC3:
+        bsid = h[5] >> 3;
+        if (bsid > 10)
+            return 0;
+        info->size = ac3_frame_size(h);
+        info->blocks = 6;
+        info->period = AC3_PERIOD;
+        info->pc = TYPE_AC3 | ((h[5] & 0x7) << 8);
+        break;
+
+    case IEC61937_EAC3:
+        bsid = h[5] >> 3;
+        info->period = EAC3_PERIOD;
+        info->pc = TYPE_EAC3;
+        if (bsid <= 10) {
+            // an AC3 frame is a 6 block independent frame
+            info->size = ac3_frame_size(h);
+            info->blocks = 6;
+            break;
+        }
+        strmtyp = h[2] >> 6;
+        if (bsid > 16 || strmtyp == 3)
+            return 0;
+        fscod = h[4] >> 6;
+        info->size = ((((h[2] & 0x7) << 8) | h[3]) + 1) * 2;
+        info->blocks = strmtyp == 1 ? 0 :
+                       fscod == 3 ? 6 : eac3_blocks[(h[4] >> 4) & 0x3];
+        break;
+
+    case IEC61937_DTS:
+        nblks = ((h[4] & 0x1) << 6) | (h[5] >> 2);
+        info->size = (((h[5] & 0x3) << 12) | (h[6] << 4) | (h[7] >> 4)) + 1;
+        info->blocks = 0;
+        info->period = (nblks + 1) * 32;
+        switch (info->period) {
+        case 512:
+            info->pc = TYPE_DTS1;
+            break;
+        case 1024:
+            info->pc = TYPE_DTS2;
+            break;
+        case 2048:
+            info->pc = TYPE_DTS3;
+            break;
+        default:
+            return 0;
+        }
+        if (info->size < 96)
+            return 0;
+        break;
+    }
+
+    return info->size >= IEC61937_HEADER;
+}
+
+/* completes the burst holding payload bytes */
+static size_t iec61937_finish(struct iec61937 *iec, size_t payload)
+{
+    uint16_t *w = (uint16_t *)iec->burst;
+    size_t bytes = iec->period * 4;
+    size_t i;
+
+    // Pd counts bytes for E-AC3 and bits for the others
+    w[0] = IEC61937_PA;
+    w[1] = IEC61937_PB;
+    w[2] = iec->pc;
+    w[3] = iec->codec == IEC61937_EAC3 ? payload : payload * 8;
+
+    if (payload & 1)
+        iec->burst[IEC61937_PREAMBLE + payload++] = 0;
+    if (iec->swap) {
+        for (i = IEC61937_PREAMBLE / 2; i < (IEC61937_PREAMBLE + payload) / 2; i++)
+            w[i] = (w[i] << 8) | (w[i] >> 8);
+    }
+    memset(iec->burst + IEC61937_PREAMBLE + payload, 0, bytes - IEC61937_PREAMBLE - payload);
+
+    iec->bursts++;
+    return bytes;
+}
+
+void iec61937_init(struct iec61937 *iec, enum iec61937_codec codec)
+{
+    iec->codec = codec;
+    iec->period = codec == IEC61937_AC3 ? AC3_PERIOD :
+                  codec == IEC61937_EAC3 ? EAC3_PERIOD : 512;
+    iec->synced = 0;
+    iec->bursts = 0;
+    iec->errors = 0;
+    iec61937_reset(iec);
+}
+
+void iec61937_reset(struct iec61937 *iec)
+{
+    iec->fill = 0;
+    iec->frame_start = 0;
+    iec->frame_size = 0;
+    iec->skip = 0;
+    iec->blocks = 0;
+    iec->stashed = 0;
+}
+
+size_t iec61937_feed(struct iec61937 *iec, const void *data, size_t bytes,
+                     const void **burst, size_t *burst_bytes)
+{
+    const uint8_t *src = (const uint8_t *)data;
+    uint8_t *payload = iec->burst + IEC61937_PREAMBLE;
+    size_t used = 0;
+    size_t n;
+    struct frame_info info = { 0 };
+
+    *burst = NULL;
+    *burst_bytes = 0;
+
+    // the header that closed the last E-AC3 burst opens this one
+    if (iec->stashed) {
+        memcpy(payload, iec->header, IEC61937_HEADER);
+        iec->fill = IEC61937_HEADER;
+        iec->stashed = 0;
+    }
+
+    while (used < bytes) {
+        if (iec->skip) {
+            n = bytes - used < iec->skip ? bytes - used : iec->skip;
+            iec->skip -= n;
+            used += n;
+            continue;
+        }
+
+        if (iec->frame_size == 0) {
+            n = iec->frame_start + IEC61937_HEADER - iec->fill;
+            n = bytes - used < n ? bytes - used : n;
+            memcpy(payload + iec->fill, src + used, n);
+            iec->fill += n;
+            used += n;
+            if (iec->fill < iec->frame_start + IEC61937_HEADER)
+                break;
+
+            if (!iec61937_parse(iec, payload + iec->frame_start, &info)) {
+                // slide a byte along to find sync again
+                if (iec->synced) {
+                    ALOGW("iec61937: lost sync after %u bursts", iec->bursts);
+                    iec->errors++;
+                    iec->synced = 0;
+                }
+                memmove(payload + iec->frame_start, payload + iec->frame_start + 1,
+                        IEC61937_HEADER - 1);
+                iec->fill--;
+                continue;
+            }
+            iec->synced = 1;
+
+            // an E-AC3 burst closes on the next independent frame, so the
+            // dependent frames of its last block set stay with it
+            if (iec->codec == IEC61937_EAC3 && info.blocks &&
+                    iec->blocks >= EAC3_BURST_BLOCKS) {
+                memcpy(iec->header, payload + iec->frame_start, IEC61937_HEADER);
+                iec->stashed = 1;
+                *burst_bytes = iec61937_finish(iec, iec->frame_start);
+                *burst = iec->burst;
+                iec->frame_start = 0;
+                iec->frame_size = info.size;
+                iec->blocks = info.blocks;
+                iec->swap = info.swap;
+                return used;
+            }
+
+            if (iec->frame_start + info.size > info.period * 4 - IEC61937_PREAMBLE) {
+                ALOGV("iec61937: %d byte frame does not fit its burst", (int)info.size);
+                iec->errors++;
+                iec->skip = info.size - IEC61937_HEADER;
+                iec->fill = iec->frame_start;
+                continue;
+            }
+
+            iec->frame_size = info.size;
+            iec->period = info.period;
+            iec->pc = info.pc;
+            iec->swap = info.swap;
+            iec->blocks += info.blocks;
+        }
+
+        n = iec->frame_start + iec->frame_size - iec->fill;
+        n = bytes - used < n ? bytes - used : n;
+        memcpy(payload + iec->fill, src + used, n);
+        iec->fill += n;
+        used += n;
+        if (iec->fill < iec->frame_start + iec->frame_size)
+            break;
+
+        iec->frame_size = 0;
+        if (iec->codec == IEC61937_EAC3) {
+            iec->frame_start = iec->fill;
+            continue;
+        }
+
+        *burst_bytes = iec61937_finish(iec, iec->fill);
+        *burst = iec->burst;
+        iec->fill = 0;
+        iec->frame_start = 0;
+        iec->blocks = 0;
+        return used;
+    }
+
+    return used;
+}
+
+size_t iec61937_pause(struct iec61937 *iec, const void **burst)
+{
+    uint16_t *w = (uint16_t *)iec->burst;
+    size_t bytes = iec->period * 4;
+
+    iec61937_reset(iec);
+
+    // the payload is the gap length, in frames of the link
+    memset(iec->burst, 0, bytes);
+    w[0] = IEC61937_PA;
+    w[1] = IEC61937_PB;
+    w[2] = TYPE_PAUSE;
+    w[3] = 32;
+    w[4] = iec->period;
+
+    *burst = iec->burst;
+    return bytes;
+}
+
+size_t iec61937_period_bytes(enum iec61937_codec codec)
+{
+    switch (codec) {
+    case IEC61937_AC3:
+        return AC3_PERIOD * 4;
+    case IEC61937_EAC3:
+        return EAC3_PERIOD * 4;
+    default:
+        return 2048 * 4;
+    }
+}
+
+void iec61937_channel_status(uint8_t *status, unsigned int rate, int non_audio)
+{
+    uint8_t fs;
+
+    switch (rate) {
+    case 22050:  fs = 0x4; break;
+    case 24000:  fs = 0x6; break;
+    case 32000:  fs = 0x3; break;
+    case 44100:  fs = 0x0; break;
+    case 48000:  fs = 0x2; break;
+    case 88200:  fs = 0x8; break;
+    case 96000:  fs = 0xa; break;
+    case 176400: fs = 0xc; break;
+    case 192000: fs = 0xe; break;
+    default:     fs = 0x1; break;   /* not indicated */
+    }
+
+    // consumer format, general category, 16 bit words for linear PCM
+    memset(status, 0, IEC61937_STATUS_BYTES);
+    status[0] = non_audio ? 0x02 : 0x00;
+    status[3] = fs;
+    status[4] = non_audio ? 0x00 : 0x02;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMX_IEC61937_H
+#define IMX_IEC61937_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Packs AC3, E-AC3 and DTS elementary streams into IEC 61937 data
+ * bursts, carried over HDMI or S/PDIF as 2 channel S16_LE frames.
+ *
+ * Every burst starts with the Pa Pb Pc Pd preamble and is padded with
+ * zeros to the repetition period of the codec. AC3 and DTS send one
+ * frame per burst at the coded rate. E-AC3 gathers 6 audio blocks per
+ * burst and must be played at 4 times the coded rate.
+ *
+ * Input may be split anywhere, partial frames are kept until the next
+ * call. Bytes that do not start a frame are skipped until sync is found.
+ */
+
+enum iec61937_codec {
+    IEC61937_AC3,
+    IEC61937_EAC3,
+    IEC61937_DTS,
+};
+
+/* the E-AC3 repetition period, the longest */
+#define IEC61937_MAX_BURST      (6144 * 4)
+/* bytes of IEC 60958 channel status */
+#define IEC61937_STATUS_BYTES   24
+
+struct iec61937 {
+    enum iec61937_codec codec;
+    unsigned int period;        /* IEC 60958 frames of the burst */
+    size_t fill;                /* payload bytes of the burst */
+    size_t frame_start;         /* payload offset of the frame being gathered */
+    size_t frame_size;          /* 0 while looking for its header */
+    size_t skip;                /* bytes of an unusable frame left to drop */
+    unsigned int blocks;        /* E-AC3 audio blocks in the burst */
+    uint16_t pc;                /* burst info, data type and stream info */
+    int swap;                   /* payload is big endian 16 bit words */
+    int synced;
+    int stashed;                /* header holds the start of the next burst */
+    uint8_t header[8];
+    uint32_t bursts;
+    uint32_t errors;
+    uint8_t burst[IEC61937_MAX_BURST];
+};
+
+void iec61937_init(struct iec61937 *iec, enum iec61937_codec codec);
+
+/* drops a partial burst, before restarting the pcm. */
+void iec61937_reset(struct iec61937 *iec);
+
+/* consumes up to bytes of stream data and returns how many were taken.
+ * When a burst is complete it stops and points *burst at it, *burst_bytes
+ * is 0 otherwise. The burst stays valid until the next call. */
+size_t iec61937_feed(struct iec61937 *iec, const void *data, size_t bytes,
+                     const void **burst, size_t *burst_bytes);
+
+/* builds a pause burst of the codec repetition period in place of any
+ * partial burst, for a receiver waiting on data. returns its size. */
+size_t iec61937_pause(struct iec61937 *iec, const void **burst);
+
+/* bytes of one burst, a write size that holds a whole frame. */
+size_t iec61937_period_bytes(enum iec61937_codec codec);
+
+/* consumer channel status for rate, the pcm rate of the link. non_audio
+ * is cleared to hand the link back to linear PCM. */
+void iec61937_channel_status(uint8_t *status, unsigned int rate, int non_audio);
+
+#endif
@@ -0,0 +1,340 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "audio_hw_reader"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <cutils/log.h>
+
+#include "pcm_reader.h"
+
+/* ANDROID_PRIORITY_URGENT_AUDIO, as the pcm writers */
+#define PCM_READER_PRIORITY (-19)
+/* periods of the pcm the ring holds */
+#define PCM_READER_PERIODS 16
+
+struct pcm_reader {
+    struct pcm *pcm;
+    unsigned int rate;
+    size_t frame_size;
+    size_t period;              /* frames of one read */
+
+    uint8_t *ring;
+    uint32_t ring_frames;       /* whole periods, so a read never wraps */
+    uint64_t head;              /* frames captured, under lock */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    pthread_t thread;
+    int wake[2];                /* a pipe, written on close */
+    int exit;                   /* under lock */
+    int error;                  /* of the last failed read, under lock */
+    unsigned int avail;         /* frames in the pcm buffer at stamp */
+    struct timespec stamp;
+    uint32_t errors;
+};
+
+static int pcm_reader_exiting(struct pcm_reader *r)
+{
+    int exit;
+
+    pthread_mutex_lock(&r->lock);
+    exit = r->exit;
+    pthread_mutex_unlock(&r->lock);
+    return exit;
+}
+
+/* waits until a period can be read from the non-blocking pcm, starting it
+ * if it is not running yet or overran. returns -ENODEV once the reader is
+ * closing. */
+static int pcm_reader_wait(struct pcm_reader *r)
+{
+    struct pollfd fds[2];
+    unsigned int avail;
+    struct timespec stamp;
+    int timeout;
+
+    fds[0].fd = r->wake[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = pcm_get_file_descriptor(r->pcm);
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        if (pcm_reader_exiting(r))
+            return -ENODEV;
+
+        switch (pcm_state(r->pcm)) {
+            case PCM_STATE_XRUN:
+                // tinyalsa still takes the pcm as prepared, the stop has
+                // the start below prepare it again
+                pcm_stop(r->pcm);
+                /* fall through */
+            case PCM_STATE_SETUP:
+            case PCM_STATE_PREPARED:
+                if (pcm_start(r->pcm) != 0)
+                    return 0;
+                timeout = -1;
+                break;
+            case PCM_STATE_RUNNING:
+                // the card reports a single frame, the rest of the period
+                // is timed
+                if (pcm_get_htimestamp(r->pcm, &avail, &stamp) != 0)
+                    timeout = -1;
+                else if (avail >= r->period)
+                    return 0;
+                else
+                    timeout = (r->period - avail) * 1000 / r->rate + 1;
+                break;
+            default:
+                // the read fails and recovers the pcm
+                return 0;
+        }
+
+        poll(fds, timeout < 0 ? 2 : 1, timeout);
+    }
+}
+
+static int pcm_reader_pcm_read(struct pcm_reader *r, void *data)
+{
+    size_t bytes = r->period * r->frame_size;
+    int ret;
+
+    ret = pcm_reader_wait(r);
+    if (ret == 0)
+        ret = pcm_read(r->pcm, data, bytes);
+    if (ret != 0) {
+        if (pcm_reader_exiting(r))
+            return ret;
+        // pcm_read restarts an overrun pcm itself and then finds nothing
+        // to read, which leaves it running with the flags of tinyalsa
+        // cleared: start it over
+        pcm_stop(r->pcm);
+        ret = pcm_reader_wait(r);
+        if (ret == 0)
+            ret = pcm_read(r->pcm, data, bytes);
+    }
+
+    return ret;
+}
+
+static void *pcm_reader_thread(void *arg)
+{
+    struct pcm_reader *r = (struct pcm_reader *)arg;
+    unsigned int avail;
+    struct timespec stamp;
+    uint64_t head;
+    int ret;
+
+    setpriority(PRIO_PROCESS, 0, PCM_READER_PRIORITY);
+
+    pthread_mutex_lock(&r->lock);
+    while (!r->exit) {
+        head = r->head;
+        pthread_mutex_unlock(&r->lock);
+
+        // the period at head is only published once it is full, so it
+        // is written without the lock while the clients read older ones
+        ret = pcm_reader_pcm_read(r, r->ring + (head % r->ring_frames) * r->frame_size);
+        if (ret == 0 && pcm_get_htimestamp(r->pcm, &avail, &stamp) != 0)
+            avail = 0;
+
+        pthread_mutex_lock(&r->lock);
+        if (ret == 0) {
+            r->head = head + r->period;
+            r->avail = avail;
+            r->stamp = stamp;
+        } else if (!r->exit) {
+            ALOGV("pcm %p read error %s", r->pcm, pcm_get_error(r->pcm));
+            r->error = ret;
+            r->errors++;
+        }
+        pthread_cond_broadcast(&r->cond);
+
+        if (ret != 0 && !r->exit) {
+            // a card that went away fails at once, do not spin on it
+            pthread_mutex_unlock(&r->lock);
+            usleep(r->period * 1000000 / r->rate);
+            pthread_mutex_lock(&r->lock);
+        }
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    return NULL;
+}
+
+struct pcm_reader *pcm_reader_open(struct pcm *pcm, const struct pcm_config *config)
+{
+    struct pcm_reader *r;
+    int fd;
+
+    if (pcm == NULL || config->period_size == 0 || config->rate == 0)
+        return NULL;
+
+    r = (struct pcm_reader *)calloc(1, sizeof(struct pcm_reader));
+    if (r == NULL)
+        return NULL;
+
+    r->pcm = pcm;
+    r->rate = config->rate;
+    r->frame_size = pcm_frames_to_bytes(pcm, 1);
+    r->period = config->period_size;
+    r->ring_frames = r->period * PCM_READER_PERIODS;
+    r->ring = (uint8_t *)malloc(r->ring_frames * r->frame_size);
+    if (r->ring == NULL) {
+        free(r);
+        return NULL;
+    }
+
+    if (pipe(r->wake) != 0) {
+        ALOGE("pcm reader wake pipe creation failed: %s", strerror(errno));
+        free(r->ring);
+        free(r);
+        return NULL;
+    }
+    fcntl(r->wake[1], F_SETFL, O_NONBLOCK);
+
+    // nothing but the thread reads the pcm from now on
+    fd = pcm_get_file_descriptor(pcm);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+    if (pthread_create(&r->thread, NULL, pcm_reader_thread, r) != 0) {
+        ALOGE("pcm reader thread creation failed: %s", strerror(errno));
+        close(r->wake[0]);
+        close(r->wake[1]);
+        pthread_cond_destroy(&r->cond);
+        pthread_mutex_destroy(&r->lock);
+        free(r->ring);
+        free(r);
+        return NULL;
+    }
+
+    ALOGV("pcm %p reader: %u frames ring", pcm, r->ring_frames);
+    return r;
+}
+
+void pcm_reader_close(struct pcm_reader *r)
+{
+    if (r == NULL)
+        return;
+
+    pthread_mutex_lock(&r->lock);
+    r->exit = 1;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+    // the thread only ever blocks in poll, the pipe gets it out of there
+    // even with a stalled card
+    write(r->wake[1], "x", 1);
+    pthread_join(r->thread, NULL);
+
+    close(r->wake[0]);
+    close(r->wake[1]);
+    pthread_cond_destroy(&r->cond);
+    pthread_mutex_destroy(&r->lock);
+    free(r->ring);
+    free(r);
+}
+
+void pcm_reader_attach(struct pcm_reader *r, struct pcm_reader_client *client)
+{
+    pthread_mutex_lock(&r->lock);
+    client->cursor = r->head;
+    client->lost = 0;
+    client->errors = r->errors;
+    pthread_mutex_unlock(&r->lock);
+}
+
+int pcm_reader_read(struct pcm_reader *r, struct pcm_reader_client *client,
+                    void *frames, size_t count)
+{
+    uint8_t *dst = (uint8_t *)frames;
+    /* the period being captured is not readable */
+    uint64_t window = r->ring_frames - r->period;
+    size_t n, pos;
+
+    pthread_mutex_lock(&r->lock);
+    while (count > 0) {
+        if (client->cursor + window < r->head) {
+            client->lost += r->head - window - client->cursor;
+            client->cursor = r->head - window;
+        }
+        if (client->cursor == r->head) {
+            // each failed read of the pcm is reported once to each client
+            if (client->errors != r->errors || r->exit) {
+                client->errors = r->errors;
+                pthread_mutex_unlock(&r->lock);
+                return r->exit ? -ENODEV : r->error;
+            }
+            pthread_cond_wait(&r->cond, &r->lock);
+            continue;
+        }
+
+        pos = client->cursor % r->ring_frames;
+        n = r->head - client->cursor;
+        if (n > count)
+            n = count;
+        if (n > r->ring_frames - pos)
+            n = r->ring_frames - pos;
+        memcpy(dst, r->ring + pos * r->frame_size, n * r->frame_size);
+        dst += n * r->frame_size;
+        client->cursor += n;
+        count -= n;
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    return 0;
+}
+
+int pcm_reader_get_delay(struct pcm_reader *r, const struct pcm_reader_client *client,
+                         size_t *frames, struct timespec *timestamp)
+{
+    int ret = 0;
+
+    pthread_mutex_lock(&r->lock);
+    if (r->stamp.tv_sec == 0 && r->stamp.tv_nsec == 0) {
+        ret = -ENODATA;
+    } else {
+        *frames = (size_t)(r->head - client->cursor) + r->avail;
+        *timestamp = r->stamp;
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    return ret;
+}
+
+void pcm_reader_dump(struct pcm_reader *r, const struct pcm_reader_client *client, int fd)
+{
+    char buffer[256];
+
+    pthread_mutex_lock(&r->lock);
+    snprintf(buffer, sizeof(buffer),
+             "  reader: ring %u/%u frames, lost %u frames, read errors %u\n",
+             (unsigned int)(r->head - client->cursor), r->ring_frames,
+             client->lost, r->errors);
+    pthread_mutex_unlock(&r->lock);
+    write(fd, buffer, strlen(buffer));
+}
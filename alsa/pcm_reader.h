@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMX_PCM_READER_H
+#define IMX_PCM_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <tinyalsa/asoundlib.h>
+
+/*
+ * Reads a capture pcm from its own thread into a ring, so several input
+ * streams capture from it at once. Each stream reads with its own cursor
+ * and converts, resamples and processes the frames itself.
+ *
+ * The ring keeps the frames in the pcm format. A stream that falls more
+ * than the ring behind loses the oldest frames, the others are not
+ * slowed down by it.
+ */
+
+struct pcm_reader;
+
+/* a stream reading from the ring */
+struct pcm_reader_client {
+    uint64_t cursor;            /* next frame to read */
+    uint32_t lost;              /* frames overwritten before they were read */
+    uint32_t errors;            /* failed reads of the pcm reported */
+};
+
+/* starts the thread reading pcm, which stays owned by the caller and
+ * must outlive the reader. The pcm is made non-blocking and must not be
+ * read by anyone else until the reader is closed. */
+struct pcm_reader *pcm_reader_open(struct pcm *pcm, const struct pcm_config *config);
+
+/* stops and joins the thread without waiting for the card. */
+void pcm_reader_close(struct pcm_reader *reader);
+
+/* the client reads from the frames captured next. */
+void pcm_reader_attach(struct pcm_reader *reader, struct pcm_reader_client *client);
+
+/* waits for count frames and copies them. returns 0, or the error of a
+ * failed read of the pcm, once for each while no frames are left. */
+int pcm_reader_read(struct pcm_reader *reader, struct pcm_reader_client *client,
+                    void *frames, size_t count);
+
+/* frames captured and not read by client yet, the pcm buffer included,
+ * as of the time stamp of the last period read. */
+int pcm_reader_get_delay(struct pcm_reader *reader, const struct pcm_reader_client *client,
+                         size_t *frames, struct timespec *timestamp);
+
+/* prints ring and error counts for a stream dump. */
+void pcm_reader_dump(struct pcm_reader *reader, const struct pcm_reader_client *client,
+                     int fd);
+
+#endif
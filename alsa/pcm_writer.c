@@ -0,0 +1,396 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "audio_hw_writer"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <cutils/atomic.h>
+#include <cutils/log.h>
+
+#include "pcm_writer.h"
+
+/* ANDROID_PRIORITY_URGENT_AUDIO, as the mixer threads feeding us */
+#define PCM_WRITER_PRIORITY (-19)
+/* the fill level is averaged over 2^FILL_AVG_SHIFT chunks */
+#define FILL_AVG_SHIFT 6
+/* ratio correction in ppm per frame of fill error, and per frame of
+ * error accumulated once a second (as a shift) */
+#define DRIFT_KP 2
+#define DRIFT_KI_SHIFT 3
+/* one ppm of a Q32 step */
+#define PPM_STEP 4295
+
+struct pcm_writer {
+    struct pcm *pcm;
+    int flags;
+    unsigned int channels;
+    unsigned int rate;
+    size_t frame_size;
+    unsigned int buffer_size;
+
+    int16_t *ring;
+    uint32_t ring_frames;       /* a power of 2 */
+    volatile int32_t head;      /* frames queued, moved by the stream only */
+    volatile int32_t tail;      /* frames taken, moved by the thread only */
+    int wake[2];                /* a pipe, written on new frames and on close */
+
+    pthread_t thread;
+    volatile int32_t exit;
+
+    size_t target;
+    size_t chunk;
+    int16_t *in;                /* frames taken from the ring */
+    int16_t *out;               /* the same after resampling */
+    int16_t *prev;              /* last frame of the previous chunk */
+    uint64_t phase;             /* Q32 position after prev */
+    uint64_t step;              /* Q32 input frames per output frame */
+
+    int64_t fill_avg;           /* frames << FILL_AVG_SHIFT, card included */
+    int32_t integral;
+    size_t frames_since_adjust;
+    int ppm;
+
+    uint32_t overruns;
+    uint32_t xruns;
+};
+
+/* frames the card takes without blocking, all of them when it is not
+ * running, so a write recovering it is not held back */
+static uint32_t pcm_writer_room(struct pcm_writer *w)
+{
+    unsigned int avail;
+    struct timespec ts;
+
+    if (pcm_get_htimestamp(w->pcm, &avail, &ts) != 0 || avail > w->buffer_size)
+        return w->buffer_size;
+    return avail;
+}
+
+/* sleeps until the stream wakes us, or the timeout in ms. with pcm_events
+ * also until the card is ready for them. */
+static void pcm_writer_wait(struct pcm_writer *w, short pcm_events, int timeout)
+{
+    struct pollfd fds[2];
+    char buf[16];
+
+    fds[0].fd = w->wake[0];
+    fds[0].events = POLLIN;
+    fds[1].fd = pcm_get_file_descriptor(w->pcm);
+    fds[1].events = pcm_events;
+    if (poll(fds, pcm_events ? 2 : 1, timeout) > 0 && (fds[0].revents & POLLIN)) {
+        while (read(w->wake[0], buf, sizeof(buf)) > 0);
+    }
+}
+
+/* frames written to the card and not played yet */
+static uint32_t pcm_writer_queued(struct pcm_writer *w)
+{
+    unsigned int avail;
+    struct timespec ts;
+
+    if (pcm_get_htimestamp(w->pcm, &avail, &ts) != 0 || avail > w->buffer_size)
+        return 0;
+    return w->buffer_size - avail;
+}
+
+/* fill counts the ring and the card, so the loop holds the latency of
+ * the whole path whether the card or the ring takes up the slack */
+static void pcm_writer_track(struct pcm_writer *w, uint32_t fill, size_t frames)
+{
+    int32_t err;
+    int ppm;
+
+    w->fill_avg += (((int64_t)fill << FILL_AVG_SHIFT) - w->fill_avg) >> FILL_AVG_SHIFT;
+    w->frames_since_adjust += frames;
+    if (w->frames_since_adjust < w->rate) {
+        return;
+    }
+    w->frames_since_adjust = 0;
+
+    // filling up means this card plays slower than the stream
+    err = (int32_t)(w->fill_avg >> FILL_AVG_SHIFT) - (int32_t)w->target;
+    w->integral += err;
+    if (w->integral > (PCM_WRITER_MAX_PPM << DRIFT_KI_SHIFT))
+        w->integral = PCM_WRITER_MAX_PPM << DRIFT_KI_SHIFT;
+    else if (w->integral < -(PCM_WRITER_MAX_PPM << DRIFT_KI_SHIFT))
+        w->integral = -(PCM_WRITER_MAX_PPM << DRIFT_KI_SHIFT);
+
+    ppm = err * DRIFT_KP + (w->integral >> DRIFT_KI_SHIFT);
+    if (ppm > PCM_WRITER_MAX_PPM)
+        ppm = PCM_WRITER_MAX_PPM;
+    else if (ppm < -PCM_WRITER_MAX_PPM)
+        ppm = -PCM_WRITER_MAX_PPM;
+
+    if (ppm != w->ppm) {
+        ALOGV("pcm %p fill %d target %d drift %d ppm", w->pcm,
+              (int)(w->fill_avg >> FILL_AVG_SHIFT), (int)w->target, ppm);
+    }
+    w->ppm = ppm;
+    w->step = (1ULL << 32) + (int64_t)ppm * PPM_STEP;
+}
+
+/* linear interpolation, the ratio never leaves 1 +- PCM_WRITER_MAX_PPM */
+static size_t pcm_writer_resample(struct pcm_writer *w, size_t frames)
+{
+    unsigned int channels = w->channels;
+    size_t count = 0;
+    unsigned int c;
+
+    while ((w->phase >> 32) < frames) {
+        size_t i = w->phase >> 32;
+        int32_t frac = (w->phase >> 17) & 0x7fff;
+        const int16_t *a = i == 0 ? w->prev : w->in + (i - 1) * channels;
+        const int16_t *b = w->in + i * channels;
+        int16_t *d = w->out + count * channels;
+
+        for (c = 0; c < channels; c++) {
+            d[c] = a[c] + ((((int32_t)b[c] - a[c]) * frac) >> 15);
+        }
+        count++;
+        w->phase += w->step;
+    }
+    w->phase -= (uint64_t)frames << 32;
+    memcpy(w->prev, w->in + (frames - 1) * channels, w->frame_size);
+
+    return count;
+}
+
+static int pcm_writer_pcm_write(struct pcm_writer *w, size_t frames)
+{
+    size_t bytes = frames * w->frame_size;
+    int ret;
+
+    if (w->flags & PCM_MMAP)
+        ret = pcm_mmap_write(w->pcm, w->out, bytes);
+    else
+        ret = pcm_write(w->pcm, w->out, bytes);
+
+    if (ret != 0) {
+        // a closing writer leaves the card as it is
+        if (android_atomic_acquire_load(&w->exit))
+            return ret;
+        w->xruns++;
+        switch (pcm_state(w->pcm)) {
+            case PCM_STATE_SETUP:
+            case PCM_STATE_XRUN:
+                ret = pcm_prepare(w->pcm);
+                if (ret != 0)
+                    return ret;
+                break;
+            default:
+                return ret;
+        }
+
+        if (w->flags & PCM_MMAP)
+            ret = pcm_mmap_write(w->pcm, w->out, bytes);
+        else
+            ret = pcm_write(w->pcm, w->out, bytes);
+    }
+
+    return ret;
+}
+
+static void *pcm_writer_thread(void *arg)
+{
+    struct pcm_writer *w = (struct pcm_writer *)arg;
+    int started = 0;
+
+    setpriority(PRIO_PROCESS, 0, PCM_WRITER_PRIORITY);
+
+    while (!android_atomic_acquire_load(&w->exit)) {
+        int32_t tail = w->tail;
+        uint32_t fill = (uint32_t)(android_atomic_acquire_load(&w->head) - tail);
+        size_t frames, pos, first;
+
+        // the first write waits for the target, so the card starts with
+        // the latency the drift loop then holds
+        if (fill == 0 || (!started && fill < w->target)) {
+            pcm_writer_wait(w, 0, -1);
+            continue;
+        }
+        started = 1;
+
+        frames = fill < w->chunk ? fill : w->chunk;
+        pos = tail & (w->ring_frames - 1);
+        first = w->ring_frames - pos < frames ? w->ring_frames - pos : frames;
+        memcpy(w->in, w->ring + pos * w->channels, first * w->frame_size);
+        memcpy(w->in + first * w->channels, w->ring, (frames - first) * w->frame_size);
+        android_atomic_release_store(tail + (int32_t)frames, &w->tail);
+
+        pcm_writer_track(w, fill + pcm_writer_queued(w), frames);
+        frames = pcm_writer_resample(w, frames);
+
+        // the pcm is non-blocking, a write only goes out once the card has
+        // room for all of it. it reports room for a single frame, so that
+        // is only waited for on a full card and the rest is timed.
+        while (!android_atomic_acquire_load(&w->exit)) {
+            uint32_t room = pcm_writer_room(w);
+
+            if (room >= frames)
+                break;
+            if (room == 0)
+                pcm_writer_wait(w, POLLOUT, -1);
+            else
+                pcm_writer_wait(w, 0, (frames - room) * 1000 / w->rate + 1);
+        }
+        if (android_atomic_acquire_load(&w->exit))
+            break;
+
+        if (frames > 0 && pcm_writer_pcm_write(w, frames) != 0) {
+            ALOGV("pcm %p write error %s", w->pcm, pcm_get_error(w->pcm));
+            usleep(frames * 1000000 / w->rate);
+        }
+    }
+
+    return NULL;
+}
+
+struct pcm_writer *pcm_writer_open(struct pcm *pcm, int flags,
+                                   unsigned int channels, unsigned int rate,
+                                   size_t target_frames)
+{
+    struct pcm_writer *w;
+    size_t out_frames;
+    int fd;
+
+    if (pcm == NULL || channels == 0 || rate == 0 || target_frames == 0)
+        return NULL;
+
+    w = (struct pcm_writer *)calloc(1, sizeof(struct pcm_writer));
+    if (w == NULL)
+        return NULL;
+
+    w->pcm = pcm;
+    w->flags = flags;
+    w->channels = channels;
+    w->rate = rate;
+    w->frame_size = channels * sizeof(int16_t);
+    w->buffer_size = pcm_get_buffer_size(pcm);
+    w->target = target_frames;
+    w->chunk = (target_frames + 1) / 2;
+    w->step = 1ULL << 32;
+    w->fill_avg = (int64_t)target_frames << FILL_AVG_SHIFT;
+
+    w->ring_frames = 1;
+    while (w->ring_frames < target_frames * 4)
+        w->ring_frames <<= 1;
+
+    // a chunk grows by at most PCM_WRITER_MAX_PPM plus the carried frame
+    out_frames = w->chunk + w->chunk / 512 + 2;
+    w->ring = (int16_t *)malloc(w->ring_frames * w->frame_size);
+    w->in = (int16_t *)malloc(w->chunk * w->frame_size);
+    w->out = (int16_t *)malloc(out_frames * w->frame_size);
+    w->prev = (int16_t *)calloc(1, w->frame_size);
+    if (w->ring == NULL || w->in == NULL || w->out == NULL || w->prev == NULL)
+        goto err_free;
+
+    if (pipe(w->wake) != 0) {
+        ALOGE("pcm writer wake pipe creation failed: %s", strerror(errno));
+        goto err_free;
+    }
+    fcntl(w->wake[0], F_SETFL, O_NONBLOCK);
+    fcntl(w->wake[1], F_SETFL, O_NONBLOCK);
+
+    // nothing but the thread writes to the pcm from now on
+    fd = pcm_get_file_descriptor(pcm);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    if (pthread_create(&w->thread, NULL, pcm_writer_thread, w) != 0) {
+        ALOGE("pcm writer thread creation failed: %s", strerror(errno));
+        close(w->wake[0]);
+        close(w->wake[1]);
+        goto err_free;
+    }
+
+    ALOGV("pcm %p writer: %u frames ring, target %d", pcm, w->ring_frames, (int)target_frames);
+    return w;
+
+err_free:
+    free(w->ring);
+    free(w->in);
+    free(w->out);
+    free(w->prev);
+    free(w);
+    return NULL;
+}
+
+void pcm_writer_close(struct pcm_writer *w)
+{
+    if (w == NULL)
+        return;
+
+    // the thread only ever blocks in poll, the pipe gets it out of there
+    // even with a stalled card
+    android_atomic_release_store(1, &w->exit);
+    write(w->wake[1], "x", 1);
+    pthread_join(w->thread, NULL);
+
+    close(w->wake[0]);
+    close(w->wake[1]);
+    free(w->ring);
+    free(w->in);
+    free(w->out);
+    free(w->prev);
+    free(w);
+}
+
+size_t pcm_writer_write(struct pcm_writer *w, const void *frames, size_t count)
+{
+    int32_t head = w->head;
+    uint32_t room = w->ring_frames -
+            (uint32_t)(head - android_atomic_acquire_load(&w->tail));
+    size_t pos, first;
+
+    if (count > room) {
+        w->overruns++;
+        count = room;
+    }
+
+    pos = head & (w->ring_frames - 1);
+    first = w->ring_frames - pos < count ? w->ring_frames - pos : count;
+    memcpy(w->ring + pos * w->channels, frames, first * w->frame_size);
+    memcpy(w->ring, (const int16_t *)frames + first * w->channels,
+           (count - first) * w->frame_size);
+    android_atomic_release_store(head + (int32_t)count, &w->head);
+    // a full pipe already has the thread awake
+    write(w->wake[1], "x", 1);
+
+    return count;
+}
+
+void pcm_writer_dump(struct pcm_writer *w, int fd)
+{
+    char buffer[256];
+    uint32_t fill = (uint32_t)(android_atomic_acquire_load(&w->head) -
+                               android_atomic_acquire_load(&w->tail));
+
+    snprintf(buffer, sizeof(buffer),
+             "  writer: ring %u frames, average %d/%u frames, drift %d ppm, overruns %u, xruns %u\n",
+             fill, (int)(w->fill_avg >> FILL_AVG_SHIFT), (unsigned int)w->target,
+             w->ppm, w->overruns, w->xruns);
+    write(fd, buffer, strlen(buffer));
+}
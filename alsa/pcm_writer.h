@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMX_PCM_WRITER_H
+#define IMX_PCM_WRITER_H
+
+#include <stddef.h>
+#include <tinyalsa/asoundlib.h>
+
+/*
+ * Plays S16 frames on a secondary pcm from its own thread, so a slow or
+ * stalled card never delays the pcm clocking the stream. The stream
+ * hands frames over through a single producer, single consumer ring
+ * that takes no lock.
+ *
+ * The two cards run from different clocks. The writer keeps the frames
+ * queued in the ring and the card around a target by resampling with a
+ * ratio that follows their level slowly, within PCM_WRITER_MAX_PPM of 1.
+ */
+#define PCM_WRITER_MAX_PPM 1000
+
+struct pcm_writer;
+
+/* starts the thread writing to pcm, which stays owned by the caller and
+ * must outlive the writer. The pcm is made non-blocking and must not be
+ * written by anyone else until the writer is closed. target_frames is the latency kept between
+ * the stream and the card, ring and pcm buffer together. It should cover
+ * a write of the stream and a period of pcm. */
+struct pcm_writer *pcm_writer_open(struct pcm *pcm, int flags,
+                                   unsigned int channels, unsigned int rate,
+                                   size_t target_frames);
+
+/* stops and joins the thread without waiting for the card, queued
+ * frames are dropped. */
+void pcm_writer_close(struct pcm_writer *writer);
+
+/* queues frames without blocking, frames that do not fit are dropped
+ * and counted as overruns. returns the number of frames queued. */
+size_t pcm_writer_write(struct pcm_writer *writer, const void *frames,
+                        size_t count);
+
+/* prints fill, drift and error counts for a stream dump. */
+void pcm_writer_dump(struct pcm_writer *writer, int fd);
+
+#endif
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The tinyalsa HAL in the harness, on the cards of audio_card_list as a
+ * udoo board has them: the codec as card 0, which also captures, then
+ * HDMI and S/PDIF. Each card gets the mixer controls its config_*.h
+ * routes set, HDMI the capabilities its EDID would give, and both
+ * digital cards their channel status control.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include <hardware/audio.h>
+#include <hardware/audio_effect.h>
+#include <system/audio.h>
+#include <tinyalsa/asoundlib.h>
+#include <audio_utils/resampler.h>
+
+#include "audio_hardware.h"
+#include "audio_hal_harness.h"
+#include "mixer_fake.h"
+#include "pcm_fake.h"
+
+/* audio_card_list of tinyalsa_hal.c, the null card last */
+#define HARNESS_CARDS 4
+
+extern struct audio_card *audio_card_list[HARNESS_CARDS];
+
+struct harness_card {
+    const char *driver;
+    unsigned int out_rate;
+    unsigned int in_rate;
+    unsigned int in_channels;
+};
+
+static const struct harness_card sCards[] = {
+    { "vt1613-audio", 44100, 44100, 2 },
+    { "imx-hdmi-soc", 48000, 0, 0 },
+    { "imx-spdif", 48000, 0, 0 },
+};
+
+static const int sHdmiChannels[] = { 2, 6, 8 };
+static const int sHdmiRates[] = { 32000, 44100, 48000, 88200, 96000, 176400, 192000 };
+
+const char harness_fixtures[] = "alsa/tests";
+
+/* one output of each type opens at a time */
+const char *const harness_neighbours[] = { "deep buffer", "primary", NULL };
+
+const char *const harness_properties[][2] = {
+    { "ro.product.device", "udoo" },
+    { NULL, NULL },
+};
+
+const struct harness_stream harness_outputs[] = {
+    { "primary", AUDIO_DEVICE_OUT_SPEAKER, AUDIO_OUTPUT_FLAG_PRIMARY,
+      AUDIO_FORMAT_PCM_16_BIT, AUDIO_CHANNEL_OUT_STEREO, 48000,
+      { AUDIO_DEVICE_OUT_SPEAKER, AUDIO_DEVICE_OUT_SPEAKER | AUDIO_DEVICE_OUT_WIRED_HEADPHONE },
+      NULL },
+    { "fast", AUDIO_DEVICE_OUT_SPEAKER, AUDIO_OUTPUT_FLAG_FAST,
+      AUDIO_FORMAT_PCM_16_BIT, AUDIO_CHANNEL_OUT_STEREO, 48000,
+      { AUDIO_DEVICE_OUT_SPEAKER, AUDIO_DEVICE_OUT_SPEAKER | AUDIO_DEVICE_OUT_WIRED_HEADPHONE },
+      NULL },
+    { "deep buffer", AUDIO_DEVICE_OUT_SPEAKER, AUDIO_OUTPUT_FLAG_DEEP_BUFFER,
+      AUDIO_FORMAT_PCM_16_BIT, AUDIO_CHANNEL_OUT_STEREO, 48000,
+      { AUDIO_DEVICE_OUT_SPEAKER, AUDIO_DEVICE_OUT_SPEAKER | AUDIO_DEVICE_OUT_WIRED_HEADPHONE },
+      NULL },
+    { "hdmi 5.1", AUDIO_DEVICE_OUT_AUX_DIGITAL, AUDIO_OUTPUT_FLAG_DIRECT,
+      AUDIO_FORMAT_PCM_16_BIT, AUDIO_CHANNEL_OUT_5POINT1, 48000,
+      { AUDIO_DEVICE_OUT_AUX_DIGITAL, AUDIO_DEVICE_OUT_AUX_DIGITAL | AUDIO_DEVICE_OUT_SPEAKER },
+      NULL },
+    { "esai 5.1", AUDIO_DEVICE_OUT_SPEAKER, AUDIO_OUTPUT_FLAG_DIRECT,
+      AUDIO_FORMAT_PCM_16_BIT, AUDIO_CHANNEL_OUT_5POINT1, 48000,
+      { AUDIO_DEVICE_OUT_SPEAKER, AUDIO_DEVICE_OUT_SPEAKER | AUDIO_DEVICE_OUT_WIRED_HEADPHONE },
+      NULL },
+    { "iec61937 ac3", AUDIO_DEVICE_OUT_AUX_DIGITAL, AUDIO_OUTPUT_FLAG_DIRECT,
+      AUDIO_FORMAT_AC3, AUDIO_CHANNEL_OUT_STEREO, 48000,
+      { AUDIO_DEVICE_OUT_AUX_DIGITAL, AUDIO_DEVICE_OUT_AUX_DIGITAL | AUDIO_DEVICE_OUT_SPEAKER },
+      "iec61937/ac3_48k_384k.es" },
+    { NULL },
+};
+
+const struct harness_stream harness_inputs[] = {
+    { "mic", AUDIO_DEVICE_IN_BUILTIN_MIC, AUDIO_OUTPUT_FLAG_NONE,
+      AUDIO_FORMAT_PCM_16_BIT, AUDIO_CHANNEL_IN_STEREO, 48000,
+      { AUDIO_DEVICE_IN_BUILTIN_MIC, AUDIO_DEVICE_IN_WIRED_HEADSET },
+      NULL, 500 },
+    { NULL },
+};
+
+struct harness_ctl {
+    const char *name;
+    int is_enum;
+    char enums[128];
+};
+
+/* every control the routes of card set, an enum with "Off" and the
+ * strings they set or an integer */
+static unsigned int collect_ctls(const struct audio_card *card, struct harness_ctl *ctls,
+                                 unsigned int max)
+{
+    struct route_setting *routes[] = {
+        card->defaults, card->bt_output, card->speaker_output, card->hs_output,
+        card->earpiece_output, card->vx_hs_mic_input, card->mm_main_mic_input,
+        card->vx_main_mic_input, card->mm_hs_mic_input, card->vx_bt_mic_input,
+        card->mm_bt_mic_input,
+    };
+    unsigned int count = 0, i, j;
+    struct route_setting *r;
+
+    for (i = 0; i < sizeof(routes) / sizeof(routes[0]); i++) {
+        for (r = routes[i]; r && r->ctl_name; r++) {
+            for (j = 0; j < count && strcmp(ctls[j].name, r->ctl_name); j++);
+            if (j == count) {
+                if (count == max)
+                    return count;
+                ctls[count].name = r->ctl_name;
+                ctls[count].is_enum = r->strval != NULL;
+                strcpy(ctls[count].enums, "Off");
+                count++;
+            }
+            if (r->strval && strcmp(r->strval, "Off")) {
+                strcat(ctls[j].enums, ",");
+                strncat(ctls[j].enums, r->strval,
+                        sizeof(ctls[j].enums) - strlen(ctls[j].enums) - 1);
+            }
+        }
+    }
+    return count;
+}
+
+int harness_setup(const char *dir)
+{
+    struct harness_ctl ctls[64];
+    static const int zero[2];
+    unsigned int card, i, j, count;
+    int ret;
+
+    mixer_fake_clear();
+    pcm_fake_clear();
+    for (card = 0; card < sizeof(sCards) / sizeof(sCards[0]); card++) {
+        const struct harness_card *c = &sCards[card];
+        const struct audio_card *config = NULL;
+
+        for (i = 0; i < HARNESS_CARDS; i++) {
+            if (!strcmp(audio_card_list[i]->driver_name, c->driver))
+                config = audio_card_list[i];
+        }
+        if (config == NULL)
+            return -1;
+
+        ret = pcm_fake_add_card(card, c->driver, c->driver, config->name,
+                                c->out_rate, c->in_rate, c->in_channels);
+        if (ret != 0)
+            return ret;
+
+        count = collect_ctls(config, ctls, sizeof(ctls) / sizeof(ctls[0]));
+        for (j = 0; j < count; j++) {
+            if (ctls[j].is_enum)
+                ret = mixer_fake_add(card, MIXER_CTL_TYPE_ENUM, ctls[j].name, 1, zero,
+                                     ctls[j].enums);
+            else
+                ret = mixer_fake_add(card, MIXER_CTL_TYPE_INT, ctls[j].name, 2, zero, NULL);
+            if (ret != 0)
+                return ret;
+        }
+
+        if (!strcmp(c->driver, "imx-hdmi-soc")) {
+            mixer_fake_add(card, MIXER_CTL_TYPE_INT, "HDMI Support Channels",
+                           sizeof(sHdmiChannels) / sizeof(sHdmiChannels[0]), sHdmiChannels,
+                           NULL);
+            mixer_fake_add(card, MIXER_CTL_TYPE_INT, "HDMI Support Rates",
+                           sizeof(sHdmiRates) / sizeof(sHdmiRates[0]), sHdmiRates, NULL);
+        }
+        if (c->in_rate == 0)
+            mixer_fake_add(card, MIXER_CTL_TYPE_IEC958, "IEC958 Playback Default", 1, zero,
+                           NULL);
+    }
+    return 0;
+}
+
+void harness_teardown(void)
+{
+}
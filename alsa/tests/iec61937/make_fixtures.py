@@ -0,0 +1,178 @@
+#!/usr/bin/env python
+#
+# Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Writes the elementary streams iec61937_test feeds and the IEC 61937
+# bursts a receiver has to see for them, framed after IEC 61937-1/-3/-5
+# and not after alsa/iec61937.c. The frames carry valid headers around
+# noise, the packer never looks past the header. Run it from this
+# directory and commit what it writes along with any change to it.
+
+import struct
+
+PA, PB = 0xF872, 0x4E1F
+
+seed = [1]
+
+
+def noise(n):
+    # no byte pair of the noise may look like a sync word
+    out = bytearray()
+    while len(out) < n:
+        seed[0] = (seed[0] * 1103515245 + 12345) & 0xffffffff
+        b = (seed[0] >> 16) & 0xff
+        if b in (0x0b, 0x77, 0x7f, 0xfe, 0x80, 0x01):
+            continue
+        out.append(b)
+    return bytes(out)
+
+
+def swap16(data):
+    data = bytearray(data)
+    if len(data) & 1:
+        data.append(0)
+    for i in range(0, len(data), 2):
+        data[i], data[i + 1] = data[i + 1], data[i]
+    return bytes(data)
+
+
+def burst(pc, pd, payload, period):
+    # the link carries S16_LE words of the big endian stream, whichever
+    # byte order it came in
+    data = struct.pack('<4H', PA, PB, pc, pd) + swap16(payload)
+    assert len(data) <= period * 4
+    return data + b'\0' * (period * 4 - len(data))
+
+
+# AC3, ATSC A/52 5.4.1
+
+AC3_KBPS = [32, 40, 48, 56, 64, 80, 96, 112, 128, 160,
+            192, 224, 256, 320, 384, 448, 512, 576, 640]
+
+
+def ac3_size(fscod, frmsizecod):
+    kbps = AC3_KBPS[frmsizecod >> 1]
+    if fscod == 0:
+        return kbps * 4
+    if fscod == 1:
+        return (kbps * 96000 // 44100 + (frmsizecod & 1)) * 2
+    return kbps * 6
+
+
+def ac3_frame(fscod, frmsizecod, bsmod, bsid=8):
+    size = ac3_size(fscod, frmsizecod)
+    head = bytes([0x0b, 0x77]) + noise(2) + bytes([
+        (fscod << 6) | frmsizecod, (bsid << 3) | bsmod])
+    return head + noise(size - len(head)), bsmod
+
+
+def ac3_bursts(frames):
+    return b''.join(burst(1 | (bsmod << 8), len(f) * 8, f, 1536)
+                    for f, bsmod in frames)
+
+
+# E-AC3, ATSC A/52 E.1.2, grouped 6 audio blocks to a burst (IEC 61937-3)
+
+def eac3_frame(strmtyp, numblkscod, size):
+    words = size // 2 - 1
+    head = bytes([0x0b, 0x77, (strmtyp << 6) | (words >> 8), words & 0xff,
+                  (numblkscod << 4) | (2 << 1), 16 << 3])
+    blocks = 0 if strmtyp == 1 else [1, 2, 3, 6][numblkscod]
+    return head + noise(size - len(head)), blocks
+
+
+def eac3_bursts(frames):
+    # a burst closes when an independent frame arrives with 6 blocks
+    # gathered, the frames after the last complete burst stay pending
+    out, cur, blocks = b'', b'', 0
+    for f, n in frames:
+        if n and blocks >= 6:
+            out += burst(21, len(cur), cur, 6144)
+            cur, blocks = b'', 0
+        cur += f
+        blocks += n
+    return out
+
+
+# DTS core, ETSI TS 102 114 5.3
+
+def dts_frame(nblks, size):
+    fsize = size - 1
+    head = bytes([0x7f, 0xfe, 0x80, 0x01,
+                  0x80 | (31 << 2) | (nblks >> 6),
+                  ((nblks & 0x3f) << 2) | (fsize >> 12),
+                  (fsize >> 4) & 0xff,
+                  ((fsize & 0xf) << 4) | 0x9])
+    return head + noise(size - len(head)), nblks
+
+
+def dts_bursts(frames):
+    out = b''
+    for f, nblks in frames:
+        period = (nblks + 1) * 32
+        if len(f) > period * 4 - 8:
+            continue
+        pc = {512: 11, 1024: 12, 2048: 13}[period]
+        out += burst(pc, len(f) * 8, f, period)
+    return out
+
+
+def write(name, data):
+    with open(name, 'wb') as f:
+        f.write(data)
+
+
+# 48 kHz, big endian, one bsmod change, an odd run of noise between the
+# last two frames
+frames = [ac3_frame(0, 2, 0), ac3_frame(0, 2, 0), ac3_frame(0, 2, 2)]
+write('ac3_48k.es', frames[0][0] + frames[1][0] + noise(5) + frames[2][0])
+write('ac3_48k.spdif', ac3_bursts(frames))
+
+# 44.1 kHz odd frmsizecod pads a word, byte swapped input, noise before
+# sync and between the first two frames, whole words as a swapped stream
+# has them
+frames = [ac3_frame(1, 3, 0), ac3_frame(1, 3, 0), ac3_frame(1, 3, 0)]
+stream = noise(38) + frames[0][0] + noise(12) + frames[1][0] + frames[2][0]
+write('ac3_44k_swapped.es', swap16(stream))
+write('ac3_44k_swapped.spdif', ac3_bursts(frames))
+
+# 2 block independent frames with a dependent frame each, then an AC3
+# frame standing for 6 blocks on its own
+frames = []
+for i in range(3):
+    frames += [eac3_frame(0, 1, 200), eac3_frame(1, 1, 60)]
+frames += [(ac3_frame(0, 4, 0, bsid=6)[0], 6)]
+frames += [eac3_frame(0, 1, 200), eac3_frame(1, 1, 60)]
+write('eac3.es', b''.join(f for f, _ in frames))
+write('eac3.spdif', eac3_bursts(frames))
+
+# 512 and 1024 sample frames, and a frame too big for its burst
+frames = [dts_frame(15, 1006), dts_frame(15, 2045), dts_frame(15, 1006),
+          dts_frame(31, 1500)]
+write('dts.es', b''.join(f for f, _ in frames))
+write('dts.spdif', dts_bursts(frames))
+
+frames = [dts_frame(15, 1006), dts_frame(15, 1006)]
+write('dts_swapped.es', swap16(b''.join(f for f, _ in frames)))
+write('dts_swapped.spdif', dts_bursts(frames))
+
+# pause bursts carry the gap, one repetition period of the codec
+write('pause_ac3.spdif', burst(3, 32, struct.pack('>H', 1536), 1536))
+write('pause_dts.spdif', burst(3, 32, struct.pack('>H', 512), 512))
+
+# what audio_hal_harness loops on the IEC 61937 output, whole frames at
+# 384 kbps so that a write of a burst worth of bytes holds four of them
+frames = [ac3_frame(0, 28, 0) for i in range(4)]
+write('ac3_48k_384k.es', b''.join(f for f, _ in frames))
@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The IEC 61937 packer against the reference bursts in tests/iec61937,
+ * byte for byte. Each stream is fed whole, a byte at a time, in random
+ * pieces and again after a reset half way through, and must give the
+ * same bursts every time. The cases are listed in tests/iec61937/cases.txt.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iec61937.h"
+#include "imx_test.h"
+
+static char sDir[PATH_MAX];
+static struct iec61937 sIec;
+
+static uint32_t sSeed;
+
+static uint32_t test_random(void)
+{
+    sSeed = sSeed * 1103515245 + 12345;
+    return (sSeed >> 16) | (sSeed << 16);
+}
+
+static uint8_t *test_load(const char *name, size_t *bytes)
+{
+    return (uint8_t *)imx_test_load(sDir, name, bytes);
+}
+
+static int test_codec(const char *name, enum iec61937_codec *codec)
+{
+    if (!strcmp(name, "ac3"))
+        *codec = IEC61937_AC3;
+    else if (!strcmp(name, "eac3"))
+        *codec = IEC61937_EAC3;
+    else if (!strcmp(name, "dts"))
+        *codec = IEC61937_DTS;
+    else
+        return -1;
+    return 0;
+}
+
+/* feeds the stream in pieces of at most piece bytes, random sizes if
+ * random is set, and compares what comes out with the reference. returns
+ * the reference bytes matched. */
+static size_t test_feed_pieces(const char *name, const uint8_t *stream, size_t bytes,
+                             const uint8_t *ref, size_t ref_bytes,
+                             size_t piece, int random, const char *how)
+{
+    size_t pos = 0, out = 0;
+    int bursts = 0;
+
+    while (pos < bytes) {
+        size_t n = random ? 1 + test_random() % piece : piece;
+        const void *burst;
+        size_t burst_bytes, used;
+
+        if (n > bytes - pos)
+            n = bytes - pos;
+        used = iec61937_feed(&sIec, stream + pos, n, &burst, &burst_bytes);
+        CHECK(used <= n, "%s %s: took %zu of %zu bytes", name, how, used, n);
+        if (used == 0 && burst_bytes == 0) {
+            CHECK(0, "%s %s: stuck at byte %zu", name, how, pos);
+            return out;
+        }
+        pos += used;
+        if (burst_bytes == 0)
+            continue;
+
+        CHECK(burst_bytes == iec61937_period_bytes(sIec.codec) ||
+              sIec.codec == IEC61937_DTS,
+              "%s %s: %zu byte burst", name, how, burst_bytes);
+        if (out + burst_bytes > ref_bytes) {
+            CHECK(0, "%s %s: burst %d is past the %zu reference bytes", name, how,
+                  bursts, ref_bytes);
+            return out;
+        }
+        if (memcmp(burst, ref + out, burst_bytes)) {
+            size_t i = 0;
+            while (((const uint8_t *)burst)[i] == ref[out + i])
+                i++;
+            CHECK(0, "%s %s: burst %d differs at byte %zu, %02x against %02x", name, how,
+                  bursts, i, ((const uint8_t *)burst)[i], ref[out + i]);
+            return out;
+        }
+        out += burst_bytes;
+        bursts++;
+    }
+    return out;
+}
+
+static void test_feed_all(const char *name, const uint8_t *stream, size_t bytes,
+                          const uint8_t *ref, size_t ref_bytes,
+                          size_t piece, int random, const char *how)
+{
+    size_t out = test_feed_pieces(name, stream, bytes, ref, ref_bytes, piece, random, how);
+
+    CHECK(out == ref_bytes, "%s %s: %zu of the %zu reference bytes", name, how, out,
+          ref_bytes);
+}
+
+static void test_feed(const char *codec_name, const char *stream_name,
+                      const char *ref_name, unsigned int errors)
+{
+    enum iec61937_codec codec;
+    uint8_t *stream, *ref;
+    size_t bytes, ref_bytes;
+
+    if (test_codec(codec_name, &codec) < 0) {
+        CHECK(0, "%s: unknown codec %s", stream_name, codec_name);
+        return;
+    }
+    stream = test_load(stream_name, &bytes);
+    ref = test_load(ref_name, &ref_bytes);
+    if (stream == NULL || ref == NULL)
+        goto out;
+
+    iec61937_init(&sIec, codec);
+    test_feed_all(stream_name, stream, bytes, ref, ref_bytes, bytes, 0, "whole");
+    CHECK(sIec.errors == errors, "%s: %u errors, expected %u", stream_name,
+          sIec.errors, errors);
+
+    iec61937_init(&sIec, codec);
+    test_feed_all(stream_name, stream, bytes, ref, ref_bytes, 1, 0, "bytewise");
+    CHECK(sIec.errors == errors, "%s bytewise: %u errors, expected %u", stream_name,
+          sIec.errors, errors);
+
+    sSeed = 1;
+    iec61937_init(&sIec, codec);
+    test_feed_all(stream_name, stream, bytes, ref, ref_bytes, 97, 1, "pieces");
+    CHECK(sIec.errors == errors, "%s pieces: %u errors, expected %u", stream_name,
+          sIec.errors, errors);
+
+    // whatever was gathered of a frame or burst goes with a reset
+    iec61937_init(&sIec, codec);
+    test_feed_pieces(stream_name, stream, bytes / 2, ref, ref_bytes, 61, 0, "half");
+    iec61937_reset(&sIec);
+    test_feed_all(stream_name, stream, bytes, ref, ref_bytes, 61, 0, "reset");
+
+out:
+    free(stream);
+    free(ref);
+}
+
+static void test_pause(const char *codec_name, const char *ref_name)
+{
+    enum iec61937_codec codec;
+    const void *burst;
+    uint8_t *ref;
+    size_t bytes, ref_bytes;
+
+    if (test_codec(codec_name, &codec) < 0) {
+        CHECK(0, "%s: unknown codec %s", ref_name, codec_name);
+        return;
+    }
+    ref = test_load(ref_name, &ref_bytes);
+    if (ref == NULL)
+        return;
+
+    iec61937_init(&sIec, codec);
+    bytes = iec61937_pause(&sIec, &burst);
+    CHECK(bytes == ref_bytes && !memcmp(burst, ref, bytes),
+          "%s: %zu byte pause burst differs from the %zu reference bytes", ref_name,
+          bytes, ref_bytes);
+    free(ref);
+}
+
+static void test_status(unsigned int rate, int non_audio, const unsigned int *want)
+{
+    uint8_t status[IEC61937_STATUS_BYTES];
+    int i;
+
+    memset(status, 0xa5, sizeof(status));
+    iec61937_channel_status(status, rate, non_audio);
+    for (i = 0; i < IEC61937_STATUS_BYTES; i++) {
+        unsigned int w = i < 5 ? want[i] : 0;
+        CHECK(status[i] == w, "status %u %d: byte %d is %02x, expected %02x", rate,
+              non_audio, i, status[i], w);
+    }
+}
+
+static int test_run_cases(void)
+{
+    char path[PATH_MAX];
+    char line[256];
+    int cases = 0;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/cases.txt", sDir);
+    f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char codec[16], a[64], b[64];
+        unsigned int errors, rate, want[5];
+        int non_audio;
+
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if (sscanf(line, "feed %15s %63s %63s %u", codec, a, b, &errors) == 4)
+            test_feed(codec, a, b, errors);
+        else if (sscanf(line, "pause %15s %63s", codec, a) == 2)
+            test_pause(codec, a);
+        else if (sscanf(line, "status %u %d %x %x %x %x %x", &rate, &non_audio, &want[0],
+                        &want[1], &want[2], &want[3], &want[4]) == 7)
+            test_status(rate, non_audio, want);
+        else {
+            CHECK(0, "%s: bad line %s", path, line);
+            continue;
+        }
+        cases++;
+    }
+    fclose(f);
+    return cases;
+}
+
+int main(int argc, char **argv)
+{
+    imx_test_path(sDir, sizeof(sDir), argc, argv, "alsa/tests/iec61937");
+    if (test_run_cases() <= 0)
+        imx_test_failures++;
+
+    return imx_test_result("iec61937_test");
+}
@@ -23,7 +23,9 @@
 #include <stdint.h>
 #include <sys/time.h>
 #include <stdlib.h>
+#include <time.h>
 
+#include <cutils/atomic.h>
 #include <cutils/log.h>
 #include <cutils/str_parms.h>
 #include <cutils/properties.h>
@@ -34,11 +36,16 @@
 
 #include <tinyalsa/asoundlib.h>
 #include <audio_utils/resampler.h>
-#include <audio_utils/echo_reference.h>
 #include <hardware/audio_effect.h>
 #include <audio_effects/effect_aec.h>
 
 #include "audio_hardware.h"
+#include "pcm_writer.h"
+#include "pcm_reader.h"
+#include "echo_ref.h"
+#include "iec61937.h"
+#include "audio_resampler.h"
+#include "card_monitor.h"
 #include "config_wm8962.h"
 #include "config_wm8958.h"
 #include "config_hdmi.h"
@@ -59,6 +66,11 @@
 #define HDMI_PERIOD_SIZE       192
 #define PLAYBACK_HDMI_PERIOD_COUNT      8
 
+/* compressed formats for passthrough, valued as in later platform headers */
+#define FORMAT_IEC61937_AC3     ((audio_format_t)0x09000000UL)
+#define FORMAT_IEC61937_E_AC3   ((audio_format_t)0x0A000000UL)
+#define FORMAT_IEC61937_DTS     ((audio_format_t)0x0B000000UL)
+
 #define ESAI_PERIOD_SIZE       192
 #define PLAYBACK_ESAI_PERIOD_COUNT      8
 
@@ -71,12 +83,30 @@
 #define LONG_PERIOD_SIZE        192
 /* number of periods for low power playback */
 #define PLAYBACK_LONG_PERIOD_COUNT  8
+/* number of frames per period of the fast (low latency) output */
+#define FAST_PERIOD_SIZE        128
+/* number of periods of the fast output, the extra ones absorb jitter */
+#define PLAYBACK_FAST_PERIOD_COUNT  4
+/* number of fast periods kept in the kernel buffer before a write */
+#define FAST_WRITE_PERIODS      2
+/* number of frames per period of the deep buffer output */
+#define DEEP_BUFFER_PERIOD_SIZE 1024
+/* number of periods for deep buffer playback */
+#define PLAYBACK_DEEP_BUFFER_PERIOD_COUNT 8
+/* frames of the deep buffer output kept for mixing, as many as its pcm
+ * holds so it keeps its latency while mixed, a power of 2 */
+#define MIX_RING_FRAMES         (DEEP_BUFFER_PERIOD_SIZE * PLAYBACK_DEEP_BUFFER_PERIOD_COUNT)
 /* number of periods for capture */
 #define CAPTURE_PERIOD_SIZE  1024
 /* number of periods for capture */
 #define CAPTURE_PERIOD_COUNT 4
 /* minimum sleep time in out_write() when write threshold is not reached */
 #define MIN_WRITE_SLEEP_US 5000
+/* same for the fast output, whose periods are much shorter */
+#define MIN_FAST_WRITE_SLEEP_US 1000
+/* maximum sleep time in out_write() waiting for the write threshold */
+#define MAX_WRITE_SLEEP_US ((FAST_PERIOD_SIZE * PLAYBACK_FAST_PERIOD_COUNT * 1000000) \
+                                / MM_FULL_POWER_SAMPLING_RATE)
 
 #define DEFAULT_OUT_SAMPLING_RATE 44100
 
@@ -90,9 +120,14 @@
 /* product-specific defines */
 #define PRODUCT_DEVICE_PROPERTY "ro.product.device"
 #define PRODUCT_NAME_PROPERTY   "ro.product.name"
+/* RESAMPLER_QUALITY_* level overriding the one each stream picks */
+#define RESAMPLER_QUALITY_PROPERTY "persist.audio.resampler.quality"
+/* delay in ms of the echo loopback test, which measures the alignment of
+ * the echo reference and feeds inputs no card captures from the output */
+#define ECHO_LOOPBACK_PROPERTY "persist.audio.echo.loopback"
 #define PRODUCT_DEVICE_IMX      "imx"
 #define PRODUCT_DEVICE_AUTO     "udoo"
-#define SUPPORT_CARD_NUM        3
+#define SUPPORT_CARD_NUM        4
 #define VT1613_AUDIO_CARD_IDX	0
 #define HDMI_AUDIO_CARD_IDX	1
 
@@ -100,6 +135,7 @@
 struct audio_card *audio_card_list[SUPPORT_CARD_NUM] = {
     &vt1613_card,
     &hdmi_card,
+    &spdif_card,
     &null_card,
 };
 
@@ -113,6 +149,26 @@ struct pcm_config pcm_config_mm_out = {
     .avail_min = 0,
 };
 
+struct pcm_config pcm_config_mm_out_fast = {
+    .channels = 2,
+    .rate = MM_FULL_POWER_SAMPLING_RATE,
+    .period_size = FAST_PERIOD_SIZE,
+    .period_count = PLAYBACK_FAST_PERIOD_COUNT,
+    .format = PCM_FORMAT_S16_LE,
+    .start_threshold = FAST_PERIOD_SIZE * FAST_WRITE_PERIODS,
+    .avail_min = FAST_PERIOD_SIZE,
+};
+
+struct pcm_config pcm_config_mm_out_deep = {
+    .channels = 2,
+    .rate = MM_FULL_POWER_SAMPLING_RATE,
+    .period_size = DEEP_BUFFER_PERIOD_SIZE,
+    .period_count = PLAYBACK_DEEP_BUFFER_PERIOD_COUNT,
+    .format = PCM_FORMAT_S16_LE,
+    .start_threshold = 0,
+    .avail_min = 0,
+};
+
 struct pcm_config pcm_config_hdmi_multi = {
     .channels = 8, /* changed when the stream is opened */
     .rate = MM_FULL_POWER_SAMPLING_RATE, /* changed when the stream is opened */
@@ -168,80 +224,60 @@ static int adev_get_rate_for_device(struct imx_audio_device *adev, uint32_t devi
 static int adev_get_channels_for_device(struct imx_audio_device *adev, uint32_t devices, unsigned int flag);
 static int adev_get_format_for_device(struct imx_audio_device *adev, uint32_t devices, unsigned int flag);
 static void in_update_aux_channels(struct imx_stream_in *in, effect_handle_t effect);
-static int pcm_read_wrapper(struct pcm *pcm, const void * buffer, size_t bytes);
+static int in_read_capture(struct imx_stream_in *in, void *buffer, size_t bytes);
+static int pcm_write_wrapper(struct pcm *pcm, const void * buffer, size_t bytes, int flags,
+                             struct stream_stats_call *call);
 
-/* Returns true on devices that are sabreauto, false otherwise */
-static int is_device_auto(void)
+static uint32_t get_resampler_quality(uint32_t quality)
 {
     char property[PROPERTY_VALUE_MAX];
+    int value;
 
-    property_get(PRODUCT_DEVICE_PROPERTY, property, "");
-
-    /* return true if the property matches the given value */
-    return strstr(property, PRODUCT_DEVICE_AUTO) != NULL;
+    if (property_get(RESAMPLER_QUALITY_PROPERTY, property, "") > 0) {
+        value = atoi(property);
+        if (value >= RESAMPLER_QUALITY_MIN && value <= RESAMPLER_QUALITY_MAX)
+            return value;
+    }
+    return quality;
 }
 
-static int convert_record_data(void *src, void *dst, unsigned int frames, bool bit_24b_2_16b, bool mono2stereo, bool stereo2mono)
+/* the loopback test delay in ms, -1 when it is off */
+static int get_echo_loopback_delay(void)
 {
-     unsigned int i;
-     short *dst_t = (short *)dst;
-     if (bit_24b_2_16b && mono2stereo && !stereo2mono) {
-        int data;
-        int *src_t = (int *)src;
-        for(i = 0; i < frames; i++)
-        {
-            data   = *src_t++;
-            *dst_t++ = (short)(data >> 8);
-            *dst_t++ = (short)(data >> 8);
-        }
-     }
+    char property[PROPERTY_VALUE_MAX];
+    int value;
 
-     if (bit_24b_2_16b && !mono2stereo && stereo2mono) {
-        int data1=0, data2=0;
-        int *src_t = (int *)src;
-        for(i = 0; i < frames; i++)
-        {
-            data1   = *src_t++;
-            data2   = *src_t++;
-            *dst_t++ = (short)(((data1 << 8) >> 17) + ((data2 << 8) >> 17));
-        }
-     }
+    if (property_get(ECHO_LOOPBACK_PROPERTY, property, "") > 0) {
+        value = atoi(property);
+        if (value >= 0)
+            return value;
+    }
+    return -1;
+}
 
-     if (bit_24b_2_16b && !mono2stereo && !stereo2mono) {
-        int data1, data2;
-        int *src_t = (int *)src;
-        for(i = 0; i < frames; i++)
-        {
-            data1   = *src_t++;
-            data2   = *src_t++;
-            *dst_t++ = (short)(data1 >> 8);
-            *dst_t++ = (short)(data2 >> 8);
-        }
-     }
+static void dump_resampler(struct resampler_itfe *resampler, int fd)
+{
+    struct audio_resampler_stats stats;
+    char buffer[160];
 
-     if (!bit_24b_2_16b && mono2stereo && !stereo2mono ) {
-        short data;
-        short *src_t = (short *)src;
-        for(i = 0; i < frames; i++)
-        {
-            data   = *src_t++;
-            *dst_t++ = data;
-            *dst_t++ = data;
-        }
-     }
+    audio_resampler_get_stats(resampler, &stats);
+    snprintf(buffer, sizeof(buffer),
+             "  resampler: %u taps x %u phases, delay %d us, %llu frames, %llu ns per frame\n",
+             stats.taps, stats.phases, stats.delay_ns / 1000,
+             (unsigned long long)stats.frames,
+             (unsigned long long)(stats.frames ? stats.cpu_ns / stats.frames : 0));
+    write(fd, buffer, strlen(buffer));
+}
 
-     if (!bit_24b_2_16b && !mono2stereo && stereo2mono) {
-        short data1, data2;
-        short *src_t = (short *)src;
-        for(i = 0; i < frames; i++)
-        {
-            data1   = *src_t++;
-            data2   = *src_t++;
-            *dst_t++ = (data1 >> 1) + (data2 >> 1);
-        }
-     }
+/* Returns true on devices that are sabreauto, false otherwise */
+static int is_device_auto(void)
+{
+    char property[PROPERTY_VALUE_MAX];
 
-     return 0;
+    property_get(PRODUCT_DEVICE_PROPERTY, property, "");
+
+    /* return true if the property matches the given value */
+    return strstr(property, PRODUCT_DEVICE_AUTO) != NULL;
 }
 
 /* The enable flag when 0 makes the assumption that enums are disabled by
@@ -281,7 +317,42 @@ static int set_route_by_array(struct mixer *mixer, struct route_setting *route,
     return 0;
 }
 
+/*
+ * NOTE: when multiple mutexes have to be acquired, always take the device
+ * mutex first, followed by the input and/or output stream mutexes.
+ *
+ * A running output is written holding its own mutex only. A thread that
+ * holds the device mutex takes the output mutex with out_lock(), which
+ * leaves control_seq odd while it waits: the next write then goes through
+ * the device mutex and hands the output over, instead of taking its mutex
+ * back as soon as the last write released it.
+ */
+static void out_lock(struct imx_stream_out *out)
+{
+    android_atomic_inc(&out->control_seq);
+    pthread_mutex_lock(&out->lock);
+}
 
+static void out_unlock(struct imx_stream_out *out)
+{
+    android_atomic_inc(&out->control_seq);
+    pthread_mutex_unlock(&out->lock);
+}
+
+/* takes the mutexes for a write: the output mutex alone while the output
+ * runs and no control thread waits for it, the device mutex as well to
+ * start it or hand it over. returns whether the device mutex is held. */
+static bool out_lock_write(struct imx_stream_out *out, struct stream_stats_call *call)
+{
+    stream_stats_lock(call, STREAM_STATS_STREAM, &out->lock);
+    if (!out->standby && !(android_atomic_acquire_load(&out->control_seq) & 1))
+        return false;
+
+    pthread_mutex_unlock(&out->lock);
+    stream_stats_lock(call, STREAM_STATS_ADEV, &out->dev->lock);
+    stream_stats_lock(call, STREAM_STATS_STREAM, &out->lock);
+    return true;
+}
 
 static void force_all_standby(struct imx_audio_device *adev)
 {
@@ -292,17 +363,18 @@ static void force_all_standby(struct imx_audio_device *adev)
     for(i = 0; i < OUTPUT_TOTAL; i++)
         if (adev->active_output[i]) {
             out = adev->active_output[i];
-            pthread_mutex_lock(&out->lock);
+            out_lock(out);
             do_output_standby(out);
-            pthread_mutex_unlock(&out->lock);
+            out_unlock(out);
         }
 
-    if (adev->active_input) {
-        in = adev->active_input;
-        pthread_mutex_lock(&in->lock);
-        do_input_standby(in);
-        pthread_mutex_unlock(&in->lock);
-    }
+    for(i = 0; i < MAX_CAPTURE_CLIENTS; i++)
+        if (adev->capture_clients[i]) {
+            in = adev->capture_clients[i];
+            pthread_mutex_lock(&in->lock);
+            do_input_standby(in);
+            pthread_mutex_unlock(&in->lock);
+        }
 }
 
 static void select_mode(struct imx_audio_device *adev)
@@ -443,44 +515,84 @@ static void select_output_device(struct imx_audio_device *adev)
     }
 }
 
-static void select_input_device(struct imx_audio_device *adev)
-{
-    int i;
-    int headset_on = 0;
-    int main_mic_on = 0;
-    int sub_mic_on = 0;
-    int bt_on = adev->in_device & AUDIO_DEVICE_IN_ALL_SCO;
+/* the mic inputs of a card, one of them is routed to its capture */
+enum {
+    INPUT_ROUTE_NONE,
+    INPUT_ROUTE_MAIN_MIC,
+    INPUT_ROUTE_HS_MIC,
+    INPUT_ROUTE_BT_MIC,
+};
 
-    if (!bt_on) {
-        if ((adev->mode != AUDIO_MODE_IN_CALL) && (adev->active_input != 0)) {
-            /* sub mic is used for camcorder or VoIP on speaker phone */
-            sub_mic_on = (adev->active_input->source == AUDIO_SOURCE_CAMCORDER) ||
-                         ((adev->out_device & AUDIO_DEVICE_OUT_SPEAKER) &&
-                          (adev->active_input->source == AUDIO_SOURCE_VOICE_COMMUNICATION));
-        }
+static int get_input_route(struct imx_audio_device *adev, int device, int source)
+{
+    if (device & AUDIO_DEVICE_IN_ALL_SCO & ~AUDIO_DEVICE_BIT_IN)
+        return INPUT_ROUTE_BT_MIC;
+    if (device & AUDIO_DEVICE_IN_WIRED_HEADSET & ~AUDIO_DEVICE_BIT_IN)
+        return INPUT_ROUTE_HS_MIC;
+    if (device & AUDIO_DEVICE_IN_BUILTIN_MIC & ~AUDIO_DEVICE_BIT_IN)
+        return INPUT_ROUTE_MAIN_MIC;
+    /* sub mic is used for camcorder or VoIP on speaker phone */
+    if ((adev->mode != AUDIO_MODE_IN_CALL) &&
+            ((source == AUDIO_SOURCE_CAMCORDER) ||
+             ((adev->out_device & AUDIO_DEVICE_OUT_SPEAKER) &&
+              (source == AUDIO_SOURCE_VOICE_COMMUNICATION))))
+        return INPUT_ROUTE_MAIN_MIC;
+    return INPUT_ROUTE_NONE;
+}
 
-        headset_on = adev->in_device & AUDIO_DEVICE_IN_WIRED_HEADSET;
-        main_mic_on = adev->in_device & AUDIO_DEVICE_IN_BUILTIN_MIC;
+static void set_input_route(struct imx_audio_device *adev, int i, int route)
+{
+    switch (route) {
+    case INPUT_ROUTE_BT_MIC:
+        set_route_by_array(adev->mixer[i], adev->card_list[i]->mm_bt_mic_input, 1);
+        break;
+    case INPUT_ROUTE_HS_MIC:
+        set_route_by_array(adev->mixer[i], adev->card_list[i]->mm_hs_mic_input, 1);
+        break;
+    case INPUT_ROUTE_MAIN_MIC:
+        set_route_by_array(adev->mixer[i], adev->card_list[i]->mm_main_mic_input, 1);
+        break;
+    default:
+        set_route_by_array(adev->mixer[i], adev->card_list[i]->mm_main_mic_input, 0);
+        break;
     }
+}
+
+/* routes every card for adev->in_device, once no input captures */
+static void select_input_device(struct imx_audio_device *adev)
+{
+    int i;
+    int route = get_input_route(adev, adev->in_device,
+                                adev->active_input ? adev->active_input->source :
+                                                     AUDIO_SOURCE_DEFAULT);
 
    /* TODO: check how capture is possible during voice calls or if
     * both use cases are mutually exclusive.
     */
-    if (bt_on)
-        for(i = 0; i < MAX_AUDIO_CARD_NUM; i++)
-            set_route_by_array(adev->mixer[i], adev->card_list[i]->mm_bt_mic_input, 1);
-    else {
-        /* Select front end */
-        if (headset_on)
-            for(i = 0; i < MAX_AUDIO_CARD_NUM; i++)
-                set_route_by_array(adev->mixer[i], adev->card_list[i]->mm_hs_mic_input, 1);
-        else if (main_mic_on || sub_mic_on)
-            for(i = 0; i < MAX_AUDIO_CARD_NUM; i++)
-                set_route_by_array(adev->mixer[i], adev->card_list[i]->mm_main_mic_input, 1);
-        else
-            for(i = 0; i < MAX_AUDIO_CARD_NUM; i++)
-                set_route_by_array(adev->mixer[i], adev->card_list[i]->mm_main_mic_input, 0);
+    for(i = 0; i < MAX_AUDIO_CARD_NUM; i++)
+        set_input_route(adev, i, route);
+}
+
+/* index in card_list of the card listing device, -1 when none does */
+static int find_input_card(struct imx_audio_device *adev, int device)
+{
+    int i;
+
+    for (i = 0; i < adev->audio_card_num; i++) {
+        if (adev->card_list[i] &&
+                (adev->card_list[i]->supported_in_devices & device & ~AUDIO_DEVICE_BIT_IN))
+            return i;
     }
+    return -1;
+}
+
+/* the main card captures what no card lists, as the builtin mic of a
+ * codec listing its headset input only */
+static int get_input_card(struct imx_audio_device *adev, int device)
+{
+    int i = find_input_card(adev, device);
+
+    return i < 0 ? VT1613_AUDIO_CARD_IDX : i;
 }
 
 static int get_card_for_device(struct imx_audio_device *adev, int device, unsigned int flag)
@@ -491,10 +603,178 @@ static int get_card_for_device(struct imx_audio_device *adev, int device, unsign
     if (flag == PCM_OUT ) {
         card = adev->card_list[out_dev_idx]->card;
     } else {
-	card = adev->card_list[VT1613_AUDIO_CARD_IDX]->card;
+	card = adev->card_list[get_input_card(adev, device)]->card;
     }
     return card;
 }
+
+/* frames a mixer output keeps in the codec pcm before writing more */
+static unsigned int out_write_threshold(const struct pcm_config *config)
+{
+    if (config == &pcm_config_mm_out_fast)
+        return FAST_PERIOD_SIZE * FAST_WRITE_PERIODS;
+    return config->period_size * config->period_count;
+}
+
+/*
+ * The primary and deep buffer outputs share the codec pcm. While the
+ * primary output owns it, the deep buffer output queues its frames in
+ * adev->mix and the primary output mixes them into its own writes.
+ *
+ * While the deep buffer output owns the pcm it keeps what it writes in
+ * adev->mix too. The primary output takes the frames its pcm had not
+ * played yet over with it, and the deep buffer output plays those the
+ * primary output left unmixed first once it has the pcm back.
+ */
+
+/* must be called with mix->lock held */
+static void out_mix_put(struct out_mix_ring *mix, const int16_t *frames, size_t count)
+{
+    size_t pos = mix->head & (mix->size - 1);
+    size_t first = MIN(count, mix->size - pos);
+
+    memcpy(mix->buf + pos * 2, frames, first * 2 * sizeof(int16_t));
+    memcpy(mix->buf, frames + first * 2, (count - first) * 2 * sizeof(int16_t));
+    mix->head += count;
+}
+
+/* the mix starts with the last held frames the deep buffer output wrote */
+static void out_mix_start(struct out_mix_ring *mix, size_t held)
+{
+    pthread_mutex_lock(&mix->lock);
+    held = MIN(held, MIN(mix->head - mix->opened, mix->size));
+    mix->tail = mix->head - held;
+    mix->active = mix->buf != NULL;
+    pthread_mutex_unlock(&mix->lock);
+}
+
+static void out_mix_stop(struct out_mix_ring *mix)
+{
+    pthread_mutex_lock(&mix->lock);
+    mix->active = false;
+    pthread_cond_broadcast(&mix->cond);
+    pthread_mutex_unlock(&mix->lock);
+}
+
+static bool out_mix_is_active(struct out_mix_ring *mix)
+{
+    bool active;
+
+    pthread_mutex_lock(&mix->lock);
+    active = mix->active;
+    pthread_mutex_unlock(&mix->lock);
+    return active;
+}
+
+/* waits for room as long as the primary output keeps consuming, frames
+ * that find none are dropped */
+static void out_mix_push(struct out_mix_ring *mix, const int16_t *frames,
+                         size_t count, unsigned int rate)
+{
+    pthread_mutex_lock(&mix->lock);
+    while (count > 0 && mix->active) {
+        size_t room = mix->size - (mix->head - mix->tail);
+        size_t n;
+
+        if (room == 0) {
+            struct timespec ts;
+            int64_t wait_ns = (int64_t)mix->size * 1000000000LL / rate;
+
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += (ts.tv_nsec + wait_ns) / 1000000000LL;
+            ts.tv_nsec = (ts.tv_nsec + wait_ns) % 1000000000LL;
+            if (pthread_cond_timedwait(&mix->cond, &mix->lock, &ts) == ETIMEDOUT) {
+                ALOGW("primary output stalled, dropping %zu deep buffer frames", count);
+                break;
+            }
+            continue;
+        }
+
+        n = MIN(room, count);
+        out_mix_put(mix, frames, n);
+        frames += n * 2;
+        count -= n;
+    }
+    pthread_mutex_unlock(&mix->lock);
+}
+
+/* mixes the queued frames into a copy of src in dst, returns false and
+ * leaves dst alone when there were none */
+static bool out_mix_pull(struct out_mix_ring *mix, int16_t *dst, const int16_t *src,
+                         size_t count)
+{
+    size_t pos, first, n;
+
+    pthread_mutex_lock(&mix->lock);
+    n = MIN(mix->head - mix->tail, count);
+    if (n > 0) {
+        memcpy(dst, src, count * 2 * sizeof(int16_t));
+        pos = mix->tail & (mix->size - 1);
+        first = MIN(n, mix->size - pos);
+        audio_conv_mix(dst, mix->buf + pos * 2, first * 2);
+        audio_conv_mix(dst + first * 2, mix->buf, (n - first) * 2);
+        mix->tail += n;
+        pthread_cond_signal(&mix->cond);
+    }
+    pthread_mutex_unlock(&mix->lock);
+    return n > 0;
+}
+
+/* the frames the deep buffer output wrote to its own pcm */
+static void out_mix_keep(struct out_mix_ring *mix, const int16_t *frames, size_t count)
+{
+    pthread_mutex_lock(&mix->lock);
+    if (mix->buf != NULL && !mix->active) {
+        if (count > mix->size) {
+            frames += (count - mix->size) * 2;
+            mix->head += count - mix->size;
+            count = mix->size;
+        }
+        out_mix_put(mix, frames, count);
+        mix->tail = mix->head;
+    }
+    pthread_mutex_unlock(&mix->lock);
+}
+
+/* puts the deep buffer output in standby, returns how many of the frames
+ * it wrote its pcm had not played yet.
+ * must be called with hw device mutex locked */
+static size_t out_mix_handover(struct imx_audio_device *adev, struct imx_stream_out *deep)
+{
+    struct timespec tstamp;
+    unsigned int avail;
+    size_t held = 0;
+    int i;
+
+    if (deep == NULL || deep->standby)
+        return 0;
+
+    out_lock(deep);
+    /* the first pcm clocks the output, its frames are resampled ones */
+    for (i = 0; i < PCM_TOTAL && !deep->pcm[i]; i++);
+    if (i < PCM_TOTAL) {
+        /* a pcm short of its start threshold holds all it was given */
+        if (pcm_get_htimestamp(deep->pcm[i], &avail, &tstamp) == 0)
+            held = (uint64_t)(pcm_get_buffer_size(deep->pcm[i]) - avail) *
+                   deep->mm_config->rate / deep->config[i].rate;
+        else
+            held = SIZE_MAX;
+    }
+    do_output_standby(deep);
+    out_unlock(deep);
+    return held;
+}
+
+/* must be called with hw device mutex locked */
+static void force_mixer_output_standby(struct imx_audio_device *adev, struct imx_stream_out *out)
+{
+    if (out != NULL && !out->standby) {
+        out_lock(out);
+        do_output_standby(out);
+        out_unlock(out);
+    }
+}
+
 /* must be called with hw device and output stream mutexes locked */
 static int start_output_stream_primary(struct imx_stream_out *out)
 {
@@ -502,8 +782,10 @@ static int start_output_stream_primary(struct imx_stream_out *out)
     unsigned int card = -1;
     unsigned int port = 0;
     int i;
+    int master;
     int pcm_device;
     bool success = false;
+    size_t held = 0;
 
     ALOGV("start_output_stream... %d, device %d",(int)out, out->device);
 
@@ -512,12 +794,17 @@ static int start_output_stream_primary(struct imx_stream_out *out)
         select_output_device(adev);
     }
 
+    /* the primary output takes the codec pcm over from the deep buffer
+     * output, and the frames it still held with it */
+    if (out == adev->active_output[OUTPUT_PRIMARY])
+        held = out_mix_handover(adev, adev->active_output[OUTPUT_DEEP_BUF]);
+
     pcm_device = out->device & (AUDIO_DEVICE_OUT_ALL &
                          ~(AUDIO_DEVICE_OUT_DGTL_DOCK_HEADSET | AUDIO_DEVICE_OUT_AUX_DIGITAL));
     if (pcm_device && (adev->active_output[OUTPUT_ESAI] == NULL || adev->active_output[OUTPUT_ESAI]->standby)) {
         out->write_flags[PCM_NORMAL]            = PCM_OUT | PCM_MMAP;
-        out->write_threshold[PCM_NORMAL]        = PLAYBACK_LONG_PERIOD_COUNT * LONG_PERIOD_SIZE;
-        out->config[PCM_NORMAL] = pcm_config_mm_out;
+        out->write_threshold[PCM_NORMAL]        = out_write_threshold(out->mm_config);
+        out->config[PCM_NORMAL] = *out->mm_config;
 
         card = get_card_for_device(adev, pcm_device, PCM_OUT);
         out->pcm[PCM_NORMAL] = pcm_open(card, port,out->write_flags[PCM_NORMAL], &out->config[PCM_NORMAL]);
@@ -552,14 +839,34 @@ static int start_output_stream_primary(struct imx_stream_out *out)
     }
 
     if (success) {
-        out->buffer_frames = pcm_config_mm_out.period_size * 2;
+        /* the resampler output, then the deep buffer frames mixed into a
+         * copy of a write */
+        out->buffer_frames = out->mm_config->period_size * 2;
         if (out->buffer == NULL)
-            out->buffer = malloc(out->buffer_frames * audio_stream_frame_size(&out->stream.common));
+            out->buffer = malloc(out->buffer_frames * 2 *
+                                 audio_stream_frame_size(&out->stream.common));
 
         if (adev->echo_reference != NULL)
             out->echo_reference = adev->echo_reference;
         if (out->resampler)
             out->resampler->reset(out->resampler);
+        if (out == adev->active_output[OUTPUT_PRIMARY])
+            out_mix_start(&adev->mix, held);
+
+        /* the first pcm is written inline and clocks the stream, the others
+         * play from their own thread so a slow card can not hold it up */
+        for (i = 0; i < PCM_TOTAL && !out->pcm[i]; i++);
+        master = i;
+        for (i = master + 1; i < PCM_TOTAL; i++) {
+            if (!out->pcm[i])
+                continue;
+            out->writer[i] = pcm_writer_open(out->pcm[i], out->write_flags[i],
+                                             out->config[i].channels, out->config[i].rate,
+                                             out->config[master].period_size * 2 +
+                                             out->config[i].period_size);
+            if (out->writer[i] == NULL)
+                ALOGW("no writer thread for pcm %d, writing it inline", i);
+        }
 
         return 0;
     }
@@ -567,6 +874,27 @@ static int start_output_stream_primary(struct imx_stream_out *out)
     return -ENOMEM;
 }
 
+/* IEC 60958 channel status of the passthrough card */
+static void out_set_channel_status(struct imx_stream_out *out, unsigned int rate, int non_audio)
+{
+    struct mixer *mixer = out->dev->mixer[out->iec_card];
+    struct mixer_ctl *ctl;
+    uint8_t status[IEC61937_STATUS_BYTES];
+
+    if (!mixer)
+        return;
+
+    ctl = mixer_get_ctl_by_name(mixer, "IEC958 Playback Default");
+    if (!ctl) {
+        ALOGW("no channel status control, the receiver may take bursts for PCM");
+        return;
+    }
+
+    iec61937_channel_status(status, rate, non_audio);
+    if (mixer_ctl_set_array(ctl, status, sizeof(status)) != 0)
+        ALOGW("cannot set channel status for %d Hz", rate);
+}
+
 static int start_output_stream_hdmi(struct imx_stream_out *out)
 {
     struct imx_audio_device *adev = out->dev;
@@ -574,16 +902,14 @@ static int start_output_stream_hdmi(struct imx_stream_out *out)
     unsigned int port = 0;
     int i = 0;
 
-    /* force standby on low latency output stream to close HDMI driver in case it was in use */
-    if (adev->active_output[OUTPUT_PRIMARY] != NULL &&
-            !adev->active_output[OUTPUT_PRIMARY]->standby) {
-        struct imx_stream_out *p_out = adev->active_output[OUTPUT_PRIMARY];
-        pthread_mutex_lock(&p_out->lock);
-        do_output_standby(p_out);
-        pthread_mutex_unlock(&p_out->lock);
-    }
+    /* force standby on the mixer output streams to close HDMI driver in case it was in use */
+    force_mixer_output_standby(adev, adev->active_output[OUTPUT_PRIMARY]);
+    force_mixer_output_standby(adev, adev->active_output[OUTPUT_DEEP_BUF]);
 
-    card = get_card_for_device(adev, out->device & AUDIO_DEVICE_OUT_AUX_DIGITAL, PCM_OUT);
+    if (out->iec)
+        card = adev->card_list[out->iec_card]->card;
+    else
+        card = get_card_for_device(adev, out->device & AUDIO_DEVICE_OUT_AUX_DIGITAL, PCM_OUT);
     ALOGW("card %d, port %d device 0x%x", card, port, out->device);
     ALOGW("rate %d, channel %d period_size 0x%x", out->config[PCM_HDMI].rate, out->config[PCM_HDMI].channels, out->config[PCM_HDMI].period_size);
 
@@ -595,9 +921,29 @@ static int start_output_stream_hdmi(struct imx_stream_out *out)
         out->pcm[PCM_HDMI] = NULL;
         return -ENOMEM;
     }
+
+    if (out->iec) {
+        const void *burst;
+        size_t bytes;
+
+        /* flag the link as compressed, then give the receiver a pause
+         * burst to switch its decoder on before the first frame */
+        out_set_channel_status(out, out->config[PCM_HDMI].rate, 1);
+        bytes = iec61937_pause(out->iec, &burst);
+        pcm_write_wrapper(out->pcm[PCM_HDMI], burst, bytes, out->write_flags[PCM_HDMI], NULL);
+    }
     return 0;
 }
 
+/********************************************************************************************************
+For esai, it will use the first channels/2 for Left channels, use second half channels for Right channels.
+So we need to transform channel map in HAL for multichannel.
+when input is "FL, FR, C, LFE, BL, BR", output is "FL,BL,C,FR,BR,LFE".
+when input is "FL, FR, C, LFE, BL, BR, SL, SR", output is "FL,BL,C,SL,FR,BR,LFE,SR"
+*********************************************************************************************************/
+static const uint8_t esai_map_6ch[6] = { 0, 4, 2, 1, 5, 3 };
+static const uint8_t esai_map_8ch[8] = { 0, 4, 2, 6, 1, 5, 3, 7 };
+
 static int start_output_stream_esai(struct imx_stream_out *out)
 {
     struct imx_audio_device *adev = out->dev;
@@ -605,14 +951,9 @@ static int start_output_stream_esai(struct imx_stream_out *out)
     unsigned int port = 0;
     int i = 0;
 
-    /* force standby on low latency output stream to close HDMI driver in case it was in use */
-    if (adev->active_output[OUTPUT_PRIMARY] != NULL &&
-            !adev->active_output[OUTPUT_PRIMARY]->standby) {
-        struct imx_stream_out *p_out = adev->active_output[OUTPUT_PRIMARY];
-        pthread_mutex_lock(&p_out->lock);
-        do_output_standby(p_out);
-        pthread_mutex_unlock(&p_out->lock);
-    }
+    /* force standby on the mixer output streams to close HDMI driver in case it was in use */
+    force_mixer_output_standby(adev, adev->active_output[OUTPUT_PRIMARY]);
+    force_mixer_output_standby(adev, adev->active_output[OUTPUT_DEEP_BUF]);
 
     card = get_card_for_device(adev, out->device & AUDIO_DEVICE_OUT_SPEAKER, PCM_OUT);
     ALOGW("card %d, port %d device 0x%x", card, port, out->device);
@@ -626,6 +967,13 @@ static int start_output_stream_esai(struct imx_stream_out *out)
         out->pcm[PCM_ESAI] = NULL;
         return -ENOMEM;
     }
+
+    if (out->config[PCM_ESAI].channels == 6)
+        out->channel_map = esai_map_6ch;
+    else if (out->config[PCM_ESAI].channels == 8)
+        out->channel_map = esai_map_8ch;
+    else
+        out->channel_map = NULL;
     return 0;
 }
 
@@ -673,27 +1021,27 @@ static size_t get_input_buffer_size(uint32_t sample_rate, int format, int channe
 }
 
 static void add_echo_reference(struct imx_stream_out *out,
-                               struct echo_reference_itfe *reference)
+                               struct echo_ref *reference)
 {
-    pthread_mutex_lock(&out->lock);
+    out_lock(out);
     out->echo_reference = reference;
-    pthread_mutex_unlock(&out->lock);
+    out_unlock(out);
 }
 
 static void remove_echo_reference(struct imx_stream_out *out,
-                                  struct echo_reference_itfe *reference)
+                                  struct echo_ref *reference)
 {
-    pthread_mutex_lock(&out->lock);
+    out_lock(out);
     if (out->echo_reference == reference) {
         /* stop writing to echo reference */
-        reference->write(reference, NULL);
+        echo_ref_stop(reference);
         out->echo_reference = NULL;
     }
-    pthread_mutex_unlock(&out->lock);
+    out_unlock(out);
 }
 
 static void put_echo_reference(struct imx_audio_device *adev,
-                          struct echo_reference_itfe *reference)
+                          struct echo_ref *reference)
 {
     if (adev->echo_reference != NULL &&
             reference == adev->echo_reference) {
@@ -701,12 +1049,12 @@ static void put_echo_reference(struct imx_audio_device *adev,
         if (adev->active_output[OUTPUT_PRIMARY] != NULL &&
              !adev->active_output[OUTPUT_PRIMARY]->standby )
                 remove_echo_reference(adev->active_output[OUTPUT_PRIMARY], reference);
-        release_echo_reference(reference);
+        echo_ref_release(reference);
         adev->echo_reference = NULL;
     }
 }
 
-static struct echo_reference_itfe *get_echo_reference(struct imx_audio_device *adev,
+static struct echo_ref *get_echo_reference(struct imx_audio_device *adev,
                                                audio_format_t format,
                                                uint32_t channel_count,
                                                uint32_t sampling_rate)
@@ -719,63 +1067,56 @@ static struct echo_reference_itfe *get_echo_reference(struct imx_audio_device *a
         uint32_t wr_channel_count = popcount(stream->get_channels(stream));
         uint32_t wr_sampling_rate = stream->get_sample_rate(stream);
 
-        int status = create_echo_reference(AUDIO_FORMAT_PCM_16_BIT,
-                                           channel_count,
-                                           sampling_rate,
-                                           AUDIO_FORMAT_PCM_16_BIT,
-                                           wr_channel_count,
-                                           wr_sampling_rate,
-                                           &adev->echo_reference);
-        if (status == 0)
+        adev->echo_reference = echo_ref_create(wr_sampling_rate, wr_channel_count,
+                                               sampling_rate, channel_count);
+        if (adev->echo_reference != NULL)
             add_echo_reference(adev->active_output[OUTPUT_PRIMARY], adev->echo_reference);
     }
 
     return adev->echo_reference;
 }
 
-static int get_playback_delay(struct imx_stream_out *out,
-                       size_t frames,
-                       struct echo_reference_buffer *buffer)
+/* time the next frame written is rendered: that of the stamp, plus what
+ * the driver buffer still holds before it */
+static int get_playback_time(struct imx_stream_out *out, int64_t *time_ns)
 {
-    size_t kernel_frames;
+    unsigned int kernel_frames;
+    struct timespec tstamp;
     int status;
     int primary_pcm = 0;
-    struct imx_audio_device *adev = out->dev;
 
     /* Find the first active PCM to act as primary */
     while ((primary_pcm < PCM_TOTAL) && !out->pcm[primary_pcm])
         primary_pcm++;
+    if (primary_pcm == PCM_TOTAL)
+        return -ENODEV;
 
-    status = pcm_get_htimestamp(out->pcm[primary_pcm], &kernel_frames, &buffer->time_stamp);
+    status = pcm_get_htimestamp(out->pcm[primary_pcm], &kernel_frames, &tstamp);
     if (status < 0) {
-        buffer->time_stamp.tv_sec  = 0;
-        buffer->time_stamp.tv_nsec = 0;
-        buffer->delay_ns           = 0;
-        ALOGV("get_playback_delay(): pcm_get_htimestamp error,"
-                "setting playbackTimestamp to 0");
+        ALOGV("get_playback_time(): pcm_get_htimestamp error");
         return status;
     }
 
     kernel_frames = pcm_get_buffer_size(out->pcm[primary_pcm]) - kernel_frames;
 
-    /* adjust render time stamp with delay added by current driver buffer.
-     * Add the duration of current frame as we want the render time of the last
-     * sample being written. */
-    buffer->delay_ns = (long)(((int64_t)(kernel_frames + frames)* 1000000000)/
-                            adev->mm_rate);
-
+    *time_ns = (int64_t)tstamp.tv_sec * 1000000000 + tstamp.tv_nsec +
+               (int64_t)kernel_frames * 1000000000 / out->config[primary_pcm].rate;
     return 0;
 }
 
 static uint32_t out_get_sample_rate(const struct audio_stream *stream)
 {
     struct imx_stream_out *out = (struct imx_stream_out *)stream;
-    return pcm_config_mm_out.rate;
+    return out->mm_config->rate;
 }
 
 static uint32_t out_get_sample_rate_hdmi(const struct audio_stream *stream)
 {
     struct imx_stream_out *out = (struct imx_stream_out *)stream;
+
+    /* E-AC3 bursts play at 4 times the coded rate */
+    if (out->iec && out->iec->codec == IEC61937_EAC3)
+        return out->config[PCM_HDMI].rate / 4;
     return out->config[PCM_HDMI].rate;
 }
 
@@ -799,7 +1140,7 @@ static size_t out_get_buffer_size_primary(const struct audio_stream *stream)
     /* take resampling into account and return the closest majoring
     multiple of 16 frames, as audioflinger expects audio buffers to
     be a multiple of 16 frames */
-    size_t size = (pcm_config_mm_out.period_size * adev->default_rate) / pcm_config_mm_out.rate;
+    size_t size = (out->mm_config->period_size * adev->default_rate) / out->mm_config->rate;
     size = ((size + 15) / 16) * 16;
     return size * audio_stream_frame_size((struct audio_stream *)stream);
 }
@@ -808,6 +1149,10 @@ static size_t out_get_buffer_size_hdmi(const struct audio_stream *stream)
 {
     struct imx_stream_out *out = (struct imx_stream_out *)stream;
 
+    /* compressed writes are bytes of the stream, up to a burst of them */
+    if (out->iec)
+        return iec61937_period_bytes(out->iec->codec);
+
     /* take resampling into account and return the closest majoring
     multiple of 16 frames, as audioflinger expects audio buffers to
     be a multiple of 16 frames */
@@ -836,6 +1181,10 @@ static uint32_t out_get_channels(const struct audio_stream *stream)
 
 static audio_format_t out_get_format(const struct audio_stream *stream)
 {
+    struct imx_stream_out *out = (struct imx_stream_out *)stream;
+
+    if (out->iec)
+        return out->format;
     return AUDIO_FORMAT_PCM_16_BIT;
 }
 
@@ -854,12 +1203,20 @@ static int do_output_standby(struct imx_stream_out *out)
     if (!out->standby) {
 
         for (i = 0; i < PCM_TOTAL; i++) {
+            if (out->writer[i]) {
+                pcm_writer_close(out->writer[i]);
+                out->writer[i] = NULL;
+            }
             if (out->pcm[i]) {
                 pcm_close(out->pcm[i]);
                 out->pcm[i] = NULL;
             }
         }
 
+        /* hand the link back to linear PCM */
+        if (out->iec)
+            out_set_channel_status(out, 0, 0);
+
         ALOGW("do_out_standby... %d",(int)out);
 
         /* if in call, don't turn off the output stage. This will
@@ -870,10 +1227,13 @@ static int do_output_standby(struct imx_stream_out *out)
 
         /* stop writing to echo reference */
         if (out->echo_reference != NULL) {
-            out->echo_reference->write(out->echo_reference, NULL);
+            echo_ref_stop(out->echo_reference);
             out->echo_reference = NULL;
         }
 
+        if (out == adev->active_output[OUTPUT_PRIMARY])
+            out_mix_stop(&adev->mix);
+
         out->standby = 1;
     }
     return 0;
@@ -885,15 +1245,34 @@ static int out_standby(struct audio_stream *stream)
     int status;
 
     pthread_mutex_lock(&out->dev->lock);
-    pthread_mutex_lock(&out->lock);
+    out_lock(out);
     status = do_output_standby(out);
-    pthread_mutex_unlock(&out->lock);
+    out_unlock(out);
     pthread_mutex_unlock(&out->dev->lock);
     return status;
 }
 
 static int out_dump(const struct audio_stream *stream, int fd)
 {
+    struct imx_stream_out *out = (struct imx_stream_out *)stream;
+    int i;
+
+    for (i = 0; i < PCM_TOTAL; i++) {
+        if (out->writer[i])
+            pcm_writer_dump(out->writer[i], fd);
+    }
+
+    if (out->resampler)
+        dump_resampler(out->resampler, fd);
+
+    if (out->iec) {
+        char buffer[128];
+
+        snprintf(buffer, sizeof(buffer), "  iec61937: format 0x%x, %u bursts, %u errors\n",
+                 out->format, out->iec->bursts, out->iec->errors);
+        write(fd, buffer, strlen(buffer));
+    }
+    stream_stats_dump(&out->stats, "write", fd);
     return 0;
 }
 
@@ -916,9 +1295,10 @@ static int out_set_parameters(struct audio_stream *stream, const char *kvpairs)
     if (ret >= 0) {
         val = atoi(value);
         pthread_mutex_lock(&adev->lock);
-        pthread_mutex_lock(&out->lock);
+        out_lock(out);
         if ((adev->out_device != val) && (val != 0)) {
-            if (out == adev->active_output[OUTPUT_PRIMARY] && !out->standby) {
+            if ((out == adev->active_output[OUTPUT_PRIMARY] ||
+                    out == adev->active_output[OUTPUT_DEEP_BUF]) && !out->standby) {
                 /* a change in output device may change the microphone selection */
                 if (adev->active_input &&
                         adev->active_input->source == AUDIO_SOURCE_VOICE_COMMUNICATION) {
@@ -942,7 +1322,7 @@ static int out_set_parameters(struct audio_stream *stream, const char *kvpairs)
                 select_output_device(adev);
             }
         }
-        pthread_mutex_unlock(&out->lock);
+        out_unlock(out);
         if (force_input_standby) {
             in = adev->active_input;
             pthread_mutex_lock(&in->lock);
@@ -1020,11 +1400,16 @@ static char * out_get_parameters(const struct audio_stream *stream, const char *
     return str;
 }
 
+/* a write waits for the kernel buffer to drain to the write threshold,
+ * so at most one more buffer is queued on top of it */
 static uint32_t out_get_latency_primary(const struct audio_stream_out *stream)
 {
     struct imx_stream_out *out = (struct imx_stream_out *)stream;
+    const struct pcm_config *config = out->mm_config;
+    unsigned int frames = out_write_threshold(config) + config->period_size;
 
-    return (pcm_config_mm_out.period_size * pcm_config_mm_out.period_count * 1000) / pcm_config_mm_out.rate;
+    frames = MIN(frames, config->period_size * config->period_count);
+    return (frames * 1000) / config->rate;
 }
 
 static uint32_t out_get_latency_hdmi(const struct audio_stream_out *stream)
@@ -1047,21 +1432,21 @@ static int out_set_volume(struct audio_stream_out *stream, float left,
     return -ENOSYS;
 }
 
-static int pcm_read_convert(struct imx_stream_in *in, struct pcm *pcm, void *data, unsigned int count)
+/* frames of the shared capture pcm, in its format, from the cursor of in */
+static int in_read_capture(struct imx_stream_in *in, void *buffer, size_t bytes)
 {
-    bool bit_24b_2_16b = false;
-    bool mono2stereo = false;
-    bool stereo2mono = false;
-    size_t frames_rq = count / audio_stream_frame_size(&in->stream.common);
+    return pcm_reader_read(in->shared->reader, &in->capture, buffer,
+                           pcm_bytes_to_frames(in->pcm, bytes));
+}
 
-    if (in->config.format == PCM_FORMAT_S24_LE && in->requested_format == PCM_FORMAT_S16_LE) bit_24b_2_16b = true;
-    if (in->config.channels == 2 && in->requested_channel == 1) stereo2mono = true;
-    if (in->config.channels == 1 && in->requested_channel == 2) mono2stereo = true;
+static int pcm_read_convert(struct imx_stream_in *in, void *data, unsigned int count)
+{
+    size_t frames_rq = count / audio_stream_frame_size(&in->stream.common);
 
-    if (bit_24b_2_16b || mono2stereo || stereo2mono) {
+    if (!audio_conv_is_identity(&in->conv)) {
         size_t size_in_bytes_tmp = pcm_frames_to_bytes(in->pcm, frames_rq);
-        if (in->read_tmp_buf_size < in->config.period_size) {
-            in->read_tmp_buf_size = in->config.period_size;
+        if (in->read_tmp_buf_size < size_in_bytes_tmp) {
+            in->read_tmp_buf_size = size_in_bytes_tmp;
             in->read_tmp_buf = (int32_t *) realloc(in->read_tmp_buf, size_in_bytes_tmp);
             ALOG_ASSERT((in->read_tmp_buf != NULL),
                         "get_next_buffer() failed to reallocate read_tmp_buf");
@@ -1069,46 +1454,23 @@ static int pcm_read_convert(struct imx_stream_in *in, struct pcm *pcm, void *dat
                      in->read_tmp_buf, size_in_bytes_tmp);
         }
 
-        in->read_status = pcm_read_wrapper(pcm, (void*)in->read_tmp_buf, size_in_bytes_tmp);
+        in->read_status = in_read_capture(in, (void*)in->read_tmp_buf, size_in_bytes_tmp);
 
         if (in->read_status != 0) {
-            ALOGE("get_next_buffer() pcm_read_wrapper error %d", in->read_status);
+            ALOGE("get_next_buffer() in_read_capture error %d", in->read_status);
             return in->read_status;
         }
-        convert_record_data((void *)in->read_tmp_buf, (void *)data, frames_rq, bit_24b_2_16b, mono2stereo, stereo2mono);
+        audio_conv_run(&in->conv, data, in->read_tmp_buf, frames_rq);
     }
     else {
-        in->read_status = pcm_read_wrapper(pcm, (void*)data, count);
+        in->read_status = in_read_capture(in, (void*)data, count);
     }
 
     return in->read_status;
 }
 
-static int pcm_read_wrapper(struct pcm *pcm, const void * buffer, size_t bytes)
-{
-    int ret = 0;
-    ret = pcm_read(pcm, (void *)buffer, bytes);
-
-    if(ret !=0) {
-         ALOGV("ret %d, pcm read %d error %s.", ret, bytes, pcm_get_error(pcm));
-
-         switch(pcm_state(pcm)) {
-              case PCM_STATE_SETUP:
-              case PCM_STATE_XRUN:
-                   ret = pcm_prepare(pcm);
-                   if(ret != 0) return ret;
-                   break;
-              default:
-                   return ret;
-         }
-
-         ret = pcm_read(pcm, (void *)buffer, bytes);
-    }
-
-    return ret;
-}
-
-static int pcm_write_wrapper(struct pcm *pcm, const void * buffer, size_t bytes, int flags)
+static int pcm_write_wrapper(struct pcm *pcm, const void * buffer, size_t bytes, int flags,
+                             struct stream_stats_call *call)
 {
     int ret = 0;
     if(flags & PCM_MMAP)
@@ -1122,6 +1484,7 @@ static int pcm_write_wrapper(struct pcm *pcm, const void * buffer, size_t bytes,
          switch(pcm_state(pcm)) {
               case PCM_STATE_SETUP:
               case PCM_STATE_XRUN:
+                   stream_stats_xrun(call);
                    ret = pcm_prepare(pcm);
                    if(ret != 0) return ret;
                    break;
@@ -1138,40 +1501,65 @@ static int pcm_write_wrapper(struct pcm *pcm, const void * buffer, size_t bytes,
     return ret;
 }
 
-static ssize_t out_write_primary(struct audio_stream_out *stream, const void* buffer,
-                         size_t bytes)
+/* sleeps until no more than write_threshold frames are left in the kernel
+ * buffer, a threshold below the buffer size keeps the queue short while
+ * the remaining periods absorb scheduling jitter */
+static void out_wait_write_threshold(struct imx_stream_out *out, int pcm_id)
+{
+    struct pcm *pcm = out->pcm[pcm_id];
+    int total_sleep_time_us = 0;
+    unsigned int avail;
+    struct timespec time_stamp;
+
+    while (pcm_get_htimestamp(pcm, &avail, &time_stamp) == 0) {
+        int kernel_frames = pcm_get_buffer_size(pcm) - avail;
+        int sleep_time_us;
+
+        if (kernel_frames <= out->write_threshold[pcm_id])
+            break;
+        sleep_time_us = (int)(((int64_t)(kernel_frames - out->write_threshold[pcm_id])
+                                * 1000000) / out->config[pcm_id].rate);
+        if (sleep_time_us < MIN_FAST_WRITE_SLEEP_US)
+            break;
+        total_sleep_time_us += sleep_time_us;
+        if (total_sleep_time_us > MAX_WRITE_SLEEP_US) {
+            ALOGV("out_wait_write_threshold() limiting sleep time %d to %d",
+                  total_sleep_time_us, MAX_WRITE_SLEEP_US);
+            break;
+        }
+        usleep(sleep_time_us);
+    }
+}
+
+/* how long the frames just written wait in the pcm before they are heard,
+ * the pcms are opened without PCM_MONOTONIC so their stamps are wall clock */
+static void out_stats_latency(struct imx_stream_out *out, struct stream_stats_call *call)
+{
+    int64_t render_ns;
+    struct timespec now;
+
+    if (get_playback_time(out, &render_ns) != 0)
+        return;
+    clock_gettime(CLOCK_REALTIME, &now);
+    render_ns -= (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+    call->latency_ns = render_ns > 0 ? render_ns : 0;
+}
+
+/* resamples frames for the pcms that need it and writes them to all of
+ * them, returns the error of the first pcm that fails.
+ * must be called with output stream mutex locked */
+static int out_write_frames(struct imx_stream_out *out, const void *buffer, size_t in_frames,
+                            struct stream_stats_call *call)
 {
-    int ret;
-    struct imx_stream_out *out = (struct imx_stream_out *)stream;
     struct imx_audio_device *adev = out->dev;
     size_t frame_size = audio_stream_frame_size(&out->stream.common);
-    size_t in_frames = bytes / frame_size;
+    size_t frames = in_frames;
     size_t out_frames = in_frames;
-    bool force_input_standby = false;
-    struct imx_stream_in *in;
+    int ret = 0;
     int i;
-    /* acquiring hw device mutex systematically is useful if a low priority thread is waiting
-     * on the output stream mutex - e.g. executing select_mode() while holding the hw device
-     * mutex
-     */
-    pthread_mutex_lock(&adev->lock);
-    pthread_mutex_lock(&out->lock);
-    if (out->standby) {
-        ret = start_output_stream_primary(out);
-        if (ret != 0) {
-            pthread_mutex_unlock(&adev->lock);
-            goto exit;
-        }
-        out->standby = 0;
-        /* a change in output device may change the microphone selection */
-        if (adev->active_input &&
-                adev->active_input->source == AUDIO_SOURCE_VOICE_COMMUNICATION)
-            force_input_standby = true;
-    }
-    pthread_mutex_unlock(&adev->lock);
 
     /* only use resampler if required */
-    for (i = 0; i < PCM_TOTAL; i++) {
+    for (i = 0; i < PCM_TOTAL && out->resampler; i++) {
         /* only use resampler if required */
         if (out->pcm[i] && (out->config[i].rate != adev->default_rate)) {
             out_frames = out->buffer_frames;
@@ -1184,29 +1572,134 @@ static ssize_t out_write_primary(struct audio_stream_out *stream, const void* bu
         }
     }
 
-    if (out->echo_reference != NULL) {
-        struct echo_reference_buffer b;
-        b.raw = (void *)buffer;
-        b.frame_count = in_frames;
+    if (out->echo_reference != NULL) {
+        int64_t render_ns;
+
+        /* the pcm has no time before it starts, the frames then follow
+         * those of the stamp before */
+        if (get_playback_time(out, &render_ns) != 0)
+            render_ns = -1;
+        echo_ref_write(out->echo_reference, (const int16_t *)buffer, in_frames, render_ns);
+    }
+    /* do not allow more than out->write_threshold frames in kernel pcm driver buffer */
+    /* Write to all active PCMs */
+    for (i = 0; i < PCM_TOTAL; i++) {
+        if (out->pcm[i]) {
+            if (out->writer[i]) {
+                /* queued for the writer thread, never blocks */
+                if (!out->resampler || out->config[i].rate == adev->default_rate)
+                    pcm_writer_write(out->writer[i], buffer, frames);
+                else
+                    pcm_writer_write(out->writer[i], out->buffer, out_frames);
+                continue;
+            }
+            if (out->write_threshold[i] < (int)pcm_get_buffer_size(out->pcm[i]))
+                out_wait_write_threshold(out, i);
+            if (!out->resampler || out->config[i].rate == adev->default_rate) {
+                /* PCM uses native sample rate */
+                ret = pcm_write_wrapper(out->pcm[i], (void *)buffer, frames * frame_size,
+                                        out->write_flags[i], call);
+            } else {
+                /* PCM needs resampler */
+                ret = pcm_write_wrapper(out->pcm[i], (void *)out->buffer, out_frames * frame_size,
+                                        out->write_flags[i], call);
+            }
+            if (ret)
+                break;
+        }
+   }
+    return ret;
+}
+
+/* the frames the primary output left unmixed when it stopped, played
+ * first once the deep buffer output has the codec pcm back.
+ * must be called with output stream mutex locked */
+static void out_mix_replay(struct imx_stream_out *out, struct stream_stats_call *call)
+{
+    struct out_mix_ring *mix = &out->dev->mix;
+    int16_t *frames = (int16_t *)(out->buffer +
+                                  out->buffer_frames * audio_stream_frame_size(&out->stream.common));
+    size_t pos, count, first, n;
+
+    pthread_mutex_lock(&mix->lock);
+    pos = mix->tail;
+    count = mix->head - mix->tail;
+    mix->tail = mix->head;
+    mix->opened = pos;
+    pthread_mutex_unlock(&mix->lock);
+
+    ALOGV_IF(count > 0, "replaying %zu deep buffer frames", count);
+    /* the ring only changes through this output, which holds its mutex */
+    while (count > 0) {
+        n = MIN(count, out->mm_config->period_size);
+        first = MIN(n, mix->size - (pos & (mix->size - 1)));
+        memcpy(frames, mix->buf + (pos & (mix->size - 1)) * 2, first * 2 * sizeof(int16_t));
+        memcpy(frames + first * 2, mix->buf, (n - first) * 2 * sizeof(int16_t));
+        if (out_write_frames(out, frames, n, call) != 0)
+            break;
+        pos += n;
+        count -= n;
+    }
+}
+
+static ssize_t out_write_primary(struct audio_stream_out *stream, const void* buffer,
+                         size_t bytes)
+{
+    int ret = 0;
+    struct imx_stream_out *out = (struct imx_stream_out *)stream;
+    struct imx_audio_device *adev = out->dev;
+    struct stream_stats_call call;
+    bool adev_locked;
+    size_t frame_size = audio_stream_frame_size(&out->stream.common);
+    size_t in_frames = bytes / frame_size;
+    bool force_input_standby = false;
+    struct imx_stream_in *in;
+    /* the hw device mutex is only taken to start the output, or to hand it over to a
+     * thread waiting for the output stream mutex while holding the hw device mutex -
+     * e.g. executing select_mode()
+     */
+    stream_stats_begin(&call);
+    adev_locked = out_lock_write(out, &call);
+    if (out == adev->active_output[OUTPUT_DEEP_BUF] && out_mix_is_active(&adev->mix)) {
+        /* the primary output owns the codec pcm, it plays these frames */
+        if (adev_locked)
+            pthread_mutex_unlock(&adev->lock);
+        out_mix_push(&adev->mix, (const int16_t *)buffer, in_frames, out->mm_config->rate);
+        pthread_mutex_unlock(&out->lock);
+        stream_stats_end(&out->stats, &call, in_frames, out->mm_config->rate, 0);
+        return bytes;
+    }
+    if (out->standby) {
+        ret = start_output_stream_primary(out);
+        if (ret != 0) {
+            pthread_mutex_unlock(&adev->lock);
+            goto exit;
+        }
+        out->standby = 0;
+        if (out == adev->active_output[OUTPUT_DEEP_BUF])
+            out_mix_replay(out, &call);
+        /* a change in output device may change the microphone selection */
+        if (adev->active_input &&
+                adev->active_input->source == AUDIO_SOURCE_VOICE_COMMUNICATION)
+            force_input_standby = true;
+    }
+    if (adev_locked)
+        pthread_mutex_unlock(&adev->lock);
+
+    if (out == adev->active_output[OUTPUT_PRIMARY] && in_frames <= out->buffer_frames) {
+        /* the caller's buffer is const, the mix goes into our own copy */
+        int16_t *mixed = (int16_t *)(out->buffer + out->buffer_frames * frame_size);
 
-        get_playback_delay(out, out_frames, &b);
-        out->echo_reference->write(out->echo_reference, &b);
+        if (out_mix_pull(&adev->mix, mixed, (const int16_t *)buffer, in_frames))
+            buffer = mixed;
     }
-    /* do not allow more than out->write_threshold frames in kernel pcm driver buffer */
-    /* Write to all active PCMs */
-    for (i = 0; i < PCM_TOTAL; i++) {
-        if (out->pcm[i]) {
-            if (out->config[i].rate == adev->default_rate) {
-                /* PCM uses native sample rate */
-                ret = pcm_write_wrapper(out->pcm[i], (void *)buffer, bytes, out->write_flags[i]);
-            } else {
-                /* PCM needs resampler */
-                ret = pcm_write_wrapper(out->pcm[i], (void *)out->buffer, out_frames * frame_size, out->write_flags[i]);
-            }
-            if (ret)
-                break;
-        }
-   }
+
+    ret = out_write_frames(out, buffer, in_frames, &call);
+    if (ret == 0 && out == adev->active_output[OUTPUT_DEEP_BUF])
+        out_mix_keep(&adev->mix, (const int16_t *)buffer, in_frames);
+
+    if (ret == 0)
+        out_stats_latency(out, &call);
 
 exit:
     pthread_mutex_unlock(&out->lock);
@@ -1227,6 +1720,8 @@ exit:
         }
         pthread_mutex_unlock(&adev->lock);
     }
+    stream_stats_end(&out->stats, &call, bytes / audio_stream_frame_size(&stream->common),
+                     out_get_sample_rate(&stream->common), ret);
     return bytes;
 }
 
@@ -1236,15 +1731,17 @@ static ssize_t out_write_hdmi(struct audio_stream_out *stream, const void* buffe
     int ret;
     struct imx_stream_out *out = (struct imx_stream_out *)stream;
     struct imx_audio_device *adev = out->dev;
+    struct stream_stats_call call;
+    bool adev_locked;
     size_t frame_size = audio_stream_frame_size(&out->stream.common);
     size_t in_frames = bytes / frame_size;
 
-    /* acquiring hw device mutex systematically is useful if a low priority thread is waiting
-     * on the output stream mutex - e.g. executing select_mode() while holding the hw device
-     * mutex
+    /* the hw device mutex is only taken to start the output, or to hand it over to a
+     * thread waiting for the output stream mutex while holding the hw device mutex -
+     * e.g. executing select_mode()
      */
-    pthread_mutex_lock(&adev->lock);
-    pthread_mutex_lock(&out->lock);
+    stream_stats_begin(&call);
+    adev_locked = out_lock_write(out, &call);
     if (out->standby) {
         ret = start_output_stream_hdmi(out);
         if (ret != 0) {
@@ -1253,11 +1750,16 @@ static ssize_t out_write_hdmi(struct audio_stream_out *stream, const void* buffe
         }
         out->standby = 0;
     }
-    pthread_mutex_unlock(&adev->lock);
+    if (adev_locked)
+        pthread_mutex_unlock(&adev->lock);
 
     /* do not allow more than out->write_threshold frames in kernel pcm driver buffer */
 
-    ret = pcm_write_wrapper(out->pcm[PCM_HDMI], (void *)buffer, bytes, out->write_flags[PCM_HDMI]);
+    ret = pcm_write_wrapper(out->pcm[PCM_HDMI], (void *)buffer, bytes, out->write_flags[PCM_HDMI],
+                            &call);
+
+    if (ret == 0)
+        out_stats_latency(out, &call);
 
 exit:
     pthread_mutex_unlock(&out->lock);
@@ -1268,58 +1770,64 @@ exit:
                out_get_sample_rate(&stream->common));
     }
 
+    stream_stats_end(&out->stats, &call, bytes / audio_stream_frame_size(&stream->common),
+                     out_get_sample_rate_hdmi(&stream->common), ret);
     return bytes;
 }
 
-/********************************************************************************************************
-For esai, it will use the first channels/2 for Left channels, use second half channels for Right channels.
-So we need to transform channel map in HAL for multichannel.
-when input is "FL, FR, C, LFE, BL, BR, SL, SR", output is "FL,BL,C,FR,BR,LFE".
-when input is "FL, FR, C, LFE, BL, BR, SL, SR", output is "FL,BL,C,SL,FR,BR,LFE,SR"
-*********************************************************************************************************/
-static void convert_output_for_esai(const void* buffer, size_t bytes, int channels)
+static ssize_t out_write_iec61937(struct audio_stream_out *stream, const void* buffer,
+                         size_t bytes)
 {
-    short *data_src = (short *)buffer;
-    short *data_dst = (short *)buffer;
-    short dataFL,dataFR,dataC,dataLFE,dataBL,dataBR,dataSL,dataSR;
-    int i;
-
-    if (channels == 6) {
-        for (i = 0; i < (int)bytes/(2*channels); i++ ) {
-           dataFL  = *data_src++;
-           dataFR  = *data_src++;
-           dataC   = *data_src++;
-           dataLFE = *data_src++;
-           dataBL  = *data_src++;
-           dataBR  = *data_src++;
-           *data_dst++ = dataFL;
-           *data_dst++ = dataBL;
-           *data_dst++ = dataC;
-           *data_dst++ = dataFR;
-           *data_dst++ = dataBR;
-           *data_dst++ = dataLFE;
-        }
-    }
-    else if (channels == 8) {
-        for (i = 0; i < (int)bytes/(2*channels); i++ ) {
-           dataFL  = *data_src++;
-           dataFR  = *data_src++;
-           dataC   = *data_src++;
-           dataLFE = *data_src++;
-           dataBL  = *data_src++;
-           dataBR  = *data_src++;
-           dataSL  = *data_src++;
-           dataSR  = *data_src++;
-           *data_dst++ = dataFL;
-           *data_dst++ = dataBL;
-           *data_dst++ = dataC;
-           *data_dst++ = dataSL;
-           *data_dst++ = dataFR;
-           *data_dst++ = dataBR;
-           *data_dst++ = dataLFE;
-           *data_dst++ = dataSR;
+    int ret = 0;
+    struct imx_stream_out *out = (struct imx_stream_out *)stream;
+    struct imx_audio_device *adev = out->dev;
+    struct stream_stats_call call;
+    bool adev_locked;
+    const uint8_t *data = (const uint8_t *)buffer;
+    const void *burst;
+    size_t burst_bytes;
+    size_t used = 0;
+
+    /* the hw device mutex is only taken to start the output, or to hand it over */
+    stream_stats_begin(&call);
+    adev_locked = out_lock_write(out, &call);
+    if (out->standby) {
+        ret = start_output_stream_hdmi(out);
+        if (ret != 0) {
+            pthread_mutex_unlock(&adev->lock);
+            goto exit;
         }
+        out->standby = 0;
+    }
+    if (adev_locked)
+        pthread_mutex_unlock(&adev->lock);
+
+    /* frames may straddle writes, every burst completed is played as it
+     * is, the pcm paces the stream at the burst repetition period */
+    while (used < bytes) {
+        used += iec61937_feed(out->iec, data + used, bytes - used, &burst, &burst_bytes);
+        if (burst_bytes == 0)
+            continue;
+        ret = pcm_write_wrapper(out->pcm[PCM_HDMI], burst, burst_bytes,
+                                out->write_flags[PCM_HDMI], &call);
+        if (ret != 0)
+            break;
+    }
+
+    if (ret == 0)
+        out_stats_latency(out, &call);
+
+exit:
+    pthread_mutex_unlock(&out->lock);
+
+    if (ret != 0) {
+        ALOGV("write error, sleep few ms");
+        usleep(out->iec->period * 1000000 / out->config[PCM_HDMI].rate);
     }
+
+    stream_stats_end(&out->stats, &call, bytes / audio_stream_frame_size(&stream->common),
+                     out_get_sample_rate_hdmi(&stream->common), ret);
+    return bytes;
 }
 
 static ssize_t out_write_esai(struct audio_stream_out *stream, const void* buffer,
@@ -1328,15 +1836,17 @@ static ssize_t out_write_esai(struct audio_stream_out *stream, const void* buffe
     int ret;
     struct imx_stream_out *out = (struct imx_stream_out *)stream;
     struct imx_audio_device *adev = out->dev;
+    struct stream_stats_call call;
+    bool adev_locked;
     size_t frame_size = audio_stream_frame_size(&out->stream.common);
     size_t in_frames = bytes / frame_size;
 
-    /* acquiring hw device mutex systematically is useful if a low priority thread is waiting
-     * on the output stream mutex - e.g. executing select_mode() while holding the hw device
-     * mutex
+    /* the hw device mutex is only taken to start the output, or to hand it over to a
+     * thread waiting for the output stream mutex while holding the hw device mutex -
+     * e.g. executing select_mode()
      */
-    pthread_mutex_lock(&adev->lock);
-    pthread_mutex_lock(&out->lock);
+    stream_stats_begin(&call);
+    adev_locked = out_lock_write(out, &call);
     if (out->standby) {
         ret = start_output_stream_esai(out);
         if (ret != 0) {
@@ -1345,12 +1855,19 @@ static ssize_t out_write_esai(struct audio_stream_out *stream, const void* buffe
         }
         out->standby = 0;
     }
-    pthread_mutex_unlock(&adev->lock);
+    if (adev_locked)
+        pthread_mutex_unlock(&adev->lock);
 
     /* do not allow more than out->write_threshold frames in kernel pcm driver buffer */
 
-    convert_output_for_esai(buffer, bytes, out->config[PCM_ESAI].channels);
-    ret = pcm_write_wrapper(out->pcm[PCM_ESAI], (void *)buffer, bytes, out->write_flags[PCM_ESAI]);
+    if (out->channel_map)
+        audio_conv_remap((int16_t *)buffer, (const int16_t *)buffer, out->channel_map,
+                         out->config[PCM_ESAI].channels, in_frames);
+    ret = pcm_write_wrapper(out->pcm[PCM_ESAI], (void *)buffer, bytes, out->write_flags[PCM_ESAI],
+                            &call);
+
+    if (ret == 0)
+        out_stats_latency(out, &call);
 
 exit:
     pthread_mutex_unlock(&out->lock);
@@ -1361,6 +1878,8 @@ exit:
                out_get_sample_rate(&stream->common));
     }
 
+    stream_stats_end(&out->stats, &call, bytes / audio_stream_frame_size(&stream->common),
+                     out_get_sample_rate_esai(&stream->common), ret);
     return bytes;
 }
 
@@ -1384,24 +1903,24 @@ static int out_remove_audio_effect(const struct audio_stream *stream, effect_han
 /** audio_stream_in implementation **/
 
 /* must be called with hw device and input stream mutexes locked */
-static int start_input_stream(struct imx_stream_in *in)
+/* opens the capture pcm of card card_idx into cap for the inputs to
+ * share, with the setup of in.
+ * must be called with hw device and input stream mutexes locked */
+static int open_capture(struct imx_stream_in *in, struct imx_capture *cap, int card_idx)
 {
-    int ret = 0;
     struct imx_audio_device *adev = in->dev;
     unsigned int card = -1;
     unsigned int port = 0;
     struct mixer *mixer;
+    struct pcm *pcm;
     int rate = 0, channels = 0, format = 0;
 
-    ALOGW("start_input_stream....");
-
-    adev->active_input = in;
-    if (adev->mode != AUDIO_MODE_IN_CALL) {
-        adev->in_device = in->device;
-        select_input_device(adev);
-    }
+    /* a USB card plugged or changed since the last scan */
+    if ((in->device & AUDIO_DEVICE_IN_USB_DEVICE) &&
+            card_monitor_generation(adev->monitor) != adev->card_generation)
+        scan_available_device(adev, false);
 
-    card = adev->card_list[VT1613_AUDIO_CARD_IDX]->card;
+    card = adev->card_list[card_idx]->card;
     port = 0;
 
     /*Error handler for usb mic plug in/plug out when recording. */
@@ -1435,17 +1954,13 @@ static int start_input_stream(struct imx_stream_in *in)
     ALOGW("rate %d, channel %d format %d, period_size 0x%x", in->config.rate, in->config.channels, 
                                  in->config.format, in->config.period_size);
 
-    if (in->need_echo_reference && in->echo_reference == NULL)
-        in->echo_reference = get_echo_reference(adev,
-                                        AUDIO_FORMAT_PCM_16_BIT,
-                                        in->requested_channel,
-                                        in->requested_rate);
-
     /* this assumes routing is done previously */
-    in->pcm = pcm_open(card, port, PCM_IN, &in->config);
-    if (!pcm_is_ready(in->pcm)) {
-        ALOGE("cannot open pcm_in driver: %s", pcm_get_error(in->pcm));
-        pcm_close(in->pcm);
+    pcm = card_monitor_take_pcm(adev->monitor, card, &in->config);
+    if (!pcm)
+        pcm = pcm_open(card, port, PCM_IN, &in->config);
+    if (!pcm_is_ready(pcm)) {
+        ALOGE("cannot open pcm_in driver: %s", pcm_get_error(pcm));
+        pcm_close(pcm);
         /*workaround for some usb camera (V-UBM46). the issue is that:
           open camerarecorder,recording, suspend, resumed, recording. sometimes the audio input
           will be failed to open.
@@ -1454,30 +1969,171 @@ static int start_input_stream(struct imx_stream_in *in)
           and reopen also failed.
           But if open and close the mixer here then the input will be opened successfully.
         */
-        if(!strcmp(adev->card_list[VT1613_AUDIO_CARD_IDX]->driver_name, "USB-Audio")) {
+        if(!strcmp(adev->card_list[card_idx]->driver_name, "USB-Audio")) {
                 mixer = mixer_open(card);
                 mixer_close(mixer);
         }
-        adev->active_input = NULL;
         return -ENOMEM;
     }
 
+    cap->reader = pcm_reader_open(pcm, &in->config);
+    if (!cap->reader) {
+        pcm_close(pcm);
+        return -ENOMEM;
+    }
+    cap->pcm = pcm;
+    cap->config = in->config;
+    return 0;
+}
+
+/* must be called with hw device and input stream mutexes locked */
+static void close_capture(struct imx_capture *cap)
+{
+    pcm_reader_close(cap->reader);
+    pcm_close(cap->pcm);
+    cap->reader = NULL;
+    cap->pcm = NULL;
+}
+
+/* no card captures the device of in: for the loopback test, it hears the
+ * output delay_ms late through the echo reference, as with a cable from
+ * the line out to the line in.
+ * must be called with hw device and input stream mutexes locked */
+static int start_input_loopback(struct imx_stream_in *in, int delay_ms)
+{
+    struct imx_audio_device *adev = in->dev;
+
+    if (in->requested_format != PCM_FORMAT_S16_LE)
+        return -EINVAL;
+
+    if (in->echo_reference == NULL && adev->echo_reference == NULL)
+        in->echo_reference = get_echo_reference(adev,
+                                        AUDIO_FORMAT_PCM_16_BIT,
+                                        in->requested_channel,
+                                        in->requested_rate);
+    if (in->echo_reference == NULL) {
+        ALOGE("echo loopback needs the primary output playing");
+        return -ENODEV;
+    }
+
+    ALOGI("echo loopback: device 0x%x hears the output %d ms late", in->device, delay_ms);
+    in->loopback = true;
+    in->loopback_delay_ns = (int64_t)delay_ms * 1000000;
+    in->loopback_start = 0;
+    return 0;
+}
+
+static int start_input_stream(struct imx_stream_in *in)
+{
+    int ret = 0;
+    struct imx_audio_device *adev = in->dev;
+    struct imx_capture *cap = NULL;
+    int loopback_delay;
+    int card_idx, route;
+    int i, j;
+
+    ALOGW("start_input_stream....");
+
+    loopback_delay = get_echo_loopback_delay();
+    in->echo_measure = loopback_delay >= 0;
+    in->proc_frame = 0;
+    in->ref_frame = 0;
+    if (in->echo_measure && find_input_card(adev, in->device) < 0)
+        return start_input_loopback(in, loopback_delay);
+
+    for (i = 0; i < MAX_CAPTURE_CLIENTS; i++) {
+        if (adev->capture_clients[i] == NULL)
+            break;
+    }
+    if (i == MAX_CAPTURE_CLIENTS) {
+        ALOGE("%d inputs capture already", MAX_CAPTURE_CLIENTS);
+        return -EBUSY;
+    }
+
+    /* a card captures one device through one route at a time, an input
+     * joins the pcm of its card only when it wants the same */
+    card_idx = get_input_card(adev, in->device);
+    route = get_input_route(adev, in->device, in->source);
+    for (j = 0; j < MAX_AUDIO_CARD_NUM; j++) {
+        if (adev->captures[j].reader != NULL && adev->captures[j].card_idx == card_idx)
+            cap = &adev->captures[j];
+    }
+    if (cap != NULL && (cap->device != in->device || cap->route != route)) {
+        ALOGE("card %d captures device 0x%x route %d, not 0x%x route %d",
+              adev->card_list[card_idx]->card, cap->device, cap->route, in->device, route);
+        return -EBUSY;
+    }
+
+    if (cap == NULL) {
+        for (j = 0; j < MAX_AUDIO_CARD_NUM && adev->captures[j].reader != NULL; j++);
+        if (j == MAX_AUDIO_CARD_NUM)
+            return -EBUSY;
+        cap = &adev->captures[j];
+
+        if (adev->mode != AUDIO_MODE_IN_CALL)
+            set_input_route(adev, card_idx, route);
+        ret = open_capture(in, cap, card_idx);
+        if (ret != 0) {
+            if (adev->mode != AUDIO_MODE_IN_CALL)
+                set_input_route(adev, card_idx, INPUT_ROUTE_NONE);
+            return ret;
+        }
+        cap->card_idx = card_idx;
+        cap->device = in->device;
+        cap->route = route;
+        cap->clients = 0;
+    } else {
+        in->config = cap->config;
+    }
+
+    /* the input started last picks the microphone */
+    adev->active_input = in;
+    if (adev->mode != AUDIO_MODE_IN_CALL)
+        adev->in_device = in->device;
+
+    in->shared = cap;
+    cap->clients++;
+    in->pcm = cap->pcm;
+    in->last_time_of_xrun = pcm_get_time_of_xrun(in->pcm);
+    pcm_reader_attach(cap->reader, &in->capture);
+    adev->capture_clients[i] = in;
+
+    /* the output feeds a single echo reference, an input starting while
+     * another holds it runs its effects without */
+    if (in->need_echo_reference && in->echo_reference == NULL &&
+            adev->echo_reference == NULL)
+        in->echo_reference = get_echo_reference(adev,
+                                        AUDIO_FORMAT_PCM_16_BIT,
+                                        in->requested_channel,
+                                        in->requested_rate);
+
+    if (audio_conv_init(&in->conv, in->config.format, in->config.channels,
+                        in->requested_format, in->requested_channel) != 0) {
+        ALOGW("no conversion from format %d channels %d to format %d channels %d",
+              in->config.format, in->config.channels,
+              in->requested_format, in->requested_channel);
+        memset(&in->conv, 0, sizeof(in->conv));
+    }
+
     in->read_buf_frames = 0;
     in->read_buf_size   = 0;
     in->proc_buf_frames = 0;
     in->proc_buf_size = 0;
 
     if (in->resampler) {
-        release_resampler(in->resampler);
+        audio_resampler_release(in->resampler);
+        in->resampler = NULL;
     }
     if (in->requested_rate != in->config.rate) {
         in->buf_provider.get_next_buffer = get_next_buffer;
         in->buf_provider.release_buffer = release_buffer;
 
-        ret = create_resampler(in->config.rate,
+        /* voice is band limited anyway, a short filter keeps its delay down */
+        ret = audio_resampler_create(in->config.rate,
                                in->requested_rate,
                                in->requested_channel,
-                               RESAMPLER_QUALITY_DEFAULT,
+                               get_resampler_quality(in->source == AUDIO_SOURCE_VOICE_COMMUNICATION ?
+                                                     RESAMPLER_QUALITY_VOIP : RESAMPLER_QUALITY_DEFAULT),
                                &in->buf_provider,
                                &in->resampler);
     }
@@ -1546,22 +2202,37 @@ static int in_set_format(struct audio_stream *stream, audio_format_t format)
 static int do_input_standby(struct imx_stream_in *in)
 {
     struct imx_audio_device *adev = in->dev;
+    struct imx_stream_in *next = NULL;
+    int i;
 
     if (!in->standby) {
         ALOGW("do_in_standby..");
-        pcm_close(in->pcm);
+        for (i = 0; i < MAX_CAPTURE_CLIENTS; i++) {
+            if (adev->capture_clients[i] == in)
+                adev->capture_clients[i] = NULL;
+            else if (adev->capture_clients[i] != NULL && next == NULL)
+                next = adev->capture_clients[i];
+        }
+        /* the pcm and the route of a card stop with the last input
+         * reading it, the other cards keep theirs */
         in->pcm = NULL;
+        if (in->shared != NULL && --in->shared->clients == 0) {
+            close_capture(in->shared);
+            if (adev->mode != AUDIO_MODE_IN_CALL)
+                set_input_route(adev, in->shared->card_idx, INPUT_ROUTE_NONE);
+        }
+        in->shared = NULL;
+        in->loopback = false;
         in->last_time_of_xrun = 0;
 
-        adev->active_input = 0;
-        if (adev->mode != AUDIO_MODE_IN_CALL) {
-            adev->in_device = AUDIO_DEVICE_NONE;
-            select_input_device(adev);
+        if (adev->active_input == in) {
+            adev->active_input = next;
+            if (adev->mode != AUDIO_MODE_IN_CALL)
+                adev->in_device = next ? next->device : AUDIO_DEVICE_NONE;
         }
 
         if (in->echo_reference != NULL) {
             /* stop reading from echo reference */
-            in->echo_reference->read(in->echo_reference, NULL);
             put_echo_reference(adev, in->echo_reference);
             in->echo_reference = NULL;
         }
@@ -1586,6 +2257,17 @@ static int in_standby(struct audio_stream *stream)
 
 static int in_dump(const struct audio_stream *stream, int fd)
 {
+    struct imx_stream_in *in = (struct imx_stream_in *)stream;
+
+    pthread_mutex_lock(&in->lock);
+    if (!in->standby && !in->loopback)
+        pcm_reader_dump(in->shared->reader, &in->capture, fd);
+    if (in->resampler)
+        dump_resampler(in->resampler, fd);
+    if (in->echo_reference)
+        echo_ref_dump(in->echo_reference, fd);
+    pthread_mutex_unlock(&in->lock);
+    stream_stats_dump(&in->stats, "read", fd);
     return 0;
 }
 
@@ -1648,33 +2330,29 @@ static int in_set_gain(struct audio_stream_in *stream, float gain)
     return 0;
 }
 
-static void get_capture_delay(struct imx_stream_in *in,
-                       size_t frames,
-                       struct echo_reference_buffer *buffer)
+/* time the first frame of proc_buf_in was captured: that of the stamp,
+ * less what was captured since and not processed yet */
+static int get_capture_time(struct imx_stream_in *in, int64_t *time_ns)
 {
 
-    /* read frames available in kernel driver buffer */
+    /* frames captured and not read yet, in the kernel driver buffer
+     * and the ring shared by the inputs */
     size_t kernel_frames;
     struct timespec tstamp;
-    long buf_delay;
-    long rsmp_delay;
-    long kernel_delay;
-    long delay_ns;
-
-    if (pcm_get_htimestamp(in->pcm, &kernel_frames, &tstamp) < 0) {
-        buffer->time_stamp.tv_sec  = 0;
-        buffer->time_stamp.tv_nsec = 0;
-        buffer->delay_ns           = 0;
-        ALOGW("read get_capture_delay(): pcm_htimestamp error");
-        return;
+    int64_t buf_delay;
+    int64_t rsmp_delay;
+    int64_t kernel_delay;
+
+    if (pcm_reader_get_delay(in->shared->reader, &in->capture, &kernel_frames, &tstamp) < 0) {
+        ALOGW("read get_capture_time(): pcm_htimestamp error");
+        return -ENODATA;
     }
 
     /* read frames available in audio HAL input buffer
      * add number of frames being read as we want the capture time of first sample
      * in current buffer */
-    buf_delay = (long)(((int64_t)(in->read_buf_frames) * 1000000000) / in->config.rate +
-                       ((int64_t)(in->proc_buf_frames) * 1000000000) /
-                           in->requested_rate);
+    buf_delay = (int64_t)in->read_buf_frames * 1000000000 / in->config.rate +
+                (int64_t)in->proc_buf_frames * 1000000000 / in->requested_rate;
 
     /* add delay introduced by resampler */
     rsmp_delay = 0;
@@ -1682,52 +2360,28 @@ static void get_capture_delay(struct imx_stream_in *in,
         rsmp_delay = in->resampler->delay_ns(in->resampler);
     }
 
-    kernel_delay = (long)(((int64_t)kernel_frames * 1000000000) / in->config.rate);
-
-    delay_ns = kernel_delay + buf_delay + rsmp_delay;
-
-    buffer->time_stamp = tstamp;
-    buffer->delay_ns   = delay_ns;
-    ALOGV("get_capture_delay time_stamp = [%ld].[%ld], delay_ns: [%d],"
-         " kernel_delay:[%ld], buf_delay:[%ld], rsmp_delay:[%ld], kernel_frames:[%d], "
-         "in->read_buf_frames:[%d], in->proc_buf_frames:[%d], frames:[%d]",
-         buffer->time_stamp.tv_sec , buffer->time_stamp.tv_nsec, buffer->delay_ns,
-         kernel_delay, buf_delay, rsmp_delay, kernel_frames,
-         in->read_buf_frames, in->proc_buf_frames, frames);
+    kernel_delay = (int64_t)kernel_frames * 1000000000 / in->config.rate;
 
+    *time_ns = (int64_t)tstamp.tv_sec * 1000000000 + tstamp.tv_nsec -
+               kernel_delay - buf_delay - rsmp_delay;
+    ALOGV("get_capture_time kernel_delay:[%lld], buf_delay:[%lld], rsmp_delay:[%lld], "
+          "kernel_frames:[%d], in->read_buf_frames:[%d], in->proc_buf_frames:[%d]",
+          kernel_delay, buf_delay, rsmp_delay, kernel_frames,
+          in->read_buf_frames, in->proc_buf_frames);
+    return 0;
 }
 
-static int32_t update_echo_reference(struct imx_stream_in *in, size_t frames)
+static int16_t *get_ref_buf(struct imx_stream_in *in, size_t frames)
 {
-    struct echo_reference_buffer b;
-    b.delay_ns = 0;
-
-    ALOGV("update_echo_reference, frames = [%d], in->ref_frames_in = [%d],  "
-          "b.frame_count = [%d]",
-         frames, in->ref_frames_in, frames - in->ref_frames_in);
-    if (in->ref_frames_in < frames) {
-        if (in->ref_buf_size < frames) {
-            in->ref_buf_size = frames;
-            in->ref_buf = (int16_t *)realloc(in->ref_buf,
-                                             in->ref_buf_size *
-                                                 in->requested_channel * sizeof(int16_t));
-        }
-
-        b.frame_count = frames - in->ref_frames_in;
-        b.raw = (void *)(in->ref_buf + in->ref_frames_in * in->requested_channel);
-
-        get_capture_delay(in, frames, &b);
-
-        if (in->echo_reference->read(in->echo_reference, &b) == 0)
-        {
-            in->ref_frames_in += b.frame_count;
-            ALOGV("update_echo_reference: in->ref_frames_in:[%d], "
-                    "in->ref_buf_size:[%d], frames:[%d], b.frame_count:[%d]",
-                 in->ref_frames_in, in->ref_buf_size, frames, b.frame_count);
-        }
-    } else
-        ALOGV("update_echo_reference: NOT enough frames to read ref buffer");
-    return b.delay_ns;
+    if (in->ref_buf_size < frames) {
+        in->ref_buf_size = frames;
+        in->ref_buf = (int16_t *)realloc(in->ref_buf,
+                                         in->ref_buf_size *
+                                             in->requested_channel * sizeof(int16_t));
+        ALOG_ASSERT((in->ref_buf != NULL),
+                    "get_ref_buf() failed to reallocate ref_buf");
+    }
+    return in->ref_buf;
 }
 
 static int set_preprocessor_param(effect_handle_t handle,
@@ -1765,16 +2419,29 @@ static int set_preprocessor_echo_delay(effect_handle_t handle,
 
 static void push_echo_reference(struct imx_stream_in *in, size_t frames)
 {
-    /* read frames from echo reference buffer and update echo delay
-     * in->ref_frames_in is updated with frames available in in->ref_buf */
-    int32_t delay_us = update_echo_reference(in, frames)/1000;
+    /* hands the effects the reference played while each of the frames in
+     * proc_buf_in was captured, once, before they process those frames */
+    uint64_t end = in->proc_frame + frames;
+    size_t count;
+    int64_t capture_ns;
     int i;
     audio_buffer_t buf;
 
-    if (in->ref_frames_in < frames)
-        frames = in->ref_frames_in;
+    if (in->ref_frame < in->proc_frame)
+        in->ref_frame = in->proc_frame;
+    if (in->ref_frame >= end)
+        return;
+    count = end - in->ref_frame;
+
+    if (get_capture_time(in, &capture_ns) == 0)
+        echo_ref_set_capture_time(in->echo_reference, in->proc_frame, capture_ns);
+    echo_ref_read(in->echo_reference, in->ref_frame, 0, get_ref_buf(in, count), count);
+    if (in->echo_measure)
+        echo_ref_measure(in->echo_reference,
+                         in->proc_buf_in + (in->ref_frame - in->proc_frame) * in->requested_channel,
+                         in->ref_buf, count);
 
-    buf.frameCount = frames;
+    buf.frameCount = count;
     buf.raw = in->ref_buf;
 
     for (i = 0; i < in->num_preprocessors; i++) {
@@ -1784,15 +2451,11 @@ static void push_echo_reference(struct imx_stream_in *in, size_t frames)
         (*in->preprocessors[i].effect_itfe)->process_reverse(in->preprocessors[i].effect_itfe,
                                                &buf,
                                                NULL);
-        set_preprocessor_echo_delay(in->preprocessors[i].effect_itfe, delay_us);
+        /* lined up on the capture already, only the acoustic path is left */
+        set_preprocessor_echo_delay(in->preprocessors[i].effect_itfe, 0);
     }
 
-    in->ref_frames_in -= buf.frameCount;
-    if (in->ref_frames_in) {
-        memcpy(in->ref_buf,
-               in->ref_buf + buf.frameCount * in->requested_channel,
-               in->ref_frames_in * in->requested_channel * sizeof(int16_t));
-    }
+    in->ref_frame = end;
 }
 
 static int get_next_buffer(struct resampler_buffer_provider *buffer_provider,
@@ -1824,7 +2487,7 @@ static int get_next_buffer(struct resampler_buffer_provider *buffer_provider,
                   in->read_buf, size_in_bytes);
         }
 
-        in->read_status = pcm_read_convert(in, in->pcm, (void*)in->read_buf, size_in_bytes);
+        in->read_status = pcm_read_convert(in, (void*)in->read_buf, size_in_bytes);
 
         if (in->read_status != 0) {
             ALOGE("get_next_buffer() pcm_read_convert error %d", in->read_status);
@@ -1972,6 +2635,7 @@ static ssize_t process_frames(struct imx_stream_in *in, void* buffer, ssize_t fr
          * in_buf.frameCount and out_buf.frameCount respectively
          * move remaining frames to the beginning of in->proc_buf */
         in->proc_buf_frames -= in_buf.frameCount;
+        in->proc_frame += in_buf.frameCount;
         if (in->proc_buf_frames) {
             memcpy(in->proc_buf_in,
                    in->proc_buf_in + in_buf.frameCount * in->requested_channel,
@@ -2022,6 +2686,54 @@ static ssize_t process_frames(struct imx_stream_in *in, void* buffer, ssize_t fr
     return frames_wr;
 }
 
+/* the loopback input: frames come in as the output plays them, a buffer
+ * is ready once its last frame is, and each is the output heard
+ * loopback_delay_ns before. The reference read for it measures how well
+ * both line up, and should lag by that delay. */
+static int in_read_loopback(struct imx_stream_in *in, void *buffer, size_t frames)
+{
+    struct timespec ts;
+    int64_t now, start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    if (in->loopback_start == 0)
+        in->loopback_start = now;
+
+    start = in->loopback_start +
+            (int64_t)(in->proc_frame / in->requested_rate) * 1000000000 +
+            (int64_t)(in->proc_frame % in->requested_rate) * 1000000000 / in->requested_rate;
+    end = start + (int64_t)frames * 1000000000 / in->requested_rate;
+    if (end > now) {
+        ts.tv_sec = end / 1000000000;
+        ts.tv_nsec = end % 1000000000;
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+    }
+
+    echo_ref_set_capture_time(in->echo_reference, in->proc_frame, start);
+    echo_ref_read(in->echo_reference, in->proc_frame, -in->loopback_delay_ns,
+                  (int16_t *)buffer, frames);
+    echo_ref_read(in->echo_reference, in->proc_frame, 0, get_ref_buf(in, frames), frames);
+    echo_ref_measure(in->echo_reference, (const int16_t *)buffer, in->ref_buf, frames);
+    in->proc_frame += frames;
+
+    return 0;
+}
+
+/* how long ago the frames just read were captured, on the clock of the
+ * capture stamps */
+static void in_stats_latency(struct imx_stream_in *in, struct stream_stats_call *call)
+{
+    int64_t capture_ns;
+    struct timespec now;
+
+    if (in->loopback || in->shared == NULL || get_capture_time(in, &capture_ns) != 0)
+        return;
+    clock_gettime(CLOCK_REALTIME, &now);
+    capture_ns = (int64_t)now.tv_sec * 1000000000 + now.tv_nsec - capture_ns;
+    call->latency_ns = capture_ns > 0 ? capture_ns : 0;
+}
+
 static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
                        size_t bytes)
 {
@@ -2029,13 +2741,15 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
     struct imx_stream_in *in = (struct imx_stream_in *)stream;
     struct imx_audio_device *adev = in->dev;
     size_t frames_rq = bytes / audio_stream_frame_size(&stream->common);
+    struct stream_stats_call call;
 
     /* acquiring hw device mutex systematically is useful if a low priority thread is waiting
      * on the input stream mutex - e.g. executing select_mode() while holding the hw device
      * mutex
      */
-    pthread_mutex_lock(&adev->lock);
-    pthread_mutex_lock(&in->lock);
+    stream_stats_begin(&call);
+    stream_stats_lock(&call, STREAM_STATS_ADEV, &adev->lock);
+    stream_stats_lock(&call, STREAM_STATS_STREAM, &in->lock);
     if (in->standby) {
         ret = start_input_stream(in);
         if (ret == 0) {
@@ -2048,12 +2762,14 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
     if (ret < 0)
         goto exit;
 
-    if (in->num_preprocessors != 0)
+    if (in->loopback)
+        ret = in_read_loopback(in, buffer, frames_rq);
+    else if (in->num_preprocessors != 0)
         ret = process_frames(in, buffer, frames_rq);
     else if (in->resampler != NULL)
         ret = read_frames(in, buffer, frames_rq);
     else
-        ret = pcm_read_convert(in, in->pcm, buffer, bytes);
+        ret = pcm_read_convert(in, buffer, bytes);
  
     if(ret < 0) ALOGW("ret %d, pcm read error %s.", ret, pcm_get_error(in->pcm));
 
@@ -2073,6 +2789,9 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
         }
     }
 
+    if (ret == 0)
+        in_stats_latency(in, &call);
+
 exit:
     if (ret < 0) {
         memset(buffer, 0, bytes);
@@ -2080,19 +2799,27 @@ exit:
                in_get_sample_rate(&stream->common));
     }
     pthread_mutex_unlock(&in->lock);
-    return bytes;
+    stream_stats_end(&in->stats, &call, frames_rq, in_get_sample_rate(&stream->common), ret);
+    /* an input its card cannot capture for now reads nothing, rather than
+     * silence the caller would take for its device */
+    return in->standby ? ret : (ssize_t)bytes;
 }
 
 static uint32_t in_get_input_frames_lost(struct audio_stream_in *stream)
 {
     int times, diff;
     struct imx_stream_in *in = (struct imx_stream_in *)stream;
+    uint32_t lost;
     if (in->pcm == NULL)  return 0;
     times = pcm_get_time_of_xrun(in->pcm);
     diff = times - in->last_time_of_xrun;
     ALOGW_IF((diff != 0), "in_get_input_frames_lost %d ms total %d ms\n",diff, times);
     in->last_time_of_xrun = times;
-    return diff * in->requested_rate / 1000;
+    /* and what the ring dropped while this input did not read */
+    lost = (uint64_t)in->capture.lost * in->requested_rate / in->config.rate;
+    ALOGW_IF((lost != 0), "in_get_input_frames_lost %u frames behind the ring", lost);
+    in->capture.lost = 0;
+    return diff * in->requested_rate / 1000 + lost;
 }
 
 #define GET_COMMAND_STATUS(status, fct_status, cmd_status) \
@@ -2479,46 +3206,40 @@ exit:
     return status;
 }
 
+/* capabilities of the HDMI card, as last cached by the card monitor */
+static int out_get_hdmi_caps(struct imx_audio_device *adev, struct card_caps *caps)
+{
+    int i;
+
+    for (i = 0; i < MAX_AUDIO_CARD_NUM; i ++) {
+         if(!strcmp(adev->card_list[i]->driver_name, hdmi_card.driver_name))
+             return card_monitor_get(adev->monitor, adev->card_list[i]->card, caps);
+    }
+    return -ENODEV;
+}
+
 static int out_read_hdmi_channel_masks(struct imx_audio_device *adev, struct imx_stream_out *out) {
 
     int count = 0;
-    int sup_channels[MAX_SUP_CHANNEL_NUM]; //temp buffer for supported channels
-    int card = -1;
     int i = 0;
     int j = 0;
-    struct mixer *mixer_hdmi = NULL;
-
-    for (i = 0; i < MAX_AUDIO_CARD_NUM; i ++) {
-         if(!strcmp(adev->card_list[i]->driver_name, hdmi_card.driver_name)) {
-             mixer_hdmi = adev->mixer[i];
-             card = adev->card_list[i]->card;
-             break;
-         }
-    }
+    struct card_caps caps;
 
-    if (mixer_hdmi) {
-        struct mixer_ctl *ctl;
-        ctl = mixer_get_ctl_by_name(mixer_hdmi, "HDMI Support Channels");
-        if (ctl) {
-            count = mixer_ctl_get_num_values(ctl);
-            for(i = 0; i < count; i ++) {
-                sup_channels[i] = mixer_ctl_get_value(ctl, i);
-                ALOGW("out_read_hdmi_channel_masks() card %d got %d sup channels", card, sup_channels[i]);
-            }
-        }
-    }
+    if (out_get_hdmi_caps(adev, &caps) == 0)
+        count = caps.hdmi_channel_count;
 
     /*when channel is 6, the mask is 5.1,when channel is 8, the mask is 7.1*/
-    for(i = 0; i < count; i++ ) {
-       if(sup_channels[i] == 2) {
+    for(i = 0; i < count && j < 3; i++ ) {
+       ALOGV("out_read_hdmi_channel_masks() got %d sup channels", caps.hdmi_channels[i]);
+       if(caps.hdmi_channels[i] == 2) {
           out->sup_channel_masks[j]   = AUDIO_CHANNEL_OUT_STEREO;
           j++;
        }
-       if(sup_channels[i] == 6) {
+       if(caps.hdmi_channels[i] == 6) {
           out->sup_channel_masks[j]   = AUDIO_CHANNEL_OUT_5POINT1;
           j++;
        }
-       if(sup_channels[i] == 8) {
+       if(caps.hdmi_channels[i] == 8) {
           out->sup_channel_masks[j]   = AUDIO_CHANNEL_OUT_7POINT1;
           j++;
        }
@@ -2532,30 +3253,86 @@ static int out_read_hdmi_channel_masks(struct imx_audio_device *adev, struct imx
 static int out_read_hdmi_rates(struct imx_audio_device *adev, struct imx_stream_out *out) {
 
     int count = 0;
-    int card = -1;
     int i = 0;
-    struct mixer *mixer_hdmi = NULL;
+    struct card_caps caps;
 
-    for (i = 0; i < MAX_AUDIO_CARD_NUM; i ++) {
-         if(!strcmp(adev->card_list[i]->driver_name, hdmi_card.driver_name)) {
-             mixer_hdmi = adev->mixer[i];
-             card = adev->card_list[i]->card;
-             break;
-         }
+    if (out_get_hdmi_caps(adev, &caps) == 0)
+        count = MIN(caps.hdmi_rate_count, MAX_SUP_RATE_NUM);
+
+    for(i = 0; i < count; i ++) {
+        out->sup_rates[i] = caps.hdmi_rates[i];
+        ALOGV("out_read_hdmi_rates() got %d sup rates", out->sup_rates[i]);
     }
 
-    if (mixer_hdmi) {
-        struct mixer_ctl *ctl;
-        ctl = mixer_get_ctl_by_name(mixer_hdmi, "HDMI Support Rates");
-        if (ctl) {
-            count = mixer_ctl_get_num_values(ctl);
-            for(i = 0; i < count; i ++) {
-                out->sup_rates[i] = mixer_ctl_get_value(ctl, i);
-                ALOGW("out_read_hdmi_rates() card %d got %d sup rates", card, out->sup_rates[i]);
-            }
+    return 0;
+}
+
+static int format_to_iec61937(audio_format_t format)
+{
+    switch (format) {
+    case FORMAT_IEC61937_AC3:
+        return IEC61937_AC3;
+    case FORMAT_IEC61937_E_AC3:
+        return IEC61937_EAC3;
+    case FORMAT_IEC61937_DTS:
+        return IEC61937_DTS;
+    default:
+        return -1;
+    }
+}
+
+/* passthrough goes to the HDMI card, or to S/PDIF on boards without one */
+static int out_open_iec61937(struct imx_audio_device *adev, struct imx_stream_out *out,
+                             struct audio_config *config)
+{
+    int codec = format_to_iec61937(config->format);
+    unsigned int rate;
+    int hdmi = -1;
+    int spdif = -1;
+    int i;
+
+    for (i = 0; i < MAX_AUDIO_CARD_NUM; i++) {
+        if (!strcmp(adev->card_list[i]->driver_name, hdmi_card.driver_name))
+            hdmi = i;
+        else if (!strcmp(adev->card_list[i]->driver_name, spdif_card.driver_name))
+            spdif = i;
+    }
+    if (hdmi < 0 && spdif < 0)
+        return -ENOSYS;
+
+    if (config->sample_rate == 0)
+        config->sample_rate = 48000;
+    config->channel_mask = AUDIO_CHANNEL_OUT_STEREO;
+    rate = codec == IEC61937_EAC3 ? config->sample_rate * 4 : config->sample_rate;
+
+    if (hdmi >= 0) {
+        out->iec_card = hdmi;
+        out_read_hdmi_rates(adev, out);
+        for (i = 0; i < MAX_SUP_RATE_NUM && out->sup_rates[i] != 0; i++) {
+            if (out->sup_rates[i] == (int)rate)
+                break;
+        }
+        if (i == MAX_SUP_RATE_NUM || out->sup_rates[i] == 0) {
+            ALOGW("HDMI sink does not take %d Hz for format 0x%x", rate, config->format);
+            return -EINVAL;
         }
+    } else {
+        /* legacy S/PDIF receivers stop at 48 kHz, which leaves out E-AC3 */
+        out->iec_card = spdif;
+        if (rate > 48000)
+            return -EINVAL;
     }
 
+    out->iec = (struct iec61937 *)malloc(sizeof(struct iec61937));
+    if (!out->iec)
+        return -ENOMEM;
+    iec61937_init(out->iec, codec);
+
+    out->format = config->format;
+    out->channel_mask = AUDIO_CHANNEL_OUT_STEREO;
+    out->config[PCM_HDMI] = pcm_config_hdmi_multi;
+    out->config[PCM_HDMI].rate = rate;
+    out->config[PCM_HDMI].channels = 2;
     return 0;
 }
 
@@ -2581,8 +3358,26 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
     out->sup_rates[0] = ladev->mm_rate;
     out->sup_channel_masks[0] = AUDIO_CHANNEL_OUT_STEREO;
     out->channel_mask = AUDIO_CHANNEL_OUT_STEREO;
+    out->mm_config = &pcm_config_mm_out;
 
     if (flags & AUDIO_OUTPUT_FLAG_DIRECT &&
+                   devices == AUDIO_DEVICE_OUT_AUX_DIGITAL &&
+                   format_to_iec61937(config->format) >= 0) {
+        ALOGW("adev_open_output_stream() IEC 61937 passthrough");
+        if (ladev->active_output[OUTPUT_HDMI] != NULL) {
+            ret = -ENOSYS;
+            goto err_open;
+        }
+        ret = out_open_iec61937(ladev, out, config);
+        if (ret != 0)
+            goto err_open;
+
+        output_type = OUTPUT_HDMI;
+        out->stream.common.get_buffer_size = out_get_buffer_size_hdmi;
+        out->stream.common.get_sample_rate = out_get_sample_rate_hdmi;
+        out->stream.get_latency = out_get_latency_hdmi;
+        out->stream.write = out_write_iec61937;
+    } else if (flags & AUDIO_OUTPUT_FLAG_DIRECT &&
                    devices == AUDIO_DEVICE_OUT_AUX_DIGITAL) {
         ALOGW("adev_open_output_stream() HDMI multichannel");
         if (ladev->active_output[OUTPUT_HDMI] != NULL) {
@@ -2629,6 +3424,28 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
         out->config[PCM_ESAI] = pcm_config_esai_multi;
         out->config[PCM_ESAI].rate = config->sample_rate;
         out->config[PCM_ESAI].channels = popcount(config->channel_mask);
+    } else if (flags & AUDIO_OUTPUT_FLAG_DEEP_BUFFER) {
+        ALOGV("adev_open_output_stream() deep buffer");
+        if (ladev->active_output[OUTPUT_DEEP_BUF] != NULL) {
+            ret = -ENOSYS;
+            goto err_open;
+        }
+        pthread_mutex_lock(&ladev->mix.lock);
+        if (ladev->mix.buf == NULL) {
+            ladev->mix.buf = (int16_t *)malloc(MIX_RING_FRAMES * 2 * sizeof(int16_t));
+            ladev->mix.size = MIX_RING_FRAMES;
+        }
+        pthread_mutex_unlock(&ladev->mix.lock);
+        if (ladev->mix.buf == NULL) {
+            ret = -ENOMEM;
+            goto err_open;
+        }
+        output_type = OUTPUT_DEEP_BUF;
+        out->mm_config = &pcm_config_mm_out_deep;
+        out->stream.common.get_buffer_size = out_get_buffer_size_primary;
+        out->stream.common.get_sample_rate = out_get_sample_rate;
+        out->stream.get_latency = out_get_latency_primary;
+        out->stream.write = out_write_primary;
     } else {
         ALOGV("adev_open_output_stream() normal buffer");
         if (ladev->active_output[OUTPUT_PRIMARY] != NULL) {
@@ -2636,20 +3453,25 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
             goto err_open;
         }
         output_type = OUTPUT_PRIMARY;
+        /* the fast output plays at the pcm rate, it never resamples */
+        if (flags & AUDIO_OUTPUT_FLAG_FAST)
+            out->mm_config = &pcm_config_mm_out_fast;
         out->stream.common.get_buffer_size = out_get_buffer_size_primary;
         out->stream.common.get_sample_rate = out_get_sample_rate;
         out->stream.get_latency = out_get_latency_primary;
         out->stream.write = out_write_primary;
     }
 
-    ret = create_resampler(ladev->default_rate,
-                           ladev->mm_rate,
-                           2,
-                           RESAMPLER_QUALITY_DEFAULT,
-                           NULL,
-                           &out->resampler);
-    if (ret != 0)
-        goto err_open;
+    if (out->mm_config != &pcm_config_mm_out_fast) {
+        ret = audio_resampler_create(ladev->default_rate,
+                               ladev->mm_rate,
+                               2,
+                               get_resampler_quality(RESAMPLER_QUALITY_DEFAULT),
+                               NULL,
+                               &out->resampler);
+        if (ret != 0)
+            goto err_open;
+    }
 
     out->stream.common.set_sample_rate  = out_set_sample_rate;
     out->stream.common.get_channels     = out_get_channels;
@@ -2686,6 +3508,7 @@ static int adev_open_output_stream(struct audio_hw_device *dev,
     return 0;
 
 err_open:
+    free(out->iec);
     free(out);
     *stream_out = NULL;
     return ret;
@@ -2711,7 +3534,8 @@ static void adev_close_output_stream(struct audio_hw_device *dev,
     if (out->buffer)
         free(out->buffer);
     if (out->resampler)
-        release_resampler(out->resampler);
+        audio_resampler_release(out->resampler);
+    free(out->iec);
     free(stream);
 }
 
@@ -2894,7 +3718,7 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
 
 err:
     if (in->resampler)
-        release_resampler(in->resampler);
+        audio_resampler_release(in->resampler);
 
     free(in);
     *stream_in = NULL;
@@ -2910,9 +3734,11 @@ static void adev_close_input_stream(struct audio_hw_device *dev,
 
     if (in->read_buf)
         free(in->read_buf);
+    if (in->read_tmp_buf)
+        free(in->read_tmp_buf);
 
     if (in->resampler) {
-        release_resampler(in->resampler);
+        audio_resampler_release(in->resampler);
     }
     if (in->proc_buf_in)
         free(in->proc_buf_in);
@@ -2927,17 +3753,23 @@ static void adev_close_input_stream(struct audio_hw_device *dev,
 
 static int adev_dump(const audio_hw_device_t *device, int fd)
 {
+    struct imx_audio_device *adev = (struct imx_audio_device *)device;
+
+    card_monitor_dump(adev->monitor, fd);
     return 0;
 }
 
 static int adev_close(hw_device_t *device)
 {
     struct imx_audio_device *adev = (struct imx_audio_device *)device;
-    int i;
-    for(i = 0; i < MAX_AUDIO_CARD_NUM; i++)
-        if(adev->mixer[i])
-            mixer_close(adev->mixer[i]);
 
+    /* closes the mixers too */
+    card_monitor_close(adev->monitor);
+
+    if (adev->mix.buf)
+        free(adev->mix.buf);
+    pthread_mutex_destroy(&adev->mix.lock);
+    pthread_cond_destroy(&adev->mix.cond);
     free(device);
     return 0;
 }
@@ -2948,7 +3780,7 @@ static int adev_get_rate_for_device(struct imx_audio_device *adev, uint32_t devi
      if (flag == PCM_OUT ) {
 	  return adev->card_list[out_dev_idx]->out_rate;
       } else {
-	  return adev->card_list[VT1613_AUDIO_CARD_IDX]->in_rate;
+	  return adev->card_list[get_input_card(adev, devices)]->in_rate;
       }
      return 0;
 }
@@ -2959,7 +3791,7 @@ static int adev_get_channels_for_device(struct imx_audio_device *adev, uint32_t
      if (flag == PCM_OUT ) {
 	  return adev->card_list[out_dev_idx]->out_channels;
       } else {
-	  return adev->card_list[VT1613_AUDIO_CARD_IDX]->in_channels;
+	  return adev->card_list[get_input_card(adev, devices)]->in_channels;
       }
      return 0;
 }
@@ -2970,7 +3802,7 @@ static int adev_get_format_for_device(struct imx_audio_device *adev, uint32_t de
      if (flag == PCM_OUT ) {
 	  return adev->card_list[out_dev_idx]->out_format;
       } else {
-	  return adev->card_list[VT1613_AUDIO_CARD_IDX]->in_format;
+	  return adev->card_list[get_input_card(adev, devices)]->in_format;
       }
      return 0;
 }
@@ -2981,13 +3813,13 @@ static int scan_available_device(struct imx_audio_device *adev, bool rescanusb)
     int m,n;
     bool found;
     bool scanned;
-    struct control *imx_control;
+    struct card_caps caps;
     int left_out_devices = SUPPORTED_DEVICE_OUT_MODULE;
     int left_in_devices = SUPPORTED_DEVICE_IN_MODULE;
-    int rate, channels, format;
     /* open the mixer for main sound card, main sound cara is like sgtl5000, wm8958, cs428888*/
     /* note: some platform do not have main sound card, only have auxiliary card.*/
     /* max num of supported card is 2 */
+    adev->card_generation = card_monitor_generation(adev->monitor);
     k = adev->audio_card_num;
     for(i = 0; i < k; i++) {
         left_out_devices &= ~adev->card_list[i]->supported_out_devices;
@@ -2996,14 +3828,10 @@ static int scan_available_device(struct imx_audio_device *adev, bool rescanusb)
 
     for (i = 0; i < MAX_AUDIO_CARD_SCAN ; i ++) {
         found = false;
-        imx_control = control_open(i);
-        if(!imx_control)
-            break;
-        ALOGW("card %d, id %s ,driver %s, name %s", i, control_card_info_get_id(imx_control),
-                                                      control_card_info_get_driver(imx_control),
-                                                      control_card_info_get_name(imx_control));
+        if (card_monitor_get(adev->monitor, i, &caps) != 0)
+            continue;
         for(j = 0; j < SUPPORT_CARD_NUM; j++) {
-            if(strstr(control_card_info_get_driver(imx_control), audio_card_list[j]->driver_name) != NULL){
+            if(strstr(caps.driver, audio_card_list[j]->driver_name) != NULL){
                 // check if the device have been scaned before
                 scanned = false;
                 n = k;
@@ -3012,13 +3840,11 @@ static int scan_available_device(struct imx_audio_device *adev, bool rescanusb)
                          scanned = true;
                          found = true;
                          if(!strcmp(adev->card_list[m]->driver_name, "USB-Audio")) {
-                             if(strcmp(control_card_info_get_name(imx_control), adev->usb_card_name) || rescanusb) {
+                             if(strcmp(caps.name, adev->usb_card_name) || rescanusb) {
                                 scanned = false;
-                                strcpy(adev->usb_card_name, control_card_info_get_name(imx_control));
+                                strcpy(adev->usb_card_name, caps.name);
                                 left_out_devices |= adev->card_list[m]->supported_out_devices;
                                 left_in_devices |= adev->card_list[m]->supported_in_devices;
-                                if(adev->mixer[m])
-                                   mixer_close(adev->mixer[m]);
                                 n = m;
                                 k --;
                              }
@@ -3031,40 +3857,26 @@ static int scan_available_device(struct imx_audio_device *adev, bool rescanusb)
                 }
                 adev->card_list[n]  = audio_card_list[j];
                 adev->card_list[n]->card = i;
-                if(!strcmp(adev->card_list[n]->driver_name, "USB-Audio")) {
-                    adev->mixer[n] = NULL;
-                } else {
-                    adev->mixer[n] = mixer_open(i);
-                    if (!adev->mixer[n]) {
-                         ALOGE("Unable to open the mixer, aborting.");
-                         return -EINVAL;
-                    }
+                /* the monitor owns the mixers, none is opened for USB cards */
+                adev->mixer[n] = caps.mixer;
+                if (!adev->mixer[n] && strcmp(adev->card_list[n]->driver_name, "USB-Audio")) {
+                     ALOGE("Unable to open the mixer, aborting.");
+                     return -EINVAL;
                 }
 
-                rate = 44100;
-                if( pcm_get_near_param(i, 0, PCM_OUT, PCM_HW_PARAM_RATE, &rate) == 0)
-                        adev->card_list[n]->out_rate = rate;
+                if (caps.out_rate)
+                    adev->card_list[n]->out_rate = caps.out_rate;
                 ALOGW("out rate %d",adev->card_list[n]->out_rate);
 
                 if(adev->card_list[n]->out_rate > adev->mm_rate)
                     adev->mm_rate = adev->card_list[n]->out_rate;
 
-                rate = 44100;
-                if( pcm_get_near_param(i, 0, PCM_IN, PCM_HW_PARAM_RATE, &rate) == 0)
-                        adev->card_list[n]->in_rate = rate;
-
-                channels = 1;
-                if( pcm_get_near_param(i, 0, PCM_IN, PCM_HW_PARAM_CHANNELS, &channels) == 0)
-                        adev->card_list[n]->in_channels = channels;
-
-                format = PCM_FORMAT_S16_LE;
-                if( pcm_check_param_mask(i, 0, PCM_IN, PCM_HW_PARAM_FORMAT, format))
-                        adev->card_list[n]->in_format = format;
-                else {
-                    format = PCM_FORMAT_S24_LE;
-                    if( pcm_check_param_mask(i, 0, PCM_IN, PCM_HW_PARAM_FORMAT, format))
-                        adev->card_list[n]->in_format = format;
-                }
+                if (caps.in_rate)
+                    adev->card_list[n]->in_rate = caps.in_rate;
+                if (caps.in_channels)
+                    adev->card_list[n]->in_channels = caps.in_channels;
+                if (caps.in_format >= 0)
+                    adev->card_list[n]->in_format = caps.in_format;
 
                 ALOGW("in rate %d, channels %d format %d",adev->card_list[n]->in_rate, adev->card_list[n]->in_channels, adev->card_list[n]->in_format);
 
@@ -3076,9 +3888,8 @@ static int scan_available_device(struct imx_audio_device *adev, bool rescanusb)
             }
         }
 
-        control_close(imx_control);
         if(!found){
-            ALOGW("unrecognized card found.");
+            ALOGW("unrecognized card %d, driver %s.", i, caps.driver);
         }
     }
     adev->audio_card_num = k;
@@ -3128,6 +3939,9 @@ static int adev_open(const hw_module_t* module, const char* name,
     if (!adev)
         return -ENOMEM;
 
+    pthread_mutex_init(&adev->mix.lock, NULL);
+    pthread_cond_init(&adev->mix.cond, NULL);
+
     adev->hw_device.common.tag      = HARDWARE_DEVICE_TAG;
     adev->hw_device.common.version  = AUDIO_DEVICE_API_VERSION_2_0;
     adev->hw_device.common.module   = (struct hw_module_t *) module;
@@ -3149,14 +3963,23 @@ static int adev_open(const hw_module_t* module, const char* name,
     adev->hw_device.dump                    = adev_dump;
     adev->mm_rate                           = 44100;
 
+    adev->monitor = card_monitor_open(&pcm_config_mm_in);
+    if (!adev->monitor) {
+        free(adev);
+        return -ENOMEM;
+    }
+
     ret = scan_available_device(adev, true);
     if (ret != 0) {
+        card_monitor_close(adev->monitor);
         free(adev);
         return ret;
     }
 
     adev->default_rate                      = adev->mm_rate;
     pcm_config_mm_out.rate                  = adev->mm_rate;
+    pcm_config_mm_out_fast.rate             = adev->mm_rate;
+    pcm_config_mm_out_deep.rate             = adev->mm_rate;
     pcm_config_mm_in.rate                   = adev->mm_rate;
     pcm_config_hdmi_multi.rate              = adev->mm_rate;
     pcm_config_esai_multi.rate              = adev->mm_rate;
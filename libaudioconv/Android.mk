@@ -0,0 +1,88 @@
+# Copyright (C) 2013 Freescale Semiconductor, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+# sample format, channel and rate conversion shared by the audio HALs,
+# linked statically.
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := audio_conv.c audio_resampler.c stream_stats.c
+LOCAL_MODULE := libimxaudioconv
+LOCAL_C_INCLUDES += \
+	external/tinyalsa/include \
+	system/media/audio_utils/include
+LOCAL_ARM_MODE := arm
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+LOCAL_CFLAGS += -mfpu=neon
+endif
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_STATIC_LIBRARY)
+
+# scalar only build for checking the references off target
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := audio_conv.c audio_resampler.c stream_stats.c
+LOCAL_MODULE := libimxaudioconv_host
+LOCAL_C_INCLUDES += \
+	external/tinyalsa/include \
+	system/media/audio_utils/include
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+# the scalar kernels against a 64 bit model and the reference outputs in
+# tests/audio_conv_golden.txt, and their cost per frame, run on the host:
+# out/host/<os>-<arch>/bin/audio_conv_test [reference file [cpu MHz]]
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := tests/audio_conv_test.c
+LOCAL_C_INCLUDES += \
+	external/tinyalsa/include \
+	system/media/audio_utils/include \
+	hardware/imx/libimxtest
+LOCAL_STATIC_LIBRARIES := libimxaudioconv_host libimxtest_host
+LOCAL_LDLIBS := -lm -lrt
+LOCAL_MODULE := audio_conv_test
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
+
+# the same on the target, NEON against scalar:
+# adb shell /data/nativetest/audio_conv_test/audio_conv_test <audio_conv_golden.txt> [cpu MHz]
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := tests/audio_conv_test.c
+LOCAL_C_INCLUDES += \
+	external/tinyalsa/include \
+	system/media/audio_utils/include \
+	hardware/imx/libimxtest
+LOCAL_STATIC_LIBRARIES := libimxaudioconv libimxtest
+LOCAL_ARM_MODE := arm
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+LOCAL_CFLAGS += -mfpu=neon
+endif
+LOCAL_MODULE := audio_conv_test
+LOCAL_MODULE_PATH := $(TARGET_OUT_DATA_NATIVE_TESTS)/audio_conv_test
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_EXECUTABLE)
+
+# THD+N, stopband and cost per frame of the polyphase resampler for the
+# rate pairs of the HALs, run on the host:
+# out/host/<os>-<arch>/bin/audio_resampler_test [cpu MHz]
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := tests/audio_resampler_test.c
+LOCAL_C_INCLUDES += \
+	external/tinyalsa/include \
+	system/media/audio_utils/include \
+	hardware/imx/libimxtest
+LOCAL_STATIC_LIBRARIES := libimxaudioconv_host libimxtest_host
+LOCAL_LDLIBS := -lm -lrt
+LOCAL_MODULE := audio_resampler_test
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
@@ -0,0 +1,482 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#include "audio_conv.h"
+
+/* downmix coefficients are Q14, front channels pass at unity */
+#define DOWNMIX_BITS 14
+#define DOWNMIX_ONE (1 << DOWNMIX_BITS)
+#define DOWNMIX_M3DB 11585
+
+static int sNeon = 1;
+
+void audio_conv_set_neon(int enable)
+{
+    sNeon = enable;
+}
+
+static inline int16_t conv_saturate(int64_t v)
+{
+    return v < -32768 ? -32768 : (v > 32767 ? 32767 : (int16_t)v);
+}
+
+/* same rounding and saturation as vqrshrn #16 */
+static inline int16_t conv_narrow(int32_t v)
+{
+    return conv_saturate(((int64_t)v + 0x8000) >> 16);
+}
+
+void audio_conv_s24_to_s16(int16_t *dst, const int32_t *src, size_t samples)
+{
+    size_t i = 0;
+
+#ifdef __ARM_NEON__
+    if (sNeon) {
+        for (; i + 8 <= samples; i += 8) {
+            int32x4_t a = vshlq_n_s32(vld1q_s32(src + i), 8);
+            int32x4_t b = vshlq_n_s32(vld1q_s32(src + i + 4), 8);
+            vst1q_s16(dst + i, vcombine_s16(vqrshrn_n_s32(a, 16),
+                                            vqrshrn_n_s32(b, 16)));
+        }
+    }
+#endif
+
+    // the top byte of the container is ignored, sign or not
+    for (; i < samples; i++) {
+        dst[i] = conv_narrow((int32_t)((uint32_t)src[i] << 8));
+    }
+}
+
+void audio_conv_s32_to_s16(int16_t *dst, const int32_t *src, size_t samples)
+{
+    size_t i = 0;
+
+#ifdef __ARM_NEON__
+    if (sNeon) {
+        for (; i + 8 <= samples; i += 8) {
+            int32x4_t a = vld1q_s32(src + i);
+            int32x4_t b = vld1q_s32(src + i + 4);
+            vst1q_s16(dst + i, vcombine_s16(vqrshrn_n_s32(a, 16),
+                                            vqrshrn_n_s32(b, 16)));
+        }
+    }
+#endif
+
+    for (; i < samples; i++) {
+        dst[i] = conv_narrow(src[i]);
+    }
+}
+
+void audio_conv_s16_to_s24(int32_t *dst, const int16_t *src, size_t samples)
+{
+    size_t i = 0;
+
+#ifdef __ARM_NEON__
+    if (sNeon) {
+        for (; i + 8 <= samples; i += 8) {
+            int16x8_t s = vld1q_s16(src + i);
+            vst1q_s32(dst + i, vshll_n_s16(vget_low_s16(s), 8));
+            vst1q_s32(dst + i + 4, vshll_n_s16(vget_high_s16(s), 8));
+        }
+    }
+#endif
+
+    for (; i < samples; i++) {
+        dst[i] = (int32_t)src[i] * 256;
+    }
+}
+
+void audio_conv_s16_to_s32(int32_t *dst, const int16_t *src, size_t samples)
+{
+    size_t i = 0;
+
+#ifdef __ARM_NEON__
+    if (sNeon) {
+        for (; i + 8 <= samples; i += 8) {
+            int16x8_t s = vld1q_s16(src + i);
+            vst1q_s32(dst + i, vshll_n_s16(vget_low_s16(s), 16));
+            vst1q_s32(dst + i + 4, vshll_n_s16(vget_high_s16(s), 16));
+        }
+    }
+#endif
+
+    for (; i < samples; i++) {
+        dst[i] = (int32_t)src[i] * 65536;
+    }
+}
+
+void audio_conv_mono_to_stereo(int16_t *dst, const int16_t *src, size_t frames)
+{
+    size_t i = 0;
+
+#ifdef __ARM_NEON__
+    if (sNeon) {
+        for (; i + 8 <= frames; i += 8) {
+            int16x8x2_t d;
+            d.val[0] = vld1q_s16(src + i);
+            d.val[1] = d.val[0];
+            vst2q_s16(dst + i * 2, d);
+        }
+    }
+#endif
+
+    for (; i < frames; i++) {
+        dst[i * 2] = src[i];
+        dst[i * 2 + 1] = src[i];
+    }
+}
+
+void audio_conv_stereo_to_mono(int16_t *dst, const int16_t *src, size_t frames)
+{
+    size_t i = 0;
+
+#ifdef __ARM_NEON__
+    if (sNeon) {
+        for (; i + 8 <= frames; i += 8) {
+            int16x8x2_t s = vld2q_s16(src + i * 2);
+            vst1q_s16(dst + i, vrhaddq_s16(s.val[0], s.val[1]));
+        }
+    }
+#endif
+
+    for (; i < frames; i++) {
+        dst[i] = (int16_t)(((int32_t)src[i * 2] + src[i * 2 + 1] + 1) >> 1);
+    }
+}
+
+/* left and right weights of every input channel, by channel count */
+static void conv_downmix_coefs(unsigned int channels,
+                               int16_t left[AUDIO_CONV_MAX_CHANNELS],
+                               int16_t right[AUDIO_CONV_MAX_CHANNELS])
+{
+    memset(left, 0, sizeof(int16_t) * AUDIO_CONV_MAX_CHANNELS);
+    memset(right, 0, sizeof(int16_t) * AUDIO_CONV_MAX_CHANNELS);
+
+    left[0] = DOWNMIX_ONE;
+    right[1] = DOWNMIX_ONE;
+    switch (channels) {
+        case 3:
+            left[2] = right[2] = DOWNMIX_M3DB;
+            break;
+        case 4:
+            left[2] = right[3] = DOWNMIX_M3DB;
+            break;
+        case 5:
+            left[2] = right[2] = DOWNMIX_M3DB;
+            left[3] = right[4] = DOWNMIX_M3DB;
+            break;
+        case 7:
+            // back center goes to both sides
+            left[6] = right[6] = DOWNMIX_M3DB;
+            // fall through
+        case 6:
+            left[2] = right[2] = DOWNMIX_M3DB;
+            left[4] = right[5] = DOWNMIX_M3DB;
+            break;
+        case 8:
+            left[2] = right[2] = DOWNMIX_M3DB;
+            left[4] = right[5] = DOWNMIX_M3DB;
+            left[6] = right[7] = DOWNMIX_M3DB;
+            break;
+        default:
+            break;
+    }
+}
+
+void audio_conv_downmix_stereo(int16_t *dst, const int16_t *src,
+                               unsigned int channels, size_t frames)
+{
+    int16_t left[AUDIO_CONV_MAX_CHANNELS];
+    int16_t right[AUDIO_CONV_MAX_CHANNELS];
+    size_t i = 0;
+    unsigned int c;
+
+    if (channels < 3 || channels > AUDIO_CONV_MAX_CHANNELS) {
+        return;
+    }
+    conv_downmix_coefs(channels, left, right);
+
+#ifdef __ARM_NEON__
+    if (sNeon) {
+        int16x8_t cl = vld1q_s16(left);
+        int16x8_t cr = vld1q_s16(right);
+
+        // a frame is loaded as 8 lanes, the last frames are left to the
+        // scalar loop so the load never passes the end of src.
+        for (; (i * channels) + AUDIO_CONV_MAX_CHANNELS <= frames * channels; i++) {
+            int16x8_t s = vld1q_s16(src + i * channels);
+            int32x4_t l = vmull_s16(vget_low_s16(s), vget_low_s16(cl));
+            int32x4_t r = vmull_s16(vget_low_s16(s), vget_low_s16(cr));
+            int32x2_t lr;
+            int16x4_t d;
+
+            l = vmlal_s16(l, vget_high_s16(s), vget_high_s16(cl));
+            r = vmlal_s16(r, vget_high_s16(s), vget_high_s16(cr));
+
+            lr = vpadd_s32(vadd_s32(vget_low_s32(l), vget_high_s32(l)),
+                           vadd_s32(vget_low_s32(r), vget_high_s32(r)));
+            d = vqrshrn_n_s32(vcombine_s32(lr, lr), DOWNMIX_BITS);
+            vst1_lane_s32((int32_t *)(dst + i * 2), vreinterpret_s32_s16(d), 0);
+        }
+    }
+#endif
+
+    for (; i < frames; i++) {
+        const int16_t *s = src + i * channels;
+        int32_t l = 0, r = 0;
+
+        for (c = 0; c < channels; c++) {
+            l += (int32_t)s[c] * left[c];
+            r += (int32_t)s[c] * right[c];
+        }
+        dst[i * 2] = conv_saturate(((int64_t)l + (DOWNMIX_ONE >> 1)) >> DOWNMIX_BITS);
+        dst[i * 2 + 1] = conv_saturate(((int64_t)r + (DOWNMIX_ONE >> 1)) >> DOWNMIX_BITS);
+    }
+}
+
+void audio_conv_remap(int16_t *dst, const int16_t *src, const uint8_t *map,
+                      unsigned int channels, size_t frames)
+{
+    int16_t frame[AUDIO_CONV_MAX_CHANNELS];
+    size_t i = 0;
+    unsigned int c;
+
+    if (channels == 0 || channels > AUDIO_CONV_MAX_CHANNELS) {
+        return;
+    }
+
+#ifdef __ARM_NEON__
+    if (sNeon && !(channels & 1)) {
+        uint8_t index[16];
+        uint8x8_t lo, hi;
+
+        // byte shuffle of the 16 bit samples, unused lanes read zero
+        memset(index, 0xff, sizeof(index));
+        for (c = 0; c < channels; c++) {
+            index[c * 2] = map[c] * 2;
+            index[c * 2 + 1] = map[c] * 2 + 1;
+        }
+        lo = vld1_u8(index);
+        hi = vld1_u8(index + 8);
+
+        for (; (i * channels) + AUDIO_CONV_MAX_CHANNELS <= frames * channels; i++) {
+            uint8x16_t s = vld1q_u8((const uint8_t *)(src + i * channels));
+            uint8_t *d = (uint8_t *)(dst + i * channels);
+            uint8x8x2_t t;
+            uint8x8_t dlo, dhi;
+
+            t.val[0] = vget_low_u8(s);
+            t.val[1] = vget_high_u8(s);
+            dlo = vtbl2_u8(t, lo);
+            dhi = vtbl2_u8(t, hi);
+
+            // only the frame is stored, src may be the next frame of dst
+            if (channels == 2) {
+                vst1_lane_u32((uint32_t *)d, vreinterpret_u32_u8(dlo), 0);
+            } else {
+                vst1_u8(d, dlo);
+                if (channels == 6)
+                    vst1_lane_u32((uint32_t *)(d + 8), vreinterpret_u32_u8(dhi), 0);
+                else if (channels == 8)
+                    vst1_u8(d + 8, dhi);
+            }
+        }
+    }
+#endif
+
+    for (; i < frames; i++) {
+        memcpy(frame, src + i * channels, channels * sizeof(int16_t));
+        for (c = 0; c < channels; c++) {
+            dst[i * channels + c] = frame[map[c]];
+        }
+    }
+}
+
+void audio_conv_mix(int16_t *dst, const int16_t *src, size_t samples)
+{
+    size_t i = 0;
+
+#ifdef __ARM_NEON__
+    if (sNeon) {
+        for (; i + 8 <= samples; i += 8) {
+            vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(dst + i), vld1q_s16(src + i)));
+        }
+    }
+#endif
+
+    for (; i < samples; i++) {
+        dst[i] = conv_saturate((int32_t)dst[i] + src[i]);
+    }
+}
+
+void audio_conv_interleave(int16_t *dst, const int16_t *const *src,
+                           unsigned int channels, size_t frames)
+{
+    size_t i = 0;
+    unsigned int c;
+
+#ifdef __ARM_NEON__
+    if (sNeon && channels == 2) {
+        for (; i + 8 <= frames; i += 8) {
+            int16x8x2_t d;
+            d.val[0] = vld1q_s16(src[0] + i);
+            d.val[1] = vld1q_s16(src[1] + i);
+            vst2q_s16(dst + i * 2, d);
+        }
+    } else if (sNeon && channels == 4) {
+        for (; i + 8 <= frames; i += 8) {
+            int16x8x4_t d;
+            for (c = 0; c < 4; c++) {
+                d.val[c] = vld1q_s16(src[c] + i);
+            }
+            vst4q_s16(dst + i * 4, d);
+        }
+    }
+#endif
+
+    for (; i < frames; i++) {
+        for (c = 0; c < channels; c++) {
+            dst[i * channels + c] = src[c][i];
+        }
+    }
+}
+
+void audio_conv_deinterleave(int16_t *const *dst, const int16_t *src,
+                             unsigned int channels, size_t frames)
+{
+    size_t i = 0;
+    unsigned int c;
+
+#ifdef __ARM_NEON__
+    if (sNeon && channels == 2) {
+        for (; i + 8 <= frames; i += 8) {
+            int16x8x2_t s = vld2q_s16(src + i * 2);
+            vst1q_s16(dst[0] + i, s.val[0]);
+            vst1q_s16(dst[1] + i, s.val[1]);
+        }
+    } else if (sNeon && channels == 4) {
+        for (; i + 8 <= frames; i += 8) {
+            int16x8x4_t s = vld4q_s16(src + i * 4);
+            for (c = 0; c < 4; c++) {
+                vst1q_s16(dst[c] + i, s.val[c]);
+            }
+        }
+    }
+#endif
+
+    for (; i < frames; i++) {
+        for (c = 0; c < channels; c++) {
+            dst[c][i] = src[i * channels + c];
+        }
+    }
+}
+
+static void conv_mono_to_stereo(const struct audio_conv *conv, int16_t *dst,
+                                const int16_t *src, size_t frames)
+{
+    (void)conv;
+    audio_conv_mono_to_stereo(dst, src, frames);
+}
+
+static void conv_stereo_to_mono(const struct audio_conv *conv, int16_t *dst,
+                                const int16_t *src, size_t frames)
+{
+    (void)conv;
+    audio_conv_stereo_to_mono(dst, src, frames);
+}
+
+static void conv_downmix_stereo(const struct audio_conv *conv, int16_t *dst,
+                                const int16_t *src, size_t frames)
+{
+    audio_conv_downmix_stereo(dst, src, conv->in_channels, frames);
+}
+
+static unsigned int conv_sample_size(enum pcm_format format)
+{
+    return format == PCM_FORMAT_S16_LE ? sizeof(int16_t) : sizeof(int32_t);
+}
+
+int audio_conv_init(struct audio_conv *conv,
+                    enum pcm_format in_format, unsigned int in_channels,
+                    enum pcm_format out_format, unsigned int out_channels)
+{
+    memset(conv, 0, sizeof(*conv));
+    if (in_channels == 0 || in_channels > AUDIO_CONV_MAX_CHANNELS ||
+        out_channels == 0 || out_channels > AUDIO_CONV_MAX_CHANNELS) {
+        return -EINVAL;
+    }
+    conv->in_channels = in_channels;
+    conv->out_channels = out_channels;
+    conv->in_frame_size = conv_sample_size(in_format) * in_channels;
+
+    if (in_format != out_format) {
+        if (out_format == PCM_FORMAT_S16_LE && in_format == PCM_FORMAT_S24_LE)
+            conv->narrow = audio_conv_s24_to_s16;
+        else if (out_format == PCM_FORMAT_S16_LE && in_format == PCM_FORMAT_S32_LE)
+            conv->narrow = audio_conv_s32_to_s16;
+        else if (in_format == PCM_FORMAT_S16_LE && out_format == PCM_FORMAT_S24_LE)
+            conv->widen = audio_conv_s16_to_s24;
+        else if (in_format == PCM_FORMAT_S16_LE && out_format == PCM_FORMAT_S32_LE)
+            conv->widen = audio_conv_s16_to_s32;
+        else
+            return -EINVAL;
+    }
+
+    if (in_channels == out_channels) {
+        return 0;
+    }
+    if (conv->widen || (!conv->narrow && in_format != PCM_FORMAT_S16_LE)) {
+        return -EINVAL;
+    }
+
+    if (in_channels == 1 && out_channels == 2)
+        conv->channels = conv_mono_to_stereo;
+    else if (in_channels == 2 && out_channels == 1)
+        conv->channels = conv_stereo_to_mono;
+    else if (in_channels > 2 && out_channels == 2)
+        conv->channels = conv_downmix_stereo;
+    else
+        return -EINVAL;
+
+    return 0;
+}
+
+void audio_conv_run(const struct audio_conv *conv, void *dst, void *src,
+                    size_t frames)
+{
+    size_t samples = frames * conv->in_channels;
+
+    if (conv->narrow && conv->channels) {
+        // narrowing in place only ever writes behind what it reads
+        conv->narrow((int16_t *)src, (const int32_t *)src, samples);
+        conv->channels(conv, (int16_t *)dst, (const int16_t *)src, frames);
+    } else if (conv->narrow) {
+        conv->narrow((int16_t *)dst, (const int32_t *)src, samples);
+    } else if (conv->widen) {
+        conv->widen((int32_t *)dst, (const int16_t *)src, samples);
+    } else if (conv->channels) {
+        conv->channels(conv, (int16_t *)dst, (const int16_t *)src, frames);
+    } else if (dst != src) {
+        memcpy(dst, src, frames * conv->in_frame_size);
+    }
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FSL_AUDIO_CONV_H
+#define FSL_AUDIO_CONV_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <tinyalsa/asoundlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Sample format and channel conversion for the audio HALs. Every kernel
+ * has a NEON path and a scalar reference producing the same samples.
+ *
+ * Samples are interleaved. S24_LE samples sit in the low 24 bits of a
+ * 32 bit word. Narrowing to 16 bits rounds to nearest and saturates.
+ */
+
+#define AUDIO_CONV_MAX_CHANNELS 8
+
+/* 24 or 32 bit -> 16 bit, dst may alias src. */
+void audio_conv_s24_to_s16(int16_t *dst, const int32_t *src, size_t samples);
+void audio_conv_s32_to_s16(int16_t *dst, const int32_t *src, size_t samples);
+
+/* 16 bit -> 24 or 32 bit. */
+void audio_conv_s16_to_s24(int32_t *dst, const int16_t *src, size_t samples);
+void audio_conv_s16_to_s32(int32_t *dst, const int16_t *src, size_t samples);
+
+/* duplicates a mono channel, dst must not alias src. */
+void audio_conv_mono_to_stereo(int16_t *dst, const int16_t *src, size_t frames);
+
+/* averages left and right rounding half up, like vrhadd, dst may alias
+ * src. */
+void audio_conv_stereo_to_mono(int16_t *dst, const int16_t *src, size_t frames);
+
+/* folds 3 to 8 channels in the WAVE order (FL FR FC LFE BL BR SL SR,
+ * quad is FL FR BL BR) down to stereo, dst may alias src. */
+void audio_conv_downmix_stereo(int16_t *dst, const int16_t *src,
+                               unsigned int channels, size_t frames);
+
+/* dst channel c of every frame is src channel map[c], dst may alias src. */
+void audio_conv_remap(int16_t *dst, const int16_t *src, const uint8_t *map,
+                      unsigned int channels, size_t frames);
+
+/* adds src to dst with saturation. */
+void audio_conv_mix(int16_t *dst, const int16_t *src, size_t samples);
+
+/* between interleaved frames and one plane per channel. */
+void audio_conv_interleave(int16_t *dst, const int16_t *const *src,
+                           unsigned int channels, size_t frames);
+void audio_conv_deinterleave(int16_t *const *dst, const int16_t *src,
+                             unsigned int channels, size_t frames);
+
+/* selects the NEON kernels (default when built for NEON) or the scalar
+ * references, to compare their output on target. */
+void audio_conv_set_neon(int enable);
+
+/*
+ * A conversion chosen once when a stream starts. Format changes are
+ * to or from S16_LE. Channel changes are on S16_LE samples: 1 -> 2,
+ * 2 -> 1 and 3..8 -> 2. Widening keeps the channel count.
+ */
+struct audio_conv {
+    unsigned int in_channels;
+    unsigned int out_channels;
+    unsigned int in_frame_size;
+    void (*narrow)(int16_t *dst, const int32_t *src, size_t samples);
+    void (*widen)(int32_t *dst, const int16_t *src, size_t samples);
+    void (*channels)(const struct audio_conv *conv, int16_t *dst,
+                     const int16_t *src, size_t frames);
+};
+
+/* returns -EINVAL when the conversion is not supported. */
+int audio_conv_init(struct audio_conv *conv,
+                    enum pcm_format in_format, unsigned int in_channels,
+                    enum pcm_format out_format, unsigned int out_channels);
+
+static inline int audio_conv_is_identity(const struct audio_conv *conv)
+{
+    return !conv->narrow && !conv->widen && !conv->channels;
+}
+
+/* converts frames from src into dst. A narrowing conversion that also
+ * changes channels uses src as scratch space. */
+void audio_conv_run(const struct audio_conv *conv, void *dst, void *src,
+                    size_t frames);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,451 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#include "audio_resampler.h"
+
+#define RESAMPLER_MAX_PHASES 1024
+#define RESAMPLER_MAX_TAPS 64
+/* input frames taken in at a time, past the window */
+#define RESAMPLER_BLOCK 256
+/* taps are Q15, each phase sums to exactly one */
+#define COEF_BITS 15
+
+struct audio_resampler {
+    struct resampler_itfe itfe;
+    struct resampler_buffer_provider *provider;
+    uint32_t in_rate;
+    uint32_t out_rate;
+    unsigned int channels;
+    unsigned int taps;
+    unsigned int phases;        /* L */
+    unsigned int step_int;      /* M / L */
+    unsigned int step_frac;     /* M % L */
+    unsigned int phase;
+    size_t pos;                 /* first frame of the next window */
+    size_t frames;              /* frames held in buf */
+    size_t size;                /* capacity of buf */
+    int16_t *coefs;             /* phases rows of taps, oldest frame first */
+    int16_t *buf;
+    uint64_t out_frames;
+    uint64_t cpu_ns;
+};
+
+static int sNeon = 1;
+
+void audio_resampler_set_neon(int enable)
+{
+    sNeon = enable;
+}
+
+static inline int16_t resampler_round(int32_t acc)
+{
+    int64_t v = ((int64_t)acc + (1 << (COEF_BITS - 1))) >> COEF_BITS;
+    return v < -32768 ? -32768 : (v > 32767 ? 32767 : (int16_t)v);
+}
+
+static void resampler_dot_mono(int16_t *out, const int16_t *x, const int16_t *c,
+                               unsigned int taps)
+{
+    int32_t acc = 0;
+    unsigned int i = 0;
+
+#ifdef __ARM_NEON__
+    if (sNeon) {
+        int32x4_t a = vdupq_n_s32(0);
+        int32x2_t s;
+
+        for (; i + 8 <= taps; i += 8) {
+            int16x8_t xv = vld1q_s16(x + i);
+            int16x8_t cv = vld1q_s16(c + i);
+            a = vmlal_s16(a, vget_low_s16(xv), vget_low_s16(cv));
+            a = vmlal_s16(a, vget_high_s16(xv), vget_high_s16(cv));
+        }
+        s = vadd_s32(vget_low_s32(a), vget_high_s32(a));
+        acc = vget_lane_s32(vpadd_s32(s, s), 0);
+    }
+#endif
+    for (; i < taps; i++)
+        acc += x[i] * c[i];
+
+    out[0] = resampler_round(acc);
+}
+
+static void resampler_dot_stereo(int16_t *out, const int16_t *x, const int16_t *c,
+                                 unsigned int taps)
+{
+    int32_t l = 0;
+    int32_t r = 0;
+    unsigned int i = 0;
+
+#ifdef __ARM_NEON__
+    if (sNeon) {
+        int32x4_t al = vdupq_n_s32(0);
+        int32x4_t ar = vdupq_n_s32(0);
+        int32x2_t s;
+
+        for (; i + 8 <= taps; i += 8) {
+            int16x8x2_t xv = vld2q_s16(x + 2 * i);
+            int16x8_t cv = vld1q_s16(c + i);
+            al = vmlal_s16(al, vget_low_s16(xv.val[0]), vget_low_s16(cv));
+            al = vmlal_s16(al, vget_high_s16(xv.val[0]), vget_high_s16(cv));
+            ar = vmlal_s16(ar, vget_low_s16(xv.val[1]), vget_low_s16(cv));
+            ar = vmlal_s16(ar, vget_high_s16(xv.val[1]), vget_high_s16(cv));
+        }
+        s = vpadd_s32(vadd_s32(vget_low_s32(al), vget_high_s32(al)),
+                      vadd_s32(vget_low_s32(ar), vget_high_s32(ar)));
+        l = vget_lane_s32(s, 0);
+        r = vget_lane_s32(s, 1);
+    }
+#endif
+    for (; i < taps; i++) {
+        l += x[2 * i] * c[i];
+        r += x[2 * i + 1] * c[i];
+    }
+
+    out[0] = resampler_round(l);
+    out[1] = resampler_round(r);
+}
+
+static double bessel_i0(double x)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    int k;
+
+    for (k = 1; k < 50 && term > sum * 1e-12; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+/* a single Kaiser windowed sinc of taps * L points, cut below the lower
+ * of the two Nyquist rates, split into its L phases */
+static void resampler_design(struct audio_resampler *rs, double rolloff, double beta)
+{
+    unsigned int taps = rs->taps;
+    unsigned int phases = rs->phases;
+    double n = (double)taps * phases;
+    double center = (n - 1) / 2;
+    double ratio = (double)rs->out_rate / rs->in_rate;
+    double fc = (ratio < 1.0 ? ratio : 1.0) * rolloff / (2 * phases);
+    double i0beta = bessel_i0(beta);
+    double h[RESAMPLER_MAX_TAPS];
+    unsigned int p, i;
+
+    for (p = 0; p < phases; p++) {
+        int16_t *c = rs->coefs + p * taps;
+        double sum = 0;
+        double carry;
+
+        for (i = 0; i < taps; i++) {
+            double t = (double)((taps - 1 - i) * phases + p) - center;
+            double x = 2 * fc * t;
+            double w = 2 * t / (n - 1);
+            double sinc = x == 0 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+
+            h[i] = sinc * bessel_i0(beta * sqrt(1 - w * w)) / i0beta;
+            sum += h[i];
+        }
+
+        // the rounding error of each tap is carried into the next, so
+        // every phase passes DC at exactly unity
+        carry = 0;
+        for (i = 0; i < taps; i++) {
+            double v = h[i] / sum * (1 << COEF_BITS) + carry;
+            long q = lrint(v);
+
+            q = q < -32768 ? -32768 : (q > 32767 ? 32767 : q);
+            c[i] = (int16_t)q;
+            carry = v - q;
+        }
+    }
+}
+
+/* produces frames while the window of the next one is held */
+static size_t resampler_run(struct audio_resampler *rs, int16_t *out, size_t count)
+{
+    unsigned int channels = rs->channels;
+    unsigned int taps = rs->taps;
+    size_t n = 0;
+
+    while (n < count && rs->pos + taps <= rs->frames) {
+        const int16_t *x = rs->buf + rs->pos * channels;
+        const int16_t *c = rs->coefs + rs->phase * taps;
+
+        if (channels == 2)
+            resampler_dot_stereo(out + 2 * n, x, c, taps);
+        else
+            resampler_dot_mono(out + n, x, c, taps);
+        n++;
+
+        rs->pos += rs->step_int;
+        rs->phase += rs->step_frac;
+        if (rs->phase >= rs->phases) {
+            rs->phase -= rs->phases;
+            rs->pos++;
+        }
+    }
+
+    return n;
+}
+
+/* moves the next window to the start of buf, returns the room left */
+static size_t resampler_compact(struct audio_resampler *rs)
+{
+    size_t keep;
+
+    if (rs->pos >= rs->frames) {
+        // decimating can step over frames not received yet
+        rs->pos -= rs->frames;
+        rs->frames = 0;
+    } else if (rs->pos > 0) {
+        keep = rs->frames - rs->pos;
+        memmove(rs->buf, rs->buf + rs->pos * rs->channels,
+                keep * rs->channels * sizeof(int16_t));
+        rs->frames = keep;
+        rs->pos = 0;
+    }
+
+    return rs->size - rs->frames;
+}
+
+/* takes up to count input frames into the room left, returns how many */
+static size_t resampler_append(struct audio_resampler *rs, const int16_t *in, size_t count)
+{
+    size_t skip = 0;
+    size_t n;
+
+    if (rs->frames == 0 && rs->pos > 0) {
+        skip = count < rs->pos ? count : rs->pos;
+        rs->pos -= skip;
+        in += skip * rs->channels;
+        count -= skip;
+    }
+
+    n = rs->size - rs->frames;
+    n = count < n ? count : n;
+    memcpy(rs->buf + rs->frames * rs->channels, in, n * rs->channels * sizeof(int16_t));
+    rs->frames += n;
+
+    return skip + n;
+}
+
+static uint64_t resampler_cpu_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void resampler_reset(struct resampler_itfe *itfe)
+{
+    struct audio_resampler *rs = (struct audio_resampler *)itfe;
+
+    // the filter starts on silence
+    rs->frames = rs->taps - 1;
+    rs->pos = 0;
+    rs->phase = 0;
+    memset(rs->buf, 0, rs->frames * rs->channels * sizeof(int16_t));
+}
+
+static int resampler_resample_from_provider(struct resampler_itfe *itfe,
+                                            int16_t *out, size_t *outFrameCount)
+{
+    struct audio_resampler *rs = (struct audio_resampler *)itfe;
+    struct resampler_buffer buffer;
+    uint64_t start = resampler_cpu_ns();
+    size_t done = 0;
+    int ret = 0;
+
+    if (rs->provider == NULL) {
+        *outFrameCount = 0;
+        return -EINVAL;
+    }
+
+    for (;;) {
+        done += resampler_run(rs, out + done * rs->channels, *outFrameCount - done);
+        if (done == *outFrameCount)
+            break;
+
+        buffer.frame_count = resampler_compact(rs);
+        ret = rs->provider->get_next_buffer(rs->provider, &buffer);
+        if (ret != 0 || buffer.raw == NULL || buffer.frame_count == 0)
+            break;
+        buffer.frame_count = resampler_append(rs, buffer.i16, buffer.frame_count);
+        rs->provider->release_buffer(rs->provider, &buffer);
+    }
+
+    *outFrameCount = done;
+    rs->out_frames += done;
+    rs->cpu_ns += resampler_cpu_ns() - start;
+    return ret;
+}
+
+static int resampler_resample_from_input(struct resampler_itfe *itfe,
+                                         int16_t *in, size_t *inFrameCount,
+                                         int16_t *out, size_t *outFrameCount)
+{
+    struct audio_resampler *rs = (struct audio_resampler *)itfe;
+    uint64_t start = resampler_cpu_ns();
+    size_t used = 0;
+    size_t done = 0;
+
+    if (rs->provider != NULL) {
+        *inFrameCount = 0;
+        *outFrameCount = 0;
+        return -EINVAL;
+    }
+
+    for (;;) {
+        done += resampler_run(rs, out + done * rs->channels, *outFrameCount - done);
+        if (done == *outFrameCount || used == *inFrameCount)
+            break;
+
+        resampler_compact(rs);
+        used += resampler_append(rs, in + used * rs->channels, *inFrameCount - used);
+    }
+
+    *inFrameCount = used;
+    *outFrameCount = done;
+    rs->out_frames += done;
+    rs->cpu_ns += resampler_cpu_ns() - start;
+    return 0;
+}
+
+/* input held past the centre of the next window */
+static int32_t resampler_delay_ns(struct resampler_itfe *itfe)
+{
+    struct audio_resampler *rs = (struct audio_resampler *)itfe;
+    int64_t frames = (int64_t)rs->frames - rs->pos - rs->taps / 2;
+
+    if (frames < 0)
+        frames = 0;
+    return (int32_t)(frames * 1000000000 / rs->in_rate);
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while (b != 0) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+int audio_resampler_create(uint32_t in_rate, uint32_t out_rate, uint32_t channels,
+                           uint32_t quality, struct resampler_buffer_provider *provider,
+                           struct resampler_itfe **resampler)
+{
+    struct audio_resampler *rs;
+    uint32_t g;
+    double rolloff, beta;
+
+    if (resampler == NULL)
+        return -EINVAL;
+    *resampler = NULL;
+
+    if (in_rate == 0 || out_rate == 0 || channels < 1 || channels > 2)
+        return -EINVAL;
+
+    g = gcd(in_rate, out_rate);
+    if (out_rate / g > RESAMPLER_MAX_PHASES)
+        return -EINVAL;
+
+    rs = (struct audio_resampler *)calloc(1, sizeof(struct audio_resampler));
+    if (rs == NULL)
+        return -ENOMEM;
+
+    rs->itfe.reset = resampler_reset;
+    rs->itfe.resample_from_provider = resampler_resample_from_provider;
+    rs->itfe.resample_from_input = resampler_resample_from_input;
+    rs->itfe.delay_ns = resampler_delay_ns;
+
+    rs->provider = provider;
+    rs->in_rate = in_rate;
+    rs->out_rate = out_rate;
+    rs->channels = channels;
+    rs->phases = out_rate / g;
+    rs->step_int = (in_rate / g) / rs->phases;
+    rs->step_frac = (in_rate / g) % rs->phases;
+
+    // stopband about 55, 70 and 90 dB down
+    if (quality <= RESAMPLER_QUALITY_VOIP) {
+        rs->taps = 16;
+        rolloff = 0.85;
+        beta = 5.0;
+    } else if (quality < 7) {
+        rs->taps = 32;
+        rolloff = 0.90;
+        beta = 7.0;
+    } else {
+        rs->taps = 64;
+        rolloff = 0.94;
+        beta = 9.0;
+    }
+
+    rs->size = rs->taps + RESAMPLER_BLOCK;
+    rs->coefs = (int16_t *)malloc(rs->phases * rs->taps * sizeof(int16_t));
+    rs->buf = (int16_t *)malloc(rs->size * channels * sizeof(int16_t));
+    if (rs->coefs == NULL || rs->buf == NULL) {
+        free(rs->coefs);
+        free(rs->buf);
+        free(rs);
+        return -ENOMEM;
+    }
+
+    resampler_design(rs, rolloff, beta);
+    resampler_reset(&rs->itfe);
+
+    *resampler = &rs->itfe;
+    return 0;
+}
+
+void audio_resampler_release(struct resampler_itfe *resampler)
+{
+    struct audio_resampler *rs = (struct audio_resampler *)resampler;
+
+    if (rs == NULL)
+        return;
+
+    free(rs->coefs);
+    free(rs->buf);
+    free(rs);
+}
+
+void audio_resampler_get_stats(struct resampler_itfe *resampler,
+                               struct audio_resampler_stats *stats)
+{
+    struct audio_resampler *rs = (struct audio_resampler *)resampler;
+
+    stats->taps = rs->taps;
+    stats->phases = rs->phases;
+    stats->delay_ns = resampler_delay_ns(resampler);
+    stats->frames = rs->out_frames;
+    stats->cpu_ns = rs->cpu_ns;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FSL_AUDIO_RESAMPLER_H
+#define FSL_AUDIO_RESAMPLER_H
+
+#include <stdint.h>
+#include <audio_utils/resampler.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Polyphase resampler for 16 bit mono or stereo, behind the audio_utils
+ * resampler interface so streams switch engines at creation only.
+ *
+ * The rate ratio is reduced to L/M and each of the L phases gets its own
+ * row of Kaiser windowed sinc taps, designed once at creation. 44.1 to
+ * 48 kHz runs 160 phases, 48 to 16 kHz a single phase decimating by 3.
+ * Nothing is allocated after creation.
+ *
+ * quality takes the RESAMPLER_QUALITY_* levels: VOIP and below use 16
+ * taps per phase, DEFAULT 32 and 7 or more 64.
+ */
+
+/* returns -EINVAL for more than 2 channels or a ratio needing more than
+ * 1024 phases. */
+int audio_resampler_create(uint32_t in_rate, uint32_t out_rate, uint32_t channels,
+                           uint32_t quality, struct resampler_buffer_provider *provider,
+                           struct resampler_itfe **resampler);
+
+void audio_resampler_release(struct resampler_itfe *resampler);
+
+struct audio_resampler_stats {
+    unsigned int taps;          /* per phase */
+    unsigned int phases;
+    int32_t delay_ns;
+    uint64_t frames;            /* produced since creation */
+    uint64_t cpu_ns;            /* thread time spent producing them */
+};
+
+void audio_resampler_get_stats(struct resampler_itfe *resampler,
+                               struct audio_resampler_stats *stats);
+
+/* selects the NEON filter (default when built for NEON) or the scalar
+ * reference, to compare their output on target. */
+void audio_resampler_set_neon(int enable);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stream_stats.h"
+
+static int64_t stats_clock_ns(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t stats_clamp(int64_t ns)
+{
+    return ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+}
+
+void stream_stats_begin(struct stream_stats_call *call)
+{
+    memset(call, 0, sizeof(*call));
+    call->latency_ns = -1;
+    call->wall_ns = stats_clock_ns(CLOCK_MONOTONIC);
+    call->cpu_ns = stats_clock_ns(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void stream_stats_lock(struct stream_stats_call *call, enum stream_stats_lock which,
+                       pthread_mutex_t *mutex)
+{
+    int64_t start;
+
+    // the clock is only read when the lock is held elsewhere
+    if (pthread_mutex_trylock(mutex) == 0)
+        return;
+
+    start = stats_clock_ns(CLOCK_MONOTONIC);
+    pthread_mutex_lock(mutex);
+    // a wait of 0 still counts as one
+    call->lock_wait_ns[which] += stats_clock_ns(CLOCK_MONOTONIC) - start + 1;
+}
+
+void stream_stats_xrun(struct stream_stats_call *call)
+{
+    if (call)
+        call->xruns++;
+}
+
+void stream_stats_end(struct stream_stats *stats, const struct stream_stats_call *call,
+                      size_t frames, unsigned int rate, int error)
+{
+    int64_t now = stats_clock_ns(CLOCK_MONOTONIC);
+    int64_t wall = now - call->wall_ns;
+    int64_t cpu = stats_clock_ns(CLOCK_THREAD_CPUTIME_ID) - call->cpu_ns;
+    int i;
+
+    pthread_mutex_lock(&stats->lock);
+    stats->calls++;
+    stats->frames += frames;
+    stats->wall_ns += wall;
+    stats->cpu_ns += cpu;
+    if (wall > stats->max_wall_ns)
+        stats->max_wall_ns = stats_clamp(wall);
+    if (cpu > stats->max_cpu_ns)
+        stats->max_cpu_ns = stats_clamp(cpu);
+    if (rate && wall > (int64_t)frames * 1000000000 / rate)
+        stats->late_calls++;
+
+    for (i = 0; i < STREAM_STATS_LOCKS; i++) {
+        if (call->lock_wait_ns[i] == 0)
+            continue;
+        stats->lock_waits[i]++;
+        stats->lock_wait_ns[i] += call->lock_wait_ns[i];
+        if (call->lock_wait_ns[i] > stats->max_lock_wait_ns[i])
+            stats->max_lock_wait_ns[i] = stats_clamp(call->lock_wait_ns[i]);
+    }
+
+    stats->xruns += call->xruns;
+    if (error != 0) {
+        stats->errors++;
+        if (stats->failing_since == 0)
+            stats->failing_since = call->wall_ns;
+    } else if (stats->failing_since != 0) {
+        stats->recoveries++;
+        if ((uint64_t)(now - stats->failing_since) > stats->max_recovery_ns)
+            stats->max_recovery_ns = now - stats->failing_since;
+        stats->failing_since = 0;
+    }
+
+    if (call->latency_ns >= 0) {
+        if (stats->min_latency_ns == 0 || call->latency_ns < stats->min_latency_ns)
+            stats->min_latency_ns = call->latency_ns;
+        if (call->latency_ns > stats->max_latency_ns)
+            stats->max_latency_ns = call->latency_ns;
+        stats->latency_ns = call->latency_ns;
+    }
+    pthread_mutex_unlock(&stats->lock);
+}
+
+void stream_stats_dump(struct stream_stats *stats, const char *title, int fd)
+{
+    static const char *lock_names[STREAM_STATS_LOCKS] = { "device", "stream" };
+    char buffer[512];
+    int len, i;
+
+    pthread_mutex_lock(&stats->lock);
+    if (stats->calls == 0) {
+        pthread_mutex_unlock(&stats->lock);
+        return;
+    }
+
+    len = snprintf(buffer, sizeof(buffer),
+                   "  %s: %llu calls, %llu frames, cpu %llu/%u us, wall %llu/%u us "
+                   "(average/max), %u late\n",
+                   title, (unsigned long long)stats->calls,
+                   (unsigned long long)stats->frames,
+                   (unsigned long long)(stats->cpu_ns / stats->calls / 1000),
+                   stats->max_cpu_ns / 1000,
+                   (unsigned long long)(stats->wall_ns / stats->calls / 1000),
+                   stats->max_wall_ns / 1000, stats->late_calls);
+    for (i = 0; i < STREAM_STATS_LOCKS && len < (int)sizeof(buffer); i++) {
+        if (stats->lock_waits[i] == 0)
+            continue;
+        len += snprintf(buffer + len, sizeof(buffer) - len,
+                        "    %s lock: waited in %u calls, %llu/%u us (average/max)\n",
+                        lock_names[i], stats->lock_waits[i],
+                        (unsigned long long)(stats->lock_wait_ns[i] /
+                                             stats->lock_waits[i] / 1000),
+                        stats->max_lock_wait_ns[i] / 1000);
+    }
+    if (len < (int)sizeof(buffer))
+        len += snprintf(buffer + len, sizeof(buffer) - len,
+                        "    xruns %u, failed calls %u, recoveries %u (longest %llu ms)%s\n",
+                        stats->xruns, stats->errors, stats->recoveries,
+                        (unsigned long long)(stats->max_recovery_ns / 1000000),
+                        stats->failing_since ? ", failing" : "");
+    if (len < (int)sizeof(buffer) && stats->max_latency_ns > 0)
+        len += snprintf(buffer + len, sizeof(buffer) - len,
+                        "    latency %lld/%lld/%lld us (min/last/max)\n",
+                        (long long)(stats->min_latency_ns / 1000),
+                        (long long)(stats->latency_ns / 1000),
+                        (long long)(stats->max_latency_ns / 1000));
+    pthread_mutex_unlock(&stats->lock);
+
+    if (len > (int)sizeof(buffer) - 1)
+        len = sizeof(buffer) - 1;
+    write(fd, buffer, len);
+}
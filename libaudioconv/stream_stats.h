@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FSL_STREAM_STATS_H
+#define FSL_STREAM_STATS_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Cost of the read or write calls of a stream, printed with its dump so
+ * it is measured on the board under the load it really runs.
+ *
+ * A call is timed from stream_stats_begin to stream_stats_end, on the
+ * monotonic clock and the CPU time of the calling thread. The locks
+ * taken through stream_stats_lock record how long the call waited for
+ * another thread, the pcm errors it recovered from are counted, and the
+ * latency the stream measures after it is kept as a minimum, last and
+ * maximum. A stream that keeps failing is timed from its first failed
+ * call to the next good one.
+ *
+ * The call is filled by the stream thread alone, the stats are only
+ * locked once at its end and by the dump.
+ */
+
+enum stream_stats_lock {
+    STREAM_STATS_ADEV,          /* the device lock */
+    STREAM_STATS_STREAM,        /* the lock of the stream */
+    STREAM_STATS_LOCKS
+};
+
+struct stream_stats_call {
+    int64_t wall_ns;
+    int64_t cpu_ns;
+    int64_t lock_wait_ns[STREAM_STATS_LOCKS];
+    uint32_t xruns;
+    int64_t latency_ns;         /* -1 when not measured */
+};
+
+struct stream_stats {
+    pthread_mutex_t lock;       /* zero is an unlocked mutex, as in the streams */
+    uint64_t calls;
+    uint64_t frames;
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+    uint32_t max_wall_ns;
+    uint32_t max_cpu_ns;
+    uint32_t late_calls;        /* took longer than the frames they moved */
+    uint64_t lock_wait_ns[STREAM_STATS_LOCKS];
+    uint32_t lock_waits[STREAM_STATS_LOCKS];
+    uint32_t max_lock_wait_ns[STREAM_STATS_LOCKS];
+    uint32_t xruns;             /* recovered by preparing the pcm again */
+    uint32_t errors;            /* calls that failed */
+    int64_t failing_since;      /* of the first failed call, 0 while good */
+    uint32_t recoveries;
+    uint64_t max_recovery_ns;
+    int64_t latency_ns;
+    int64_t min_latency_ns;
+    int64_t max_latency_ns;
+};
+
+void stream_stats_begin(struct stream_stats_call *call);
+
+/* locks mutex, timing the wait when another thread holds it. */
+void stream_stats_lock(struct stream_stats_call *call, enum stream_stats_lock which,
+                       pthread_mutex_t *mutex);
+
+/* a pcm error the call recovered from. call may be NULL. */
+void stream_stats_xrun(struct stream_stats_call *call);
+
+/* adds the call, which moved frames at rate and failed when error is not 0. */
+void stream_stats_end(struct stream_stats *stats, const struct stream_stats_call *call,
+                      size_t frames, unsigned int rate, int error);
+
+/* prints the stats under title for a stream dump. */
+void stream_stats_dump(struct stream_stats *stats, const char *title, int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,404 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The sample and channel conversions over generated audio with the edge
+ * samples mixed in, checked against a 64 bit model of each kernel, NEON
+ * against scalar sample for sample, and against the crc32 of each output
+ * in tests/audio_conv_golden.txt. Frame counts are odd so the scalar
+ * tails run after the vector loops.
+ *
+ * Thread CPU time per frame is printed for every kernel, scalar and, when
+ * built for NEON, vector, and cycles per frame when the clock in MHz is
+ * given after the reference file.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "audio_conv.h"
+#include "imx_test.h"
+
+#define FRAMES 1001
+/* calls per timing */
+#define REPEAT 1000
+
+static uint32_t sSeed;
+static double sMhz;
+
+static uint32_t test_random(void)
+{
+    sSeed = sSeed * 1103515245 + 12345;
+    return (sSeed >> 16) | (sSeed << 16);
+}
+
+/* random samples, every 16th one at full scale or silence */
+static void test_fill16(int16_t *p, size_t n, uint32_t seed)
+{
+    static const int16_t edges[] = { 32767, -32768, 0, -1, 1, 32766, -32767 };
+    size_t i;
+
+    sSeed = seed;
+    for (i = 0; i < n; i++) {
+        uint32_t r = test_random();
+        p[i] = (i % 16 == 5) ? edges[r % 7] : (int16_t)r;
+    }
+}
+
+static void test_fill32(int32_t *p, size_t n, uint32_t seed)
+{
+    static const int32_t edges[] = {
+        INT32_MAX, INT32_MIN, 0x7fff8000, -0x8000, 0x8000, 0x7fff7fff, -1,
+    };
+    size_t i;
+
+    sSeed = seed;
+    for (i = 0; i < n; i++) {
+        uint32_t r = test_random();
+        p[i] = (i % 16 == 5) ? edges[r % 7] : (int32_t)r;
+    }
+}
+
+/* S24_LE in the low 24 bits, the top byte is whatever the card left */
+static void test_fill24(int32_t *p, size_t n, uint32_t seed)
+{
+    static const int32_t edges[] = {
+        0x7fffff, 0x800000, 0x7fff80, 0xffff80, 0x000080, 0x12000000, -1,
+    };
+    size_t i;
+
+    sSeed = seed;
+    for (i = 0; i < n; i++) {
+        uint32_t r = test_random();
+        p[i] = (i % 16 == 5) ? edges[r % 7] : (int32_t)r;
+    }
+}
+
+static int16_t test_saturate(double v)
+{
+    return v < -32768 ? -32768 : (v > 32767 ? 32767 : (int16_t)v);
+}
+
+static void test_report(const char *name, double scalar_ns, double neon_ns)
+{
+    printf("%-16s scalar %6.2f ns/frame", name, scalar_ns);
+    if (sMhz > 0)
+        printf(" %6.1f cycles/frame", sMhz * scalar_ns / 1000);
+#ifdef __ARM_NEON__
+    printf(", NEON %6.2f ns/frame", neon_ns);
+    if (sMhz > 0)
+        printf(" %6.1f cycles/frame", sMhz * neon_ns / 1000);
+#else
+    (void)neon_ns;
+#endif
+    printf("\n");
+}
+
+/* thread CPU time per frame of a call over FRAMES frames */
+#define TEST_TIME(ns, call) do {                            \
+        int64_t start = imx_test_ns(CLOCK_THREAD_CPUTIME_ID); \
+        int r;                                              \
+        for (r = 0; r < REPEAT; r++)                        \
+            call;                                           \
+        ns = (double)(imx_test_ns(CLOCK_THREAD_CPUTIME_ID) - start) / REPEAT / FRAMES; \
+    } while (0)
+
+/* runs fn with NEON off and on into two buffers, which must match */
+#define TEST_BOTH(name, out, bytes, call) do {              \
+        void *ref = malloc(bytes);                          \
+        double scalar_ns, neon_ns;                          \
+        audio_conv_set_neon(0);                             \
+        TEST_TIME(scalar_ns, call);                         \
+        memcpy(ref, out, bytes);                            \
+        audio_conv_set_neon(1);                             \
+        TEST_TIME(neon_ns, call);                           \
+        CHECK(!memcmp(ref, out, bytes), "%s: NEON output differs", name); \
+        free(ref);                                          \
+        imx_test_golden(name, imx_test_crc32(0, out, bytes)); \
+        test_report(name, scalar_ns, neon_ns);              \
+    } while (0)
+
+/*****************************************************************************/
+
+static void test_narrow(void)
+{
+    int32_t src[FRAMES * 2];
+    int16_t dst[FRAMES * 2];
+    size_t n = FRAMES * 2, i;
+
+    test_fill24(src, n, 1);
+    TEST_BOTH("s24_to_s16", dst, sizeof(dst), audio_conv_s24_to_s16(dst, src, n));
+    for (i = 0; i < n; i++) {
+        // sign extended 24 bits, rounded half up to 16
+        int32_t s = (int32_t)((uint32_t)src[i] << 8) >> 8;
+        int16_t want = test_saturate(floor(s / 256.0 + 0.5));
+        if (dst[i] != want) {
+            CHECK(0, "s24_to_s16: %06x gave %d, model %d", src[i] & 0xffffff, dst[i], want);
+            break;
+        }
+    }
+
+    test_fill32(src, n, 2);
+    TEST_BOTH("s32_to_s16", dst, sizeof(dst), audio_conv_s32_to_s16(dst, src, n));
+    for (i = 0; i < n; i++) {
+        int16_t want = test_saturate(floor(src[i] / 65536.0 + 0.5));
+        if (dst[i] != want) {
+            CHECK(0, "s32_to_s16: %08x gave %d, model %d", src[i], dst[i], want);
+            break;
+        }
+    }
+
+    // in place, as audio_conv_run narrows
+    test_fill32(src, n, 2);
+    audio_conv_s32_to_s16((int16_t *)src, src, n);
+    CHECK(!memcmp(src, dst, sizeof(dst)), "s32_to_s16 in place differs");
+}
+
+static void test_widen(void)
+{
+    int16_t src[FRAMES * 2];
+    int32_t dst[FRAMES * 2];
+    size_t n = FRAMES * 2, i;
+
+    test_fill16(src, n, 3);
+    TEST_BOTH("s16_to_s24", dst, sizeof(dst), audio_conv_s16_to_s24(dst, src, n));
+    for (i = 0; i < n; i++)
+        CHECK(dst[i] == src[i] * 256, "s16_to_s24: %d gave %d", src[i], dst[i]);
+    TEST_BOTH("s16_to_s32", dst, sizeof(dst), audio_conv_s16_to_s32(dst, src, n));
+    for (i = 0; i < n; i++)
+        CHECK(dst[i] == src[i] * 65536, "s16_to_s32: %d gave %d", src[i], dst[i]);
+}
+
+static void test_channels(void)
+{
+    int16_t src[FRAMES * 8];
+    int16_t dst[FRAMES * 8];
+    size_t i;
+    unsigned int channels;
+
+    test_fill16(src, FRAMES, 4);
+    TEST_BOTH("mono_to_stereo", dst, FRAMES * 4,
+              audio_conv_mono_to_stereo(dst, src, FRAMES));
+    for (i = 0; i < FRAMES; i++)
+        CHECK(dst[i * 2] == src[i] && dst[i * 2 + 1] == src[i], "mono_to_stereo %zu", i);
+
+    test_fill16(src, FRAMES * 2, 5);
+    TEST_BOTH("stereo_to_mono", dst, FRAMES * 2,
+              audio_conv_stereo_to_mono(dst, src, FRAMES));
+    for (i = 0; i < FRAMES; i++) {
+        int16_t want = (int16_t)floor((src[i * 2] + src[i * 2 + 1]) / 2.0 + 0.5);
+        if (dst[i] != want) {
+            CHECK(0, "stereo_to_mono: %d and %d gave %d, model %d", src[i * 2],
+                  src[i * 2 + 1], dst[i], want);
+            break;
+        }
+    }
+    // a half rounds up, also below zero
+    src[0] = -1;
+    src[1] = 0;
+    src[2] = -3;
+    src[3] = 0;
+    audio_conv_stereo_to_mono(dst, src, 2);
+    CHECK(dst[0] == 0 && dst[1] == -1, "stereo_to_mono rounding: %d %d", dst[0], dst[1]);
+
+    for (channels = 3; channels <= AUDIO_CONV_MAX_CHANNELS; channels++) {
+        // WAVE order: FL FR FC LFE BL BR SL SR, quad is FL FR BL BR
+        static const signed char left[9][8] = {
+            [3] = { 2, 0, 1 },
+            [4] = { 2, 0, 1, 0 },
+            [5] = { 2, 0, 1, 1, 0 },
+            [6] = { 2, 0, 1, 0, 1, 0 },
+            [7] = { 2, 0, 1, 0, 1, 0, 1 },
+            [8] = { 2, 0, 1, 0, 1, 0, 1, 0 },
+        };
+        static const signed char right[9][8] = {
+            [3] = { 0, 2, 1 },
+            [4] = { 0, 2, 0, 1 },
+            [5] = { 0, 2, 1, 0, 1 },
+            [6] = { 0, 2, 1, 0, 0, 1 },
+            [7] = { 0, 2, 1, 0, 0, 1, 1 },
+            [8] = { 0, 2, 1, 0, 0, 1, 0, 1 },
+        };
+        char name[32];
+        unsigned int c;
+
+        snprintf(name, sizeof(name), "downmix_%u", channels);
+        test_fill16(src, FRAMES * channels, 6 + channels);
+        TEST_BOTH(name, dst, FRAMES * 4,
+                  audio_conv_downmix_stereo(dst, src, channels, FRAMES));
+        for (i = 0; i < FRAMES; i++) {
+            // 2 is unity, 1 is -3 dB
+            double l = 0, r = 0;
+            for (c = 0; c < channels; c++) {
+                l += src[i * channels + c] * (left[channels][c] == 2 ? 1.0 :
+                                              left[channels][c] * M_SQRT1_2);
+                r += src[i * channels + c] * (right[channels][c] == 2 ? 1.0 :
+                                              right[channels][c] * M_SQRT1_2);
+            }
+            // -3 dB is 11585 / 16384, half a step short per channel at full scale
+            if (abs(dst[i * 2] - test_saturate(floor(l + 0.5))) > 2 ||
+                abs(dst[i * 2 + 1] - test_saturate(floor(r + 0.5))) > 2) {
+                CHECK(0, "%s: frame %zu is %d %d, model %.1f %.1f", name, i,
+                      dst[i * 2], dst[i * 2 + 1], l, r);
+                break;
+            }
+        }
+    }
+}
+
+static void test_remap(void)
+{
+    static const uint8_t maps[][8] = {
+        { 1, 0 },
+        { 0, 1, 4, 5, 2, 3 },
+        { 7, 6, 5, 4, 3, 2, 1, 0 },
+        { 2, 2, 0 },
+    };
+    static const unsigned int counts[] = { 2, 6, 8, 3 };
+    int16_t src[FRAMES * 8], dst[FRAMES * 8], copy[FRAMES * 8];
+    size_t m, i;
+
+    for (m = 0; m < sizeof(counts) / sizeof(counts[0]); m++) {
+        unsigned int channels = counts[m], c;
+        size_t bytes = FRAMES * channels * sizeof(int16_t);
+        char name[32];
+
+        snprintf(name, sizeof(name), "remap_%u", channels);
+        test_fill16(src, FRAMES * channels, 20 + m);
+        TEST_BOTH(name, dst, bytes, audio_conv_remap(dst, src, maps[m], channels, FRAMES));
+        for (i = 0; i < FRAMES; i++) {
+            for (c = 0; c < channels; c++) {
+                CHECK(dst[i * channels + c] == src[i * channels + maps[m][c]],
+                      "%s: frame %zu channel %u", name, i, c);
+            }
+        }
+
+        // in place gives the same
+        memcpy(copy, src, bytes);
+        audio_conv_remap(copy, copy, maps[m], channels, FRAMES);
+        CHECK(!memcmp(copy, dst, bytes), "%s in place differs", name);
+    }
+}
+
+static void test_mix(void)
+{
+    int16_t src[FRAMES * 2], dst[FRAMES * 2], orig[FRAMES * 2];
+    size_t n = FRAMES * 2, i;
+
+    test_fill16(src, n, 30);
+    test_fill16(orig, n, 31);
+    TEST_BOTH("mix", dst, sizeof(dst),
+              (memcpy(dst, orig, sizeof(dst)), audio_conv_mix(dst, src, n)));
+    for (i = 0; i < n; i++)
+        CHECK(dst[i] == test_saturate((double)orig[i] + src[i]), "mix %zu", i);
+}
+
+static void test_interleave(void)
+{
+    int16_t src[FRAMES * 4], dst[FRAMES * 4];
+    int16_t planes[4][FRAMES];
+    int16_t *p[4] = { planes[0], planes[1], planes[2], planes[3] };
+    unsigned int channels;
+    size_t i;
+
+    for (channels = 1; channels <= 4; channels++) {
+        double scalar_ns, neon_ns;
+        char name[32];
+        unsigned int c;
+
+        test_fill16(src, FRAMES * channels, 40 + channels);
+        audio_conv_deinterleave(p, src, channels, FRAMES);
+        for (i = 0; i < FRAMES; i++) {
+            for (c = 0; c < channels; c++)
+                CHECK(planes[c][i] == src[i * channels + c], "deinterleave %u", channels);
+        }
+        audio_conv_interleave(dst, (const int16_t *const *)p, channels, FRAMES);
+        CHECK(!memcmp(dst, src, FRAMES * channels * 2), "interleave %u", channels);
+
+        snprintf(name, sizeof(name), "deinterleave_%u", channels);
+        audio_conv_set_neon(0);
+        TEST_TIME(scalar_ns, audio_conv_deinterleave(p, src, channels, FRAMES));
+        audio_conv_set_neon(1);
+        TEST_TIME(neon_ns, audio_conv_deinterleave(p, src, channels, FRAMES));
+        test_report(name, scalar_ns, neon_ns);
+        snprintf(name, sizeof(name), "interleave_%u", channels);
+        audio_conv_set_neon(0);
+        TEST_TIME(scalar_ns, audio_conv_interleave(dst, (const int16_t *const *)p, channels,
+                                                   FRAMES));
+        audio_conv_set_neon(1);
+        TEST_TIME(neon_ns, audio_conv_interleave(dst, (const int16_t *const *)p, channels,
+                                                 FRAMES));
+        test_report(name, scalar_ns, neon_ns);
+    }
+}
+
+/* the stream setups of the HALs through audio_conv_init and _run */
+static void test_run(void)
+{
+    struct audio_conv conv;
+    int32_t src[FRAMES * 6];
+    int16_t dst[FRAMES * 6], ref[FRAMES * 6];
+
+    // a 6 channel S32 capture narrowed and folded to stereo in one go
+    CHECK(audio_conv_init(&conv, PCM_FORMAT_S32_LE, 6, PCM_FORMAT_S16_LE, 2) == 0, "init");
+    CHECK(conv.in_frame_size == 24, "frame size %u", conv.in_frame_size);
+    test_fill32(src, FRAMES * 6, 50);
+    audio_conv_s32_to_s16(ref, src, FRAMES * 6);
+    audio_conv_downmix_stereo(ref, ref, 6, FRAMES);
+    audio_conv_run(&conv, dst, src, FRAMES);
+    CHECK(!memcmp(dst, ref, FRAMES * 4), "narrow and downmix");
+
+    CHECK(audio_conv_init(&conv, PCM_FORMAT_S16_LE, 2, PCM_FORMAT_S16_LE, 2) == 0 &&
+          audio_conv_is_identity(&conv), "identity");
+    CHECK(audio_conv_init(&conv, PCM_FORMAT_S16_LE, 1, PCM_FORMAT_S16_LE, 2) == 0 &&
+          conv.channels, "mono to stereo");
+
+    // what the HALs fall back on
+    CHECK(audio_conv_init(&conv, PCM_FORMAT_S16_LE, 1, PCM_FORMAT_S24_LE, 2) == -EINVAL,
+          "widening with a channel change");
+    CHECK(audio_conv_init(&conv, PCM_FORMAT_S24_LE, 2, PCM_FORMAT_S32_LE, 2) == -EINVAL,
+          "24 to 32 bit");
+    CHECK(audio_conv_init(&conv, PCM_FORMAT_S16_LE, 2, PCM_FORMAT_S16_LE, 6) == -EINVAL,
+          "upmix");
+    CHECK(audio_conv_init(&conv, PCM_FORMAT_S16_LE, 9, PCM_FORMAT_S16_LE, 2) == -EINVAL,
+          "9 channels");
+}
+
+int main(int argc, char **argv)
+{
+    char path[PATH_MAX];
+
+    imx_test_path(path, sizeof(path), argc, argv, "libaudioconv/tests/audio_conv_golden.txt");
+    if (argc > 2)
+        sMhz = atof(argv[2]);
+    imx_test_golden_load(path);
+
+    test_narrow();
+    test_widen();
+    test_channels();
+    test_remap();
+    test_mix();
+    test_interleave();
+    test_run();
+
+    imx_test_golden_unused();
+    return imx_test_result("audio_conv_test");
+}
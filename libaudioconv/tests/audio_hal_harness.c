@@ -0,0 +1,778 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Each stream the HAL side lists runs in every scenario below that
+ * applies to it, on a new stream each time, for the seconds given as the
+ * second argument (1 by default). A third argument runs only the stream
+ * of that name.
+ *
+ *  - clean: nothing else runs. No card may underrun or overrun, every
+ *    pulse must come out, within a second, and the stream dump must
+ *    count every call.
+ *  - contention: a thread changes the routing of the stream every
+ *    HARNESS_ROUTE_MS, on a mixer taking HARNESS_MIXER_US per ioctl as a
+ *    codec behind I2C does. No call may fail.
+ *  - device: outputs only. The routing of another stream of the HAL,
+ *    the first of harness_neighbours that opens, changes as often on the
+ *    slow mixer. Its thread holds the device lock for every change, a
+ *    running output is written without it: no write may wait for the
+ *    device lock.
+ *  - xrun: the card is forced into an xrun half of HARNESS_XRUN_MS into
+ *    the run, then every HARNESS_XRUN_MS or every four latencies of an
+ *    output when that is longer. Half way between an output is also
+ *    stalled for twice its latency. The time decides, not the number of
+ *    calls, so an output of long writes gets its xruns too. Every xrun
+ *    must be recovered from.
+ *
+ * Outputs are written pulses that the fake card times when it plays
+ * them, inputs read pulses the fake card timed when it captured them,
+ * which gives the latency from the application to the speaker and from
+ * the microphone to the application. The last part of a run carries no
+ * pulses, so those sent have come out before the stream closes.
+ *
+ * For each run the harness prints the CPU and wall time of the calls,
+ * what the stream dump says of the waits on the device and stream locks
+ * and of the xruns, and the latency.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <cutils/properties.h>
+#include <hardware/audio.h>
+#include <hardware/hardware.h>
+
+#include "audio_hal_harness.h"
+#include "imx_test.h"
+#include "mixer_fake.h"
+#include "pcm_fake.h"
+
+#define HARNESS_ROUTE_MS 20
+#define HARNESS_MIXER_US 200
+#define HARNESS_PULSE_MS 100
+#define HARNESS_XRUN_MS 250
+#define HARNESS_QUIET_MS 300        /* at the end of a run, on top of twice the latency */
+#define HARNESS_MAX_LATENCY_NS 1000000000LL
+#define HARNESS_STALL_NS 2000000LL  /* a late tick worth reporting */
+#define HARNESS_FAST_PRIORITY 3     /* SCHED_FIFO of the fast mixer of AudioFlinger */
+#define HARNESS_MIXER_NICE (-19)    /* ANDROID_PRIORITY_URGENT_AUDIO of its other threads */
+
+enum harness_scenario {
+    SCENARIO_CLEAN,
+    SCENARIO_CONTENTION,
+    SCENARIO_DEVICE,
+    SCENARIO_XRUN,
+    SCENARIOS
+};
+
+static const char *sScenarioNames[SCENARIOS] = { "clean", "contention", "device", "xrun" };
+
+/* the HAL linked in */
+extern struct audio_module HAL_MODULE_INFO_SYM;
+
+struct harness_run {
+    unsigned int calls;
+    unsigned int failed;
+    int64_t cpu_ns;
+    int64_t max_cpu_ns;
+    int64_t wall_ns;
+    int64_t max_wall_ns;
+
+    unsigned int pulses;
+    unsigned int heard;
+    int pulsing;
+    int64_t sent_ns[PCM_FAKE_PULSES];
+    int64_t min_latency_ns;
+    int64_t max_latency_ns;
+    int64_t sum_latency_ns;
+
+    unsigned int route_changes;
+    const char *neighbour;      /* whose routing changes, NULL for the stream */
+    int64_t route_ns;           /* spent changing the routing */
+    int64_t max_route_ns;
+    struct pcm_fake_stats card;
+    unsigned int latency_ms;    /* of the stream, or of a read */
+    int64_t stall_ns;           /* the host stopped us */
+
+    /* from the stream dump */
+    unsigned int dump_calls;
+    unsigned int lock_waits[2];
+    unsigned int lock_avg_us[2];
+    unsigned int lock_max_us[2];
+    unsigned int xruns;
+    unsigned int errors;
+    unsigned int recoveries;
+    unsigned int recovery_ms;
+    long long hal_latency_us;
+};
+
+struct harness_control {
+    struct audio_stream *stream;
+    const audio_devices_t *routes;
+    volatile int exit;
+    unsigned int changes;
+    int64_t busy_ns;
+    int64_t max_busy_ns;
+    pthread_t thread;
+};
+
+static double sSeconds = 1;
+static audio_io_handle_t sHandle;
+
+int property_get(const char *key, char *value, const char *default_value)
+{
+    unsigned int i;
+
+    for (i = 0; harness_properties[i][0]; i++) {
+        if (!strcmp(key, harness_properties[i][0]))
+            return snprintf(value, PROPERTY_VALUE_MAX, "%s", harness_properties[i][1]);
+    }
+    if (default_value)
+        return snprintf(value, PROPERTY_VALUE_MAX, "%s", default_value);
+    value[0] = '\0';
+    return 0;
+}
+
+static void *control_thread(void *arg)
+{
+    struct harness_control *c = (struct harness_control *)arg;
+    char kvpairs[32];
+    int64_t start, busy;
+
+    // the nice value of the stream thread came along with the thread
+    setpriority(PRIO_PROCESS, 0, 0);
+    while (!c->exit) {
+        snprintf(kvpairs, sizeof(kvpairs), "%s=%u", AUDIO_PARAMETER_STREAM_ROUTING,
+                 c->routes[c->changes & 1]);
+        start = imx_test_ns(CLOCK_MONOTONIC);
+        c->stream->set_parameters(c->stream, kvpairs);
+        busy = imx_test_ns(CLOCK_MONOTONIC) - start;
+        c->busy_ns += busy;
+        if (busy > c->max_busy_ns)
+            c->max_busy_ns = busy;
+        c->changes++;
+        usleep(HARNESS_ROUTE_MS * 1000);
+    }
+    return NULL;
+}
+
+static void control_start(struct harness_control *c, struct audio_stream *stream,
+                          const struct harness_stream *s)
+{
+    pthread_attr_t attr;
+    struct sched_param param = { .sched_priority = 0 };
+
+    memset(c, 0, sizeof(*c));
+    c->stream = stream;
+    c->routes = s->routes;
+    mixer_fake_set_delay(HARNESS_MIXER_US);
+    // a binder thread of the framework, whatever runs the stream
+    pthread_attr_init(&attr);
+    pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+    pthread_attr_setschedparam(&attr, &param);
+    CHECK(pthread_create(&c->thread, &attr, control_thread, c) == 0, "no control thread");
+    pthread_attr_destroy(&attr);
+}
+
+static void control_stop(struct harness_control *c, struct harness_run *r)
+{
+    c->exit = 1;
+    pthread_join(c->thread, NULL);
+    mixer_fake_set_delay(0);
+    r->route_changes = c->changes;
+    r->route_ns = c->busy_ns;
+    r->max_route_ns = c->max_busy_ns;
+}
+
+static int xrun_cards(unsigned int flags)
+{
+    unsigned int card;
+    int count = 0;
+
+    for (card = 0; card < PCM_FAKE_CARDS; card++)
+        count += pcm_fake_xrun(card, flags);
+    return count;
+}
+
+static void add_latency(struct harness_run *r, int64_t latency)
+{
+    if (r->heard == 0 || latency < r->min_latency_ns)
+        r->min_latency_ns = latency;
+    if (latency > r->max_latency_ns)
+        r->max_latency_ns = latency;
+    r->sum_latency_ns += latency;
+    r->heard++;
+}
+
+static void collect_played(struct harness_run *r)
+{
+    struct pcm_fake_pulse pulses[64];
+    size_t i, n;
+
+    while ((n = pcm_fake_played(pulses, 64)) > 0) {
+        for (i = 0; i < n; i++) {
+            int64_t *sent = &r->sent_ns[pulses[i].seq];
+
+            if (*sent < 0)
+                continue;
+            add_latency(r, pulses[i].ns - *sent);
+            *sent = -1;
+        }
+    }
+}
+
+static void add_call(struct harness_run *r, int64_t wall, int64_t cpu, int failed)
+{
+    r->calls++;
+    r->failed += failed;
+    r->wall_ns += wall;
+    r->cpu_ns += cpu;
+    if (wall > r->max_wall_ns)
+        r->max_wall_ns = wall;
+    if (cpu > r->max_cpu_ns)
+        r->max_cpu_ns = cpu;
+}
+
+/* the stream_stats lines of the dump under title */
+static void parse_dump(struct audio_stream *stream, const char *title, struct harness_run *r)
+{
+    static const char *locks[2] = { "device lock: waited in ", "stream lock: waited in " };
+    char text[8192], head[32];
+    const char *p, *q;
+    int fds[2];
+    ssize_t n, len = 0;
+    int i;
+
+    if (pipe(fds) != 0)
+        return;
+    stream->dump(stream, fds[1]);
+    close(fds[1]);
+    while (len < (ssize_t)sizeof(text) - 1 &&
+           (n = read(fds[0], text + len, sizeof(text) - 1 - len)) > 0)
+        len += n;
+    close(fds[0]);
+    text[len] = '\0';
+
+    r->hal_latency_us = -1;
+    snprintf(head, sizeof(head), "  %s: ", title);
+    p = strstr(text, head);
+    if (p == NULL)
+        return;
+    sscanf(p + strlen(head), "%u calls", &r->dump_calls);
+    for (i = 0; i < 2; i++) {
+        q = strstr(p, locks[i]);
+        if (q)
+            sscanf(q + strlen(locks[i]), "%u calls, %u/%u us", &r->lock_waits[i],
+                   &r->lock_avg_us[i], &r->lock_max_us[i]);
+    }
+    q = strstr(p, "    xruns ");
+    if (q)
+        sscanf(q, "    xruns %u, failed calls %u, recoveries %u (longest %u ms)",
+               &r->xruns, &r->errors, &r->recoveries, &r->recovery_ms);
+    q = strstr(p, "    latency ");
+    if (q) {
+        long long min, max;
+        sscanf(q, "    latency %lld/%lld/%lld us", &min, &r->hal_latency_us, &max);
+    }
+}
+
+/* a pulse of PCM_FAKE_PULSE_FRAMES every HARNESS_PULSE_MS on every channel,
+ * pos counts the frames of the stream. a pulse only starts while pulses is
+ * set, and always ends. */
+static void fill_pulses(int16_t *buffer, size_t frames, unsigned int channels,
+                        unsigned int rate, uint64_t *pos, int pulses, int64_t now,
+                        struct harness_run *r)
+{
+    uint64_t every = (uint64_t)rate * HARNESS_PULSE_MS / 1000;
+    size_t i;
+    unsigned int c;
+
+    for (i = 0; i < frames; i++, (*pos)++) {
+        unsigned int seq = (*pos / every) % PCM_FAKE_PULSES;
+        int level = 0;
+
+        if (*pos % every == 0) {
+            r->pulsing = pulses;
+            if (pulses) {
+                r->sent_ns[seq] = now;
+                r->pulses++;
+            }
+        }
+        if (r->pulsing && *pos % every < PCM_FAKE_PULSE_FRAMES)
+            level = pcm_fake_pulse_level(seq);
+        for (c = 0; c < channels; c++)
+            buffer[i * channels + c] = level;
+    }
+}
+
+/* the stream of harness_outputs or harness_inputs called name, opened and
+ * left in standby. NULL if there is none or the HAL refuses it. */
+static struct audio_stream *open_named(struct audio_hw_device *dev, const char *name,
+                                       const struct harness_stream **s, int *output)
+{
+    struct audio_config config;
+    struct audio_stream_out *out;
+    struct audio_stream_in *in;
+    unsigned int i;
+
+    for (i = 0; harness_outputs[i].name; i++) {
+        if (strcmp(harness_outputs[i].name, name))
+            continue;
+        *s = &harness_outputs[i];
+        *output = 1;
+        memset(&config, 0, sizeof(config));
+        config.sample_rate = (*s)->sample_rate;
+        config.channel_mask = (*s)->channel_mask;
+        config.format = (*s)->format;
+        if (dev->open_output_stream(dev, ++sHandle, (*s)->devices, (*s)->flags, &config,
+                                    &out) != 0)
+            return NULL;
+        return &out->common;
+    }
+    for (i = 0; harness_inputs[i].name; i++) {
+        if (strcmp(harness_inputs[i].name, name))
+            continue;
+        *s = &harness_inputs[i];
+        *output = 0;
+        memset(&config, 0, sizeof(config));
+        config.sample_rate = (*s)->sample_rate;
+        config.channel_mask = (*s)->channel_mask;
+        config.format = AUDIO_FORMAT_PCM_16_BIT;
+        if (dev->open_input_stream(dev, ++sHandle, (*s)->devices, &config, &in) != 0)
+            return NULL;
+        return &in->common;
+    }
+    return NULL;
+}
+
+/* the first of harness_neighbours the HAL opens next to the stream s */
+static struct audio_stream *open_neighbour(struct audio_hw_device *dev,
+                                           const struct harness_stream *s,
+                                           const struct harness_stream **ns, int *output)
+{
+    struct audio_stream *stream;
+    unsigned int i;
+
+    for (i = 0; harness_neighbours[i]; i++) {
+        stream = open_named(dev, harness_neighbours[i], ns, output);
+        if (stream)
+            return stream;
+    }
+    CHECK(0, "%s device: no neighbour opens", s->name);
+    return NULL;
+}
+
+static void close_neighbour(struct audio_hw_device *dev, struct audio_stream *stream,
+                            int output)
+{
+    if (output)
+        dev->close_output_stream(dev, (struct audio_stream_out *)stream);
+    else
+        dev->close_input_stream(dev, (struct audio_stream_in *)stream);
+}
+
+static void run_output(struct audio_hw_device *dev, const struct harness_stream *s,
+                       const char *dir, int scenario, struct harness_run *r)
+{
+    struct audio_config config;
+    struct audio_stream_out *out;
+    struct audio_stream *neighbour = NULL;
+    const struct harness_stream *ns = NULL;
+    struct harness_control control;
+    struct sched_param param;
+    uint8_t *buffer, *source = NULL;
+    size_t bytes, frame_size, source_size = 0, source_pos = 0;
+    unsigned int channels, rate, latency_ms, i;
+    int64_t start, duration_ns, quiet_ns, xrun_ns, next_xrun, next_stall;
+    uint64_t pos = 0;
+    int policy, nice, ns_output = 0, controlled = 0, ret;
+
+    memset(r, 0, sizeof(*r));
+    memset(r->sent_ns, 0xff, sizeof(r->sent_ns));
+    memset(&config, 0, sizeof(config));
+    config.sample_rate = s->sample_rate;
+    config.channel_mask = s->channel_mask;
+    config.format = s->format;
+    ret = dev->open_output_stream(dev, ++sHandle, s->devices, s->flags, &config, &out);
+    CHECK(ret == 0, "%s: open_output_stream %d", s->name, ret);
+    if (ret != 0)
+        return;
+
+    bytes = out->common.get_buffer_size(&out->common);
+    frame_size = audio_stream_frame_size(&out->common);
+    channels = popcount(out->common.get_channels(&out->common));
+    rate = out->common.get_sample_rate(&out->common);
+    latency_ms = out->get_latency(out);
+    if (s->source) {
+        // the pulses are no bitstream, there is nothing to write without it
+        source = (uint8_t *)imx_test_load(dir, s->source, &source_size);
+        if (source == NULL) {
+            dev->close_output_stream(dev, out);
+            return;
+        }
+    }
+    buffer = (uint8_t *)malloc(bytes);
+
+    quiet_ns = (2LL * latency_ms + HARNESS_QUIET_MS) * 1000000;
+    duration_ns = (int64_t)(sSeconds * 1000000000);
+    if (duration_ns < quiet_ns + 500000000)
+        duration_ns = quiet_ns + 500000000;
+
+    if (scenario == SCENARIO_DEVICE)
+        neighbour = open_neighbour(dev, s, &ns, &ns_output);
+
+    mixer_fake_reset();
+    pcm_fake_reset();
+    if (scenario == SCENARIO_CONTENTION) {
+        control_start(&control, &out->common, s);
+        controlled = 1;
+    }
+
+    // a fast output keeps a few ms in the card, it is written from a
+    // real time thread or it underruns on any host. the others are
+    // written at the priority of the mixer threads, which on Linux is
+    // that of the calling thread alone.
+    pthread_getschedparam(pthread_self(), &policy, &param);
+    nice = getpriority(PRIO_PROCESS, 0);
+    if (s->flags & AUDIO_OUTPUT_FLAG_FAST) {
+        struct sched_param fast = { .sched_priority = HARNESS_FAST_PRIORITY };
+        pthread_setschedparam(pthread_self(), SCHED_FIFO, &fast);
+    } else {
+        setpriority(PRIO_PROCESS, 0, HARNESS_MIXER_NICE);
+    }
+
+    xrun_ns = HARNESS_XRUN_MS * 1000000LL;
+    if (xrun_ns < 4LL * latency_ms * 1000000)
+        xrun_ns = 4LL * latency_ms * 1000000;
+    start = imx_test_ns(CLOCK_MONOTONIC);
+    // the first xrun comes early, the writes of a long output are few
+    next_xrun = start + HARNESS_XRUN_MS * 1000000LL / 2;
+    next_stall = next_xrun + xrun_ns / 2;
+    for (i = 0; ; i++) {
+        int64_t now = imx_test_ns(CLOCK_MONOTONIC);
+        int64_t cpu;
+        int quiet = now - start > duration_ns - quiet_ns;
+
+        if (now - start >= duration_ns)
+            break;
+
+        if (scenario == SCENARIO_XRUN && !quiet && i > 0) {
+            if (now >= next_stall) {
+                usleep(2 * latency_ms * 1000);
+                next_stall += xrun_ns;
+            } else if (now >= next_xrun) {
+                xrun_cards(PCM_OUT);
+                next_xrun += xrun_ns;
+            }
+            now = imx_test_ns(CLOCK_MONOTONIC);
+        }
+
+        if (source) {
+            size_t done = 0;
+
+            while (done < bytes) {
+                size_t n = source_size - source_pos < bytes - done ?
+                           source_size - source_pos : bytes - done;
+                memcpy(buffer + done, source + source_pos, n);
+                done += n;
+                source_pos = (source_pos + n) % source_size;
+            }
+        } else {
+            fill_pulses((int16_t *)buffer, bytes / frame_size, channels, rate, &pos,
+                        !quiet, now, r);
+        }
+
+        // the first write starts the output under the device lock
+        if (scenario == SCENARIO_DEVICE && i == 1 && neighbour) {
+            control_start(&control, neighbour, ns);
+            r->neighbour = ns->name;
+            controlled = 1;
+        }
+
+        cpu = imx_test_ns(CLOCK_THREAD_CPUTIME_ID);
+        ret = out->write(out, buffer, bytes);
+        add_call(r, imx_test_ns(CLOCK_MONOTONIC) - now,
+                 imx_test_ns(CLOCK_THREAD_CPUTIME_ID) - cpu, ret < 0);
+        collect_played(r);
+    }
+    pthread_setschedparam(pthread_self(), policy, &param);
+    setpriority(PRIO_PROCESS, 0, nice);
+
+    if (controlled)
+        control_stop(&control, r);
+    collect_played(r);
+    parse_dump(&out->common, "write", r);
+    dev->close_output_stream(dev, out);
+    if (neighbour)
+        close_neighbour(dev, neighbour, ns_output);
+    r->card = pcm_fake_out;
+    r->latency_ms = latency_ms;
+    r->stall_ns = pcm_fake_stall();
+
+    free(buffer);
+    free(source);
+}
+
+static void run_input(struct audio_hw_device *dev, const struct harness_stream *s,
+                      int scenario, struct harness_run *r)
+{
+    struct audio_config config;
+    struct audio_stream_in *in;
+    struct harness_control control;
+    int16_t *buffer;
+    size_t bytes, frames, f;
+    unsigned int channels, pulse_frames = 0, muted, i;
+    int64_t start, duration_ns, quiet_ns, next_xrun;
+    int in_pulse = 0;
+    int ret;
+
+    memset(r, 0, sizeof(*r));
+    memset(&config, 0, sizeof(config));
+    config.sample_rate = s->sample_rate;
+    config.channel_mask = s->channel_mask;
+    config.format = AUDIO_FORMAT_PCM_16_BIT;
+    ret = dev->open_input_stream(dev, ++sHandle, s->devices, &config, &in);
+    CHECK(ret == 0, "%s: open_input_stream %d", s->name, ret);
+    if (ret != 0)
+        return;
+
+    bytes = in->common.get_buffer_size(&in->common);
+    channels = popcount(in->common.get_channels(&in->common));
+    frames = bytes / (channels * sizeof(int16_t));
+    buffer = (int16_t *)malloc(bytes);
+
+    quiet_ns = HARNESS_QUIET_MS * 1000000LL;
+    duration_ns = (int64_t)(sSeconds * 1000000000);
+    if (duration_ns < quiet_ns + 500000000)
+        duration_ns = quiet_ns + 500000000;
+
+    mixer_fake_reset();
+    pcm_fake_reset();
+    pcm_fake_set_capture_pulses(HARNESS_PULSE_MS);
+    if (scenario == SCENARIO_CONTENTION)
+        control_start(&control, &in->common, s);
+
+    start = imx_test_ns(CLOCK_MONOTONIC);
+    next_xrun = start + HARNESS_XRUN_MS * 1000000LL / 2;
+    for (i = 0; ; i++) {
+        int64_t now = imx_test_ns(CLOCK_MONOTONIC);
+        int64_t cpu, end;
+
+        if (now - start >= duration_ns)
+            break;
+        if (scenario == SCENARIO_XRUN && now - start < duration_ns - quiet_ns &&
+                now >= next_xrun) {
+            xrun_cards(PCM_IN);
+            next_xrun += HARNESS_XRUN_MS * 1000000LL;
+        }
+
+        cpu = imx_test_ns(CLOCK_THREAD_CPUTIME_ID);
+        ret = in->read(in, buffer, bytes);
+        end = imx_test_ns(CLOCK_MONOTONIC);
+        add_call(r, end - now, imx_test_ns(CLOCK_THREAD_CPUTIME_ID) - cpu, ret < 0);
+        if (ret < 0)
+            continue;
+
+        // pulses are read in their middle, as the fake card does
+        for (f = 0; f < frames; f++) {
+            int level = buffer[f * channels];
+            int seq;
+            int64_t captured;
+
+            if (level <= pcm_fake_pulse_level(0) / 2) {
+                in_pulse = 0;
+                continue;
+            }
+            if (!in_pulse) {
+                in_pulse = 1;
+                pulse_frames = 0;
+            }
+            if (++pulse_frames != PCM_FAKE_PULSE_FRAMES / 2)
+                continue;
+            seq = pcm_fake_pulse_seq(level);
+            captured = seq >= 0 ? pcm_fake_captured(seq) : -1;
+            CHECK(captured >= 0 && captured < end, "%s: pulse of level %d was never captured",
+                  s->name, level);
+            if (captured >= 0 && captured < end)
+                add_latency(r, end - captured);
+        }
+    }
+
+    if (scenario == SCENARIO_CONTENTION)
+        control_stop(&control, r);
+    parse_dump(&in->common, "read", r);
+    r->latency_ms = frames * 1000 / in->common.get_sample_rate(&in->common);
+    dev->close_input_stream(dev, in);
+    r->card = pcm_fake_in;
+    r->stall_ns = pcm_fake_stall();
+    // the capture starts with a pulse, those in the silence after the
+    // start are not heard. a routing change restarts it every time.
+    muted = (s->muted_ms + HARNESS_PULSE_MS - 1) / HARNESS_PULSE_MS;
+    r->pulses = r->card.pulses;
+    if (scenario != SCENARIO_CONTENTION)
+        r->pulses = r->pulses > muted ? r->pulses - muted : 0;
+
+    free(buffer);
+}
+
+static void report(const struct harness_stream *s, int scenario, int output,
+                   const struct harness_run *r)
+{
+    unsigned int calls = r->calls ? r->calls : 1;
+
+    printf("%s %s: %u %s, cpu %lld/%lld us, wall %lld/%lld us (average/max), %u failed",
+           s->name, sScenarioNames[scenario], r->calls, output ? "writes" : "reads",
+           (long long)(r->cpu_ns / calls / 1000), (long long)(r->max_cpu_ns / 1000),
+           (long long)(r->wall_ns / calls / 1000), (long long)(r->max_wall_ns / 1000),
+           r->failed);
+    if (r->route_changes)
+        printf(", %u routing changes of %s taking %lld/%lld us",
+               r->route_changes, r->neighbour ? r->neighbour : s->name,
+               (long long)(r->route_ns / r->route_changes / 1000),
+               (long long)(r->max_route_ns / 1000));
+    printf("\n  device lock: %u waits %u/%u us, stream lock: %u waits %u/%u us (average/max)\n",
+           r->lock_waits[0], r->lock_avg_us[0], r->lock_max_us[0],
+           r->lock_waits[1], r->lock_avg_us[1], r->lock_max_us[1]);
+    printf("  card: %u xruns, %u forced, %u recoveries (longest %lld ms); "
+           "stream: %u xruns, %u failed calls, %u recoveries (longest %u ms)\n",
+           r->card.xruns, r->card.injected, r->card.recoveries,
+           (long long)(r->card.max_recovery_ns / 1000000),
+           r->xruns, r->errors, r->recoveries, r->recovery_ms);
+    if (r->stall_ns >= HARNESS_STALL_NS)
+        printf("  the host stalled the cards for up to %.1f ms\n", r->stall_ns / 1e6);
+    if (r->heard)
+        printf("  latency %.1f/%.1f/%.1f ms (min/average/max), %u of %u pulses\n",
+               r->min_latency_ns / 1e6, r->sum_latency_ns / r->heard / 1e6,
+               r->max_latency_ns / 1e6, r->heard, r->pulses);
+    if (r->hal_latency_us >= 0)
+        printf("  the stream says %.1f ms of latency\n", r->hal_latency_us / 1e3);
+}
+
+static void check(const struct harness_stream *s, int scenario, int output,
+                  const struct harness_run *r)
+{
+    int pulses = !output || s->source == NULL;
+
+    CHECK(r->calls > 0, "%s %s: no calls", s->name, sScenarioNames[scenario]);
+    switch (scenario) {
+    case SCENARIO_CLEAN:
+        CHECK(r->failed == 0, "%s clean: %u calls failed", s->name, r->failed);
+        // unless the host stopped the process for half the latency, as
+        // long as the stream keeps ahead of the card
+        CHECK(r->card.xruns == 0 || r->stall_ns * 2 >= r->latency_ms * 1000000LL,
+              "%s clean: %u xruns", s->name, r->card.xruns);
+        CHECK(r->dump_calls == r->calls, "%s clean: the dump counts %u calls of %u",
+              s->name, r->dump_calls, r->calls);
+        if (!pulses)
+            break;
+        CHECK(r->pulses > 0, "%s clean: no pulses", s->name);
+        // an input has the pulses of its last periods still in the card
+        CHECK(r->heard == r->pulses || (!output && r->heard + 1 +
+                  r->max_latency_ns / (HARNESS_PULSE_MS * 1000000) >= r->pulses),
+              "%s clean: %u of %u pulses came out", s->name, r->heard, r->pulses);
+        CHECK(r->heard == 0 || (r->min_latency_ns > 0 &&
+                  r->max_latency_ns < HARNESS_MAX_LATENCY_NS),
+              "%s clean: latency %lld to %lld ms", s->name,
+              (long long)(r->min_latency_ns / 1000000),
+              (long long)(r->max_latency_ns / 1000000));
+        // what the stream measures itself has to be on the same scale
+        CHECK(r->hal_latency_us < 0 || (r->hal_latency_us > 0 &&
+                  r->hal_latency_us * 1000 < HARNESS_MAX_LATENCY_NS),
+              "%s clean: the stream says %lld us of latency", s->name, r->hal_latency_us);
+        break;
+    case SCENARIO_CONTENTION:
+        CHECK(r->failed == 0, "%s contention: %u calls failed", s->name, r->failed);
+        CHECK(r->route_changes > 0, "%s contention: the routing never changed", s->name);
+        break;
+    case SCENARIO_DEVICE:
+        CHECK(r->failed == 0, "%s device: %u calls failed", s->name, r->failed);
+        CHECK(r->route_changes > 0, "%s device: no routing changed", s->name);
+        CHECK(r->lock_waits[0] == 0, "%s device: %u writes waited for the device lock, "
+              "%u us at most", s->name, r->lock_waits[0], r->lock_max_us[0]);
+        break;
+    case SCENARIO_XRUN:
+        CHECK(r->card.injected > 0, "%s xrun: no xrun forced", s->name);
+        CHECK(r->card.recoveries == r->card.xruns, "%s xrun: %u of %u xruns recovered",
+              s->name, r->card.recoveries, r->card.xruns);
+        CHECK(r->errors <= r->card.xruns, "%s xrun: %u calls failed on %u xruns",
+              s->name, r->errors, r->card.xruns);
+        break;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct audio_hw_device *dev;
+    hw_device_t *device;
+    struct harness_run run;
+    const char *only = NULL;
+    char dir[256];
+    int i, scenario, ret;
+
+    imx_test_path(dir, sizeof(dir), argc, argv, harness_fixtures);
+    if (argc > 2)
+        sSeconds = atof(argv[2]);
+    if (argc > 3)
+        only = argv[3];
+
+    ret = harness_setup(dir);
+    CHECK(ret == 0, "%s: no setup %d", dir, ret);
+    if (ret == 0) {
+        ret = HAL_MODULE_INFO_SYM.common.methods->open(&HAL_MODULE_INFO_SYM.common,
+                                                       AUDIO_HARDWARE_INTERFACE, &device);
+        CHECK(ret == 0, "adev_open %d", ret);
+    }
+    if (ret != 0) {
+        harness_teardown();
+        return imx_test_result("audio_hal_harness");
+    }
+    dev = (struct audio_hw_device *)device;
+
+    for (i = 0; harness_outputs[i].name; i++) {
+        if (only && strcmp(only, harness_outputs[i].name))
+            continue;
+        for (scenario = 0; scenario < SCENARIOS; scenario++) {
+            run_output(dev, &harness_outputs[i], dir, scenario, &run);
+            report(&harness_outputs[i], scenario, 1, &run);
+            check(&harness_outputs[i], scenario, 1, &run);
+        }
+    }
+    for (i = 0; harness_inputs[i].name; i++) {
+        if (only && strcmp(only, harness_inputs[i].name))
+            continue;
+        for (scenario = 0; scenario < SCENARIOS; scenario++) {
+            if (scenario == SCENARIO_DEVICE)
+                continue;
+            run_input(dev, &harness_inputs[i], scenario, &run);
+            report(&harness_inputs[i], scenario, 0, &run);
+            check(&harness_inputs[i], scenario, 0, &run);
+        }
+    }
+    device->close(device);
+    harness_teardown();
+
+    return imx_test_result("audio_hal_harness");
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AUDIO_HAL_HARNESS_H
+#define AUDIO_HAL_HARNESS_H
+
+#include <hardware/audio.h>
+
+/*
+ * Runs an audio HAL on the host, linked against the fake tinyalsa of
+ * pcm_fake.c and mixer_fake.c. The HAL side, one file next to each HAL,
+ * describes its cards and the streams to run, the harness does the rest:
+ * each stream is written or read for a few seconds clean, against a
+ * thread changing its routing on a slow mixer, against one changing the
+ * routing of another stream, and with the card underrunning, overrunning
+ * or stalled.
+ */
+
+struct harness_stream {
+    const char *name;
+    audio_devices_t devices;
+    audio_output_flags_t flags;         /* outputs only */
+    audio_format_t format;
+    audio_channel_mask_t channel_mask;
+    uint32_t sample_rate;
+    audio_devices_t routes[2];          /* the contention thread flips between them */
+    const char *source;                 /* file of the fixtures written in a loop, NULL
+                                           for the pulses latency is measured with */
+    unsigned int muted_ms;              /* inputs: what the HAL silences after a start */
+};
+
+/* terminated by a NULL name */
+extern const struct harness_stream harness_outputs[];
+extern const struct harness_stream harness_inputs[];
+
+/* names of harness_outputs or harness_inputs, the first that opens next
+ * to a running output is routed to and fro. terminated by a NULL. */
+extern const char *const harness_neighbours[];
+
+/* the fixtures under $ANDROID_BUILD_TOP/hardware/imx by default */
+extern const char harness_fixtures[];
+
+/* property_get answers, terminated by a NULL key */
+extern const char *const harness_properties[][2];
+
+/* sets up the fake cards the HAL opens, from the fixtures in dir */
+int harness_setup(const char *dir);
+
+/* undoes what harness_setup left outside the process, the HAL closed */
+void harness_teardown(void);
+
+#endif /* AUDIO_HAL_HARNESS_H */
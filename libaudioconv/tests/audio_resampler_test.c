@@ -0,0 +1,341 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The polyphase resampler on sine tones at -1 dBFS, for the rate pairs
+ * the HALs use and each quality level. The output is fitted with the
+ * tone at the output rate and what is left over is the THD+N, images
+ * and aliases included. A tone above the output Nyquist rate must come
+ * out attenuated by the stopband.
+ *
+ * Each case also checks the frame count, the gain, that stereo keeps
+ * its channels apart, that input handed over in odd pieces or through
+ * a provider gives the same samples, and NEON against scalar. Thread
+ * CPU time per output frame is printed, and cycles per frame when the
+ * clock in MHz is given as the first argument.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "audio_resampler.h"
+#include "imx_test.h"
+
+/* seconds of input per case */
+#define SECONDS 1
+#define AMPLITUDE (0.891 * 32767)   /* -1 dBFS */
+#define CHUNK 1024
+
+static double sMhz;
+
+struct test_case {
+    uint32_t in_rate;
+    uint32_t out_rate;
+    uint32_t channels;
+    uint32_t quality;
+    double freq;
+    double max_db;      /* THD+N, or the level of a tone in the stopband */
+};
+
+static const struct test_case sCases[] = {
+    /* HDMI and USB cards at the other of the two rates */
+    { 44100, 48000, 2, RESAMPLER_QUALITY_DEFAULT, 1000, -80 },
+    { 44100, 48000, 2, RESAMPLER_QUALITY_DEFAULT, 15000, -75 },
+    { 44100, 48000, 2, RESAMPLER_QUALITY_MAX, 1000, -90 },
+    { 44100, 48000, 2, RESAMPLER_QUALITY_MAX, 18000, -75 },
+    { 48000, 44100, 2, RESAMPLER_QUALITY_DEFAULT, 1000, -80 },
+    { 48000, 44100, 2, RESAMPLER_QUALITY_MAX, 15000, -75 },
+    /* capture for voice */
+    { 48000, 16000, 1, RESAMPLER_QUALITY_VOIP, 1000, -90 },
+    { 48000, 16000, 1, RESAMPLER_QUALITY_VOIP, 12000, -50 },
+    { 48000, 16000, 2, RESAMPLER_QUALITY_DEFAULT, 1000, -90 },
+    { 48000, 16000, 1, RESAMPLER_QUALITY_DEFAULT, 12000, -70 },
+    { 48000, 8000, 1, RESAMPLER_QUALITY_VOIP, 1000, -90 },
+    { 44100, 16000, 1, RESAMPLER_QUALITY_VOIP, 1000, -58 },
+    /* voice and low rate content played at the card rate */
+    { 16000, 48000, 2, RESAMPLER_QUALITY_DEFAULT, 1000, -90 },
+    { 16000, 48000, 1, RESAMPLER_QUALITY_DEFAULT, 6000, -75 },
+    { 8000, 48000, 2, RESAMPLER_QUALITY_DEFAULT, 1000, -85 },
+    { 22050, 48000, 2, RESAMPLER_QUALITY_DEFAULT, 1000, -78 },
+    { 32000, 44100, 2, RESAMPLER_QUALITY_DEFAULT, 1000, -85 },
+};
+
+struct test_provider {
+    struct resampler_buffer_provider provider;
+    const int16_t *in;
+    size_t frames;
+    size_t pos;
+    uint32_t channels;
+    size_t piece;
+};
+
+static int test_get_next_buffer(struct resampler_buffer_provider *provider,
+                                struct resampler_buffer *buffer)
+{
+    struct test_provider *p = (struct test_provider *)provider;
+    size_t n = p->frames - p->pos;
+
+    // less than asked for, the resampler has to come back
+    if (n > p->piece)
+        n = p->piece;
+    if (n > buffer->frame_count)
+        n = buffer->frame_count;
+    if (n == 0) {
+        buffer->raw = NULL;
+        buffer->frame_count = 0;
+        return -ENODATA;
+    }
+    buffer->i16 = (short *)(p->in + p->pos * p->channels);
+    buffer->frame_count = n;
+    return 0;
+}
+
+static void test_release_buffer(struct resampler_buffer_provider *provider,
+                                struct resampler_buffer *buffer)
+{
+    struct test_provider *p = (struct test_provider *)provider;
+
+    p->pos += buffer->frame_count;
+}
+
+/* the tone, the right channel in opposite phase */
+static void test_tone(int16_t *in, size_t frames, uint32_t channels, uint32_t rate,
+                      double freq)
+{
+    size_t i;
+
+    for (i = 0; i < frames; i++) {
+        double v = floor(AMPLITUDE * sin(2 * M_PI * freq * i / rate) + 0.5);
+        in[i * channels] = (int16_t)v;
+        if (channels == 2)
+            in[i * 2 + 1] = (int16_t)-v;
+    }
+}
+
+/* fits a tone of freq and a DC offset over n frames of one channel, n
+ * being whole periods. returns the power left over, the tone's in *power
+ * and the offset in *offset. */
+static double test_residual(const int16_t *out, size_t n, uint32_t channels,
+                            uint32_t rate, double freq, double *power, double *offset)
+{
+    double s = 0, c = 0, dc = 0, res = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        double w = 2 * M_PI * freq * i / rate;
+        s += out[i * channels] * sin(w);
+        c += out[i * channels] * cos(w);
+        dc += out[i * channels];
+    }
+    s *= 2.0 / n;
+    c *= 2.0 / n;
+    dc /= n;
+    for (i = 0; i < n; i++) {
+        double w = 2 * M_PI * freq * i / rate;
+        double e = out[i * channels] - (s * sin(w) + c * cos(w) + dc);
+        res += e * e;
+    }
+    *power = (s * s + c * c) / 2;
+    *offset = dc;
+    return res / n;
+}
+
+/* frames of one period of freq at rate, whole samples */
+static size_t test_period(uint32_t rate, double freq)
+{
+    uint32_t a = rate, b = (uint32_t)freq;
+
+    while (b != 0) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return rate / a;
+}
+
+/* resamples in, taking pieces of at most piece frames at a time */
+static size_t test_run_input(struct resampler_itfe *rs, const int16_t *in, size_t frames,
+                             int16_t *out, size_t out_frames, uint32_t channels,
+                             size_t piece)
+{
+    size_t pos = 0, done = 0;
+
+    while (pos < frames && done < out_frames) {
+        size_t n = frames - pos < piece ? frames - pos : piece;
+        size_t o = out_frames - done;
+
+        rs->resample_from_input(rs, (int16_t *)in + pos * channels, &n,
+                                out + done * channels, &o);
+        if (n == 0 && o == 0)
+            break;
+        pos += n;
+        done += o;
+    }
+    return done;
+}
+
+static void test_case(const struct test_case *t)
+{
+    size_t frames = t->in_rate * SECONDS;
+    size_t out_max = (size_t)((uint64_t)frames * t->out_rate / t->in_rate) + 64;
+    int16_t *in = malloc(frames * t->channels * sizeof(int16_t));
+    int16_t *out = malloc(out_max * t->channels * sizeof(int16_t));
+    int16_t *ref = malloc(out_max * t->channels * sizeof(int16_t));
+    struct resampler_itfe *rs;
+    struct audio_resampler_stats stats;
+    struct test_provider provider;
+    size_t done, n, i, period, skip, expect;
+    double res, power, db, gain, offset;
+    char name[64];
+    int ret;
+
+    snprintf(name, sizeof(name), "%u->%u %uch q%u %.0f Hz", t->in_rate, t->out_rate,
+             t->channels, t->quality, t->freq);
+    test_tone(in, frames, t->channels, t->in_rate, t->freq);
+
+    ret = audio_resampler_create(t->in_rate, t->out_rate, t->channels, t->quality,
+                                 NULL, &rs);
+    CHECK(ret == 0, "%s: create failed %d", name, ret);
+    if (ret != 0)
+        goto out;
+
+    audio_resampler_set_neon(0);
+    done = test_run_input(rs, in, frames, ref, out_max, t->channels, frames);
+    audio_resampler_get_stats(rs, &stats);
+
+    // the filter holds back about a window of input
+    expect = (size_t)((uint64_t)frames * t->out_rate / t->in_rate);
+    CHECK(done <= expect && done + stats.taps * t->out_rate / t->in_rate + 2 >= expect,
+          "%s: %zu frames out of %zu, expected about %zu", name, done, frames, expect);
+
+    // the first windows run over the silence before the tone
+    period = test_period(t->out_rate, t->freq);
+    skip = (size_t)stats.taps * 2 * t->out_rate / t->in_rate + period;
+    n = done > skip ? (done - skip) / period * period : 0;
+    CHECK(n >= t->out_rate / 4, "%s: %zu frames to measure", name, n);
+    if (n < t->out_rate / 4)
+        goto release;
+
+    if (t->freq * 2 < t->out_rate) {
+        res = test_residual(ref + skip * t->channels, n, t->channels, t->out_rate,
+                            t->freq, &power, &offset);
+        db = 10 * log10(res / power);
+        CHECK(db <= t->max_db, "%s: THD+N %.1f dB, limit %.0f", name, db, t->max_db);
+        // the short VOIP filters droop already within the voice band
+        gain = 10 * log10(power / (AMPLITUDE * AMPLITUDE / 2));
+        CHECK(fabs(gain) < (t->quality <= RESAMPLER_QUALITY_VOIP ? 0.5 : 0.2),
+              "%s: gain %.2f dB", name, gain);
+        // the output rounds to nearest, a low tone comes out without an
+        // offset. high ones leave a fraction of a bit of distortion there.
+        CHECK(t->freq > 1000 || fabs(offset) < 0.25, "%s: DC offset %.2f", name, offset);
+    } else {
+        // nothing of the tone may fold back below the output Nyquist rate
+        res = 0;
+        for (i = skip; i < skip + n; i++)
+            res += (double)ref[i * t->channels] * ref[i * t->channels];
+        db = 10 * log10(res / n / (AMPLITUDE * AMPLITUDE / 2));
+        CHECK(db <= t->max_db, "%s: alias at %.1f dB, limit %.0f", name, db, t->max_db);
+    }
+
+    if (t->channels == 2) {
+        for (i = 0; i < done; i++) {
+            if (abs(ref[i * 2] + ref[i * 2 + 1]) > 1) {
+                CHECK(0, "%s: frame %zu, right %d is not left %d inverted", name, i,
+                      ref[i * 2 + 1], ref[i * 2]);
+                break;
+            }
+        }
+    }
+
+    printf("%-32s taps %2u phases %4u: %s %6.1f dB, delay %5.2f ms, %4.0f ns/frame",
+           name, stats.taps, stats.phases, t->freq * 2 < t->out_rate ? "THD+N" : "alias",
+           db, stats.delay_ns / 1e6, (double)stats.cpu_ns / stats.frames);
+    if (sMhz > 0)
+        printf(", %4.0f cycles/frame", sMhz * stats.cpu_ns / 1000 / stats.frames);
+    printf("\n");
+
+    // the same samples in odd pieces, with NEON where built for it
+    audio_resampler_set_neon(1);
+    rs->reset(rs);
+    memset(out, 0, out_max * t->channels * sizeof(int16_t));
+    n = test_run_input(rs, in, frames, out, out_max, t->channels, 331);
+    CHECK(n == done && !memcmp(out, ref, done * t->channels * sizeof(int16_t)),
+          "%s: output in pieces differs", name);
+
+release:
+    audio_resampler_release(rs);
+
+    // and through a provider that hands out less than asked for
+    provider.provider.get_next_buffer = test_get_next_buffer;
+    provider.provider.release_buffer = test_release_buffer;
+    provider.in = in;
+    provider.frames = frames;
+    provider.pos = 0;
+    provider.channels = t->channels;
+    provider.piece = 97;
+    ret = audio_resampler_create(t->in_rate, t->out_rate, t->channels, t->quality,
+                                 &provider.provider, &rs);
+    CHECK(ret == 0, "%s: create with a provider failed %d", name, ret);
+    if (ret == 0) {
+        size_t got = 0;
+
+        memset(out, 0, out_max * t->channels * sizeof(int16_t));
+        while (got < done) {
+            n = done - got < CHUNK ? done - got : CHUNK;
+            rs->resample_from_provider(rs, out + got * t->channels, &n);
+            if (n == 0)
+                break;
+            got += n;
+        }
+        CHECK(got == done && !memcmp(out, ref, done * t->channels * sizeof(int16_t)),
+              "%s: output through the provider differs", name);
+        audio_resampler_release(rs);
+    }
+
+out:
+    free(in);
+    free(out);
+    free(ref);
+}
+
+static void test_limits(void)
+{
+    struct resampler_itfe *rs = (struct resampler_itfe *)1;
+
+    CHECK(audio_resampler_create(48000, 44100, 6, RESAMPLER_QUALITY_DEFAULT, NULL, &rs) ==
+          -EINVAL && rs == NULL, "6 channels accepted");
+    CHECK(audio_resampler_create(48000, 44101, 2, RESAMPLER_QUALITY_DEFAULT, NULL, &rs) ==
+          -EINVAL && rs == NULL, "44101 phases accepted");
+    CHECK(audio_resampler_create(0, 48000, 2, RESAMPLER_QUALITY_DEFAULT, NULL, &rs) ==
+          -EINVAL, "rate 0 accepted");
+}
+
+int main(int argc, char **argv)
+{
+    size_t i;
+
+    if (argc > 1)
+        sMhz = atof(argv[1]);
+
+    for (i = 0; i < sizeof(sCases) / sizeof(sCases[0]); i++)
+        test_case(&sCases[i]);
+    test_limits();
+
+    return imx_test_result("audio_resampler_test");
+}
@@ -0,0 +1,402 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The tinyalsa mixer for the host tests, on cards kept in memory. The
+ * values live on across mixer_open and mixer_close as in the driver. Each
+ * call counts the ioctls tinyalsa makes for it: mixer_ctl_set_value reads
+ * the control before writing it, mixer_ctl_set_array only writes, and a
+ * count past the values of the control or an array of an enum fails with
+ * -EINVAL as it does there. A card without controls has no mixer. */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <tinyalsa/asoundlib.h>
+
+#include "mixer_fake.h"
+
+#define MIXER_FAKE_MAX_CTLS 512
+#define MIXER_FAKE_MAX_VALUES 24
+#define MIXER_FAKE_MAX_ENUMS 8
+#define MIXER_FAKE_IEC958_BYTES 24
+
+struct mixer_ctl {
+    char name[64];
+    enum mixer_ctl_type type;
+    unsigned int num_values;
+    int value[MIXER_FAKE_MAX_VALUES];
+    unsigned int num_enums;
+    char enums[MIXER_FAKE_MAX_ENUMS][32];
+};
+
+struct mixer {
+    unsigned int card;
+    int open;
+    unsigned int num_ctls;
+    struct mixer_ctl ctl[MIXER_FAKE_MAX_CTLS];
+};
+
+struct mixer_fake_stats mixer_fake;
+
+static struct mixer sCards[MIXER_FAKE_CARDS];
+static unsigned int sDelayUs;
+/* the driver serializes the ioctls of concurrent threads */
+static pthread_mutex_t sLock = PTHREAD_MUTEX_INITIALIZER;
+
+int mixer_fake_add(unsigned int card, enum mixer_ctl_type type, const char *name,
+                   unsigned int num_values, const int *values, const char *enums)
+{
+    struct mixer *mixer;
+    struct mixer_ctl *ctl;
+    char list[256];
+    char *e, *save;
+    unsigned int i;
+
+    if (card >= MIXER_FAKE_CARDS)
+        return -EINVAL;
+    mixer = &sCards[card];
+    if (mixer->num_ctls == MIXER_FAKE_MAX_CTLS ||
+            num_values == 0 || num_values > MIXER_FAKE_MAX_VALUES)
+        return -EINVAL;
+    if (type != MIXER_CTL_TYPE_BOOL && type != MIXER_CTL_TYPE_INT &&
+            type != MIXER_CTL_TYPE_ENUM && type != MIXER_CTL_TYPE_IEC958)
+        return -EINVAL;
+
+    ctl = &mixer->ctl[mixer->num_ctls];
+    memset(ctl, 0, sizeof(*ctl));
+    snprintf(ctl->name, sizeof(ctl->name), "%s", name);
+    ctl->type = type;
+    ctl->num_values = num_values;
+    for (i = 0; i < num_values && values; i++)
+        ctl->value[i] = values[i];
+    if (enums) {
+        snprintf(list, sizeof(list), "%s", enums);
+        for (e = strtok_r(list, ",", &save); e; e = strtok_r(NULL, ",", &save)) {
+            if (ctl->num_enums == MIXER_FAKE_MAX_ENUMS)
+                return -EINVAL;
+            snprintf(ctl->enums[ctl->num_enums++], sizeof(ctl->enums[0]), "%s", e);
+        }
+    }
+    mixer->card = card;
+    mixer->num_ctls++;
+    return 0;
+}
+
+int mixer_fake_load(unsigned int card, const char *path)
+{
+    char line[512];
+    int values[MIXER_FAKE_MAX_VALUES];
+    FILE *f;
+
+    if (card >= MIXER_FAKE_CARDS)
+        return -EINVAL;
+    f = fopen(path, "r");
+    if (f == NULL)
+        return -errno;
+
+    sCards[card].num_ctls = 0;
+    while (fgets(line, sizeof(line), f)) {
+        char *type, *num, *value, *name, *enums, *save;
+        enum mixer_ctl_type t;
+        unsigned int i, n;
+
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        line[strcspn(line, "\n")] = '\0';
+        type = strtok_r(line, "\t", &save);
+        num = strtok_r(NULL, "\t", &save);
+        value = strtok_r(NULL, "\t", &save);
+        name = strtok_r(NULL, "\t", &save);
+        enums = strtok_r(NULL, "\t", &save);
+        if (name == NULL)
+            goto err;
+
+        if (!strcmp(type, "BOOL"))
+            t = MIXER_CTL_TYPE_BOOL;
+        else if (!strcmp(type, "INT"))
+            t = MIXER_CTL_TYPE_INT;
+        else if (!strcmp(type, "ENUM"))
+            t = MIXER_CTL_TYPE_ENUM;
+        else
+            goto err;
+        n = atoi(num);
+        for (i = 0; i < n && i < MIXER_FAKE_MAX_VALUES; i++)
+            values[i] = atoi(value);
+        if (mixer_fake_add(card, t, name, n, values, enums) != 0)
+            goto err;
+    }
+    fclose(f);
+    return 0;
+
+err:
+    fclose(f);
+    sCards[card].num_ctls = 0;
+    return -EINVAL;
+}
+
+void mixer_fake_clear(void)
+{
+    memset(sCards, 0, sizeof(sCards));
+}
+
+void mixer_fake_reset(void)
+{
+    pthread_mutex_lock(&sLock);
+    memset(&mixer_fake, 0, sizeof(mixer_fake));
+    pthread_mutex_unlock(&sLock);
+}
+
+void mixer_fake_set_delay(unsigned int us)
+{
+    sDelayUs = us;
+}
+
+unsigned int mixer_fake_num_ctls(unsigned int card)
+{
+    return sCards[card].num_ctls;
+}
+
+int mixer_fake_value(unsigned int card, unsigned int ctl)
+{
+    struct mixer_ctl *c = &sCards[card].ctl[ctl];
+    unsigned int i;
+
+    for (i = 1; i < c->num_values; i++)
+        if (c->value[i] != c->value[0])
+            return -1;
+    return c->value[0];
+}
+
+void mixer_fake_rename(unsigned int card, unsigned int ctl, const char *name)
+{
+    snprintf(sCards[card].ctl[ctl].name, sizeof(sCards[card].ctl[ctl].name), "%s", name);
+}
+
+/* the bus time of value ioctls, outside the lock as the codec is
+ * written after the driver has taken the value */
+static void mixer_fake_bus(unsigned int ioctls)
+{
+    if (sDelayUs)
+        usleep(sDelayUs * ioctls);
+}
+
+struct mixer *mixer_open(unsigned int card)
+{
+    struct mixer *mixer;
+    unsigned int i;
+
+    if (card >= MIXER_FAKE_CARDS)
+        return NULL;
+    mixer = &sCards[card];
+    pthread_mutex_lock(&sLock);
+    if (mixer->num_ctls == 0 || mixer->open) {
+        pthread_mutex_unlock(&sLock);
+        return NULL;
+    }
+
+    /* the list twice, for the count then the ids, then each control and
+     * each enum string */
+    mixer_fake.infos += 2;
+    for (i = 0; i < mixer->num_ctls; i++)
+        mixer_fake.infos += 1 + mixer->ctl[i].num_enums;
+    mixer->open = 1;
+    pthread_mutex_unlock(&sLock);
+    return mixer;
+}
+
+void mixer_close(struct mixer *mixer)
+{
+    if (mixer == NULL)
+        return;
+    pthread_mutex_lock(&sLock);
+    mixer->open = 0;
+    pthread_mutex_unlock(&sLock);
+}
+
+const char *mixer_get_name(struct mixer *mixer)
+{
+    return "mixer-fake";
+}
+
+unsigned int mixer_get_num_ctls(struct mixer *mixer)
+{
+    return mixer->num_ctls;
+}
+
+struct mixer_ctl *mixer_get_ctl(struct mixer *mixer, unsigned int id)
+{
+    if (id >= mixer->num_ctls)
+        return NULL;
+    return &mixer->ctl[id];
+}
+
+struct mixer_ctl *mixer_get_ctl_by_name(struct mixer *mixer, const char *name)
+{
+    unsigned int i;
+
+    for (i = 0; i < mixer->num_ctls; i++)
+        if (!strcmp(mixer->ctl[i].name, name))
+            return &mixer->ctl[i];
+    return NULL;
+}
+
+const char *mixer_ctl_get_name(struct mixer_ctl *ctl)
+{
+    return ctl->name;
+}
+
+enum mixer_ctl_type mixer_ctl_get_type(struct mixer_ctl *ctl)
+{
+    return ctl->type;
+}
+
+unsigned int mixer_ctl_get_num_values(struct mixer_ctl *ctl)
+{
+    return ctl->num_values;
+}
+
+unsigned int mixer_ctl_get_num_enums(struct mixer_ctl *ctl)
+{
+    return ctl->num_enums;
+}
+
+const char *mixer_ctl_get_enum_string(struct mixer_ctl *ctl, unsigned int enum_id)
+{
+    if (enum_id >= ctl->num_enums)
+        return NULL;
+    return ctl->enums[enum_id];
+}
+
+int mixer_ctl_get_value(struct mixer_ctl *ctl, unsigned int id)
+{
+    int value;
+
+    pthread_mutex_lock(&sLock);
+    if (id >= ctl->num_values || ctl->type == MIXER_CTL_TYPE_IEC958) {
+        mixer_fake.errors++;
+        pthread_mutex_unlock(&sLock);
+        return -EINVAL;
+    }
+    mixer_fake.reads++;
+    mixer_fake.gets++;
+    value = ctl->value[id];
+    pthread_mutex_unlock(&sLock);
+    mixer_fake_bus(1);
+    return value;
+}
+
+static int mixer_fake_valid(struct mixer_ctl *ctl, long value)
+{
+    switch (ctl->type) {
+    case MIXER_CTL_TYPE_BOOL:
+        return value == 0 || value == 1;
+    case MIXER_CTL_TYPE_ENUM:
+        return value >= 0 && value < (long)ctl->num_enums;
+    default:
+        return 1;
+    }
+}
+
+int mixer_ctl_set_value(struct mixer_ctl *ctl, unsigned int id, int value)
+{
+    pthread_mutex_lock(&sLock);
+    if (id >= ctl->num_values || ctl->type == MIXER_CTL_TYPE_IEC958 ||
+            !mixer_fake_valid(ctl, value)) {
+        mixer_fake.errors++;
+        pthread_mutex_unlock(&sLock);
+        return -EINVAL;
+    }
+    mixer_fake.reads++;
+    mixer_fake.writes++;
+    if (ctl->value[id] == value)
+        mixer_fake.redundant++;
+    ctl->value[id] = value;
+    pthread_mutex_unlock(&sLock);
+    mixer_fake_bus(2);
+    return 0;
+}
+
+/* count is in values, longs for BOOL and INT controls, and in bytes of
+ * channel status for IEC958 ones */
+int mixer_ctl_set_array(struct mixer_ctl *ctl, const void *array, size_t count)
+{
+    const long *values = array;
+    int changed = 0;
+    size_t i;
+
+    pthread_mutex_lock(&sLock);
+    if (ctl->type == MIXER_CTL_TYPE_IEC958) {
+        if (count == 0 || count > MIXER_FAKE_IEC958_BYTES)
+            goto err;
+        mixer_fake.writes++;
+        pthread_mutex_unlock(&sLock);
+        mixer_fake_bus(1);
+        return 0;
+    }
+    if (count == 0 || count > ctl->num_values ||
+            (ctl->type != MIXER_CTL_TYPE_BOOL && ctl->type != MIXER_CTL_TYPE_INT))
+        goto err;
+    for (i = 0; i < count; i++) {
+        if (!mixer_fake_valid(ctl, values[i]))
+            goto err;
+    }
+    mixer_fake.writes++;
+    for (i = 0; i < count; i++) {
+        changed |= ctl->value[i] != values[i];
+        ctl->value[i] = values[i];
+    }
+    if (!changed)
+        mixer_fake.redundant++;
+    pthread_mutex_unlock(&sLock);
+    mixer_fake_bus(1);
+    return 0;
+
+err:
+    mixer_fake.errors++;
+    pthread_mutex_unlock(&sLock);
+    return -EINVAL;
+}
+
+/* writes every value of the enum, without reading it first */
+int mixer_ctl_set_enum_by_string(struct mixer_ctl *ctl, const char *string)
+{
+    unsigned int i, id;
+    int changed = 0;
+
+    pthread_mutex_lock(&sLock);
+    for (id = 0; id < ctl->num_enums; id++)
+        if (!strcmp(ctl->enums[id], string))
+            break;
+    if (ctl->type != MIXER_CTL_TYPE_ENUM || id == ctl->num_enums) {
+        mixer_fake.errors++;
+        pthread_mutex_unlock(&sLock);
+        return -EINVAL;
+    }
+    mixer_fake.writes++;
+    for (i = 0; i < ctl->num_values; i++) {
+        changed |= ctl->value[i] != (int)id;
+        ctl->value[i] = id;
+    }
+    if (!changed)
+        mixer_fake.redundant++;
+    pthread_mutex_unlock(&sLock);
+    mixer_fake_bus(1);
+    return 0;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef MIXER_FAKE_H
+#define MIXER_FAKE_H
+
+#include <tinyalsa/asoundlib.h>
+
+#define MIXER_FAKE_CARDS 4
+
+/* the ioctls the tinyalsa mixer calls would have made since the last reset */
+struct mixer_fake_stats {
+    unsigned int infos;         /* SNDRV_CTL_IOCTL_ELEM_LIST and _INFO, at open */
+    unsigned int reads;         /* SNDRV_CTL_IOCTL_ELEM_READ */
+    unsigned int gets;          /* of them, mixer_ctl_get_value */
+    unsigned int writes;        /* SNDRV_CTL_IOCTL_ELEM_WRITE */
+    unsigned int redundant;     /* writes leaving every value as it was */
+    unsigned int errors;        /* calls tinyalsa fails with -EINVAL */
+};
+
+extern struct mixer_fake_stats mixer_fake;
+
+/* loads the controls of card at their power on values from a list of
+ * "type<tab>values<tab>value<tab>name<tab>enum,strings" lines */
+int mixer_fake_load(unsigned int card, const char *path);
+
+/* adds a control to card with num_values values, enums is a comma
+ * separated list for an ENUM control, NULL otherwise. IEC958 controls
+ * take the channel status bytes and keep no value. */
+int mixer_fake_add(unsigned int card, enum mixer_ctl_type type, const char *name,
+                   unsigned int num_values, const int *values, const char *enums);
+
+/* drops the controls of every card */
+void mixer_fake_clear(void);
+
+void mixer_fake_reset(void);
+
+/* time each value ioctl takes, as a codec behind a slow bus would */
+void mixer_fake_set_delay(unsigned int us);
+
+unsigned int mixer_fake_num_ctls(unsigned int card);
+
+/* -1 when the values of the control differ */
+int mixer_fake_value(unsigned int card, unsigned int ctl);
+
+/* as a driver update renaming a control would */
+void mixer_fake_rename(unsigned int card, unsigned int ctl, const char *name);
+
+#endif /* MIXER_FAKE_H */
@@ -0,0 +1,1104 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The tinyalsa pcm for the host tests, on cards clocked by CLOCK_MONOTONIC.
+ *
+ * The upper half is the KitKat tinyalsa: its prepared and running flags,
+ * the thresholds pcm_open picks, the restart of pcm_write and pcm_read on
+ * -EPIPE and the error strings. The lower half stands for the driver: the
+ * hardware pointer moves a period at a time at the rate of the stream,
+ * skewed by the drift of the card, a playback pcm underruns when it
+ * reaches the application pointer and a capture one overruns at the stop
+ * threshold. A non-blocking file descriptor, set with fcntl as the HAL
+ * does, makes the transfers partial as in the driver.
+ *
+ * The file descriptor is an eventfd polled as the pcm one would be: its
+ * counter is held at its maximum while a playback pcm has no room, and at
+ * one while a capture pcm has frames, by a thread following the cards.
+ *
+ * Written pulses are followed to the period the card plays them in, and
+ * the captured signal carries pulses of its own, so the tests measure
+ * the latency from the application to the speaker and back. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cutils/uevent.h>
+#include <tinyalsa/asoundlib.h>
+
+#include "pcm_fake.h"
+
+#define PCM_FAKE_TICK_NS 1000000
+#define PCM_FAKE_PENDING 256
+#define PCM_FAKE_PLAYED 1024
+
+#define PULSE_BASE 0x1000
+#define PULSE_STEP 0x600
+#define PULSE_THRESHOLD 0x800
+
+#define FD_PLAYBACK_FULL 0xfffffffffffffffeULL
+
+struct pcm_fake_card {
+    int present;
+    char id[16];
+    char driver[16];
+    char name[80];
+    unsigned int out_rate;
+    unsigned int in_rate;
+    unsigned int in_channels;
+    int ppm;
+};
+
+struct pcm {
+    struct pcm *next;
+    unsigned int card;
+    unsigned int device;
+    unsigned int flags;
+    struct pcm_config config;
+    unsigned int buffer_size;
+    unsigned int frame_bytes;
+    int fd;
+    uint64_t fd_count;          /* the eventfd counter */
+    char error[PCM_ERROR_MAX];
+
+    /* tinyalsa */
+    int prepared;
+    int running;
+    unsigned int underruns;
+
+    /* driver */
+    int state;
+    uint64_t hw;
+    uint64_t appl;
+    uint64_t base;              /* hw at the start */
+    int64_t start_ns;
+    int64_t tstamp_ns;          /* of the last period */
+    int64_t xrun_ns;            /* of the running xrun, 0 otherwise */
+    int64_t recover_ns;         /* of the xrun the next start recovers */
+    int64_t xrun_total_ns;
+    double rate;                /* frames per ns, with the drift */
+
+    /* playback pulses written and not played */
+    int in_pulse;
+    unsigned int pulse_frames;
+    uint64_t pending_pos[PCM_FAKE_PENDING];
+    unsigned int pending_seq[PCM_FAKE_PENDING];
+    unsigned int pending_head;
+    unsigned int pending_tail;
+
+    /* capture pulses */
+    unsigned int seq_base;
+};
+
+struct control {
+    unsigned int card;
+};
+
+struct pcm_fake_stats pcm_fake_out, pcm_fake_in;
+
+static pthread_mutex_t sLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sTick = PTHREAD_COND_INITIALIZER;
+static pthread_once_t sOnce = PTHREAD_ONCE_INIT;
+static struct pcm_fake_card sCards[PCM_FAKE_CARDS];
+static struct pcm *sPcms;
+
+static struct pcm_fake_pulse sPlayed[PCM_FAKE_PLAYED];
+static unsigned int sPlayedHead, sPlayedTail;
+static int64_t sCaptured[PCM_FAKE_PULSES];
+static unsigned int sCaptureSeq;
+static unsigned int sCapturePeriodMs = 100;
+static int64_t sStallNs;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static struct pcm_fake_stats *stats_of(struct pcm *pcm)
+{
+    return (pcm->flags & PCM_IN) ? &pcm_fake_in : &pcm_fake_out;
+}
+
+static int oops(struct pcm *pcm, int e, const char *msg)
+{
+    snprintf(pcm->error, sizeof(pcm->error), "%s: %s", msg, strerror(e));
+    return -1;
+}
+
+int pcm_fake_pulse_level(unsigned int seq)
+{
+    return PULSE_BASE + (seq % PCM_FAKE_PULSES) * PULSE_STEP;
+}
+
+int pcm_fake_pulse_seq(int level)
+{
+    int seq = (level - PULSE_BASE + PULSE_STEP / 2) / PULSE_STEP;
+
+    if (level < PULSE_BASE - PULSE_STEP / 2 || seq >= PCM_FAKE_PULSES)
+        return -1;
+    return seq;
+}
+
+/* the top 16 bits of sample i */
+static int get_sample(struct pcm *pcm, const void *data, size_t i)
+{
+    switch (pcm->config.format) {
+    case PCM_FORMAT_S32_LE:
+        return ((const int32_t *)data)[i] >> 16;
+    case PCM_FORMAT_S24_LE:
+        return ((const int32_t *)data)[i] >> 8;
+    case PCM_FORMAT_S8:
+        return ((const int8_t *)data)[i] << 8;
+    default:
+        return ((const int16_t *)data)[i];
+    }
+}
+
+static void put_sample(struct pcm *pcm, void *data, size_t i, int value)
+{
+    switch (pcm->config.format) {
+    case PCM_FORMAT_S32_LE:
+        ((int32_t *)data)[i] = value << 16;
+        break;
+    case PCM_FORMAT_S24_LE:
+        ((int32_t *)data)[i] = value << 8;
+        break;
+    case PCM_FORMAT_S8:
+        ((int8_t *)data)[i] = value >> 8;
+        break;
+    default:
+        ((int16_t *)data)[i] = value;
+        break;
+    }
+}
+
+static int64_t ns_at(struct pcm *pcm, uint64_t pos)
+{
+    return pcm->start_ns + (int64_t)((double)(pos - pcm->base) / pcm->rate);
+}
+
+/* the pending pulses before pos reached the speaker */
+static void played(struct pcm *pcm, uint64_t pos)
+{
+    while (pcm->pending_tail != pcm->pending_head &&
+           pcm->pending_pos[pcm->pending_tail % PCM_FAKE_PENDING] < pos) {
+        unsigned int i = pcm->pending_tail++ % PCM_FAKE_PENDING;
+
+        if (sPlayedHead - sPlayedTail < PCM_FAKE_PLAYED) {
+            sPlayed[sPlayedHead % PCM_FAKE_PLAYED].seq = pcm->pending_seq[i];
+            sPlayed[sPlayedHead % PCM_FAKE_PLAYED].ns = ns_at(pcm, pcm->pending_pos[i]);
+            sPlayedHead++;
+        }
+    }
+}
+
+/* what the card has not played by now never will be */
+static void drop(struct pcm *pcm)
+{
+    if (!(pcm->flags & PCM_IN)) {
+        played(pcm, pcm->hw < pcm->appl ? pcm->hw : pcm->appl);
+        pcm_fake_out.lost += pcm->pending_head - pcm->pending_tail;
+    }
+    pcm->pending_tail = pcm->pending_head;
+    pcm->in_pulse = 0;
+}
+
+static void xrun(struct pcm *pcm, int64_t ns)
+{
+    if (!(pcm->flags & PCM_IN))
+        played(pcm, pcm->hw < pcm->appl ? pcm->hw : pcm->appl);
+    pcm->state = PCM_STATE_XRUN;
+    pcm->xrun_ns = ns;
+    pcm->recover_ns = ns;
+    stats_of(pcm)->xruns++;
+}
+
+static uint64_t avail_of(struct pcm *pcm)
+{
+    if (pcm->flags & PCM_IN)
+        return pcm->hw - pcm->appl;
+    return pcm->buffer_size - (pcm->appl - pcm->hw);
+}
+
+/* what poll on the pcm would report, kept in the eventfd counter */
+static void update_fd(struct pcm *pcm)
+{
+    uint64_t want, count;
+    int ready;
+
+    switch (pcm->state) {
+    case PCM_STATE_PREPARED:
+    case PCM_STATE_RUNNING:
+        if (pcm->flags & PCM_IN)
+            ready = pcm->state == PCM_STATE_RUNNING &&
+                    avail_of(pcm) >= (uint64_t)pcm->config.avail_min;
+        else
+            ready = avail_of(pcm) >= (uint64_t)pcm->config.avail_min;
+        break;
+    default:
+        // errors wake the poll too
+        ready = 1;
+        break;
+    }
+    if (pcm->flags & PCM_IN)
+        want = ready ? 1 : 0;
+    else
+        want = ready ? 0 : FD_PLAYBACK_FULL;
+
+    if (want == pcm->fd_count || pcm->fd < 0)
+        return;
+    if (pcm->fd_count != 0)
+        read(pcm->fd, &count, sizeof(count));
+    if (want != 0)
+        write(pcm->fd, &want, sizeof(want));
+    pcm->fd_count = want;
+}
+
+/* moves the hardware pointer to the last period boundary before ns */
+static void update(struct pcm *pcm, int64_t ns)
+{
+    uint64_t period = pcm->config.period_size;
+    uint64_t hw, limit;
+
+    if (pcm->state == PCM_STATE_RUNNING) {
+        hw = pcm->base + (uint64_t)floor((double)(ns - pcm->start_ns) * pcm->rate / period) * period;
+        if (pcm->flags & PCM_IN)
+            limit = pcm->appl + pcm->config.stop_threshold;
+        else
+            limit = pcm->appl + pcm->config.stop_threshold - pcm->buffer_size;
+
+        if (hw > pcm->hw && hw >= limit) {
+            // the period the card ran out in
+            hw = pcm->base + (limit - pcm->base + period - 1) / period * period;
+            if (hw <= pcm->hw)
+                hw = pcm->hw + period;
+            pcm->hw = hw;
+            pcm->tstamp_ns = ns_at(pcm, hw);
+            xrun(pcm, pcm->tstamp_ns);
+        } else if (hw > pcm->hw) {
+            pcm->hw = hw;
+            pcm->tstamp_ns = ns_at(pcm, hw);
+            if (!(pcm->flags & PCM_IN))
+                played(pcm, hw);
+        }
+    }
+    update_fd(pcm);
+}
+
+static void *ticker(void *arg)
+{
+    struct timespec next;
+    struct pcm *pcm;
+    int64_t ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    for (;;) {
+        next.tv_nsec += PCM_FAKE_TICK_NS;
+        if (next.tv_nsec >= 1000000000) {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        pthread_mutex_lock(&sLock);
+        ns = now_ns() - (next.tv_sec * 1000000000LL + next.tv_nsec);
+        if (ns > sStallNs)
+            sStallNs = ns;
+        for (pcm = sPcms; pcm; pcm = pcm->next)
+            update(pcm, now_ns());
+        pthread_cond_broadcast(&sTick);
+        pthread_mutex_unlock(&sLock);
+    }
+    return NULL;
+}
+
+static void start_ticker(void)
+{
+    struct sched_param param;
+    pthread_t thread;
+    unsigned int i;
+
+    for (i = 0; i < PCM_FAKE_PULSES; i++)
+        sCaptured[i] = -1;
+    pthread_create(&thread, NULL, ticker, NULL);
+    pthread_detach(thread);
+
+    // the card clock waits for no one, when the host lets us
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+    pthread_setschedparam(thread, SCHED_FIFO, &param);
+}
+
+static int k_prepare(struct pcm *pcm)
+{
+    int64_t ns = now_ns();
+
+    update(pcm, ns);
+    if (pcm->state == PCM_STATE_RUNNING)
+        return -EBUSY;
+    if (pcm->state == PCM_STATE_OPEN || pcm->state == PCM_STATE_DISCONNECTED)
+        return -EBADFD;
+    drop(pcm);
+    if (pcm->xrun_ns) {
+        pcm->xrun_total_ns += ns - pcm->xrun_ns;
+        pcm->xrun_ns = 0;
+    }
+    pcm->appl = pcm->hw;
+    pcm->state = PCM_STATE_PREPARED;
+    update_fd(pcm);
+    return 0;
+}
+
+static int k_start(struct pcm *pcm)
+{
+    struct pcm_fake_stats *stats = stats_of(pcm);
+    struct pcm_fake_card *card = &sCards[pcm->card];
+    int64_t ns = now_ns();
+
+    if (pcm->state != PCM_STATE_PREPARED)
+        return -EBADFD;
+    if (!(pcm->flags & PCM_IN) && pcm->appl == pcm->hw)
+        return -EPIPE;
+
+    pcm->state = PCM_STATE_RUNNING;
+    pcm->base = pcm->hw;
+    pcm->start_ns = ns;
+    pcm->tstamp_ns = ns;
+    pcm->rate = pcm->config.rate * (1.0 + card->ppm / 1000000.0) / 1000000000.0;
+    pcm->seq_base = sCaptureSeq;
+    stats->starts++;
+    if (pcm->recover_ns) {
+        stats->recoveries++;
+        if (ns - pcm->recover_ns > stats->max_recovery_ns)
+            stats->max_recovery_ns = ns - pcm->recover_ns;
+        pcm->recover_ns = 0;
+    }
+    update_fd(pcm);
+    return 0;
+}
+
+static void k_drop(struct pcm *pcm)
+{
+    int64_t ns = now_ns();
+
+    update(pcm, ns);
+    drop(pcm);
+    if (pcm->xrun_ns) {
+        pcm->xrun_total_ns += ns - pcm->xrun_ns;
+        pcm->xrun_ns = 0;
+    }
+    pcm->state = PCM_STATE_SETUP;
+    update_fd(pcm);
+}
+
+/* follows the pulses of channel 0, a pulse is read in its middle so
+ * that the edges a resampler softens do not matter */
+static void scan_pulses(struct pcm *pcm, const void *data, uint64_t frames)
+{
+    unsigned int channels = pcm->config.channels;
+    uint64_t i;
+
+    for (i = 0; i < frames; i++) {
+        int level = get_sample(pcm, data, i * channels);
+
+        if (level <= PULSE_THRESHOLD) {
+            pcm->in_pulse = 0;
+            continue;
+        }
+        if (!pcm->in_pulse) {
+            pcm->in_pulse = 1;
+            pcm->pulse_frames = 0;
+        }
+        if (++pcm->pulse_frames == PCM_FAKE_PULSE_FRAMES / 2) {
+            int seq = pcm_fake_pulse_seq(level);
+            uint64_t pos = pcm->appl + i + 1 - PCM_FAKE_PULSE_FRAMES / 2;
+
+            if (seq >= 0 && pcm->pending_head - pcm->pending_tail < PCM_FAKE_PENDING) {
+                pcm->pending_pos[pcm->pending_head % PCM_FAKE_PENDING] = pos;
+                pcm->pending_seq[pcm->pending_head % PCM_FAKE_PENDING] = seq;
+                pcm->pending_head++;
+                pcm_fake_out.pulses++;
+            }
+        }
+    }
+}
+
+/* the captured signal: silence with a pulse every sCapturePeriodMs */
+static void capture(struct pcm *pcm, void *data, uint64_t frames)
+{
+    uint64_t every = (uint64_t)pcm->config.rate * sCapturePeriodMs / 1000;
+    unsigned int channels = pcm->config.channels;
+    uint64_t i;
+    unsigned int c;
+
+    for (i = 0; i < frames; i++) {
+        uint64_t rel = pcm->appl + i - pcm->base;
+        unsigned int seq = pcm->seq_base + rel / every;
+        int level = 0;
+
+        if (rel % every < PCM_FAKE_PULSE_FRAMES) {
+            level = pcm_fake_pulse_level(seq);
+            if (rel % every == 0) {
+                sCaptured[seq % PCM_FAKE_PULSES] = ns_at(pcm, pcm->appl + i);
+                pcm_fake_in.pulses++;
+                if (seq + 1 > sCaptureSeq)
+                    sCaptureSeq = seq + 1;
+            }
+        }
+        for (c = 0; c < channels; c++)
+            put_sample(pcm, data, i * channels + c, level);
+    }
+}
+
+static int nonblocking(struct pcm *pcm)
+{
+    return (fcntl(pcm->fd, F_GETFL) & O_NONBLOCK) != 0;
+}
+
+/* SNDRV_PCM_IOCTL_WRITEI_FRAMES, returns the frames taken */
+static int k_writei(struct pcm *pcm, const void *data, uint64_t frames)
+{
+    const uint8_t *src = (const uint8_t *)data;
+    int nonblock = nonblocking(pcm);
+    uint64_t done = 0;
+
+    while (done < frames) {
+        uint64_t n;
+
+        update(pcm, now_ns());
+        if (pcm->state == PCM_STATE_XRUN)
+            return -EPIPE;
+        if (pcm->state != PCM_STATE_PREPARED && pcm->state != PCM_STATE_RUNNING)
+            return -EBADFD;
+
+        n = avail_of(pcm);
+        if (n > frames - done)
+            n = frames - done;
+        if (n == 0) {
+            if (nonblock)
+                break;
+            pthread_cond_wait(&sTick, &sLock);
+            continue;
+        }
+        scan_pulses(pcm, src + done * pcm->frame_bytes, n);
+        pcm->appl += n;
+        done += n;
+        pcm_fake_out.frames += n;
+        if (pcm->state == PCM_STATE_PREPARED &&
+                pcm->appl - pcm->hw >= pcm->config.start_threshold)
+            k_start(pcm);
+        update_fd(pcm);
+    }
+    if (done == 0 && frames > 0)
+        return -EAGAIN;
+    return done;
+}
+
+/* SNDRV_PCM_IOCTL_READI_FRAMES */
+static int k_readi(struct pcm *pcm, void *data, uint64_t frames)
+{
+    uint8_t *dst = (uint8_t *)data;
+    int nonblock = nonblocking(pcm);
+    uint64_t done = 0;
+
+    while (done < frames) {
+        uint64_t n;
+
+        update(pcm, now_ns());
+        if (pcm->state == PCM_STATE_XRUN)
+            return -EPIPE;
+        if (pcm->state == PCM_STATE_PREPARED && frames >= pcm->config.start_threshold)
+            k_start(pcm);
+        if (pcm->state != PCM_STATE_RUNNING)
+            return -EBADFD;
+
+        n = avail_of(pcm);
+        if (n > frames - done)
+            n = frames - done;
+        if (n == 0) {
+            if (nonblock)
+                break;
+            pthread_cond_wait(&sTick, &sLock);
+            continue;
+        }
+        capture(pcm, dst + done * pcm->frame_bytes, n);
+        pcm->appl += n;
+        done += n;
+        pcm_fake_in.frames += n;
+        update_fd(pcm);
+    }
+    if (done == 0 && frames > 0)
+        return -EAGAIN;
+    return done;
+}
+
+int pcm_fake_add_card(unsigned int card, const char *id, const char *driver,
+                      const char *name, unsigned int out_rate, unsigned int in_rate,
+                      unsigned int in_channels)
+{
+    struct pcm_fake_card *c;
+
+    if (card >= PCM_FAKE_CARDS)
+        return -EINVAL;
+    c = &sCards[card];
+    memset(c, 0, sizeof(*c));
+    c->present = 1;
+    snprintf(c->id, sizeof(c->id), "%s", id);
+    snprintf(c->driver, sizeof(c->driver), "%s", driver);
+    snprintf(c->name, sizeof(c->name), "%s", name);
+    c->out_rate = out_rate;
+    c->in_rate = in_rate;
+    c->in_channels = in_channels;
+    return 0;
+}
+
+void pcm_fake_clear(void)
+{
+    pthread_mutex_lock(&sLock);
+    memset(sCards, 0, sizeof(sCards));
+    pthread_mutex_unlock(&sLock);
+}
+
+void pcm_fake_reset(void)
+{
+    pthread_mutex_lock(&sLock);
+    memset(&pcm_fake_out, 0, sizeof(pcm_fake_out));
+    memset(&pcm_fake_in, 0, sizeof(pcm_fake_in));
+    sPlayedTail = sPlayedHead;
+    sStallNs = 0;
+    pthread_mutex_unlock(&sLock);
+}
+
+int64_t pcm_fake_stall(void)
+{
+    int64_t ns;
+
+    pthread_mutex_lock(&sLock);
+    ns = sStallNs;
+    pthread_mutex_unlock(&sLock);
+    return ns;
+}
+
+void pcm_fake_set_drift(unsigned int card, int ppm)
+{
+    if (card < PCM_FAKE_CARDS)
+        sCards[card].ppm = ppm;
+}
+
+int pcm_fake_xrun(unsigned int card, unsigned int flags)
+{
+    struct pcm *pcm;
+    int count = 0;
+
+    pthread_mutex_lock(&sLock);
+    for (pcm = sPcms; pcm; pcm = pcm->next) {
+        if (pcm->card != card || (pcm->flags & PCM_IN) != (flags & PCM_IN))
+            continue;
+        update(pcm, now_ns());
+        if (pcm->state != PCM_STATE_RUNNING)
+            continue;
+        xrun(pcm, now_ns());
+        stats_of(pcm)->injected++;
+        update_fd(pcm);
+        count++;
+    }
+    pthread_mutex_unlock(&sLock);
+    return count;
+}
+
+size_t pcm_fake_played(struct pcm_fake_pulse *pulses, size_t max)
+{
+    size_t n = 0;
+
+    pthread_mutex_lock(&sLock);
+    while (n < max && sPlayedTail != sPlayedHead)
+        pulses[n++] = sPlayed[sPlayedTail++ % PCM_FAKE_PLAYED];
+    pthread_mutex_unlock(&sLock);
+    return n;
+}
+
+int64_t pcm_fake_captured(unsigned int seq)
+{
+    int64_t ns;
+
+    pthread_mutex_lock(&sLock);
+    ns = sCaptured[seq % PCM_FAKE_PULSES];
+    pthread_mutex_unlock(&sLock);
+    return ns;
+}
+
+void pcm_fake_set_capture_pulses(unsigned int period_ms)
+{
+    sCapturePeriodMs = period_ms;
+}
+
+struct pcm *pcm_open(unsigned int card, unsigned int device, unsigned int flags,
+                     struct pcm_config *config)
+{
+    struct pcm *pcm, *other;
+
+    pthread_once(&sOnce, start_ticker);
+
+    pcm = (struct pcm *)calloc(1, sizeof(struct pcm));
+    if (pcm == NULL)
+        return NULL;
+    pcm->fd = -1;
+    pcm->card = card;
+    pcm->device = device;
+    pcm->flags = flags;
+
+    pthread_mutex_lock(&sLock);
+    if (card >= PCM_FAKE_CARDS || !sCards[card].present || device != 0 || config == NULL ||
+            ((flags & PCM_IN) ? sCards[card].in_rate : sCards[card].out_rate) == 0) {
+        oops(pcm, ENODEV, "cannot open device");
+        pthread_mutex_unlock(&sLock);
+        return pcm;
+    }
+    for (other = sPcms; other; other = other->next) {
+        if (other->card == card && (other->flags & PCM_IN) == (flags & PCM_IN)) {
+            oops(pcm, EBUSY, "cannot open device");
+            pthread_mutex_unlock(&sLock);
+            return pcm;
+        }
+    }
+
+    pcm->config = *config;
+    pcm->buffer_size = config->period_count * config->period_size;
+    pcm->frame_bytes = config->channels * pcm_format_to_bits(config->format) / 8;
+    if (!config->start_threshold)
+        pcm->config.start_threshold = (flags & PCM_IN) ? 1 : pcm->buffer_size / 2;
+    if (!config->stop_threshold)
+        pcm->config.stop_threshold = (flags & PCM_IN) ? pcm->buffer_size * 10 : pcm->buffer_size;
+    if (!config->avail_min)
+        pcm->config.avail_min = (flags & PCM_MMAP) ? config->period_size : 1;
+    pcm->state = PCM_STATE_SETUP;
+
+    pcm->fd = eventfd(0, 0);
+    if (pcm->fd < 0) {
+        oops(pcm, errno, "cannot open device");
+        pthread_mutex_unlock(&sLock);
+        return pcm;
+    }
+    update_fd(pcm);
+    pcm->next = sPcms;
+    sPcms = pcm;
+    stats_of(pcm)->opens++;
+    pthread_mutex_unlock(&sLock);
+    return pcm;
+}
+
+int pcm_close(struct pcm *pcm)
+{
+    struct pcm **p;
+
+    if (pcm == NULL)
+        return 0;
+    pthread_mutex_lock(&sLock);
+    for (p = &sPcms; *p; p = &(*p)->next) {
+        if (*p == pcm) {
+            *p = pcm->next;
+            k_drop(pcm);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sLock);
+    if (pcm->fd >= 0)
+        close(pcm->fd);
+    free(pcm);
+    return 0;
+}
+
+int pcm_is_ready(struct pcm *pcm)
+{
+    return pcm->fd >= 0;
+}
+
+const char *pcm_get_error(struct pcm *pcm)
+{
+    return pcm->error;
+}
+
+int pcm_get_file_descriptor(struct pcm *pcm)
+{
+    return pcm->fd;
+}
+
+unsigned int pcm_get_buffer_size(struct pcm *pcm)
+{
+    return pcm->buffer_size;
+}
+
+unsigned int pcm_format_to_bits(enum pcm_format format)
+{
+    switch (format) {
+    case PCM_FORMAT_S32_LE:
+    case PCM_FORMAT_S24_LE:
+        return 32;
+    case PCM_FORMAT_S8:
+        return 8;
+    default:
+        return 16;
+    }
+}
+
+unsigned int pcm_frames_to_bytes(struct pcm *pcm, unsigned int frames)
+{
+    return frames * pcm->frame_bytes;
+}
+
+unsigned int pcm_bytes_to_frames(struct pcm *pcm, unsigned int bytes)
+{
+    return bytes / pcm->frame_bytes;
+}
+
+int pcm_state(struct pcm *pcm)
+{
+    int state;
+
+    pthread_mutex_lock(&sLock);
+    update(pcm, now_ns());
+    state = pcm->state;
+    pthread_mutex_unlock(&sLock);
+    return state;
+}
+
+int pcm_get_time_of_xrun(struct pcm *pcm)
+{
+    int64_t ns;
+
+    pthread_mutex_lock(&sLock);
+    update(pcm, now_ns());
+    ns = pcm->xrun_total_ns;
+    if (pcm->xrun_ns)
+        ns += now_ns() - pcm->xrun_ns;
+    pthread_mutex_unlock(&sLock);
+    return ns / 1000000;
+}
+
+static int prepare_locked(struct pcm *pcm)
+{
+    int ret;
+
+    if (pcm->prepared)
+        return 0;
+    ret = k_prepare(pcm);
+    if (ret < 0)
+        return oops(pcm, -ret, "cannot prepare channel");
+    pcm->prepared = 1;
+    return 0;
+}
+
+static int start_locked(struct pcm *pcm)
+{
+    int ret = prepare_locked(pcm);
+
+    if (ret)
+        return ret;
+    ret = k_start(pcm);
+    if (ret < 0)
+        return oops(pcm, -ret, "cannot start channel");
+    pcm->running = 1;
+    return 0;
+}
+
+int pcm_prepare(struct pcm *pcm)
+{
+    int ret;
+
+    pthread_mutex_lock(&sLock);
+    ret = prepare_locked(pcm);
+    pthread_mutex_unlock(&sLock);
+    return ret;
+}
+
+int pcm_start(struct pcm *pcm)
+{
+    int ret;
+
+    pthread_mutex_lock(&sLock);
+    ret = start_locked(pcm);
+    pthread_mutex_unlock(&sLock);
+    return ret;
+}
+
+int pcm_stop(struct pcm *pcm)
+{
+    pthread_mutex_lock(&sLock);
+    k_drop(pcm);
+    pcm->prepared = 0;
+    pcm->running = 0;
+    pthread_mutex_unlock(&sLock);
+    return 0;
+}
+
+int pcm_write(struct pcm *pcm, const void *data, unsigned int count)
+{
+    unsigned int frames;
+    int ret;
+
+    if (pcm->flags & PCM_IN)
+        return -EINVAL;
+    frames = count / pcm->frame_bytes;
+
+    pthread_mutex_lock(&sLock);
+    for (;;) {
+        if (!pcm->running) {
+            ret = prepare_locked(pcm);
+            if (ret)
+                break;
+            ret = k_writei(pcm, data, frames);
+            if (ret < 0) {
+                ret = oops(pcm, -ret, "cannot write initial data");
+                break;
+            }
+            pcm->running = 1;
+            ret = 0;
+            break;
+        }
+        ret = k_writei(pcm, data, frames);
+        if (ret < 0) {
+            pcm->prepared = 0;
+            pcm->running = 0;
+            if (ret == -EPIPE) {
+                // we failed to make our window -- try to restart
+                pcm->underruns++;
+                if (pcm->flags & PCM_NORESTART)
+                    break;
+                continue;
+            }
+            ret = oops(pcm, -ret, "cannot write stream data");
+            break;
+        }
+        ret = 0;
+        break;
+    }
+    pthread_mutex_unlock(&sLock);
+    return ret;
+}
+
+int pcm_read(struct pcm *pcm, void *data, unsigned int count)
+{
+    unsigned int frames;
+    int ret;
+
+    if (!(pcm->flags & PCM_IN))
+        return -EINVAL;
+    frames = count / pcm->frame_bytes;
+
+    pthread_mutex_lock(&sLock);
+    for (;;) {
+        if (!pcm->running) {
+            ret = start_locked(pcm);
+            if (ret < 0) {
+                ret = -EBADFD;
+                break;
+            }
+        }
+        ret = k_readi(pcm, data, frames);
+        if (ret < 0) {
+            pcm->prepared = 0;
+            pcm->running = 0;
+            if (ret == -EPIPE) {
+                // we failed to make our window -- try to restart
+                pcm->underruns++;
+                continue;
+            }
+            ret = oops(pcm, -ret, "cannot read stream data");
+            break;
+        }
+        ret = 0;
+        break;
+    }
+    pthread_mutex_unlock(&sLock);
+    return ret;
+}
+
+/* an xrun fails the write as the pcm_wait of tinyalsa reports it, the
+ * rest follows pcm_mmap_transfer: the pcm starts at the threshold before
+ * a copy, and a card without room waits for avail_min */
+int pcm_mmap_write(struct pcm *pcm, const void *data, unsigned int count)
+{
+    const uint8_t *src = (const uint8_t *)data;
+    uint64_t frames, done = 0;
+    int ret = 0;
+
+    if (!(pcm->flags & PCM_MMAP) || (pcm->flags & PCM_IN))
+        return -ENOSYS;
+    frames = count / pcm->frame_bytes;
+
+    pthread_mutex_lock(&sLock);
+    if (pcm->state == PCM_STATE_SETUP) {
+        ret = prepare_locked(pcm);
+        if (ret)
+            goto out;
+    }
+    while (done < frames) {
+        uint64_t avail, n;
+
+        update(pcm, now_ns());
+        if (pcm->state == PCM_STATE_XRUN) {
+            pcm->prepared = 0;
+            pcm->running = 0;
+            ret = -EPIPE;
+            goto out;
+        }
+        avail = avail_of(pcm);
+        if (!pcm->running && pcm->buffer_size - avail >= pcm->config.start_threshold) {
+            ret = start_locked(pcm);
+            if (ret < 0)
+                goto out;
+        }
+        if (pcm->running && avail < (uint64_t)pcm->config.avail_min) {
+            pthread_cond_wait(&sTick, &sLock);
+            continue;
+        }
+        n = frames - done < avail ? frames - done : avail;
+        if (n == 0)
+            break;
+        scan_pulses(pcm, src + done * pcm->frame_bytes, n);
+        pcm->appl += n;
+        done += n;
+        pcm_fake_out.frames += n;
+        update_fd(pcm);
+    }
+out:
+    pthread_mutex_unlock(&sLock);
+    return ret;
+}
+
+int pcm_get_htimestamp(struct pcm *pcm, unsigned int *avail, struct timespec *tstamp)
+{
+    struct timespec mono, real;
+    int64_t ns;
+
+    if (!pcm_is_ready(pcm))
+        return -1;
+    pthread_mutex_lock(&sLock);
+    update(pcm, now_ns());
+    if (pcm->state != PCM_STATE_RUNNING && pcm->state != PCM_STATE_DRAINING) {
+        pthread_mutex_unlock(&sLock);
+        return -1;
+    }
+    *avail = avail_of(pcm);
+    ns = pcm->tstamp_ns;
+    pthread_mutex_unlock(&sLock);
+
+    // without PCM_MONOTONIC the driver stamps with the wall clock
+    if (!(pcm->flags & PCM_MONOTONIC)) {
+        clock_gettime(CLOCK_MONOTONIC, &mono);
+        clock_gettime(CLOCK_REALTIME, &real);
+        ns += (real.tv_sec - mono.tv_sec) * 1000000000LL + real.tv_nsec - mono.tv_nsec;
+    }
+    tstamp->tv_sec = ns / 1000000000;
+    tstamp->tv_nsec = ns % 1000000000;
+    return 0;
+}
+
+/* the Freescale additions of tinyalsa, answered from the cards */
+
+struct control *control_open(unsigned int card)
+{
+    struct control *control;
+
+    if (card >= PCM_FAKE_CARDS || !sCards[card].present)
+        return NULL;
+    control = (struct control *)calloc(1, sizeof(struct control));
+    if (control)
+        control->card = card;
+    return control;
+}
+
+void control_close(struct control *control)
+{
+    free(control);
+}
+
+const char *control_card_info_get_id(struct control *control)
+{
+    return sCards[control->card].id;
+}
+
+const char *control_card_info_get_driver(struct control *control)
+{
+    return sCards[control->card].driver;
+}
+
+const char *control_card_info_get_name(struct control *control)
+{
+    return sCards[control->card].name;
+}
+
+int pcm_get_near_param(unsigned int card, unsigned int device, unsigned int flags,
+                       int type, int *data)
+{
+    struct pcm_fake_card *c;
+    unsigned int rate;
+
+    if (card >= PCM_FAKE_CARDS || !sCards[card].present || device != 0)
+        return -1;
+    c = &sCards[card];
+    rate = (flags & PCM_IN) ? c->in_rate : c->out_rate;
+    if (rate == 0)
+        return -1;
+    switch (type) {
+    case PCM_HW_PARAM_RATE:
+        *data = rate;
+        return 0;
+    case PCM_HW_PARAM_CHANNELS:
+        *data = (flags & PCM_IN) ? c->in_channels : 2;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+int pcm_check_param_mask(unsigned int card, unsigned int device, unsigned int flags,
+                         int type, int value)
+{
+    struct pcm_fake_card *c;
+
+    if (card >= PCM_FAKE_CARDS || !sCards[card].present || device != 0)
+        return 0;
+    c = &sCards[card];
+    if (((flags & PCM_IN) ? c->in_rate : c->out_rate) == 0)
+        return 0;
+    return type == PCM_HW_PARAM_FORMAT && value == PCM_FORMAT_S16_LE;
+}
+
+/* no uevents on the host, the cards stay as the test set them */
+
+int uevent_open_socket(int buf_sz, bool passcred)
+{
+    return -1;
+}
+
+ssize_t uevent_kernel_multicast_recv(int socket, void *buffer, size_t length)
+{
+    errno = EINVAL;
+    return -1;
+}
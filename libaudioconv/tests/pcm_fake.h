@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PCM_FAKE_H
+#define PCM_FAKE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <tinyalsa/asoundlib.h>
+
+#define PCM_FAKE_CARDS 4
+
+/* a pulse is PCM_FAKE_PULSE_FRAMES frames at a level telling its number
+ * modulo PCM_FAKE_PULSES, on every channel */
+#define PCM_FAKE_PULSE_FRAMES 64
+#define PCM_FAKE_PULSES 16
+
+/* what the cards of one direction went through since the last reset */
+struct pcm_fake_stats {
+    unsigned int opens;
+    unsigned int starts;        /* SNDRV_PCM_IOCTL_START, explicit or by threshold */
+    unsigned int xruns;         /* the card ran dry or overran */
+    unsigned int injected;      /* of them, forced by pcm_fake_xrun */
+    unsigned int recoveries;    /* starts after an xrun */
+    int64_t max_recovery_ns;    /* xrun to the next start */
+    uint64_t frames;            /* transferred */
+    unsigned int pulses;        /* written or captured */
+    unsigned int lost;          /* written and dropped by prepare, close or xrun */
+};
+
+extern struct pcm_fake_stats pcm_fake_out, pcm_fake_in;
+
+struct pcm_fake_pulse {
+    unsigned int seq;
+    int64_t ns;                 /* CLOCK_MONOTONIC */
+};
+
+/* a card as control_open and the hw params show it, out_rate or in_rate
+ * 0 for a card without playback or capture. its pcms run at the rate
+ * they are opened with. */
+int pcm_fake_add_card(unsigned int card, const char *id, const char *driver,
+                      const char *name, unsigned int out_rate, unsigned int in_rate,
+                      unsigned int in_channels);
+
+/* drops every card, the pcms must be closed */
+void pcm_fake_clear(void);
+
+void pcm_fake_reset(void);
+
+/* the longest the card clock ticked late since the last reset: the host
+ * stalled the process, the cards with it */
+int64_t pcm_fake_stall(void);
+
+/* the card clock runs ppm fast against CLOCK_MONOTONIC */
+void pcm_fake_set_drift(unsigned int card, int ppm);
+
+/* the running pcms of card in the direction of flags (PCM_OUT or PCM_IN)
+ * overrun or underrun at once. returns how many did. */
+int pcm_fake_xrun(unsigned int card, unsigned int flags);
+
+/* the level of pulse seq, and the number a pulse of level carries or -1 */
+int pcm_fake_pulse_level(unsigned int seq);
+int pcm_fake_pulse_seq(int level);
+
+/* the written pulses played since the last call, with when the card
+ * played their first frame. returns how many were copied. */
+size_t pcm_fake_played(struct pcm_fake_pulse *pulses, size_t max);
+
+/* when the card captured the first frame of pulse seq, -1 if it has not
+ * yet or the number came round again since. the captured signal has a
+ * pulse every period_ms. */
+int64_t pcm_fake_captured(unsigned int seq);
+void pcm_fake_set_capture_pulses(unsigned int period_ms);
+
+#endif /* PCM_FAKE_H */
@@ -0,0 +1,61 @@
+# Copyright (C) 2013 Freescale Semiconductor, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+# software composition kernels shared by the gralloc and hwcomposer
+# fallbacks, linked statically.
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := compose.cpp
+LOCAL_MODULE := libimxcompose
+LOCAL_ARM_MODE := arm
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+LOCAL_CFLAGS += -mfpu=neon
+endif
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_STATIC_LIBRARY)
+
+# scalar only build for checking the references off target
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := compose.cpp
+LOCAL_MODULE := libimxcompose_host
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+# the scalar kernels against a floating point model and the reference
+# outputs in tests/compose_golden.txt, and their Mpix/s, run on the host:
+# out/host/<os>-<arch>/bin/compose_test
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := tests/compose_test.cpp
+LOCAL_C_INCLUDES += hardware/imx/libimxtest
+LOCAL_STATIC_LIBRARIES := libimxcompose_host libimxtest_host
+LOCAL_LDLIBS := -lrt
+LOCAL_MODULE := compose_test
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
+
+# the same on the target, NEON against scalar:
+# adb shell /data/nativetest/compose_test/compose_test <compose_golden.txt>
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := tests/compose_test.cpp
+LOCAL_C_INCLUDES += hardware/imx/libimxtest
+LOCAL_STATIC_LIBRARIES := libimxcompose libimxtest
+LOCAL_ARM_MODE := arm
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+LOCAL_CFLAGS += -mfpu=neon
+endif
+LOCAL_MODULE := compose_test
+LOCAL_MODULE_PATH := $(TARGET_OUT_DATA_NATIVE_TESTS)/compose_test
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,660 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <system/graphics.h>
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#include "compose.h"
+
+/* bilinear weights have 7 bits so two passes fit 16 and 32 bit lanes */
+#define SCALE_BITS 7
+#define SCALE_ONE (1 << SCALE_BITS)
+
+static int sNeon = 1;
+
+void compose_set_neon(int enable)
+{
+    sNeon = enable;
+}
+
+static int compose_bpp(int format)
+{
+    switch (format) {
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+            return 4;
+        case HAL_PIXEL_FORMAT_RGB_565:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+/* byte offset of red in a 32bpp pixel */
+static int compose_red(int format)
+{
+    return format == HAL_PIXEL_FORMAT_BGRA_8888 ? 2 : 0;
+}
+
+static int compose_is_yuv420(int format)
+{
+    switch (format) {
+        case HAL_PIXEL_FORMAT_YCbCr_420_SP:
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+        case HAL_PIXEL_FORMAT_YCbCr_420_P:
+        case HAL_PIXEL_FORMAT_YV12:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static inline uint8_t compose_clamp(int v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+/* x / 255 rounded, exact for x <= 255 * 255 */
+static inline uint32_t compose_div255(uint32_t x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+static inline uint8_t* compose_row(const compose_image_t *img, int plane, int y)
+{
+    return (uint8_t *)img->planes[plane] + y * img->stride[plane];
+}
+
+/*****************************************************************************/
+/* pixel format conversion */
+
+static void compose_565_to_8888(uint8_t *dst, const uint16_t *src, int n,
+                                int red)
+{
+    int i = 0;
+#ifdef __ARM_NEON__
+    if (sNeon) {
+        for (; i + 8 <= n; i += 8) {
+            uint16x8_t p = vld1q_u16(src + i);
+            uint8x8x4_t out;
+            uint8x8_t r = vand_u8(vshrn_n_u16(p, 8), vdup_n_u8(0xf8));
+            uint8x8_t g = vand_u8(vshrn_n_u16(p, 3), vdup_n_u8(0xfc));
+            uint8x8_t b = vmovn_u16(vshlq_n_u16(p, 3));
+            out.val[red] = vsri_n_u8(r, r, 5);
+            out.val[1] = vsri_n_u8(g, g, 6);
+            out.val[2 - red] = vsri_n_u8(b, b, 5);
+            out.val[3] = vdup_n_u8(0xff);
+            vst4_u8(dst + i * 4, out);
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        uint16_t p = src[i];
+        uint8_t r = p >> 11, g = (p >> 5) & 0x3f, b = p & 0x1f;
+        uint8_t *d = dst + i * 4;
+        d[red] = (r << 3) | (r >> 2);
+        d[1] = (g << 2) | (g >> 4);
+        d[2 - red] = (b << 3) | (b >> 2);
+        d[3] = 0xff;
+    }
+}
+
+static void compose_8888_to_565(uint16_t *dst, const uint8_t *src, int n,
+                                int red)
+{
+    int i = 0;
+#ifdef __ARM_NEON__
+    if (sNeon) {
+        for (; i + 8 <= n; i += 8) {
+            uint8x8x4_t in = vld4_u8(src + i * 4);
+            uint16x8_t p = vshll_n_u8(in.val[red], 8);
+            p = vsriq_n_u16(p, vshll_n_u8(in.val[1], 8), 5);
+            p = vsriq_n_u16(p, vshll_n_u8(in.val[2 - red], 8), 11);
+            vst1q_u16(dst + i, p);
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        const uint8_t *s = src + i * 4;
+        dst[i] = ((s[red] >> 3) << 11) | ((s[1] >> 2) << 5) | (s[2 - red] >> 3);
+    }
+}
+
+/* 32bpp to 32bpp, swapping red and blue and/or forcing alpha opaque */
+static void compose_8888_to_8888(uint8_t *dst, const uint8_t *src, int n,
+                                 int swap, int opaque)
+{
+    int i = 0;
+#ifdef __ARM_NEON__
+    if (sNeon) {
+        for (; i + 16 <= n; i += 16) {
+            uint8x16x4_t in = vld4q_u8(src + i * 4);
+            if (swap) {
+                uint8x16_t t = in.val[0];
+                in.val[0] = in.val[2];
+                in.val[2] = t;
+            }
+            if (opaque) {
+                in.val[3] = vdupq_n_u8(0xff);
+            }
+            vst4q_u8(dst + i * 4, in);
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        const uint8_t *s = src + i * 4;
+        uint8_t *d = dst + i * 4;
+        uint8_t r = s[0], b = s[2];
+        d[0] = swap ? b : r;
+        d[1] = s[1];
+        d[2] = swap ? r : b;
+        d[3] = opaque ? 0xff : s[3];
+    }
+}
+
+/* BT.601 video range, u and v advance by cstep per two pixels */
+static void compose_yuv_to_8888(uint8_t *dst, const uint8_t *y,
+                                const uint8_t *u, const uint8_t *v,
+                                int cstep, int n, int red)
+{
+    int i = 0;
+#ifdef __ARM_NEON__
+    if (sNeon) {
+        for (; i + 16 <= n; i += 16) {
+            const uint8_t *pu = u + (i >> 1) * cstep;
+            const uint8_t *pv = v + (i >> 1) * cstep;
+            uint8x8_t cb, cr;
+            if (cstep == 2) {
+                uint8x8x2_t uv = vld2_u8(pu < pv ? pu : pv);
+                cb = uv.val[pu < pv ? 0 : 1];
+                cr = uv.val[pu < pv ? 1 : 0];
+            } else {
+                cb = vld1_u8(pu);
+                cr = vld1_u8(pv);
+            }
+
+            int16x8_t d = vreinterpretq_s16_u16(vsubl_u8(cb, vdup_n_u8(128)));
+            int16x8_t e = vreinterpretq_s16_u16(vsubl_u8(cr, vdup_n_u8(128)));
+            int32x4_t cr4[2], cg4[2], cb4[2];
+            cr4[0] = vmull_n_s16(vget_low_s16(e), 409);
+            cr4[1] = vmull_n_s16(vget_high_s16(e), 409);
+            cg4[0] = vmlal_n_s16(vmull_n_s16(vget_low_s16(d), -100), vget_low_s16(e), -208);
+            cg4[1] = vmlal_n_s16(vmull_n_s16(vget_high_s16(d), -100), vget_high_s16(e), -208);
+            cb4[0] = vmull_n_s16(vget_low_s16(d), 516);
+            cb4[1] = vmull_n_s16(vget_high_s16(d), 516);
+
+            uint8x16_t luma = vld1q_u8(y + i);
+            int16x8_t c[2];
+            c[0] = vreinterpretq_s16_u16(vsubl_u8(vget_low_u8(luma), vdup_n_u8(16)));
+            c[1] = vreinterpretq_s16_u16(vsubl_u8(vget_high_u8(luma), vdup_n_u8(16)));
+
+            uint16x4_t r16[4], g16[4], b16[4];
+            for (int k = 0; k < 4; k++) {
+                // every chroma sample covers two neighbouring pixels.
+                int32x4x2_t zr = vzipq_s32(cr4[k >> 1], cr4[k >> 1]);
+                int32x4x2_t zg = vzipq_s32(cg4[k >> 1], cg4[k >> 1]);
+                int32x4x2_t zb = vzipq_s32(cb4[k >> 1], cb4[k >> 1]);
+                int16x4_t ck = (k & 1) ? vget_high_s16(c[k >> 1]) : vget_low_s16(c[k >> 1]);
+                int32x4_t yy = vmlal_n_s16(vdupq_n_s32(128), ck, 298);
+                r16[k] = vqshrun_n_s32(vaddq_s32(yy, zr.val[k & 1]), 8);
+                g16[k] = vqshrun_n_s32(vaddq_s32(yy, zg.val[k & 1]), 8);
+                b16[k] = vqshrun_n_s32(vaddq_s32(yy, zb.val[k & 1]), 8);
+            }
+
+            uint8x8x4_t out;
+            for (int h = 0; h < 2; h++) {
+                out.val[red] = vqmovn_u16(vcombine_u16(r16[h * 2], r16[h * 2 + 1]));
+                out.val[1] = vqmovn_u16(vcombine_u16(g16[h * 2], g16[h * 2 + 1]));
+                out.val[2 - red] = vqmovn_u16(vcombine_u16(b16[h * 2], b16[h * 2 + 1]));
+                out.val[3] = vdup_n_u8(0xff);
+                vst4_u8(dst + (i + h * 8) * 4, out);
+            }
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        int c = y[i] - 16;
+        int d = u[(i >> 1) * cstep] - 128;
+        int e = v[(i >> 1) * cstep] - 128;
+        int yy = 298 * c + 128;
+        uint8_t *p = dst + i * 4;
+        p[red] = compose_clamp((yy + 409 * e) >> 8);
+        p[1] = compose_clamp((yy - 100 * d - 208 * e) >> 8);
+        p[2 - red] = compose_clamp((yy + 516 * d) >> 8);
+        p[3] = 0xff;
+    }
+}
+
+static int compose_convert_yuv(const compose_image_t *dst,
+                               const compose_image_t *src, int w, int h)
+{
+    int red = compose_red(dst->format);
+    int cstep = 1;
+    int uplane = 1, vplane = 2;
+    int uoff = 0, voff = 0;
+
+    switch (src->format) {
+        case HAL_PIXEL_FORMAT_YCbCr_420_SP:
+            cstep = 2;
+            vplane = 1;
+            voff = 1;
+            break;
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+            cstep = 2;
+            vplane = 1;
+            uoff = 1;
+            break;
+        default:
+            break;
+    }
+
+    for (int y = 0; y < h; y++) {
+        compose_yuv_to_8888(compose_row(dst, 0, y), compose_row(src, 0, y),
+                            compose_row(src, uplane, y >> 1) + uoff,
+                            compose_row(src, vplane, y >> 1) + voff,
+                            cstep, w, red);
+    }
+
+    return 0;
+}
+
+int compose_convert(const compose_image_t *dst, const compose_image_t *src)
+{
+    int w = dst->width < src->width ? dst->width : src->width;
+    int h = dst->height < src->height ? dst->height : src->height;
+    int dbpp = compose_bpp(dst->format);
+    int sbpp = compose_bpp(src->format);
+
+    if (dbpp == 0) {
+        return -EINVAL;
+    }
+
+    if (compose_is_yuv420(src->format)) {
+        return dbpp == 4 ? compose_convert_yuv(dst, src, w, h) : -EINVAL;
+    }
+
+    if (sbpp == 0) {
+        return -EINVAL;
+    }
+
+    for (int y = 0; y < h; y++) {
+        uint8_t *d = compose_row(dst, 0, y);
+        uint8_t *s = compose_row(src, 0, y);
+        if (src->format == dst->format) {
+            memcpy(d, s, w * dbpp);
+        } else if (sbpp == 2) {
+            compose_565_to_8888(d, (const uint16_t *)s, w, compose_red(dst->format));
+        } else if (dbpp == 2) {
+            compose_8888_to_565((uint16_t *)d, s, w, compose_red(src->format));
+        } else {
+            compose_8888_to_8888(d, s, w,
+                                 compose_red(src->format) != compose_red(dst->format),
+                                 src->format == HAL_PIXEL_FORMAT_RGBX_8888);
+        }
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+/* blending */
+
+#ifdef __ARM_NEON__
+static inline uint8x8_t compose_div255_neon(uint16x8_t x)
+{
+    uint16x8_t t = vaddq_u16(x, vdupq_n_u16(128));
+    return vaddhn_u16(t, vshrq_n_u16(t, 8));
+}
+#endif
+
+static void compose_blend_row(uint8_t *dst, const uint8_t *src, int n,
+                              int alpha, int opaque)
+{
+    int i = 0;
+#ifdef __ARM_NEON__
+    if (sNeon) {
+        uint8x8_t pa = vdup_n_u8(alpha);
+        for (; i + 8 <= n; i += 8) {
+            uint8x8x4_t s = vld4_u8(src + i * 4);
+            uint8x8x4_t d = vld4_u8(dst + i * 4);
+            if (opaque) {
+                s.val[3] = vdup_n_u8(0xff);
+            }
+            if (alpha != 0xff) {
+                for (int c = 0; c < 4; c++)
+                    s.val[c] = compose_div255_neon(vmull_u8(s.val[c], pa));
+            }
+            uint8x8_t ia = vmvn_u8(s.val[3]);
+            for (int c = 0; c < 4; c++) {
+                uint8x8_t dc = compose_div255_neon(vmull_u8(d.val[c], ia));
+                d.val[c] = vqadd_u8(s.val[c], dc);
+            }
+            vst4_u8(dst + i * 4, d);
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        const uint8_t *s = src + i * 4;
+        uint8_t *d = dst + i * 4;
+        uint32_t sc[4] = { s[0], s[1], s[2], opaque ? 0xffu : s[3] };
+        if (alpha != 0xff) {
+            for (int c = 0; c < 4; c++)
+                sc[c] = compose_div255(sc[c] * alpha);
+        }
+        uint32_t ia = 255 - sc[3];
+        for (int c = 0; c < 4; c++) {
+            uint32_t v = sc[c] + compose_div255(d[c] * ia);
+            d[c] = v > 255 ? 255 : v;
+        }
+    }
+}
+
+int compose_blend(const compose_image_t *dst, const compose_image_t *src,
+                  int plane_alpha)
+{
+    int w = dst->width < src->width ? dst->width : src->width;
+    int h = dst->height < src->height ? dst->height : src->height;
+
+    if (compose_bpp(dst->format) != 4 || compose_bpp(src->format) != 4 ||
+        compose_red(dst->format) != compose_red(src->format)) {
+        return -EINVAL;
+    }
+
+    plane_alpha = plane_alpha < 0 ? 0 : (plane_alpha > 255 ? 255 : plane_alpha);
+    for (int y = 0; y < h; y++) {
+        compose_blend_row(compose_row(dst, 0, y), compose_row(src, 0, y), w,
+                          plane_alpha, src->format == HAL_PIXEL_FORMAT_RGBX_8888);
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+/* rotation */
+
+static inline void compose_copy_px(uint8_t *d, const uint8_t *s, int bpp)
+{
+    if (bpp == 4)
+        *(uint32_t *)d = *(const uint32_t *)s;
+    else
+        *(uint16_t *)d = *(const uint16_t *)s;
+}
+
+/* destination of src pixel (sx, sy): flips first, then 90 clockwise */
+static inline void compose_rotate_px(const compose_image_t *dst,
+                                     const compose_image_t *src,
+                                     int transform, int bpp, int sx, int sy)
+{
+    int fx = (transform & HAL_TRANSFORM_FLIP_H) ? src->width - 1 - sx : sx;
+    int fy = (transform & HAL_TRANSFORM_FLIP_V) ? src->height - 1 - sy : sy;
+    int dx = fx, dy = fy;
+
+    if (transform & HAL_TRANSFORM_ROT_90) {
+        dx = src->height - 1 - fy;
+        dy = fx;
+    }
+    compose_copy_px(compose_row(dst, 0, dy) + dx * bpp,
+                    compose_row(src, 0, sy) + sx * bpp, bpp);
+}
+
+#ifdef __ARM_NEON__
+static inline uint32x4_t compose_reverse_u32(uint32x4_t v)
+{
+    v = vrev64q_u32(v);
+    return vcombine_u32(vget_high_u32(v), vget_low_u32(v));
+}
+
+/* 4x4 blocks for plain 90 and 270 rotations over the top left w4 x h4
+ * of the source, the scalar loop takes the remaining edges. */
+static void compose_rotate_blocks(const compose_image_t *dst,
+                                  const compose_image_t *src, int transform,
+                                  int w4, int h4)
+{
+    int H = src->height, W = src->width;
+
+    for (int r = 0; r < h4; r += 4) {
+        const uint8_t *s0 = compose_row(src, 0, r);
+        for (int c = 0; c < w4; c += 4) {
+            const uint8_t *s = s0 + c * 4;
+            uint32x4_t a0 = vld1q_u32((const uint32_t *)s);
+            uint32x4_t a1 = vld1q_u32((const uint32_t *)(s + src->stride[0]));
+            uint32x4_t a2 = vld1q_u32((const uint32_t *)(s + src->stride[0] * 2));
+            uint32x4_t a3 = vld1q_u32((const uint32_t *)(s + src->stride[0] * 3));
+            uint32x4x2_t t01 = vtrnq_u32(a0, a1);
+            uint32x4x2_t t23 = vtrnq_u32(a2, a3);
+            uint32x4_t col[4];
+            col[0] = vcombine_u32(vget_low_u32(t01.val[0]), vget_low_u32(t23.val[0]));
+            col[1] = vcombine_u32(vget_low_u32(t01.val[1]), vget_low_u32(t23.val[1]));
+            col[2] = vcombine_u32(vget_high_u32(t01.val[0]), vget_high_u32(t23.val[0]));
+            col[3] = vcombine_u32(vget_high_u32(t01.val[1]), vget_high_u32(t23.val[1]));
+
+            for (int k = 0; k < 4; k++) {
+                if (transform == HAL_TRANSFORM_ROT_90) {
+                    uint8_t *d = compose_row(dst, 0, c + k) + (H - 4 - r) * 4;
+                    vst1q_u32((uint32_t *)d, compose_reverse_u32(col[k]));
+                } else {
+                    uint8_t *d = compose_row(dst, 0, W - 1 - c - k) + r * 4;
+                    vst1q_u32((uint32_t *)d, col[k]);
+                }
+            }
+        }
+    }
+}
+#endif
+
+int compose_rotate(const compose_image_t *dst, const compose_image_t *src,
+                   int transform)
+{
+    int bpp = compose_bpp(src->format);
+    int W = src->width, H = src->height;
+    int w4 = 0, h4 = 0;
+
+    if (bpp == 0 || dst->format != src->format) {
+        return -EINVAL;
+    }
+    if (transform & HAL_TRANSFORM_ROT_90) {
+        if (dst->width < H || dst->height < W)
+            return -EINVAL;
+    } else if (dst->width < W || dst->height < H) {
+        return -EINVAL;
+    }
+
+    if (transform == HAL_TRANSFORM_FLIP_V || transform == 0) {
+        for (int y = 0; y < H; y++) {
+            int sy = transform ? H - 1 - y : y;
+            memcpy(compose_row(dst, 0, y), compose_row(src, 0, sy), W * bpp);
+        }
+        return 0;
+    }
+
+#ifdef __ARM_NEON__
+    if (sNeon && bpp == 4 && !(transform & HAL_TRANSFORM_ROT_90)) {
+        // mirrored rows, 180 also walks the rows backwards.
+        for (int y = 0; y < H; y++) {
+            int sy = (transform & HAL_TRANSFORM_FLIP_V) ? H - 1 - y : y;
+            const uint8_t *s = compose_row(src, 0, sy);
+            uint8_t *d = compose_row(dst, 0, y);
+            int x = 0;
+            for (; x + 4 <= W; x += 4) {
+                uint32x4_t v = vld1q_u32((const uint32_t *)(s + (W - 4 - x) * 4));
+                vst1q_u32((uint32_t *)(d + x * 4), compose_reverse_u32(v));
+            }
+            for (; x < W; x++) {
+                compose_copy_px(d + x * 4, s + (W - 1 - x) * 4, 4);
+            }
+        }
+        return 0;
+    }
+
+    if (sNeon && bpp == 4 && (transform == HAL_TRANSFORM_ROT_90 ||
+                              transform == HAL_TRANSFORM_ROT_270)) {
+        w4 = W & ~3;
+        h4 = H & ~3;
+        compose_rotate_blocks(dst, src, transform, w4, h4);
+    }
+#endif
+
+    for (int sy = 0; sy < H; sy++) {
+        // the block pass covered the top left w4 x h4 of the source.
+        for (int sx = sy < h4 ? w4 : 0; sx < W; sx++) {
+            compose_rotate_px(dst, src, transform, bpp, sx, sy);
+        }
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+/* bilinear scaling */
+
+typedef struct {
+    int x0;
+    int x1;
+    uint8_t weights[8];
+} compose_tap_t;
+
+/* sample position of dst pixel i in 16.16 src coordinates, pixel
+ * centers aligned, with the neighbour and SCALE_BITS of fraction. */
+static void compose_tap(int i, int srclen, int dstlen, int *p0, int *p1, int *frac)
+{
+    int64_t pos = ((int64_t)(2 * i + 1) * srclen << 16) / (2 * dstlen) - 32768;
+    if (pos < 0)
+        pos = 0;
+
+    *p0 = pos >> 16;
+    *frac = (pos >> (16 - SCALE_BITS)) & (SCALE_ONE - 1);
+    if (*p0 >= srclen - 1) {
+        *p0 = srclen - 1;
+        *frac = 0;
+    }
+    *p1 = *p0 + 1 < srclen ? *p0 + 1 : *p0;
+}
+
+/* horizontal pass of one src row into 16 bit channels */
+static void compose_scale_h(uint16_t *out, const uint8_t *src,
+                            const compose_tap_t *taps, int n)
+{
+    int i = 0;
+#ifdef __ARM_NEON__
+    if (sNeon) {
+        for (; i < n; i++) {
+            const compose_tap_t *t = &taps[i];
+            // the two taps are neighbours except on the last column.
+            if (t->x1 != t->x0 + 1)
+                break;
+            uint16x8_t m = vmull_u8(vld1_u8(src + t->x0 * 4), vld1_u8(t->weights));
+            vst1_u16(out + i * 4, vadd_u16(vget_low_u16(m), vget_high_u16(m)));
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        const compose_tap_t *t = &taps[i];
+        const uint8_t *a = src + t->x0 * 4;
+        const uint8_t *b = src + t->x1 * 4;
+        for (int c = 0; c < 4; c++)
+            out[i * 4 + c] = a[c] * t->weights[0] + b[c] * t->weights[4];
+    }
+}
+
+static void compose_scale_v(uint8_t *dst, const uint16_t *top,
+                            const uint16_t *bottom, int frac, int n)
+{
+    uint16_t w0 = SCALE_ONE - frac, w1 = frac;
+    int i = 0;
+#ifdef __ARM_NEON__
+    if (sNeon) {
+        for (; i + 8 <= n; i += 8) {
+            uint16x8_t t = vld1q_u16(top + i);
+            uint16x8_t b = vld1q_u16(bottom + i);
+            uint32x4_t lo = vmlal_n_u16(vmull_n_u16(vget_low_u16(t), w0), vget_low_u16(b), w1);
+            uint32x4_t hi = vmlal_n_u16(vmull_n_u16(vget_high_u16(t), w0), vget_high_u16(b), w1);
+            uint16x8_t v = vcombine_u16(vrshrn_n_u32(lo, 2 * SCALE_BITS),
+                                        vrshrn_n_u32(hi, 2 * SCALE_BITS));
+            vst1_u8(dst + i, vmovn_u16(v));
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        uint32_t v = top[i] * w0 + bottom[i] * w1;
+        dst[i] = (v + (1 << (2 * SCALE_BITS - 1))) >> (2 * SCALE_BITS);
+    }
+}
+
+int compose_scale(const compose_image_t *dst, const compose_image_t *src)
+{
+    int dw = dst->width, dh = dst->height;
+    int sw = src->width, sh = src->height;
+
+    if (compose_bpp(src->format) != 4 || dst->format != src->format ||
+        dw <= 0 || dh <= 0 || sw <= 0 || sh <= 0) {
+        return -EINVAL;
+    }
+
+    compose_tap_t *taps = (compose_tap_t *)malloc(dw * sizeof(*taps));
+    uint16_t *rows = (uint16_t *)malloc(dw * 4 * 2 * sizeof(*rows));
+    if (taps == NULL || rows == NULL) {
+        free(taps);
+        free(rows);
+        return -ENOMEM;
+    }
+
+    for (int x = 0; x < dw; x++) {
+        int frac;
+        compose_tap(x, sw, dw, &taps[x].x0, &taps[x].x1, &frac);
+        memset(taps[x].weights, SCALE_ONE - frac, 4);
+        memset(taps[x].weights + 4, frac, 4);
+    }
+
+    // the two filtered src rows are kept while consecutive dst rows
+    // sample the same ones.
+    uint16_t *line[2] = { rows, rows + dw * 4 };
+    int cached[2] = { -1, -1 };
+    for (int y = 0; y < dh; y++) {
+        int y0, y1, frac;
+        compose_tap(y, sh, dh, &y0, &y1, &frac);
+
+        if (cached[0] != y0) {
+            if (cached[1] == y0) {
+                uint16_t *t = line[0];
+                line[0] = line[1];
+                line[1] = t;
+                cached[0] = y0;
+                cached[1] = -1;
+            } else {
+                compose_scale_h(line[0], compose_row(src, 0, y0), taps, dw);
+                cached[0] = y0;
+            }
+        }
+        if (cached[1] != y1) {
+            compose_scale_h(line[1], compose_row(src, 0, y1), taps, dw);
+            cached[1] = y1;
+        }
+
+        compose_scale_v(compose_row(dst, 0, y), line[0], line[1], frac, dw * 4);
+    }
+
+    free(rows);
+    free(taps);
+    return 0;
+}
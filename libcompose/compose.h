@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FSL_COMPOSE_H
+#define FSL_COMPOSE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Software composition for the display HALs, used where the 2D cores
+ * can not take a buffer. Every operation has a NEON path and a scalar
+ * reference producing the same bytes.
+ *
+ * Formats are HAL_PIXEL_FORMAT_* values. RGB images use planes[0] only.
+ * For YCbCr_420_SP and YCrCb_420_SP planes[1] is the interleaved chroma
+ * plane, for YCbCr_420_P and YV12 planes[1] holds Cb and planes[2] Cr
+ * whatever their order in memory. Strides are in bytes.
+ */
+typedef struct {
+    int format;
+    int width;
+    int height;
+    void *planes[3];
+    int stride[3];
+} compose_image_t;
+
+/* copies the overlapping area, converting RGB_565 <-> 32bpp, swapping
+ * red and blue, or YUV 4:2:0 (BT.601 video range) -> 32bpp. */
+int compose_convert(const compose_image_t *dst, const compose_image_t *src);
+
+/* src-over blend of a premultiplied 32bpp src scaled by plane_alpha
+ * (0-255) onto a 32bpp dst of the same channel order. */
+int compose_blend(const compose_image_t *dst, const compose_image_t *src,
+                  int plane_alpha);
+
+/* HAL_TRANSFORM_ROT_90/180/270 or flips, dst is sized for the result. */
+int compose_rotate(const compose_image_t *dst, const compose_image_t *src,
+                   int transform);
+
+/* bilinear scaling of the whole src onto the whole dst, 32bpp only. */
+int compose_scale(const compose_image_t *dst, const compose_image_t *src);
+
+/* selects the NEON kernels (default when built for NEON) or the scalar
+ * references, to compare their output on target. */
+void compose_set_neon(int enable);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,590 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The composition kernels over generated images of odd sizes, checked
+ * three ways:
+ *
+ *   - against a floating point model of the operation, within the
+ *     rounding the integer kernels are allowed,
+ *   - the NEON and scalar paths byte for byte, which only differ when
+ *     built for the target,
+ *   - against the crc32 of each output in tests/compose_golden.txt, so a
+ *     change of rounding shows up even inside the tolerance.
+ *
+ * Rows carry padding filled with a canary that must survive.
+ *
+ * Each case then runs again at 32 times its size, and the pixels written
+ * per second of thread CPU time are printed for the scalar kernel and,
+ * when built for NEON, the vector one.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <system/graphics.h>
+
+#include "compose.h"
+#include "imx_test.h"
+
+#define CANARY 0xa5
+#define PAD 12
+/* size of the timed images against the case, and pixels per timing */
+#define SPEED_SCALE 32
+#define SPEED_PIXELS (4 << 20)
+
+/*****************************************************************************/
+
+static uint32_t sSeed;
+
+static uint8_t test_random()
+{
+    sSeed = sSeed * 1103515245 + 12345;
+    return sSeed >> 16;
+}
+
+static int test_planes(int format)
+{
+    switch (format) {
+        case HAL_PIXEL_FORMAT_YCbCr_420_SP:
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+            return 2;
+        case HAL_PIXEL_FORMAT_YCbCr_420_P:
+        case HAL_PIXEL_FORMAT_YV12:
+            return 3;
+        default:
+            return 1;
+    }
+}
+
+static int test_bpp(int format)
+{
+    switch (format) {
+        case HAL_PIXEL_FORMAT_RGB_565:
+            return 2;
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+            return 4;
+        default:
+            return 1;
+    }
+}
+
+/* bytes of the image content in a row and rows of a plane */
+static void test_plane_size(const compose_image_t *img, int plane, int *row, int *rows)
+{
+    int cw = (img->width + 1) / 2;
+    *row = img->width * test_bpp(img->format);
+    *rows = img->height;
+    if (plane) {
+        *row = test_planes(img->format) == 2 ? cw * 2 : cw;
+        *rows = (img->height + 1) / 2;
+    }
+}
+
+static void test_alloc(compose_image_t *img, int format, int w, int h)
+{
+    memset(img, 0, sizeof(*img));
+    img->format = format;
+    img->width = w;
+    img->height = h;
+    for (int p = 0; p < test_planes(format); p++) {
+        int row, rows;
+        test_plane_size(img, p, &row, &rows);
+        img->stride[p] = row + PAD;
+        img->planes[p] = malloc(img->stride[p] * rows);
+        memset(img->planes[p], CANARY, img->stride[p] * rows);
+    }
+}
+
+static void test_free(compose_image_t *img)
+{
+    for (int p = 0; p < 3; p++)
+        free(img->planes[p]);
+}
+
+static uint8_t *test_row(const compose_image_t *img, int plane, int y)
+{
+    return (uint8_t *)img->planes[plane] + y * img->stride[plane];
+}
+
+static uint8_t *test_px(const compose_image_t *img, int x, int y)
+{
+    return test_row(img, 0, y) + x * test_bpp(img->format);
+}
+
+/* random content, premultiplied for 32bpp with alpha */
+static void test_fill(compose_image_t *img, uint32_t seed)
+{
+    sSeed = seed;
+    for (int p = 0; p < test_planes(img->format); p++) {
+        int row, rows;
+        test_plane_size(img, p, &row, &rows);
+        for (int y = 0; y < rows; y++) {
+            uint8_t *r = test_row(img, p, y);
+            for (int i = 0; i < row; i++)
+                r[i] = test_random();
+        }
+    }
+    if (img->format == HAL_PIXEL_FORMAT_RGBA_8888 || img->format == HAL_PIXEL_FORMAT_BGRA_8888) {
+        for (int y = 0; y < img->height; y++) {
+            for (int x = 0; x < img->width; x++) {
+                uint8_t *p = test_px(img, x, y);
+                // a few fully transparent and opaque pixels
+                if (p[3] < 16)
+                    p[3] = 0;
+                else if (p[3] > 240)
+                    p[3] = 255;
+                for (int c = 0; c < 3; c++)
+                    p[c] = p[c] * p[3] / 255;
+            }
+        }
+    }
+}
+
+static uint32_t test_crc(const compose_image_t *img)
+{
+    uint32_t crc = 0;
+    for (int y = 0; y < img->height; y++)
+        crc = imx_test_crc32(crc, test_row(img, 0, y), img->width * test_bpp(img->format));
+    return crc;
+}
+
+static bool test_padding(const compose_image_t *img)
+{
+    int row, rows;
+    test_plane_size(img, 0, &row, &rows);
+    for (int y = 0; y < rows; y++) {
+        const uint8_t *r = test_row(img, 0, y);
+        for (int i = row; i < img->stride[0]; i++) {
+            if (r[i] != CANARY)
+                return false;
+        }
+    }
+    return true;
+}
+
+static bool test_same(const compose_image_t *a, const compose_image_t *b)
+{
+    for (int y = 0; y < a->height; y++) {
+        if (memcmp(test_row(a, 0, y), test_row(b, 0, y), a->width * test_bpp(a->format)))
+            return false;
+    }
+    return true;
+}
+
+/*****************************************************************************/
+
+/* a channel of a 32bpp image as r, g, b, a */
+static int test_channel(const compose_image_t *img, int x, int y, int c)
+{
+    const uint8_t *p = test_px(img, x, y);
+    if (img->format == HAL_PIXEL_FORMAT_RGB_565) {
+        uint16_t v = *(const uint16_t *)p;
+        switch (c) {
+            case 0: return (v >> 11) * 255 / 31;
+            case 1: return ((v >> 5) & 0x3f) * 255 / 63;
+            case 2: return (v & 0x1f) * 255 / 31;
+            default: return 255;
+        }
+    }
+    if (img->format == HAL_PIXEL_FORMAT_BGRA_8888 && c != 1 && c != 3)
+        c = 2 - c;
+    return p[c];
+}
+
+static void test_yuv(const compose_image_t *img, int x, int y, int *Y, int *U, int *V)
+{
+    int cx = x / 2, cy = y / 2;
+    *Y = test_row(img, 0, y)[x];
+    switch (img->format) {
+        case HAL_PIXEL_FORMAT_YCbCr_420_SP:
+            *U = test_row(img, 1, cy)[cx * 2];
+            *V = test_row(img, 1, cy)[cx * 2 + 1];
+            break;
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+            *V = test_row(img, 1, cy)[cx * 2];
+            *U = test_row(img, 1, cy)[cx * 2 + 1];
+            break;
+        default:
+            *U = test_row(img, 1, cy)[cx];
+            *V = test_row(img, 2, cy)[cx];
+            break;
+    }
+}
+
+static double test_clamp(double v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+/* one channel against the model, reported once per image */
+static int test_error(const char *name, int got, double want, double tolerance, int x, int y,
+                      int c)
+{
+    if (fabs(got - want) > tolerance) {
+        CHECK(false, "%s: channel %d at %d,%d is %d, model %.2f", name, c, x, y, got, want);
+        return 1;
+    }
+    return 0;
+}
+
+static void test_model_convert(const char *name, const compose_image_t *dst,
+                               const compose_image_t *src)
+{
+    for (int y = 0; y < dst->height; y++) {
+        for (int x = 0; x < dst->width; x++) {
+            double want[4];
+            int tolerance = 1;
+
+            if (test_planes(src->format) > 1) {
+                int Y, U, V;
+                test_yuv(src, x, y, &Y, &U, &V);
+                want[0] = test_clamp(1.164 * (Y - 16) + 1.596 * (V - 128));
+                want[1] = test_clamp(1.164 * (Y - 16) - 0.391 * (U - 128) - 0.813 * (V - 128));
+                want[2] = test_clamp(1.164 * (Y - 16) + 2.018 * (U - 128));
+                want[3] = 255;
+                tolerance = 2;
+            } else {
+                for (int c = 0; c < 4; c++)
+                    want[c] = test_channel(src, x, y, c);
+                if (src->format == HAL_PIXEL_FORMAT_RGBX_8888)
+                    want[3] = 255;
+            }
+
+            if (dst->format == HAL_PIXEL_FORMAT_RGB_565) {
+                // truncated to 5 and 6 bits
+                uint16_t v = *(const uint16_t *)test_px(dst, x, y);
+                int r = (int)want[0] >> 3, g = (int)want[1] >> 2, b = (int)want[2] >> 3;
+                CHECK(v == ((r << 11) | (g << 5) | b), "%s: pixel %d,%d is %04x", name, x, y, v);
+                continue;
+            }
+            for (int c = 0; c < 4; c++) {
+                if (test_error(name, test_channel(dst, x, y, c), want[c], tolerance, x, y, c))
+                    return;
+            }
+        }
+    }
+}
+
+static void test_model_blend(const char *name, const compose_image_t *out,
+                             const compose_image_t *dst, const compose_image_t *src, int alpha)
+{
+    for (int y = 0; y < out->height; y++) {
+        for (int x = 0; x < out->width; x++) {
+            double s[4], sa;
+            for (int c = 0; c < 4; c++)
+                s[c] = test_channel(src, x, y, c) * alpha / 255.0;
+            if (src->format == HAL_PIXEL_FORMAT_RGBX_8888)
+                s[3] = alpha;
+            sa = s[3] / 255.0;
+            for (int c = 0; c < 4; c++) {
+                double want = test_clamp(s[c] + test_channel(dst, x, y, c) * (1 - sa));
+                // the plane alpha product is rounded before it scales dst
+                if (test_error(name, test_channel(out, x, y, c), want, alpha == 255 ? 1 : 1.5,
+                               x, y, c))
+                    return;
+            }
+        }
+    }
+}
+
+static void test_model_rotate(const char *name, const compose_image_t *dst,
+                              const compose_image_t *src, int transform)
+{
+    int bpp = test_bpp(src->format);
+
+    for (int y = 0; y < dst->height; y++) {
+        for (int x = 0; x < dst->width; x++) {
+            // undo the rotation, then the flips
+            int sx = x, sy = y;
+            if (transform & HAL_TRANSFORM_ROT_90) {
+                sx = y;
+                sy = src->height - 1 - x;
+            }
+            if (transform & HAL_TRANSFORM_FLIP_H)
+                sx = src->width - 1 - sx;
+            if (transform & HAL_TRANSFORM_FLIP_V)
+                sy = src->height - 1 - sy;
+            if (memcmp(test_px(dst, x, y), test_px(src, sx, sy), bpp)) {
+                CHECK(false, "%s: pixel %d,%d is not source %d,%d", name, x, y, sx, sy);
+                return;
+            }
+        }
+    }
+}
+
+static void test_model_scale(const char *name, const compose_image_t *dst,
+                             const compose_image_t *src)
+{
+    for (int y = 0; y < dst->height; y++) {
+        // pixel centers aligned, clamped to the edges
+        double fy = (y + 0.5) * src->height / dst->height - 0.5;
+        fy = fy < 0 ? 0 : (fy > src->height - 1 ? src->height - 1 : fy);
+        int y0 = (int)fy, y1 = y0 + 1 < src->height ? y0 + 1 : y0;
+        for (int x = 0; x < dst->width; x++) {
+            double fx = (x + 0.5) * src->width / dst->width - 0.5;
+            fx = fx < 0 ? 0 : (fx > src->width - 1 ? src->width - 1 : fx);
+            int x0 = (int)fx, x1 = x0 + 1 < src->width ? x0 + 1 : x0;
+            double ax = fx - x0, ay = fy - y0;
+            for (int c = 0; c < 4; c++) {
+                double top = test_channel(src, x0, y0, c) * (1 - ax) +
+                        test_channel(src, x1, y0, c) * ax;
+                double bottom = test_channel(src, x0, y1, c) * (1 - ax) +
+                        test_channel(src, x1, y1, c) * ax;
+                double want = top * (1 - ay) + bottom * ay;
+                // weights have 7 bits, 255 / 128 off per pass at most
+                if (test_error(name, test_channel(dst, x, y, c), want, 4, x, y, c))
+                    return;
+            }
+        }
+    }
+}
+
+/*****************************************************************************/
+
+static void test_golden(const char *name, const compose_image_t *out)
+{
+    imx_test_golden(name, test_crc(out));
+}
+
+enum { OP_CONVERT, OP_BLEND, OP_ROTATE, OP_SCALE };
+
+struct test_case_t {
+    const char *name;
+    int op;
+    int srcFormat;
+    int sw, sh;
+    int dstFormat;
+    int dw, dh;
+    int arg;
+};
+
+static const test_case_t sCases[] = {
+    { "convert_565_rgba", OP_CONVERT, HAL_PIXEL_FORMAT_RGB_565, 37, 19,
+      HAL_PIXEL_FORMAT_RGBA_8888, 37, 19, 0 },
+    { "convert_565_bgra", OP_CONVERT, HAL_PIXEL_FORMAT_RGB_565, 37, 19,
+      HAL_PIXEL_FORMAT_BGRA_8888, 37, 19, 0 },
+    { "convert_rgba_565", OP_CONVERT, HAL_PIXEL_FORMAT_RGBA_8888, 37, 19,
+      HAL_PIXEL_FORMAT_RGB_565, 37, 19, 0 },
+    { "convert_bgra_565", OP_CONVERT, HAL_PIXEL_FORMAT_BGRA_8888, 37, 19,
+      HAL_PIXEL_FORMAT_RGB_565, 37, 19, 0 },
+    { "convert_rgba_bgra", OP_CONVERT, HAL_PIXEL_FORMAT_RGBA_8888, 37, 19,
+      HAL_PIXEL_FORMAT_BGRA_8888, 37, 19, 0 },
+    { "convert_rgbx_rgba", OP_CONVERT, HAL_PIXEL_FORMAT_RGBX_8888, 37, 19,
+      HAL_PIXEL_FORMAT_RGBA_8888, 37, 19, 0 },
+    // a larger destination only takes the overlap
+    { "convert_rgba_crop", OP_CONVERT, HAL_PIXEL_FORMAT_RGBA_8888, 21, 9,
+      HAL_PIXEL_FORMAT_RGBA_8888, 37, 19, 0 },
+    { "convert_nv12_rgba", OP_CONVERT, HAL_PIXEL_FORMAT_YCbCr_420_SP, 38, 20,
+      HAL_PIXEL_FORMAT_RGBA_8888, 38, 20, 0 },
+    { "convert_nv21_bgra", OP_CONVERT, HAL_PIXEL_FORMAT_YCrCb_420_SP, 37, 19,
+      HAL_PIXEL_FORMAT_BGRA_8888, 37, 19, 0 },
+    { "convert_i420_rgba", OP_CONVERT, HAL_PIXEL_FORMAT_YCbCr_420_P, 37, 19,
+      HAL_PIXEL_FORMAT_RGBA_8888, 37, 19, 0 },
+    { "convert_yv12_rgbx", OP_CONVERT, HAL_PIXEL_FORMAT_YV12, 38, 20,
+      HAL_PIXEL_FORMAT_RGBX_8888, 38, 20, 0 },
+    { "blend_rgba_opaque", OP_BLEND, HAL_PIXEL_FORMAT_RGBA_8888, 37, 19,
+      HAL_PIXEL_FORMAT_RGBA_8888, 37, 19, 255 },
+    { "blend_rgba_half", OP_BLEND, HAL_PIXEL_FORMAT_RGBA_8888, 37, 19,
+      HAL_PIXEL_FORMAT_RGBA_8888, 37, 19, 128 },
+    { "blend_bgra_clear", OP_BLEND, HAL_PIXEL_FORMAT_BGRA_8888, 37, 19,
+      HAL_PIXEL_FORMAT_BGRA_8888, 37, 19, 0 },
+    { "blend_rgbx_third", OP_BLEND, HAL_PIXEL_FORMAT_RGBX_8888, 37, 19,
+      HAL_PIXEL_FORMAT_RGBA_8888, 37, 19, 85 },
+    { "rotate_8888_90", OP_ROTATE, HAL_PIXEL_FORMAT_RGBA_8888, 37, 19,
+      HAL_PIXEL_FORMAT_RGBA_8888, 19, 37, HAL_TRANSFORM_ROT_90 },
+    { "rotate_8888_180", OP_ROTATE, HAL_PIXEL_FORMAT_RGBA_8888, 37, 19,
+      HAL_PIXEL_FORMAT_RGBA_8888, 37, 19, HAL_TRANSFORM_ROT_180 },
+    { "rotate_8888_270", OP_ROTATE, HAL_PIXEL_FORMAT_RGBA_8888, 37, 19,
+      HAL_PIXEL_FORMAT_RGBA_8888, 19, 37, HAL_TRANSFORM_ROT_270 },
+    { "rotate_8888_flip_h", OP_ROTATE, HAL_PIXEL_FORMAT_RGBA_8888, 37, 19,
+      HAL_PIXEL_FORMAT_RGBA_8888, 37, 19, HAL_TRANSFORM_FLIP_H },
+    { "rotate_8888_flip_v", OP_ROTATE, HAL_PIXEL_FORMAT_RGBA_8888, 37, 19,
+      HAL_PIXEL_FORMAT_RGBA_8888, 37, 19, HAL_TRANSFORM_FLIP_V },
+    { "rotate_8888_90_flip_h", OP_ROTATE, HAL_PIXEL_FORMAT_RGBA_8888, 37, 19,
+      HAL_PIXEL_FORMAT_RGBA_8888, 19, 37, HAL_TRANSFORM_ROT_90 | HAL_TRANSFORM_FLIP_H },
+    { "rotate_8888_block", OP_ROTATE, HAL_PIXEL_FORMAT_BGRA_8888, 32, 16,
+      HAL_PIXEL_FORMAT_BGRA_8888, 16, 32, HAL_TRANSFORM_ROT_90 },
+    { "rotate_565_90", OP_ROTATE, HAL_PIXEL_FORMAT_RGB_565, 37, 19,
+      HAL_PIXEL_FORMAT_RGB_565, 19, 37, HAL_TRANSFORM_ROT_90 },
+    { "rotate_565_270", OP_ROTATE, HAL_PIXEL_FORMAT_RGB_565, 37, 19,
+      HAL_PIXEL_FORMAT_RGB_565, 19, 37, HAL_TRANSFORM_ROT_270 },
+    { "scale_up", OP_SCALE, HAL_PIXEL_FORMAT_RGBA_8888, 37, 19,
+      HAL_PIXEL_FORMAT_RGBA_8888, 64, 48, 0 },
+    { "scale_down", OP_SCALE, HAL_PIXEL_FORMAT_RGBA_8888, 64, 48,
+      HAL_PIXEL_FORMAT_RGBA_8888, 23, 17, 0 },
+    { "scale_stretch", OP_SCALE, HAL_PIXEL_FORMAT_BGRA_8888, 37, 3,
+      HAL_PIXEL_FORMAT_BGRA_8888, 9, 29, 0 },
+    { "scale_pixel", OP_SCALE, HAL_PIXEL_FORMAT_RGBA_8888, 1, 1,
+      HAL_PIXEL_FORMAT_RGBA_8888, 5, 5, 0 },
+};
+#define CASES (sizeof(sCases) / sizeof(sCases[0]))
+
+static int test_op(const test_case_t *t, compose_image_t *dst, const compose_image_t *src)
+{
+    switch (t->op) {
+        case OP_CONVERT:
+            return compose_convert(dst, src);
+        case OP_BLEND:
+            return compose_blend(dst, src, t->arg);
+        case OP_ROTATE:
+            return compose_rotate(dst, src, t->arg);
+        default:
+            return compose_scale(dst, src);
+    }
+}
+
+static void test_case(const test_case_t *t, uint32_t seed)
+{
+    compose_image_t src, dst, out[2];
+
+    test_alloc(&src, t->srcFormat, t->sw, t->sh);
+    test_fill(&src, seed);
+    test_alloc(&dst, t->dstFormat, t->dw, t->dh);
+    test_fill(&dst, seed * 7 + 1);
+
+    // the scalar reference, then NEON where built in
+    for (int neon = 0; neon < 2; neon++) {
+        test_alloc(&out[neon], t->dstFormat, t->dw, t->dh);
+        for (int y = 0; y < t->dh; y++)
+            memcpy(test_row(&out[neon], 0, y), test_row(&dst, 0, y),
+                   t->dw * test_bpp(t->dstFormat));
+        compose_set_neon(neon);
+        int err = test_op(t, &out[neon], &src);
+        CHECK(err == 0, "%s: failed %d", t->name, err);
+        CHECK(test_padding(&out[neon]), "%s: wrote past the row", t->name);
+    }
+    compose_set_neon(1);
+    CHECK(test_same(&out[0], &out[1]), "%s: NEON output differs from the reference", t->name);
+
+    switch (t->op) {
+        case OP_CONVERT: {
+            // the model only covers the overlap
+            compose_image_t overlap = out[0];
+            overlap.width = t->sw < t->dw ? t->sw : t->dw;
+            overlap.height = t->sh < t->dh ? t->sh : t->dh;
+            test_model_convert(t->name, &overlap, &src);
+            break;
+        }
+        case OP_BLEND:
+            test_model_blend(t->name, &out[0], &dst, &src, t->arg);
+            break;
+        case OP_ROTATE:
+            test_model_rotate(t->name, &out[0], &src, t->arg);
+            break;
+        default:
+            test_model_scale(t->name, &out[0], &src);
+            break;
+    }
+    test_golden(t->name, &out[0]);
+
+    test_free(&src);
+    test_free(&dst);
+    test_free(&out[0]);
+    test_free(&out[1]);
+}
+
+static double test_mpix(const test_case_t *t, compose_image_t *dst, const compose_image_t *src,
+                        int pixels)
+{
+    int reps = SPEED_PIXELS / pixels + 1;
+    int64_t start = imx_test_ns(CLOCK_THREAD_CPUTIME_ID);
+    for (int i = 0; i < reps; i++)
+        test_op(t, dst, src);
+    int64_t ns = imx_test_ns(CLOCK_THREAD_CPUTIME_ID) - start;
+    return ns > 0 ? 1000.0 * pixels * reps / ns : 0;
+}
+
+/* the case at SPEED_SCALE times its size, in Mpix written per second */
+static void test_speed(const test_case_t *t, uint32_t seed)
+{
+    compose_image_t src, dst;
+    int w = t->dw * SPEED_SCALE, h = t->dh * SPEED_SCALE;
+
+    test_alloc(&src, t->srcFormat, t->sw * SPEED_SCALE, t->sh * SPEED_SCALE);
+    test_fill(&src, seed);
+    test_alloc(&dst, t->dstFormat, w, h);
+    test_fill(&dst, seed * 7 + 1);
+    // a convert only writes the overlap
+    if (t->op == OP_CONVERT) {
+        w = src.width < w ? src.width : w;
+        h = src.height < h ? src.height : h;
+    }
+    int pixels = w * h;
+
+    compose_set_neon(0);
+    printf("%-24s %5dx%-5d scalar %7.1f Mpix/s", t->name, w, h,
+           test_mpix(t, &dst, &src, pixels));
+#ifdef __ARM_NEON__
+    compose_set_neon(1);
+    printf(", NEON %7.1f Mpix/s", test_mpix(t, &dst, &src, pixels));
+#endif
+    printf("\n");
+    compose_set_neon(1);
+
+    test_free(&src);
+    test_free(&dst);
+}
+
+/* what the callers rely on to fall back to their own paths */
+static void test_invalid()
+{
+    compose_image_t a, b;
+
+    test_alloc(&a, HAL_PIXEL_FORMAT_YCbCr_420_SP, 8, 8);
+    test_alloc(&b, HAL_PIXEL_FORMAT_RGB_565, 8, 8);
+    CHECK(compose_convert(&b, &a) == -EINVAL, "yuv to 565 accepted");
+    CHECK(compose_convert(&a, &b) == -EINVAL, "565 to yuv accepted");
+    test_free(&a);
+
+    test_alloc(&a, HAL_PIXEL_FORMAT_RGBA_8888, 8, 8);
+    CHECK(compose_blend(&a, &b, 255) == -EINVAL, "blend of 565 accepted");
+    CHECK(compose_scale(&a, &b) == -EINVAL, "scale of 565 accepted");
+    CHECK(compose_rotate(&a, &b, HAL_TRANSFORM_ROT_90) == -EINVAL, "rotate across formats");
+    test_free(&b);
+
+    test_alloc(&b, HAL_PIXEL_FORMAT_BGRA_8888, 8, 8);
+    CHECK(compose_blend(&a, &b, 255) == -EINVAL, "blend across channel orders");
+    test_free(&b);
+
+    test_alloc(&b, HAL_PIXEL_FORMAT_RGBA_8888, 4, 8);
+    CHECK(compose_rotate(&b, &a, HAL_TRANSFORM_ROT_90) == -EINVAL, "rotate into a small dst");
+    test_free(&a);
+    test_free(&b);
+}
+
+int main(int argc, char **argv)
+{
+    char path[PATH_MAX];
+
+    imx_test_path(path, sizeof(path), argc, argv, "libcompose/tests/compose_golden.txt");
+    imx_test_golden_load(path);
+
+    for (size_t i = 0; i < CASES; i++)
+        test_case(&sCases[i], 0x1000 + i);
+    test_invalid();
+    for (size_t i = 0; i < CASES; i++)
+        test_speed(&sCases[i], 0x1000 + i);
+
+    imx_test_golden_unused();
+    return imx_test_result("compose_test");
+}
@@ -0,0 +1,49 @@
+# Copyright (C) 2013 Freescale Semiconductor, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+# page flip thread shared by the framebuffer HALs, linked statically.
+# users link libsync for the release fences.
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := fb_flip.cpp
+LOCAL_C_INCLUDES += system/core/libsync
+LOCAL_MODULE := libimxfbflip
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_STATIC_LIBRARY)
+
+# the flip queue against a fake display and a pipe based sw_sync
+flip_test_src_files :=			\
+	fb_flip.cpp			\
+	tests/fake_display.cpp		\
+	tests/sw_sync_fake.cpp
+
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := $(flip_test_src_files) tests/fb_flip_test.cpp
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/tests/include hardware/imx/libimxtest
+LOCAL_STATIC_LIBRARIES := libimxtest_host libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+LOCAL_MODULE := fb_flip_test
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
+
+# frame rate, post time and tearing of the flip modes at 60 Hz
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := $(flip_test_src_files) tests/fb_flip_bench.cpp
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/tests/include
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+LOCAL_MODULE := fb_flip_bench
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
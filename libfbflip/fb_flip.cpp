@@ -0,0 +1,235 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+#include <system/thread_defs.h>
+#include <sw_sync.h>
+
+#include "fb_flip.h"
+
+// frames between two flip statistics reports
+#define FLIP_STATS_FRAMES 300
+
+int64_t fb_flip_now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static void fb_flip_stats(fb_flip_queue_t* q, const fb_flip_t* flip, int64_t now)
+{
+    if (q->lastFlip) {
+        int64_t frame = now - q->lastFlip;
+        q->frameTime += frame;
+        if (frame > q->maxFrameTime)
+            q->maxFrameTime = frame;
+    }
+    q->lastFlip = now;
+
+    // a frame is late when it was not on screen by the vsync it was
+    // queued for, pending flips ahead of it included.
+    if (now - flip->posted > (q->maxPending + 1) * q->period + q->period / 2)
+        q->missed++;
+
+    if (++q->frames >= FLIP_STATS_FRAMES) {
+        if (q->stats) {
+            ALOGD("flip: %u frames, frame time avg %lld us max %lld us, missed %u",
+                    q->frames, q->frameTime / q->frames / 1000,
+                    q->maxFrameTime / 1000, q->missed);
+        }
+        q->frames = 0;
+        q->frameTime = 0;
+        q->maxFrameTime = 0;
+        q->missed = 0;
+    }
+}
+
+/* a flip left the queue, shown or not: the buffer before it is off
+ * screen and its fence signals. called with the lock held. */
+static void fb_flip_done(fb_flip_queue_t* q)
+{
+    q->head = (q->head + 1) % FB_FLIP_QUEUE_SIZE;
+    q->pending--;
+    q->done++;
+    if (q->timeline >= 0)
+        sw_sync_timeline_inc(q->timeline, 1);
+    pthread_cond_broadcast(&q->cond);
+}
+
+static void* fb_flip_thread(void* arg)
+{
+    fb_flip_queue_t* q = (fb_flip_queue_t*)arg;
+
+    setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_URGENT_DISPLAY);
+
+    pthread_mutex_lock(&q->lock);
+    while (!q->exit) {
+        if (!q->pending) {
+            pthread_cond_wait(&q->cond, &q->lock);
+            continue;
+        }
+
+        fb_flip_t* flip = &q->entries[q->head];
+        pthread_mutex_unlock(&q->lock);
+
+        q->ops->pan(q, flip);
+        int64_t now = fb_flip_now();
+
+        pthread_mutex_lock(&q->lock);
+        fb_flip_stats(q, flip, now);
+        fb_flip_done(q);
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    return NULL;
+}
+
+int fb_flip_start(fb_flip_queue_t* q, const fb_flip_ops_t* ops, void* data,
+        int numBuffers, float fps)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    memset(q, 0, sizeof(*q));
+    q->timeline = -1;
+    if (numBuffers < 2)
+        return -EINVAL;
+
+    q->ops = ops;
+    q->data = data;
+    q->maxPending = numBuffers - 2;
+    if (q->maxPending > FB_FLIP_QUEUE_SIZE - 1)
+        q->maxPending = FB_FLIP_QUEUE_SIZE - 1;
+    q->period = fps > 0 ? (int64_t)(1000000000.0f / fps) : 16666666;
+    property_get("debug.gralloc.flipstats", value, "0");
+    q->stats = atoi(value);
+
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    if (pthread_create(&q->thread, NULL, fb_flip_thread, q) != 0) {
+        ALOGE("flip thread creation failed, posting synchronously");
+        pthread_cond_destroy(&q->cond);
+        pthread_mutex_destroy(&q->lock);
+        return -EAGAIN;
+    }
+    q->running = 1;
+    return 0;
+}
+
+void fb_flip_stop(fb_flip_queue_t* q)
+{
+    if (!q->running)
+        return;
+
+    pthread_mutex_lock(&q->lock);
+    q->exit = 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+    pthread_join(q->thread, NULL);
+
+    // the flips the thread did not get to give their buffers back.
+    pthread_mutex_lock(&q->lock);
+    while (q->pending) {
+        q->ops->cancel(q, &q->entries[q->head]);
+        fb_flip_done(q);
+    }
+    // nothing replaces the buffer on screen any more, its fence would
+    // never signal.
+    if (q->timeline >= 0) {
+        sw_sync_timeline_inc(q->timeline, 1);
+        close(q->timeline);
+        q->timeline = -1;
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    pthread_cond_destroy(&q->cond);
+    pthread_mutex_destroy(&q->lock);
+    q->running = 0;
+}
+
+void fb_flip_drain(fb_flip_queue_t* q)
+{
+    if (!q->running)
+        return;
+
+    pthread_mutex_lock(&q->lock);
+    while (q->pending && !q->exit)
+        pthread_cond_wait(&q->cond, &q->lock);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* made with the first fence, the devices that never ask for one have
+ * none. called with the lock held. */
+static void fb_flip_timeline(fb_flip_queue_t* q)
+{
+    q->timeline = sw_sync_timeline_create();
+    if (q->timeline < 0) {
+        ALOGW("no sw_sync timeline, posts wait for their flip");
+        q->noTimeline = 1;
+        return;
+    }
+    if (q->done)
+        sw_sync_timeline_inc(q->timeline, q->done);
+}
+
+int fb_flip_queue(fb_flip_queue_t* q, const fb_flip_t* flip, int* releaseFence)
+{
+    int fence = -1;
+
+    pthread_mutex_lock(&q->lock);
+    while (q->pending >= FB_FLIP_QUEUE_SIZE && !q->exit)
+        pthread_cond_wait(&q->cond, &q->lock);
+    if (q->exit) {
+        pthread_mutex_unlock(&q->lock);
+        q->ops->cancel(q, (fb_flip_t*)flip);
+        if (releaseFence)
+            *releaseFence = -1;
+        return -ENODEV;
+    }
+
+    q->entries[(q->head + q->pending) % FB_FLIP_QUEUE_SIZE] = *flip;
+    q->pending++;
+    uint32_t seq = ++q->queued;
+    if (releaseFence && q->timeline < 0 && !q->noTimeline)
+        fb_flip_timeline(q);
+    // the buffer leaves the screen with the flip after it.
+    if (releaseFence && q->timeline >= 0)
+        fence = sw_sync_fence_create(q->timeline, "fb_flip", seq + 1);
+    pthread_cond_broadcast(&q->cond);
+
+    if (fence >= 0) {
+        // wait until a back buffer is free again.
+        while (q->pending > q->maxPending && !q->exit)
+            pthread_cond_wait(&q->cond, &q->lock);
+    }
+    else {
+        while ((int32_t)(q->done - seq) < 0 && !q->exit)
+            pthread_cond_wait(&q->cond, &q->lock);
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    if (releaseFence)
+        *releaseFence = fence;
+    return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FSL_FB_FLIP_H
+#define FSL_FB_FLIP_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <linux/fb.h>
+#include <hardware/gralloc.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Page flips of a framebuffer device handed to a dedicated thread, which
+ * pans the display at vsync and then releases the previous front buffer.
+ * Shared by the mx5x and mx6 framebuffer HALs.
+ *
+ * A buffer posted with a release fence is off screen once its fence
+ * signals, that is once the flip after it is done. The post only waits
+ * for a free back buffer. A buffer posted without one has nothing telling
+ * the compositor when the previous front buffer can be drawn again, the
+ * post then returns once its flip is done.
+ */
+
+#define FB_FLIP_QUEUE_SIZE 3
+
+typedef struct fb_flip {
+    buffer_handle_t buffer;
+    struct fb_var_screeninfo info;
+    int64_t posted;
+    /* for the device, what has to land in the buffer before the pan */
+    void* hook;
+    uint32_t token;
+} fb_flip_t;
+
+struct fb_flip_queue;
+
+typedef struct fb_flip_ops {
+    /* pans the display to the flip at vsync. when it succeeds the buffer
+     * it replaces is released, when it fails the buffer of the flip. */
+    int (*pan)(struct fb_flip_queue* q, fb_flip_t* flip);
+    /* releases the buffer of a flip that never went on screen. */
+    void (*cancel)(struct fb_flip_queue* q, fb_flip_t* flip);
+} fb_flip_ops_t;
+
+typedef struct fb_flip_queue {
+    const fb_flip_ops_t* ops;
+    void* data;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    fb_flip_t entries[FB_FLIP_QUEUE_SIZE];
+    int head;
+    int pending;
+    int maxPending;
+    int running;
+    int exit;
+
+    /* sw_sync timeline stepped once per flip done, -1 without one */
+    int timeline;
+    int noTimeline;
+    uint32_t queued;
+    uint32_t done;
+
+    int stats;
+    int64_t period;
+    int64_t lastFlip;
+    int64_t frameTime;
+    int64_t maxFrameTime;
+    uint32_t frames;
+    uint32_t missed;
+} fb_flip_queue_t;
+
+/* starts the flip thread of a device with numBuffers framebuffers, data
+ * is left to the ops. 0 or -errno, the device then pans itself. */
+int fb_flip_start(fb_flip_queue_t* q, const fb_flip_ops_t* ops, void* data,
+        int numBuffers, float fps);
+
+/* stops the thread. flips still queued are cancelled and every fence
+ * handed out signals, the buffer left on screen stays locked. */
+void fb_flip_stop(fb_flip_queue_t* q);
+
+/* waits until every queued flip is done. */
+void fb_flip_drain(fb_flip_queue_t* q);
+
+/* queues a flip of a buffer locked for the post. with releaseFence the
+ * fence of the buffer is returned there, -1 when none can be made and
+ * the post waited for its flip. */
+int fb_flip_queue(fb_flip_queue_t* q, const fb_flip_t* flip, int* releaseFence);
+
+int64_t fb_flip_now(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "fake_display.h"
+
+static void fake_sleep_until(int64_t when)
+{
+    struct timespec t;
+    t.tv_sec = when / 1000000000LL;
+    t.tv_nsec = when % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) != 0)
+        ;
+}
+
+void fake_display_init(fake_display_t* d, int64_t period)
+{
+    memset(d, 0, sizeof(*d));
+    pthread_mutex_init(&d->lock, NULL);
+    d->start = fb_flip_now();
+    d->period = period;
+}
+
+void fake_display_pan(fake_display_t* d, buffer_handle_t buffer)
+{
+    __sync_fetch_and_add(&d->panning, 1);
+    int64_t now = fb_flip_now() + d->panDelay;
+    int64_t vsync = d->start + ((now - d->start) / d->period + 1) * d->period;
+    fake_sleep_until(vsync);
+
+    pthread_mutex_lock(&d->lock);
+    if (d->screen)
+        d->released++;
+    d->screen = buffer;
+    d->shown++;
+    pthread_mutex_unlock(&d->lock);
+}
+
+buffer_handle_t fake_display_screen(fake_display_t* d)
+{
+    pthread_mutex_lock(&d->lock);
+    buffer_handle_t screen = d->screen;
+    pthread_mutex_unlock(&d->lock);
+    return screen;
+}
+
+static int fake_display_flip(fb_flip_queue_t* q, fb_flip_t* flip)
+{
+    fake_display_pan((fake_display_t*)q->data, flip->buffer);
+    return 0;
+}
+
+static void fake_display_cancel(fb_flip_queue_t* q, fb_flip_t* flip)
+{
+    fake_display_t* d = (fake_display_t*)q->data;
+    (void)flip;
+    pthread_mutex_lock(&d->lock);
+    d->cancelled++;
+    pthread_mutex_unlock(&d->lock);
+}
+
+const fb_flip_ops_t fake_display_ops = {
+    fake_display_flip,
+    fake_display_cancel,
+};
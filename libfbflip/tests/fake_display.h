@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_FLIP_FAKE_DISPLAY_H
+#define FB_FLIP_FAKE_DISPLAY_H
+
+#include "fb_flip.h"
+
+/* A display scanning out one buffer, panned on a vsync grid of period
+ * ns. Buffers are any distinct handles. */
+typedef struct fake_display {
+    pthread_mutex_t lock;
+    int64_t start;
+    int64_t period;
+    /* added to every pan, in ns */
+    int64_t panDelay;
+    buffer_handle_t screen;
+    volatile int panning;
+    int shown;
+    int released;
+    int cancelled;
+} fake_display_t;
+
+void fake_display_init(fake_display_t* d, int64_t period);
+
+/* the pan of FBIOPAN_DISPLAY with FB_ACTIVATE_VBL: waits for the next
+ * vsync and shows the buffer, releasing the one it replaces. */
+void fake_display_pan(fake_display_t* d, buffer_handle_t buffer);
+
+buffer_handle_t fake_display_screen(fake_display_t* d);
+
+/* ops of a flip queue whose data is the display. */
+extern const fb_flip_ops_t fake_display_ops;
+
+#endif
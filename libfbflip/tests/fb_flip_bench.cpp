@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Frame rate, time blocked in the post and tearing of a compositor posting
+ * to a 60 Hz fake display with three framebuffers, for:
+ *
+ *   sync      the pan in fb_post, as before the flip thread
+ *   queued    the flip thread returning with a flip pending and no fence
+ *   fence     the flip thread handing out release fences, waited by the
+ *             gpu (mx6) or by the mx5x composer before gles draws
+ *   blocking  the flip thread, the post waiting for its flip (mx5x
+ *             without the composer)
+ *
+ * The compositor renders into the two slots of the framebuffer surface
+ * of SurfaceFlinger: frame n goes into the buffer frame n - 2 was posted
+ * in, once its release fence signaled when there is one. Rendering into a
+ * buffer on screen or still queued for the screen is a tear. The 2D core
+ * blits the copybit layers from the post on, the pan waits for them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sw_sync.h>
+
+#include "fake_display.h"
+
+#define PERIOD 16666667LL
+#define FRAMES 120
+#define SLOTS 2
+
+enum { MODE_SYNC, MODE_QUEUED, MODE_FENCE, MODE_BLOCKING, MODES };
+static const char* sModeNames[MODES] = { "sync", "queued", "fence", "blocking" };
+
+static native_handle_t sBuffers[SLOTS];
+static int64_t sBlit;
+
+static void bench_work(int64_t ns)
+{
+    struct timespec t;
+    t.tv_sec = ns / 1000000000LL;
+    t.tv_nsec = ns % 1000000000LL;
+    nanosleep(&t, NULL);
+}
+
+static void bench_sleep_until(int64_t when)
+{
+    struct timespec t;
+    t.tv_sec = when / 1000000000LL;
+    t.tv_nsec = when % 1000000000LL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t, NULL) != 0)
+        ;
+}
+
+/* the pan of the flip thread, once the blits queued by the post are done */
+static int bench_pan(fb_flip_queue_t* q, fb_flip_t* flip)
+{
+    bench_sleep_until(flip->posted + sBlit);
+    return fake_display_ops.pan(q, flip);
+}
+
+static void bench_cancel(fb_flip_queue_t* q, fb_flip_t* flip)
+{
+    fake_display_ops.cancel(q, flip);
+}
+
+static const fb_flip_ops_t sBenchOps = {
+    bench_pan,
+    bench_cancel,
+};
+
+static bool bench_busy(fake_display_t* d, fb_flip_queue_t* q, buffer_handle_t buffer)
+{
+    bool busy = fake_display_screen(d) == buffer;
+    if (q->running) {
+        pthread_mutex_lock(&q->lock);
+        for (int i = 0; i < q->pending; i++) {
+            if (q->entries[(q->head + i) % FB_FLIP_QUEUE_SIZE].buffer == buffer)
+                busy = true;
+        }
+        pthread_mutex_unlock(&q->lock);
+    }
+    return busy;
+}
+
+static void bench_run(int mode, int64_t cpu, int64_t render, int64_t blit)
+{
+    fake_display_t d;
+    fb_flip_queue_t q;
+    int fences[SLOTS] = { -1, -1 };
+    int64_t postTime = 0, maxPost = 0;
+    int tears = 0;
+
+    fake_display_init(&d, PERIOD);
+    memset(&q, 0, sizeof(q));
+    sBlit = blit;
+    if (mode != MODE_SYNC)
+        fb_flip_start(&q, &sBenchOps, &d, 3, 60.0f);
+
+    int64_t start = fb_flip_now();
+    for (int n = 0; n < FRAMES; n++) {
+        buffer_handle_t buffer = (buffer_handle_t)&sBuffers[n % SLOTS];
+
+        bench_work(cpu);
+        if (fences[n % SLOTS] >= 0) {
+            // the gpu waits for the release fence before drawing
+            sync_wait(fences[n % SLOTS], 1000);
+            close(fences[n % SLOTS]);
+            fences[n % SLOTS] = -1;
+        }
+        if (bench_busy(&d, &q, buffer))
+            tears++;
+        bench_work(render);
+
+        fb_flip_t flip;
+        memset(&flip, 0, sizeof(flip));
+        flip.buffer = buffer;
+        flip.posted = fb_flip_now();
+        int fence = -1;
+        switch (mode) {
+            case MODE_SYNC:
+                bench_work(blit);
+                fake_display_pan(&d, buffer);
+                break;
+            case MODE_QUEUED:
+                fb_flip_queue(&q, &flip, &fence);
+                close(fence);
+                break;
+            case MODE_FENCE:
+                fb_flip_queue(&q, &flip, &fences[n % SLOTS]);
+                break;
+            case MODE_BLOCKING:
+                fb_flip_queue(&q, &flip, NULL);
+                break;
+        }
+        int64_t post = fb_flip_now() - flip.posted;
+        postTime += post;
+        if (post > maxPost)
+            maxPost = post;
+    }
+    fb_flip_drain(&q);
+    int64_t elapsed = fb_flip_now() - start;
+    fb_flip_stop(&q);
+    for (int i = 0; i < SLOTS; i++) {
+        if (fences[i] >= 0)
+            close(fences[i]);
+    }
+
+    printf("%-9s %5.1f fps  post avg %5.2f ms max %5.2f ms  %3d tears\n",
+           sModeNames[mode], FRAMES * 1e9 / elapsed, postTime / FRAMES / 1e6,
+           maxPost / 1e6, tears);
+}
+
+int main()
+{
+    // cpu, gpu and 2D time of a frame, ms
+    static const int loads[][3] = { { 2, 8, 0 }, { 6, 12, 0 }, { 4, 8, 6 }, { 6, 6, 8 } };
+
+    for (size_t l = 0; l < sizeof(loads) / sizeof(loads[0]); l++) {
+        printf("%d frames, cpu %d ms, render %d ms, blit %d ms, 60 Hz, %d slots:\n",
+               FRAMES, loads[l][0], loads[l][1], loads[l][2], SLOTS);
+        for (int mode = 0; mode < MODES; mode++)
+            bench_run(mode, loads[l][0] * 1000000LL, loads[l][1] * 1000000LL,
+                      loads[l][2] * 1000000LL);
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The flip queue against a fake display: release fences signal once the
+ * buffer is off screen, posts without one return once on screen, and a
+ * close gives back the flips still queued. */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sw_sync.h>
+
+#include "fake_display.h"
+#include "imx_test.h"
+
+// 500 Hz keeps the test short
+#define PERIOD 2000000LL
+
+static native_handle_t sBuffers[3];
+#define BUFFER(i) ((buffer_handle_t)&sBuffers[i])
+
+static fb_flip_t test_flip(int i)
+{
+    fb_flip_t flip;
+    memset(&flip, 0, sizeof(flip));
+    flip.buffer = BUFFER(i);
+    flip.posted = fb_flip_now();
+    return flip;
+}
+
+static bool test_signaled(int fence)
+{
+    return sync_wait(fence, 0) == 0;
+}
+
+/* a fence signals when the flip after its buffer is done, never before. */
+static void test_release_fence()
+{
+    fb_flip_queue_t q;
+    fake_display_t d;
+    int fence[4];
+
+    fake_display_init(&d, PERIOD);
+    CHECK(fb_flip_start(&q, &fake_display_ops, &d, 3, 500.0f) == 0, "start");
+
+    for (int i = 0; i < 4; i++) {
+        fb_flip_t flip = test_flip(i % 3);
+        CHECK(fb_flip_queue(&q, &flip, &fence[i]) == 0, "queue %d", i);
+        CHECK(fence[i] >= 0, "no fence for flip %d", i);
+        CHECK(q.pending <= q.maxPending, "post %d returned with no back buffer", i);
+    }
+    for (int i = 0; i < 3; i++) {
+        CHECK(sync_wait(fence[i], 1000) == 0, "fence %d never signaled", i);
+        // the fence signals with the next flip, which is then on screen
+        CHECK(d.shown >= i + 2, "fence %d signaled after %d flips", i, d.shown);
+    }
+    fb_flip_drain(&q);
+    CHECK(fake_display_screen(&d) == BUFFER(3 % 3), "last flip not on screen");
+    CHECK(!test_signaled(fence[3]), "fence of the front buffer signaled");
+
+    fb_flip_stop(&q);
+    CHECK(test_signaled(fence[3]), "front buffer fence left after close");
+    CHECK(d.cancelled == 0, "%d flips cancelled", d.cancelled);
+    for (int i = 0; i < 4; i++)
+        close(fence[i]);
+}
+
+/* without a fence the post returns with its buffer on screen. */
+static void test_blocking()
+{
+    fb_flip_queue_t q;
+    fake_display_t d;
+
+    fake_display_init(&d, PERIOD);
+    CHECK(fb_flip_start(&q, &fake_display_ops, &d, 3, 500.0f) == 0, "start");
+    for (int i = 0; i < 6; i++) {
+        fb_flip_t flip = test_flip(i % 3);
+        CHECK(fb_flip_queue(&q, &flip, NULL) == 0, "queue %d", i);
+        CHECK(fake_display_screen(&d) == BUFFER(i % 3), "post %d returned before its flip", i);
+    }
+
+    // a first fence after posts without one still waits for the next flip
+    int fence;
+    fb_flip_t flip = test_flip(0);
+    CHECK(fb_flip_queue(&q, &flip, &fence) == 0 && fence >= 0, "fenced post");
+    fb_flip_drain(&q);
+    CHECK(!test_signaled(fence), "fence signaled with its own flip");
+    flip = test_flip(1);
+    CHECK(fb_flip_queue(&q, &flip, NULL) == 0, "post after the fence");
+    CHECK(test_signaled(fence), "fence not signaled by the next flip");
+    close(fence);
+
+    fb_flip_stop(&q);
+    CHECK(d.shown == 8 && d.released == 7, "shown %d released %d", d.shown, d.released);
+}
+
+/* a close with flips queued gives their buffers back and signals all the
+ * fences handed out. */
+static void test_close_pending()
+{
+    fb_flip_queue_t q;
+    fake_display_t d;
+    int fence[2];
+
+    fake_display_init(&d, PERIOD);
+    d.panDelay = 20 * PERIOD;
+    // four buffers leave two flips queued
+    CHECK(fb_flip_start(&q, &fake_display_ops, &d, 4, 500.0f) == 0, "start");
+    for (int i = 0; i < 2; i++) {
+        fb_flip_t flip = test_flip(i);
+        CHECK(fb_flip_queue(&q, &flip, &fence[i]) == 0, "queue %d", i);
+    }
+    CHECK(q.pending == 2, "%d flips pending", q.pending);
+    while (!d.panning)
+        usleep(1000);
+    fb_flip_stop(&q);
+
+    // the first was in the pan when the close came, the second never ran
+    CHECK(d.shown == 1 && d.cancelled == 1, "shown %d cancelled %d", d.shown, d.cancelled);
+    for (int i = 0; i < 2; i++) {
+        CHECK(test_signaled(fence[i]), "fence %d left after close", i);
+        close(fence[i]);
+    }
+}
+
+int main()
+{
+    test_release_fence();
+    test_blocking();
+    test_close_pending();
+
+    return imx_test_result("fb_flip_test");
+}
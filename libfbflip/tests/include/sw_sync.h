@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* sw_sync and sync_wait of libsync for the host tests, implemented by
+ * sw_sync_fake.cpp with a pipe per fence. */
+#ifndef FB_FLIP_TEST_SW_SYNC_H
+#define FB_FLIP_TEST_SW_SYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int sw_sync_timeline_create(void);
+int sw_sync_timeline_inc(int fd, unsigned count);
+int sw_sync_fence_create(int fd, const char* name, unsigned value);
+int sync_wait(int fd, int timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* A fence is the read end of a pipe, whose write end is closed once the
+ * timeline reaches the fence value. */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sw_sync.h>
+
+#define MAX_FENCES 64
+
+struct fake_fence {
+    int timeline;
+    unsigned value;
+    int wfd;
+};
+
+static pthread_mutex_t sLock = PTHREAD_MUTEX_INITIALIZER;
+static struct fake_fence sFences[MAX_FENCES];
+static int sTimeline = -1;
+static unsigned sValue;
+
+int sw_sync_timeline_create(void)
+{
+    pthread_mutex_lock(&sLock);
+    int fd = open("/dev/null", O_RDONLY);
+    sTimeline = fd;
+    sValue = 0;
+    pthread_mutex_unlock(&sLock);
+    return fd;
+}
+
+int sw_sync_timeline_inc(int fd, unsigned count)
+{
+    pthread_mutex_lock(&sLock);
+    if (fd != sTimeline) {
+        pthread_mutex_unlock(&sLock);
+        return -EINVAL;
+    }
+    sValue += count;
+    for (int i = 0; i < MAX_FENCES; i++) {
+        struct fake_fence* f = &sFences[i];
+        if (f->wfd > 0 && f->timeline == fd && (int)(sValue - f->value) >= 0) {
+            close(f->wfd);
+            f->wfd = 0;
+        }
+    }
+    pthread_mutex_unlock(&sLock);
+    return 0;
+}
+
+int sw_sync_fence_create(int fd, const char* name, unsigned value)
+{
+    int p[2];
+
+    (void)name;
+    pthread_mutex_lock(&sLock);
+    if (fd != sTimeline || pipe(p) != 0) {
+        pthread_mutex_unlock(&sLock);
+        return -1;
+    }
+    if ((int)(sValue - value) >= 0) {
+        close(p[1]);
+        pthread_mutex_unlock(&sLock);
+        return p[0];
+    }
+    for (int i = 0; i < MAX_FENCES; i++) {
+        if (sFences[i].wfd <= 0) {
+            sFences[i].timeline = fd;
+            sFences[i].value = value;
+            sFences[i].wfd = p[1];
+            pthread_mutex_unlock(&sLock);
+            return p[0];
+        }
+    }
+    pthread_mutex_unlock(&sLock);
+    close(p[0]);
+    close(p[1]);
+    return -1;
+}
+
+int sync_wait(int fd, int timeout)
+{
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    int ret = poll(&pfd, 1, timeout);
+    if (ret > 0)
+        return 0;
+    errno = ret == 0 ? ETIME : errno;
+    return -1;
+}
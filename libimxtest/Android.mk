@@ -0,0 +1,30 @@
+# Copyright (C) 2013 Freescale Semiconductor, Inc.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+LOCAL_PATH := $(call my-dir)
+
+# checks, fixtures, reference crc32s and timing shared by the host tests
+# and benchmarks of the HALs, linked statically.
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := imx_test.c
+LOCAL_MODULE := libimxtest_host
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_STATIC_LIBRARY)
+
+# the same for the tests that time the NEON kernels on the target
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := imx_test.c
+LOCAL_MODULE := libimxtest
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_STATIC_LIBRARY)
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "imx_test.h"
+
+#define IMX_TEST_GOLDEN 128
+
+struct imx_test_golden {
+    char name[32];
+    uint32_t crc;
+    int used;
+};
+
+int imx_test_failures;
+
+static struct imx_test_golden sGolden[IMX_TEST_GOLDEN];
+static int sGoldenCount;
+
+void imx_test_fail(const char *file, int line, const char *fmt, ...)
+{
+    va_list args;
+
+    fprintf(stderr, "FAIL %s:%d: ", file, line);
+    va_start(args, fmt);
+    vfprintf(stderr, fmt, args);
+    va_end(args);
+    fputc('\n', stderr);
+    imx_test_failures++;
+}
+
+int imx_test_result(const char *name)
+{
+    printf("%s: %s (%d failures)\n", name, imx_test_failures ? "FAILED" : "PASSED",
+           imx_test_failures);
+    return imx_test_failures ? 1 : 0;
+}
+
+void imx_test_path(char *path, size_t size, int argc, char **argv, const char *tree)
+{
+    const char *top;
+
+    if (argc > 1) {
+        snprintf(path, size, "%s", argv[1]);
+        return;
+    }
+    top = getenv("ANDROID_BUILD_TOP");
+    snprintf(path, size, "%s/hardware/imx/%s", top ? top : ".", tree);
+}
+
+void *imx_test_load(const char *dir, const char *name, size_t *size)
+{
+    char path[1024];
+    void *data = NULL;
+    FILE *f;
+    long len;
+
+    *size = 0;
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    f = fopen(path, "rb");
+    if (f == NULL) {
+        imx_test_fail(__FILE__, __LINE__, "%s: %s", path, strerror(errno));
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    if (len > 0)
+        data = malloc(len);
+    if (data != NULL && fread(data, 1, len, f) == (size_t)len)
+        *size = len;
+    fclose(f);
+    if (*size == 0) {
+        imx_test_fail(__FILE__, __LINE__, "%s: empty or short read", path);
+        free(data);
+        return NULL;
+    }
+    return data;
+}
+
+uint32_t imx_test_crc32(uint32_t crc, const void *data, size_t size)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    int k;
+
+    crc = ~crc;
+    while (size--) {
+        crc ^= *p++;
+        for (k = 0; k < 8; k++)
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+int imx_test_golden_load(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char buf[128];
+
+    if (f == NULL) {
+        imx_test_fail(__FILE__, __LINE__, "%s: %s", path, strerror(errno));
+        return -1;
+    }
+    while (fgets(buf, sizeof(buf), f) && sGoldenCount < IMX_TEST_GOLDEN) {
+        struct imx_test_golden *g = &sGolden[sGoldenCount];
+        if (buf[0] == '#' || sscanf(buf, "%31s %x", g->name, &g->crc) != 2)
+            continue;
+        g->used = 0;
+        sGoldenCount++;
+    }
+    fclose(f);
+    return 0;
+}
+
+void imx_test_golden(const char *name, uint32_t crc)
+{
+    int i;
+
+    for (i = 0; i < sGoldenCount; i++) {
+        if (strcmp(sGolden[i].name, name))
+            continue;
+        sGolden[i].used = 1;
+        if (sGolden[i].crc != crc) {
+            imx_test_fail(__FILE__, __LINE__, "%s: output changed, crc %08x, reference %08x",
+                          name, crc, sGolden[i].crc);
+            fprintf(stderr, "%s %08x\n", name, crc);
+        }
+        return;
+    }
+    imx_test_fail(__FILE__, __LINE__, "%s: no reference output, crc %08x", name, crc);
+}
+
+void imx_test_golden_unused(void)
+{
+    int i;
+
+    for (i = 0; i < sGoldenCount; i++) {
+        if (!sGolden[i].used)
+            imx_test_fail(__FILE__, __LINE__, "%s: reference without a case", sGolden[i].name);
+    }
+}
+
+int64_t imx_test_ns(clockid_t clock)
+{
+    struct timespec t;
+
+    clock_gettime(clock, &t);
+    return (int64_t)t.tv_sec * 1000000000LL + t.tv_nsec;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef IMX_TEST_H
+#define IMX_TEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* what the host tests and benchmarks share: failed checks are printed
+ * with their place and counted, the count decides the exit status. */
+
+extern int imx_test_failures;
+
+#define CHECK(cond, ...) do {                                   \
+        if (!(cond))                                            \
+            imx_test_fail(__FILE__, __LINE__, __VA_ARGS__);     \
+    } while (0)
+
+void imx_test_fail(const char *file, int line, const char *fmt, ...)
+        __attribute__((format(printf, 3, 4)));
+
+/* prints "<name>: PASSED (0 failures)" or FAILED, returns the exit status */
+int imx_test_result(const char *name);
+
+/* argv[1] when given, else tree, a path under hardware/imx of
+ * $ANDROID_BUILD_TOP or of the current directory */
+void imx_test_path(char *path, size_t size, int argc, char **argv, const char *tree);
+
+/* all of dir/name, NULL and a failure when it cannot be read or is empty.
+ * freed with free(). */
+void *imx_test_load(const char *dir, const char *name, size_t *size);
+
+uint32_t imx_test_crc32(uint32_t crc, const void *data, size_t size);
+
+/* the reference outputs of a test, "name crc32" lines, # comments. a
+ * missing file is a failure. */
+int imx_test_golden_load(const char *path);
+/* the output of the case name against its reference. a mismatch prints
+ * the line to update the reference with. */
+void imx_test_golden(const char *name, uint32_t crc);
+/* a failure for every reference no case checked */
+void imx_test_golden_unused(void);
+
+int64_t imx_test_ns(clockid_t clock);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* IMX_TEST_H */
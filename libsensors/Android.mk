@@ -32,12 +32,30 @@ LOCAL_SRC_FILES := 						\
 				AccelSensor.cpp			\
 				MagSensor.cpp			\
 				PressSensor.cpp			\
+				FusionSensor.cpp		\
+				SensorFifo.cpp			\
 				InputEventReader.cpp
 
 LOCAL_SHARED_LIBRARIES := liblog libcutils libdl
 
 include $(BUILD_SHARED_LIBRARY)
 
+# the rotation vector, gravity and linear acceleration against the device
+# motion recorded in tests/fusion, run on the host:
+# out/host/<os>-<arch>/bin/fusion_test [trace dir]
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := 						\
+				FusionSensor.cpp		\
+				SensorBase.cpp			\
+				SensorFifo.cpp			\
+				tests/fusion_test.cpp
+LOCAL_C_INCLUDES += hardware/imx/libimxtest
+LOCAL_STATIC_LIBRARIES := libimxtest_host liblog libcutils
+LOCAL_LDLIBS := -lm -lrt
+LOCAL_MODULE := fusion_test
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
+
 endif # !TARGET_SIMULATOR
 
 endif #
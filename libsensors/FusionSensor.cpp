@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#include <cutils/log.h>
+
+#include "FusionSensor.h"
+
+/*****************************************************************************/
+
+/* time constants of the gravity filter in s, for a sample of 1 g and for
+ * one that is FUSION_MOVING_G or more away from it */
+#define FUSION_TAU_STILL        0.2f
+#define FUSION_TAU_MOVING       2.0f
+#define FUSION_MOVING_G         0.2f
+/* time constant of the magnetic field filter in s */
+#define FUSION_TAU_MAG          0.1f
+/* a gap longer than this in s starts the filters again */
+#define FUSION_MAX_GAP          1.0f
+/* the reference is too close to gravity for a heading below this */
+#define FUSION_MIN_HORIZONTAL   0.1f
+/* events of the three sensors for one accelerometer read of 16 samples */
+#define FUSION_QUEUE_EVENTS     64
+/* CPU time one update is expected to take, 0.25% of a CPU at 50 Hz */
+#define FUSION_BUDGET_NS        50000
+
+static int64_t getCpuTime()
+{
+    struct timespec t;
+    t.tv_sec = t.tv_nsec = 0;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return int64_t(t.tv_sec)*1000000000LL + t.tv_nsec;
+}
+
+static float lowPassGain(float dt, float tau)
+{
+    return dt / (tau + dt);
+}
+
+FusionSensor::FusionSensor()
+    : SensorBase(NULL, NULL),
+      mHasGravity(false),
+      mHasMag(false),
+      mGravityTime(0),
+      mMagTime(0),
+      mAccelStatus(SENSOR_STATUS_UNRELIABLE),
+      mUpdates(0),
+      mOverBudget(0),
+      mCpuTime(0),
+      mMaxCpuTime(0)
+{
+    memset(mEnabled, 0, sizeof(mEnabled));
+    memset(mGravity, 0, sizeof(mGravity));
+    memset(mMag, 0, sizeof(mMag));
+}
+
+FusionSensor::~FusionSensor()
+{
+}
+
+bool FusionSensor::hasPendingEvents() const
+{
+    return mEvents.count() > 0;
+}
+
+bool FusionSensor::isActive() const
+{
+    for (int i = 0; i < sensors; i++) {
+        if (mEnabled[i])
+            return true;
+    }
+    return false;
+}
+
+int FusionSensor::setEnable(int32_t handle, int en)
+{
+    int what;
+    switch (handle) {
+        case ID_RV: what = rv; break;
+        case ID_GR: what = gravity; break;
+        case ID_LA: what = linear; break;
+        default: return -EINVAL;
+    }
+    if (en && mEvents.allocate(FUSION_QUEUE_EVENTS))
+        return -ENOMEM;
+
+    bool active = isActive();
+    if (en)
+        mEnabled[what]++;
+    else if (mEnabled[what] > 0)
+        mEnabled[what]--;
+
+    if (active && !isActive()) {
+        // the next enable starts from fresh samples
+        logStats();
+        mHasGravity = false;
+        mHasMag = false;
+    }
+    ALOGD("FusionSensor enable %d, handle %d, mEnabled %d", en, handle, mEnabled[what]);
+    return 0;
+}
+
+int FusionSensor::getEnable(int32_t handle)
+{
+    switch (handle) {
+        case ID_RV: return mEnabled[rv];
+        case ID_GR: return mEnabled[gravity];
+        case ID_LA: return mEnabled[linear];
+    }
+    return 0;
+}
+
+int FusionSensor::readEvents(sensors_event_t* data, int count)
+{
+    if (count < 1)
+        return -EINVAL;
+    return mEvents.read(data, count);
+}
+
+void FusionSensor::processEvent(int code, int value)
+{
+}
+
+void FusionSensor::updateGravity(sensors_event_t const& event)
+{
+    const float* a = event.acceleration.v;
+    float dt = (event.timestamp - mGravityTime) * 1e-9f;
+
+    mGravityTime = event.timestamp;
+    mAccelStatus = event.acceleration.status;
+    if (!mHasGravity || dt <= 0.0f || dt > FUSION_MAX_GAP) {
+        mGravity[0] = a[0];
+        mGravity[1] = a[1];
+        mGravity[2] = a[2];
+        mHasGravity = true;
+        return;
+    }
+
+    // the further the sample is from 1 g, the more of it is motion
+    float norm = sqrtf(a[0]*a[0] + a[1]*a[1] + a[2]*a[2]);
+    float moving = fabsf(norm - GRAVITY_EARTH) / (GRAVITY_EARTH * FUSION_MOVING_G);
+    if (moving > 1.0f)
+        moving = 1.0f;
+    float k = lowPassGain(dt, FUSION_TAU_STILL + (FUSION_TAU_MOVING - FUSION_TAU_STILL) * moving);
+
+    for (int i = 0; i < 3; i++)
+        mGravity[i] += k * (a[i] - mGravity[i]);
+}
+
+void FusionSensor::updateMag(sensors_event_t const& event)
+{
+    const float* m = event.magnetic.v;
+    float dt = (event.timestamp - mMagTime) * 1e-9f;
+
+    mMagTime = event.timestamp;
+    if (!mHasMag || dt <= 0.0f || dt > FUSION_MAX_GAP) {
+        mMag[0] = m[0];
+        mMag[1] = m[1];
+        mMag[2] = m[2];
+        mHasMag = true;
+        return;
+    }
+
+    float k = lowPassGain(dt, FUSION_TAU_MAG);
+    for (int i = 0; i < 3; i++)
+        mMag[i] += k * (m[i] - mMag[i]);
+}
+
+/* the quaternion rotating the device into the world, east north up as for
+ * SensorManager.getRotationMatrix, with ref pointing to the north. false
+ * when gravity or the horizontal part of ref is too small. */
+bool FusionSensor::attitude(const float* ref, float* q) const
+{
+    const float* g = mGravity;
+    float gn = sqrtf(g[0]*g[0] + g[1]*g[1] + g[2]*g[2]);
+    if (gn < GRAVITY_EARTH * 0.1f)
+        return false;
+
+    float up[3] = { g[0] / gn, g[1] / gn, g[2] / gn };
+    float e[3] = {
+        ref[1]*up[2] - ref[2]*up[1],
+        ref[2]*up[0] - ref[0]*up[2],
+        ref[0]*up[1] - ref[1]*up[0],
+    };
+    float en = sqrtf(e[0]*e[0] + e[1]*e[1] + e[2]*e[2]);
+    float rn = sqrtf(ref[0]*ref[0] + ref[1]*ref[1] + ref[2]*ref[2]);
+    if (en < rn * FUSION_MIN_HORIZONTAL)
+        return false;
+    e[0] /= en;
+    e[1] /= en;
+    e[2] /= en;
+    float n[3] = {
+        up[1]*e[2] - up[2]*e[1],
+        up[2]*e[0] - up[0]*e[2],
+        up[0]*e[1] - up[1]*e[0],
+    };
+
+    // rows east, north and up
+    const float r[9] = {
+        e[0],  e[1],  e[2],
+        n[0],  n[1],  n[2],
+        up[0], up[1], up[2],
+    };
+    float x, y, z, w, s;
+    float trace = r[0] + r[4] + r[8];
+    if (trace > 0.0f) {
+        s = sqrtf(trace + 1.0f) * 2.0f;
+        w = 0.25f * s;
+        x = (r[7] - r[5]) / s;
+        y = (r[2] - r[6]) / s;
+        z = (r[3] - r[1]) / s;
+    } else if (r[0] > r[4] && r[0] > r[8]) {
+        s = sqrtf(1.0f + r[0] - r[4] - r[8]) * 2.0f;
+        w = (r[7] - r[5]) / s;
+        x = 0.25f * s;
+        y = (r[1] + r[3]) / s;
+        z = (r[2] + r[6]) / s;
+    } else if (r[4] > r[8]) {
+        s = sqrtf(1.0f + r[4] - r[0] - r[8]) * 2.0f;
+        w = (r[2] - r[6]) / s;
+        x = (r[1] + r[3]) / s;
+        y = 0.25f * s;
+        z = (r[5] + r[7]) / s;
+    } else {
+        s = sqrtf(1.0f + r[8] - r[0] - r[4]) * 2.0f;
+        w = (r[3] - r[1]) / s;
+        x = (r[2] + r[6]) / s;
+        y = (r[5] + r[7]) / s;
+        z = 0.25f * s;
+    }
+    // the framework takes w from x, y and z, it must not be negative
+    if (w < 0.0f) {
+        x = -x; y = -y; z = -z; w = -w;
+    }
+    q[0] = x;
+    q[1] = y;
+    q[2] = z;
+    q[3] = w;
+    return true;
+}
+
+/* the events of the enabled sensors for an accelerometer sample */
+void FusionSensor::fuse(sensors_event_t const& event)
+{
+    if (!isActive() || !mEvents.size())
+        return;
+
+    if (event.sensor == ID_M) {
+        updateMag(event);
+        return;
+    }
+    if (event.sensor != ID_A)
+        return;
+
+    int64_t start = getCpuTime();
+    updateGravity(event);
+
+    sensors_event_t ev;
+    float q[4];
+    float gn = sqrtf(mGravity[0]*mGravity[0] + mGravity[1]*mGravity[1] +
+                     mGravity[2]*mGravity[2]);
+    float scale = gn > 0.0f ? GRAVITY_EARTH / gn : 0.0f;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.version = sizeof(sensors_event_t);
+    ev.timestamp = event.timestamp;
+
+    if (mEnabled[gravity]) {
+        ev.sensor = ID_GR;
+        ev.type = SENSOR_TYPE_GRAVITY;
+        for (int i = 0; i < 3; i++)
+            ev.acceleration.v[i] = mGravity[i] * scale;
+        ev.acceleration.status = mAccelStatus;
+        mEvents.push(ev);
+    }
+    if (mEnabled[linear]) {
+        ev.sensor = ID_LA;
+        ev.type = SENSOR_TYPE_LINEAR_ACCELERATION;
+        for (int i = 0; i < 3; i++)
+            ev.acceleration.v[i] = event.acceleration.v[i] - mGravity[i] * scale;
+        ev.acceleration.status = mAccelStatus;
+        mEvents.push(ev);
+    }
+    memset(ev.data, 0, sizeof(ev.data));
+    if (mEnabled[rv] && mHasMag && attitude(mMag, q)) {
+        ev.sensor = ID_RV;
+        ev.type = SENSOR_TYPE_ROTATION_VECTOR;
+        memcpy(ev.data, q, sizeof(q));
+        // no estimate of the heading accuracy without a gyro
+        ev.data[4] = -1.0f;
+        mEvents.push(ev);
+    }
+
+    int64_t cpu = getCpuTime() - start;
+    mUpdates++;
+    mCpuTime += cpu;
+    if (cpu > mMaxCpuTime)
+        mMaxCpuTime = cpu;
+    if (cpu > FUSION_BUDGET_NS)
+        mOverBudget++;
+}
+
+void FusionSensor::logStats()
+{
+    if (mUpdates) {
+        ALOGI("fusion: %u updates, cpu %lld/%lld us (average/max), %u over the %d us budget,"
+              " %u events lost",
+              mUpdates, (long long)(mCpuTime / mUpdates / 1000), (long long)(mMaxCpuTime / 1000),
+              mOverBudget, FUSION_BUDGET_NS / 1000, mEvents.lost());
+    }
+    mUpdates = 0;
+    mOverBudget = 0;
+    mCpuTime = 0;
+    mMaxCpuTime = 0;
+}
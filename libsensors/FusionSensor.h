@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_FSL_FUSION_SENSOR_H
+#define ANDROID_FSL_FUSION_SENSOR_H
+
+#include <stdint.h>
+#include <errno.h>
+#include <sys/cdefs.h>
+#include <sys/types.h>
+
+#include "sensors.h"
+#include "SensorBase.h"
+#include "SensorFifo.h"
+
+/*****************************************************************************/
+
+/*
+ * Rotation vector, gravity and linear acceleration derived from the
+ * accelerometer and the magnetometer, there is no gyro.
+ *
+ * Gravity is the accelerometer through a complementary filter whose gain
+ * drops while the device accelerates: a sample close to 1 g is trusted
+ * with a short time constant, one far from it with a long one. The linear
+ * acceleration is what remains of the sample. The rotation vector is the
+ * attitude of gravity and of the filtered magnetic field. Without a gyro
+ * there is no heading but the field's, so no game rotation vector.
+ *
+ * The sensor has no device of its own, it is fed the accelerometer and
+ * magnetometer events the context reads and only computes while one of
+ * its sensors is enabled. The CPU time of each update is measured against
+ * a budget and logged once they are all disabled.
+ */
+class FusionSensor : public SensorBase {
+public:
+    FusionSensor();
+    virtual ~FusionSensor();
+    virtual bool hasPendingEvents() const;
+    virtual int setEnable(int32_t handle, int enabled);
+    virtual int getEnable(int32_t handle);
+    virtual int readEvents(sensors_event_t* data, int count);
+    void processEvent(int code, int value);
+    bool isActive() const;
+    void fuse(sensors_event_t const& event);
+
+private:
+    enum {
+        rv          = 0,
+        gravity     = 1,
+        linear      = 2,
+        sensors     = 3,
+    };
+    void updateGravity(sensors_event_t const& event);
+    void updateMag(sensors_event_t const& event);
+    bool attitude(const float* ref, float* q) const;
+    void logStats();
+    int mEnabled[sensors];
+    SensorFifo mEvents;
+    float mGravity[3];
+    float mMag[3];
+    bool mHasGravity;
+    bool mHasMag;
+    int64_t mGravityTime;
+    int64_t mMagTime;
+    int8_t mAccelStatus;
+    uint32_t mUpdates;
+    uint32_t mOverBudget;
+    int64_t mCpuTime;
+    int64_t mMaxCpuTime;
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_FSL_FUSION_SENSOR_H
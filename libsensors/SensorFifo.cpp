@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SensorFifo.h"
+
+/*****************************************************************************/
+
+SensorFifo::SensorFifo()
+    : mEvents(NULL),
+      mSize(0),
+      mHead(0),
+      mCount(0),
+      mLost(0)
+{
+}
+
+SensorFifo::~SensorFifo()
+{
+    free(mEvents);
+}
+
+int SensorFifo::allocate(size_t numEvents)
+{
+    if (mEvents)
+        return 0;
+
+    mEvents = (sensors_event_t*)malloc(numEvents * sizeof(sensors_event_t));
+    if (!mEvents)
+        return -ENOMEM;
+    mSize = numEvents;
+    return 0;
+}
+
+void SensorFifo::push(sensors_event_t const& event)
+{
+    if (mCount == mSize) {
+        // full, the oldest event is lost
+        mHead = (mHead + 1) % mSize;
+        mCount--;
+        mLost++;
+    }
+    mEvents[(mHead + mCount) % mSize] = event;
+    mCount++;
+}
+
+size_t SensorFifo::read(sensors_event_t* data, size_t count)
+{
+    size_t n = count < mCount ? count : mCount;
+    size_t first = mSize - mHead;
+
+    if (first > n)
+        first = n;
+    memcpy(data, mEvents + mHead, first * sizeof(sensors_event_t));
+    memcpy(data + first, mEvents, (n - first) * sizeof(sensors_event_t));
+    mHead = (mHead + n) % (mSize ? mSize : 1);
+    mCount -= n;
+    return n;
+}
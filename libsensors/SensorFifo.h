@@ -0,0 +1,53 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_FIFO_H
+#define ANDROID_SENSOR_FIFO_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <hardware/sensors.h>
+
+/*****************************************************************************/
+
+/*
+ * Events of one sensor kept while it batches, oldest first. The ring is
+ * only allocated once the sensor batches; when it is full the oldest
+ * event is dropped for the new one.
+ */
+class SensorFifo
+{
+    sensors_event_t* mEvents;
+    size_t mSize;
+    size_t mHead;
+    size_t mCount;
+    uint32_t mLost;
+
+public:
+    SensorFifo();
+    ~SensorFifo();
+    int allocate(size_t numEvents);
+    void push(sensors_event_t const& event);
+    size_t read(sensors_event_t* data, size_t count);
+    size_t count() const { return mCount; }
+    size_t size() const { return mSize; }
+    uint32_t lost() const { return mLost; }
+};
+
+/*****************************************************************************/
+
+#endif  // ANDROID_SENSOR_FIFO_H
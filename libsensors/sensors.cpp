@@ -25,6 +25,7 @@
 #include <poll.h>
 #include <pthread.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <linux/input.h>
 
@@ -34,8 +35,10 @@
 #include "sensors.h"
 
 #include "AccelSensor.h"
+#include "FusionSensor.h"
 #include "MagSensor.h"
 #include "PressSensor.h"
+#include "SensorFifo.h"
 
 
 /*****************************************************************************/
@@ -44,6 +47,13 @@
 
 #define LIGHT_SENSOR_POLLTIME    2000000000
 
+/* events buffered for each sensor while it batches, 5 s at 50 Hz. the
+ * framework reads up to 256 events per poll, a full fifo is reported in
+ * one call */
+#define SENSORS_FIFO_EVENTS      256
+/* a fifo filled this much is reported before its deadline */
+#define SENSORS_FIFO_WATERMARK   (SENSORS_FIFO_EVENTS * 3 / 4)
+
 #define SENSORS_ACCELERATION     (1<<ID_A)
 #define SENSORS_MAGNETIC_FIELD   (1<<ID_M)
 #define SENSORS_ORIENTATION      (1<<ID_O)
@@ -52,6 +62,9 @@
 #define SENSORS_PRESS            (1<<ID_P)
 #define SENSORS_TEMPERATURE		 (1<<ID_T)
 #define SENSORS_PROXIMITY        (1<<ID_PX)
+#define SENSORS_ROTATION_VECTOR  (1<<ID_RV)
+#define SENSORS_GRAVITY          (1<<ID_GR)
+#define SENSORS_LINEAR_ACCELERATION (1<<ID_LA)
 
 #define SENSORS_ACCELERATION_HANDLE     0
 #define SENSORS_MAGNETIC_FIELD_HANDLE   1
@@ -61,6 +74,9 @@
 #define SENSORS_PRESSURE_HANDLE         5
 #define SENSORS_TEMPERATURE_HANDLE      6
 #define SENSORS_PROXIMITY_HANDLE        7
+#define SENSORS_ROTATION_VECTOR_HANDLE  8
+#define SENSORS_GRAVITY_HANDLE          9
+#define SENSORS_LINEAR_ACCELERATION_HANDLE 10
 
 /*****************************************************************************/
 
@@ -69,23 +85,42 @@ static const struct sensor_t sSensorList[] = {
         { "Freescale 3-axis Accelerometer",
           "Freescale Semiconductor Inc.",
           1, SENSORS_ACCELERATION_HANDLE,
-          SENSOR_TYPE_ACCELEROMETER, RANGE_A, CONVERT_A, 0.30f, 20000, { } },
+          SENSOR_TYPE_ACCELEROMETER, RANGE_A, CONVERT_A, 0.30f, 20000,
+          SENSORS_FIFO_EVENTS, SENSORS_FIFO_EVENTS, { } },
         { "Freescale 3-axis Magnetic field sensor",
           "Freescale Semiconductor Inc.",
           1, SENSORS_MAGNETIC_FIELD_HANDLE,
-          SENSOR_TYPE_MAGNETIC_FIELD, 1500.0f, CONVERT_M, 0.50f, 100000, { } },
+          SENSOR_TYPE_MAGNETIC_FIELD, 1500.0f, CONVERT_M, 0.50f, 100000,
+          SENSORS_FIFO_EVENTS, SENSORS_FIFO_EVENTS, { } },
         { "Freescale Orientation sensor",
           "Freescale Semiconductor Inc.",
           1, SENSORS_ORIENTATION_HANDLE,
-          SENSOR_TYPE_ORIENTATION, 360.0f, CONVERT_O, 0.50f, 100000, { } },
+          SENSOR_TYPE_ORIENTATION, 360.0f, CONVERT_O, 0.50f, 100000,
+          SENSORS_FIFO_EVENTS, SENSORS_FIFO_EVENTS, { } },
         { "MPL3115 Temperature sensor",
           "Freescale Semiconductor Inc.",
           1, SENSORS_TEMPERATURE_HANDLE,
-          SENSOR_TYPE_TEMPERATURE, 85.0f, CONVERT_TEMPERATURE, 0.35f, 0, { } },
+          SENSOR_TYPE_TEMPERATURE, 85.0f, CONVERT_TEMPERATURE, 0.35f, 0,
+          SENSORS_FIFO_EVENTS, SENSORS_FIFO_EVENTS, { } },
         { "ISL29023 Light sensor",
           "Intersil",
           1, SENSORS_LIGHT_HANDLE,
-          SENSOR_TYPE_LIGHT, 16000.0f, 1.0f, 0.35f, 0, { } },
+          SENSOR_TYPE_LIGHT, 16000.0f, 1.0f, 0.35f, 0, 0, 0, { } },
+        { "Freescale Rotation Vector sensor",
+          "Freescale Semiconductor Inc.",
+          1, SENSORS_ROTATION_VECTOR_HANDLE,
+          SENSOR_TYPE_ROTATION_VECTOR, 1.0f, 1.0f / (1<<24), 0.80f, 20000,
+          SENSORS_FIFO_EVENTS, SENSORS_FIFO_EVENTS, { } },
+        { "Freescale Gravity sensor",
+          "Freescale Semiconductor Inc.",
+          1, SENSORS_GRAVITY_HANDLE,
+          SENSOR_TYPE_GRAVITY, RANGE_A, CONVERT_A, 0.30f, 20000,
+          SENSORS_FIFO_EVENTS, SENSORS_FIFO_EVENTS, { } },
+        { "Freescale Linear Acceleration sensor",
+          "Freescale Semiconductor Inc.",
+          1, SENSORS_LINEAR_ACCELERATION_HANDLE,
+          SENSOR_TYPE_LINEAR_ACCELERATION, RANGE_A, CONVERT_A, 0.30f, 20000,
+          SENSORS_FIFO_EVENTS, SENSORS_FIFO_EVENTS, { } },
 };
 
 
@@ -117,13 +152,32 @@ struct sensors_module_t HAL_MODULE_INFO_SYM = {
         get_sensors_list: sensors__get_sensors_list,
 };
 
+static const struct sensor_t* getSensor(int handle)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(sSensorList); i++) {
+        if (sSensorList[i].handle == handle)
+            return &sSensorList[i];
+    }
+    return NULL;
+}
+
+static int64_t getTimestamp(clockid_t clock)
+{
+    struct timespec t;
+    t.tv_sec = t.tv_nsec = 0;
+    clock_gettime(clock, &t);
+    return int64_t(t.tv_sec)*1000000000LL + t.tv_nsec;
+}
+
 struct sensors_poll_context_t {
-    struct sensors_poll_device_t device; // must be first
+    struct sensors_poll_device_1 device; // must be first
 
         sensors_poll_context_t();
         ~sensors_poll_context_t();
     int activate(int handle, int enabled);
     int setDelay(int handle, int64_t ns);
+    int batch(int handle, int flags, int64_t period_ns, int64_t timeout);
+    int flush(int handle);
     int pollEvents(sensors_event_t* data, int count);
 
 private:
@@ -131,6 +185,7 @@ private:
         accel           = 0,
         mag 		    = 1,
         pressure        = 2,
+        fusion          = 3,
         numSensorDrivers,
         numFds,
     };
@@ -141,6 +196,46 @@ private:
     int mWritePipeFd;
     SensorBase* mSensors[numSensorDrivers];
 
+    /*
+     * Batching is done here, the drivers have no fifo of their own: the
+     * events of a batching sensor are kept until its report latency ends
+     * or its fifo reaches the watermark, then the events of all the
+     * sensors batching are reported at once. The framework is woken once
+     * per batch instead of once per event.
+     */
+    struct batch_t {
+        int64_t timeout;        // max report latency, 0 when not batching
+        int64_t deadline;       // the oldest event buffered is reported by then
+        int flushes;            // flush complete events to report
+        SensorFifo fifo;
+    };
+    enum { numHandles = ID_LA + 1 };
+    batch_t mBatch[numHandles];
+    pthread_mutex_t mBatchLock;
+
+    /* wakeups of the framework and CPU time of the poll thread, reported
+     * for each report latency when it changes */
+    struct {
+        int64_t latency;
+        int64_t start;
+        uint32_t wakeups;
+        uint32_t events;
+        int64_t cpuTime;
+        int64_t cpuMark;
+    } mStats;
+
+    /* handles the framework enabled. the accelerometer and the magnetometer
+     * also run for the fusion, their events are then only reported when
+     * enabled here */
+    bool mActive[numHandles];
+
+    int fuseEvents(sensors_event_t* data, int count);
+    int batchEvents(sensors_event_t* data, int count);
+    int readBatches(sensors_event_t* data, int count);
+    int batchTimeout();
+    void updateStats();
+    void wakePoll();
+
     int handleToDriver(int handle) const {
         switch (handle) {
             case ID_A:
@@ -151,6 +246,10 @@ private:
 			case ID_P:
 			case ID_T:
 				 return pressure;
+            case ID_RV:
+            case ID_GR:
+            case ID_LA:
+                return fusion;
         }
         return -EINVAL;
     }
@@ -174,7 +273,12 @@ sensors_poll_context_t::sensors_poll_context_t()
 	mPollFds[pressure].fd = mSensors[pressure]->getFd();
 	mPollFds[pressure].events = POLLIN;
 	mPollFds[pressure].revents = 0;
-	
+
+    // no device, fed what the others read
+    mSensors[fusion] = new FusionSensor();
+    mPollFds[fusion].fd = -1;
+    mPollFds[fusion].events = POLLIN;
+    mPollFds[fusion].revents = 0;
 	
     int wakeFds[2];
     int result = pipe(wakeFds);
@@ -186,6 +290,16 @@ sensors_poll_context_t::sensors_poll_context_t()
     mPollFds[wake].fd = wakeFds[0];
     mPollFds[wake].events = POLLIN;
     mPollFds[wake].revents = 0;
+
+    for (int i=0 ; i<numHandles ; i++) {
+        mBatch[i].timeout = 0;
+        mBatch[i].deadline = 0;
+        mBatch[i].flushes = 0;
+        mActive[i] = false;
+    }
+    pthread_mutex_init(&mBatchLock, NULL);
+    memset(&mStats, 0, sizeof(mStats));
+    mStats.start = getTimestamp(CLOCK_MONOTONIC);
 }
 
 sensors_poll_context_t::~sensors_poll_context_t() {
@@ -194,6 +308,13 @@ sensors_poll_context_t::~sensors_poll_context_t() {
     }
     close(mPollFds[wake].fd);
     close(mWritePipeFd);
+    pthread_mutex_destroy(&mBatchLock);
+}
+
+void sensors_poll_context_t::wakePoll() {
+    const char wakeMessage(WAKE_MESSAGE);
+    int result = write(mWritePipeFd, &wakeMessage, 1);
+    ALOGE_IF(result<0, "error sending wake message (%s)", strerror(errno));
 }
 
 int sensors_poll_context_t::activate(int handle, int enabled) {
@@ -205,11 +326,28 @@ int sensors_poll_context_t::activate(int handle, int enabled) {
 		if(err)
 			return err;
 	}
+	if (index == fusion) {
+		// the fusion needs the accelerometer, and the magnetometer for a heading
+		err = mSensors[accel]->setEnable(ID_A, enabled);
+		if (!err && handle == ID_RV)
+			err = mSensors[mag]->setEnable(ID_M, enabled);
+		if (err)
+			return err;
+	}
 	err |=  mSensors[index]->setEnable(handle, enabled);
+    if (!err)
+        mActive[handle] = enabled;
+    if (!enabled) {
+        // its batching ends, what it buffered is reported
+        pthread_mutex_lock(&mBatchLock);
+        if (mBatch[handle].timeout) {
+            mBatch[handle].timeout = 0;
+            updateStats();
+        }
+        pthread_mutex_unlock(&mBatchLock);
+    }
     if (enabled && !err) {
-        const char wakeMessage(WAKE_MESSAGE);
-        int result = write(mWritePipeFd, &wakeMessage, 1);
-        ALOGE_IF(result<0, "error sending wake message (%s)", strerror(errno));
+        wakePoll();
     }
     return err;
 }
@@ -221,13 +359,192 @@ int sensors_poll_context_t::setDelay(int handle, int64_t ns) {
 	if(handle == ID_O || handle ==  ID_M){
 		 mSensors[accel]->setDelay(handle, ns);// if handle == orientaion or magnetic ,please enable ACCELERATE Sensor
 	}
+	if (index == fusion) {
+		mSensors[accel]->setDelay(ID_A, ns);
+		if (handle == ID_RV)
+			mSensors[mag]->setDelay(ID_M, ns);
+	}
     return mSensors[index]->setDelay(handle, ns);
 }
 
+int sensors_poll_context_t::batch(int handle, int flags, int64_t period_ns, int64_t timeout) {
+    int index = handleToDriver(handle);
+    if (index < 0) return index;
+    const struct sensor_t* sensor = getSensor(handle);
+    if (timeout > 0 && (!sensor || !sensor->fifoMaxEventCount))
+        return -EINVAL;
+    if (flags & SENSORS_BATCH_DRY_RUN)
+        return 0;
+
+    int err = setDelay(handle, period_ns);
+    if (err)
+        return err;
+
+    pthread_mutex_lock(&mBatchLock);
+    if (timeout > 0)
+        err = mBatch[handle].fifo.allocate(sensor->fifoMaxEventCount);
+    if (!err && mBatch[handle].timeout != timeout) {
+        mBatch[handle].timeout = timeout;
+        updateStats();
+    }
+    pthread_mutex_unlock(&mBatchLock);
+
+    // the poll waits for the new latency
+    wakePoll();
+    return err;
+}
+
+int sensors_poll_context_t::flush(int handle) {
+    int index = handleToDriver(handle);
+    if (index < 0) return index;
+    if (!mSensors[index]->getEnable(handle))
+        return -EINVAL;
+
+    pthread_mutex_lock(&mBatchLock);
+    mBatch[handle].flushes++;
+    pthread_mutex_unlock(&mBatchLock);
+    wakePoll();
+    return 0;
+}
+
+/* the accelerometer and magnetometer events feed the fusion, those of a
+ * sensor only enabled for it are dropped. returns how many were kept. */
+int sensors_poll_context_t::fuseEvents(sensors_event_t* data, int count) {
+    FusionSensor* const fusionSensor = static_cast<FusionSensor*>(mSensors[fusion]);
+    int kept = 0;
+
+    if (!fusionSensor->isActive())
+        return count;
+    for (int i=0 ; i<count ; i++) {
+        if (data[i].sensor == ID_A || data[i].sensor == ID_M) {
+            fusionSensor->fuse(data[i]);
+            if (!mActive[data[i].sensor])
+                continue;
+        }
+        data[kept++] = data[i];
+    }
+    return kept;
+}
+
+/* the events of the sensors batching are buffered, the others are kept
+ * in data. returns how many were kept. */
+int sensors_poll_context_t::batchEvents(sensors_event_t* data, int count) {
+    int kept = 0;
+    int64_t now = getTimestamp(CLOCK_MONOTONIC);
+
+    pthread_mutex_lock(&mBatchLock);
+    for (int i=0 ; i<count ; i++) {
+        batch_t* batch = &mBatch[data[i].sensor];
+        // once buffered, the events of a sensor are reported in order
+        if (!batch->timeout && !batch->fifo.count()) {
+            data[kept++] = data[i];
+            continue;
+        }
+        if (!batch->fifo.count())
+            batch->deadline = now + batch->timeout;
+        batch->fifo.push(data[i]);
+    }
+    pthread_mutex_unlock(&mBatchLock);
+    return kept;
+}
+
+/* when a batch is due, reports what all the sensors buffered, followed by
+ * the flush complete events asked for. */
+int sensors_poll_context_t::readBatches(sensors_event_t* data, int count) {
+    int64_t now = getTimestamp(CLOCK_MONOTONIC);
+    bool due = false;
+    int nbEvents = 0;
+
+    pthread_mutex_lock(&mBatchLock);
+    for (int i=0 ; i<numHandles ; i++) {
+        batch_t* batch = &mBatch[i];
+        if (batch->flushes ||
+                (batch->fifo.count() && (!batch->timeout || now >= batch->deadline ||
+                                         batch->fifo.count() >= SENSORS_FIFO_WATERMARK)))
+            due = true;
+    }
+
+    for (int i=0 ; due && count && i<numHandles ; i++) {
+        batch_t* batch = &mBatch[i];
+        int nb = batch->fifo.read(data, count);
+        count -= nb;
+        nbEvents += nb;
+        data += nb;
+        // the flush completes once all that was buffered is reported
+        while (batch->flushes && count && !batch->fifo.count()) {
+            memset(data, 0, sizeof(*data));
+            data->version = META_DATA_VERSION;
+            data->type = SENSOR_TYPE_META_DATA;
+            data->meta_data.what = META_DATA_FLUSH_COMPLETE;
+            data->meta_data.sensor = i;
+            batch->flushes--;
+            count--;
+            nbEvents++;
+            data++;
+        }
+    }
+    pthread_mutex_unlock(&mBatchLock);
+    return nbEvents;
+}
+
+/* ms the poll may wait before a batch is due, -1 when none is buffered */
+int sensors_poll_context_t::batchTimeout() {
+    int64_t now = getTimestamp(CLOCK_MONOTONIC);
+    int64_t deadline = -1;
+
+    pthread_mutex_lock(&mBatchLock);
+    for (int i=0 ; i<numHandles ; i++) {
+        batch_t* batch = &mBatch[i];
+        if (batch->flushes)
+            deadline = now;
+        else if (batch->fifo.count() && (deadline < 0 || batch->deadline < deadline))
+            deadline = batch->deadline;
+    }
+    pthread_mutex_unlock(&mBatchLock);
+
+    if (deadline < 0)
+        return -1;
+    if (deadline <= now)
+        return 0;
+    return (int)((deadline - now + 999999) / 1000000);
+}
+
+/* called with mBatchLock held when a report latency changed. the stats
+ * gathered with the shortest latency before are logged. */
+void sensors_poll_context_t::updateStats() {
+    int64_t latency = 0;
+    int64_t now = getTimestamp(CLOCK_MONOTONIC);
+    int64_t elapsed = now - mStats.start;
+
+    for (int i=0 ; i<numHandles ; i++) {
+        if (mBatch[i].timeout && (!latency || mBatch[i].timeout < latency))
+            latency = mBatch[i].timeout;
+    }
+    if (latency == mStats.latency)
+        return;
+
+    if (elapsed >= 1000000000LL && mStats.wakeups) {
+        ALOGI("batch latency %lld ms: %lld.%lld wakeups/s, %lld events/s, %lld us cpu/s"
+              " over %lld s",
+              mStats.latency / 1000000,
+              mStats.wakeups * 1000000000LL / elapsed,
+              mStats.wakeups * 10000000000LL / elapsed % 10,
+              mStats.events * 1000000000LL / elapsed,
+              mStats.cpuTime * 1000 / elapsed,
+              elapsed / 1000000000);
+    }
+    mStats.latency = latency;
+    mStats.start = now;
+    mStats.wakeups = 0;
+    mStats.events = 0;
+    mStats.cpuTime = 0;
+}
+
 int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
 {
     int nbEvents = 0;
     int n = 0;
+    int64_t cpu;
 
     do {
         // see if we have some leftover from the last poll()
@@ -240,19 +557,29 @@ int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
                     // no more data for this sensor
                     mPollFds[i].revents = 0;
                 }
+                if (nb > 0)
+                    nb = fuseEvents(data, nb);
+                if (nb > 0)
+                    nb = batchEvents(data, nb);
                 count -= nb;
                 nbEvents += nb;
                 data += nb;
             }
         }
 
+        int nb = readBatches(data, count);
+        count -= nb;
+        nbEvents += nb;
+        data += nb;
+
         if (count) {
             // we still have some room, so try to see if we can get
             // some events immediately or just wait if we don't have
-            // anything to return
+            // anything to return, or until a batch is due
             //n = poll(mPollFds, numFds, nbEvents ? 0 : -1);
+            int timeout = nbEvents ? 0 : batchTimeout();
 			do {                
-			 	n = poll(mPollFds, numFds, nbEvents ? 0 : -1);            
+			 	n = poll(mPollFds, numFds, timeout);
 			} while (n < 0 && errno == EINTR);
             if (n<0) {
                 ALOGE("poll() failed (%s)", strerror(errno));
@@ -266,8 +593,19 @@ int sensors_poll_context_t::pollEvents(sensors_event_t* data, int count)
                 mPollFds[wake].revents = 0;
             }
         }
-        // if we have events and space, go read them
-    } while (n && count);
+        // if we have events and space, go read them, a batch may be due
+        // when nothing came
+    } while ((n || !nbEvents) && count);
+
+    // the CPU time the poll thread took since it last returned
+    cpu = getTimestamp(CLOCK_THREAD_CPUTIME_ID);
+    pthread_mutex_lock(&mBatchLock);
+    if (mStats.cpuMark)
+        mStats.cpuTime += cpu - mStats.cpuMark;
+    mStats.cpuMark = cpu;
+    mStats.wakeups++;
+    mStats.events += nbEvents;
+    pthread_mutex_unlock(&mBatchLock);
 
     return nbEvents;
 }
@@ -301,6 +639,18 @@ static int poll__poll(struct sensors_poll_device_t *dev,
     return ctx->pollEvents(data, count);
 }
 
+static int poll__batch(struct sensors_poll_device_1 *dev,
+        int handle, int flags, int64_t period_ns, int64_t timeout) {
+    sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+    return ctx->batch(handle, flags, period_ns, timeout);
+}
+
+static int poll__flush(struct sensors_poll_device_1 *dev,
+        int handle) {
+    sensors_poll_context_t *ctx = (sensors_poll_context_t *)dev;
+    return ctx->flush(handle);
+}
+
 /*****************************************************************************/
 
 /** Open a new instance of a sensor device using name */
@@ -310,15 +660,17 @@ static int open_sensors(const struct hw_module_t* module, const char* id,
         int status = -EINVAL;
         sensors_poll_context_t *dev = new sensors_poll_context_t();
 
-        memset(&dev->device, 0, sizeof(sensors_poll_device_t));
+        memset(&dev->device, 0, sizeof(sensors_poll_device_1));
 
         dev->device.common.tag = HARDWARE_DEVICE_TAG;
-        dev->device.common.version  = 0;
+        dev->device.common.version  = SENSORS_DEVICE_API_VERSION_1_1;
         dev->device.common.module   = const_cast<hw_module_t*>(module);
         dev->device.common.close    = poll__close;
         dev->device.activate        = poll__activate;
         dev->device.setDelay        = poll__setDelay;
         dev->device.poll            = poll__poll;
+        dev->device.batch           = poll__batch;
+        dev->device.flush           = poll__flush;
 
         *device = &dev->device.common;
         status = 0;
@@ -42,6 +42,9 @@ __BEGIN_DECLS
 #define ID_P  (5)
 #define ID_T  (6)
 #define ID_PX (7)
+#define ID_RV (8)
+#define ID_GR (9)
+#define ID_LA (10)
 
 #define HWROTATION_0   (0)
 #define HWROTATION_90  (1)
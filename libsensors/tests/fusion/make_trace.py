@@ -0,0 +1,158 @@
+#!/usr/bin/env python
+#
+# Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Writes trace.txt, the accelerometer at 50 Hz and the magnetometer at
+# 10 Hz of a device picked up from a table, tilted, turned by half a
+# circle, shaken and put down again, with the attitude, gravity and linear
+# acceleration it really had. The samples carry the noise and the
+# resolution of the drivers and the time stamps their jitter. Run it from
+# this directory and commit what it writes along with any change to it.
+
+import math
+
+G = 9.80665
+# the resolution of CONVERT_A and CONVERT_M in sensors.h
+LSB_A = G / 0x4000
+LSB_M = 1.0 / 20.0
+# the field in east north up, 48 uT with an inclination of 60 degrees
+FIELD = (0.0, 24.0, -41.6)
+
+seed = [1]
+
+
+def noise(sigma):
+    # the sum of four uniform draws is close enough to a gaussian
+    s = 0.0
+    for i in range(4):
+        seed[0] = (seed[0] * 1103515245 + 12345) & 0xffffffff
+        s += ((seed[0] >> 8) & 0xffff) / 65536.0 - 0.5
+    return s * sigma * math.sqrt(3.0)
+
+
+def ramp(t, t0, t1):
+    # 0 before t0, 1 after t1, a half cosine in between
+    if t <= t0:
+        return 0.0
+    if t >= t1:
+        return 1.0
+    return 0.5 - 0.5 * math.cos(math.pi * (t - t0) / (t1 - t0))
+
+
+# (from, to) in s and what the device does, the angles in degrees
+PHASES = [
+    (0.0, 3.0, 'still'),
+    (3.0, 6.0, 'turn'),     # picked up: pitch 0 to 35
+    (6.0, 9.0, 'still'),
+    (9.0, 15.0, 'turn'),    # yaw 0 to 180
+    (15.0, 18.0, 'still'),
+    (18.0, 21.0, 'shake'),  # 3 m/s2 at 2 Hz along east
+    (21.0, 24.0, 'still'),
+    (24.0, 27.0, 'turn'),   # roll 0 to -20, pitch back to 10
+    (27.0, 30.0, 'still'),
+]
+
+
+def phase(t):
+    for t0, t1, what in PHASES:
+        if t0 <= t < t1:
+            return what
+    return 'still'
+
+
+def pose(t):
+    yaw = 180.0 * ramp(t, 9.0, 15.0)
+    pitch = 35.0 * ramp(t, 3.0, 6.0) - 25.0 * ramp(t, 24.0, 27.0)
+    roll = -20.0 * ramp(t, 24.0, 27.0)
+    lin = (0.0, 0.0, 0.0)
+    if 18.0 <= t < 21.0:
+        lin = (3.0 * math.sin(2.0 * math.pi * 2.0 * (t - 18.0)), 0.0, 0.0)
+    return yaw, pitch, roll, lin
+
+
+def matrix(yaw, pitch, roll):
+    # device to world: yaw about up, then pitch about the device x axis,
+    # then roll about its y axis
+    cy, sy = math.cos(math.radians(yaw)), math.sin(math.radians(yaw))
+    cp, sp = math.cos(math.radians(pitch)), math.sin(math.radians(pitch))
+    cr, sr = math.cos(math.radians(roll)), math.sin(math.radians(roll))
+    z = [[cy, -sy, 0.0], [sy, cy, 0.0], [0.0, 0.0, 1.0]]
+    x = [[1.0, 0.0, 0.0], [0.0, cp, -sp], [0.0, sp, cp]]
+    y = [[cr, 0.0, sr], [0.0, 1.0, 0.0], [-sr, 0.0, cr]]
+    return mul(mul(z, x), y)
+
+
+def mul(a, b):
+    return [[sum(a[i][k] * b[k][j] for k in range(3)) for j in range(3)] for i in range(3)]
+
+
+def to_device(r, v):
+    # the transpose takes the world into the device
+    return [sum(r[k][i] * v[k] for k in range(3)) for i in range(3)]
+
+
+def quaternion(r):
+    w = math.sqrt(max(0.0, 1.0 + r[0][0] + r[1][1] + r[2][2])) / 2.0
+    x = math.copysign(math.sqrt(max(0.0, 1.0 + r[0][0] - r[1][1] - r[2][2])) / 2.0,
+                      r[2][1] - r[1][2])
+    y = math.copysign(math.sqrt(max(0.0, 1.0 - r[0][0] + r[1][1] - r[2][2])) / 2.0,
+                      r[0][2] - r[2][0])
+    z = math.copysign(math.sqrt(max(0.0, 1.0 - r[0][0] - r[1][1] + r[2][2])) / 2.0,
+                      r[1][0] - r[0][1])
+    return x, y, z, w
+
+
+def quantize(v, lsb):
+    return [round(x / lsb) * lsb for x in v]
+
+
+def main():
+    lines = [
+        '# A ns x y z  qx qy qz qw  gx gy gz  lx ly lz  phase',
+        '#   an accelerometer sample in m/s2, then the attitude, gravity and',
+        '#   linear acceleration the device had',
+        '# M ns x y z',
+        '#   a magnetometer sample in uT',
+    ]
+    events = []
+    for i in range(30 * 50):
+        t = i / 50.0 + noise(0.001)
+        yaw, pitch, roll, lin = pose(t)
+        r = matrix(yaw, pitch, roll)
+        g = to_device(r, (0.0, 0.0, G))
+        l = to_device(r, lin)
+        a = quantize([g[k] + l[k] + noise(0.05) for k in range(3)], LSB_A)
+        q = quaternion(r)
+        events.append((int(t * 1e9) + 1000000000,
+                       'A %%d %s  %s  %s  %s  %s' % (
+                           ' '.join('%.4f' % x for x in a),
+                           ' '.join('%.5f' % x for x in q),
+                           ' '.join('%.4f' % x for x in g),
+                           ' '.join('%.4f' % x for x in l),
+                           phase(t))))
+    for i in range(30 * 10):
+        t = i / 10.0 + 0.005 + noise(0.001)
+        yaw, pitch, roll, lin = pose(t)
+        m = to_device(matrix(yaw, pitch, roll), FIELD)
+        m = quantize([m[k] + noise(0.4) for k in range(3)], LSB_M)
+        events.append((int(t * 1e9) + 1000000000,
+                       'M %%d %s' % ' '.join('%.2f' % x for x in m)))
+    events.sort(key=lambda e: e[0])
+    lines += [fmt % ns for ns, fmt in events]
+    with open('trace.txt', 'w') as f:
+        f.write('\n'.join(lines) + '\n')
+
+
+main()
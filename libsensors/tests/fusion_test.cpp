@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * FusionSensor replaying tests/fusion/trace.txt, a device tilted, turned
+ * by half a circle, shaken and put down, against the attitude, gravity and
+ * linear acceleration it really had. The errors are averaged over each
+ * phase of the trace: still, turning and shaken. The rotation vector must
+ * follow the turn, there is no gyro to hold the heading so it is the
+ * field's or none. The CPU time of an update is checked against the
+ * budget of FusionSensor.cpp, a host being faster than any i.MX.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "FusionSensor.h"
+#include "imx_test.h"
+
+/* FUSION_BUDGET_NS of FusionSensor.cpp */
+#define TEST_BUDGET_NS  50000
+
+static char sDir[PATH_MAX];
+
+enum {
+    PHASE_STILL,
+    PHASE_TURN,
+    PHASE_SHAKE,
+    PHASES,
+};
+
+static const char* const sPhases[PHASES] = { "still", "turn", "shake" };
+
+/* the mean errors allowed in each phase: rotation vector and gravity
+ * direction in degrees, linear acceleration in m/s2. shaken, the gravity
+ * filter slows down and leaves more of the motion in gravity. */
+static const float sMaxRv[PHASES] = { 1.5f, 6.0f, 6.0f };
+static const float sMaxGravity[PHASES] = { 0.5f, 3.0f, 4.0f };
+static const float sMaxLinear[PHASES] = { 0.15f, 0.5f, 0.7f };
+
+struct test_error {
+    double rv, gravity, linear;
+    unsigned int samples, rvs;
+};
+
+static struct test_error sErrors[PHASES];
+
+static float test_angle(const float* a, const float* b)
+{
+    float dot = a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+    float na = sqrtf(a[0]*a[0] + a[1]*a[1] + a[2]*a[2]);
+    float nb = sqrtf(b[0]*b[0] + b[1]*b[1] + b[2]*b[2]);
+    float c = dot / (na * nb);
+    if (c > 1.0f)
+        c = 1.0f;
+    return acosf(c < -1.0f ? -1.0f : c) * 180.0f / float(M_PI);
+}
+
+static float test_rotation(const float* a, const float* b)
+{
+    float dot = fabsf(a[0]*b[0] + a[1]*b[1] + a[2]*b[2] + a[3]*b[3]);
+    return 2.0f * acosf(dot > 1.0f ? 1.0f : dot) * 180.0f / float(M_PI);
+}
+
+/* the events one sample gave, against what the trace says the device had */
+static void test_score(const sensors_event_t* events, int count, const float* q,
+                       const float* g, const float* l, int phase, bool* rv_seen)
+{
+    struct test_error* e = &sErrors[phase];
+    bool has_gravity = false, has_linear = false;
+
+    for (int i = 0; i < count; i++) {
+        const sensors_event_t* ev = &events[i];
+        switch (ev->sensor) {
+        case ID_GR: {
+            CHECK(ev->type == SENSOR_TYPE_GRAVITY, "handle %d has type %d", ID_GR, ev->type);
+            e->gravity += test_angle(ev->acceleration.v, g);
+            has_gravity = true;
+            break;
+        }
+        case ID_LA: {
+            CHECK(ev->type == SENSOR_TYPE_LINEAR_ACCELERATION, "handle %d has type %d",
+                  ID_LA, ev->type);
+            float d[3] = {
+                ev->acceleration.v[0] - l[0],
+                ev->acceleration.v[1] - l[1],
+                ev->acceleration.v[2] - l[2],
+            };
+            e->linear += sqrtf(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]);
+            has_linear = true;
+            break;
+        }
+        case ID_RV:
+            CHECK(ev->type == SENSOR_TYPE_ROTATION_VECTOR, "handle %d has type %d",
+                  ID_RV, ev->type);
+            CHECK(ev->data[3] >= 0.0f, "rotation vector with w %f", ev->data[3]);
+            CHECK(ev->data[4] == -1.0f, "rotation vector with accuracy %f", ev->data[4]);
+            e->rv += test_rotation(ev->data, q);
+            e->rvs++;
+            *rv_seen = true;
+            break;
+        default:
+            CHECK(0, "event of handle %d type %d", ev->sensor, ev->type);
+        }
+    }
+    CHECK(has_gravity && has_linear, "sample without gravity or linear acceleration");
+    e->samples++;
+}
+
+static int test_replay(FusionSensor& fusion, FILE* f, int64_t* cpu, int64_t* max_cpu,
+                       unsigned int* updates)
+{
+    char line[256], phase[16];
+    sensors_event_t events[16];
+    bool rv_seen = false;
+
+    while (fgets(line, sizeof(line), f)) {
+        sensors_event_t ev;
+        long long ns;
+        float q[4], g[3], l[3];
+        int p;
+
+        if (line[0] == '#')
+            continue;
+        memset(&ev, 0, sizeof(ev));
+        ev.version = sizeof(sensors_event_t);
+        if (line[0] == 'M') {
+            if (sscanf(line, "M %lld %f %f %f", &ns, &ev.magnetic.v[0], &ev.magnetic.v[1],
+                       &ev.magnetic.v[2]) != 4) {
+                CHECK(0, "bad line: %s", line);
+                return -1;
+            }
+            ev.sensor = ID_M;
+            ev.type = SENSOR_TYPE_MAGNETIC_FIELD;
+            ev.magnetic.status = SENSOR_STATUS_ACCURACY_HIGH;
+            ev.timestamp = ns;
+            fusion.fuse(ev);
+            CHECK(!fusion.hasPendingEvents(), "events for a magnetometer sample");
+            continue;
+        }
+        if (sscanf(line, "A %lld %f %f %f %f %f %f %f %f %f %f %f %f %f %15s", &ns,
+                   &ev.acceleration.v[0], &ev.acceleration.v[1], &ev.acceleration.v[2],
+                   &q[0], &q[1], &q[2], &q[3], &g[0], &g[1], &g[2], &l[0], &l[1], &l[2],
+                   phase) != 15) {
+            CHECK(0, "bad line: %s", line);
+            return -1;
+        }
+        for (p = 0; p < PHASES && strcmp(phase, sPhases[p]); p++);
+        if (p == PHASES) {
+            CHECK(0, "bad phase: %s", phase);
+            return -1;
+        }
+        ev.sensor = ID_A;
+        ev.type = SENSOR_TYPE_ACCELEROMETER;
+        ev.acceleration.status = SENSOR_STATUS_ACCURACY_HIGH;
+        ev.timestamp = ns;
+
+        int64_t start = imx_test_ns(CLOCK_THREAD_CPUTIME_ID);
+        fusion.fuse(ev);
+        int64_t used = imx_test_ns(CLOCK_THREAD_CPUTIME_ID) - start;
+        *cpu += used;
+        if (used > *max_cpu)
+            *max_cpu = used;
+        (*updates)++;
+
+        int count = fusion.readEvents(events, sizeof(events) / sizeof(events[0]));
+        CHECK(count >= 2 && count <= 3, "%d events for a sample", count);
+        test_score(events, count, q, g, l, p, &rv_seen);
+        // once there is a field there is a rotation vector for every sample
+        CHECK(!rv_seen || count == 3, "no rotation vector at %lld", ns);
+    }
+    return 0;
+}
+
+/* the handles the fusion answers to, and that nothing of it is computed
+ * for a sensor that is not enabled */
+static void test_handles()
+{
+    FusionSensor fusion;
+    sensors_event_t ev, out[4];
+
+    CHECK(fusion.setEnable(ID_LA + 1, 1) == -EINVAL, "handle %d after linear acceleration",
+          ID_LA + 1);
+    CHECK(fusion.setEnable(ID_A, 1) == -EINVAL, "accelerometer handle");
+    CHECK(!fusion.isActive(), "active without a sensor");
+
+    CHECK(fusion.setEnable(ID_GR, 1) == 0, "enable gravity");
+    CHECK(fusion.getEnable(ID_GR) == 1, "gravity not enabled");
+    CHECK(fusion.getEnable(ID_RV) == 0 && fusion.getEnable(ID_LA) == 0,
+          "gravity enabled another sensor");
+
+    memset(&ev, 0, sizeof(ev));
+    ev.sensor = ID_M;
+    ev.type = SENSOR_TYPE_MAGNETIC_FIELD;
+    ev.magnetic.v[1] = 24.0f;
+    ev.magnetic.v[2] = -41.6f;
+    ev.timestamp = 1000000000LL;
+    fusion.fuse(ev);
+    ev.sensor = ID_A;
+    ev.type = SENSOR_TYPE_ACCELEROMETER;
+    ev.acceleration.v[1] = 0.0f;
+    ev.acceleration.v[2] = GRAVITY_EARTH;
+    ev.timestamp += 20000000LL;
+    fusion.fuse(ev);
+    CHECK(fusion.readEvents(out, 4) == 1 && out[0].sensor == ID_GR &&
+          out[0].type == SENSOR_TYPE_GRAVITY, "handle %d is not gravity alone", ID_GR);
+
+    fusion.setEnable(ID_GR, 0);
+    CHECK(!fusion.isActive(), "active once disabled");
+    ev.timestamp += 20000000LL;
+    fusion.fuse(ev);
+    CHECK(!fusion.hasPendingEvents(), "events once disabled");
+}
+
+int main(int argc, char** argv)
+{
+    char path[PATH_MAX];
+    int64_t cpu = 0, max_cpu = 0;
+    unsigned int updates = 0;
+
+    imx_test_path(sDir, sizeof(sDir), argc, argv, "libsensors/tests/fusion");
+
+    test_handles();
+
+    snprintf(path, sizeof(path), "%s/trace.txt", sDir);
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        CHECK(0, "%s: %s", path, strerror(errno));
+    } else {
+        FusionSensor fusion;
+        fusion.setEnable(ID_RV, 1);
+        fusion.setEnable(ID_GR, 1);
+        fusion.setEnable(ID_LA, 1);
+        test_replay(fusion, f, &cpu, &max_cpu, &updates);
+        fclose(f);
+        fusion.setEnable(ID_RV, 0);
+        fusion.setEnable(ID_GR, 0);
+        fusion.setEnable(ID_LA, 0);
+    }
+
+    for (int p = 0; p < PHASES; p++) {
+        const struct test_error* e = &sErrors[p];
+        if (!e->samples) {
+            CHECK(0, "no %s samples", sPhases[p]);
+            continue;
+        }
+        float rv = e->rvs ? e->rv / e->rvs : 180.0f;
+        float gravity = e->gravity / e->samples;
+        float linear = e->linear / e->samples;
+        printf("%-5s %4u samples: rotation vector %5.2f deg, gravity %5.2f deg,"
+               " linear acceleration %5.3f m/s2\n", sPhases[p], e->samples, rv, gravity, linear);
+        CHECK(e->rvs + 5 >= e->samples, "%s: %u rotation vectors for %u samples", sPhases[p],
+              e->rvs, e->samples);
+        CHECK(rv <= sMaxRv[p], "%s: rotation vector off by %.2f deg", sPhases[p], rv);
+        CHECK(gravity <= sMaxGravity[p], "%s: gravity off by %.2f deg", sPhases[p], gravity);
+        CHECK(linear <= sMaxLinear[p], "%s: linear acceleration off by %.3f m/s2",
+              sPhases[p], linear);
+    }
+    if (updates) {
+        printf("cpu %lld/%lld ns per update (average/max), budget %d ns\n",
+               (long long)(cpu / updates), (long long)max_cpu, TEST_BUDGET_NS);
+        CHECK(cpu / updates <= TEST_BUDGET_NS, "%lld ns per update",
+              (long long)(cpu / updates));
+    }
+
+    return imx_test_result("fusion_test");
+}
@@ -25,9 +25,55 @@ LOCAL_SRC_FILES := \
 LOCAL_C_INCLUDES += \
 	external/tinyalsa/include \
 	external/expat/lib \
-	$(call include-path-for, audio-utils)
+	$(call include-path-for, audio-utils) \
+	hardware/imx/libaudioconv
 LOCAL_SHARED_LIBRARIES := liblog libcutils libtinyalsa libaudioutils libexpat
+LOCAL_STATIC_LIBRARIES := libimxaudioconv
 LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_SHARED_LIBRARY)
 
+
+# value ioctls and time of a start and of routing changes on a fake mixer,
+# run on the host: out/host/<os>-<arch>/bin/audio_route_bench
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := \
+	audio_route.c \
+	../../libaudioconv/tests/mixer_fake.c \
+	tests/audio_route_bench.c
+LOCAL_C_INCLUDES += \
+	external/tinyalsa/include \
+	external/expat/lib \
+	$(LOCAL_PATH)/../../libaudioconv/tests \
+	hardware/imx/libimxtest
+LOCAL_CFLAGS := -DMIXER_XML_PATH=\"mixer_paths.xml\" -DMIXER_CACHE_PATH=\"mixer_paths.bin\"
+LOCAL_STATIC_LIBRARIES := libexpat liblog libcutils libimxtest_host
+LOCAL_LDLIBS := -lrt -lpthread
+LOCAL_MODULE := audio_route_bench
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
+
+# CPU time, lock waits, xrun recovery and latency of the output and the
+# input on a fake tinyalsa with the codec of tests/mixer, run on the host:
+# out/host/<os>-<arch>/bin/audio_hal_harness [fixtures] [seconds] [stream]
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := \
+	audio_hw.c \
+	audio_route.c \
+	../../libaudioconv/tests/pcm_fake.c \
+	../../libaudioconv/tests/mixer_fake.c \
+	../../libaudioconv/tests/audio_hal_harness.c \
+	tests/harness_mx5x.c
+LOCAL_C_INCLUDES += \
+	external/tinyalsa/include \
+	external/expat/lib \
+	$(call include-path-for, audio-utils) \
+	hardware/imx/libaudioconv \
+	$(LOCAL_PATH)/../../libaudioconv/tests \
+	hardware/imx/libimxtest
+LOCAL_CFLAGS := -DMIXER_XML_PATH=\"mixer_paths.xml\" -DMIXER_CACHE_PATH=\"mixer_paths.bin\"
+LOCAL_STATIC_LIBRARIES := libexpat liblog libcutils libimxaudioconv_host libimxtest_host
+LOCAL_LDLIBS := -lrt -lpthread -lm
+LOCAL_MODULE := audio_hal_harness
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
@@ -22,8 +22,13 @@
 #include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include <sys/time.h>
 
+#include <cutils/atomic.h>
 #include <cutils/log.h>
 #include <cutils/properties.h>
 #include <cutils/str_parms.h>
@@ -37,7 +42,10 @@
 
 #include <audio_utils/resampler.h>
 
+#include "audio_conv.h"
+#include "audio_resampler.h"
 #include "audio_route.h"
+#include "stream_stats.h"
 
 #define PCM_CARD 0
 #define PCM_DEVICE 0
@@ -105,6 +113,7 @@ struct audio_device {
     struct audio_route *ar;
     int orientation;
     bool screen_off;
+    volatile int32_t state_seq; /* bumped when the output state below changes */
 
     struct stream_out *active_out;
     struct stream_in *active_in;
@@ -114,6 +123,7 @@ struct stream_out {
     struct audio_stream_out stream;
 
     pthread_mutex_t lock; /* see note below on mutex acquisition order */
+    volatile int32_t control_seq; /* odd while a control thread waits for lock */
     struct pcm *pcm;
     struct pcm_config *pcm_config;
     bool standby;
@@ -125,6 +135,10 @@ struct stream_out {
     int write_threshold;
     int cur_write_threshold;
     int buffer_type;
+    bool sco_on;
+    int32_t state_seq;    /* of the device state buffer_type and sco_on follow */
+
+    struct stream_stats stats;
 
     struct audio_device *dev;
 };
@@ -145,6 +159,8 @@ struct stream_in {
     size_t frames_in;
     int read_status;
 
+    struct stream_stats stats;
+
     struct audio_device *dev;
 };
 
@@ -170,10 +186,34 @@ static void release_buffer(struct resampler_buffer_provider *buffer_provider,
  * NOTE: when multiple mutexes have to be acquired, always take the
  * audio_device mutex first, followed by the stream_in and/or
  * stream_out mutexes.
+ *
+ * A running stream_out is written holding its own mutex only. A thread
+ * holding the audio_device mutex takes it with out_lock(), which leaves
+ * control_seq odd while it waits, so that the next write goes through
+ * the audio_device mutex and hands the stream over. The write also goes
+ * through it when state_seq tells the device state it follows changed.
  */
 
 /* Helper functions */
 
+static void out_lock(struct stream_out *out)
+{
+    android_atomic_inc(&out->control_seq);
+    pthread_mutex_lock(&out->lock);
+}
+
+static void out_unlock(struct stream_out *out)
+{
+    android_atomic_inc(&out->control_seq);
+    pthread_mutex_unlock(&out->lock);
+}
+
+/* the screen, the active input or the output device changed */
+static void adev_state_changed(struct audio_device *adev)
+{
+    android_atomic_inc(&adev->state_seq);
+}
+
 static void select_devices(struct audio_device *adev)
 {
     int headphone_on;
@@ -210,7 +250,7 @@ static void do_out_standby(struct stream_out *out)
         out->pcm = NULL;
         adev->active_out = NULL;
         if (out->resampler) {
-            release_resampler(out->resampler);
+            audio_resampler_release(out->resampler);
             out->resampler = NULL;
         }
         if (out->buffer) {
@@ -230,8 +270,9 @@ static void do_in_standby(struct stream_in *in)
         pcm_close(in->pcm);
         in->pcm = NULL;
         adev->active_in = NULL;
+        adev_state_changed(adev);
         if (in->resampler) {
-            release_resampler(in->resampler);
+            audio_resampler_release(in->resampler);
             in->resampler = NULL;
         }
         if (in->buffer) {
@@ -295,7 +336,7 @@ static int start_output_stream(struct stream_out *out)
      * create a resampler.
      */
     if (out_get_sample_rate(&out->stream.common) != out->pcm_config->rate) {
-        ret = create_resampler(out_get_sample_rate(&out->stream.common),
+        ret = audio_resampler_create(out_get_sample_rate(&out->stream.common),
                                out->pcm_config->rate,
                                out->pcm_config->channels,
                                RESAMPLER_QUALITY_DEFAULT,
@@ -341,13 +382,13 @@ static int start_input_stream(struct stream_in *in)
      */
     if (adev->active_out) {
         struct stream_out *out = adev->active_out;
-        pthread_mutex_lock(&out->lock);
+        out_lock(out);
         if (((in->pcm_config->rate % 8000 == 0) &&
                  (out->pcm_config->rate % 8000) != 0) ||
                  ((in->pcm_config->rate % 11025 == 0) &&
                  (out->pcm_config->rate % 11025) != 0))
             do_out_standby(out);
-        pthread_mutex_unlock(&out->lock);
+        out_unlock(out);
     }
 
     in->pcm = pcm_open(PCM_CARD, device, PCM_IN, in->pcm_config);
@@ -366,7 +407,7 @@ static int start_input_stream(struct stream_in *in)
         in->buf_provider.get_next_buffer = get_next_buffer;
         in->buf_provider.release_buffer = release_buffer;
 
-        ret = create_resampler(in->pcm_config->rate,
+        ret = audio_resampler_create(in->pcm_config->rate,
                                in_get_sample_rate(&in->stream.common),
                                1,
                                RESAMPLER_QUALITY_DEFAULT,
@@ -379,6 +420,7 @@ static int start_input_stream(struct stream_in *in)
     in->frames_in = 0;
 
     adev->active_in = in;
+    adev_state_changed(adev);
 
     return 0;
 }
@@ -519,16 +561,35 @@ static int out_standby(struct audio_stream *stream)
     struct stream_out *out = (struct stream_out *)stream;
 
     pthread_mutex_lock(&out->dev->lock);
-    pthread_mutex_lock(&out->lock);
+    out_lock(out);
     do_out_standby(out);
-    pthread_mutex_unlock(&out->lock);
+    out_unlock(out);
     pthread_mutex_unlock(&out->dev->lock);
 
     return 0;
 }
 
+static void dump_resampler(struct resampler_itfe *resampler, int fd)
+{
+    struct audio_resampler_stats stats;
+    char buffer[160];
+
+    audio_resampler_get_stats(resampler, &stats);
+    snprintf(buffer, sizeof(buffer),
+             "  resampler: %u taps x %u phases, delay %d us, %llu frames, %llu ns per frame\n",
+             stats.taps, stats.phases, stats.delay_ns / 1000,
+             (unsigned long long)stats.frames,
+             (unsigned long long)(stats.frames ? stats.cpu_ns / stats.frames : 0));
+    write(fd, buffer, strlen(buffer));
+}
+
 static int out_dump(const struct audio_stream *stream, int fd)
 {
+    struct stream_out *out = (struct stream_out *)stream;
+
+    if (out->resampler)
+        dump_resampler(out->resampler, fd);
+    stream_stats_dump(&out->stats, "write", fd);
     return 0;
 }
 
@@ -555,12 +616,13 @@ static int out_set_parameters(struct audio_stream *stream, const char *kvpairs)
              */
             if ((val & AUDIO_DEVICE_OUT_ALL_SCO) ^
                     (adev->out_device & AUDIO_DEVICE_OUT_ALL_SCO)) {
-                pthread_mutex_lock(&out->lock);
+                out_lock(out);
                 do_out_standby(out);
-                pthread_mutex_unlock(&out->lock);
+                out_unlock(out);
             }
 
             adev->out_device = val;
+            adev_state_changed(adev);
             select_devices(adev);
         }
     }
@@ -599,6 +661,39 @@ static int out_set_volume(struct audio_stream_out *stream, float left,
     return -ENOSYS;
 }
 
+/* how long the frames just written wait in the pcm before they are heard.
+ * the pcm is opened without PCM_MONOTONIC, its stamps are wall clock. */
+static void out_stats_latency(struct stream_out *out, struct stream_stats_call *call)
+{
+    unsigned int avail;
+    struct timespec stamp, now;
+    int64_t ns;
+
+    if (pcm_get_htimestamp(out->pcm, &avail, &stamp) < 0)
+        return;
+    clock_gettime(CLOCK_REALTIME, &now);
+    ns = (int64_t)(stamp.tv_sec - now.tv_sec) * 1000000000 + stamp.tv_nsec - now.tv_nsec +
+         (int64_t)(pcm_get_buffer_size(out->pcm) - avail) * 1000000000 / out->pcm_config->rate;
+    call->latency_ns = ns > 0 ? ns : 0;
+}
+
+/* takes the mutexes for a write: the stream_out mutex alone while it
+ * runs, no control thread waits for it and the device state it follows is
+ * unchanged, the audio_device mutex as well otherwise. returns whether the
+ * audio_device mutex is held. */
+static bool out_lock_write(struct stream_out *out, struct stream_stats_call *call)
+{
+    stream_stats_lock(call, STREAM_STATS_STREAM, &out->lock);
+    if (!out->standby && !(android_atomic_acquire_load(&out->control_seq) & 1) &&
+            out->state_seq == android_atomic_acquire_load(&out->dev->state_seq))
+        return false;
+
+    pthread_mutex_unlock(&out->lock);
+    stream_stats_lock(call, STREAM_STATS_ADEV, &out->dev->lock);
+    stream_stats_lock(call, STREAM_STATS_STREAM, &out->lock);
+    return true;
+}
+
 static ssize_t out_write(struct audio_stream_out *stream, const void* buffer,
                          size_t bytes)
 {
@@ -610,30 +705,36 @@ static ssize_t out_write(struct audio_stream_out *stream, const void* buffer,
     size_t in_frames = bytes / frame_size;
     size_t out_frames;
     int buffer_type;
-    int kernel_frames;
+    int kernel_frames = 0;  /* a pcm not started yet has no time stamp */
     bool sco_on;
+    struct stream_stats_call call;
     //ALOGE("%s (), %s:%d", __FUNCTION__, __FILE__, __LINE__);
 
     /*
-     * acquiring hw device mutex systematically is useful if a low
-     * priority thread is waiting on the output stream mutex - e.g.
-     * executing out_set_parameters() while holding the hw device
-     * mutex
+     * the hw device mutex is only taken to start the output, to follow
+     * a change of the device state, or to hand the output stream mutex
+     * over to a thread waiting for it while holding the hw device
+     * mutex - e.g. executing out_set_parameters()
      */
-    pthread_mutex_lock(&adev->lock);
-    pthread_mutex_lock(&out->lock);
-    if (out->standby) {
-        ret = start_output_stream(out);
-        if (ret != 0) {
-            pthread_mutex_unlock(&adev->lock);
-            goto exit;
+    stream_stats_begin(&call);
+    if (out_lock_write(out, &call)) {
+        if (out->standby) {
+            ret = start_output_stream(out);
+            if (ret != 0) {
+                pthread_mutex_unlock(&adev->lock);
+                goto exit;
+            }
+            out->standby = false;
         }
-        out->standby = false;
+        out->state_seq = android_atomic_acquire_load(&adev->state_seq);
+        out->sco_on = (adev->out_device & AUDIO_DEVICE_OUT_ALL_SCO);
+        buffer_type = (adev->screen_off && !adev->active_in) ?
+                OUT_BUFFER_TYPE_LONG : OUT_BUFFER_TYPE_SHORT;
+        pthread_mutex_unlock(&adev->lock);
+    } else {
+        buffer_type = out->buffer_type;
     }
-    buffer_type = (adev->screen_off && !adev->active_in) ?
-            OUT_BUFFER_TYPE_LONG : OUT_BUFFER_TYPE_SHORT;
-    sco_on = (adev->out_device & AUDIO_DEVICE_OUT_ALL_SCO);
-    pthread_mutex_unlock(&adev->lock);
+    sco_on = out->sco_on;
 
     /* detect changes in screen ON/OFF state and adapt buffer size
      * if needed. Do not change buffer size when routed to SCO device. */
@@ -655,11 +756,7 @@ static ssize_t out_write(struct audio_stream_out *stream, const void* buffer,
     /* Reduce number of channels, if necessary */
     if (popcount(out_get_channels(&stream->common)) >
                  (int)out->pcm_config->channels) {
-        unsigned int i;
-
-        /* Discard right channel */
-        for (i = 1; i < in_frames; i++)
-            in_buffer[i] = in_buffer[i * 2];
+        audio_conv_stereo_to_mono(in_buffer, in_buffer, in_frames);
 
         /* The frame size is now half */
         frame_size /= 2;
@@ -738,8 +835,13 @@ static ssize_t out_write(struct audio_stream_out *stream, const void* buffer,
     if (ret == -EPIPE) {
         /* In case of underrun, don't sleep since we want to catch up asap */
         pthread_mutex_unlock(&out->lock);
+        stream_stats_xrun(&call);
+        stream_stats_end(&out->stats, &call, bytes / audio_stream_frame_size(&stream->common),
+                         out_get_sample_rate(&stream->common), ret);
         return ret;
     }
+    if (ret == 0)
+        out_stats_latency(out, &call);
 
 exit:
     pthread_mutex_unlock(&out->lock);
@@ -749,6 +851,8 @@ exit:
                out_get_sample_rate(&stream->common));
     }
 
+    stream_stats_end(&out->stats, &call, bytes / audio_stream_frame_size(&stream->common),
+                     out_get_sample_rate(&stream->common), ret);
     return bytes;
 }
 
@@ -834,6 +938,11 @@ static int in_standby(struct audio_stream *stream)
 
 static int in_dump(const struct audio_stream *stream, int fd)
 {
+    struct stream_in *in = (struct stream_in *)stream;
+
+    if (in->resampler)
+        dump_resampler(in->resampler, fd);
+    stream_stats_dump(&in->stats, "read", fd);
     return 0;
 }
 
@@ -886,6 +995,21 @@ static int in_set_gain(struct audio_stream_in *stream, float gain)
     return 0;
 }
 
+/* how long ago the frames just read were captured */
+static void in_stats_latency(struct stream_in *in, struct stream_stats_call *call)
+{
+    unsigned int avail;
+    struct timespec stamp, now;
+    int64_t ns;
+
+    if (pcm_get_htimestamp(in->pcm, &avail, &stamp) < 0)
+        return;
+    clock_gettime(CLOCK_REALTIME, &now);
+    ns = (int64_t)(now.tv_sec - stamp.tv_sec) * 1000000000 + now.tv_nsec - stamp.tv_nsec +
+         (int64_t)(avail + in->frames_in) * 1000000000 / in->pcm_config->rate;
+    call->latency_ns = ns > 0 ? ns : 0;
+}
+
 static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
                        size_t bytes)
 {
@@ -893,6 +1017,7 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
     struct stream_in *in = (struct stream_in *)stream;
     struct audio_device *adev = in->dev;
     size_t frames_rq = bytes / audio_stream_frame_size(&stream->common);
+    struct stream_stats_call call;
 
     /*
      * acquiring hw device mutex systematically is useful if a low
@@ -900,8 +1025,9 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
      * executing in_set_parameters() while holding the hw device
      * mutex
      */
-    pthread_mutex_lock(&adev->lock);
-    pthread_mutex_lock(&in->lock);
+    stream_stats_begin(&call);
+    stream_stats_lock(&call, STREAM_STATS_ADEV, &adev->lock);
+    stream_stats_lock(&call, STREAM_STATS_STREAM, &in->lock);
     if (in->standby) {
         ret = start_input_stream(in);
         if (ret == 0)
@@ -943,12 +1069,16 @@ static ssize_t in_read(struct audio_stream_in *stream, void* buffer,
     if (ret == 0 && adev->mic_mute)
         memset(buffer, 0, bytes);
 
+    if (ret == 0)
+        in_stats_latency(in, &call);
+
 exit:
     if (ret < 0)
         usleep(bytes * 1000000 / audio_stream_frame_size(&stream->common) /
                in_get_sample_rate(&stream->common));
 
     pthread_mutex_unlock(&in->lock);
+    stream_stats_end(&in->stats, &call, frames_rq, in_get_sample_rate(&stream->common), ret);
     return bytes;
 }
 
@@ -1072,6 +1202,7 @@ static int adev_set_parameters(struct audio_hw_device *dev, const char *kvpairs)
             adev->screen_off = false;
         else
             adev->screen_off = true;
+        adev_state_changed(adev);
     }
 
     str_parms_destroy(parms);
@@ -21,28 +21,54 @@
 
 #include <errno.h>
 #include <expat.h>
+#include <fcntl.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <cutils/log.h>
 
 #include <tinyalsa/asoundlib.h>
 
 #define BUF_SIZE 1024
-#define MIXER_XML_PATH "/system/etc/mixer_paths.xml"
 #define INITIAL_MIXER_PATH_SIZE 8
 
+/* the host benchmark has both in its own directory */
+#ifndef MIXER_XML_PATH
+#define MIXER_XML_PATH "/system/etc/mixer_paths.xml"
+#endif
+
+/* the paths compiled from MIXER_XML_PATH, for the next start to skip
+ * parsing it, which takes longer than opening the mixer */
+#ifndef MIXER_CACHE_PATH
+#define MIXER_CACHE_PATH "/data/misc/audio/mixer_paths.bin"
+#endif
+#define MIXER_CACHE_MAGIC 0x5054584d    /* "MXTP" */
+#define MIXER_CACHE_VERSION 2
+
+/* values of a control written in one ioctl, the others go one by one */
+#define MAX_BATCH_VALUES 16
+
 #define MIXER_CARD 0
 
 struct mixer_state {
     struct mixer_ctl *ctl;
+    enum mixer_ctl_type type;
+    unsigned int num_values;
+    bool used;                  /* set by a path, its value is tracked */
+    bool dirty;                 /* new_value set since the last update */
     int old_value;
     int new_value;
     int reset_value;
 };
 
+/* ctl is the index of the control in the mixer and in mixer_state */
 struct mixer_setting {
-    struct mixer_ctl *ctl;
+    unsigned int ctl;
     int value;
 };
 
@@ -56,11 +82,49 @@ struct mixer_path {
 struct audio_route {
     struct mixer *mixer;
     unsigned int num_mixer_ctls;
+    uint32_t ctl_names_hash;
     struct mixer_state *mixer_state;
+    unsigned int *used;         /* indexes of the controls the paths set */
+    unsigned int num_used;
+    unsigned int *dirty;        /* indexes of the controls to update */
+    unsigned int num_dirty;
 
     unsigned int mixer_path_size;
     unsigned int num_mixer_paths;
     struct mixer_path *mixer_path;
+    struct mixer_path initial;  /* top level ctls of the xml */
+};
+
+/* layout of MIXER_CACHE_PATH: the header, then the arrays in the order
+ * of their counts, then the strings. Names are offsets in the strings. */
+struct cache_header {
+    uint32_t magic;
+    uint32_t version;
+    int64_t xml_mtime;          /* of the xml compiled */
+    int64_t xml_size;
+    uint32_t num_mixer_ctls;    /* of the mixer the indexes are valid for */
+    uint32_t ctl_names_hash;    /* of all its controls, not only those used */
+    uint32_t num_ctls;
+    uint32_t num_paths;         /* the initial values first, unnamed */
+    uint32_t num_settings;
+    uint32_t strings_size;
+};
+
+/* each control the settings use, named so a driver change is seen */
+struct cache_ctl {
+    uint32_t index;
+    uint32_t name;
+};
+
+struct cache_path {
+    uint32_t name;
+    uint32_t first;
+    uint32_t length;
+};
+
+struct cache_setting {
+    uint32_t ctl;
+    int32_t value;
 };
 
 struct config_parse_state {
@@ -82,6 +146,11 @@ static void path_free(struct audio_route *ar)
             free(ar->mixer_path[i].setting);
     }
     free(ar->mixer_path);
+    free(ar->initial.setting);
+    ar->mixer_path = NULL;
+    ar->mixer_path_size = 0;
+    ar->num_mixer_paths = 0;
+    memset(&ar->initial, 0, sizeof(ar->initial));
 }
 
 static struct mixer_path *path_get_by_name(struct audio_route *ar,
@@ -144,14 +213,14 @@ static bool path_setting_exists(struct mixer_path *path,
     return false;
 }
 
-static int path_add_setting(struct mixer_path *path,
+static int path_add_setting(struct audio_route *ar, struct mixer_path *path,
                             struct mixer_setting *setting)
 {
     struct mixer_setting *new_path_setting;
 
     if (path_setting_exists(path, setting)) {
         ALOGE("Duplicate path  setting '%s'", 
-              mixer_ctl_get_name(setting->ctl));
+              mixer_ctl_get_name(ar->mixer_state[setting->ctl].ctl));
         return -1;
     }
 
@@ -180,44 +249,48 @@ static int path_add_setting(struct mixer_path *path,
     return 0;
 }
 
-static int path_add_path(struct mixer_path *path, struct mixer_path *sub_path)
+static int path_add_path(struct audio_route *ar, struct mixer_path *path,
+                         struct mixer_path *sub_path)
 {
     unsigned int i;
 
     for (i = 0; i < sub_path->length; i++)
-        if (path_add_setting(path, &sub_path->setting[i]) < 0)
+        if (path_add_setting(ar, path, &sub_path->setting[i]) < 0)
             return -1;
 
     return 0;
 }
 
-static void path_print(struct mixer_path *path)
+static void path_print(struct audio_route *ar, struct mixer_path *path)
 {
     unsigned int i;
 
     ALOGV("Path: %s, length: %d", path->name, path->length);
     for (i = 0; i < path->length; i++)
-        ALOGV("  %d: %s -> %d", i, mixer_ctl_get_name(path->setting[i].ctl),
+        ALOGV("  %d: %s -> %d", i,
+              mixer_ctl_get_name(ar->mixer_state[path->setting[i].ctl].ctl),
               path->setting[i].value);
 }
 
-static int path_apply(struct audio_route *ar, struct mixer_path *path)
+/* the control is written on the next update if the value differs */
+static void mixer_state_set(struct audio_route *ar, unsigned int ctl, int value)
 {
-    unsigned int i;
-    unsigned int j;
+    struct mixer_state *state = &ar->mixer_state[ctl];
 
-    for (i = 0; i < path->length; i++) {
-        struct mixer_ctl *ctl = path->setting[i].ctl;
+    state->new_value = value;
+    if (!state->dirty) {
+        state->dirty = true;
+        ar->dirty[ar->num_dirty++] = ctl;
+    }
+}
 
-        /* locate the mixer ctl in the list */
-        for (j = 0; j < ar->num_mixer_ctls; j++) {
-            if (ar->mixer_state[j].ctl == ctl)
-                break;
-        }
+static int path_apply(struct audio_route *ar, struct mixer_path *path)
+{
+    unsigned int i;
 
-        /* apply the new value */
-        ar->mixer_state[j].new_value = path->setting[i].value;
-    }
+    /* the controls were resolved to their state when the path was built */
+    for (i = 0; i < path->length; i++)
+        mixer_state_set(ar, path->setting[i].ctl, path->setting[i].value);
 
     return 0;
 }
@@ -264,17 +337,25 @@ static void start_tag(void *data, const XML_Char *tag_name,
             if (state->level == 1) {
                 /* top level path: create and stash the path */
                 state->path = path_create(ar, (char *)attr_name);
-            } else {
+            } else if (state->path) {
                 /* nested path */
                 struct mixer_path *sub_path = path_get_by_name(ar, attr_name);
-                path_add_path(state->path, sub_path);
+                if (sub_path)
+                    path_add_path(ar, state->path, sub_path);
+                else
+                    ALOGE("Unknown path '%s'", attr_name);
             }
         }
     }
 
     else if (strcmp(tag_name, "ctl") == 0) {
         /* Obtain the mixer ctl and value */
-        ctl = mixer_get_ctl_by_name(ar->mixer, attr_name);
+        ctl = attr_name ? mixer_get_ctl_by_name(ar->mixer, attr_name) : NULL;
+        if (ctl == NULL || attr_value == NULL) {
+            ALOGE("Invalid ctl '%s'", attr_name ? attr_name : "");
+            state->level++;
+            return;
+        }
         switch (mixer_ctl_get_type(ctl)) {
         case MIXER_CTL_TYPE_BOOL:
         case MIXER_CTL_TYPE_INT:
@@ -288,22 +369,27 @@ static void start_tag(void *data, const XML_Char *tag_name,
             break;
         }
 
-        if (state->level == 1) {
-            /* top level ctl (initial setting) */
+        /* locate the mixer ctl in the list, once for all applies */
+        for (i = 0; i < ar->num_mixer_ctls; i++) {
+            if (ar->mixer_state[i].ctl == ctl)
+                break;
+        }
+        mixer_setting.ctl = i;
+        mixer_setting.value = value;
 
-            /* locate the mixer ctl in the list */
-            for (i = 0; i < ar->num_mixer_ctls; i++) {
-                if (ar->mixer_state[i].ctl == ctl)
+        if (state->level == 1) {
+            /* top level ctl (initial setting), the last one wins */
+            for (i = 0; i < ar->initial.length; i++) {
+                if (ar->initial.setting[i].ctl == mixer_setting.ctl)
                     break;
             }
-
-            /* apply the new value */
-            ar->mixer_state[i].new_value = value;
-        } else {
+            if (i < ar->initial.length)
+                ar->initial.setting[i].value = value;
+            else
+                path_add_setting(ar, &ar->initial, &mixer_setting);
+        } else if (state->path) {
             /* nested ctl (within a path) */
-            mixer_setting.ctl = ctl;
-            mixer_setting.value = value;
-            path_add_setting(state->path, &mixer_setting);
+            path_add_setting(ar, state->path, &mixer_setting);
         }
     }
 
@@ -317,20 +403,35 @@ static void end_tag(void *data, const XML_Char *tag_name)
     state->level--;
 }
 
+
 static int alloc_mixer_state(struct audio_route *ar)
 {
+    const char *name;
     unsigned int i;
 
     ar->num_mixer_ctls = mixer_get_num_ctls(ar->mixer);
-    ar->mixer_state = malloc(ar->num_mixer_ctls * sizeof(struct mixer_state));
-    if (!ar->mixer_state)
+    ar->mixer_state = calloc(ar->num_mixer_ctls, sizeof(struct mixer_state));
+    ar->used = malloc(ar->num_mixer_ctls * sizeof(unsigned int));
+    ar->dirty = malloc(ar->num_mixer_ctls * sizeof(unsigned int));
+    if (!ar->mixer_state || !ar->used || !ar->dirty) {
+        free(ar->mixer_state);
+        free(ar->used);
+        free(ar->dirty);
         return -1;
+    }
 
+    /* no value is read yet, only those of the controls the paths use are.
+     * The names came with the open, a driver renaming or adding a control
+     * the xml names changes their hash. */
+    ar->ctl_names_hash = 2166136261u;
     for (i = 0; i < ar->num_mixer_ctls; i++) {
         ar->mixer_state[i].ctl = mixer_get_ctl(ar->mixer, i);
-        /* only get value 0, assume multiple ctl values are the same */
-        ar->mixer_state[i].old_value = mixer_ctl_get_value(ar->mixer_state[i].ctl, 0);
-        ar->mixer_state[i].new_value = ar->mixer_state[i].old_value;
+        name = mixer_ctl_get_name(ar->mixer_state[i].ctl);
+        do {
+            ar->ctl_names_hash = (ar->ctl_names_hash ^ (uint8_t)*name) * 16777619u;
+        } while (*name++);
+        ar->mixer_state[i].type = mixer_ctl_get_type(ar->mixer_state[i].ctl);
+        ar->mixer_state[i].num_values = mixer_ctl_get_num_values(ar->mixer_state[i].ctl);
     }
 
     return 0;
@@ -339,34 +440,94 @@ static int alloc_mixer_state(struct audio_route *ar)
 static void free_mixer_state(struct audio_route *ar)
 {
     free(ar->mixer_state);
+    free(ar->used);
+    free(ar->dirty);
     ar->mixer_state = NULL;
+    ar->used = NULL;
+    ar->dirty = NULL;
 }
 
-void update_mixer_state(struct audio_route *ar)
+static void mark_path_used(struct audio_route *ar, struct mixer_path *path)
+{
+    unsigned int i;
+    struct mixer_state *state;
+
+    for (i = 0; i < path->length; i++) {
+        state = &ar->mixer_state[path->setting[i].ctl];
+        if (!state->used) {
+            state->used = true;
+            ar->used[ar->num_used++] = path->setting[i].ctl;
+        }
+    }
+}
+
+/* reads the controls the paths set, the only ones ever written */
+static void read_mixer_state(struct audio_route *ar)
 {
     unsigned int i;
+    struct mixer_state *state;
+
+    ar->num_used = 0;
+    mark_path_used(ar, &ar->initial);
+    for (i = 0; i < ar->num_mixer_paths; i++)
+        mark_path_used(ar, &ar->mixer_path[i]);
+
+    for (i = 0; i < ar->num_used; i++) {
+        state = &ar->mixer_state[ar->used[i]];
+        /* only get value 0, assume multiple ctl values are the same */
+        state->old_value = mixer_ctl_get_value(state->ctl, 0);
+        state->new_value = state->old_value;
+    }
+}
+
+/* sets all values of a control the same, in one ioctl when it can */
+static void mixer_state_write(struct mixer_state *state)
+{
+    long values[MAX_BATCH_VALUES];
     unsigned int j;
 
-    for (i = 0; i < ar->num_mixer_ctls; i++) {
+    if ((state->type == MIXER_CTL_TYPE_BOOL || state->type == MIXER_CTL_TYPE_INT) &&
+            state->num_values <= MAX_BATCH_VALUES) {
+        for (j = 0; j < state->num_values; j++)
+            values[j] = state->new_value;
+        /* the count is in values, not bytes */
+        if (mixer_ctl_set_array(state->ctl, values, state->num_values) == 0)
+            return;
+    }
+
+    /* each of these reads the control back before writing it */
+    for (j = 0; j < state->num_values; j++)
+        mixer_ctl_set_value(state->ctl, j, state->new_value);
+}
+
+void update_mixer_state(struct audio_route *ar)
+{
+    unsigned int i;
+    struct mixer_state *state;
+
+    /* only the controls set since the last update can have changed */
+    for (i = 0; i < ar->num_dirty; i++) {
+        state = &ar->mixer_state[ar->dirty[i]];
         /* if the value has changed, update the mixer */
-        if (ar->mixer_state[i].old_value != ar->mixer_state[i].new_value) {
-            /* set all ctl values the same */
-            for (j = 0; j < mixer_ctl_get_num_values(ar->mixer_state[i].ctl); j++)
-                mixer_ctl_set_value(ar->mixer_state[i].ctl, j,
-                                    ar->mixer_state[i].new_value);
-            ar->mixer_state[i].old_value = ar->mixer_state[i].new_value;
+        if (state->old_value != state->new_value) {
+            mixer_state_write(state);
+            state->old_value = state->new_value;
         }
+        state->dirty = false;
     }
+    ar->num_dirty = 0;
 }
 
 /* saves the current state of the mixer, for resetting all controls */
 static void save_mixer_state(struct audio_route *ar)
 {
     unsigned int i;
+    struct mixer_state *state;
 
-    for (i = 0; i < ar->num_mixer_ctls; i++) {
-        /* only get value 0, assume multiple ctl values are the same */
-        ar->mixer_state[i].reset_value = mixer_ctl_get_value(ar->mixer_state[i].ctl, 0);
+    /* the values of the controls used are known since they were read */
+    for (i = 0; i < ar->num_used; i++) {
+        state = &ar->mixer_state[ar->used[i]];
+        state->reset_value = state->old_value;
     }
 }
 
@@ -374,10 +535,14 @@ static void save_mixer_state(struct audio_route *ar)
 void reset_mixer_state(struct audio_route *ar)
 {
     unsigned int i;
+    struct mixer_state *state;
 
     /* load all of the saved values */
-    for (i = 0; i < ar->num_mixer_ctls; i++)
-        ar->mixer_state[i].new_value = ar->mixer_state[i].reset_value;
+    for (i = 0; i < ar->num_used; i++) {
+        state = &ar->mixer_state[ar->used[i]];
+        if (state->new_value != state->reset_value)
+            mixer_state_set(ar, ar->used[i], state->reset_value);
+    }
 }
 
 void audio_route_apply_path(struct audio_route *ar, const char *name)
@@ -398,45 +563,26 @@ void audio_route_apply_path(struct audio_route *ar, const char *name)
     path_apply(ar, path);
 }
 
-struct audio_route *audio_route_init(void)
+static int parse_mixer_xml(struct audio_route *ar)
 {
     struct config_parse_state state;
     XML_Parser parser;
     FILE *file;
     int bytes_read;
     void *buf;
-    int i;
-    struct mixer_path *path;
-    struct audio_route *ar;
-
-    ar = calloc(1, sizeof(struct audio_route));
-    if (!ar)
-        goto err_calloc;
-
-    ar->mixer = mixer_open(MIXER_CARD);
-    if (!ar->mixer) {
-        ALOGE("Unable to open the mixer, aborting.");
-        goto err_mixer_open;
-    }
-
-    ar->mixer_path = NULL;
-    ar->mixer_path_size = 0;
-    ar->num_mixer_paths = 0;
-
-    /* allocate space for and read current mixer settings */
-    if (alloc_mixer_state(ar) < 0)
-        goto err_mixer_state;
+    int ret = -1;
 
     file = fopen(MIXER_XML_PATH, "r");
     if (!file) {
         ALOGE("Failed to open %s", MIXER_XML_PATH);
-        goto err_fopen;
+        return -1;
     }
 
     parser = XML_ParserCreate(NULL);
     if (!parser) {
         ALOGE("Failed to create XML parser");
-        goto err_parser_create;
+        fclose(file);
+        return -1;
     }
 
     memset(&state, 0, sizeof(state));
@@ -447,36 +593,278 @@ struct audio_route *audio_route_init(void)
     for (;;) {
         buf = XML_GetBuffer(parser, BUF_SIZE);
         if (buf == NULL)
-            goto err_parse;
+            break;
 
         bytes_read = fread(buf, 1, BUF_SIZE, file);
         if (bytes_read < 0)
-            goto err_parse;
+            break;
 
         if (XML_ParseBuffer(parser, bytes_read,
                             bytes_read == 0) == XML_STATUS_ERROR) {
             ALOGE("Error in mixer xml (%s)", MIXER_XML_PATH);
-            goto err_parse;
+            break;
         }
 
-        if (bytes_read == 0)
+        if (bytes_read == 0) {
+            ret = 0;
             break;
+        }
+    }
+
+    XML_ParserFree(parser);
+    fclose(file);
+    return ret;
+}
+
+/* loads the paths compiled from the xml of xml_stat for this mixer */
+static int load_mixer_cache(struct audio_route *ar, const struct stat *xml_stat)
+{
+    struct cache_header header;
+    struct cache_ctl *ctls;
+    struct cache_path *paths;
+    struct cache_setting *settings;
+    struct mixer_setting setting;
+    struct mixer_path *path;
+    const char *strings;
+    char *data = NULL;
+    size_t size;
+    unsigned int i, j;
+    struct stat st;
+    int fd;
+    int ret = -1;
+
+    fd = open(MIXER_CACHE_PATH, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(header) ||
+            read(fd, &header, sizeof(header)) != sizeof(header))
+        goto exit;
+
+    if (header.magic != MIXER_CACHE_MAGIC || header.version != MIXER_CACHE_VERSION ||
+            header.xml_mtime != (int64_t)xml_stat->st_mtime ||
+            header.xml_size != (int64_t)xml_stat->st_size ||
+            header.num_mixer_ctls != ar->num_mixer_ctls ||
+            header.ctl_names_hash != ar->ctl_names_hash) {
+        ALOGV("%s is stale", MIXER_CACHE_PATH);
+        goto exit;
     }
 
+    size = (size_t)header.num_ctls * sizeof(*ctls) +
+           (size_t)header.num_paths * sizeof(*paths) +
+           (size_t)header.num_settings * sizeof(*settings) + header.strings_size;
+    if (header.num_ctls > ar->num_mixer_ctls || header.num_paths == 0 ||
+            header.strings_size == 0 ||
+            (off_t)(sizeof(header) + size) != st.st_size)
+        goto exit;
+
+    data = malloc(size);
+    if (!data || read(fd, data, size) != (ssize_t)size)
+        goto exit;
+
+    ctls = (struct cache_ctl *)data;
+    paths = (struct cache_path *)(ctls + header.num_ctls);
+    settings = (struct cache_setting *)(paths + header.num_paths);
+    strings = (const char *)(settings + header.num_settings);
+    if (strings[header.strings_size - 1] != '\0')
+        goto exit;
+
+    /* the indexes hold as long as each control keeps its name */
+    for (i = 0; i < header.num_ctls; i++) {
+        if (ctls[i].index >= ar->num_mixer_ctls || ctls[i].name >= header.strings_size ||
+                strcmp(strings + ctls[i].name,
+                       mixer_ctl_get_name(ar->mixer_state[ctls[i].index].ctl)) != 0) {
+            ALOGV("%s is for another driver", MIXER_CACHE_PATH);
+            goto exit;
+        }
+        ar->mixer_state[ctls[i].index].used = true;
+    }
+
+    for (i = 0; i < header.num_paths; i++) {
+        if (paths[i].name >= header.strings_size ||
+                paths[i].first > header.num_settings ||
+                paths[i].length > header.num_settings - paths[i].first)
+            goto exit_paths;
+
+        if (i == 0)
+            path = &ar->initial;
+        else if ((path = path_create(ar, strings + paths[i].name)) == NULL)
+            goto exit_paths;
+
+        for (j = paths[i].first; j < paths[i].first + paths[i].length; j++) {
+            if (settings[j].ctl >= ar->num_mixer_ctls ||
+                    !ar->mixer_state[settings[j].ctl].used)
+                goto exit_paths;
+            setting.ctl = settings[j].ctl;
+            setting.value = settings[j].value;
+            if (path_add_setting(ar, path, &setting) < 0)
+                goto exit_paths;
+        }
+    }
+    ret = 0;
+    goto exit;
+
+exit_paths:
+    path_free(ar);
+exit:
+    /* read_mixer_state marks the controls again from the paths */
+    for (i = 0; i < ar->num_mixer_ctls; i++)
+        ar->mixer_state[i].used = false;
+    free(data);
+    close(fd);
+    return ret;
+}
+
+static void cache_add_path(struct audio_route *ar, struct mixer_path *path,
+                           struct cache_path *cache_path, uint32_t name,
+                           struct cache_setting *settings, uint32_t *num_settings)
+{
+    unsigned int i;
+
+    cache_path->name = name;
+    cache_path->first = *num_settings;
+    cache_path->length = path->length;
+    for (i = 0; i < path->length; i++) {
+        settings[*num_settings].ctl = path->setting[i].ctl;
+        settings[*num_settings].value = path->setting[i].value;
+        (*num_settings)++;
+    }
+}
+
+/* writes the paths parsed from the xml of xml_stat for the next start,
+ * once read_mixer_state has listed the controls they use */
+static void save_mixer_cache(struct audio_route *ar, const struct stat *xml_stat)
+{
+    struct cache_header header;
+    struct cache_ctl *ctls;
+    struct cache_path *paths;
+    struct cache_setting *settings;
+    char *strings;
+    char *data;
+    size_t size;
+    unsigned int i;
+    uint32_t total = ar->initial.length;
+    const char *name;
+    FILE *file;
+    int ok;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = MIXER_CACHE_MAGIC;
+    header.version = MIXER_CACHE_VERSION;
+    header.xml_mtime = xml_stat->st_mtime;
+    header.xml_size = xml_stat->st_size;
+    header.num_mixer_ctls = ar->num_mixer_ctls;
+    header.ctl_names_hash = ar->ctl_names_hash;
+    header.num_ctls = ar->num_used;
+    header.num_paths = ar->num_mixer_paths + 1;
+    header.strings_size = 1;
+    for (i = 0; i < ar->num_used; i++)
+        header.strings_size += strlen(mixer_ctl_get_name(ar->mixer_state[ar->used[i]].ctl)) + 1;
+    for (i = 0; i < ar->num_mixer_paths; i++) {
+        header.strings_size += strlen(ar->mixer_path[i].name) + 1;
+        total += ar->mixer_path[i].length;
+    }
+    header.num_settings = total;
+
+    size = (size_t)header.num_ctls * sizeof(*ctls) +
+           (size_t)header.num_paths * sizeof(*paths) +
+           (size_t)header.num_settings * sizeof(*settings) + header.strings_size;
+    data = calloc(1, size);
+    if (!data)
+        return;
+
+    ctls = (struct cache_ctl *)data;
+    paths = (struct cache_path *)(ctls + header.num_ctls);
+    settings = (struct cache_setting *)(paths + header.num_paths);
+    strings = (char *)(settings + header.num_settings);
+
+    /* offset 0 is the empty name of the initial values */
+    header.strings_size = 1;
+    for (i = 0; i < ar->num_used; i++) {
+        name = mixer_ctl_get_name(ar->mixer_state[ar->used[i]].ctl);
+        ctls[i].index = ar->used[i];
+        ctls[i].name = header.strings_size;
+        strcpy(strings + header.strings_size, name);
+        header.strings_size += strlen(name) + 1;
+    }
+
+    total = 0;
+    cache_add_path(ar, &ar->initial, &paths[0], 0, settings, &total);
+    for (i = 0; i < ar->num_mixer_paths; i++) {
+        cache_add_path(ar, &ar->mixer_path[i], &paths[i + 1], header.strings_size,
+                       settings, &total);
+        strcpy(strings + header.strings_size, ar->mixer_path[i].name);
+        header.strings_size += strlen(ar->mixer_path[i].name) + 1;
+    }
+
+    /* written aside then renamed, a start never reads half a table */
+    file = fopen(MIXER_CACHE_PATH ".tmp", "w");
+    if (!file) {
+        ALOGV("Unable to write %s", MIXER_CACHE_PATH);
+        free(data);
+        return;
+    }
+    ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+         fwrite(data, size, 1, file) == 1;
+    ok = (fclose(file) == 0) && ok;
+    if (!ok || rename(MIXER_CACHE_PATH ".tmp", MIXER_CACHE_PATH) != 0) {
+        ALOGW("Unable to write %s", MIXER_CACHE_PATH);
+        unlink(MIXER_CACHE_PATH ".tmp");
+    }
+    free(data);
+}
+
+struct audio_route *audio_route_init(void)
+{
+    struct stat xml_stat;
+    struct audio_route *ar;
+    bool cached;
+
+    ar = calloc(1, sizeof(struct audio_route));
+    if (!ar)
+        goto err_calloc;
+
+    ar->mixer = mixer_open(MIXER_CARD);
+    if (!ar->mixer) {
+        ALOGE("Unable to open the mixer, aborting.");
+        goto err_mixer_open;
+    }
+
+    ar->mixer_path = NULL;
+    ar->mixer_path_size = 0;
+    ar->num_mixer_paths = 0;
+
+    /* allocate space for the mixer settings */
+    if (alloc_mixer_state(ar) < 0)
+        goto err_mixer_state;
+
+    if (stat(MIXER_XML_PATH, &xml_stat) < 0) {
+        ALOGE("Failed to open %s", MIXER_XML_PATH);
+        goto err_parse;
+    }
+
+    /* the xml is only parsed when it changed since it was compiled */
+    cached = load_mixer_cache(ar, &xml_stat) == 0;
+    if (!cached && parse_mixer_xml(ar) < 0)
+        goto err_parse;
+
+    /* read the current values of the controls the paths use */
+    read_mixer_state(ar);
+    if (!cached)
+        save_mixer_cache(ar, &xml_stat);
+    ALOGV("%d paths on %d of %d controls, %s", ar->num_mixer_paths, ar->num_used,
+          ar->num_mixer_ctls, cached ? "cached" : "parsed");
+
     /* apply the initial mixer values, and save them so we can reset the
        mixer to the original values */
+    path_apply(ar, &ar->initial);
     update_mixer_state(ar);
     save_mixer_state(ar);
 
-    XML_ParserFree(parser);
-    fclose(file);
     return ar;
 
 err_parse:
-    XML_ParserFree(parser);
-err_parser_create:
-    fclose(file);
-err_fopen:
+    path_free(ar);
     free_mixer_state(ar);
 err_mixer_state:
     mixer_close(ar->mixer);
@@ -489,6 +877,7 @@ err_calloc:
 
 void audio_route_free(struct audio_route *ar)
 {
+    path_free(ar);
     free_mixer_state(ar);
     mixer_close(ar->mixer);
     free(ar);
@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Value ioctls and time of audio_route on the fake mixer of tests/mixer,
+ * a 220 control codec with 110 initial values and 25 paths:
+ *
+ *   parsed   a start parsing mixer_paths.xml and writing the cache
+ *   cached   a start from the cache
+ *   route    a routing change as select_devices makes it: reset, the
+ *            paths of the route, update
+ *
+ * After each start and route every control must hold the value listed
+ * in tests/mixer/routes.txt, no write may leave a control as it was and
+ * a route may not read a value back. A touched xml, a renamed control
+ * either way and a truncated cache must have the next start parse the xml
+ * again.
+ *
+ * audio_route.c is built here with MIXER_XML_PATH and MIXER_CACHE_PATH in
+ * the current directory, a temporary one the xml is copied to.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "audio_route.h"
+#include "mixer_fake.h"
+#include "imx_test.h"
+
+#define MAX_ROUTES 64
+#define MAX_ROUTE_PATHS 8
+#define MAX_CTLS 512
+#define STARTS 20
+#define PASSES 50
+
+struct route {
+    char name[MAX_ROUTE_PATHS * 32];
+    char paths[MAX_ROUTE_PATHS][32];
+    int num_paths;
+    int expect[MAX_CTLS];
+};
+
+static char sDir[PATH_MAX];
+static char sTmp[PATH_MAX];
+static struct route sRoutes[MAX_ROUTES];
+static int sNumRoutes;
+static const struct route *sInitial;    /* the route with no path */
+
+static unsigned int bench_ioctls(void)
+{
+    return mixer_fake.reads + mixer_fake.writes;
+}
+
+static int bench_load_routes(void)
+{
+    char path[PATH_MAX];
+    char line[4096];
+    struct route *r = NULL;
+    FILE *f;
+
+    snprintf(path, sizeof(path), "%s/routes.txt", sDir);
+    f = fopen(path, "r");
+    if (f == NULL) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        char *p, *end;
+        unsigned int i;
+
+        line[strcspn(line, "\n")] = '\0';
+        if (!strncmp(line, "route", 5) && sNumRoutes < MAX_ROUTES) {
+            r = &sRoutes[sNumRoutes++];
+            for (p = strtok(line + 5, " "); p && r->num_paths < MAX_ROUTE_PATHS;
+                 p = strtok(NULL, " "))
+                snprintf(r->paths[r->num_paths++], sizeof(r->paths[0]), "%s", p);
+            for (i = 0, end = r->name; i < (unsigned int)r->num_paths; i++)
+                end += sprintf(end, "%s%s", i ? "+" : "", r->paths[i]);
+            if (r->num_paths == 0) {
+                strcpy(r->name, "(initial)");
+                sInitial = r;
+            }
+        } else if (!strncmp(line, "expect", 6) && r) {
+            p = line + 6;
+            for (i = 0; i < mixer_fake_num_ctls(0); i++) {
+                r->expect[i] = strtol(p, &end, 10);
+                CHECK(end != p, "%s: %s has %u values", path, r->name, i);
+                p = end;
+            }
+        }
+    }
+    fclose(f);
+    CHECK(sInitial != NULL, "%s: no route without paths", path);
+    return sNumRoutes;
+}
+
+static int bench_copy(const char *from, const char *to)
+{
+    char buf[4096];
+    FILE *in, *out;
+    size_t n;
+    int ret = 0;
+
+    in = fopen(from, "rb");
+    if (in == NULL)
+        return -1;
+    out = fopen(to, "wb");
+    if (out == NULL) {
+        fclose(in);
+        return -1;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+        if (fwrite(buf, 1, n, out) != n)
+            ret = -1;
+    fclose(in);
+    if (fclose(out) != 0)
+        ret = -1;
+    return ret;
+}
+
+/* a reboot, the card back at its power on values */
+static void bench_power_on(void)
+{
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/controls.txt", sDir);
+    CHECK(mixer_fake_load(0, path) == 0, "%s: bad control list", path);
+    mixer_fake_reset();
+}
+
+static void bench_check_state(const struct route *r, const char *when)
+{
+    unsigned int i;
+
+    for (i = 0; i < mixer_fake_num_ctls(0); i++) {
+        int value = mixer_fake_value(0, i);
+        if (value != r->expect[i]) {
+            CHECK(0, "%s %s: control %u is %d, expected %d", when, r->name, i, value,
+                  r->expect[i]);
+            return;
+        }
+    }
+    CHECK(mixer_fake.redundant == 0 && mixer_fake.errors == 0,
+          "%s %s: %u redundant writes, %u errors", when, r->name, mixer_fake.redundant,
+          mixer_fake.errors);
+}
+
+static ino_t bench_cache_inode(void)
+{
+    struct stat st;
+
+    if (stat("mixer_paths.bin", &st) < 0)
+        return 0;
+    return st.st_ino;
+}
+
+/* a start, and whether it parsed the xml: that rewrites the cache */
+static struct audio_route *bench_start(const char *when, int *parsed, int64_t *ns,
+                                       unsigned int *ioctls)
+{
+    struct audio_route *ar;
+    ino_t inode = bench_cache_inode();
+    int64_t t;
+
+    bench_power_on();
+    t = imx_test_ns(CLOCK_MONOTONIC);
+    ar = audio_route_init();
+    *ns = imx_test_ns(CLOCK_MONOTONIC) - t;
+    *ioctls = bench_ioctls();
+    *parsed = bench_cache_inode() != inode;
+    if (ar == NULL) {
+        CHECK(0, "%s: audio_route_init failed", when);
+        return NULL;
+    }
+    CHECK(bench_cache_inode() != 0, "%s: no cache written", when);
+    bench_check_state(sInitial, when);
+    return ar;
+}
+
+static void bench_starts(void)
+{
+    struct audio_route *ar;
+    int64_t ns, parsed_ns = 0, cached_ns = 0;
+    unsigned int ioctls, parsed_ioctls = 0, cached_ioctls = 0;
+    int parsed, i;
+
+    for (i = 0; i < STARTS; i++) {
+        unlink("mixer_paths.bin");
+        ar = bench_start("parsed start", &parsed, &ns, &ioctls);
+        if (ar == NULL)
+            return;
+        CHECK(parsed, "parsed start: the cache was not written");
+        parsed_ns += ns;
+        parsed_ioctls = ioctls;
+        audio_route_free(ar);
+
+        ar = bench_start("cached start", &parsed, &ns, &ioctls);
+        if (ar == NULL)
+            return;
+        CHECK(!parsed, "cached start: the xml was parsed again");
+        CHECK(ioctls == parsed_ioctls, "cached start: %u ioctls, %u parsed", ioctls,
+              parsed_ioctls);
+        cached_ns += ns;
+        cached_ioctls = ioctls;
+        audio_route_free(ar);
+    }
+
+    printf("%-32s %4u ioctls  %8.1f us  (+%u at open)\n", "start parsed", parsed_ioctls,
+           parsed_ns / 1000.0 / STARTS, mixer_fake.infos);
+    printf("%-32s %4u ioctls  %8.1f us\n", "start cached", cached_ioctls,
+           cached_ns / 1000.0 / STARTS);
+}
+
+static void bench_routes(void)
+{
+    static int64_t ns[MAX_ROUTES];
+    static unsigned int ioctls[MAX_ROUTES];
+    struct audio_route *ar;
+    unsigned int total = 0, max = 0;
+    int64_t ignored_ns;
+    int i, j, pass, parsed;
+
+    ar = bench_start("routes", &parsed, &ignored_ns, &ioctls[0]);
+    if (ar == NULL)
+        return;
+
+    for (pass = 0; pass < PASSES; pass++) {
+        for (i = 0; i < sNumRoutes; i++) {
+            const struct route *r = &sRoutes[i];
+            int64_t t;
+
+            mixer_fake_reset();
+            t = imx_test_ns(CLOCK_MONOTONIC);
+            reset_mixer_state(ar);
+            for (j = 0; j < r->num_paths; j++)
+                audio_route_apply_path(ar, r->paths[j]);
+            update_mixer_state(ar);
+            ns[i] += imx_test_ns(CLOCK_MONOTONIC) - t;
+            ioctls[i] = bench_ioctls();
+
+            CHECK(mixer_fake.gets == 0, "route %s: %u values read", r->name, mixer_fake.gets);
+            bench_check_state(r, "route");
+        }
+    }
+    audio_route_free(ar);
+
+    for (i = 0; i < sNumRoutes; i++) {
+        char name[64];
+        snprintf(name, sizeof(name), "route %s", sRoutes[i].name);
+        printf("%-32s %4u ioctls  %8.1f us\n", name, ioctls[i], ns[i] / 1000.0 / PASSES);
+        total += ioctls[i];
+        if (ioctls[i] > max)
+            max = ioctls[i];
+    }
+    printf("%d routes: %.1f ioctls avg, %u max\n", sNumRoutes, (double)total / sNumRoutes,
+           max);
+}
+
+/* a changed xml or driver throws the cache away */
+static void bench_invalidate(void)
+{
+    struct audio_route *ar;
+    struct timeval times[2];
+    struct stat st;
+    unsigned int ioctls;
+    ino_t inode;
+    int64_t ns;
+    int parsed;
+
+    ar = bench_start("warm", &parsed, &ns, &ioctls);
+    if (ar == NULL)
+        return;
+    audio_route_free(ar);
+
+    stat("mixer_paths.xml", &st);
+    times[0].tv_sec = times[1].tv_sec = st.st_mtime + 1;
+    times[0].tv_usec = times[1].tv_usec = 0;
+    utimes("mixer_paths.xml", times);
+    ar = bench_start("touched xml", &parsed, &ns, &ioctls);
+    if (ar == NULL)
+        return;
+    CHECK(parsed, "touched xml: the stale cache was used");
+    audio_route_free(ar);
+    inode = bench_cache_inode();
+
+    /* a driver renaming a control the paths use, then a cache saved on
+     * it, where the xml named a control the card did not have */
+    bench_power_on();
+    mixer_fake_rename(0, 0, "HPOUTL Mixer DAC Left Switch");
+    ar = audio_route_init();
+    CHECK(ar && bench_cache_inode() != inode, "renamed control: the cache was used");
+    if (ar)
+        audio_route_free(ar);
+    inode = bench_cache_inode();
+    ar = bench_start("control back", &parsed, &ns, &ioctls);
+    if (ar == NULL)
+        return;
+    CHECK(parsed, "control back: the cache of another driver was used");
+    audio_route_free(ar);
+
+    truncate("mixer_paths.bin", 100);
+    ar = bench_start("truncated cache", &parsed, &ns, &ioctls);
+    if (ar == NULL)
+        return;
+    CHECK(parsed, "truncated cache: not parsed again");
+    audio_route_free(ar);
+}
+
+int main(int argc, char **argv)
+{
+    char path[PATH_MAX];
+
+    imx_test_path(sDir, sizeof(sDir), argc, argv, "mx5x/audio/tests/mixer");
+    if (sDir[0] != '/') {
+        char cwd[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", getcwd(cwd, sizeof(cwd)), sDir);
+        snprintf(sDir, sizeof(sDir), "%s", path);
+    }
+
+    bench_power_on();
+    if (imx_test_failures || bench_load_routes() <= 0) {
+        printf("audio_route_bench: FAILED, no fixtures in %s\n", sDir);
+        return 1;
+    }
+
+    snprintf(sTmp, sizeof(sTmp), "/tmp/audio_route_bench.XXXXXX");
+    snprintf(path, sizeof(path), "%s/mixer_paths.xml", sDir);
+    if (mkdtemp(sTmp) == NULL || chdir(sTmp) < 0 ||
+            bench_copy(path, "mixer_paths.xml") < 0) {
+        printf("audio_route_bench: FAILED, cannot copy %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    printf("%u controls, %d routes, %d starts, %d passes:\n", mixer_fake_num_ctls(0),
+           sNumRoutes, STARTS, PASSES);
+    bench_starts();
+    bench_routes();
+    bench_invalidate();
+
+    unlink("mixer_paths.bin");
+    unlink("mixer_paths.xml");
+    chdir("/");
+    rmdir(sTmp);
+
+    return imx_test_result("audio_route_bench");
+}
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The mx5x HAL in the harness, on card 0 as it opens it: the codec of
+ * tests/mixer at 44.1 kHz, playing and capturing in stereo. audio_route.c
+ * is built with MIXER_XML_PATH and MIXER_CACHE_PATH in the current
+ * directory, a temporary one the xml is copied to.
+ */
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <hardware/audio.h>
+#include <system/audio.h>
+
+#include "audio_hal_harness.h"
+#include "mixer_fake.h"
+#include "pcm_fake.h"
+
+static char sTmp[PATH_MAX];
+
+const char harness_fixtures[] = "mx5x/audio/tests/mixer";
+
+/* the one output follows the output device, routing the input leaves it
+ * running */
+const char *const harness_neighbours[] = { "mic", NULL };
+
+const char *const harness_properties[][2] = {
+    { NULL, NULL },
+};
+
+const struct harness_stream harness_outputs[] = {
+    { "primary", AUDIO_DEVICE_OUT_SPEAKER, AUDIO_OUTPUT_FLAG_PRIMARY,
+      AUDIO_FORMAT_PCM_16_BIT, AUDIO_CHANNEL_OUT_STEREO, 44100,
+      { AUDIO_DEVICE_OUT_SPEAKER, AUDIO_DEVICE_OUT_SPEAKER | AUDIO_DEVICE_OUT_WIRED_HEADPHONE },
+      NULL },
+    { NULL },
+};
+
+const struct harness_stream harness_inputs[] = {
+    { "mic", AUDIO_DEVICE_IN_BUILTIN_MIC, AUDIO_OUTPUT_FLAG_NONE,
+      AUDIO_FORMAT_PCM_16_BIT, AUDIO_CHANNEL_IN_MONO, 44100,
+      { AUDIO_DEVICE_IN_BUILTIN_MIC, AUDIO_DEVICE_IN_WIRED_HEADSET },
+      NULL, 0 },
+    { NULL },
+};
+
+static int harness_copy(const char *from, const char *to)
+{
+    char buf[4096];
+    FILE *in, *out;
+    size_t n;
+    int ret = 0;
+
+    in = fopen(from, "rb");
+    if (in == NULL)
+        return -1;
+    out = fopen(to, "wb");
+    if (out == NULL) {
+        fclose(in);
+        return -1;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0)
+        if (fwrite(buf, 1, n, out) != n)
+            ret = -1;
+    fclose(in);
+    if (fclose(out) != 0)
+        ret = -1;
+    return ret;
+}
+
+int harness_setup(const char *dir)
+{
+    char path[PATH_MAX], xml[PATH_MAX];
+    int ret;
+
+    mixer_fake_clear();
+    pcm_fake_clear();
+    snprintf(path, sizeof(path), "%s/controls.txt", dir);
+    ret = mixer_fake_load(0, path);
+    if (ret != 0)
+        return ret;
+    ret = pcm_fake_add_card(0, "imx3stack", "imx-3stack", "imx-3stack", 44100, 44100, 2);
+    if (ret != 0)
+        return ret;
+
+    snprintf(sTmp, sizeof(sTmp), "/tmp/audio_hal_harness.XXXXXX");
+    snprintf(path, sizeof(path), "%s/mixer_paths.xml", dir);
+    if (mkdtemp(sTmp) == NULL) {
+        sTmp[0] = '\0';
+        return -1;
+    }
+    // dir may be relative, the xml is copied before moving over
+    snprintf(xml, sizeof(xml), "%s/mixer_paths.xml", sTmp);
+    if (harness_copy(path, xml) < 0 || chdir(sTmp) < 0)
+        return -1;
+    return 0;
+}
+
+void harness_teardown(void)
+{
+    if (sTmp[0] == '\0')
+        return;
+    unlink("mixer_paths.bin");
+    unlink("mixer_paths.xml");
+    chdir("/");
+    rmdir(sTmp);
+}
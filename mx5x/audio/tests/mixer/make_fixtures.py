@@ -0,0 +1,240 @@
+#!/usr/bin/env python
+#
+# Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Writes the card audio_route_bench runs on: controls.txt, the controls of
+# a codec with their power on values, mixer_paths.xml, its initial values
+# and paths, and routes.txt, the value of every control once the paths of
+# a route are applied over the initial values. The values are worked out
+# here from the xml rules and not by audio_route.c. Run it from this
+# directory and commit what it writes along with any change to it.
+
+INPUTS = ['DACL', 'DACR', 'IN1L', 'IN1R', 'IN2L', 'IN2R', 'IN3L', 'IN3R',
+          'MIXINL', 'MIXINR', 'Tone', 'Beep']
+OUTPUTS = ['HPOUTL', 'HPOUTR', 'SPKOUTL', 'SPKOUTR', 'LINEOUTL', 'LINEOUTR',
+           'EAROUT', 'MONOOUT']
+MIC_SOURCES = ['IN1', 'IN2', 'IN3', 'DMIC']
+
+# name: (type, values, power on value, enum strings)
+controls = []
+
+
+def ctl(name, kind, values, value, enums=()):
+    controls.append((name, kind, values, value, list(enums)))
+
+
+for out in OUTPUTS:
+    for src in INPUTS:
+        ctl('%s Mixer %s Switch' % (out, src), 'BOOL', 1, 0)
+for out in ['Headphone', 'Speaker', 'Lineout', 'Earpiece']:
+    ctl('%s Volume' % out, 'INT', 2, 0)
+    ctl('%s Switch' % out, 'BOOL', 2, 0)
+    ctl('%s ZC Switch' % out, 'BOOL', 2, 0)
+    ctl('%s Boost Volume' % out, 'INT', 1, 0)
+for side in 'LR':
+    ctl('INPGA%s Switch' % side, 'BOOL', 1, 0)
+    ctl('INPGA%s Volume' % side, 'INT', 1, 0)
+    ctl('INPGA%s Source' % side, 'ENUM', 1, 0, MIC_SOURCES)
+    ctl('MIXIN%s PGA Switch' % side, 'BOOL', 1, 0)
+    ctl('MIXIN%s Boost Volume' % side, 'INT', 1, 0)
+    ctl('ADC%s Mux' % side, 'ENUM', 1, 0, ['ADC', 'DMIC', 'Loopback'])
+    ctl('DAC%s Mux' % side, 'ENUM', 1, 0, ['Left', 'Right', 'Mono', 'Off'])
+for i in range(1, 5):
+    ctl('EQ Band %d Volume' % i, 'INT', 2, 12)
+    ctl('DRC Stage %d Volume' % i, 'INT', 1, 0)
+for name, values in [('Digital Playback Volume', 2), ('Digital Capture Volume', 2),
+                     ('Sidetone Volume', 2), ('Beep Volume', 1), ('ALC Target', 1),
+                     ('ALC Hold Time', 1), ('ALC Decay Time', 1), ('ALC Attack Time', 1),
+                     ('Noise Gate Threshold', 1), ('DAC Deemphasis', 1),
+                     ('ADC High Pass Filter Cut Off', 1), ('Speaker Gain', 1)]:
+    ctl(name, 'INT', values, 0)
+for name in ['Capture Switch', 'Playback Deemphasis Switch', 'ADC High Pass Filter Switch',
+             'ALC Switch', 'Noise Gate Switch', 'EQ Switch', 'DRC Switch',
+             'Mic Bias Switch', 'DMIC Switch', 'Speaker Amp Switch',
+             'Headphone Detect Switch', 'Mic Detect Switch', 'Sidetone Switch',
+             'Beep Switch', 'DAC Mono Switch', 'ADC Mono Switch', 'Loopback Switch',
+             'Thermal Shutdown Switch', 'Class D Switch', 'HP Charge Pump Switch']:
+    ctl(name, 'BOOL', 1, 0)
+for name, enums in [('ALC Mode', ['ALC', 'Limiter']), ('DRC Mode', ['Off', 'Soft', 'Hard']),
+                    ('DAC Oversampling', ['64x', '128x']),
+                    ('ADC Oversampling', ['64x', '128x']),
+                    ('Mic Bias Voltage', ['0.9 AVDD', '0.65 AVDD']),
+                    ('HP Charge Pump Mode', ['Auto', 'Fixed', 'Off']),
+                    ('Speaker Mode', ['Class D', 'Class AB']),
+                    ('Capture Source', ['Mic', 'Line', 'Digital'])]:
+    ctl(name, 'ENUM', 1, 0, enums)
+for i in range(220 - len(controls)):
+    ctl('DSP Coefficient %d' % i, 'INT', 1, 0)
+assert len(controls) == 220
+
+index = dict((c[0], i) for i, c in enumerate(controls))
+
+
+def value_of(name, text):
+    kind, enums = controls[index[name]][1], controls[index[name]][4]
+    return enums.index(text) if kind == 'ENUM' else int(text)
+
+
+# the top level values, some of them set twice where the last one wins
+initial = []
+for name, kind, values, value, enums in controls:
+    if 'DSP Coefficient' in name:
+        continue
+    if kind == 'ENUM':
+        initial.append((name, enums[0]))
+    elif 'Volume' in name:
+        initial.append((name, '40'))
+    else:
+        initial.append((name, '0'))
+initial = initial[:108]
+initial += [('Headphone Volume', '50'), ('Speaker Volume', '55')]
+
+# path: settings, a setting is (control, value) or ('path', name)
+paths = []
+
+
+def path(name, settings):
+    paths.append((name, settings))
+
+
+def out_path(out, srcs):
+    return [('%s Mixer %s Switch' % (out, s), '1') for s in srcs]
+
+path('dac-left', [('DACL Mux', 'Left'), ('Digital Playback Volume', '96')])
+path('dac-right', [('DACR Mux', 'Right')])
+path('speaker', [('path', 'dac-left')] +
+     out_path('SPKOUTL', ['DACL']) + out_path('SPKOUTR', ['DACR']) +
+     [('path', 'dac-right'), ('Speaker Switch', '1'), ('Speaker Volume', '60'),
+      ('Speaker Amp Switch', '1'), ('Class D Switch', '1'), ('Speaker Mode', 'Class D'),
+      ('Speaker Gain', '3'), ('DRC Switch', '1'), ('DRC Mode', 'Soft'),
+      ('EQ Switch', '1'), ('EQ Band 1 Volume', '8'), ('EQ Band 4 Volume', '16')])
+path('headphone', [('path', 'dac-left')] +
+     out_path('HPOUTL', ['DACL']) + out_path('HPOUTR', ['DACR']) +
+     [('path', 'dac-right'), ('Headphone Switch', '1'), ('Headphone Volume', '52'),
+      ('Headphone ZC Switch', '1'), ('HP Charge Pump Switch', '1'),
+      ('HP Charge Pump Mode', 'Auto'), ('Headphone Detect Switch', '1')])
+path('main-mic', [('INPGAL Switch', '1'), ('INPGAL Volume', '24'),
+                  ('INPGAL Source', 'IN1'), ('MIXINL PGA Switch', '1'),
+                  ('MIXINL Boost Volume', '2'), ('ADCL Mux', 'ADC'),
+                  ('Capture Switch', '1'), ('Digital Capture Volume', '100'),
+                  ('Mic Bias Switch', '1'), ('Mic Bias Voltage', '0.9 AVDD'),
+                  ('ALC Switch', '1'), ('ALC Mode', 'ALC'), ('ALC Target', '11'),
+                  ('ADC High Pass Filter Switch', '1'), ('Capture Source', 'Mic')])
+path('headset-mic', [('INPGAR Switch', '1'), ('INPGAR Volume', '20'),
+                     ('INPGAR Source', 'IN2'), ('MIXINR PGA Switch', '1'),
+                     ('ADCR Mux', 'ADC'), ('Capture Switch', '1'),
+                     ('Digital Capture Volume', '90'), ('Mic Bias Switch', '1'),
+                     ('Mic Detect Switch', '1'), ('Capture Source', 'Mic')])
+path('dmic', [('DMIC Switch', '1'), ('ADCL Mux', 'DMIC'), ('ADCR Mux', 'DMIC'),
+              ('INPGAL Source', 'DMIC'), ('INPGAR Source', 'DMIC'),
+              ('Capture Switch', '1'), ('Capture Source', 'Digital')])
+path('earpiece', [('path', 'dac-left')] + out_path('EAROUT', ['DACL']) +
+     [('Earpiece Switch', '1'), ('Earpiece Volume', '45'), ('DAC Mono Switch', '1')])
+path('line-out', [('path', 'dac-left'), ('path', 'dac-right')] +
+     out_path('LINEOUTL', ['DACL']) + out_path('LINEOUTR', ['DACR']) +
+     [('Lineout Switch', '1'), ('Lineout Volume', '57')])
+path('line-in', out_path('HPOUTL', ['IN3L']) + out_path('HPOUTR', ['IN3R']) +
+     [('INPGAL Source', 'IN3'), ('INPGAR Source', 'IN3'), ('Capture Source', 'Line')])
+path('mono-out', out_path('MONOOUT', ['DACL', 'DACR']) +
+     [('DAC Mono Switch', '1'), ('DACL Mux', 'Mono')])
+path('sidetone', [('Sidetone Switch', '1'), ('Sidetone Volume', '6')] +
+     out_path('HPOUTL', ['MIXINL']) + out_path('HPOUTR', ['MIXINR']))
+path('loopback', [('Loopback Switch', '1'), ('ADCL Mux', 'Loopback'),
+                  ('ADCR Mux', 'Loopback')])
+path('beep', [('Beep Switch', '1'), ('Beep Volume', '30')] +
+     out_path('SPKOUTL', ['Beep']) + out_path('HPOUTL', ['Beep']))
+path('tone', out_path('SPKOUTL', ['Tone']) + out_path('SPKOUTR', ['Tone']))
+path('voice-call', [('path', 'earpiece'), ('path', 'main-mic'), ('path', 'sidetone'),
+                    ('Noise Gate Switch', '1'), ('Noise Gate Threshold', '4')])
+path('voice-call-speaker', [('path', 'speaker'), ('path', 'main-mic'),
+                            ('Noise Gate Switch', '1'), ('Noise Gate Threshold', '2')])
+path('voice-call-headset', [('path', 'headphone'), ('path', 'headset-mic'),
+                            ('path', 'sidetone')])
+path('bt-sco', [('DACL Mux', 'Mono'), ('DACR Mux', 'Off'), ('ADCL Mux', 'Loopback'),
+                ('ADC Mono Switch', '1')])
+path('speaker-and-headphone', [('path', 'speaker')] +
+     out_path('HPOUTL', ['DACL']) + out_path('HPOUTR', ['DACR']) +
+     [('Headphone Switch', '1'), ('Headphone Volume', '40')])
+path('hifi', [('DAC Oversampling', '128x'), ('DAC Deemphasis', '0'),
+              ('Playback Deemphasis Switch', '0')])
+path('capture-hifi', [('ADC Oversampling', '128x'), ('ADC High Pass Filter Cut Off', '2')])
+path('speaker-eq-off', [('EQ Switch', '0'), ('DRC Switch', '0'), ('DRC Mode', 'Off')])
+path('camcorder-mic', [('path', 'main-mic'), ('DMIC Switch', '1'), ('ALC Hold Time', '3'),
+                       ('ALC Decay Time', '2')])
+path('mute', [('Speaker Switch', '0'), ('Headphone Switch', '0'),
+              ('Lineout Switch', '0'), ('Earpiece Switch', '0')])
+assert len(paths) == 25
+
+
+def expand(settings):
+    out = []
+    for name, value in settings:
+        if name == 'path':
+            out += expand(dict(paths)[value])
+        else:
+            out.append((name, value))
+    return out
+
+
+for name, settings in paths:
+    flat = [c for c, _ in expand(settings)]
+    assert len(flat) == len(set(flat)), name
+
+state = [c[3] for c in controls]
+for name, value in initial:
+    state[index[name]] = value_of(name, value)
+
+# what select_devices asks for, then the other use cases in and out
+routes = [['speaker'], ['headphone'], ['speaker', 'main-mic'], ['headphone', 'main-mic'],
+          ['speaker-and-headphone'], [], ['voice-call'], ['voice-call-speaker'],
+          ['voice-call-headset'], ['speaker'], ['line-out', 'line-in'],
+          ['earpiece', 'bt-sco'], ['camcorder-mic', 'speaker'], ['headphone', 'hifi'],
+          ['speaker', 'beep', 'tone'], ['mono-out', 'capture-hifi', 'dmic'],
+          ['speaker', 'speaker-eq-off'], ['headset-mic', 'loopback'], ['mute'],
+          ['headphone', 'headset-mic']]
+
+
+def xml_settings(settings, indent):
+    out = ''
+    for name, value in settings:
+        if name == 'path':
+            out += '%s<path name="%s" />\n' % (indent, value)
+        else:
+            out += '%s<ctl name="%s" value="%s" />\n' % (indent, name, value)
+    return out
+
+with open('controls.txt', 'w') as f:
+    f.write('# type\tvalues\tpower on value\tname\tenum strings\n')
+    for name, kind, values, value, enums in controls:
+        f.write('%s\t%d\t%d\t%s\t%s\n' % (kind, values, value, name, ','.join(enums)))
+
+with open('mixer_paths.xml', 'w') as f:
+    f.write('<mixer>\n')
+    f.write(xml_settings(initial, '  '))
+    for name, settings in paths:
+        f.write('  <path name="%s">\n' % name)
+        f.write(xml_settings(settings, '    '))
+        f.write('  </path>\n')
+    f.write('</mixer>\n')
+
+with open('routes.txt', 'w') as f:
+    f.write('# route <paths>, then the value of every control once they are applied\n')
+    for route in routes:
+        values = list(state)
+        for p in route:
+            for name, value in expand(dict(paths)[p]):
+                values[index[name]] = value_of(name, value)
+        f.write('route %s\n' % ' '.join(route))
+        f.write('expect %s\n' % ' '.join(str(v) for v in values))
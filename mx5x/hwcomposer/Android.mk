@@ -21,10 +21,11 @@ ifeq ($(TARGET_HAVE_IMX_HWCOMPOSER),true)
 include $(CLEAR_VARS)
 LOCAL_PRELINK_MODULE := false
 LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
-LOCAL_SHARED_LIBRARIES := liblog libEGL libcutils libutils libui libhardware libhardware_legacy libGLESv1_CM
-LOCAL_SRC_FILES := hwcomposer.cpp hwc_vsync.cpp
+LOCAL_SHARED_LIBRARIES := liblog libEGL libcutils libutils libui libhardware libhardware_legacy libGLESv1_CM libsync
+LOCAL_SRC_FILES := hwcomposer.cpp hwc_vsync.cpp hwc_copybit.cpp
 LOCAL_MODULE := hwcomposer.$(TARGET_BOARD_PLATFORM)
 LOCAL_C_INCLUDES += hardware/imx/mx5x/libgralloc
+LOCAL_C_INCLUDES += hardware/imx/mx5x/libcopybit
 LOCAL_CFLAGS:= -DLOG_TAG=\"hwcomposer\"
 #LOCAL_CFLAGS += -DDEBUG_HWC_VSYNC_TIMING
 
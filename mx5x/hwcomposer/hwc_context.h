@@ -31,12 +31,21 @@
 #include <linux/mxcfb.h>
 #include <linux/ioctl.h>
 #include <EGL/egl.h>
+#define EGL_EGLEXT_PROTOTYPES
+#include <EGL/eglext.h>
 #include "gralloc_priv.h"
+#include "copybit_async.h"
 #include "hwc_vsync.h"
 /*****************************************************************************/
 #define HWC_MAIN_FB "/dev/graphics/fb0"
 
 class VSyncThread;
+struct hwc_context_t;
+
+struct hwc_post_hook_t {
+    fb_post_hook_t hook;
+    struct hwc_context_t* ctx;
+};
 
 struct hwc_context_t {
     hwc_composer_device_1_t device;
@@ -48,6 +57,20 @@ struct hwc_context_t {
     hwc_procs_t* m_callback;
     bool m_vsync_enable;
     sp<VSyncThread> m_vsync_thread;
+
+    /* layers composed by the 2D core, see hwc_copybit.cpp */
+    copybit_async_device_t* m_copybit;
+    private_module_t* m_gralloc;
+    hwc_post_hook_t m_post_hook;
+    hwc_display_contents_1_t* m_post_list;
+    size_t m_copybit_layers;
+    uint32_t m_copybit_token;
+    /* the gles output of the frame, the blits wait for it */
+    EGLDisplay m_gles_dpy;
+    EGLSyncKHR m_gles_sync;
+    /* release fences of the post before last and of the last post */
+    int m_release_fence[2];
+    bool m_posted;
 };
 
 #endif
@@ -0,0 +1,396 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include <unistd.h>
+#include <cutils/log.h>
+#include <hardware/copybit.h>
+#include <sync/sync.h>
+#include <GLES/gl.h>
+
+#include "hwc_context.h"
+#include "hwc_copybit.h"
+
+/*****************************************************************************/
+
+#define HWC_COPYBIT_MAX_SCALE 8
+#define HWC_FENCE_TIMEOUT 1000
+
+struct hwc_blit_region_t {
+    copybit_region_t base;
+    hwc_rect_t const* rects;
+    size_t count;
+    size_t index;
+};
+
+static int hwc_blit_region_next(copybit_region_t const* region, copybit_rect_t* rect)
+{
+    hwc_blit_region_t* r = (hwc_blit_region_t*)region;
+    if (r->index >= r->count) {
+        return 0;
+    }
+
+    hwc_rect_t const* src = &r->rects[r->index++];
+    rect->l = src->left;
+    rect->t = src->top;
+    rect->r = src->right;
+    rect->b = src->bottom;
+    return 1;
+}
+
+static bool hwc_copybit_format(int format)
+{
+    switch (format) {
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+        case HAL_PIXEL_FORMAT_RGB_565:
+            return true;
+        default:
+            // the z430/z160 cores have no yuv input.
+            return false;
+    }
+}
+
+static bool hwc_has_alpha(int format)
+{
+    return format == HAL_PIXEL_FORMAT_RGBA_8888 ||
+           format == HAL_PIXEL_FORMAT_BGRA_8888;
+}
+
+static bool hwc_copybit_supported(hwc_layer_1_t* layer)
+{
+    private_handle_t* hnd = (private_handle_t*)layer->handle;
+
+    if (hnd == NULL || (layer->flags & HWC_SKIP_LAYER)) {
+        return false;
+    }
+
+    if (!hnd->phys || !hwc_copybit_format(hnd->format)) {
+        return false;
+    }
+
+    // copybit blends whenever the source has alpha, so opaque layers
+    // must come without it and blended ones premultiplied.
+    if (layer->blending == HWC_BLENDING_NONE && hwc_has_alpha(hnd->format)) {
+        return false;
+    }
+    if (layer->blending == HWC_BLENDING_COVERAGE) {
+        return false;
+    }
+    // the plane alpha is only applied while blending, and copybit has
+    // none for BGRA.
+    if (layer->planeAlpha < 0xff &&
+        (layer->blending != HWC_BLENDING_PREMULT ||
+         hnd->format != HAL_PIXEL_FORMAT_RGBA_8888)) {
+        return false;
+    }
+
+    int srcw = layer->sourceCrop.right - layer->sourceCrop.left;
+    int srch = layer->sourceCrop.bottom - layer->sourceCrop.top;
+    int dstw = layer->displayFrame.right - layer->displayFrame.left;
+    int dsth = layer->displayFrame.bottom - layer->displayFrame.top;
+    switch (layer->transform) {
+        case 0:
+        case HWC_TRANSFORM_FLIP_H:
+        case HWC_TRANSFORM_FLIP_V:
+        case HWC_TRANSFORM_ROT_180:
+            break;
+        case HWC_TRANSFORM_ROT_90:
+        case HWC_TRANSFORM_ROT_270: {
+            int tmp = dstw;
+            dstw = dsth;
+            dsth = tmp;
+            break;
+        }
+        default:
+            return false;
+    }
+
+    if (srcw <= 0 || srch <= 0 || dstw <= 0 || dsth <= 0) {
+        return false;
+    }
+    if (srcw > dstw * HWC_COPYBIT_MAX_SCALE || dstw > srcw * HWC_COPYBIT_MAX_SCALE ||
+        srch > dsth * HWC_COPYBIT_MAX_SCALE || dsth > srch * HWC_COPYBIT_MAX_SCALE) {
+        return false;
+    }
+
+    return true;
+}
+
+static void hwc_fill_image(copybit_image_t* img, private_handle_t* hnd)
+{
+    img->w = hnd->width;
+    img->h = hnd->height;
+    img->format = hnd->format;
+    img->base = (void*)hnd->base;
+    img->handle = (native_handle_t*)hnd;
+}
+
+/* the 2D core does not see what the 3D one still has to write, the
+ * blits go over the gles output once its fence signaled. */
+static void hwc_gles_wait(struct hwc_context_t* ctx)
+{
+    if (ctx->m_gles_sync == EGL_NO_SYNC_KHR) {
+        return;
+    }
+
+    EGLint status = eglClientWaitSyncKHR(ctx->m_gles_dpy, ctx->m_gles_sync,
+            EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, HWC_FENCE_TIMEOUT * 1000000ULL);
+    if (status != EGL_CONDITION_SATISFIED_KHR) {
+        ALOGW("<%s,%d> gles fence not signaled: 0x%x", __FUNCTION__, __LINE__, status);
+    }
+    eglDestroySyncKHR(ctx->m_gles_dpy, ctx->m_gles_sync);
+    ctx->m_gles_sync = EGL_NO_SYNC_KHR;
+}
+
+/* called from fb_post, inside eglSwapBuffers of hwc_set. hwc_copybit_set
+ * waited for the layers and fenced the gles output before. */
+static int hwc_copybit_compose(fb_post_hook_t* hook, buffer_handle_t buffer,
+        uint32_t* token)
+{
+    struct hwc_context_t* ctx = ((hwc_post_hook_t*)hook)->ctx;
+    hwc_display_contents_1_t* list = ctx->m_post_list;
+    private_handle_t* target = (private_handle_t*)buffer;
+    copybit_device_t* copybit = &ctx->m_copybit->copybit;
+    int queued = 0;
+
+    if (list == NULL) {
+        return 0;
+    }
+
+    hwc_gles_wait(ctx);
+    if (!target->phys || !hwc_copybit_format(target->format)) {
+        return 0;
+    }
+
+    copybit_image_t dst;
+    hwc_fill_image(&dst, target);
+    for (size_t i = 0; i < list->numHwLayers; i++) {
+        hwc_layer_1_t* layer = &list->hwLayers[i];
+        if (layer->compositionType != HWC_OVERLAY) {
+            continue;
+        }
+
+        copybit_image_t src;
+        hwc_fill_image(&src, (private_handle_t*)layer->handle);
+        copybit_rect_t srcRect = { layer->sourceCrop.left, layer->sourceCrop.top,
+                                   layer->sourceCrop.right, layer->sourceCrop.bottom };
+        copybit_rect_t dstRect = { layer->displayFrame.left, layer->displayFrame.top,
+                                   layer->displayFrame.right, layer->displayFrame.bottom };
+        hwc_blit_region_t region;
+        region.base.next = hwc_blit_region_next;
+        region.rects = layer->visibleRegionScreen.rects;
+        region.count = layer->visibleRegionScreen.numRects;
+        region.index = 0;
+
+        copybit->set_parameter(copybit, COPYBIT_TRANSFORM, layer->transform);
+        copybit->set_parameter(copybit, COPYBIT_PLANE_ALPHA, layer->planeAlpha);
+        int err = ctx->m_copybit->stretch_async(ctx->m_copybit, &dst, &src,
+                &dstRect, &srcRect, &region.base, token);
+        if (err) {
+            ALOGE("<%s,%d> stretch of layer %zu failed %d", __FUNCTION__, __LINE__, i, err);
+            continue;
+        }
+        queued = 1;
+    }
+
+    if (queued) {
+        ctx->m_copybit_token = *token;
+    }
+    return queued;
+}
+
+/* called from the gralloc flip thread before the buffer is shown */
+static void hwc_copybit_wait(fb_post_hook_t* hook, uint32_t token)
+{
+    struct hwc_context_t* ctx = ((hwc_post_hook_t*)hook)->ctx;
+    ctx->m_copybit->wait(ctx->m_copybit, token);
+}
+
+/* called from fb_post once the flip is queued, for every post. the fence
+ * signals when the buffer leaves the screen, so the fence of the post
+ * before signals with this flip. */
+static void hwc_copybit_posted(fb_post_hook_t* hook, int releaseFence)
+{
+    struct hwc_context_t* ctx = ((hwc_post_hook_t*)hook)->ctx;
+
+    if (ctx->m_release_fence[0] >= 0) {
+        close(ctx->m_release_fence[0]);
+    }
+    ctx->m_release_fence[0] = ctx->m_release_fence[1];
+    ctx->m_release_fence[1] = releaseFence;
+    ctx->m_posted = releaseFence >= 0;
+}
+
+int hwc_copybit_open(struct hwc_context_t* ctx)
+{
+    const hw_module_t* module;
+    copybit_device_t* copybit;
+
+    ctx->m_gles_sync = EGL_NO_SYNC_KHR;
+    ctx->m_release_fence[0] = -1;
+    ctx->m_release_fence[1] = -1;
+
+    if (hw_get_module(COPYBIT_HARDWARE_MODULE_ID, &module) != 0 ||
+        copybit_open(module, &copybit) != 0) {
+        ALOGI("<%s,%d> no copybit, gles composes every layer", __FUNCTION__, __LINE__);
+        return -ENODEV;
+    }
+
+    if (copybit->common.version < COPYBIT_ASYNC_DEVICE_VERSION) {
+        ALOGI("<%s,%d> copybit is synchronous, not used", __FUNCTION__, __LINE__);
+        copybit_close(copybit);
+        return -ENODEV;
+    }
+
+    if (hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &module) != 0) {
+        copybit_close(copybit);
+        return -ENODEV;
+    }
+
+    ctx->m_copybit = (copybit_async_device_t*)copybit;
+    ctx->m_gralloc = (private_module_t*)module;
+    ctx->m_post_hook.hook.compose = hwc_copybit_compose;
+    ctx->m_post_hook.hook.wait = hwc_copybit_wait;
+    ctx->m_post_hook.hook.posted = hwc_copybit_posted;
+    ctx->m_post_hook.ctx = ctx;
+    ctx->m_gralloc->postHook = &ctx->m_post_hook.hook;
+
+    return 0;
+}
+
+void hwc_copybit_close(struct hwc_context_t* ctx)
+{
+    if (ctx->m_copybit == NULL) {
+        return;
+    }
+
+    ctx->m_gralloc->postHook = NULL;
+    ctx->m_copybit->wait(ctx->m_copybit, ctx->m_copybit_token);
+    for (int i = 0; i < 2; i++) {
+        if (ctx->m_release_fence[i] >= 0) {
+            close(ctx->m_release_fence[i]);
+            ctx->m_release_fence[i] = -1;
+        }
+    }
+    copybit_close(&ctx->m_copybit->copybit);
+    ctx->m_copybit = NULL;
+}
+
+static void hwc_wait_fence(int *fd)
+{
+    if (*fd < 0) {
+        return;
+    }
+
+    if (sync_wait(*fd, HWC_FENCE_TIMEOUT) < 0) {
+        ALOGW("%s wait fence %d failed", __FUNCTION__, *fd);
+    }
+    close(*fd);
+    *fd = -1;
+}
+
+void hwc_copybit_set(struct hwc_context_t* ctx, hwc_display_contents_1_t* list)
+{
+    if (list == NULL) {
+        return;
+    }
+
+    // the 2D core reads the buffers as soon as the blits are queued,
+    // they must be complete by then.
+    for (size_t i = 0; i < list->numHwLayers; i++) {
+        hwc_layer_1_t* layer = &list->hwLayers[i];
+        if (layer->compositionType == HWC_OVERLAY) {
+            hwc_wait_fence(&layer->acquireFenceFd);
+        }
+        layer->releaseFenceFd = -1;
+    }
+
+    // the post hook waits for this, not for the gles commands that come
+    // with eglSwapBuffers or the next frame.
+    ctx->m_posted = false;
+    ctx->m_gles_dpy = (EGLDisplay)list->dpy;
+    ctx->m_gles_sync = eglCreateSyncKHR(ctx->m_gles_dpy, EGL_SYNC_FENCE_KHR, NULL);
+    if (ctx->m_gles_sync == EGL_NO_SYNC_KHR) {
+        glFinish();
+    }
+}
+
+void hwc_copybit_done(struct hwc_context_t* ctx, hwc_display_contents_1_t* list)
+{
+    // the swap failed before the post
+    if (ctx->m_gles_sync != EGL_NO_SYNC_KHR) {
+        eglDestroySyncKHR(ctx->m_gles_dpy, ctx->m_gles_sync);
+        ctx->m_gles_sync = EGL_NO_SYNC_KHR;
+    }
+
+    // a post that waited for its flip is done with the blits
+    if (!ctx->m_posted) {
+        return;
+    }
+    ctx->m_posted = false;
+
+    // the blits are done once this flip is, when the fence of the post
+    // before signals. the first post has none, it waits for them here.
+    int fence = ctx->m_release_fence[0];
+    if (fence < 0) {
+        ctx->m_copybit->wait(ctx->m_copybit, ctx->m_copybit_token);
+        return;
+    }
+    for (size_t i = 0; i < list->numHwLayers; i++) {
+        hwc_layer_1_t* layer = &list->hwLayers[i];
+        if (layer->compositionType == HWC_OVERLAY) {
+            layer->releaseFenceFd = dup(fence);
+        }
+    }
+}
+
+size_t hwc_copybit_prepare(struct hwc_context_t* ctx,
+        hwc_display_contents_1_t* list)
+{
+    size_t claimed = 0;
+
+    if (ctx->m_copybit == NULL || list == NULL ||
+        ctx->m_gralloc->framebuffer == NULL) {
+        return 0;
+    }
+
+    // the post returned with its flip queued, the buffer gles may draw
+    // into next is off screen once the flip of the post before is done.
+    hwc_wait_fence(&ctx->m_release_fence[0]);
+
+    // only this hwc hands out overlays, take back last frame's choice
+    // as surfaceflinger keeps it until the geometry changes.
+    for (size_t i = 0; i < list->numHwLayers; i++) {
+        if (list->hwLayers[i].compositionType == HWC_OVERLAY) {
+            list->hwLayers[i].compositionType = HWC_FRAMEBUFFER;
+        }
+    }
+
+    // blits go over the gles output, so only a run of layers on top of
+    // the stack can be taken. the bottom layer always stays with gles
+    // to have a frame posted at all.
+    for (size_t i = list->numHwLayers; i-- > 1; ) {
+        hwc_layer_1_t* layer = &list->hwLayers[i];
+        if (layer->compositionType != HWC_FRAMEBUFFER ||
+            !hwc_copybit_supported(layer)) {
+            break;
+        }
+        layer->compositionType = HWC_OVERLAY;
+        claimed++;
+    }
+
+    return claimed;
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef HWC_COPYBIT_H_
+#define HWC_COPYBIT_H_
+
+#include "hwc_context.h"
+
+/* The topmost simple RGB layers are marked HWC_OVERLAY and blitted by
+ * the 2D core over the gles output when it is posted, the flip waits for
+ * the blits before the buffer goes on screen. The post returns once the
+ * flip is queued, the release fences it hands back keep the framebuffer
+ * and the layers busy until the flip is done. */
+int hwc_copybit_open(struct hwc_context_t* ctx);
+void hwc_copybit_close(struct hwc_context_t* ctx);
+size_t hwc_copybit_prepare(struct hwc_context_t* ctx,
+        hwc_display_contents_1_t* list);
+/* waits for the acquire fences of the layers kept for the 2D core and
+ * fences the gles output, before eglSwapBuffers */
+void hwc_copybit_set(struct hwc_context_t* ctx, hwc_display_contents_1_t* list);
+/* hands the release fences of the post to the layers, after it */
+void hwc_copybit_done(struct hwc_context_t* ctx, hwc_display_contents_1_t* list);
+
+#endif
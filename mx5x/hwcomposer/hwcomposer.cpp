@@ -35,6 +35,7 @@
 #include "gralloc_priv.h"
 #include "hwc_context.h"
 #include "hwc_vsync.h"
+#include "hwc_copybit.h"
 
 /*****************************************************************************/
 static int hwc_device_open(const struct hw_module_t* module, const char* name,
@@ -78,6 +79,13 @@ static void dump_layer(hwc_layer_1_t const* l) {
 static int hwc_prepare(hwc_composer_device_1_t *dev,
         size_t numDisplays, hwc_display_contents_1_t** displays)
 {
+    struct hwc_context_t *ctx = (struct hwc_context_t *)dev;
+
+    if (!displays || numDisplays == 0) {
+        return 0;
+    }
+
+    ctx->m_copybit_layers = hwc_copybit_prepare(ctx, displays[0]);
     return 0;
 }
 
@@ -90,8 +98,18 @@ static int hwc_set(hwc_composer_device_1_t *dev,
     unsigned int i;
 
     if (displays[0]->dpy !=NULL && displays[0]->sur !=NULL) {
+        // layers kept for the 2D core are queued when gralloc gets the
+        // buffer from eglSwapBuffers, over what gles rendered into it.
+        if (ctx->m_copybit_layers) {
+            hwc_copybit_set(ctx, displays[0]);
+        }
+        ctx->m_post_list = ctx->m_copybit_layers ? displays[0] : NULL;
         success = eglSwapBuffers((EGLDisplay)displays[0]->dpy,
             (EGLSurface)displays[0]->sur);;
+        ctx->m_post_list = NULL;
+        if (ctx->m_copybit_layers) {
+            hwc_copybit_done(ctx, displays[0]);
+        }
     }
 
     if ( displays != NULL) {
@@ -136,6 +154,7 @@ static int hwc_device_close(struct hw_device_t *dev)
         if(ctx->m_vsync_thread != NULL) {
             ctx->m_vsync_thread->requestExitAndWait();
         }
+        hwc_copybit_close(ctx);
         free(ctx);
     }
     return 0;
@@ -269,6 +288,7 @@ static int hwc_device_open(const struct hw_module_t* module, const char* name,
         dev->m_mainfb_fd = open(HWC_MAIN_FB, O_RDWR);
         dev->m_vsync_thread = new VSyncThread(dev);
         hwc_get_framebuffer_info(dev);
+        hwc_copybit_open(dev);
 
 nor_exit:
 
@@ -24,7 +24,7 @@ include $(CLEAR_VARS)
 LOCAL_PRELINK_MODULE := true
 LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
 LOCAL_C_INCLUDES += hardware/imx/mx5x/libgralloc
-LOCAL_SHARED_LIBRARIES := liblog
+LOCAL_SHARED_LIBRARIES := liblog libcutils libhardware
 ifeq ($(BOARD_SOC_TYPE),IMX50)
 LOCAL_SHARED_LIBRARIES += libc2d_z160
 else
@@ -44,3 +44,19 @@ include $(BUILD_SHARED_LIBRARY)
 endif
 endif
 endif
+
+# the surface cache and region batching against a recording C2D, run on
+# the host: out/host/<os>-<arch>/bin/copybit_test
+LOCAL_PATH := $(call my-dir)
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := 	\
+	copybit.cpp	\
+	tests/c2d_fake.cpp	\
+	tests/copybit_test.cpp
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/tests hardware/imx/mx5x/libgralloc hardware/imx/libimxtest
+LOCAL_CFLAGS := -DLOG_TAG=\"copybit\" -D_LINUX
+LOCAL_STATIC_LIBRARIES := libimxtest_host libcutils liblog
+LOCAL_LDLIBS := -lpthread
+LOCAL_MODULE := copybit_test
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
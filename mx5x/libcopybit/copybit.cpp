@@ -20,10 +20,13 @@
 #define LOG_TAG "copybit"
 
 #include <cutils/log.h>
+#include <cutils/atomic.h>
+#include <cutils/properties.h>
  
 #include <c2d_api.h>
 
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
@@ -32,15 +35,20 @@
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/mman.h>
+#include <time.h>
 
 #include <hardware/copybit.h>
 
 #include "gralloc_priv.h"
+#include "copybit_async.h"
 
 
 /******************************************************************************/
 #define MAX_SCALE_FACTOR    (8)
 #define MDP_ALPHA_NOP 0xff
+#define SURFACE_CACHE_SIZE  (8)
+#define MAX_BLIT_RECTS      (32)
+#define BLIT_STATS_COUNT    (300)
 /******************************************************************************/
 
 /* mFlags bit define */
@@ -55,14 +63,43 @@ enum {
     C2D_ALPHA_BLEND = 0x8,
 };
 
+/** C2D surface wrapping a gralloc buffer, reused while the buffer lives */
+struct c2d_surface_cache_t {
+    C2D_SURFACE surface;
+    void*   phys;
+    void*   host;
+    int     width;
+    int     height;
+    int     stride;
+    int     format;
+    uint32_t lastUse;
+};
+
 /** State information for each device instance */
 struct copybit_context_t {
-    struct copybit_device_t device;
+    struct copybit_async_device_t device;
     C2D_CONTEXT c2dctx;
     int     mCache;
     uint32_t mAlpha;
     uint32_t mRotate;    
     uint32_t mFlags;
+
+    /* blits may be queued by one thread and waited for by another */
+    pthread_mutex_t mLock;
+    uint32_t mSubmitted;
+    uint32_t mCompleted;
+
+    private_module_t* gralloc;
+    int32_t mFreeCount;
+    uint32_t mUseCount;
+    c2d_surface_cache_t mSurfaces[SURFACE_CACHE_SIZE];
+
+    /* blit cost, logged with debug.copybit.stats */
+    int     mStats;
+    uint32_t mBlits;
+    uint32_t mRects;
+    uint32_t mSurfAllocs;
+    int64_t mBlitTime;
 };
 
 
@@ -290,6 +327,121 @@ static void image_to_surface(copybit_image_t const *img, C2D_SURFACE_DEF *surfac
     surfaceDef->flags = C2D_SURFACE_NO_BUFFER_ALLOC;
 }
 
+/** wait for everything queued so far */
+static void finish_copybit(struct copybit_context_t *ctx)
+{
+    if (ctx->mCompleted != ctx->mSubmitted) {
+        c2dFinish(ctx->c2dctx);
+        ctx->mCompleted = ctx->mSubmitted;
+    }
+}
+
+/** drop every cached surface */
+static void flush_surfaces(struct copybit_context_t *ctx)
+{
+    finish_copybit(ctx);
+    for (int i = 0; i < SURFACE_CACHE_SIZE; i++) {
+        c2d_surface_cache_t *entry = &ctx->mSurfaces[i];
+        if (entry->surface != NULL) {
+            c2dSurfFree(ctx->c2dctx, entry->surface);
+        }
+        memset(entry, 0, sizeof(*entry));
+    }
+}
+
+/** buffers released by gralloc may come back at the same address with
+    another layout, forget the cached surfaces once anything is freed */
+static void check_surfaces(struct copybit_context_t *ctx)
+{
+    if (ctx->gralloc == NULL) {
+        return;
+    }
+
+    int32_t freeCount = android_atomic_acquire_load(&ctx->gralloc->freeCount);
+    if (freeCount != ctx->mFreeCount) {
+        flush_surfaces(ctx);
+        ctx->mFreeCount = freeCount;
+    }
+}
+
+/** find or create the C2D surface of an image, least recently used
+    entries are replaced once the cache is full */
+static C2D_SURFACE get_surface(struct copybit_context_t *ctx,
+                               copybit_image_t const *img)
+{
+    C2D_SURFACE_DEF surfaceDef;
+    c2d_surface_cache_t *victim = &ctx->mSurfaces[0];
+
+    image_to_surface(img, &surfaceDef);
+    ctx->mUseCount++;
+    for (int i = 0; i < SURFACE_CACHE_SIZE; i++) {
+        c2d_surface_cache_t *entry = &ctx->mSurfaces[i];
+        if (entry->surface != NULL &&
+            entry->phys == surfaceDef.buffer &&
+            entry->host == surfaceDef.host &&
+            entry->width == (int)surfaceDef.width &&
+            entry->height == (int)surfaceDef.height &&
+            entry->stride == (int)surfaceDef.stride &&
+            entry->format == (int)surfaceDef.format) {
+            entry->lastUse = ctx->mUseCount;
+            return entry->surface;
+        }
+        if (entry->surface == NULL ||
+            (victim->surface != NULL && entry->lastUse < victim->lastUse)) {
+            victim = entry;
+        }
+    }
+
+    if (victim->surface != NULL) {
+        // a queued blit may still use it
+        finish_copybit(ctx);
+        c2dSurfFree(ctx->c2dctx, victim->surface);
+        victim->surface = NULL;
+    }
+
+    C2D_SURFACE surface;
+    if (c2dSurfAlloc(ctx->c2dctx, &surface, &surfaceDef) != C2D_STATUS_OK) {
+        return NULL;
+    }
+    ctx->mSurfAllocs++;
+
+    victim->surface = surface;
+    victim->phys = surfaceDef.buffer;
+    victim->host = surfaceDef.host;
+    victim->width = surfaceDef.width;
+    victim->height = surfaceDef.height;
+    victim->stride = surfaceDef.stride;
+    victim->format = surfaceDef.format;
+    victim->lastUse = ctx->mUseCount;
+    return surface;
+}
+
+static int64_t now_ns()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static void blit_stats(struct copybit_context_t *ctx, int64_t start)
+{
+    ctx->mBlits++;
+    ctx->mBlitTime += now_ns() - start;
+    if (ctx->mBlits < BLIT_STATS_COUNT) {
+        return;
+    }
+
+    if (ctx->mStats) {
+        ALOGD("%u blits, %u rects, %u surface allocs, avg %lld us per blit",
+              ctx->mBlits, ctx->mRects, ctx->mSurfAllocs,
+              ctx->mBlitTime / ctx->mBlits / 1000);
+    }
+    ctx->mBlits = 0;
+    ctx->mRects = 0;
+    ctx->mSurfAllocs = 0;
+    ctx->mBlitTime = 0;
+}
+
 /** setup rectangles */
 static void set_rects(struct copybit_context_t *dev,
                       C2D_RECT *srcRect,
@@ -331,22 +483,21 @@ static void set_rects(struct copybit_context_t *dev,
     }
 }
 
-/** do a stretch blit type operation */
-static int stretch_copybit(
-        struct copybit_device_t *dev,
+/** queue a stretch blit type operation, the caller holds mLock and
+    decides whether to wait for the 2D core */
+static int submit_copybit(
+        struct copybit_context_t *ctx,
         struct copybit_image_t const *dst,
         struct copybit_image_t const *src,
         struct copybit_rect_t const *dst_rect,
         struct copybit_rect_t const *src_rect,
         struct copybit_region_t const *region) 
 {
-    struct copybit_context_t* ctx = (struct copybit_context_t*)dev;
-    C2D_SURFACE_DEF srcSurfaceDef;
-    C2D_SURFACE_DEF dstSurfaceDef;
     C2D_SURFACE srcSurface;
     C2D_SURFACE dstSurface;    
-    C2D_RECT srcRect;
-    C2D_RECT dstRect;
+    C2D_RECT srcRects[MAX_BLIT_RECTS];
+    C2D_RECT dstRects[MAX_BLIT_RECTS];
+    int numRects = 0;
     int status = 0;
 
     if (ctx) {
@@ -373,19 +524,18 @@ static int stretch_copybit(
         struct copybit_rect_t clip;
         status = 0;
 
-
-        image_to_surface(src, &srcSurfaceDef);
-        if (c2dSurfAlloc(ctx->c2dctx, &srcSurface, &srcSurfaceDef) != C2D_STATUS_OK)
+        check_surfaces(ctx);
+        srcSurface = get_surface(ctx, src);
+        if (srcSurface == NULL)
         {
             ALOGE("srcSurface c2dSurfAlloc fail");
             return -EINVAL;
         }
                 
-        image_to_surface(dst, &dstSurfaceDef);
-        if (c2dSurfAlloc(ctx->c2dctx, &dstSurface, &dstSurfaceDef) != C2D_STATUS_OK)
+        dstSurface = get_surface(ctx, dst);
+        if (dstSurface == NULL)
         {
             ALOGE("dstSurface c2dSurfAlloc fail");
-            c2dSurfFree(ctx->c2dctx, srcSurface);
             return -EINVAL;
         }
 
@@ -404,28 +554,40 @@ static int stretch_copybit(
         c2dSetGlobalAlpha(ctx->c2dctx, ctx->mAlpha);  
         c2dSetDither(ctx->c2dctx, (ctx->mFlags & C2D_DITHER) > 0 ? 1:0); 
 
-        while ((status == 0) && region->next(region, &clip)) {          
+        // clip the whole region first, then queue every rect and wait
+        // for the 2D core only once.
+        while (region->next(region, &clip)) {          
+                C2D_RECT *srcRect = &srcRects[numRects];
+                C2D_RECT *dstRect = &dstRects[numRects];
+
                 intersect(&clip, &bounds, &clip);
-                set_rects(ctx, &srcRect, &dstRect, dst_rect, src_rect, &clip, src);
-                if (srcRect.width<=0 || srcRect.height<=0)
+                set_rects(ctx, srcRect, dstRect, dst_rect, src_rect, &clip, src);
+                if (srcRect->width<=0 || srcRect->height<=0 ||
+                    dstRect->width<=0 || dstRect->height<=0)
                 {
-                        ALOGE("srcRect invalid");
                         continue;
                 }
-                if (dstRect.width<=0 || dstRect.height<=0)
+
+                if (++numRects == MAX_BLIT_RECTS)
                 {
-                        ALOGE("dstRect invalid");
-                        continue;
+                        for (int i = 0; i < numRects; i++) {
+                                c2dSetSrcRectangle(ctx->c2dctx, &srcRects[i]);
+                                c2dSetDstRectangle(ctx->c2dctx, &dstRects[i]);
+                                c2dDrawBlit(ctx->c2dctx);
+                        }
+                        c2dFlush(ctx->c2dctx);
+                        ctx->mRects += numRects;
+                        numRects = 0;
                 }
+        }
 
-                c2dSetSrcRectangle(ctx->c2dctx, &srcRect);
-                c2dSetDstRectangle(ctx->c2dctx, &dstRect);      
+        for (int i = 0; i < numRects; i++) {
+                c2dSetSrcRectangle(ctx->c2dctx, &srcRects[i]);
+                c2dSetDstRectangle(ctx->c2dctx, &dstRects[i]);
                 c2dDrawBlit(ctx->c2dctx); 
         }
-
-		c2dFinish(ctx->c2dctx);
-		c2dSurfFree(ctx->c2dctx, srcSurface);
-		c2dSurfFree(ctx->c2dctx, dstSurface);
+        ctx->mRects += numRects;
+        ctx->mSubmitted++;
 
     } 
     else {
@@ -436,6 +598,75 @@ static int stretch_copybit(
     return status;
 }
 
+/** do a stretch blit type operation */
+static int stretch_copybit(
+        struct copybit_device_t *dev,
+        struct copybit_image_t const *dst,
+        struct copybit_image_t const *src,
+        struct copybit_rect_t const *dst_rect,
+        struct copybit_rect_t const *src_rect,
+        struct copybit_region_t const *region) 
+{
+    struct copybit_context_t* ctx = (struct copybit_context_t*)dev;
+    if (!ctx) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&ctx->mLock);
+    int64_t start = now_ns();
+    int status = submit_copybit(ctx, dst, src, dst_rect, src_rect, region);
+    finish_copybit(ctx);
+    blit_stats(ctx, start);
+    pthread_mutex_unlock(&ctx->mLock);
+
+    return status;
+}
+
+/** queue a stretch blit and return without waiting for it, *token is
+    handed to wait_copybit later */
+static int stretch_async_copybit(
+        struct copybit_async_device_t *dev,
+        struct copybit_image_t const *dst,
+        struct copybit_image_t const *src,
+        struct copybit_rect_t const *dst_rect,
+        struct copybit_rect_t const *src_rect,
+        struct copybit_region_t const *region,
+        uint32_t *token)
+{
+    struct copybit_context_t* ctx = (struct copybit_context_t*)dev;
+    if (!ctx || !token) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&ctx->mLock);
+    int64_t start = now_ns();
+    int status = submit_copybit(ctx, dst, src, dst_rect, src_rect, region);
+    c2dFlush(ctx->c2dctx);
+    *token = ctx->mSubmitted;
+    blit_stats(ctx, start);
+    pthread_mutex_unlock(&ctx->mLock);
+
+    return status;
+}
+
+/** block until the blit identified by token is done. C2D only waits for
+    the whole queue, so later blits complete along with it. */
+static int wait_copybit(struct copybit_async_device_t *dev, uint32_t token)
+{
+    struct copybit_context_t* ctx = (struct copybit_context_t*)dev;
+    if (!ctx) {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&ctx->mLock);
+    if ((int32_t)(token - ctx->mCompleted) > 0) {
+        finish_copybit(ctx);
+    }
+    pthread_mutex_unlock(&ctx->mLock);
+
+    return 0;
+}
+
 /** Perform a blit type operation */
 /* Pay attention, from now on blit_copybit will only work on C2D_ALPHA_BLEND_NONE mode,
  if need C2D_ALPHA_BLEND_SRCOVER mode pls use stretch_copybit */
@@ -468,8 +699,11 @@ static int close_copybit(struct hw_device_t *dev)
     struct copybit_context_t* ctx = (struct copybit_context_t*)dev;
     if (ctx) {
         C2D_STATUS c2dstatus;
-        if (ctx->c2dctx != NULL)
+        if (ctx->c2dctx != NULL) {
+            flush_surfaces(ctx);
         	c2dstatus = c2dDestroyContext(ctx->c2dctx);
+        }
+        pthread_mutex_destroy(&ctx->mLock);
         free(ctx);
     }
     return 0;
@@ -485,24 +719,39 @@ static int open_copybit(const struct hw_module_t* module, const char* name,
     ctx = (copybit_context_t *)malloc(sizeof(copybit_context_t));
     memset(ctx, 0, sizeof(*ctx));
 
-    ctx->device.common.tag = HARDWARE_DEVICE_TAG;
-    ctx->device.common.version = 1;
-    ctx->device.common.module = const_cast<hw_module_t*>(module);
-    ctx->device.common.close = close_copybit;
-    ctx->device.set_parameter = set_parameter_copybit;
-    ctx->device.get = get;
-    ctx->device.blit = blit_copybit;
-    ctx->device.stretch = stretch_copybit;
+    ctx->device.copybit.common.tag = HARDWARE_DEVICE_TAG;
+    ctx->device.copybit.common.version = COPYBIT_ASYNC_DEVICE_VERSION;
+    ctx->device.copybit.common.module = const_cast<hw_module_t*>(module);
+    ctx->device.copybit.common.close = close_copybit;
+    ctx->device.copybit.set_parameter = set_parameter_copybit;
+    ctx->device.copybit.get = get;
+    ctx->device.copybit.blit = blit_copybit;
+    ctx->device.copybit.stretch = stretch_copybit;
+    ctx->device.stretch_async = stretch_async_copybit;
+    ctx->device.wait = wait_copybit;
+    pthread_mutex_init(&ctx->mLock, NULL);
     ctx->mAlpha = MDP_ALPHA_NOP;
     ctx->mFlags |= C2D_ALPHA_BLEND;
+
+    // gralloc counts the buffers it frees, cached surfaces are dropped
+    // whenever that changes.
+    const hw_module_t *gralloc;
+    if (hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &gralloc) == 0) {
+        ctx->gralloc = (private_module_t *)gralloc;
+        ctx->mFreeCount = android_atomic_acquire_load(&ctx->gralloc->freeCount);
+    }
+
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.copybit.stats", value, "0");
+    ctx->mStats = atoi(value);
      
     C2D_STATUS c2dstatus;
     c2dstatus = c2dCreateContext(&ctx->c2dctx);
     if (c2dstatus != C2D_STATUS_OK)
-        close_copybit(&ctx->device.common);
+        close_copybit(&ctx->device.copybit.common);
     else
     {
-        *device = &ctx->device.common;
+        *device = &ctx->device.copybit.common;
         status = 0;
     }
 
@@ -0,0 +1,47 @@
+/*
+ * Copyright 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ */
+
+/*
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COPYBIT_ASYNC_H_
+#define COPYBIT_ASYNC_H_
+
+#include <stdint.h>
+#include <hardware/copybit.h>
+
+/** copybit devices reporting this version in common.version can be cast
+    to copybit_async_device_t */
+#define COPYBIT_ASYNC_DEVICE_VERSION    2
+
+/** Asynchronous extension of the copybit device. stretch_async queues
+    the blit on the 2D core and returns a completion token right away,
+    wait blocks until the blit of that token is done. Tokens increase
+    with every blit, waiting for one also covers the ones before it. */
+struct copybit_async_device_t {
+    struct copybit_device_t copybit;
+
+    int (*stretch_async)(struct copybit_async_device_t *dev,
+                         struct copybit_image_t const *dst,
+                         struct copybit_image_t const *src,
+                         struct copybit_rect_t const *dst_rect,
+                         struct copybit_rect_t const *src_rect,
+                         struct copybit_region_t const *region,
+                         uint32_t *token);
+
+    int (*wait)(struct copybit_async_device_t *dev, uint32_t token);
+};
+
+#endif /* COPYBIT_ASYNC_H_ */
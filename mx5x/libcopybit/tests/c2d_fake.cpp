@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* C2D for the host tests: it draws nothing and records the calls. Blits
+ * are queued until c2dFinish, a surface freed while a queued blit still
+ * uses it is counted as an error, as is a blit without both surfaces or
+ * with a rect outside of them. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "c2d_fake.h"
+
+struct c2d_fake_surface {
+    C2D_SURFACE_DEF def;
+    /* blits using the surface not finished yet */
+    int pending;
+};
+
+struct c2d_fake_context {
+    c2d_fake_surface *src;
+    c2d_fake_surface *dst;
+    C2D_RECT srcRect;
+    C2D_RECT dstRect;
+    /* surfaces used by the queued blits */
+    c2d_fake_surface *queued[2 * C2D_FAKE_MAX_RECTS];
+    int numQueued;
+};
+
+struct c2d_fake_stats c2d_fake;
+
+void c2d_fake_reset()
+{
+    int surfaces = c2d_fake.surfaces;
+    memset(&c2d_fake, 0, sizeof(c2d_fake));
+    c2d_fake.surfaces = surfaces;
+}
+
+static bool c2d_fake_inside(const C2D_RECT *r, const c2d_fake_surface *s)
+{
+    return r->x >= 0 && r->y >= 0 && r->width > 0 && r->height > 0 &&
+           (unsigned int)(r->x + r->width) <= s->def.width &&
+           (unsigned int)(r->y + r->height) <= s->def.height;
+}
+
+C2D_STATUS c2dCreateContext(C2D_CONTEXT *a_c2dContext)
+{
+    *a_c2dContext = calloc(1, sizeof(c2d_fake_context));
+    return *a_c2dContext ? C2D_STATUS_OK : C2D_STATUS_OUT_OF_MEMORY;
+}
+
+C2D_STATUS c2dDestroyContext(C2D_CONTEXT a_c2dContext)
+{
+    c2d_fake_context *ctx = (c2d_fake_context *)a_c2dContext;
+    if (ctx->numQueued) {
+        fprintf(stderr, "c2d: context destroyed with %d queued blits\n",
+                ctx->numQueued / 2);
+        c2d_fake.errors++;
+    }
+    free(ctx);
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dSurfAlloc(C2D_CONTEXT, C2D_SURFACE *a_c2dSurface,
+        C2D_SURFACE_DEF *a_surfaceDef)
+{
+    c2d_fake_surface *s = (c2d_fake_surface *)calloc(1, sizeof(*s));
+    s->def = *a_surfaceDef;
+    *a_c2dSurface = s;
+    c2d_fake.surfAllocs++;
+    c2d_fake.surfaces++;
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dSurfFree(C2D_CONTEXT, C2D_SURFACE a_c2dSurface)
+{
+    c2d_fake_surface *s = (c2d_fake_surface *)a_c2dSurface;
+    if (s->pending) {
+        // kept, the queued blits still point at it
+        fprintf(stderr, "c2d: surface freed with %d blits queued\n", s->pending);
+        c2d_fake.errors++;
+    } else {
+        free(s);
+    }
+    c2d_fake.surfFrees++;
+    c2d_fake.surfaces--;
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dSetDstSurface(C2D_CONTEXT a_c2dContext, C2D_SURFACE a_c2dSurface)
+{
+    ((c2d_fake_context *)a_c2dContext)->dst = (c2d_fake_surface *)a_c2dSurface;
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dSetSrcSurface(C2D_CONTEXT a_c2dContext, C2D_SURFACE a_c2dSurface)
+{
+    ((c2d_fake_context *)a_c2dContext)->src = (c2d_fake_surface *)a_c2dSurface;
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dSetSrcRectangle(C2D_CONTEXT a_c2dContext, C2D_RECT *a_rect)
+{
+    ((c2d_fake_context *)a_c2dContext)->srcRect = *a_rect;
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dSetDstRectangle(C2D_CONTEXT a_c2dContext, C2D_RECT *a_rect)
+{
+    ((c2d_fake_context *)a_c2dContext)->dstRect = *a_rect;
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dSetSrcRotate(C2D_CONTEXT, unsigned int a_rotation)
+{
+    c2d_fake.rotation = a_rotation;
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dSetBlendMode(C2D_CONTEXT, C2D_ALPHA_BLEND_MODE a_mode)
+{
+    c2d_fake.blend = a_mode;
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dSetGlobalAlpha(C2D_CONTEXT, unsigned int a_value)
+{
+    c2d_fake.globalAlpha = a_value;
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dSetDither(C2D_CONTEXT, int)
+{
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dDrawBlit(C2D_CONTEXT a_c2dContext)
+{
+    c2d_fake_context *ctx = (c2d_fake_context *)a_c2dContext;
+
+    if (!ctx->src || !ctx->dst ||
+            !c2d_fake_inside(&ctx->srcRect, ctx->src) ||
+            !c2d_fake_inside(&ctx->dstRect, ctx->dst)) {
+        fprintf(stderr, "c2d: blit %d,%d %dx%d -> %d,%d %dx%d out of its surfaces\n",
+                ctx->srcRect.x, ctx->srcRect.y, ctx->srcRect.width, ctx->srcRect.height,
+                ctx->dstRect.x, ctx->dstRect.y, ctx->dstRect.width, ctx->dstRect.height);
+        c2d_fake.errors++;
+        return C2D_STATUS_INVALID_PARAM;
+    }
+    if (ctx->numQueued + 2 > 2 * C2D_FAKE_MAX_RECTS) {
+        fprintf(stderr, "c2d: more than %d blits queued\n", C2D_FAKE_MAX_RECTS);
+        c2d_fake.errors++;
+        return C2D_STATUS_OUT_OF_MEMORY;
+    }
+
+    if (c2d_fake.blits < C2D_FAKE_MAX_RECTS) {
+        c2d_fake.srcRects[c2d_fake.blits] = ctx->srcRect;
+        c2d_fake.dstRects[c2d_fake.blits] = ctx->dstRect;
+    }
+    c2d_fake.blits++;
+    ctx->src->pending++;
+    ctx->dst->pending++;
+    ctx->queued[ctx->numQueued++] = ctx->src;
+    ctx->queued[ctx->numQueued++] = ctx->dst;
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dFlush(C2D_CONTEXT)
+{
+    c2d_fake.flushes++;
+    return C2D_STATUS_OK;
+}
+
+C2D_STATUS c2dFinish(C2D_CONTEXT a_c2dContext)
+{
+    c2d_fake_context *ctx = (c2d_fake_context *)a_c2dContext;
+    for (int i = 0; i < ctx->numQueued; i++)
+        ctx->queued[i]->pending--;
+    ctx->numQueued = 0;
+    c2d_fake.finishes++;
+    return C2D_STATUS_OK;
+}
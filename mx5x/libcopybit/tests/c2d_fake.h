@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef C2D_FAKE_H_
+#define C2D_FAKE_H_
+
+#include <c2d_api.h>
+
+#define C2D_FAKE_MAX_RECTS 256
+
+/* what the copybit device asked of the 2D core since the last reset */
+struct c2d_fake_stats {
+    int surfAllocs;
+    int surfFrees;
+    int surfaces;           /* alive */
+    int blits;
+    int flushes;
+    int finishes;
+    /* surfaces freed or blits drawn with a bad state, the hardware would
+     * have read freed memory or garbage */
+    int errors;
+    unsigned int globalAlpha;
+    unsigned int rotation;
+    C2D_ALPHA_BLEND_MODE blend;
+    C2D_RECT srcRects[C2D_FAKE_MAX_RECTS];
+    C2D_RECT dstRects[C2D_FAKE_MAX_RECTS];
+};
+
+extern struct c2d_fake_stats c2d_fake;
+
+void c2d_fake_reset();
+
+#endif /* C2D_FAKE_H_ */
@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The copybit device against the recording C2D: the surface cache and its
+ * least recently used eviction, the flush on gralloc frees, the batching
+ * of region rects, the rotated rects and the asynchronous tokens. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <cutils/log.h>
+#include <cutils/atomic.h>
+#include <hardware/copybit.h>
+#include "gralloc_priv.h"
+#include "copybit_async.h"
+#include "c2d_fake.h"
+#include "imx_test.h"
+
+extern struct copybit_module_t HAL_MODULE_INFO_SYM;
+
+/* the gralloc module copybit looks up for its free count */
+static private_module_t sGralloc;
+
+int hw_get_module(const char *id, const struct hw_module_t **module)
+{
+    if (strcmp(id, GRALLOC_HARDWARE_MODULE_ID))
+        return -ENOENT;
+    *module = &sGralloc.base.common;
+    return 0;
+}
+
+struct test_region {
+    struct copybit_region_t region;
+    const struct copybit_rect_t *rects;
+    int count;
+    mutable int next;
+};
+
+static int test_region_next(struct copybit_region_t const *region,
+        struct copybit_rect_t *rect)
+{
+    const test_region *r = (const test_region *)region;
+    if (r->next >= r->count)
+        return 0;
+    *rect = r->rects[r->next++];
+    return 1;
+}
+
+static void test_region_init(test_region *r, const struct copybit_rect_t *rects,
+        int count)
+{
+    r->region.next = test_region_next;
+    r->rects = rects;
+    r->count = count;
+    r->next = 0;
+}
+
+/* images only need distinct addresses, nothing is drawn */
+static copybit_image_t test_image(private_handle_t *hnd, int index,
+        int w, int h, int format)
+{
+    hnd->phys = 0x10000000 + index * 0x100000;
+    hnd->base = 0x40000000 + index * 0x100000;
+    hnd->width = w;
+    hnd->height = h;
+    hnd->format = format;
+
+    copybit_image_t img;
+    img.w = w;
+    img.h = h;
+    img.format = format;
+    img.base = (void *)(intptr_t)hnd->base;
+    img.handle = hnd;
+    return img;
+}
+
+static int test_blit(copybit_device_t *dev, copybit_image_t *dst,
+        copybit_image_t *src)
+{
+    struct copybit_rect_t full = { 0, 0, (int)dst->w, (int)dst->h };
+    struct copybit_rect_t srcRect = { 0, 0, (int)src->w, (int)src->h };
+    test_region region;
+    test_region_init(&region, &full, 1);
+    return dev->stretch(dev, dst, src, &full, &srcRect, &region.region);
+}
+
+static void test_cache(copybit_device_t *dev)
+{
+    private_handle_t dh(-1, 0, 0), sh(-1, 0, 0);
+    copybit_image_t dst = test_image(&dh, 0, 64, 64, COPYBIT_FORMAT_RGBA_8888);
+    copybit_image_t src = test_image(&sh, 1, 64, 64, COPYBIT_FORMAT_RGBA_8888);
+
+    c2d_fake_reset();
+    for (int i = 0; i < 10; i++)
+        CHECK(test_blit(dev, &dst, &src) == 0, "blit %d failed", i);
+    CHECK(c2d_fake.surfAllocs == 2, "%d surface allocs for 10 blits, expected 2",
+          c2d_fake.surfAllocs);
+    CHECK(c2d_fake.blits == 10, "%d blits", c2d_fake.blits);
+    CHECK(c2d_fake.finishes == 10, "%d finishes, stretch waits for each blit",
+          c2d_fake.finishes);
+
+    // another layout at the same address is another surface
+    copybit_image_t resized = test_image(&sh, 1, 32, 64, COPYBIT_FORMAT_RGBA_8888);
+    c2d_fake_reset();
+    CHECK(test_blit(dev, &dst, &resized) == 0, "resized blit failed");
+    CHECK(c2d_fake.surfAllocs == 1, "resized source reused a stale surface");
+}
+
+static void test_eviction(copybit_async_device_t *dev)
+{
+    // the destination and 8 sources do not fit in the 8 cache entries
+    private_handle_t handles[9] = {
+        private_handle_t(-1, 0, 0), private_handle_t(-1, 0, 0),
+        private_handle_t(-1, 0, 0), private_handle_t(-1, 0, 0),
+        private_handle_t(-1, 0, 0), private_handle_t(-1, 0, 0),
+        private_handle_t(-1, 0, 0), private_handle_t(-1, 0, 0),
+        private_handle_t(-1, 0, 0),
+    };
+    copybit_image_t images[9];
+    for (int i = 0; i < 9; i++)
+        images[i] = test_image(&handles[i], 100 + i, 32, 32, COPYBIT_FORMAT_RGB_565);
+    copybit_image_t *dst = &images[0];
+    struct copybit_rect_t full = { 0, 0, 32, 32 };
+    uint32_t token = 0;
+
+    // start from an empty cache, the surfaces of earlier tests are
+    // dropped on the first blit
+    android_atomic_inc(&sGralloc.freeCount);
+    c2d_fake_reset();
+    int earlier = c2d_fake.surfaces;
+
+    // the blits stay queued, evicting a surface must wait for them
+    for (int i = 1; i <= 8; i++) {
+        test_region region;
+        test_region_init(&region, &full, 1);
+        CHECK(dev->stretch_async(dev, dst, &images[i], &full, &full,
+                                 &region.region, &token) == 0, "async blit %d", i);
+    }
+    CHECK(c2d_fake.surfAllocs == 9, "%d allocs for 9 surfaces", c2d_fake.surfAllocs);
+    CHECK(c2d_fake.surfFrees == earlier + 1,
+          "%d frees, expected the eviction of source 1", c2d_fake.surfFrees - earlier);
+    CHECK(c2d_fake.finishes == 1, "%d finishes, the eviction waits once",
+          c2d_fake.finishes);
+
+    // source 2 was used after source 1 and is still cached
+    test_region region;
+    test_region_init(&region, &full, 1);
+    CHECK(dev->stretch_async(dev, dst, &images[2], &full, &full,
+                             &region.region, &token) == 0, "async blit 2");
+    CHECK(c2d_fake.surfAllocs == 9, "source 2 was evicted before source 1");
+
+    // source 1 comes back in place of source 3, the least recently used
+    test_region_init(&region, &full, 1);
+    CHECK(dev->stretch_async(dev, dst, &images[1], &full, &full,
+                             &region.region, &token) == 0, "async blit 1");
+    CHECK(c2d_fake.surfAllocs == 10 && c2d_fake.surfFrees == earlier + 2,
+          "%d allocs %d frees after source 1 came back",
+          c2d_fake.surfAllocs, c2d_fake.surfFrees - earlier);
+    test_region_init(&region, &full, 1);
+    CHECK(dev->stretch_async(dev, dst, &images[4], &full, &full,
+                             &region.region, &token) == 0, "async blit 4");
+    CHECK(c2d_fake.surfAllocs == 10, "source 4 was evicted instead of 3");
+
+    CHECK(dev->wait(dev, token) == 0, "wait");
+    CHECK(c2d_fake.errors == 0, "%d surfaces freed under queued blits",
+          c2d_fake.errors);
+}
+
+static void test_gralloc_free(copybit_device_t *dev)
+{
+    private_handle_t dh(-1, 0, 0), sh(-1, 0, 0);
+    copybit_image_t dst = test_image(&dh, 200, 64, 64, COPYBIT_FORMAT_RGBA_8888);
+    copybit_image_t src = test_image(&sh, 201, 64, 64, COPYBIT_FORMAT_RGBA_8888);
+
+    CHECK(test_blit(dev, &dst, &src) == 0, "blit failed");
+    int alive = c2d_fake.surfaces;
+    c2d_fake_reset();
+
+    // a buffer freed in gralloc may come back at the same address
+    android_atomic_inc(&sGralloc.freeCount);
+    CHECK(test_blit(dev, &dst, &src) == 0, "blit after free failed");
+    CHECK(c2d_fake.surfFrees == alive, "%d of %d cached surfaces dropped",
+          c2d_fake.surfFrees, alive);
+    CHECK(c2d_fake.surfAllocs == 2, "%d allocs after the free, expected 2",
+          c2d_fake.surfAllocs);
+
+    c2d_fake_reset();
+    CHECK(test_blit(dev, &dst, &src) == 0, "blit failed");
+    CHECK(c2d_fake.surfAllocs == 0, "surfaces dropped without a free");
+}
+
+static void test_region_batch(copybit_device_t *dev)
+{
+    private_handle_t dh(-1, 0, 0), sh(-1, 0, 0);
+    copybit_image_t dst = test_image(&dh, 300, 640, 480, COPYBIT_FORMAT_RGBA_8888);
+    copybit_image_t src = test_image(&sh, 301, 640, 480, COPYBIT_FORMAT_RGBA_8888);
+    struct copybit_rect_t full = { 0, 0, 640, 480 };
+    struct copybit_rect_t rects[80];
+    int count = 0;
+
+    // 70 tiles of a fragmented region, then rects with nothing to draw
+    for (int i = 0; i < 70; i++) {
+        struct copybit_rect_t r = { (i % 10) * 64, (i / 10) * 64,
+                                    (i % 10) * 64 + 32, (i / 10) * 64 + 16 };
+        rects[count++] = r;
+    }
+    struct copybit_rect_t empty = { 100, 100, 100, 200 };
+    struct copybit_rect_t outside = { 700, 0, 800, 100 };
+    struct copybit_rect_t inverted = { 50, 50, 40, 60 };
+    struct copybit_rect_t edge = { 600, 460, 700, 500 };
+    rects[count++] = empty;
+    rects[count++] = outside;
+    rects[count++] = inverted;
+    rects[count++] = edge;
+
+    test_region region;
+    test_region_init(&region, rects, count);
+    c2d_fake_reset();
+    CHECK(dev->stretch(dev, &dst, &src, &full, &full, &region.region) == 0,
+          "region blit failed");
+    CHECK(c2d_fake.blits == 71, "%d blits, expected 70 tiles and the clipped edge",
+          c2d_fake.blits);
+    CHECK(c2d_fake.flushes == 2, "%d flushes, expected one per 32 rects",
+          c2d_fake.flushes);
+    CHECK(c2d_fake.finishes == 1, "%d finishes for one region", c2d_fake.finishes);
+    for (int i = 0; i < 70 && i < c2d_fake.blits; i++) {
+        C2D_RECT *d = &c2d_fake.dstRects[i];
+        CHECK(d->x == rects[i].l && d->y == rects[i].t &&
+              d->width == 32 && d->height == 16,
+              "tile %d went to %d,%d %dx%d", i, d->x, d->y, d->width, d->height);
+        CHECK(!memcmp(d, &c2d_fake.srcRects[i], sizeof(*d)),
+              "tile %d read from elsewhere", i);
+    }
+    C2D_RECT *e = &c2d_fake.dstRects[70];
+    CHECK(e->x == 600 && e->y == 460 && e->width == 40 && e->height == 20,
+          "edge clipped to %d,%d %dx%d", e->x, e->y, e->width, e->height);
+    CHECK(c2d_fake.errors == 0, "%d bad blits", c2d_fake.errors);
+}
+
+static void test_rotation(copybit_device_t *dev)
+{
+    private_handle_t dh(-1, 0, 0), sh(-1, 0, 0);
+    copybit_image_t dst = test_image(&dh, 400, 200, 200, COPYBIT_FORMAT_RGBA_8888);
+    copybit_image_t src = test_image(&sh, 401, 100, 50, COPYBIT_FORMAT_RGBA_8888);
+    struct copybit_rect_t srcRect = { 0, 0, 100, 50 };
+    struct copybit_rect_t dstRect = { 10, 20, 60, 120 };
+    static const struct {
+        int transform;
+        C2D_RECT left;      /* the source of the left half of dstRect */
+    } cases[] = {
+        // rotated clockwise the bottom of the source lands on the left
+        { COPYBIT_TRANSFORM_ROT_90,  { 0, 25, 100, 25 } },
+        { COPYBIT_TRANSFORM_ROT_270, { 0,  0, 100, 25 } },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        struct copybit_rect_t left = { 10, 20, 35, 120 };
+        test_region region;
+        test_region_init(&region, &left, 1);
+
+        c2d_fake_reset();
+        dev->set_parameter(dev, COPYBIT_TRANSFORM, cases[i].transform);
+        CHECK(dev->stretch(dev, &dst, &src, &dstRect, &srcRect, &region.region) == 0,
+              "rotated blit %d failed", cases[i].transform);
+        C2D_RECT *s = &c2d_fake.srcRects[0];
+        CHECK(c2d_fake.blits == 1 && !memcmp(s, &cases[i].left, sizeof(*s)),
+              "transform %d read %d,%d %dx%d", cases[i].transform,
+              s->x, s->y, s->width, s->height);
+        C2D_RECT *d = &c2d_fake.dstRects[0];
+        CHECK(d->x == 10 && d->y == 20 && d->width == 25 && d->height == 100,
+              "transform %d wrote %d,%d %dx%d", cases[i].transform,
+              d->x, d->y, d->width, d->height);
+    }
+    dev->set_parameter(dev, COPYBIT_TRANSFORM, 0);
+
+    // a source rect outside of the image is refused
+    struct copybit_rect_t bad = { 0, 0, 101, 50 };
+    test_region region;
+    test_region_init(&region, &dstRect, 1);
+    CHECK(dev->stretch(dev, &dst, &src, &dstRect, &bad, &region.region) == -EINVAL,
+          "source rect outside of the image accepted");
+}
+
+static void test_async(copybit_async_device_t *dev)
+{
+    private_handle_t dh(-1, 0, 0), sh(-1, 0, 0);
+    copybit_image_t dst = test_image(&dh, 500, 64, 64, COPYBIT_FORMAT_RGBA_8888);
+    copybit_image_t src = test_image(&sh, 501, 64, 64, COPYBIT_FORMAT_RGBA_8888);
+    struct copybit_rect_t full = { 0, 0, 64, 64 };
+    uint32_t first = 0, second = 0;
+    test_region region;
+
+    // the first blit of a new pair only allocates, nothing to wait for
+    test_blit(&dev->copybit, &dst, &src);
+    c2d_fake_reset();
+
+    test_region_init(&region, &full, 1);
+    dev->stretch_async(dev, &dst, &src, &full, &full, &region.region, &first);
+    test_region_init(&region, &full, 1);
+    dev->stretch_async(dev, &dst, &src, &full, &full, &region.region, &second);
+    CHECK(second == first + 1, "tokens %u then %u", first, second);
+    CHECK(c2d_fake.finishes == 0, "async blits waited for the 2D core");
+    CHECK(c2d_fake.flushes == 2, "%d flushes, one per async blit", c2d_fake.flushes);
+
+    dev->wait(dev, first);
+    CHECK(c2d_fake.finishes == 1, "wait did not finish");
+    dev->wait(dev, second);
+    dev->wait(dev, first);
+    CHECK(c2d_fake.finishes == 1, "%d finishes, the first wait covered both",
+          c2d_fake.finishes);
+}
+
+int main()
+{
+    hw_device_t *device = NULL;
+    hw_module_t *module = &HAL_MODULE_INFO_SYM.common;
+
+    if (module->methods->open(module, COPYBIT_HARDWARE_COPYBIT0, &device) != 0) {
+        fprintf(stderr, "copybit open failed\n");
+        return 1;
+    }
+    copybit_async_device_t *dev = (copybit_async_device_t *)device;
+    CHECK(device->version == COPYBIT_ASYNC_DEVICE_VERSION, "no async device");
+
+    test_cache(&dev->copybit);
+    test_eviction(dev);
+    test_gralloc_free(&dev->copybit);
+    test_region_batch(&dev->copybit);
+    test_rotation(&dev->copybit);
+    test_async(dev);
+
+    c2d_fake_reset();
+    device->close(device);
+    CHECK(c2d_fake.surfaces == 0, "%d surfaces left after close", c2d_fake.surfaces);
+    CHECK(c2d_fake.errors == 0, "%d bad calls on close", c2d_fake.errors);
+
+    return imx_test_result("copybit_test");
+}
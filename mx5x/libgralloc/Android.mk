@@ -21,13 +21,16 @@ ifeq ($(TARGET_HAVE_IMX_GRALLOC), true)
 include $(CLEAR_VARS)
 LOCAL_PRELINK_MODULE := true
 LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
-LOCAL_SHARED_LIBRARIES := liblog libcutils libGLESv1_CM libipu libion
+LOCAL_SHARED_LIBRARIES := liblog libcutils libGLESv1_CM libipu libion libsync
 LOCAL_SHARED_LIBRARIES += libc2d_z430
 LOCAL_C_INCLUDES += external/linux-lib/ipu
 LOCAL_C_INCLUDES += hardware/imx/mx5x/libcopybit
+LOCAL_C_INCLUDES += hardware/imx/libcompose hardware/imx/libfbflip
+LOCAL_STATIC_LIBRARIES := libimxcompose libimxfbflip
 
 LOCAL_SRC_FILES := 	\
 	gralloc.cpp 	\
+	gralloc_pool.cpp \
 	framebuffer.cpp \
 	mapper.cpp
 LOCAL_MODULE := gralloc.$(TARGET_BOARD_PLATFORM)
@@ -38,3 +41,45 @@ LOCAL_MODULE_TAGS := eng
 include $(BUILD_SHARED_LIBRARY)
 
 endif
+
+# allocation latency with and without the buffer pool, run on the host:
+# out/host/<os>-<arch>/bin/gralloc_pool_bench
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := 	\
+	gralloc_pool.cpp \
+	tests/gralloc_pool_bench.cpp
+LOCAL_CFLAGS := -DLOG_TAG=\"gralloc_pool_bench\"
+LOCAL_STATIC_LIBRARIES := libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+LOCAL_MODULE := gralloc_pool_bench
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
+
+# mappings of imported buffers shared per buffer and never opening a
+# device, run on the host: out/host/<os>-<arch>/bin/gralloc_map_test
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := 	\
+	mapper.cpp \
+	tests/gralloc_map_test.cpp
+LOCAL_C_INCLUDES += hardware/imx/libimxtest
+LOCAL_CFLAGS := -DLOG_TAG=\"gralloc_map_test\"
+LOCAL_STATIC_LIBRARIES := libimxtest_host libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+LOCAL_MODULE := gralloc_map_test
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
+
+# first lock and first read of 1 to 16 MB buffers, fresh, through a
+# shared mapping and in the allocating process, run on the host:
+# out/host/<os>-<arch>/bin/gralloc_map_bench
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := 	\
+	mapper.cpp \
+	tests/gralloc_map_bench.cpp
+LOCAL_C_INCLUDES += hardware/imx/libimxtest
+LOCAL_CFLAGS := -DLOG_TAG=\"gralloc_map_bench\"
+LOCAL_STATIC_LIBRARIES := libimxtest_host libcutils liblog
+LOCAL_LDLIBS := -lpthread -lrt
+LOCAL_MODULE := gralloc_map_bench
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
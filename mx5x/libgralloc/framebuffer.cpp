@@ -32,7 +32,10 @@
 #include <hardware/hardware.h>
 
 #include "gralloc_priv.h"
+#include "compose.h"
 #include "gr.h"
+#include "fb_flip.h"
+#include <c2d_api.h>
 #define  MAX_RECT_NUM   20
 
 // numbers of buffers for page flipping
@@ -45,6 +48,8 @@ enum {
 
 struct fb_context_t {
     framebuffer_device_t  device;
+    fb_flip_queue_t flip;
+    C2D_CONTEXT c2dctx;
 };
 
 static int nr_framebuffers;
@@ -118,6 +123,242 @@ static int fb_setUpdateRect(struct framebuffer_device_t* dev,
     return 0;
 }
 
+/*****************************************************************************/
+
+static int fb_flip_pan(fb_flip_queue_t* q, fb_flip_t* flip)
+{
+    fb_context_t* ctx = (fb_context_t*)q->data;
+    private_module_t* m = reinterpret_cast<private_module_t*>(
+            ctx->device.common.module);
+    fb_post_hook_t* hook = (fb_post_hook_t*)flip->hook;
+
+    if (hook) {
+        hook->wait(hook, flip->token);
+    }
+
+    if (ioctl(m->framebuffer->fd, FBIOPAN_DISPLAY, &flip->info) == -1) {
+        ALOGW("FBIOPAN_DISPLAY failed: %s", strerror(errno));
+        m->base.unlock(&m->base, flip->buffer);
+        return -errno;
+    }
+
+    if (m->currentBuffer) {
+        m->base.unlock(&m->base, m->currentBuffer);
+    }
+    m->currentBuffer = flip->buffer;
+    return 0;
+}
+
+static void fb_flip_cancel(fb_flip_queue_t* q, fb_flip_t* flip)
+{
+    fb_context_t* ctx = (fb_context_t*)q->data;
+    private_module_t* m = reinterpret_cast<private_module_t*>(
+            ctx->device.common.module);
+    fb_post_hook_t* hook = (fb_post_hook_t*)flip->hook;
+
+    // the blits still write into the buffer
+    if (hook) {
+        hook->wait(hook, flip->token);
+    }
+    m->base.unlock(&m->base, flip->buffer);
+}
+
+static const fb_flip_ops_t sFlipOps = {
+    fb_flip_pan,
+    fb_flip_cancel,
+};
+
+static void fb_start_flips(fb_context_t* ctx, private_module_t* m)
+{
+    if (!(m->flags & PAGE_FLIP))
+        return;
+
+    fb_flip_start(&ctx->flip, &sFlipOps, ctx, m->numBuffers, m->fps);
+}
+
+/* the HWC 1.0 composer hands no release fence back to SurfaceFlinger,
+ * posts wait for their flip unless the composer takes the fence. */
+static int fb_queue_flip(fb_context_t* ctx, private_module_t* m,
+        buffer_handle_t buffer, fb_post_hook_t* hook, uint32_t token,
+        int* releaseFence)
+{
+    private_handle_t const* hnd = reinterpret_cast<private_handle_t const*>(buffer);
+    void *vaddr = NULL;
+    fb_flip_t flip;
+
+    m->base.lock(&m->base, buffer,
+            private_module_t::PRIV_USAGE_LOCKED_FOR_POST,
+            0, 0, ALIGN_PIXEL(m->info.xres), ALIGN_PIXEL_128(m->info.yres), &vaddr);
+
+    const size_t offset = hnd->base - m->framebuffer->base;
+
+    memset(&flip, 0, sizeof(flip));
+    flip.buffer = buffer;
+    flip.info = m->info;
+    flip.info.activate = FB_ACTIVATE_VBL;
+    flip.info.yoffset = offset / m->finfo.line_length;
+    flip.posted = fb_flip_now();
+    flip.hook = hook;
+    flip.token = token;
+
+    return fb_flip_queue(&ctx->flip, &flip, releaseFence);
+}
+
+/*****************************************************************************/
+
+static int fb_bytes_per_pixel(int format)
+{
+    switch (format) {
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+            return 4;
+        case HAL_PIXEL_FORMAT_RGB_888:
+            return 3;
+        case HAL_PIXEL_FORMAT_RGB_565:
+        case HAL_PIXEL_FORMAT_RGBA_5551:
+        case HAL_PIXEL_FORMAT_RGBA_4444:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+static int fb_format(private_module_t* m)
+{
+    if (m->info.bits_per_pixel != 32)
+        return HAL_PIXEL_FORMAT_RGB_565;
+    return m->info.red.offset == 0 ? HAL_PIXEL_FORMAT_RGBA_8888 :
+                                     HAL_PIXEL_FORMAT_BGRA_8888;
+}
+
+static int fb_c2d_format(int format)
+{
+    switch (format) {
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+            return C2D_COLOR_8888_ABGR;
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+            return C2D_COLOR_8888;
+        case HAL_PIXEL_FORMAT_RGB_565:
+            return C2D_COLOR_0565;
+        case HAL_PIXEL_FORMAT_RGBA_5551:
+            return C2D_COLOR_5551_RGBA;
+        case HAL_PIXEL_FORMAT_RGBA_4444:
+            return C2D_COLOR_4444_RGBA;
+        default:
+            return -1;
+    }
+}
+
+/* blit a physically contiguous buffer to the front framebuffer with the
+ * 2D core, handling stride and format differences. */
+static int fb_blit_c2d(fb_context_t* ctx, private_module_t* m,
+        private_handle_t const* hnd)
+{
+    C2D_SURFACE_DEF srcSurfaceDef;
+    C2D_SURFACE_DEF dstSurfaceDef;
+    C2D_SURFACE srcSurface;
+    C2D_SURFACE dstSurface;
+    C2D_RECT rect;
+    int format = fb_c2d_format(hnd->format);
+    int bpp = fb_bytes_per_pixel(hnd->format);
+
+    if (!(hnd->flags & private_handle_t::PRIV_FLAGS_USES_ION) ||
+            !hnd->phys || format < 0) {
+        return -EINVAL;
+    }
+
+    if (ctx->c2dctx == NULL &&
+            c2dCreateContext(&ctx->c2dctx) != C2D_STATUS_OK) {
+        ALOGE("c2dCreateContext failed, falling back to memcpy");
+        ctx->c2dctx = NULL;
+        return -EINVAL;
+    }
+
+    memset(&srcSurfaceDef, 0, sizeof(srcSurfaceDef));
+    srcSurfaceDef.format = (C2D_COLORFORMAT)format;
+    srcSurfaceDef.width = hnd->width;
+    srcSurfaceDef.height = hnd->height;
+    srcSurfaceDef.stride = hnd->width * bpp;
+    srcSurfaceDef.buffer = (void *)hnd->phys;
+    srcSurfaceDef.host = (void *)hnd->base;
+    srcSurfaceDef.flags = C2D_SURFACE_NO_BUFFER_ALLOC;
+
+    memset(&dstSurfaceDef, 0, sizeof(dstSurfaceDef));
+    dstSurfaceDef.format = m->info.bits_per_pixel == 32 ?
+            C2D_COLOR_8888_ABGR : C2D_COLOR_0565;
+    dstSurfaceDef.width = m->info.xres;
+    dstSurfaceDef.height = m->info.yres;
+    dstSurfaceDef.stride = m->finfo.line_length;
+    dstSurfaceDef.buffer = (void *)m->framebuffer->phys;
+    dstSurfaceDef.host = (void *)m->framebuffer->base;
+    dstSurfaceDef.flags = C2D_SURFACE_NO_BUFFER_ALLOC;
+
+    if (c2dSurfAlloc(ctx->c2dctx, &srcSurface, &srcSurfaceDef) != C2D_STATUS_OK) {
+        ALOGE("srcSurface c2dSurfAlloc fail");
+        return -EINVAL;
+    }
+    if (c2dSurfAlloc(ctx->c2dctx, &dstSurface, &dstSurfaceDef) != C2D_STATUS_OK) {
+        ALOGE("dstSurface c2dSurfAlloc fail");
+        c2dSurfFree(ctx->c2dctx, srcSurface);
+        return -EINVAL;
+    }
+
+    rect.x = 0;
+    rect.y = 0;
+    rect.width = hnd->width < (int)m->info.xres ? hnd->width : m->info.xres;
+    rect.height = hnd->height < (int)m->info.yres ? hnd->height : m->info.yres;
+
+    c2dSetSrcSurface(ctx->c2dctx, srcSurface);
+    c2dSetDstSurface(ctx->c2dctx, dstSurface);
+    c2dSetSrcRotate(ctx->c2dctx, 0);
+    c2dSetBlendMode(ctx->c2dctx, C2D_ALPHA_BLEND_NONE);
+    c2dSetGlobalAlpha(ctx->c2dctx, 0xff);
+    c2dSetDither(ctx->c2dctx, 0);
+    c2dSetSrcRectangle(ctx->c2dctx, &rect);
+    c2dSetDstRectangle(ctx->c2dctx, &rect);
+    c2dDrawBlit(ctx->c2dctx);
+    c2dFinish(ctx->c2dctx);
+
+    c2dSurfFree(ctx->c2dctx, srcSurface);
+    c2dSurfFree(ctx->c2dctx, dstSurface);
+
+    return 0;
+}
+
+/* last resort for buffers the 2D core can't read (ashmem), converts
+ * the pixels when the buffer format is not the framebuffer one. */
+static void fb_copy_cpu(private_module_t* m, private_handle_t const* hnd,
+        void* fb_vaddr, void* buffer_vaddr)
+{
+    size_t dst_stride = m->finfo.line_length;
+    size_t src_stride = hnd->width * fb_bytes_per_pixel(hnd->format);
+    int format = fb_format(m);
+
+    if (src_stride == 0 || (src_stride == dst_stride && hnd->format == format)) {
+        memcpy(fb_vaddr, buffer_vaddr, m->finfo.line_length * ALIGN_PIXEL_128(m->info.yres));
+        return;
+    }
+
+    compose_image_t src, dst;
+    memset(&src, 0, sizeof(src));
+    src.format = hnd->format;
+    src.width = hnd->width;
+    src.height = hnd->height;
+    src.planes[0] = buffer_vaddr;
+    src.stride[0] = src_stride;
+
+    memset(&dst, 0, sizeof(dst));
+    dst.format = format;
+    dst.width = m->info.xres;
+    dst.height = m->info.yres;
+    dst.planes[0] = fb_vaddr;
+    dst.stride[0] = dst_stride;
+
+    compose_convert(&dst, &src);
+}
+
 static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
 {
     if (!buffer)
@@ -128,6 +369,33 @@ static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
     private_handle_t const* hnd = reinterpret_cast<private_handle_t const*>(buffer);
     private_module_t* m = reinterpret_cast<private_module_t*>(
             dev->common.module);
+
+    // 2D layers of the composer are queued on top of the gles output
+    // here, the flip thread waits for them before the pan.
+    fb_post_hook_t* postHook = m->postHook;
+    fb_post_hook_t* hook = postHook;
+    uint32_t token = 0;
+    if (hook && hook->compose(hook, buffer, &token) <= 0)
+        hook = NULL;
+
+    if ((hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER) &&
+            ctx->flip.running) {
+        if (postHook == NULL)
+            return fb_queue_flip(ctx, m, buffer, hook, token, NULL);
+
+        // the composer keeps the buffer busy until its fence signals,
+        // the blits and the pan go on while it prepares the next frame.
+        int fence = -1;
+        int err = fb_queue_flip(ctx, m, buffer, hook, token, &fence);
+        postHook->posted(postHook, fence);
+        return err;
+    }
+
+    if (hook)
+        hook->wait(hook, token);
+
+    // keep the copy path ordered behind any queued flip.
+    fb_flip_drain(&ctx->flip);
     if (m->currentBuffer) {
         m->base.unlock(&m->base, m->currentBuffer);
         m->currentBuffer = 0;
@@ -152,13 +420,12 @@ static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
 
         m->currentBuffer = buffer;
         
-    } else {
-        // If we can't do the page_flip, just copy the buffer to the front 
-        // FIXME: use copybit HAL instead of memcpy
-        
+    } else if (fb_blit_c2d(ctx, m, hnd) != 0) {
+        // If we can't do the page_flip nor the blit, copy the buffer
+        // to the front.
         void* fb_vaddr;
         void* buffer_vaddr;
-        
+
         m->base.lock(&m->base, m->framebuffer, 
                 GRALLOC_USAGE_SW_WRITE_RARELY, 
                 0, 0, ALIGN_PIXEL(m->info.xres), ALIGN_PIXEL_128(m->info.yres),
@@ -169,7 +436,7 @@ static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
                 0, 0, ALIGN_PIXEL(m->info.xres), ALIGN_PIXEL_128(m->info.yres),
                 &buffer_vaddr);
 
-        memcpy(fb_vaddr, buffer_vaddr, m->finfo.line_length * ALIGN_PIXEL_128(m->info.yres));
+        fb_copy_cpu(m, hnd, fb_vaddr, buffer_vaddr);
 
         m->base.unlock(&m->base, buffer); 
         m->base.unlock(&m->base, m->framebuffer); 
@@ -392,6 +659,9 @@ static int fb_close(struct hw_device_t *dev)
 {
     fb_context_t* ctx = (fb_context_t*)dev;
     if (ctx) {
+        fb_flip_stop(&ctx->flip);
+        if (ctx->c2dctx != NULL)
+            c2dDestroyContext(ctx->c2dctx);
         free(ctx);
     }
     return 0;
@@ -446,6 +716,7 @@ int fb_device_open(hw_module_t const* module, const char* name,
             const_cast<int&>(dev->device.numFramebuffers) = NUM_BUFFERS;
             *device = &dev->device.common;
             fbdev = (framebuffer_device_t*) *device;
+            fb_start_flips(dev, m);
       }
 
     fslwatermark_sem_open();
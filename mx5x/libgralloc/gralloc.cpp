@@ -38,14 +38,20 @@
 
 #include "gralloc_priv.h"
 #include "gr.h"
+#include "gralloc_pool.h"
 
 #include <ion/ion.h>
+#include <c2d_api.h>
 
 /*****************************************************************************/
 
 struct gralloc_context_t {
     alloc_device_t  device;
     /* our private data here */
+    gralloc_pool_t pool;
+    /* clears the ion buffers, created on the first one */
+    pthread_mutex_t c2dLock;
+    C2D_CONTEXT c2dctx;
 };
 
 static int gralloc_alloc_buffer(alloc_device_t* dev,
@@ -111,6 +117,8 @@ struct private_module_t HAL_MODULE_INFO_SYM = {
     currentBuffer: 0,
     ion_master: -1,
     master_phys: 0,
+    freeCount: 0,
+    postHook: 0,
 };
 
 #define ION_GPU_POOL_ID 2
@@ -218,6 +226,82 @@ static int init_ion_area(private_module_t* m)
     return err;
 }
 
+/*****************************************************************************/
+
+/* the 2D core addresses the buffer as rows of one page of 32 bit pixels,
+ * in bands no taller than it takes. */
+#define CLEAR_WIDTH (PAGE_SIZE / 4)
+#define CLEAR_ROWS 2048
+
+static int gralloc_clear_c2d_locked(gralloc_context_t* ctx, size_t size,
+        unsigned long phys)
+{
+    if (ctx->c2dctx == NULL &&
+            c2dCreateContext(&ctx->c2dctx) != C2D_STATUS_OK) {
+        ALOGE("c2dCreateContext failed, clearing with the cpu");
+        ctx->c2dctx = NULL;
+        return -EINVAL;
+    }
+
+    for (size_t offset = 0; offset < size; ) {
+        C2D_SURFACE_DEF def;
+        C2D_SURFACE surface;
+        C2D_RECT rect;
+        size_t rows = (size - offset) / PAGE_SIZE;
+
+        if (rows > CLEAR_ROWS)
+            rows = CLEAR_ROWS;
+        memset(&def, 0, sizeof(def));
+        def.format = C2D_COLOR_8888;
+        def.width = CLEAR_WIDTH;
+        def.height = rows;
+        def.stride = PAGE_SIZE;
+        def.buffer = (void *)(phys + offset);
+        def.host = NULL;
+        def.flags = C2D_SURFACE_NO_BUFFER_ALLOC;
+        if (c2dSurfAlloc(ctx->c2dctx, &surface, &def) != C2D_STATUS_OK) {
+            ALOGE("clear c2dSurfAlloc fail");
+            return -EINVAL;
+        }
+
+        rect.x = 0;
+        rect.y = 0;
+        rect.width = CLEAR_WIDTH;
+        rect.height = rows;
+        c2dSetDstSurface(ctx->c2dctx, surface);
+        c2dSetDstRectangle(ctx->c2dctx, &rect);
+        c2dSetBlendMode(ctx->c2dctx, C2D_ALPHA_BLEND_NONE);
+        c2dSetFgColor(ctx->c2dctx, 0);
+        C2D_STATUS status = c2dDrawRect(ctx->c2dctx, C2D_PARAM_FILL_BIT);
+        c2dFinish(ctx->c2dctx);
+        c2dSurfFree(ctx->c2dctx, surface);
+        if (status != C2D_STATUS_OK) {
+            ALOGE("clear c2dDrawRect fail");
+            return -EINVAL;
+        }
+        offset += rows * PAGE_SIZE;
+    }
+    return 0;
+}
+
+/* zero an ion buffer with a fill of the 2D core, which needs no mapping
+ * and leaves the cpu and its cache alone. whatever the core refuses is
+ * cleared with the cpu. */
+static int gralloc_clear_c2d(void* data, int fd, size_t size, unsigned long phys)
+{
+    gralloc_context_t* ctx = reinterpret_cast<gralloc_context_t*>(data);
+    int err = -EINVAL;
+
+    if (phys && size % PAGE_SIZE == 0) {
+        pthread_mutex_lock(&ctx->c2dLock);
+        err = gralloc_clear_c2d_locked(ctx, size, phys);
+        pthread_mutex_unlock(&ctx->c2dLock);
+    }
+    if (err < 0)
+        err = gralloc_clear_buffer(fd, size);
+    return err;
+}
+
 static int gralloc_alloc_buffer(alloc_device_t* dev,
         size_t size, int usage, buffer_handle_t* pHandle)
 {
@@ -229,6 +313,7 @@ static int gralloc_alloc_buffer(alloc_device_t* dev,
     int offset = 0;
     int lockState = 0;
     void *buffer_handle = NULL;
+    unsigned long phys = 0;
 
     size = roundUpToPageSize(size);
 
@@ -256,10 +341,23 @@ try_ashmem:
 
         err = init_ion_area(m);
         if (err == 0) {
+            gralloc_context_t* ctx = reinterpret_cast<gralloc_context_t*>(dev);
             struct ion_handle *handle, *alloc_handle;
-            unsigned char *base = 0;
+            int cls = gralloc_pool_class(usage);
+            int64_t start = gralloc_now();
+
+            if (gralloc_pool_get(&ctx->pool, size, cls, &fd, &phys) == 0) {
+                gralloc_pool_stats(&ctx->pool, true, start);
+                goto done;
+            }
 
             err = ion_alloc(m->ion_master, size, PAGE_SIZE, ION_GPU_POOL_ID, &handle);
+            if (err < 0) {
+                // the gpu carveout is exhausted, give back what the pool
+                // holds and try once more.
+                gralloc_pool_trim(&ctx->pool);
+                err = ion_alloc(m->ion_master, size, PAGE_SIZE, ION_GPU_POOL_ID, &handle);
+            }
             if(err < 0) {
                 ALOGE("Cannot allocate ion size = %d err = %d", size, err);
                 return err;
@@ -279,12 +377,20 @@ try_ashmem:
                 ALOGE("Cannot get physical for ion handle = %p", handle);
                 return -errno;
             }
+            phys = m->master_phys;
 
             err = ion_free(m->ion_master, alloc_handle);
             if(err < 0) {
                 ALOGE("Cannot free ion handle = %p err = %d", alloc_handle, err);
                 return err;
             }
+
+            err = gralloc_clear_c2d(ctx, fd, size, phys);
+            if (err < 0) {
+                close(fd);
+                return err;
+            }
+            gralloc_pool_stats(&ctx->pool, false, start);
         } else {
             if ((usage & GRALLOC_USAGE_HW_2D) == 0) {
                 // the caller didn't request ION, so we can try something else
@@ -297,6 +403,7 @@ try_ashmem:
         }
     }
 
+done:
     if (err == 0) {
         private_handle_t* hnd = new private_handle_t(fd, size, flags);
         hnd->offset = 0 ;
@@ -304,9 +411,7 @@ try_ashmem:
         hnd->lockState = lockState;
         hnd->handle = buffer_handle;
         if (flags & private_handle_t::PRIV_FLAGS_USES_ION) {
-            private_module_t* m = reinterpret_cast<private_module_t*>(
-                    dev->common.module);
-            hnd->phys = m->master_phys;
+            hnd->phys = phys;
         }
         *pHandle = hnd;
     }
@@ -418,15 +523,27 @@ static int gralloc_free(alloc_device_t* dev,
     } else {
         gralloc_module_t* module = reinterpret_cast<gralloc_module_t*>(
                 dev->common.module);
+        gralloc_context_t* ctx = reinterpret_cast<gralloc_context_t*>(dev);
         terminateBuffer(module, const_cast<private_handle_t*>(hnd));
         if (hnd->flags & private_handle_t::PRIV_FLAGS_USES_ION) {
-            int fd = ion_open();
-            ion_import(fd, hnd->fd, (struct ion_handle **)&hnd->handle);
-            if(munmap((void *)hnd->base, hnd->size)) {
+            android_atomic_inc(&reinterpret_cast<private_module_t*>(
+                    dev->common.module)->freeCount);
+            if (hnd->base && munmap((void *)hnd->base, hnd->size)) {
                 ALOGE("Failed to unmap at %p : %s", (void*)hnd->base, strerror(errno));
             }
-            ion_free(fd,(struct ion_handle *)hnd->handle);
-            close(fd);
+            if (gralloc_pool_put(&ctx->pool, hnd->fd, hnd->size,
+                    hnd->phys, hnd->usage)) {
+                // the pool owns the fd now
+                delete hnd;
+                return 0;
+            }
+
+            private_module_t* m = reinterpret_cast<private_module_t*>(
+                    dev->common.module);
+            if (init_ion_area(m) == 0) {
+                ion_import(m->ion_master, hnd->fd, (struct ion_handle **)&hnd->handle);
+                ion_free(m->ion_master, (struct ion_handle *)hnd->handle);
+            }
         }
 
     }
@@ -445,6 +562,10 @@ static int gralloc_close(struct hw_device_t *dev)
         /* TODO: keep a list of all buffer_handle_t created, and free them
          * all here.
          */
+        gralloc_pool_destroy(&ctx->pool);
+        if (ctx->c2dctx)
+            c2dDestroyContext(ctx->c2dctx);
+        pthread_mutex_destroy(&ctx->c2dLock);
         free(ctx);
     }
     return 0;
@@ -474,6 +595,11 @@ int gralloc_device_open(const hw_module_t* module, const char* name,
         dev->device.alloc   = gralloc_alloc;
         dev->device.free    = gralloc_free;
 
+        gralloc_pool_init(&dev->pool);
+        pthread_mutex_init(&dev->c2dLock, NULL);
+        dev->pool.clear = gralloc_clear_c2d;
+        dev->pool.clearData = dev;
+
         *device = &dev->device.common;
         status = 0;
     } else {
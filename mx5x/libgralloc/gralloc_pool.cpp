@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/mman.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include <hardware/gralloc.h>
+
+#include "gralloc_pool.h"
+
+/*****************************************************************************/
+
+int64_t gralloc_now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+int gralloc_pool_class(int usage)
+{
+    if (usage & (GRALLOC_USAGE_SW_READ_MASK | GRALLOC_USAGE_SW_WRITE_MASK))
+        return POOL_CLASS_SW;
+    return POOL_CLASS_HW;
+}
+
+void gralloc_pool_init(gralloc_pool_t* pool)
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    pthread_mutex_init(&pool->lock, NULL);
+    property_get("ro.gralloc.pool_kb", value, "");
+    pool->maxBytes = (value[0] ? atoi(value) : POOL_DEFAULT_KB) * 1024;
+    property_get("debug.gralloc.poolstats", value, "0");
+    pool->stats = atoi(value);
+}
+
+static void gralloc_pool_remove_locked(gralloc_pool_t* pool, int index)
+{
+    pool->bytes -= pool->entries[index].size;
+    pool->count--;
+    memmove(&pool->entries[index], &pool->entries[index + 1],
+            (pool->count - index) * sizeof(pool->entries[0]));
+}
+
+/* drop everything released before "before", or all the entries when it
+ * is 0. aged entries are dropped on the next alloc or free, so buffers
+ * kept for a burst do not keep pinning the gpu carveout afterwards. */
+static void gralloc_pool_trim_locked(gralloc_pool_t* pool, int64_t before)
+{
+    while (pool->count > 0 &&
+            (before == 0 || pool->entries[0].released < before)) {
+        close(pool->entries[0].fd);
+        gralloc_pool_remove_locked(pool, 0);
+    }
+}
+
+void gralloc_pool_trim(gralloc_pool_t* pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    gralloc_pool_trim_locked(pool, 0);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void gralloc_pool_destroy(gralloc_pool_t* pool)
+{
+    gralloc_pool_trim(pool);
+    pthread_mutex_destroy(&pool->lock);
+}
+
+int gralloc_pool_get(gralloc_pool_t* pool, size_t size, int cls,
+        int* fd, unsigned long* phys)
+{
+    int found = -1;
+
+    pthread_mutex_lock(&pool->lock);
+    gralloc_pool_trim_locked(pool, gralloc_now() - POOL_MAX_AGE_NS);
+    for (int i = pool->count - 1; i >= 0; i--) {
+        if (pool->entries[i].size == size && pool->entries[i].cls == cls) {
+            found = i;
+            break;
+        }
+    }
+    if (found >= 0) {
+        *fd = pool->entries[found].fd;
+        *phys = pool->entries[found].phys;
+        gralloc_pool_remove_locked(pool, found);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (found < 0)
+        return -ENOENT;
+
+    // the allocator serves every process, the previous owner may not be
+    // the next one. the gpu and the 2d core can read the buffer before
+    // the new owner renders all of it, whatever the usage class.
+    int err = pool->clear ? pool->clear(pool->clearData, *fd, size, *phys) :
+            gralloc_clear_buffer(*fd, size);
+    if (err < 0) {
+        close(*fd);
+        return -ENOENT;
+    }
+    return 0;
+}
+
+bool gralloc_pool_put(gralloc_pool_t* pool, int fd, size_t size,
+        unsigned long phys, int usage)
+{
+    if (!phys || size > pool->maxBytes ||
+            (usage & GRALLOC_USAGE_PROTECTED)) {
+        return false;
+    }
+
+    int64_t now = gralloc_now();
+    pthread_mutex_lock(&pool->lock);
+    gralloc_pool_trim_locked(pool, now - POOL_MAX_AGE_NS);
+    while (pool->count > 0 && (pool->count >= POOL_MAX_ENTRIES ||
+            pool->bytes + size > pool->maxBytes)) {
+        close(pool->entries[0].fd);
+        gralloc_pool_remove_locked(pool, 0);
+    }
+
+    gralloc_pool_entry_t* entry = &pool->entries[pool->count++];
+    entry->fd = fd;
+    entry->size = size;
+    entry->phys = phys;
+    entry->cls = gralloc_pool_class(usage);
+    entry->released = now;
+    pool->bytes += size;
+    pthread_mutex_unlock(&pool->lock);
+
+    return true;
+}
+
+void gralloc_pool_stats(gralloc_pool_t* pool, bool recycled, int64_t start)
+{
+    int64_t duration = gralloc_now() - start;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->allocs++;
+    if (recycled) {
+        pool->hits++;
+        pool->recycledTime += duration;
+    } else {
+        pool->freshTime += duration;
+    }
+
+    if (pool->allocs >= POOL_STATS_ALLOCS) {
+        if (pool->stats) {
+            uint32_t misses = pool->allocs - pool->hits;
+            ALOGD("pool: %u allocs, %u recycled avg %lld us, %u fresh avg %lld us,"
+                    " %d cached (%u KB)", pool->allocs,
+                    pool->hits, pool->hits ? pool->recycledTime / pool->hits / 1000 : 0,
+                    misses, misses ? pool->freshTime / misses / 1000 : 0,
+                    pool->count, pool->bytes / 1024);
+        }
+        pool->allocs = 0;
+        pool->hits = 0;
+        pool->freshTime = 0;
+        pool->recycledTime = 0;
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* new or recycled ion memory may hold anything its previous owner left
+ * behind, clear it once here rather than on every mapping. */
+int gralloc_clear_buffer(int fd, size_t size)
+{
+    void* vaddr = mmap(0, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (vaddr == MAP_FAILED) {
+        ALOGE("Could not mmap fd=%d to clear it (%s)", fd, strerror(errno));
+        return -errno;
+    }
+    memset(vaddr, 0, size);
+    munmap(vaddr, size);
+    return 0;
+}
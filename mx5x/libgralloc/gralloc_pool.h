@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef GRALLOC_POOL_H_
+#define GRALLOC_POOL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/*****************************************************************************/
+
+#define POOL_MAX_ENTRIES    16
+#define POOL_DEFAULT_KB     16384
+#define POOL_MAX_AGE_NS     2000000000LL
+#define POOL_STATS_ALLOCS   100
+
+enum {
+    POOL_CLASS_HW = 0,
+    POOL_CLASS_SW,
+};
+
+/* zeroes the contiguous buffer fd at phys before the pool hands it out */
+typedef int (*gralloc_pool_clear_t)(void* data, int fd, size_t size, unsigned long phys);
+
+/* an ion buffer released by gralloc_free, still shared through fd and
+ * waiting to be handed out again for the same size and usage class. */
+struct gralloc_pool_entry_t {
+    int fd;
+    size_t size;
+    unsigned long phys;
+    int cls;
+    int64_t released;
+};
+
+struct gralloc_pool_t {
+    pthread_mutex_t lock;
+    /* ordered from the oldest to the most recently released */
+    gralloc_pool_entry_t entries[POOL_MAX_ENTRIES];
+    int count;
+    size_t bytes;
+    size_t maxBytes;
+
+    /* how recycled buffers are cleared, gralloc_clear_buffer when NULL */
+    gralloc_pool_clear_t clear;
+    void* clearData;
+
+    /* allocation latency, logged with debug.gralloc.poolstats */
+    int stats;
+    uint32_t allocs;
+    uint32_t hits;
+    int64_t freshTime;
+    int64_t recycledTime;
+};
+
+int64_t gralloc_now();
+int gralloc_pool_class(int usage);
+void gralloc_pool_init(gralloc_pool_t* pool);
+void gralloc_pool_destroy(gralloc_pool_t* pool);
+void gralloc_pool_trim(gralloc_pool_t* pool);
+
+/* a recycled buffer of size and class, cleared. -ENOENT when none. */
+int gralloc_pool_get(gralloc_pool_t* pool, size_t size, int cls,
+        int* fd, unsigned long* phys);
+
+/* takes the ownership of fd when the buffer is kept */
+bool gralloc_pool_put(gralloc_pool_t* pool, int fd, size_t size,
+        unsigned long phys, int usage);
+
+void gralloc_pool_stats(gralloc_pool_t* pool, bool recycled, int64_t start);
+
+/* zero size bytes of the shared buffer fd */
+int gralloc_clear_buffer(int fd, size_t size);
+
+/*****************************************************************************/
+
+#endif /* GRALLOC_POOL_H_ */
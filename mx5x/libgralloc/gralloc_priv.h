@@ -40,6 +40,20 @@
 struct private_module_t;
 struct private_handle_t;
 
+/* Lets the composer blit the layers it kept for the 2D core on top of
+ * what gles rendered into a buffer posted to the framebuffer. compose
+ * returns 1 with a token when blits were queued, wait is called with
+ * that token before the buffer goes on screen. With a hook the post
+ * returns once the flip is queued and hands the release fence of the
+ * buffer to posted, -1 when the post waited for its flip: the composer
+ * keeps it and waits for it before drawing again. */
+struct fb_post_hook_t {
+    int (*compose)(struct fb_post_hook_t* hook, buffer_handle_t buffer,
+            uint32_t* token);
+    void (*wait)(struct fb_post_hook_t* hook, uint32_t token);
+    void (*posted)(struct fb_post_hook_t* hook, int releaseFence);
+};
+
 struct private_module_t {
     gralloc_module_t base;
 
@@ -51,6 +65,10 @@ struct private_module_t {
     buffer_handle_t currentBuffer;
     int ion_master;
     unsigned long master_phys;
+    /* bumped by every gralloc_free, lets 2D users drop what they cached
+     * about buffers that may be gone */
+    volatile int32_t freeCount;
+    struct fb_post_hook_t* volatile postHook;
 
     struct fb_var_screeninfo info;
     struct fb_fix_screeninfo finfo;
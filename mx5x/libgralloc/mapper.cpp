@@ -18,45 +18,118 @@
 
 #include <errno.h>
 #include <pthread.h>
+#include <stdlib.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include <ion/ion.h>
+#include <time.h>
 
 #include <cutils/log.h>
 #include <cutils/atomic.h>
+#include <cutils/properties.h>
 #include <hardware/hardware.h>
 #include <hardware/gralloc.h>
 
 #include "gralloc_priv.h"
 
+static pthread_mutex_t sMapLock = PTHREAD_MUTEX_INITIALIZER; 
+
+/* Handles of the same contiguous buffer registered several times in one
+ * process share a single mapping, found through the physical address
+ * which stays unique while any of them keeps the buffer alive. Buffers
+ * allocated in this process keep their own mapping. */
+#define GRALLOC_MAX_MAPPINGS 64
+
+struct gralloc_mapping_t {
+    int phys;
+    int size;
+    intptr_t base;
+    int refs;
+};
+
+static gralloc_mapping_t sMappings[GRALLOC_MAX_MAPPINGS];
+static int sMapStats = -1;
+
+static int64_t gralloc_map_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static gralloc_mapping_t* gralloc_find_mapping_locked(int phys, int size)
+{
+    for (int i = 0; i < GRALLOC_MAX_MAPPINGS; i++) {
+        if (sMappings[i].refs && sMappings[i].phys == phys &&
+            sMappings[i].size == size) {
+            return &sMappings[i];
+        }
+    }
+    return NULL;
+}
+
+static void gralloc_add_mapping_locked(int phys, int size, intptr_t base)
+{
+    for (int i = 0; i < GRALLOC_MAX_MAPPINGS; i++) {
+        if (sMappings[i].refs == 0) {
+            sMappings[i].phys = phys;
+            sMappings[i].size = size;
+            sMappings[i].base = base;
+            sMappings[i].refs = 1;
+            return;
+        }
+    }
+    // table full, the buffer simply keeps a private mapping.
+}
+
+/* called with sMapLock held */
 static int gralloc_map(gralloc_module_t const* module,
         buffer_handle_t handle,
         void** vaddr)
 {
     private_handle_t* hnd = (private_handle_t*)handle;
     if (!(hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER)) {
-        int fd;
         size_t size = hnd->size;
+        int64_t start = 0;
+
+        if (sMapStats < 0) {
+            char value[PROPERTY_VALUE_MAX];
+            property_get("debug.gralloc.mapstats", value, "0");
+            sMapStats = atoi(value);
+        }
+        if (sMapStats) {
+            start = gralloc_map_now();
+        }
+
+        bool shared = hnd->phys && hnd->pid != getpid();
+        gralloc_mapping_t* mapping = NULL;
+        if (shared) {
+            mapping = gralloc_find_mapping_locked(hnd->phys, hnd->size);
+        }
 
-        fd = ion_open();
-        if(fd < 0) {
-            ALOGE("gralloc_map() Cannot open ion err = %d", errno);
-            return -errno;
+        if (mapping != NULL) {
+            mapping->refs++;
+            hnd->base = mapping->base;
+        } else {
+            void* mappedAddress = mmap(0, size,
+                    PROT_READ|PROT_WRITE, MAP_SHARED, hnd->fd, 0);
+            if (mappedAddress == MAP_FAILED) {
+                ALOGE("Could not mmap handle %p, fd=%d (%s)",
+                        handle, hnd->fd, strerror(errno));
+                hnd->base = 0;
+                return -errno;
+            }
+            hnd->base = intptr_t(mappedAddress);
+            if (shared) {
+                gralloc_add_mapping_locked(hnd->phys, hnd->size, hnd->base);
+            }
         }
-        void* mappedAddress = mmap(0, size,
-                PROT_READ|PROT_WRITE, MAP_SHARED, hnd->fd, 0);
-        if (mappedAddress == MAP_FAILED) {
-            ALOGE("Could not mmap handle %p, fd=%d (%s)",
-                    handle, hnd->fd, strerror(errno));
-            hnd->base = 0;
-            return -errno;
+
+        if (sMapStats) {
+            ALOGD("map %d KB %s in %lld us", hnd->size / 1024,
+                  mapping ? "shared" : "new",
+                  (gralloc_map_now() - start) / 1000);
         }
-        hnd->base = intptr_t(mappedAddress);
-        memset(mappedAddress, 0, size);
-        //ALOGD("gralloc_map() succeeded fd=%d, off=%d, size=%d, vaddr=%p", 
-        //        hnd->fd, hnd->offset, hnd->size, mappedAddress);
-        close(fd);
     }
     *vaddr = (void*)hnd->base;
     return 0;
@@ -70,8 +143,19 @@ static int gralloc_unmap(gralloc_module_t const* module,
         void* base = (void*)hnd->base;
         size_t size = hnd->size;
 
+        pthread_mutex_lock(&sMapLock);
+        gralloc_mapping_t* mapping = NULL;
+        if (hnd->phys && hnd->pid != getpid()) {
+            mapping = gralloc_find_mapping_locked(hnd->phys, hnd->size);
+        }
+        if (mapping != NULL && mapping->base == hnd->base && --mapping->refs > 0) {
+            // still mapped through another handle of this buffer
+            base = NULL;
+        }
+        pthread_mutex_unlock(&sMapLock);
+
         //ALOGD("unmapping from %p, size=%d", base, size);
-        if (munmap(base, size) < 0) {
+        if (base && munmap(base, size) < 0) {
             ALOGE("Could not unmap %s", strerror(errno));
         }
     }
@@ -79,8 +163,6 @@ static int gralloc_unmap(gralloc_module_t const* module,
     return 0;
 }
 
-static pthread_mutex_t sMapLock = PTHREAD_MUTEX_INITIALIZER; 
-
 int gralloc_register_buffer(gralloc_module_t const* module,
         buffer_handle_t handle)
 {
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Latency of the first lock of a buffer through mapper.cpp and of the
+ * first read of each of its pages, on the host, for buffers of 1 to
+ * 16 MB. Shared memory stands in for the ion buffers and is cleared
+ * through a mapping of its own, as gralloc_alloc_buffer does. Three
+ * cases:
+ *
+ *   fresh     a handle imported from the allocating process, the only
+ *             one of its buffer here: a new mapping
+ *   shared    a second handle of a buffer already mapped and read
+ *             through the first one: the mapping is found in the table
+ *   allocator the handle in the process that allocated it, which maps
+ *             it on the first lock and never through the table
+ *
+ * Host shared memory fills the page tables on the first touch of each
+ * page. An ion carveout mapping is filled by the mmap itself, so on the
+ * target the cost moves from the touch to the lock; the total is what
+ * compares.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <cutils/log.h>
+#include <hardware/gralloc.h>
+
+#include "gralloc_priv.h"
+#include "imx_test.h"
+
+extern int gralloc_register_buffer(gralloc_module_t const* module, buffer_handle_t handle);
+extern int gralloc_unregister_buffer(gralloc_module_t const* module, buffer_handle_t handle);
+extern int gralloc_lock(gralloc_module_t const* module, buffer_handle_t handle, int usage,
+        int l, int t, int w, int h, void** vaddr);
+extern int gralloc_unlock(gralloc_module_t const* module, buffer_handle_t handle);
+
+#define PHYS_BASE 0x40000000
+#define RUNS 10
+#define PAGE 4096
+
+enum { CASE_FRESH, CASE_SHARED, CASE_ALLOCATOR, CASES };
+
+static const char* const sCaseNames[CASES] = { "fresh", "shared", "allocator" };
+
+struct bench_result_t {
+    int64_t lock;
+    int64_t touch;
+    int64_t max;
+};
+
+/*****************************************************************************/
+
+extern "C" void* mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+#if defined(__x86_64__)
+    // handles keep the address in an int, stay below 2 GB on 64 bit hosts
+    flags |= MAP_32BIT;
+#endif
+    return (void*)syscall(SYS_mmap, addr, length, prot, flags, fd, offset);
+}
+
+static private_module_t sModule;
+#define MODULE (&sModule.base)
+
+/* a buffer as gralloc_alloc_buffer leaves it: allocated and cleared */
+static int bench_region(size_t size)
+{
+    char name[64];
+    static int sCount;
+
+    snprintf(name, sizeof(name), "/gralloc_map_bench.%d.%d", getpid(), sCount++);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+        return -1;
+    shm_unlink(name);
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        return -1;
+    }
+    void* p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    memset(p, 0, size);
+    munmap(p, size);
+    return fd;
+}
+
+/* a handle as it arrives through binder, or as the allocator keeps it */
+static private_handle_t* bench_handle(int fd, size_t size, int phys, bool imported)
+{
+    private_handle_t* hnd = new private_handle_t(dup(fd), size,
+            private_handle_t::PRIV_FLAGS_USES_ION);
+    hnd->phys = phys;
+    if (imported) {
+        hnd->pid = getpid() + 1;
+        hnd->base = 0x1234;
+        hnd->lockState = private_handle_t::LOCK_STATE_MAPPED;
+        CHECK(gralloc_register_buffer(MODULE, hnd) == 0, "register");
+    }
+    return hnd;
+}
+
+static void bench_release(private_handle_t* hnd, bool imported)
+{
+    if (imported) {
+        CHECK(gralloc_unregister_buffer(MODULE, hnd) == 0, "unregister");
+    } else {
+        // the allocating process unmaps in terminateBuffer on free
+        munmap((void*)(intptr_t)hnd->base, hnd->size);
+    }
+    close(hnd->fd);
+    delete hnd;
+}
+
+/* the first lock and a read of every page, timed apart */
+static void bench_lock(private_handle_t* hnd, int64_t* lock, int64_t* touch)
+{
+    void* vaddr = NULL;
+    int64_t start = imx_test_ns(CLOCK_MONOTONIC);
+    int err = gralloc_lock(MODULE, hnd, GRALLOC_USAGE_SW_READ_OFTEN, 0, 0, 16, 16, &vaddr);
+    int64_t locked = imx_test_ns(CLOCK_MONOTONIC);
+    CHECK(err == 0 && vaddr, "lock: %d", err);
+    if (err == 0 && vaddr) {
+        const volatile uint8_t* p = (const volatile uint8_t*)vaddr;
+        unsigned sum = 0;
+        for (int i = 0; i < hnd->size; i += PAGE)
+            sum += p[i];
+        CHECK(sum == 0, "buffer not cleared");
+    }
+    *lock = locked - start;
+    *touch = imx_test_ns(CLOCK_MONOTONIC) - locked;
+    CHECK(gralloc_unlock(MODULE, hnd) == 0, "unlock");
+}
+
+static void bench_case(int type, size_t size, int phys, bench_result_t* r)
+{
+    int fd = bench_region(size);
+    CHECK(fd >= 0, "%zu byte region: %s", size, strerror(errno));
+    if (fd < 0)
+        return;
+
+    bool imported = type != CASE_ALLOCATOR;
+    private_handle_t* first = NULL;
+    if (type == CASE_SHARED) {
+        int64_t lock, touch;
+        first = bench_handle(fd, size, phys, true);
+        bench_lock(first, &lock, &touch);
+    }
+
+    int64_t lock, touch;
+    private_handle_t* hnd = bench_handle(fd, size, phys, imported);
+    bench_lock(hnd, &lock, &touch);
+    if (first != NULL)
+        CHECK(hnd->base == first->base, "second handle mapped again");
+    r->lock += lock;
+    r->touch += touch;
+    if (lock + touch > r->max)
+        r->max = lock + touch;
+
+    bench_release(hnd, imported);
+    if (first != NULL)
+        bench_release(first, true);
+    close(fd);
+}
+
+int main()
+{
+    memset(&sModule, 0, sizeof(sModule));
+
+    // the first map reads its debug property
+    bench_result_t warmup;
+    memset(&warmup, 0, sizeof(warmup));
+    bench_case(CASE_FRESH, PAGE, PHYS_BASE, &warmup);
+
+    printf("size   case       lock us  touch us  total us  max us\n");
+    for (int mb = 1; mb <= 16; mb *= 2) {
+        size_t size = mb << 20;
+        for (int type = 0; type < CASES; type++) {
+            bench_result_t r;
+            memset(&r, 0, sizeof(r));
+            for (int run = 0; run < RUNS; run++)
+                bench_case(type, size, PHYS_BASE + run * size, &r);
+            printf("%2d MB  %-9s %8lld %9lld %9lld %7lld\n", mb, sCaseNames[type],
+                   (long long)(r.lock / RUNS / 1000), (long long)(r.touch / RUNS / 1000),
+                   (long long)((r.lock + r.touch) / RUNS / 1000), (long long)(r.max / 1000));
+        }
+    }
+
+    return imx_test_result("gralloc_map_bench");
+}
@@ -0,0 +1,328 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Mapping of imported buffers by mapper.cpp, on the host. Shared memory
+ * stands in for the ion buffers, a handle with another pid for one
+ * imported from the allocating process. mmap, munmap and open are
+ * answered here to count the real mappings and catch a device opened
+ * for a map:
+ *
+ *   - handles of one contiguous buffer share a mapping, which lives
+ *     until the last of them is unregistered
+ *   - ashmem buffers, buffers of this process and buffers past the
+ *     mapping table keep their own mapping
+ *   - every mapping is gone once its handles are, also when threads
+ *     import the same buffers concurrently
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include <cutils/log.h>
+#include <hardware/gralloc.h>
+
+#include "gralloc_priv.h"
+#include "imx_test.h"
+
+extern int gralloc_register_buffer(gralloc_module_t const* module, buffer_handle_t handle);
+extern int gralloc_unregister_buffer(gralloc_module_t const* module, buffer_handle_t handle);
+extern int gralloc_lock(gralloc_module_t const* module, buffer_handle_t handle, int usage,
+        int l, int t, int w, int h, void** vaddr);
+extern int gralloc_unlock(gralloc_module_t const* module, buffer_handle_t handle);
+
+#define BUFFER_SIZE (64 * 1024)
+#define PHYS_BASE 0x40000000
+#define THREADS 4
+
+/*****************************************************************************/
+
+static pthread_mutex_t sFakeLock = PTHREAD_MUTEX_INITIALIZER;
+static int sMaps;
+static int sUnmaps;
+static int sOpens;
+
+extern "C" void* mmap(void* addr, size_t length, int prot, int flags, int fd, off_t offset)
+{
+#if defined(__x86_64__)
+    // handles keep the address in an int, stay below 2 GB on 64 bit hosts
+    flags |= MAP_32BIT;
+#endif
+    void* p = (void*)syscall(SYS_mmap, addr, length, prot, flags, fd, offset);
+    if (p != MAP_FAILED) {
+        pthread_mutex_lock(&sFakeLock);
+        sMaps++;
+        pthread_mutex_unlock(&sFakeLock);
+    }
+    return p;
+}
+
+extern "C" int munmap(void* addr, size_t length)
+{
+    int err = syscall(SYS_munmap, addr, length);
+    if (err == 0) {
+        pthread_mutex_lock(&sFakeLock);
+        sUnmaps++;
+        pthread_mutex_unlock(&sFakeLock);
+    }
+    return err;
+}
+
+extern "C" int open(const char* path, int flags, ...)
+{
+    mode_t mode = 0;
+    if (flags & O_CREAT) {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, int);
+        va_end(args);
+    }
+    pthread_mutex_lock(&sFakeLock);
+    sOpens++;
+    pthread_mutex_unlock(&sFakeLock);
+    return syscall(SYS_openat, AT_FDCWD, path, flags, mode);
+}
+
+/*****************************************************************************/
+
+static private_module_t sModule;
+// the first map reads its debug property
+static bool sWarmup;
+#define MODULE (&sModule.base)
+
+static int test_region(uint8_t fill)
+{
+    char name[64];
+    static int sCount;
+
+    snprintf(name, sizeof(name), "/gralloc_map_test.%d.%d", getpid(), sCount++);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+        return -1;
+    shm_unlink(name);
+    if (ftruncate(fd, BUFFER_SIZE) < 0) {
+        close(fd);
+        return -1;
+    }
+    uint8_t* p = (uint8_t*)mmap(0, BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    memset(p, fill, BUFFER_SIZE);
+    munmap(p, BUFFER_SIZE);
+    return fd;
+}
+
+/* a handle of the buffer as it arrives through binder: own fd, other pid */
+static private_handle_t* test_import(int fd, int phys)
+{
+    private_handle_t* hnd = new private_handle_t(dup(fd), BUFFER_SIZE,
+            phys ? private_handle_t::PRIV_FLAGS_USES_ION : 0);
+    hnd->phys = phys;
+    hnd->pid = getpid() + 1;
+    // whatever the allocating process had there
+    hnd->base = 0x1234;
+    hnd->lockState = private_handle_t::LOCK_STATE_MAPPED;
+    CHECK(gralloc_register_buffer(MODULE, hnd) == 0, "register");
+    return hnd;
+}
+
+static void test_release(private_handle_t* hnd)
+{
+    CHECK(gralloc_unregister_buffer(MODULE, hnd) == 0, "unregister");
+    close(hnd->fd);
+    delete hnd;
+}
+
+static uint8_t* test_lock(private_handle_t* hnd)
+{
+    void* vaddr = NULL;
+    int opens = sOpens;
+    int err = gralloc_lock(MODULE, hnd, GRALLOC_USAGE_SW_READ_OFTEN, 0, 0, 16, 16, &vaddr);
+    CHECK(err == 0 && vaddr, "lock: %d", err);
+    CHECK(gralloc_unlock(MODULE, hnd) == 0, "unlock");
+    // a map only needs the buffer fd, no device
+    CHECK(sOpens == opens || sWarmup, "%d files opened for a map", sOpens - opens);
+    return (uint8_t*)vaddr;
+}
+
+static bool test_mapped(const void* vaddr)
+{
+    unsigned char vec[BUFFER_SIZE / 4096];
+    return mincore((void*)vaddr, BUFFER_SIZE, vec) == 0;
+}
+
+/*****************************************************************************/
+
+static void test_shared()
+{
+    int fd = test_region(0x5a);
+    int maps = sMaps, unmaps = sUnmaps;
+
+    private_handle_t* a = test_import(fd, PHYS_BASE);
+    private_handle_t* b = test_import(fd, PHYS_BASE);
+    uint8_t* va = test_lock(a);
+    uint8_t* vb = test_lock(b);
+    // locking again keeps the mapping of the first lock
+    CHECK(test_lock(a) == va, "mapped again on the second lock");
+
+    CHECK(va == vb, "two mappings of one buffer: %p and %p", va, vb);
+    CHECK(sMaps - maps == 1, "%d mmaps for one buffer", sMaps - maps);
+    CHECK(va && va[0] == 0x5a && va[BUFFER_SIZE - 1] == 0x5a, "content");
+
+    test_release(a);
+    CHECK(sUnmaps == unmaps, "unmapped with a handle left");
+    CHECK(test_mapped(vb) && vb[BUFFER_SIZE / 2] == 0x5a, "mapping gone under the second handle");
+
+    test_release(b);
+    CHECK(sUnmaps - unmaps == 1, "%d munmaps", sUnmaps - unmaps);
+    CHECK(!test_mapped(vb), "mapping left after the last handle");
+
+    // the buffer is gone, the next one at that address gets a mapping of its own
+    int fd2 = test_region(0x33);
+    private_handle_t* c = test_import(fd2, PHYS_BASE);
+    uint8_t* vc = test_lock(c);
+    CHECK(vc && vc[0] == 0x33, "stale mapping reused for a new buffer");
+    test_release(c);
+    close(fd2);
+    close(fd);
+}
+
+static void test_private()
+{
+    int fd = test_region(0x11);
+    int fd2 = test_region(0x22);
+
+    // another buffer has its own mapping
+    private_handle_t* a = test_import(fd, PHYS_BASE);
+    private_handle_t* b = test_import(fd2, PHYS_BASE + BUFFER_SIZE);
+    uint8_t* va = test_lock(a);
+    uint8_t* vb = test_lock(b);
+    CHECK(va != vb && va[0] == 0x11 && vb[0] == 0x22, "buffers mixed up");
+    test_release(a);
+    test_release(b);
+
+    // ashmem has no physical address to share on
+    int maps = sMaps;
+    a = test_import(fd, 0);
+    b = test_import(fd, 0);
+    va = test_lock(a);
+    vb = test_lock(b);
+    CHECK(va != vb && sMaps - maps == 2, "ashmem buffers shared");
+    test_release(a);
+    test_release(b);
+    CHECK(!test_mapped(va) && !test_mapped(vb), "ashmem mappings left");
+
+    // the allocating process keeps its own mapping, imports do not use it
+    private_handle_t* own = new private_handle_t(dup(fd), BUFFER_SIZE,
+            private_handle_t::PRIV_FLAGS_USES_ION);
+    own->phys = PHYS_BASE;
+    uint8_t* vo = test_lock(own);
+    a = test_import(fd, PHYS_BASE);
+    va = test_lock(a);
+    CHECK(va != vo, "import shares the mapping of the allocating process");
+    test_release(a);
+    CHECK(test_mapped(vo), "mapping of the allocating process dropped");
+    munmap(vo, BUFFER_SIZE);
+    close(own->fd);
+    delete own;
+
+    close(fd);
+    close(fd2);
+}
+
+/* more buffers than the table holds still map and unmap */
+static void test_table_full()
+{
+    enum { COUNT = 80 };
+    private_handle_t* hnd[COUNT][2];
+    int fd = test_region(0x77);
+    int maps = sMaps, unmaps = sUnmaps;
+
+    for (int i = 0; i < COUNT; i++) {
+        for (int k = 0; k < 2; k++) {
+            hnd[i][k] = test_import(fd, PHYS_BASE + i * BUFFER_SIZE);
+            uint8_t* v = test_lock(hnd[i][k]);
+            CHECK(v && v[i] == 0x77, "buffer %d", i);
+        }
+    }
+    // the table holds 64, the others map once per handle
+    CHECK(sMaps - maps <= COUNT * 2 && sMaps - maps >= COUNT, "%d mmaps", sMaps - maps);
+    for (int i = 0; i < COUNT; i++) {
+        for (int k = 0; k < 2; k++)
+            test_release(hnd[i][k]);
+    }
+    CHECK(sMaps - maps == sUnmaps - unmaps, "%d mmaps, %d munmaps", sMaps - maps,
+          sUnmaps - unmaps);
+    close(fd);
+}
+
+static int sThreadFds[4];
+
+static void* test_thread(void*)
+{
+    for (int n = 0; n < 500; n++) {
+        int i = n % 4;
+        private_handle_t* hnd = test_import(sThreadFds[i], PHYS_BASE + i * BUFFER_SIZE);
+        uint8_t* v = test_lock(hnd);
+        CHECK(v && v[n % BUFFER_SIZE] == i + 1, "thread read buffer %d", i);
+        test_release(hnd);
+    }
+    return NULL;
+}
+
+static void test_threads()
+{
+    pthread_t threads[THREADS];
+    int maps = sMaps, unmaps = sUnmaps;
+
+    for (int i = 0; i < 4; i++)
+        sThreadFds[i] = test_region(i + 1);
+    maps = sMaps;
+    unmaps = sUnmaps;
+    for (int i = 0; i < THREADS; i++)
+        pthread_create(&threads[i], NULL, test_thread, NULL);
+    for (int i = 0; i < THREADS; i++)
+        pthread_join(threads[i], NULL);
+    CHECK(sMaps - maps == sUnmaps - unmaps, "%d mmaps, %d munmaps", sMaps - maps,
+          sUnmaps - unmaps);
+    for (int i = 0; i < 4; i++)
+        close(sThreadFds[i]);
+}
+
+int main()
+{
+    memset(&sModule, 0, sizeof(sModule));
+    sWarmup = true;
+    int fd = test_region(0);
+    private_handle_t* hnd = test_import(fd, 0);
+    test_lock(hnd);
+    test_release(hnd);
+    close(fd);
+    sWarmup = false;
+
+    test_shared();
+    test_private();
+    test_table_full();
+    test_threads();
+
+    return imx_test_result("gralloc_map_test");
+}
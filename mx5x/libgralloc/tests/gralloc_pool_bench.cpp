@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Allocation latency of gralloc_alloc_buffer with and without the pool,
+ * on the host. Shared memory stands in for the ion carveout: a fresh
+ * buffer is a new region cleared through a new mapping, as after
+ * ion_alloc, a recycled one comes out of the pool. The ion ioctls a
+ * fresh buffer also costs on the target are not counted.
+ *
+ * The workload is the surface churn of an activity transition: a window
+ * allocates its three buffers, draws into them and frees them, with the
+ * size of the next window. Every recycled buffer is checked to come back
+ * cleared, whatever its usage class.
+ *
+ * The clear is timed apart. Here it is a memset through a mapping. On the
+ * target the 2D core fills the buffer, and that part of the latency no
+ * longer costs cpu time.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <hardware/gralloc.h>
+
+#include "gralloc_pool.h"
+
+#define WINDOWS 200
+#define BUFFERS 3
+
+struct bench_size_t {
+    int width;
+    int height;
+    int bpp;
+    int usage;
+};
+
+static const bench_size_t sSizes[] = {
+    { 800, 480, 4, GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_RENDER },
+    { 800, 480, 2, GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_SW_WRITE_OFTEN },
+    { 480, 800, 4, GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_HW_RENDER },
+    { 1024, 600, 4, GRALLOC_USAGE_HW_2D },
+    { 320, 240, 4, GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_SW_READ_OFTEN },
+};
+#define SIZES (sizeof(sSizes) / sizeof(sSizes[0]))
+
+struct bench_buffer_t {
+    int fd;
+    size_t size;
+    int usage;
+};
+
+struct bench_result_t {
+    int64_t total;
+    int64_t clear;
+    int64_t max;
+    uint32_t allocs;
+    uint32_t hits;
+    uint32_t dirty;
+};
+
+static int bench_region(size_t size)
+{
+    char name[64];
+    static int sCount;
+
+    snprintf(name, sizeof(name), "/gralloc_pool_bench.%d.%d", getpid(), sCount++);
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+        return -1;
+    shm_unlink(name);
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int64_t sClearTime;
+
+/* the clear of gralloc_pool_get and of a fresh buffer, timed */
+static int bench_clear(void* data, int fd, size_t size, unsigned long phys)
+{
+    int64_t start = gralloc_now();
+    int err = gralloc_clear_buffer(fd, size);
+    sClearTime += gralloc_now() - start;
+    return err;
+}
+
+static int bench_alloc(gralloc_pool_t* pool, size_t size, int usage,
+        bench_buffer_t* buffer, bench_result_t* result)
+{
+    int fd = -1;
+    unsigned long phys = 0;
+    int64_t start = gralloc_now();
+    int64_t clear = sClearTime;
+    bool recycled = false;
+
+    if (gralloc_pool_get(pool, size, gralloc_pool_class(usage), &fd, &phys) == 0) {
+        recycled = true;
+    } else {
+        fd = bench_region(size);
+        if (fd < 0 || bench_clear(NULL, fd, size, 0) < 0) {
+            fprintf(stderr, "cannot allocate %zu bytes\n", size);
+            return -1;
+        }
+    }
+
+    int64_t t = gralloc_now() - start;
+    result->total += t;
+    result->clear += sClearTime - clear;
+    if (t > result->max)
+        result->max = t;
+    result->allocs++;
+
+    if (recycled) {
+        result->hits++;
+        uint8_t* p = (uint8_t*)mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+            return -1;
+        for (size_t i = 0; i < size; i += 64) {
+            if (p[i]) {
+                result->dirty++;
+                break;
+            }
+        }
+        munmap(p, size);
+    }
+
+    buffer->fd = fd;
+    buffer->size = size;
+    buffer->usage = usage;
+    return 0;
+}
+
+static void bench_draw(bench_buffer_t* buffer)
+{
+    void* p = mmap(0, buffer->size, PROT_READ | PROT_WRITE, MAP_SHARED, buffer->fd, 0);
+    if (p == MAP_FAILED)
+        return;
+    memset(p, 0xa5, buffer->size);
+    munmap(p, buffer->size);
+}
+
+static void bench_free(gralloc_pool_t* pool, bench_buffer_t* buffer)
+{
+    // any non zero phys, there is no carveout here
+    if (!gralloc_pool_put(pool, buffer->fd, buffer->size, 1, buffer->usage))
+        close(buffer->fd);
+}
+
+static int bench_run(size_t maxBytes, bench_result_t* result)
+{
+    gralloc_pool_t pool;
+
+    memset(&pool, 0, sizeof(pool));
+    gralloc_pool_init(&pool);
+    pool.maxBytes = maxBytes;
+    pool.clear = bench_clear;
+    memset(result, 0, sizeof(*result));
+
+    for (int w = 0; w < WINDOWS; w++) {
+        const bench_size_t* s = &sSizes[w % SIZES];
+        size_t size = (s->width * s->height * s->bpp + 4095) & ~4095;
+        bench_buffer_t buffers[BUFFERS];
+
+        for (int i = 0; i < BUFFERS; i++) {
+            if (bench_alloc(&pool, size, s->usage, &buffers[i], result) < 0)
+                return -1;
+            bench_draw(&buffers[i]);
+        }
+        for (int i = 0; i < BUFFERS; i++)
+            bench_free(&pool, &buffers[i]);
+    }
+
+    gralloc_pool_destroy(&pool);
+    return 0;
+}
+
+int main()
+{
+    static const struct {
+        const char* name;
+        size_t maxBytes;
+    } runs[] = {
+        { "no pool", 0 },
+        { "pool 16MB", POOL_DEFAULT_KB * 1024 },
+    };
+    int failures = 0;
+
+    printf("%d windows of %d buffers, %zu sizes:\n", WINDOWS, BUFFERS, SIZES);
+    for (size_t r = 0; r < sizeof(runs) / sizeof(runs[0]); r++) {
+        bench_result_t result;
+
+        if (bench_run(runs[r].maxBytes, &result) < 0)
+            return 1;
+        printf("%-10s alloc avg %7.1f us, clear %7.1f us of it, max %7.1f us  "
+                "%3u%% recycled  %u dirty\n",
+                runs[r].name, result.total / 1000.0 / result.allocs,
+                result.clear / 1000.0 / result.allocs,
+                result.max / 1000.0, result.hits * 100 / result.allocs,
+                result.dirty);
+        failures += result.dirty;
+    }
+
+    if (failures) {
+        printf("gralloc_pool_bench: FAILED, recycled buffers not cleared\n");
+        return 1;
+    }
+    return 0;
+}
@@ -29,21 +29,57 @@ LOCAL_SHARED_LIBRARIES :=			\
 	libui					\
 	libhardware				\
 	libhardware_legacy			\
-	libbinder
+	libbinder				\
+	libsync
 
 LOCAL_SRC_FILES :=				\
 	hwcomposer.cpp				\
 	hwc_vsync.cpp				\
 	hwc_display.cpp				\
-	hwc_uevent.cpp
+	hwc_uevent.cpp				\
+	hwc_hotplug.cpp				\
+	hwc_stats.cpp
 
 LOCAL_MODULE := hwcomposer.$(TARGET_BOARD_PLATFORM)
 LOCAL_C_INCLUDES += hardware/imx/mx6/libgralloc_wrapper
 LOCAL_CFLAGS:= -DLOG_TAG=\"hwcomposer\"
 LOCAL_CFLAGS += -DENABLE_VSYNC
-ifneq ($(HAVE_FSL_IMX_GPU3D),true)
+# virtual displays need HWC 1.3 and G2D for the write back. the Vivante
+# hwc of the 3D boards only knows HWC 1.1, it is handed the physical
+# displays alone with the crops it reads, see hwc_viv_displays.
+ifeq ($(HAVE_FSL_IMX_GPU2D),true)
+LOCAL_SRC_FILES += hwc_virtual.cpp
+LOCAL_SHARED_LIBRARIES += libg2d
+LOCAL_STATIC_LIBRARIES += libimxcompose
+LOCAL_C_INCLUDES += hardware/imx/libcompose
+LOCAL_C_INCLUDES += device/fsl-proprietary/include
+LOCAL_C_INCLUDES += system/core/libsync
+LOCAL_CFLAGS += -DENABLE_VIRTUAL_DISPLAY -DUSE_HWCOMPOSER_VERSION_1_3
+else ifneq ($(HAVE_FSL_IMX_GPU3D),true)
 LOCAL_CFLAGS += -DUSE_HWCOMPOSER_VERSION_1_2
 endif
 LOCAL_MODULE_TAGS := optional
 include $(BUILD_SHARED_LIBRARY)
 endif
+
+# virtual display composition against a software g2d and the pipe based
+# sw_sync of libfbflip, run on the host:
+# out/host/<os>-<arch>/bin/hwc_virtual_test
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES :=				\
+	hwc_virtual.cpp				\
+	tests/g2d_fake.cpp			\
+	tests/hwc_virtual_test.cpp		\
+	../../libfbflip/tests/sw_sync_fake.cpp
+LOCAL_C_INCLUDES +=				\
+	$(LOCAL_PATH)/tests/include		\
+	hardware/imx/mx6/libgralloc_wrapper	\
+	hardware/imx/libcompose			\
+	hardware/imx/libfbflip/tests/include	\
+	hardware/imx/libimxtest
+LOCAL_CFLAGS := -DLOG_TAG=\"hwcomposer\"
+LOCAL_STATIC_LIBRARIES := libimxcompose_host libimxtest_host libutils libcutils liblog
+LOCAL_LDLIBS := -lpthread
+LOCAL_MODULE := hwc_virtual_test
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
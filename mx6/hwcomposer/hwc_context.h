@@ -37,6 +37,8 @@
 #include "gralloc_priv.h"
 #include "hwc_vsync.h"
 #include "hwc_uevent.h"
+#include "hwc_stats.h"
+#include "hwc_hotplug.h"
 /*****************************************************************************/
 #define HWC_VIV_HARDWARE_MODULE_ID "hwcomposer_viv"
 #define HWC_MAIN_FB "/dev/graphics/fb0"
@@ -45,15 +47,21 @@
 #define HWC_STRING_LENGTH 32
 #define HWC_FB_PATH "/dev/graphics/fb"
 #define HWC_FB_SYS "/sys/class/graphics/fb"
+/* primary and external are backed by a framebuffer, the third slot
+ * holds the virtual display written back into its output buffer. */
+#define HWC_NUM_PHYSICAL_DISPLAY_TYPES 2
+#define HWC_NUM_DISPLAYS 3
 
 class VSyncThread;
 class UeventThread;
+struct hwc_virtual;
 
 enum {
     HWC_DISPLAY_LDB = 1,
     HWC_DISPLAY_HDMI = 2,
     HWC_DISPLAY_DVI = 3,
-    HWC_DISPLAY_HDMI_ON_BOARD = 4
+    HWC_DISPLAY_HDMI_ON_BOARD = 4,
+    HWC_DISPLAY_WRITEBACK = 5
 };
 
 typedef struct {
@@ -73,21 +81,50 @@ typedef struct {
 struct hwc_context_t {
     hwc_composer_device_1 device;
     /* our private state goes below here */
-    displayInfo mDispInfo[HWC_NUM_DISPLAY_TYPES];
-    //hwc_layer_list_t* mDispList[HWC_NUM_DISPLAY_TYPES];
-    //size_t mListCapacity[HWC_NUM_DISPLAY_TYPES];
+    displayInfo mDispInfo[HWC_NUM_DISPLAYS];
+    //hwc_layer_list_t* mDispList[HWC_NUM_DISPLAYS];
+    //size_t mListCapacity[HWC_NUM_DISPLAYS];
 
     bool m_vsync_enable;
 
     hwc_procs_t* m_callback;
 
+    /* guards the connected state and the fd of the external display
+     * against the hotplug, which may close and reopen it. only held for
+     * the flag and the fd, never across the bring up. */
+    pthread_mutex_t m_lock;
+    /* serializes the bring up of the external display, EDID read, mode
+     * switch and framebuffer reopen, between open and the uevent thread. */
+    pthread_mutex_t m_plug_lock;
+
     sp<VSyncThread> m_vsync_thread;
+    sp<VSyncThread> m_ext_vsync_thread;
     sp<UeventThread> m_uevent_thread;
 
     hwc_composer_device_1* m_viv_hwc;
+    /* copies of the physical display lists with integer crops, handed
+     * to the Vivante hwc from HWC 1.3 on. */
+    hwc_display_contents_1_t* m_viv_lists[HWC_NUM_PHYSICAL_DISPLAY_TYPES];
+    hwc_display_contents_1_t* m_viv_displays[HWC_NUM_PHYSICAL_DISPLAY_TYPES];
+    size_t m_viv_capacity[HWC_NUM_PHYSICAL_DISPLAY_TYPES];
     hw_module_t const *m_gralloc_module;
 
-    framebuffer_device_t* mFbDev[HWC_NUM_DISPLAY_TYPES];
+    framebuffer_device_t* mFbDev[HWC_NUM_PHYSICAL_DISPLAY_TYPES];
+    void* m_g2d_handle;
+    /* the thread writing the virtual display, see hwc_virtual.cpp */
+    struct hwc_virtual* m_virtual;
+
+    hwcStats mStats;
+    hwcEdid mEdid;
 };
 
+/* the float source crop of HWC 1.3 rounded to the pixel. */
+static inline void hwc_round_crop(const hwc_frect_t *cropf, hwc_rect_t *crop)
+{
+    crop->left = (int)(cropf->left + 0.5f);
+    crop->top = (int)(cropf->top + 0.5f);
+    crop->right = (int)(cropf->right + 0.5f);
+    crop->bottom = (int)(cropf->bottom + 0.5f);
+}
+
 #endif
@@ -34,17 +34,17 @@
 #include "gralloc_priv.h"
 #include "hwc_context.h"
 #include "hwc_vsync.h"
+#include "hwc_display.h"
 
 static int hwc_judge_display_state(struct hwc_context_t* ctx)
 {
     char fb_path[HWC_PATH_LENGTH];
     char tmp[HWC_PATH_LENGTH];
     char value[HWC_STRING_LENGTH];
-    FILE *fp;
     int dispid = 0;
 
     for (int i = 0; i < HWC_MAX_FB; i++) {
-        if(dispid >= HWC_NUM_DISPLAY_TYPES) {
+        if(dispid >= HWC_NUM_PHYSICAL_DISPLAY_TYPES) {
             ALOGW("system can't support more than %d devices", dispid);
             break;
         }
@@ -53,90 +53,65 @@ static int hwc_judge_display_state(struct hwc_context_t* ctx)
         memset(fb_path, 0, sizeof(fb_path));
         snprintf(fb_path, HWC_PATH_LENGTH, HWC_FB_SYS"%d", i);
         //check the fb device exist.
-        if (!(fp = fopen(fb_path, "r"))) {
+        if (access(fb_path, F_OK) < 0) {
             ALOGW("open %s failed", fb_path);
             continue;
         }
-        fclose(fp);
 
         //check if it is a real device
         snprintf(tmp, sizeof(tmp), "%s/name", fb_path);
-        if (!(fp = fopen(tmp, "r"))) {
-            ALOGW("open %s failed", tmp);
-            continue;
-        }
-        memset(value, 0, sizeof(value));
-        if (!fgets(value, sizeof(value), fp)) {
+        if (hwc_read_sysfs(tmp, value, sizeof(value)) <= 0) {
             ALOGE("Unable to read fb%d name %s", i, tmp);
-            fclose(fp);
             continue;
         }
         if (strstr(value, "FG")) {
             ALOGI("fb%d is overlay device", i);
-            fclose(fp);
             continue;
         }
-        fclose(fp);
 
         //read fb device name
         snprintf(tmp, sizeof(tmp), "%s/fsl_disp_dev_property", fb_path);
-        if (!(fp = fopen(tmp, "r"))) {
+        int len = hwc_read_sysfs(tmp, value, sizeof(value));
+        if (len < 0) {
             ALOGI("open %s failed", tmp);
-            //continue;
             //make default type to ldb.
             pInfo->type = HWC_DISPLAY_LDB;
             pInfo->connected = true;
         }
+        else if (len == 0) {
+            ALOGI("read %s failed", tmp);
+            continue;
+        }
+        else if (strstr(value, "hdmi")) {
+            ALOGI("fb%d is %s device", i, value);
+            pInfo->type = HWC_DISPLAY_HDMI;
+        }
+        else if (strstr(value, "dvi")) {
+            ALOGI("fb%d is %s device", i, value);
+            pInfo->type = HWC_DISPLAY_DVI;
+        }
         else {
-            memset(value, 0, sizeof(value));
-            if (!fgets(value, sizeof(value), fp)) {
-                ALOGI("read %s failed", tmp);
-                continue;
-                //make default type to ldb.
-                //pInfo->type = HWC_DISPLAY_LDB;
-                //pInfo->connected = true;
-            }
-            else if (strstr(value, "hdmi")) {
-                ALOGI("fb%d is %s device", i, value);
-                pInfo->type = HWC_DISPLAY_HDMI;
-            }
-            else if (strstr(value, "dvi")) {
-                ALOGI("fb%d is %s device", i, value);
-                pInfo->type = HWC_DISPLAY_DVI;
-            }
-            else {
-                ALOGI("fb%d is %s device", i, value);
-                pInfo->type = HWC_DISPLAY_LDB;
-                pInfo->connected = true;
-            }
-            fclose(fp);
+            ALOGI("fb%d is %s device", i, value);
+            pInfo->type = HWC_DISPLAY_LDB;
+            pInfo->connected = true;
         }
 
         pInfo->fb_num = i;
         if(pInfo->type != HWC_DISPLAY_LDB) {
             //judge connected device state
             snprintf(tmp, sizeof(tmp), "%s/disp_dev/cable_state", fb_path);
-            if (!(fp = fopen(tmp, "r"))) {
-                ALOGI("open %s failed", tmp);
+            if (hwc_read_sysfs(tmp, value, sizeof(value)) <= 0) {
+                ALOGI("read %s failed", tmp);
                 //make default to false.
                 pInfo->connected = false;
             }
+            else if (strstr(value, "plugin")) {
+                ALOGI("fb%d device %s", i, value);
+                pInfo->connected = true;
+            }
             else {
-                memset(value,  0, sizeof(value));
-                if (!fgets(value, sizeof(value), fp)) {
-                    ALOGI("read %s failed", tmp);
-                    //make default to false.
-                    pInfo->connected = false;
-                }
-                else if (strstr(value, "plugin")) {
-                    ALOGI("fb%d device %s", i, value);
-                    pInfo->connected = true;
-                }
-                else {
-                    ALOGI("fb%d device %s", i, value);
-                    pInfo->connected = false;
-                }
-                fclose(fp);
+                ALOGI("fb%d device %s", i, value);
+                pInfo->connected = false;
             }
         }
 
@@ -156,18 +131,23 @@ int hwc_get_framebuffer_info(displayInfo *pInfo)
     char fb_path[HWC_PATH_LENGTH];
     int refreshRate;
 
-    memset(fb_path, 0, sizeof(fb_path));
-    snprintf(fb_path, HWC_PATH_LENGTH, HWC_FB_PATH"%d", pInfo->fb_num);
-    pInfo->fd = open(fb_path, O_RDWR);
-    if(pInfo->fd < 0) {
-        ALOGE("open %s failed", fb_path);
-        return BAD_VALUE;
+    // the fd stays open across plug cycles, it is only refreshed here.
+    if (pInfo->fd <= 0) {
+        memset(fb_path, 0, sizeof(fb_path));
+        snprintf(fb_path, HWC_PATH_LENGTH, HWC_FB_PATH"%d", pInfo->fb_num);
+        pInfo->fd = open(fb_path, O_RDWR);
+        if(pInfo->fd < 0) {
+            ALOGE("open %s failed", fb_path);
+            pInfo->fd = 0;
+            return BAD_VALUE;
+        }
     }
 
     struct fb_var_screeninfo info;
     if (ioctl(pInfo->fd, FBIOGET_VSCREENINFO, &info) == -1) {
         ALOGE("FBIOGET_VSCREENINFO ioctl failed: %s", strerror(errno));
         close(pInfo->fd);
+        pInfo->fd = 0;
         return BAD_VALUE;
     }
 
@@ -214,7 +194,7 @@ int hwc_get_display_info(struct hwc_context_t* ctx)
     int dispid = 0;
 
     hwc_judge_display_state(ctx);
-    for(dispid=0; dispid<HWC_NUM_DISPLAY_TYPES; dispid++) {
+    for(dispid=0; dispid<HWC_NUM_PHYSICAL_DISPLAY_TYPES; dispid++) {
         displayInfo *pInfo = &ctx->mDispInfo[dispid];
         if(pInfo->connected) {
             err = hwc_get_framebuffer_info(pInfo);
@@ -228,7 +208,7 @@ int hwc_get_display_fbid(struct hwc_context_t* ctx, int disp_type)
 {
     int fbid = -1;
     int dispid = 0;
-    for(dispid=0; dispid<HWC_NUM_DISPLAY_TYPES; dispid++) {
+    for(dispid=0; dispid<HWC_NUM_PHYSICAL_DISPLAY_TYPES; dispid++) {
         displayInfo *pInfo = &ctx->mDispInfo[dispid];
         if(pInfo->type == disp_type) {
             fbid = pInfo->fb_num;
@@ -242,7 +222,7 @@ int hwc_get_display_fbid(struct hwc_context_t* ctx, int disp_type)
 int hwc_get_display_dispid(struct hwc_context_t* ctx, int disp_type)
 {
     int dispid = 0;
-    for(dispid=0; dispid<HWC_NUM_DISPLAY_TYPES; dispid++) {
+    for(dispid=0; dispid<HWC_NUM_PHYSICAL_DISPLAY_TYPES; dispid++) {
         displayInfo *pInfo = &ctx->mDispInfo[dispid];
         if(pInfo->type == disp_type) {
             return dispid;
@@ -252,3 +232,21 @@ int hwc_get_display_dispid(struct hwc_context_t* ctx, int disp_type)
     return dispid;
 }
 
+
+int hwc_open_framebuffer(struct hwc_context_t* ctx, int dispid)
+{
+    char fbname[HWC_STRING_LENGTH];
+    int fbid = ctx->mDispInfo[dispid].fb_num;
+
+    if (ctx->m_gralloc_module == NULL) {
+        return -ENODEV;
+    }
+
+    memset(fbname, 0, sizeof(fbname));
+    snprintf(fbname, sizeof(fbname), "fb%d", fbid);
+    ALOGI("hwcomposer: open framebuffer %s", fbname);
+    // gralloc takes the fb number through the device pointer.
+    ctx->mFbDev[dispid] = (framebuffer_device_t*)fbid;
+    return ctx->m_gralloc_module->methods->open(ctx->m_gralloc_module, fbname,
+                (struct hw_device_t**)&ctx->mFbDev[dispid]);
+}
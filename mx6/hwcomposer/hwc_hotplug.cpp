@@ -0,0 +1,299 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "hwc_context.h"
+#include "hwc_display.h"
+#include "hwc_hotplug.h"
+
+/* the IPU display clock tops out at 1080p60 rates by default. */
+#define HWC_HDMI_MAX_PIXCLK "148500"
+#define HWC_HDMI_MODES_LEN 2048
+
+static const hwcMode sMode1080p60 = { 1920, 1080, 60, 148500 };
+static const hwcMode sMode720p60 = { 1280, 720, 60, 74250 };
+
+int hwc_read_sysfs(const char *path, char *buff, int len)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    int total = 0;
+    while (total < len - 1) {
+        int n = read(fd, buff + total, len - 1 - total);
+        if (n <= 0)
+            break;
+        total += n;
+    }
+    buff[total] = '\0';
+    close(fd);
+
+    return total;
+}
+
+int hwc_write_sysfs(const char *path, const char *value)
+{
+    int fd = open(path, O_WRONLY);
+    if (fd < 0) {
+        return -errno;
+    }
+
+    int len = strlen(value);
+    int err = write(fd, value, len) == len ? 0 : -errno;
+    close(fd);
+
+    return err;
+}
+
+/* mxc_hdmi prints the EDID as hex bytes, other drivers export it raw. */
+static int hwc_edid_load(int fbid, uint8_t *edid)
+{
+    static const uint8_t header[8] = { 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00 };
+    char path[HWC_PATH_LENGTH];
+    char buff[HWC_EDID_LEN * 6];
+    int len;
+
+    snprintf(path, sizeof(path), HWC_FB_SYS"%d/disp_dev/edid", fbid);
+    len = hwc_read_sysfs(path, buff, sizeof(buff));
+    if (len < 128) {
+        return 0;
+    }
+
+    if (!memcmp(buff, header, sizeof(header))) {
+        len = len > HWC_EDID_LEN ? HWC_EDID_LEN : len;
+        memcpy(edid, buff, len);
+        return len;
+    }
+
+    int count = 0;
+    char *s = buff;
+    while (count < HWC_EDID_LEN) {
+        char *end;
+        unsigned long v = strtoul(s, &end, 16);
+        if (end == s)
+            break;
+        edid[count++] = (uint8_t)v;
+        s = end;
+    }
+
+    if (count < 128 || memcmp(edid, header, sizeof(header))) {
+        return 0;
+    }
+    return count;
+}
+
+static void hwc_edid_parse(int fbid, hwcEdid *info)
+{
+    uint8_t edid[HWC_EDID_LEN];
+
+    memset(info, 0, sizeof(*info));
+    if (!hwc_edid_load(fbid, edid)) {
+        ALOGI("no edid for fb%d", fbid);
+        return;
+    }
+
+    // the first detailed timing descriptor holds the preferred mode.
+    const uint8_t *dtd = &edid[54];
+    int pixclock = (dtd[0] | (dtd[1] << 8)) * 10;
+    if (pixclock == 0) {
+        return;
+    }
+
+    int hactive = dtd[2] | ((dtd[4] & 0xf0) << 4);
+    int hblank = dtd[3] | ((dtd[4] & 0x0f) << 8);
+    int vactive = dtd[5] | ((dtd[7] & 0xf0) << 4);
+    int vblank = dtd[6] | ((dtd[7] & 0x0f) << 8);
+    int htotal = hactive + hblank;
+    int vtotal = vactive + vblank;
+    if (htotal == 0 || vtotal == 0) {
+        return;
+    }
+
+    info->native.xres = hactive;
+    info->native.yres = vactive;
+    info->native.pixclock = pixclock;
+    info->native.refresh = (pixclock * 1000 + htotal * vtotal / 2) / (htotal * vtotal);
+    info->width_mm = dtd[12] | ((dtd[14] & 0xf0) << 4);
+    info->height_mm = dtd[13] | ((dtd[14] & 0x0f) << 8);
+    if (info->width_mm == 0 || info->height_mm == 0) {
+        info->width_mm = edid[21] * 10;
+        info->height_mm = edid[22] * 10;
+    }
+    info->valid = true;
+
+    ALOGI("fb%d edid native %dx%d@%d %dkHz %dx%dmm", fbid, hactive, vactive,
+          info->native.refresh, pixclock, info->width_mm, info->height_mm);
+}
+
+/* finds the line of the sysfs modes list matching mode, lines look
+ * like "U:1920x1080p-60". */
+static bool hwc_find_mode(const char *modes, const hwcMode *mode,
+                          char *line, int len)
+{
+    const char *s = modes;
+    while (*s) {
+        const char *end = strchr(s, '\n');
+        int n = end ? end - s : strlen(s);
+        int xres, yres, refresh;
+        char scan;
+
+        if (sscanf(s, "%*c:%dx%d%c-%d", &xres, &yres, &scan, &refresh) == 4 &&
+            scan == 'p' && xres == mode->xres && yres == mode->yres &&
+            abs(refresh - mode->refresh) <= 1 && n < len) {
+            memcpy(line, s, n);
+            line[n] = '\0';
+            return true;
+        }
+
+        if (!end)
+            break;
+        s = end + 1;
+    }
+
+    return false;
+}
+
+/* writes the preferred mode the display supports within the pixel clock
+ * limit, keeps what the kernel chose when nothing fits. */
+static void hwc_select_mode(int fbid, const hwcEdid *edid)
+{
+    char path[HWC_PATH_LENGTH];
+    char modes[HWC_HDMI_MODES_LEN];
+    char current[HWC_STRING_LENGTH];
+    char line[HWC_STRING_LENGTH];
+    char value[PROPERTY_VALUE_MAX];
+    const hwcMode *candidates[3];
+    int count = 0;
+
+    snprintf(path, sizeof(path), HWC_FB_SYS"%d/modes", fbid);
+    if (hwc_read_sysfs(path, modes, sizeof(modes)) <= 0) {
+        return;
+    }
+
+    property_get("hwc.hdmi.max_pixclk", value, HWC_HDMI_MAX_PIXCLK);
+    int maxPixclock = atoi(value);
+    property_get("hwc.hdmi.mode_policy", value, "native");
+    if (!strcmp(value, "native") && edid->valid) {
+        candidates[count++] = &edid->native;
+    }
+    if (strcmp(value, "720p")) {
+        candidates[count++] = &sMode1080p60;
+    }
+    candidates[count++] = &sMode720p60;
+
+    for (int i = 0; i < count; i++) {
+        if (maxPixclock > 0 && candidates[i]->pixclock > maxPixclock) {
+            continue;
+        }
+        if (!hwc_find_mode(modes, candidates[i], line, sizeof(line))) {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), HWC_FB_SYS"%d/mode", fbid);
+        if (hwc_read_sysfs(path, current, sizeof(current)) > 0 &&
+            !strncmp(current, line, strlen(line))) {
+            return;
+        }
+
+        ALOGI("fb%d switching to mode %s", fbid, line);
+        strcat(line, "\n");
+        if (hwc_write_sysfs(path, line) < 0) {
+            ALOGE("write %s failed: %s", path, strerror(errno));
+        }
+        return;
+    }
+
+    ALOGI("fb%d keeps the kernel mode", fbid);
+}
+
+/* the framebuffer device of the last plug cycle stays open, it only
+ * needs the virtual resolution gralloc mapped to be restored. */
+static bool hwc_reuse_framebuffer(struct hwc_context_t* ctx, displayInfo *pInfo)
+{
+    framebuffer_device_t *fbDev = ctx->mFbDev[HWC_DISPLAY_EXTERNAL];
+    private_module_t *priv_m = (private_module_t *)ctx->m_gralloc_module;
+    struct fb_var_screeninfo info;
+
+    if (fbDev == NULL || priv_m == NULL || priv_m->external_module == NULL ||
+        priv_m->external_module->framebuffer == NULL) {
+        return false;
+    }
+
+    if (ioctl(pInfo->fd, FBIOGET_VSCREENINFO, &info) == -1) {
+        return false;
+    }
+
+    struct fb_var_screeninfo *mapped = &priv_m->external_module->info;
+    if (info.xres != fbDev->width || info.yres != fbDev->height ||
+        info.bits_per_pixel != mapped->bits_per_pixel) {
+        ALOGI("fb%d geometry changed %dx%d -> %dx%d", pInfo->fb_num,
+              fbDev->width, fbDev->height, info.xres, info.yres);
+        return false;
+    }
+
+    if (info.xres_virtual != mapped->xres_virtual ||
+        info.yres_virtual != mapped->yres_virtual) {
+        info = *mapped;
+        info.xoffset = 0;
+        info.yoffset = 0;
+        info.activate = FB_ACTIVATE_NOW;
+        if (ioctl(pInfo->fd, FBIOPUT_VSCREENINFO, &info) == -1) {
+            ALOGE("FBIOPUT_VSCREENINFO failed: %s", strerror(errno));
+            return false;
+        }
+    }
+
+    if (ioctl(pInfo->fd, FBIOBLANK, FB_BLANK_UNBLANK) < 0) {
+        ALOGW("fb%d unblank failed", pInfo->fb_num);
+    }
+    return true;
+}
+
+int hwc_hotplug_plugin(struct hwc_context_t* ctx, nsecs_t timestamp)
+{
+    displayInfo *pInfo = &ctx->mDispInfo[HWC_DISPLAY_EXTERNAL];
+    int fbid = pInfo->fb_num;
+
+    hwc_edid_parse(fbid, &ctx->mEdid);
+    hwc_select_mode(fbid, &ctx->mEdid);
+
+    int err = hwc_get_framebuffer_info(pInfo);
+    if (err != NO_ERROR) {
+        return err;
+    }
+
+    if (ctx->mEdid.valid && ctx->mEdid.width_mm > 0 && ctx->mEdid.height_mm > 0) {
+        pInfo->xdpi = 1000 * (pInfo->xres * 25.4f) / ctx->mEdid.width_mm;
+        pInfo->ydpi = 1000 * (pInfo->yres * 25.4f) / ctx->mEdid.height_mm;
+    }
+
+    if (!hwc_reuse_framebuffer(ctx, pInfo)) {
+        if (ctx->mFbDev[HWC_DISPLAY_EXTERNAL] != NULL) {
+            framebuffer_close(ctx->mFbDev[HWC_DISPLAY_EXTERNAL]);
+            ctx->mFbDev[HWC_DISPLAY_EXTERNAL] = NULL;
+        }
+        err = hwc_open_framebuffer(ctx, HWC_DISPLAY_EXTERNAL);
+    }
+
+    ALOGI("fb%d %dx%d ready in %lldms", fbid, pInfo->xres, pInfo->yres,
+          ns2ms(systemTime(SYSTEM_TIME_MONOTONIC) - timestamp));
+    return err;
+}
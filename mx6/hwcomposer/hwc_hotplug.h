@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HWC_HOTPLUG_H
+#define HWC_HOTPLUG_H
+
+#include <utils/Timers.h>
+
+#define HWC_EDID_LEN 256
+
+typedef struct {
+    int xres;
+    int yres;
+    int refresh;    /* Hz */
+    int pixclock;   /* kHz */
+} hwcMode;
+
+/* What the external display reported in its EDID, refreshed on plugin. */
+typedef struct {
+    bool valid;
+    hwcMode native;
+    int width_mm;
+    int height_mm;
+} hwcEdid;
+
+struct hwc_context_t;
+
+/* sysfs attributes are small, read and write them without stdio. */
+int hwc_read_sysfs(const char *path, char *buff, int len);
+int hwc_write_sysfs(const char *path, const char *value);
+
+/* Brings the external display up after a plugin event received at
+ * timestamp: picks the mode from the EDID and the hwc.hdmi.mode_policy
+ * property, then reuses the framebuffer mapping of the previous plug
+ * cycle when the geometry did not change. */
+int hwc_hotplug_plugin(struct hwc_context_t* ctx, nsecs_t timestamp);
+
+#endif
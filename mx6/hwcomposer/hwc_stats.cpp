@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <stdio.h>
+#include <string.h>
+#include <utils/Trace.h>
+#include "hwc_context.h"
+#include "hwc_stats.h"
+
+using namespace android;
+
+static const nsecs_t sBucketBounds[HWC_STATS_BUCKETS - 1] = {
+    us2ns(500), ms2ns(1), ms2ns(2), ms2ns(4), ms2ns(8), ms2ns(16), ms2ns(33)
+};
+
+static const char *sBucketNames[HWC_STATS_BUCKETS] = {
+    "<0.5ms", "<1ms", "<2ms", "<4ms", "<8ms", "<16ms", "<33ms", ">=33ms"
+};
+
+static const char *sCompNames[HWC_STATS_COMP_TYPES] = {
+    "gles", "overlay", "background", "fbtarget"
+};
+
+static void hwc_histogram_add(hwcHistogram *hist, nsecs_t value)
+{
+    int i;
+    for (i = 0; i < HWC_STATS_BUCKETS - 1; i++) {
+        if (value < sBucketBounds[i])
+            break;
+    }
+
+    hist->buckets[i]++;
+    hist->count++;
+    hist->total += value;
+    if (value > hist->max)
+        hist->max = value;
+}
+
+static int hwc_histogram_dump(const char *name, hwcHistogram *hist,
+                              char *buff, int buff_len)
+{
+    int len;
+    nsecs_t avg = hist->count ? hist->total / hist->count : 0;
+
+    len = snprintf(buff, buff_len, "  %-12s n=%u avg=%lldus max=%lldus\n   ",
+                   name, hist->count, ns2us(avg), ns2us(hist->max));
+    for (int i = 0; i < HWC_STATS_BUCKETS && len < buff_len; i++) {
+        len += snprintf(buff + len, buff_len - len, " %s:%u",
+                        sBucketNames[i], hist->buckets[i]);
+    }
+    if (len < buff_len)
+        len += snprintf(buff + len, buff_len - len, "\n");
+
+    return len < buff_len ? len : buff_len;
+}
+
+void hwc_stats_init(hwcStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    pthread_mutex_init(&stats->lock, NULL);
+}
+
+void hwc_stats_deinit(hwcStats *stats)
+{
+    pthread_mutex_destroy(&stats->lock);
+}
+
+void hwc_stats_prepare(hwcStats *stats, nsecs_t start, size_t numDisplays,
+                       hwc_display_contents_1_t** displays)
+{
+    nsecs_t duration = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    pthread_mutex_lock(&stats->lock);
+    hwc_histogram_add(&stats->prepare, duration);
+    for (size_t i = 0; i < numDisplays && i < HWC_NUM_DISPLAY_TYPES; i++) {
+        hwc_display_contents_1_t *list = displays[i];
+        if (!list)
+            continue;
+
+        stats->frames[i]++;
+        for (size_t j = 0; j < list->numHwLayers; j++) {
+            int32_t type = list->hwLayers[j].compositionType;
+            if (type >= 0 && type < HWC_STATS_COMP_TYPES)
+                stats->layers[i][type]++;
+        }
+    }
+    pthread_mutex_unlock(&stats->lock);
+
+    ATRACE_INT("HWC-prepare-us", (int32_t)ns2us(duration));
+}
+
+void hwc_stats_set(hwcStats *stats, nsecs_t start)
+{
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t duration = now - start;
+    nsecs_t latency = -1;
+
+    pthread_mutex_lock(&stats->lock);
+    hwc_histogram_add(&stats->set, duration);
+    if (stats->lastVsync > 0 && start >= stats->lastVsync) {
+        latency = start - stats->lastVsync;
+        hwc_histogram_add(&stats->vsyncToSet, latency);
+    }
+    pthread_mutex_unlock(&stats->lock);
+
+    ATRACE_INT("HWC-set-us", (int32_t)ns2us(duration));
+    if (latency >= 0)
+        ATRACE_INT("HWC-vsync-to-set-us", (int32_t)ns2us(latency));
+}
+
+void hwc_stats_vsync(hwcStats *stats, nsecs_t timestamp, nsecs_t period)
+{
+    uint32_t missed = 0;
+
+    pthread_mutex_lock(&stats->lock);
+    // anything later than one and a half periods counts the skipped ones.
+    if (stats->lastVsync > 0 && period > 0) {
+        nsecs_t delta = timestamp - stats->lastVsync;
+        if (delta > period + period / 2) {
+            missed = (uint32_t)((delta + period / 2) / period) - 1;
+            stats->missedVsync += missed;
+        }
+    }
+    stats->lastVsync = timestamp;
+    stats->vsyncCount++;
+    missed = stats->missedVsync;
+    pthread_mutex_unlock(&stats->lock);
+
+    ATRACE_INT("HWC-missed-vsync", (int32_t)missed);
+}
+
+void hwc_stats_hotplug(hwcStats *stats, bool connected, nsecs_t timestamp)
+{
+    pthread_mutex_lock(&stats->lock);
+    if (connected)
+        stats->plugin++;
+    else
+        stats->plugout++;
+    // the first frame posted to the external display closes the plug.
+    stats->plugTime = connected ? timestamp : 0;
+    pthread_mutex_unlock(&stats->lock);
+
+    ATRACE_INT("HWC-external-connected", connected ? 1 : 0);
+}
+
+void hwc_stats_external_frame(hwcStats *stats)
+{
+    nsecs_t latency = 0;
+
+    pthread_mutex_lock(&stats->lock);
+    if (stats->plugTime > 0) {
+        latency = systemTime(SYSTEM_TIME_MONOTONIC) - stats->plugTime;
+        stats->plugTime = 0;
+        stats->plugToFrame = latency;
+        if (latency > stats->plugToFrameMax)
+            stats->plugToFrameMax = latency;
+    }
+    pthread_mutex_unlock(&stats->lock);
+
+    if (latency > 0) {
+        ALOGI("external display first frame %lldms after plugin", ns2ms(latency));
+        ATRACE_INT("HWC-plug-to-frame-ms", (int32_t)ns2ms(latency));
+    }
+}
+
+void hwc_stats_dump(hwcStats *stats, char *buff, int buff_len)
+{
+    int len = 0;
+
+    if (!buff || buff_len <= 0)
+        return;
+
+    pthread_mutex_lock(&stats->lock);
+    len += snprintf(buff + len, buff_len - len, "Frame statistics:\n");
+    if (len < buff_len)
+        len += hwc_histogram_dump("prepare", &stats->prepare,
+                                  buff + len, buff_len - len);
+    if (len < buff_len)
+        len += hwc_histogram_dump("set", &stats->set,
+                                  buff + len, buff_len - len);
+    if (len < buff_len)
+        len += hwc_histogram_dump("vsync->set", &stats->vsyncToSet,
+                                  buff + len, buff_len - len);
+    if (len < buff_len)
+        len += snprintf(buff + len, buff_len - len,
+                        "  vsync=%u missed=%u hotplug in=%u out=%u"
+                        " plug->frame last=%lldms max=%lldms\n",
+                        stats->vsyncCount, stats->missedVsync,
+                        stats->plugin, stats->plugout,
+                        ns2ms(stats->plugToFrame), ns2ms(stats->plugToFrameMax));
+    for (int i = 0; i < HWC_NUM_DISPLAY_TYPES && len < buff_len; i++) {
+        len += snprintf(buff + len, buff_len - len, "  display %d frames=%u",
+                        i, stats->frames[i]);
+        for (int j = 0; j < HWC_STATS_COMP_TYPES && len < buff_len; j++) {
+            len += snprintf(buff + len, buff_len - len, " %s:%llu",
+                            sCompNames[j], stats->layers[i][j]);
+        }
+        if (len < buff_len)
+            len += snprintf(buff + len, buff_len - len, "\n");
+    }
+    pthread_mutex_unlock(&stats->lock);
+}
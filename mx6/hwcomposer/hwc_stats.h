@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HWC_STATS_H
+#define HWC_STATS_H
+
+#include <pthread.h>
+#include <utils/Timers.h>
+#include <hardware/hwcomposer.h>
+
+#define HWC_STATS_BUCKETS 8
+#define HWC_STATS_COMP_TYPES 4
+
+/* Times in nanoseconds. A bucket counts the values below its upper
+ * bound in sBucketBounds, the last one everything above the last bound. */
+typedef struct {
+    uint32_t count;
+    nsecs_t total;
+    nsecs_t max;
+    uint32_t buckets[HWC_STATS_BUCKETS];
+} hwcHistogram;
+
+/* Always-on frame timing counters, reported by hwc dump and as
+ * systrace counters. */
+typedef struct {
+    pthread_mutex_t lock;
+    hwcHistogram prepare;
+    hwcHistogram set;
+    hwcHistogram vsyncToSet;
+    nsecs_t lastVsync;
+    uint32_t vsyncCount;
+    uint32_t missedVsync;
+    uint64_t layers[HWC_NUM_DISPLAY_TYPES][HWC_STATS_COMP_TYPES];
+    uint32_t frames[HWC_NUM_DISPLAY_TYPES];
+    uint32_t plugin;
+    uint32_t plugout;
+    nsecs_t plugTime;
+    nsecs_t plugToFrame;
+    nsecs_t plugToFrameMax;
+} hwcStats;
+
+void hwc_stats_init(hwcStats *stats);
+void hwc_stats_deinit(hwcStats *stats);
+void hwc_stats_prepare(hwcStats *stats, nsecs_t start, size_t numDisplays,
+                       hwc_display_contents_1_t** displays);
+void hwc_stats_set(hwcStats *stats, nsecs_t start);
+void hwc_stats_vsync(hwcStats *stats, nsecs_t timestamp, nsecs_t period);
+void hwc_stats_hotplug(hwcStats *stats, bool connected, nsecs_t timestamp);
+void hwc_stats_external_frame(hwcStats *stats);
+void hwc_stats_dump(hwcStats *stats, char *buff, int buff_len);
+
+#endif
@@ -35,7 +35,7 @@ status_t UeventThread::readyToRun() {
 }
 
 void UeventThread::handleHdmiUevent(const char *buff, int len, int dispid) {
-    struct private_module_t *priv_m = NULL;
+    nsecs_t timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
     int fbid = -1;
     const char *s = buff;
 
@@ -44,31 +44,22 @@ void UeventThread::handleHdmiUevent(const char *buff, int len, int dispid) {
 
     s += strlen(s) + 1;
 
+    bool plugin = false, plugout = false;
     while (*s) {
         if (!strncmp(s, "EVENT=plugin", strlen("EVENT=plugin"))) {
             if (dispid == HWC_DISPLAY_PRIMARY) {
                 mCtx->m_vsync_thread->setFakeVSync(false);
                 return;
             }
-
-            mCtx->mDispInfo[HWC_DISPLAY_EXTERNAL].connected = true;
-            fbid = hwc_get_display_fbid(mCtx, HWC_DISPLAY_HDMI);
-            if (fbid < 0) {
-                ALOGE("unrecognized fb num for hdmi");
-            } else {
-                ALOGI("HDMI Plugin detected");
-                if (mCtx->mDispInfo[HWC_DISPLAY_EXTERNAL].xres == 0) {
-                    hwc_get_framebuffer_info(&mCtx->mDispInfo[HWC_DISPLAY_EXTERNAL]);
-                }
-            }
+            plugin = true;
+            plugout = false;
         } else if (!strncmp(s, "EVENT=plugout", strlen("EVENT=plugout"))) {
             if (dispid == HWC_DISPLAY_PRIMARY) {
                 mCtx->m_vsync_thread->setFakeVSync(true);
                 return;
             }
-
-            mCtx->mDispInfo[HWC_DISPLAY_EXTERNAL].connected = false;
-            ALOGI("HDMI Plugout detected");
+            plugin = false;
+            plugout = true;
         }
 
         s += strlen(s) + 1;
@@ -76,19 +67,45 @@ void UeventThread::handleHdmiUevent(const char *buff, int len, int dispid) {
             break;
     }
 
-    if (fbid >= 0 && mCtx->mFbDev[HWC_DISPLAY_EXTERNAL] == NULL && mCtx->m_gralloc_module != NULL) {
-        ALOGI("HDMI Gralloc Framebuffer opening. ");
-        mCtx->mFbDev[HWC_DISPLAY_EXTERNAL] = reinterpret_cast<framebuffer_device_t*>(fbid);
-        char fbname[HWC_STRING_LENGTH];
-        memset(fbname, 0, sizeof(fbname));
-        sprintf(fbname, "fb%d", fbid);
-        mCtx->m_gralloc_module->methods->open(mCtx->m_gralloc_module, fbname,
-                                              (struct hw_device_t**)&mCtx->mFbDev[HWC_DISPLAY_EXTERNAL]);
-        priv_m = (struct private_module_t *)mCtx->m_gralloc_module;
+    // the external vsync only copies the fd of a connected display, it
+    // is disconnected while the bring up below may reopen it. the slow
+    // part runs without m_lock, the lock is only held for the flag.
+    if (plugin || plugout) {
+        pthread_mutex_lock(&mCtx->m_lock);
+        mCtx->mDispInfo[HWC_DISPLAY_EXTERNAL].connected = false;
+        pthread_mutex_unlock(&mCtx->m_lock);
+    }
+
+    if (plugin) {
+        pthread_mutex_lock(&mCtx->m_plug_lock);
+        fbid = hwc_get_display_fbid(mCtx, HWC_DISPLAY_HDMI);
+        if (fbid < 0) {
+            ALOGE("unrecognized fb num for hdmi");
+        } else {
+            ALOGI("HDMI Plugin detected");
+            if (hwc_hotplug_plugin(mCtx, timestamp) < 0) {
+                ALOGE("HDMI fb%d bring up failed", fbid);
+            }
+        }
+        pthread_mutex_unlock(&mCtx->m_plug_lock);
+    } else if (plugout) {
+        // the framebuffer device stays open for the next plugin.
+        ALOGI("HDMI Plugout detected");
     }
 
-    mCtx->m_callback->hotplug(mCtx->m_callback, HWC_DISPLAY_EXTERNAL,
-                              mCtx->mDispInfo[HWC_DISPLAY_EXTERNAL].connected);
+    bool connected;
+    pthread_mutex_lock(&mCtx->m_lock);
+    if (plugin) {
+        mCtx->mDispInfo[HWC_DISPLAY_EXTERNAL].connected = true;
+    }
+    connected = mCtx->mDispInfo[HWC_DISPLAY_EXTERNAL].connected;
+    pthread_mutex_unlock(&mCtx->m_lock);
+
+    hwc_stats_hotplug(&mCtx->mStats, connected, timestamp);
+    if (mCtx->m_ext_vsync_thread != NULL) {
+        mCtx->m_ext_vsync_thread->setConnected(connected);
+    }
+    mCtx->m_callback->hotplug(mCtx->m_callback, HWC_DISPLAY_EXTERNAL, connected);
 }
 
 bool UeventThread::threadLoop() {
@@ -0,0 +1,665 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sync/sync.h>
+#include <sw_sync.h>
+#include "g2d.h"
+#include "compose.h"
+#include "hwc_context.h"
+#include "hwc_virtual.h"
+
+/*****************************************************************************/
+
+#define HWC_FENCE_TIMEOUT 1000
+#define HWC_VIRTUAL_QUEUE_SIZE 2
+
+/* the frames set hands over, composed by a thread of their own once their
+ * acquire fences signal. the fences set returns are those of a sw_sync
+ * timeline stepped once per frame written. without a timeline the thread
+ * is not started and set composes the frame itself. */
+struct hwc_virtual {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    /* copies of the lists, they own the acquire fences */
+    hwc_display_contents_1_t* lists[HWC_VIRTUAL_QUEUE_SIZE];
+    size_t capacity[HWC_VIRTUAL_QUEUE_SIZE];
+    int head;
+    int pending;
+    bool running;
+    bool ready;
+    bool exit;
+    int timeline;
+    uint32_t queued;
+    /* opened by the thread, a g2d handle stays with the thread that made it */
+    void* g2d;
+};
+
+static int hwc_g2d_format(int format)
+{
+    switch (format) {
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+            return G2D_RGBA8888;
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+            return G2D_RGBX8888;
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+            return G2D_BGRA8888;
+        case HAL_PIXEL_FORMAT_RGB_565:
+            return G2D_RGB565;
+        case HAL_PIXEL_FORMAT_YCbCr_420_SP:
+            return G2D_NV12;
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+            return G2D_NV21;
+        case HAL_PIXEL_FORMAT_YCbCr_420_P:
+            return G2D_I420;
+        case HAL_PIXEL_FORMAT_YV12:
+            return G2D_YV12;
+        case HAL_PIXEL_FORMAT_YCbCr_422_I:
+            return G2D_YUYV;
+        default:
+            return -1;
+    }
+}
+
+static bool hwc_is_yuv(int format)
+{
+    switch (format) {
+        case HAL_PIXEL_FORMAT_YCbCr_420_SP:
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+        case HAL_PIXEL_FORMAT_YCbCr_420_P:
+        case HAL_PIXEL_FORMAT_YV12:
+        case HAL_PIXEL_FORMAT_YCbCr_422_I:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* gpu allocated buffers are 16 pixels aligned in both directions,
+ * framebuffer ones follow the fb line length. */
+static void hwc_fill_surface(struct g2d_surface *surf, private_handle_t *hnd)
+{
+    int stride = ALIGN_PIXEL_16(hnd->width);
+    int height = ALIGN_PIXEL_16(hnd->height);
+
+    memset(surf, 0, sizeof(*surf));
+    if (hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER) {
+        stride = ALIGN_PIXEL(hnd->width);
+    }
+
+    surf->format = (enum g2d_format)hwc_g2d_format(hnd->format);
+    surf->planes[0] = hnd->phys;
+    switch (hnd->format) {
+        case HAL_PIXEL_FORMAT_YCbCr_420_SP:
+        case HAL_PIXEL_FORMAT_YCrCb_420_SP:
+            surf->planes[1] = hnd->phys + stride * height;
+            break;
+        case HAL_PIXEL_FORMAT_YCbCr_420_P:
+        case HAL_PIXEL_FORMAT_YV12:
+            surf->planes[1] = hnd->phys + stride * height;
+            surf->planes[2] = surf->planes[1] + stride * height / 4;
+            break;
+        default:
+            break;
+    }
+
+    surf->left = 0;
+    surf->top = 0;
+    surf->right = hnd->width;
+    surf->bottom = hnd->height;
+    surf->stride = stride;
+    surf->width = hnd->width;
+    surf->height = hnd->height;
+    surf->global_alpha = 0xff;
+    surf->rot = G2D_ROTATION_0;
+}
+
+/* cpu copy of the framebuffer target for outputs G2D can not reach,
+ * both buffers are mapped in the compositor process. */
+static int hwc_copy_cpu(private_handle_t *src, private_handle_t *dst)
+{
+    compose_image_t in, out;
+    private_handle_t *hnd[2] = { src, dst };
+    compose_image_t *img[2] = { &in, &out };
+
+    for (int i = 0; i < 2; i++) {
+        int stride = ALIGN_PIXEL_16(hnd[i]->width);
+        if (hnd[i]->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER) {
+            stride = ALIGN_PIXEL(hnd[i]->width);
+        }
+        if (!hnd[i]->base || hwc_is_yuv(hnd[i]->format)) {
+            return -EINVAL;
+        }
+
+        memset(img[i], 0, sizeof(*img[i]));
+        img[i]->format = hnd[i]->format;
+        img[i]->width = hnd[i]->width;
+        img[i]->height = hnd[i]->height;
+        img[i]->planes[0] = (void *)hnd[i]->base;
+        img[i]->stride[0] = stride *
+                (hnd[i]->format == HAL_PIXEL_FORMAT_RGB_565 ? 2 : 4);
+    }
+
+    return compose_convert(&out, &in);
+}
+
+static enum g2d_rotation hwc_g2d_rotation(uint32_t transform)
+{
+    switch (transform) {
+        case HWC_TRANSFORM_ROT_90:
+            return G2D_ROTATION_90;
+        case HWC_TRANSFORM_ROT_180:
+            return G2D_ROTATION_180;
+        case HWC_TRANSFORM_ROT_270:
+            return G2D_ROTATION_270;
+        case HWC_TRANSFORM_FLIP_H:
+            return G2D_FLIP_H;
+        case HWC_TRANSFORM_FLIP_V:
+            return G2D_FLIP_V;
+        default:
+            return G2D_ROTATION_0;
+    }
+}
+
+static bool hwc_layer_supported(hwc_layer_1_t *layer)
+{
+    private_handle_t *hnd = (private_handle_t *)layer->handle;
+
+    if (layer->flags & HWC_SKIP_LAYER || hnd == NULL) {
+        return false;
+    }
+
+    // G2D only reads physically contiguous memory.
+    if (!hnd->phys || hwc_g2d_format(hnd->format) < 0) {
+        return false;
+    }
+
+    // combined rotation and flip is not supported by G2D.
+    if (layer->transform != 0 &&
+            hwc_g2d_rotation(layer->transform) == G2D_ROTATION_0) {
+        return false;
+    }
+
+    return true;
+}
+
+static void hwc_wait_fence(int *fd)
+{
+    if (*fd < 0) {
+        return;
+    }
+
+    if (sync_wait(*fd, HWC_FENCE_TIMEOUT) < 0) {
+        ALOGW("%s wait fence %d failed", __FUNCTION__, *fd);
+    }
+    close(*fd);
+    *fd = -1;
+}
+
+static void *hwc_get_g2d(struct hwc_context_t* ctx)
+{
+    if (ctx->m_g2d_handle == NULL) {
+        if (g2d_open(&ctx->m_g2d_handle) != 0) {
+            ALOGE("%s g2d_open failed", __FUNCTION__);
+            ctx->m_g2d_handle = NULL;
+        }
+    }
+
+    return ctx->m_g2d_handle;
+}
+
+/* the integer source crop of the layer, HWC 1.3 gives it in floats. */
+static void hwc_source_crop(struct hwc_context_t* ctx, hwc_layer_1_t *layer,
+                            hwc_rect_t *crop)
+{
+    if (ctx->device.common.version >= HWC_DEVICE_API_VERSION_1_3) {
+        hwc_round_crop(&layer->sourceCropf, crop);
+    }
+    else {
+        *crop = layer->sourceCropi;
+    }
+}
+
+/* clips frame to the bounds of the output and trims the source crop by
+ * the same share, following the transform that maps one on the other.
+ * false when nothing of the layer is left. */
+static bool hwc_clip_layer(int width, int height, uint32_t transform,
+                           hwc_rect_t *crop, hwc_rect_t *frame)
+{
+    // edges of the crop trimmed when the left, top, right and bottom
+    // edges of the frame are: 0 left, 1 top, 2 right, 3 bottom.
+    static const int edges[][4] = {
+        { 0, 1, 2, 3 },     // none
+        { 2, 1, 0, 3 },     // flip h
+        { 0, 3, 2, 1 },     // flip v
+        { 2, 3, 0, 1 },     // rot 180
+        { 3, 0, 1, 2 },     // rot 90
+        { 1, 2, 3, 0 },     // rot 270
+    };
+    int map;
+    switch (transform) {
+        case HWC_TRANSFORM_FLIP_H: map = 1; break;
+        case HWC_TRANSFORM_FLIP_V: map = 2; break;
+        case HWC_TRANSFORM_ROT_180: map = 3; break;
+        case HWC_TRANSFORM_ROT_90: map = 4; break;
+        case HWC_TRANSFORM_ROT_270: map = 5; break;
+        default: map = 0; break;
+    }
+
+    int frameW = frame->right - frame->left;
+    int frameH = frame->bottom - frame->top;
+    int cropW = crop->right - crop->left;
+    int cropH = crop->bottom - crop->top;
+    if (frameW <= 0 || frameH <= 0 || cropW <= 0 || cropH <= 0) {
+        return false;
+    }
+
+    int clip[4] = {
+        frame->left < 0 ? -frame->left : 0,
+        frame->top < 0 ? -frame->top : 0,
+        frame->right > width ? frame->right - width : 0,
+        frame->bottom > height ? frame->bottom - height : 0,
+    };
+    if (clip[0] + clip[2] >= frameW || clip[1] + clip[3] >= frameH) {
+        return false;
+    }
+
+    int trim[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 4; i++) {
+        if (clip[i] == 0) {
+            continue;
+        }
+        int edge = edges[map][i];
+        int frameSize = (i & 1) ? frameH : frameW;
+        int cropSize = (edge & 1) ? cropH : cropW;
+        trim[edge] = (int)((int64_t)clip[i] * cropSize / frameSize);
+    }
+
+    frame->left += clip[0];
+    frame->top += clip[1];
+    frame->right -= clip[2];
+    frame->bottom -= clip[3];
+    crop->left += trim[0];
+    crop->top += trim[1];
+    crop->right -= trim[2];
+    crop->bottom -= trim[3];
+
+    return crop->right > crop->left && crop->bottom > crop->top;
+}
+
+static int hwc_blit_layer(struct hwc_context_t* ctx, void *g2d, hwc_layer_1_t *layer,
+                          struct g2d_surface *dst, bool blend)
+{
+    struct g2d_surface src;
+    private_handle_t *hnd = (private_handle_t *)layer->handle;
+    hwc_rect_t crop, frame = layer->displayFrame;
+
+    hwc_source_crop(ctx, layer, &crop);
+    if (!hwc_clip_layer(dst->width, dst->height, layer->transform, &crop, &frame)) {
+        return 0;
+    }
+
+    hwc_fill_surface(&src, hnd);
+    src.left = crop.left;
+    src.top = crop.top;
+    src.right = crop.right;
+    src.bottom = crop.bottom;
+
+    dst->left = frame.left;
+    dst->top = frame.top;
+    dst->right = frame.right;
+    dst->bottom = frame.bottom;
+    dst->rot = hwc_g2d_rotation(layer->transform);
+
+    if (blend && layer->blending != HWC_BLENDING_NONE) {
+        src.blendfunc = layer->blending == HWC_BLENDING_PREMULT ?
+                        G2D_ONE : G2D_SRC_ALPHA;
+        dst->blendfunc = G2D_ONE_MINUS_SRC_ALPHA;
+        src.global_alpha = layer->planeAlpha;
+        g2d_enable(g2d, G2D_BLEND);
+        if (layer->planeAlpha != 0xff) {
+            g2d_enable(g2d, G2D_GLOBAL_ALPHA);
+        }
+    }
+
+    int err = g2d_blit(g2d, &src, dst);
+
+    g2d_disable(g2d, G2D_GLOBAL_ALPHA);
+    g2d_disable(g2d, G2D_BLEND);
+    dst->left = 0;
+    dst->top = 0;
+    dst->right = dst->width;
+    dst->bottom = dst->height;
+    dst->rot = G2D_ROTATION_0;
+    dst->blendfunc = G2D_ZERO;
+
+    return err;
+}
+
+/* writes the layers of a list into its output buffer, once its acquire
+ * fences signalled. */
+static int hwc_compose_virtual(struct hwc_context_t* ctx, void *g2d,
+                               hwc_display_contents_1_t* list)
+{
+    private_handle_t *out = (private_handle_t *)list->outbuf;
+    hwc_layer_1_t *fbt = NULL;
+    bool overlay = false;
+    int err = 0;
+
+    for (size_t i = 0; i < list->numHwLayers; i++) {
+        hwc_layer_1_t *layer = &list->hwLayers[i];
+        if (layer->compositionType == HWC_FRAMEBUFFER_TARGET) {
+            fbt = layer;
+        }
+        else if (layer->compositionType == HWC_OVERLAY) {
+            overlay = true;
+        }
+    }
+
+    bool copy = fbt != NULL && fbt->handle != NULL && fbt->handle != list->outbuf;
+    if (g2d == NULL || !out->phys) {
+        // prepare left every layer to gles, only the target is moved.
+        return copy ? hwc_copy_cpu((private_handle_t *)fbt->handle, out) : 0;
+    }
+
+    struct g2d_surface dst;
+    hwc_fill_surface(&dst, out);
+    if (overlay) {
+        dst.clrcolor = 0xff000000;
+        g2d_clear(g2d, &dst);
+        for (size_t i = 0; i < list->numHwLayers; i++) {
+            hwc_layer_1_t *layer = &list->hwLayers[i];
+            if (layer->compositionType != HWC_OVERLAY) {
+                continue;
+            }
+            err = hwc_blit_layer(ctx, g2d, layer, &dst, !hwc_is_yuv(out->format));
+            if (err) {
+                ALOGE("%s g2d_blit failed %d", __FUNCTION__, err);
+                break;
+            }
+        }
+    }
+    else if (copy && hwc_layer_supported(fbt)) {
+        // gles composited into the framebuffer target, convert it
+        // into the output buffer format.
+        err = hwc_blit_layer(ctx, g2d, fbt, &dst, false);
+    }
+    else if (copy) {
+        err = hwc_copy_cpu((private_handle_t *)fbt->handle, out);
+    }
+
+    g2d_finish(g2d);
+    return err;
+}
+
+static void hwc_wait_acquire(hwc_display_contents_1_t* list)
+{
+    hwc_wait_fence(&list->outbufAcquireFenceFd);
+    for (size_t i = 0; i < list->numHwLayers; i++) {
+        hwc_wait_fence(&list->hwLayers[i].acquireFenceFd);
+    }
+}
+
+static void *hwc_virtual_thread(void *arg)
+{
+    struct hwc_context_t* ctx = (struct hwc_context_t*)arg;
+    struct hwc_virtual* q = ctx->m_virtual;
+
+    if (g2d_open(&q->g2d) != 0) {
+        ALOGE("%s g2d_open failed", __FUNCTION__);
+        q->g2d = NULL;
+    }
+
+    pthread_mutex_lock(&q->lock);
+    q->ready = true;
+    pthread_cond_broadcast(&q->cond);
+    for (;;) {
+        while (q->pending == 0 && !q->exit) {
+            pthread_cond_wait(&q->cond, &q->lock);
+        }
+        // what was queued is still written before the thread leaves
+        if (q->pending == 0) {
+            break;
+        }
+        hwc_display_contents_1_t* list = q->lists[q->head];
+        pthread_mutex_unlock(&q->lock);
+
+        hwc_wait_acquire(list);
+        hwc_compose_virtual(ctx, q->g2d, list);
+        sw_sync_timeline_inc(q->timeline, 1);
+
+        pthread_mutex_lock(&q->lock);
+        q->head = (q->head + 1) % HWC_VIRTUAL_QUEUE_SIZE;
+        q->pending--;
+        pthread_cond_broadcast(&q->cond);
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    if (q->g2d != NULL) {
+        g2d_close(q->g2d);
+        q->g2d = NULL;
+    }
+    return NULL;
+}
+
+static void hwc_virtual_start(struct hwc_context_t* ctx)
+{
+    struct hwc_virtual* q = (struct hwc_virtual*)calloc(1, sizeof(*q));
+    if (q == NULL) {
+        return;
+    }
+
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    ctx->m_virtual = q;
+
+    q->timeline = sw_sync_timeline_create();
+    if (q->timeline < 0) {
+        ALOGW("no sw_sync timeline, the virtual display is written in set");
+        return;
+    }
+    if (pthread_create(&q->thread, NULL, hwc_virtual_thread, ctx) != 0) {
+        ALOGW("no virtual display thread, it is written in set");
+        close(q->timeline);
+        q->timeline = -1;
+        return;
+    }
+
+    pthread_mutex_lock(&q->lock);
+    q->running = true;
+    while (!q->ready) {
+        pthread_cond_wait(&q->cond, &q->lock);
+    }
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* the g2d handle the virtual display is written with, NULL without g2d. */
+static void *hwc_virtual_g2d(struct hwc_context_t* ctx)
+{
+    if (ctx->m_virtual == NULL) {
+        hwc_virtual_start(ctx);
+    }
+    if (ctx->m_virtual != NULL && ctx->m_virtual->running) {
+        return ctx->m_virtual->g2d;
+    }
+    return hwc_get_g2d(ctx);
+}
+
+/* queues a copy of the list for the thread, the acquire fences go with
+ * it. the sequence number of the frame, 0 when it could not be queued. */
+static uint32_t hwc_virtual_queue(struct hwc_virtual* q, hwc_display_contents_1_t* list)
+{
+    size_t size = sizeof(*list) + list->numHwLayers * sizeof(hwc_layer_1_t);
+    uint32_t seq = 0;
+
+    pthread_mutex_lock(&q->lock);
+    // the frame before the last one must be written first
+    while (q->pending == HWC_VIRTUAL_QUEUE_SIZE) {
+        pthread_cond_wait(&q->cond, &q->lock);
+    }
+
+    int slot = (q->head + q->pending) % HWC_VIRTUAL_QUEUE_SIZE;
+    if (q->capacity[slot] < list->numHwLayers || q->lists[slot] == NULL) {
+        free(q->lists[slot]);
+        q->lists[slot] = (hwc_display_contents_1_t*)malloc(size);
+        q->capacity[slot] = q->lists[slot] != NULL ? list->numHwLayers : 0;
+    }
+    if (q->lists[slot] != NULL) {
+        memcpy(q->lists[slot], list, size);
+        q->pending++;
+        seq = ++q->queued;
+        pthread_cond_broadcast(&q->cond);
+    }
+    pthread_mutex_unlock(&q->lock);
+
+    if (seq != 0) {
+        list->outbufAcquireFenceFd = -1;
+        for (size_t i = 0; i < list->numHwLayers; i++) {
+            list->hwLayers[i].acquireFenceFd = -1;
+        }
+    }
+    return seq;
+}
+
+/* waits until the thread wrote every frame queued. */
+static void hwc_virtual_drain(struct hwc_virtual* q)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->pending > 0) {
+        pthread_cond_wait(&q->cond, &q->lock);
+    }
+    pthread_mutex_unlock(&q->lock);
+}
+
+int hwc_prepare_virtual(struct hwc_context_t* ctx, hwc_display_contents_1_t* list)
+{
+    displayInfo *pInfo = &ctx->mDispInfo[HWC_DISPLAY_VIRTUAL];
+    private_handle_t *out = (private_handle_t *)list->outbuf;
+
+    pInfo->connected = true;
+    pInfo->type = HWC_DISPLAY_WRITEBACK;
+    if (out == NULL || !out->phys || hwc_g2d_format(out->format) < 0 ||
+            hwc_virtual_g2d(ctx) == NULL) {
+        return 0;
+    }
+
+    pInfo->xres = out->width;
+    pInfo->yres = out->height;
+    pInfo->format = out->format;
+
+    size_t numLayers = 0;
+    bool opaque = true;
+    for (size_t i = 0; i < list->numHwLayers; i++) {
+        hwc_layer_1_t *layer = &list->hwLayers[i];
+        if (layer->compositionType == HWC_FRAMEBUFFER_TARGET) {
+            continue;
+        }
+        if (!hwc_layer_supported(layer)) {
+            return 0;
+        }
+        if (layer->blending != HWC_BLENDING_NONE) {
+            opaque = false;
+        }
+        numLayers++;
+    }
+
+    // G2D can not blend into a yuv surface, only a single opaque layer
+    // is converted directly, the rest goes through the framebuffer target.
+    if (hwc_is_yuv(out->format) && (numLayers != 1 || !opaque)) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < list->numHwLayers; i++) {
+        hwc_layer_1_t *layer = &list->hwLayers[i];
+        if (layer->compositionType == HWC_FRAMEBUFFER) {
+            layer->compositionType = HWC_OVERLAY;
+        }
+    }
+
+    return 0;
+}
+
+int hwc_set_virtual(struct hwc_context_t* ctx, hwc_display_contents_1_t* list)
+{
+    struct hwc_virtual* q = ctx->m_virtual;
+
+    list->retireFenceFd = -1;
+    for (size_t i = 0; i < list->numHwLayers; i++) {
+        list->hwLayers[i].releaseFenceFd = -1;
+    }
+
+    if (list->outbuf == NULL) {
+        hwc_wait_acquire(list);
+        return 0;
+    }
+
+    uint32_t seq = 0;
+    if (q != NULL && q->running) {
+        seq = hwc_virtual_queue(q, list);
+    }
+    if (seq == 0) {
+        hwc_wait_acquire(list);
+        return hwc_compose_virtual(ctx, hwc_get_g2d(ctx), list);
+    }
+
+    // the output is written and the layers read once the frame is done
+    int fence = sw_sync_fence_create(q->timeline, "hwc_virtual", seq);
+    if (fence < 0) {
+        ALOGW("%s no fence for frame %u, waiting for it", __FUNCTION__, seq);
+        hwc_virtual_drain(q);
+        return 0;
+    }
+    for (size_t i = 0; i < list->numHwLayers; i++) {
+        hwc_layer_1_t *layer = &list->hwLayers[i];
+        if (layer->compositionType == HWC_OVERLAY ||
+                layer->compositionType == HWC_FRAMEBUFFER_TARGET) {
+            layer->releaseFenceFd = dup(fence);
+        }
+    }
+    list->retireFenceFd = fence;
+    return 0;
+}
+
+void hwc_close_virtual(struct hwc_context_t* ctx)
+{
+    struct hwc_virtual* q = ctx->m_virtual;
+
+    if (q != NULL) {
+        if (q->running) {
+            pthread_mutex_lock(&q->lock);
+            q->exit = true;
+            pthread_cond_broadcast(&q->cond);
+            pthread_mutex_unlock(&q->lock);
+            pthread_join(q->thread, NULL);
+            close(q->timeline);
+        }
+        for (int i = 0; i < HWC_VIRTUAL_QUEUE_SIZE; i++) {
+            free(q->lists[i]);
+        }
+        pthread_cond_destroy(&q->cond);
+        pthread_mutex_destroy(&q->lock);
+        free(q);
+        ctx->m_virtual = NULL;
+    }
+
+    if (ctx->m_g2d_handle != NULL) {
+        g2d_close(ctx->m_g2d_handle);
+        ctx->m_g2d_handle = NULL;
+    }
+}
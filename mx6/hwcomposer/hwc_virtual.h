@@ -0,0 +1,29 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HWC_VIRTUAL_H
+#define HWC_VIRTUAL_H
+
+/* Virtual display composition: layers are written back into the output
+ * buffer of the virtual display with G2D, including the RGB to NV12
+ * conversion needed by the VPU encoder. set queues the frame for a thread
+ * and returns at once, the retire and release fences signal once it is
+ * written. */
+int hwc_prepare_virtual(struct hwc_context_t* ctx, hwc_display_contents_1_t* list);
+int hwc_set_virtual(struct hwc_context_t* ctx, hwc_display_contents_1_t* list);
+void hwc_close_virtual(struct hwc_context_t* ctx);
+
+#endif
@@ -21,22 +21,122 @@
 
 #undef DEBUG_HWC_VSYNC_TIMING
 
+/* the model needs a few consistent edges before predictions are used. */
+#define VSYNC_LOCK_SAMPLES 8
+/* residual error is folded into the phase by 1/4 and the period by 1/16. */
+#define VSYNC_PHASE_GAIN 4
+#define VSYNC_PERIOD_GAIN 16
+/* number of consecutive ioctl failures bridged with predicted vsync. */
+#define VSYNC_MAX_ERRORS 30
+/* wake up this much before the next hardware vsync. */
+#define VSYNC_WAKE_UP 400000
+#define HWC_DEFAULT_VSYNC_PERIOD (1000000000 / 60)
+
 using namespace android;
 
-VSyncThread::VSyncThread(hwc_context_t *ctx)
-    : Thread(false), mCtx(ctx), mEnabled(false),
-      mFakeVSync(false), mNextFakeVSync(0)
+VSyncModel::VSyncModel()
+    : mNominalPeriod(0), mPeriod(0), mReference(0), mSamples(0)
+{
+}
+
+void VSyncModel::reset(nsecs_t period)
+{
+    mNominalPeriod = period;
+    mPeriod = period;
+    mReference = 0;
+    mSamples = 0;
+}
+
+void VSyncModel::addSample(nsecs_t timestamp)
+{
+    if (mPeriod <= 0) {
+        return;
+    }
+
+    if (mReference == 0 || timestamp <= mReference) {
+        mReference = timestamp;
+        mSamples = 1;
+        return;
+    }
+
+    nsecs_t delta = timestamp - mReference;
+    nsecs_t edges = (delta + mPeriod / 2) / mPeriod;
+    if (edges <= 0) {
+        return;
+    }
+
+    nsecs_t predicted = mReference + edges * mPeriod;
+    nsecs_t error = timestamp - predicted;
+    if (error > mPeriod / 4 || error < -mPeriod / 4) {
+        // glitch or mode change, restart the phase from this edge.
+        mReference = timestamp;
+        mSamples = 1;
+        return;
+    }
+
+    mPeriod += error / edges / VSYNC_PERIOD_GAIN;
+    if (mPeriod > mNominalPeriod + mNominalPeriod / 10 ||
+        mPeriod < mNominalPeriod - mNominalPeriod / 10) {
+        mPeriod = mNominalPeriod;
+    }
+    mReference = predicted + error / VSYNC_PHASE_GAIN;
+    if (mSamples < VSYNC_LOCK_SAMPLES) {
+        mSamples++;
+    }
+}
+
+bool VSyncModel::isLocked() const
+{
+    return mSamples >= VSYNC_LOCK_SAMPLES;
+}
+
+nsecs_t VSyncModel::getPeriod() const
+{
+    return mPeriod;
+}
+
+nsecs_t VSyncModel::computeNextVSync(nsecs_t now) const
+{
+    if (mReference == 0 || mPeriod <= 0 || now < mReference) {
+        return mReference > now ? mReference : now;
+    }
+
+    nsecs_t edges = (now - mReference) / mPeriod + 1;
+    return mReference + edges * mPeriod;
+}
+
+VSyncThread::VSyncThread(hwc_context_t *ctx, int dispid)
+    : Thread(false), mCtx(ctx), mDispId(dispid), mEnabled(false),
+      mConnected(dispid == HWC_DISPLAY_PRIMARY), mFd(-1), mFdStale(true),
+      mFakeVSync(false), mNextFakeVSync(0), mPhaseOffset(0), mErrors(0),
+      mLastVSync(0)
 {
     mRefreshPeriod = 0;
 }
 
+VSyncThread::~VSyncThread()
+{
+    if (mFd >= 0) {
+        close(mFd);
+    }
+}
+
 void VSyncThread::onFirstRef()
 {
-    run("HWC-VSYNC-Thread", PRIORITY_URGENT_DISPLAY);
+    run(mDispId == HWC_DISPLAY_PRIMARY ? "HWC-VSYNC-Thread" :
+        "HWC-EXT-VSYNC-Thread", PRIORITY_URGENT_DISPLAY);
 }
 
 status_t VSyncThread::readyToRun()
 {
+    char property[PROPERTY_VALUE_MAX];
+    // callbacks can be delivered ahead of the hardware edge, in us.
+    property_get("hwc.vsync.phase_offset", property, "0");
+    mPhaseOffset = us2ns(atoi(property));
+    if (mPhaseOffset < 0) {
+        mPhaseOffset = 0;
+    }
+
     return NO_ERROR;
 }
 
@@ -46,21 +146,87 @@ void VSyncThread::setEnabled(bool enabled) {
     mCondition.signal();
 }
 
+void VSyncThread::setConnected(bool connected) {
+    Mutex::Autolock _l(mLock);
+    mConnected = connected;
+    // force the model to restart from the new timing.
+    mRefreshPeriod = 0;
+    mFdStale = true;
+    mCondition.signal();
+}
+
 void VSyncThread::setFakeVSync(bool enable)
 {
     mFakeVSync = enable;
 }
 
+/* takes a copy of the display fd under the context lock once the
+ * display was reconnected, false when it is not connected. the lock is
+ * left alone while the copy is good, a hotplug holding it never delays
+ * a vsync. */
+bool VSyncThread::refreshFd()
+{
+    bool stale;
+    bool connected;
+    {
+        Mutex::Autolock _l(mLock);
+        stale = mFdStale;
+        mFdStale = false;
+        connected = mConnected;
+    }
+
+    if (!stale && mFd >= 0) {
+        return connected;
+    }
+    if (mFd >= 0) {
+        close(mFd);
+        mFd = -1;
+    }
+    if (!connected) {
+        return false;
+    }
+
+    pthread_mutex_lock(&mCtx->m_lock);
+    // still coming up, the hotplug marks it stale again once it is done.
+    connected = mCtx->mDispInfo[mDispId].connected;
+    if (connected && mCtx->mDispInfo[mDispId].fd > 0) {
+        mFd = dup(mCtx->mDispInfo[mDispId].fd);
+    }
+    pthread_mutex_unlock(&mCtx->m_lock);
+
+    return connected;
+}
+
 bool VSyncThread::threadLoop()
 {
     { // scope for lock
         Mutex::Autolock _l(mLock);
-        while (!mEnabled) {
+        while (!mEnabled || !mConnected) {
             mCondition.wait(mLock);
         }
     }
 
-    if (mFakeVSync) {
+    if (!refreshFd()) {
+        // unplugged, wait for the hotplug to update mConnected.
+        Mutex::Autolock _l(mLock);
+        if (mConnected && mEnabled) {
+            mCondition.waitRelative(mLock, mCtx->mDispInfo[mDispId].vsync_period > 0 ?
+                                    mCtx->mDispInfo[mDispId].vsync_period :
+                                    HWC_DEFAULT_VSYNC_PERIOD);
+        }
+        return true;
+    }
+
+    nsecs_t period = mCtx->mDispInfo[mDispId].vsync_period;
+    if (period <= 0) {
+        period = HWC_DEFAULT_VSYNC_PERIOD;
+    }
+    if (period != mRefreshPeriod) {
+        mRefreshPeriod = period;
+        mModel.reset(period);
+    }
+
+    if (mFakeVSync || mFd < 0) {
         performFakeVSync();
     }
     else {
@@ -70,9 +236,60 @@ bool VSyncThread::threadLoop()
     return true;
 }
 
+void VSyncThread::sleepUntil(nsecs_t time)
+{
+    struct timespec spec;
+    spec.tv_sec  = time / 1000000000;
+    spec.tv_nsec = time % 1000000000;
+
+    int err;
+    do {
+        err = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &spec, NULL);
+    } while (err<0 && errno == EINTR);
+}
+
+nsecs_t VSyncThread::computeNextVSync(nsecs_t now)
+{
+    nsecs_t period = mModel.getPeriod();
+    nsecs_t next = mModel.computeNextVSync(now);
+    // never report the same edge twice.
+    if (next <= mLastVSync + period / 2) {
+        next += period;
+    }
+
+    return next;
+}
+
+void VSyncThread::fireVSync(nsecs_t timestamp)
+{
+    mLastVSync = timestamp;
+    if (mDispId == HWC_DISPLAY_PRIMARY) {
+        hwc_stats_vsync(&mCtx->mStats, timestamp, mRefreshPeriod);
+    }
+
+    mCtx->m_callback->vsync(mCtx->m_callback, mDispId, timestamp);
+}
+
+bool VSyncThread::waitHwVSync(nsecs_t *timestamp)
+{
+    uint64_t vsync = 0;
+    uint32_t crt = (uint32_t)&vsync;
+
+    int err = ioctl(mFd, MXCFB_WAIT_FOR_VSYNC, crt);
+    if ( err < 0 ) {
+        ALOGE("FBIO_WAITFORVSYNC error: %s\n", strerror(errno));
+        mErrors++;
+        return false;
+    }
+
+    mErrors = 0;
+    *timestamp = vsync;
+    mModel.addSample(*timestamp);
+    return true;
+}
+
 void VSyncThread::performFakeVSync()
 {
-    mRefreshPeriod = mCtx->mDispInfo[HWC_DISPLAY_PRIMARY].vsync_period;
     const nsecs_t period = mRefreshPeriod;
     const nsecs_t now = systemTime(CLOCK_MONOTONIC);
     nsecs_t next_vsync = mNextFakeVSync;
@@ -94,19 +311,38 @@ void VSyncThread::performFakeVSync()
     } while (err<0 && errno == EINTR);
 
     if (err == 0) {
-        mCtx->m_callback->vsync(mCtx->m_callback, 0, next_vsync);
+        fireVSync(next_vsync);
     }
 }
 
 void VSyncThread::performVSync()
 {
-    uint64_t timestamp = 0;
-    uint32_t crt = (uint32_t)&timestamp;
+    nsecs_t timestamp = 0;
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
 
-    int err = ioctl(mCtx->mDispInfo[HWC_DISPLAY_PRIMARY].fd,
-                    MXCFB_WAIT_FOR_VSYNC, crt);
-    if ( err < 0 ) {
-        ALOGE("FBIO_WAITFORVSYNC error: %s\n", strerror(errno));
+    // with a locked model the callback runs mPhaseOffset ahead of the
+    // predicted edge, the hardware wait afterwards keeps the model in sync.
+    if (mPhaseOffset > 0 && mModel.isLocked()) {
+        nsecs_t next = computeNextVSync(now + mPhaseOffset);
+        sleepUntil(next - mPhaseOffset);
+        fireVSync(next);
+        if (!waitHwVSync(&timestamp) && mErrors > VSYNC_MAX_ERRORS) {
+            mModel.reset(mRefreshPeriod);
+        }
+        return;
+    }
+
+    if (!waitHwVSync(&timestamp)) {
+        if (!mModel.isLocked() || mErrors > VSYNC_MAX_ERRORS) {
+            // nothing to predict from, keep going at the nominal rate.
+            performFakeVSync();
+            return;
+        }
+
+        // short driver failure, coast on the predicted edges.
+        timestamp = computeNextVSync(now);
+        sleepUntil(timestamp);
+        fireVSync(timestamp);
         return;
     }
 
@@ -115,23 +351,16 @@ void VSyncThread::performVSync()
     nsecs_t cur_time_ns;
 
     cur_time_ns  = systemTime(SYSTEM_TIME_MONOTONIC);
-    mCtx->m_callback->vsync(mCtx->m_callback, 0, timestamp);
+    fireVSync(timestamp);
     ALOGE("Vsync %llu, %llu\n", cur_time_ns - last_time_ns,
           cur_time_ns - timestamp);
     last_time_ns = cur_time_ns;
 #else
-    mCtx->m_callback->vsync(mCtx->m_callback, 0, timestamp);
+    fireVSync(timestamp);
 #endif
 
-    struct timespec tm;
-    struct timespec ts;
-    const nsecs_t wake_up = 400000;
-
-    double m_frame_period_ns = mCtx->mDispInfo[HWC_DISPLAY_PRIMARY].vsync_period;
-
-    ts.tv_nsec =  (timestamp + m_frame_period_ns)
-        - (systemTime(SYSTEM_TIME_MONOTONIC) + wake_up );
-    ts.tv_sec = 0;
-    nanosleep( &ts, &tm);
+    nsecs_t wake_up = mModel.computeNextVSync(timestamp) - VSYNC_WAKE_UP;
+    if (wake_up > systemTime(SYSTEM_TIME_MONOTONIC)) {
+        sleepUntil(wake_up);
+    }
 }
-
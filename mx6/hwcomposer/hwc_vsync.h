@@ -45,11 +45,34 @@ extern "C" int clock_nanosleep(clockid_t clock_id, int flags,
                            struct timespec *remain);
 struct hwc_context_t;
 
+/* Filtered estimate of the hardware vsync period and phase. Every hardware
+ * timestamp is matched to the predicted edge and the residual error nudges
+ * both the phase and the period, so the prediction stays usable when the
+ * driver misses a few events. */
+class VSyncModel
+{
+public:
+    VSyncModel();
+    void reset(nsecs_t period);
+    void addSample(nsecs_t timestamp);
+    bool isLocked() const;
+    nsecs_t getPeriod() const;
+    nsecs_t computeNextVSync(nsecs_t now) const;
+
+private:
+    nsecs_t mNominalPeriod;
+    nsecs_t mPeriod;
+    nsecs_t mReference;
+    int mSamples;
+};
+
 class VSyncThread : public Thread
 {
 public:
-    explicit VSyncThread(hwc_context_t *ctx);
+    VSyncThread(hwc_context_t *ctx, int dispid);
+    virtual ~VSyncThread();
     void setEnabled(bool enabled);
+    void setConnected(bool connected);
     void setFakeVSync(bool enable);
 
 private:
@@ -58,15 +81,31 @@ private:
     virtual bool threadLoop();
     void performFakeVSync();
     void performVSync();
+    bool waitHwVSync(nsecs_t *timestamp);
+    void sleepUntil(nsecs_t time);
+    nsecs_t computeNextVSync(nsecs_t now);
+    void fireVSync(nsecs_t timestamp);
+    bool refreshFd();
 
     hwc_context_t *mCtx;
+    int mDispId;
     mutable Mutex mLock;
     Condition mCondition;
     bool mEnabled;
+    bool mConnected;
+    /* own copy of the display fd, so a hotplug closing the context one
+     * never pulls it from under a wait. taken again after a reconnect. */
+    int mFd;
+    bool mFdStale;
 
     bool mFakeVSync;
     mutable nsecs_t mNextFakeVSync;
     nsecs_t mRefreshPeriod;
+
+    VSyncModel mModel;
+    nsecs_t mPhaseOffset;
+    int mErrors;
+    nsecs_t mLastVSync;
 };
 
 #endif
@@ -19,6 +19,7 @@
 
 #include <fcntl.h>
 #include <errno.h>
+#include <string.h>
 
 #define HWC_REMOVE_DEPRECATED_VERSIONS 1
 #include <cutils/log.h>
@@ -32,11 +33,15 @@
 #include <linux/mxcfb.h>
 #include <linux/ioctl.h>
 #include <EGL/egl.h>
+#include <sync/sync.h>
 #include "gralloc_priv.h"
 #include "hwc_context.h"
 #include "hwc_vsync.h"
 #include "hwc_uevent.h"
 #include "hwc_display.h"
+#ifdef ENABLE_VIRTUAL_DISPLAY
+#include "hwc_virtual.h"
+#endif
 
 /*****************************************************************************/
 static int hwc_device_open(const struct hw_module_t* module, const char* name,
@@ -83,7 +88,12 @@ static int hwc_device_close(struct hw_device_t *dev)
     if (ctx) {
         if (ctx->m_vsync_thread != NULL) {
             ctx->m_vsync_thread->requestExitAndWait();
-            ctx->m_uevent_thread.clear();
+            ctx->m_vsync_thread.clear();
+        }
+
+        if (ctx->m_ext_vsync_thread != NULL) {
+            ctx->m_ext_vsync_thread->requestExitAndWait();
+            ctx->m_ext_vsync_thread.clear();
         }
 
         if (ctx->m_uevent_thread.get() != NULL) {
@@ -91,20 +101,103 @@ static int hwc_device_close(struct hw_device_t *dev)
             ctx->m_uevent_thread.clear();
         }
 
-        for (int i=0; i<HWC_NUM_DISPLAY_TYPES; i++) {
-            if(ctx->mDispInfo[i].connected)
+        for (int i=0; i<HWC_NUM_PHYSICAL_DISPLAY_TYPES; i++) {
+            if(ctx->mDispInfo[i].fd > 0)
                 close(ctx->mDispInfo[i].fd);
         }
 
         if(ctx->m_viv_hwc) {
             hwc_close_1(ctx->m_viv_hwc);
         }
+        for (int i=0; i<HWC_NUM_PHYSICAL_DISPLAY_TYPES; i++) {
+            free(ctx->m_viv_lists[i]);
+        }
 
+#ifdef ENABLE_VIRTUAL_DISPLAY
+        hwc_close_virtual(ctx);
+#endif
+        hwc_stats_deinit(&ctx->mStats);
+        pthread_mutex_destroy(&ctx->m_lock);
+        pthread_mutex_destroy(&ctx->m_plug_lock);
         free(ctx);
     }
     return 0;
 }
 
+/* the Vivante hwc reads the integer source crop of HWC 1.1, which shares
+ * its storage with the float one from HWC 1.3 on. it then works on copies
+ * of the lists with the crop rounded, rebuilt for every call. */
+static hwc_display_contents_1_t** hwc_viv_displays(struct hwc_context_t* ctx,
+        size_t numDisplays, hwc_display_contents_1_t** displays)
+{
+    if (ctx->device.common.version < HWC_DEVICE_API_VERSION_1_3) {
+        return displays;
+    }
+
+    for (size_t i = 0; i < numDisplays; i++) {
+        hwc_display_contents_1_t *list = displays[i];
+        ctx->m_viv_displays[i] = NULL;
+        if (list == NULL) {
+            continue;
+        }
+
+        size_t size = sizeof(*list) + list->numHwLayers * sizeof(hwc_layer_1_t);
+        if (ctx->m_viv_capacity[i] < list->numHwLayers || ctx->m_viv_lists[i] == NULL) {
+            free(ctx->m_viv_lists[i]);
+            ctx->m_viv_lists[i] = (hwc_display_contents_1_t*)malloc(size);
+            if (ctx->m_viv_lists[i] == NULL) {
+                ctx->m_viv_capacity[i] = 0;
+                return NULL;
+            }
+            ctx->m_viv_capacity[i] = list->numHwLayers;
+        }
+
+        hwc_display_contents_1_t *copy = ctx->m_viv_lists[i];
+        memcpy(copy, list, size);
+        for (size_t j = 0; j < list->numHwLayers; j++) {
+            hwc_frect_t cropf = list->hwLayers[j].sourceCropf;
+            hwc_round_crop(&cropf, &copy->hwLayers[j].sourceCropi);
+        }
+        ctx->m_viv_displays[i] = copy;
+    }
+
+    return ctx->m_viv_displays;
+}
+
+/* copies back what the Vivante hwc decided in prepare or returned in set. */
+static void hwc_viv_results(struct hwc_context_t* ctx, size_t numDisplays,
+        hwc_display_contents_1_t** displays, hwc_display_contents_1_t** viv,
+        bool set)
+{
+    if (viv == displays) {
+        return;
+    }
+
+    for (size_t i = 0; i < numDisplays; i++) {
+        hwc_display_contents_1_t *list = displays[i];
+        hwc_display_contents_1_t *copy = viv[i];
+        if (list == NULL || copy == NULL) {
+            continue;
+        }
+
+        if (set) {
+            list->retireFenceFd = copy->retireFenceFd;
+        }
+        for (size_t j = 0; j < list->numHwLayers; j++) {
+            hwc_layer_1_t *layer = &list->hwLayers[j];
+            if (set) {
+                layer->releaseFenceFd = copy->hwLayers[j].releaseFenceFd;
+                layer->acquireFenceFd = copy->hwLayers[j].acquireFenceFd;
+            }
+            else {
+                layer->compositionType = copy->hwLayers[j].compositionType;
+                layer->hints = copy->hwLayers[j].hints;
+                layer->flags = copy->hwLayers[j].flags;
+            }
+        }
+    }
+}
+
 static int hwc_prepare(hwc_composer_device_1_t *dev,
         size_t numDisplays, hwc_display_contents_1_t** displays)
 {
@@ -116,19 +209,81 @@ static int hwc_prepare(hwc_composer_device_1_t *dev,
     struct hwc_context_t* ctx = (struct hwc_context_t*)dev;
     hwc_display_contents_1_t *primary_contents = displays[HWC_DISPLAY_PRIMARY];
     hwc_display_contents_1_t *external_contents = displays[HWC_DISPLAY_EXTERNAL];
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    int err = 0;
+
     if (primary_contents) {
     }
 
     if (external_contents) {
     }
 
+#ifdef ENABLE_VIRTUAL_DISPLAY
+    if (numDisplays > HWC_DISPLAY_VIRTUAL && displays[HWC_DISPLAY_VIRTUAL]) {
+        hwc_prepare_virtual(ctx, displays[HWC_DISPLAY_VIRTUAL]);
+    }
+    else {
+        ctx->mDispInfo[HWC_DISPLAY_VIRTUAL].connected = false;
+    }
+#endif
+
     if(ctx->m_viv_hwc) {
+        size_t numPhysical = numDisplays > HWC_NUM_PHYSICAL_DISPLAY_TYPES ?
+                             HWC_NUM_PHYSICAL_DISPLAY_TYPES : numDisplays;
         char property[PROPERTY_VALUE_MAX];
         property_get("service.bootanim.exit", property, "0");
-        if(!atoi(property)) numDisplays = numDisplays >= 1 ? 1 : 0;
-        return ctx->m_viv_hwc->prepare(ctx->m_viv_hwc, numDisplays, displays);
+        if(!atoi(property)) numPhysical = numPhysical >= 1 ? 1 : 0;
+        hwc_display_contents_1_t** viv = hwc_viv_displays(ctx, numPhysical, displays);
+        if (viv == NULL) {
+            return -ENOMEM;
+        }
+        err = ctx->m_viv_hwc->prepare(ctx->m_viv_hwc, numPhysical, viv);
+        hwc_viv_results(ctx, numPhysical, displays, viv, false);
+    }
+
+    hwc_stats_prepare(&ctx->mStats, start, numDisplays, displays);
+    return err;
+}
+
+/* post the framebuffer target, its release fence signals once the flip
+ * after it took the buffer off the screen. a gralloc without the fenced
+ * post answers -EINVAL and gets a plain post, any other error means the
+ * buffer was already taken or dropped and must not be posted again. */
+static int hwc_post_framebuffer(struct hwc_context_t* ctx, int disp,
+        hwc_layer_1 *fbt)
+{
+    framebuffer_device_t* fbdev = ctx->mFbDev[disp];
+    gralloc_module_t const* gralloc =
+            (gralloc_module_t const*)ctx->m_gralloc_module;
+    int fence = -1;
+    int err = -EINVAL;
+
+    if (gralloc != NULL && gralloc->perform != NULL) {
+        err = gralloc->perform(gralloc, GRALLOC_MODULE_PERFORM_POST_FENCE,
+                fbdev, fbt->handle, &fence);
+    }
+    if (err == -EINVAL)
+        return fbdev->post(fbdev, fbt->handle);
+    if (err != 0) {
+        ALOGE("%s: post to display %d failed: %s", __FUNCTION__, disp,
+                strerror(-err));
+        return err;
     }
+    if (fence < 0)
+        return 0;
 
+    if (fbt->releaseFenceFd >= 0) {
+        // the Vivante hwc handed back a fence of its own
+        int merged = sync_merge("hwc_fb", fbt->releaseFenceFd, fence);
+        if (merged < 0) {
+            sync_wait(fbt->releaseFenceFd, -1);
+        } else {
+            close(fence);
+            fence = merged;
+        }
+        close(fbt->releaseFenceFd);
+    }
+    fbt->releaseFenceFd = fence;
     return 0;
 }
 
@@ -143,31 +298,51 @@ static int hwc_set(struct hwc_composer_device_1 *dev,
     struct hwc_context_t* ctx = (struct hwc_context_t*)dev;
     hwc_display_contents_1_t *primary_contents = displays[HWC_DISPLAY_PRIMARY];
     hwc_display_contents_1_t *external_contents = displays[HWC_DISPLAY_EXTERNAL];
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+
+#ifdef ENABLE_VIRTUAL_DISPLAY
+    if (numDisplays > HWC_DISPLAY_VIRTUAL && displays[HWC_DISPLAY_VIRTUAL]) {
+        hwc_set_virtual(ctx, displays[HWC_DISPLAY_VIRTUAL]);
+    }
+#endif
 
     if(ctx->m_viv_hwc) {
+        size_t numPhysical = numDisplays > HWC_NUM_PHYSICAL_DISPLAY_TYPES ?
+                             HWC_NUM_PHYSICAL_DISPLAY_TYPES : numDisplays;
 
         char property[PROPERTY_VALUE_MAX];
         property_get("service.bootanim.exit", property, "0");
-        if(!atoi(property)) numDisplays = numDisplays >= 1 ? 1 : 0;
+        if(!atoi(property)) numPhysical = numPhysical >= 1 ? 1 : 0;
 
-        int err = ctx->m_viv_hwc->set(ctx->m_viv_hwc, numDisplays, displays);
+        hwc_display_contents_1_t** viv = hwc_viv_displays(ctx, numPhysical, displays);
+        if (viv == NULL) {
+            return -ENOMEM;
+        }
+        int err = ctx->m_viv_hwc->set(ctx->m_viv_hwc, numPhysical, viv);
+        hwc_viv_results(ctx, numPhysical, displays, viv, true);
 
         if(err) return err;
     }
 
+    int err = 0;
     if (primary_contents && ctx->mDispInfo[HWC_DISPLAY_PRIMARY].blank == 0) {
         hwc_layer_1 *fbt = &primary_contents->hwLayers[primary_contents->numHwLayers - 1];
         if(ctx->mFbDev[HWC_DISPLAY_PRIMARY] != NULL)
-        ctx->mFbDev[HWC_DISPLAY_PRIMARY]->post(ctx->mFbDev[HWC_DISPLAY_PRIMARY], fbt->handle);
+        err = hwc_post_framebuffer(ctx, HWC_DISPLAY_PRIMARY, fbt);
     }
     
     if (external_contents && ctx->mDispInfo[HWC_DISPLAY_EXTERNAL].blank == 0) {
         hwc_layer_1 *fbt = &external_contents->hwLayers[external_contents->numHwLayers - 1];
-        if(ctx->mFbDev[HWC_DISPLAY_EXTERNAL] != NULL)
-        ctx->mFbDev[HWC_DISPLAY_EXTERNAL]->post(ctx->mFbDev[HWC_DISPLAY_EXTERNAL], fbt->handle);
+        if(ctx->mFbDev[HWC_DISPLAY_EXTERNAL] != NULL) {
+            int ret = hwc_post_framebuffer(ctx, HWC_DISPLAY_EXTERNAL, fbt);
+            if (err == 0)
+                err = ret;
+            hwc_stats_external_frame(&ctx->mStats);
+        }
     }
 
-    return 0;
+    hwc_stats_set(&ctx->mStats, start);
+    return err;
 }
 
 static void hwc_registerProcs(struct hwc_composer_device_1* dev,
@@ -181,8 +356,21 @@ static void hwc_registerProcs(struct hwc_composer_device_1* dev,
 static int hwc_eventControl(struct hwc_composer_device_1* dev, int dpy, int event, int enabled)
 {
     struct hwc_context_t* ctx = (struct hwc_context_t*)dev;
-    if(ctx && event == HWC_EVENT_VSYNC) {
+    if(!ctx || event != HWC_EVENT_VSYNC) {
+        return 0;
+    }
+
+    switch (dpy) {
+    case HWC_DISPLAY_PRIMARY:
         ctx->m_vsync_thread->setEnabled(enabled);
+        break;
+    case HWC_DISPLAY_EXTERNAL:
+        if (ctx->m_ext_vsync_thread != NULL) {
+            ctx->m_ext_vsync_thread->setEnabled(enabled);
+        }
+        break;
+    default:
+        return -EINVAL;
     }
 
     return 0;
@@ -212,7 +400,7 @@ static int hwc_query(struct hwc_composer_device_1* dev,
 static int hwc_blank(struct hwc_composer_device_1 *dev, int disp, int blank)
 {
     struct hwc_context_t* ctx = (struct hwc_context_t*)dev;
-    if (!ctx || disp < 0 || disp >= HWC_NUM_DISPLAY_TYPES) {
+    if (!ctx || disp < 0 || disp >= HWC_NUM_PHYSICAL_DISPLAY_TYPES) {
         return 0;
     }
 
@@ -236,6 +424,16 @@ static int hwc_blank(struct hwc_composer_device_1 *dev, int disp, int blank)
     return 0;
 }
 
+static void hwc_dump(struct hwc_composer_device_1* dev, char *buff, int buff_len)
+{
+    struct hwc_context_t* ctx = (struct hwc_context_t*)dev;
+    if (!ctx || !buff || buff_len <= 0) {
+        return;
+    }
+
+    hwc_stats_dump(&ctx->mStats, buff, buff_len);
+}
+
 static int hwc_getDisplayConfigs(struct hwc_composer_device_1 *dev,
         int disp, uint32_t *configs, size_t *numConfigs)
 {
@@ -243,7 +441,7 @@ static int hwc_getDisplayConfigs(struct hwc_composer_device_1 *dev,
         return 0;
 
     struct hwc_context_t* ctx = (struct hwc_context_t*)dev;
-    if (!ctx || disp < 0 || disp >= HWC_NUM_DISPLAY_TYPES) {
+    if (!ctx || disp < 0 || disp >= HWC_NUM_PHYSICAL_DISPLAY_TYPES) {
         return -EINVAL;
     }
 
@@ -260,7 +458,7 @@ static int hwc_getDisplayAttributes(struct hwc_composer_device_1 *dev,
         int disp, uint32_t config, const uint32_t *attributes, int32_t *values)
 {
     struct hwc_context_t* ctx = (struct hwc_context_t*)dev;
-    if (!ctx || disp < 0 || disp >= HWC_NUM_DISPLAY_TYPES) {
+    if (!ctx || disp < 0 || disp >= HWC_NUM_PHYSICAL_DISPLAY_TYPES) {
         return -EINVAL;
     }
 
@@ -324,7 +522,9 @@ static int hwc_device_open(const struct hw_module_t* module, const char* name,
 
         dev->device.prepare = hwc_prepare;
         dev->device.set = hwc_set;
-#ifdef  USE_HWCOMPOSER_VERSION_1_2
+#if defined(USE_HWCOMPOSER_VERSION_1_3)
+        dev->device.common.version = HWC_DEVICE_API_VERSION_1_3;
+#elif defined(USE_HWCOMPOSER_VERSION_1_2)
         dev->device.common.version = HWC_DEVICE_API_VERSION_1_2;
 #else
         dev->device.common.version = HWC_DEVICE_API_VERSION_1_1;
@@ -332,31 +532,35 @@ static int hwc_device_open(const struct hw_module_t* module, const char* name,
         dev->device.registerProcs = hwc_registerProcs;
         dev->device.eventControl = hwc_eventControl;
         dev->device.query = hwc_query;
+        dev->device.dump = hwc_dump;
 
         dev->device.blank = hwc_blank;
         dev->device.getDisplayConfigs = hwc_getDisplayConfigs;
         dev->device.getDisplayAttributes = hwc_getDisplayAttributes;
 
         /* our private state goes below here */
-        dev->m_vsync_thread = new VSyncThread(dev);
+        pthread_mutex_init(&dev->m_lock, NULL);
+        pthread_mutex_init(&dev->m_plug_lock, NULL);
+        hwc_stats_init(&dev->mStats);
+        dev->m_vsync_thread = new VSyncThread(dev, HWC_DISPLAY_PRIMARY);
         dev->m_uevent_thread = new UeventThread(dev);
         hwc_get_display_info(dev);
+        dev->m_ext_vsync_thread = new VSyncThread(dev, HWC_DISPLAY_EXTERNAL);
 
         hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &dev->m_gralloc_module);
-        struct private_module_t *priv_m = (struct private_module_t *)dev->m_gralloc_module;
-
-        for(int dispid=0; dispid<HWC_NUM_DISPLAY_TYPES; dispid++) {
-            if(dev->mDispInfo[dispid].connected && dev->m_gralloc_module != NULL) {
-                int fbid = dev->mDispInfo[dispid].fb_num;
-                char fbname[HWC_STRING_LENGTH];
-                memset(fbname, 0, sizeof(fbname));
-                sprintf(fbname, "fb%d", fbid);
-                ALOGI("hwcomposer: open framebuffer %s", fbname);
-                dev->mFbDev[dispid] = (framebuffer_device_t*)fbid;
-                dev->m_gralloc_module->methods->open(dev->m_gralloc_module, fbname,
-                           (struct hw_device_t**)&dev->mFbDev[dispid]);
-            }
+
+        for(int dispid=0; dispid<HWC_NUM_PHYSICAL_DISPLAY_TYPES; dispid++) {
+            if(!dev->mDispInfo[dispid].connected)
+                continue;
+            if(dispid == HWC_DISPLAY_EXTERNAL) {
+                pthread_mutex_lock(&dev->m_plug_lock);
+                hwc_hotplug_plugin(dev, systemTime(SYSTEM_TIME_MONOTONIC));
+                pthread_mutex_unlock(&dev->m_plug_lock);
+            } else
+                hwc_open_framebuffer(dev, dispid);
         }
+        // the external vsync takes its fd once the display is up.
+        dev->m_ext_vsync_thread->setConnected(dev->mDispInfo[HWC_DISPLAY_EXTERNAL].connected);
 
         const hw_module_t *hwc_module;
         if(hw_get_module(HWC_VIV_HARDWARE_MODULE_ID,
@@ -0,0 +1,279 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Software g2d for the host tests: nearest sampling, the rotations as the
+ * hwcomposer maps them, blending with a global alpha, RGB sources and RGB
+ * or NV12 destinations. Rectangles outside of their surface are counted
+ * as errors instead of being clipped, the hardware would write past the
+ * buffer. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "g2d.h"
+
+struct g2d_fake {
+    bool blend;
+    bool globalAlpha;
+};
+
+static struct g2d_fake sG2d;
+static int sErrors;
+static int sBlits;
+
+static bool g2d_fake_check(const char *what, struct g2d_surface *s)
+{
+    if (s->left < 0 || s->top < 0 || s->right > s->width ||
+            s->bottom > s->height || s->left >= s->right ||
+            s->top >= s->bottom || s->width > s->stride) {
+        fprintf(stderr, "g2d: %s rect %d,%d %d,%d outside of %dx%d\n", what,
+                s->left, s->top, s->right, s->bottom, s->width, s->height);
+        sErrors++;
+        return false;
+    }
+    return true;
+}
+
+static int g2d_fake_bpp(enum g2d_format format)
+{
+    switch (format) {
+        case G2D_RGBA8888:
+        case G2D_RGBX8888:
+        case G2D_BGRA8888:
+        case G2D_BGRX8888:
+            return 4;
+        case G2D_RGB565:
+        case G2D_BGR565:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+static void g2d_fake_read(struct g2d_surface *s, int x, int y, uint8_t *rgba)
+{
+    uint8_t *p = (uint8_t *)(intptr_t)s->planes[0] +
+                 (y * s->stride + x) * g2d_fake_bpp(s->format);
+    uint16_t v;
+
+    switch (s->format) {
+        case G2D_RGBA8888:
+        case G2D_RGBX8888:
+            rgba[0] = p[0]; rgba[1] = p[1]; rgba[2] = p[2];
+            rgba[3] = s->format == G2D_RGBA8888 ? p[3] : 0xff;
+            break;
+        case G2D_BGRA8888:
+        case G2D_BGRX8888:
+            rgba[0] = p[2]; rgba[1] = p[1]; rgba[2] = p[0];
+            rgba[3] = s->format == G2D_BGRA8888 ? p[3] : 0xff;
+            break;
+        case G2D_RGB565:
+        case G2D_BGR565:
+            memcpy(&v, p, 2);
+            rgba[0] = ((v >> 11) & 0x1f) << 3;
+            rgba[1] = ((v >> 5) & 0x3f) << 2;
+            rgba[2] = (v & 0x1f) << 3;
+            rgba[3] = 0xff;
+            if (s->format == G2D_BGR565) {
+                uint8_t t = rgba[0];
+                rgba[0] = rgba[2];
+                rgba[2] = t;
+            }
+            break;
+        default:
+            memset(rgba, 0, 4);
+            break;
+    }
+}
+
+static void g2d_fake_write(struct g2d_surface *s, int x, int y, const uint8_t *rgba)
+{
+    if (s->format == G2D_NV12) {
+        int r = rgba[0], g = rgba[1], b = rgba[2];
+        uint8_t *luma = (uint8_t *)(intptr_t)s->planes[0];
+        uint8_t *chroma = (uint8_t *)(intptr_t)s->planes[1];
+        luma[y * s->stride + x] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        if (!(x & 1) && !(y & 1)) {
+            uint8_t *uv = chroma + (y / 2) * s->stride + x;
+            uv[0] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+            uv[1] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+        }
+        return;
+    }
+
+    uint8_t *p = (uint8_t *)(intptr_t)s->planes[0] +
+                 (y * s->stride + x) * g2d_fake_bpp(s->format);
+    uint16_t v;
+    switch (s->format) {
+        case G2D_RGBA8888:
+        case G2D_RGBX8888:
+            p[0] = rgba[0]; p[1] = rgba[1]; p[2] = rgba[2]; p[3] = rgba[3];
+            break;
+        case G2D_BGRA8888:
+        case G2D_BGRX8888:
+            p[0] = rgba[2]; p[1] = rgba[1]; p[2] = rgba[0]; p[3] = rgba[3];
+            break;
+        case G2D_RGB565:
+            v = ((rgba[0] >> 3) << 11) | ((rgba[1] >> 2) << 5) | (rgba[2] >> 3);
+            memcpy(p, &v, 2);
+            break;
+        case G2D_BGR565:
+            v = ((rgba[2] >> 3) << 11) | ((rgba[1] >> 2) << 5) | (rgba[0] >> 3);
+            memcpy(p, &v, 2);
+            break;
+        default:
+            break;
+    }
+}
+
+int g2d_open(void **handle)
+{
+    memset(&sG2d, 0, sizeof(sG2d));
+    *handle = &sG2d;
+    return 0;
+}
+
+int g2d_close(void *handle)
+{
+    return handle == &sG2d ? 0 : -1;
+}
+
+int g2d_enable(void *handle, enum g2d_cap_mode cap)
+{
+    struct g2d_fake *g2d = (struct g2d_fake *)handle;
+    if (cap == G2D_BLEND) {
+        g2d->blend = true;
+    }
+    else if (cap == G2D_GLOBAL_ALPHA) {
+        g2d->globalAlpha = true;
+    }
+    return 0;
+}
+
+int g2d_disable(void *handle, enum g2d_cap_mode cap)
+{
+    struct g2d_fake *g2d = (struct g2d_fake *)handle;
+    if (cap == G2D_BLEND) {
+        g2d->blend = false;
+    }
+    else if (cap == G2D_GLOBAL_ALPHA) {
+        g2d->globalAlpha = false;
+    }
+    return 0;
+}
+
+int g2d_clear(void *handle, struct g2d_surface *area)
+{
+    uint8_t rgba[4] = {
+        (uint8_t)(area->clrcolor & 0xff),
+        (uint8_t)((area->clrcolor >> 8) & 0xff),
+        (uint8_t)((area->clrcolor >> 16) & 0xff),
+        (uint8_t)((area->clrcolor >> 24) & 0xff),
+    };
+
+    if (handle != &sG2d || !g2d_fake_check("clear", area)) {
+        return -1;
+    }
+    for (int y = area->top; y < area->bottom; y++) {
+        for (int x = area->left; x < area->right; x++) {
+            g2d_fake_write(area, x, y, rgba);
+        }
+    }
+    return 0;
+}
+
+int g2d_blit(void *handle, struct g2d_surface *src, struct g2d_surface *dst)
+{
+    struct g2d_fake *g2d = (struct g2d_fake *)handle;
+
+    if (handle != &sG2d || !g2d_fake_check("src", src) ||
+            !g2d_fake_check("dst", dst) || !g2d_fake_bpp(src->format) ||
+            (!g2d_fake_bpp(dst->format) && dst->format != G2D_NV12)) {
+        return -1;
+    }
+    sBlits++;
+
+    int dw = dst->right - dst->left;
+    int dh = dst->bottom - dst->top;
+    int sw = src->right - src->left;
+    int sh = src->bottom - src->top;
+    int ga = g2d->globalAlpha ? src->global_alpha : 0xff;
+    for (int y = 0; y < dh; y++) {
+        for (int x = 0; x < dw; x++) {
+            // position in the destination, in units of 1/2 pixel
+            int u = 2 * x + 1, v = 2 * y + 1;
+            int s, t, su, sv;
+            switch (dst->rot) {
+                case G2D_FLIP_H:
+                    s = 2 * dw - u; t = v; su = dw; sv = dh; break;
+                case G2D_FLIP_V:
+                    s = u; t = 2 * dh - v; su = dw; sv = dh; break;
+                case G2D_ROTATION_180:
+                    s = 2 * dw - u; t = 2 * dh - v; su = dw; sv = dh; break;
+                case G2D_ROTATION_90:
+                    // clockwise: the source left column is the top row
+                    s = v; t = 2 * dw - u; su = dh; sv = dw; break;
+                case G2D_ROTATION_270:
+                    s = 2 * dh - v; t = u; su = dh; sv = dw; break;
+                default:
+                    s = u; t = v; su = dw; sv = dh; break;
+            }
+            int sx = src->left + s * sw / (2 * su);
+            int sy = src->top + t * sh / (2 * sv);
+
+            uint8_t in[4], out[4];
+            g2d_fake_read(src, sx, sy, in);
+            if (g2d->blend) {
+                g2d_fake_read(dst, dst->left + x, dst->top + y, out);
+                int a = in[3] * ga / 255;
+                for (int c = 0; c < 3; c++) {
+                    int sc = src->blendfunc == G2D_SRC_ALPHA ?
+                             in[c] * a / 255 : in[c] * ga / 255;
+                    int dc = dst->blendfunc == G2D_ONE_MINUS_SRC_ALPHA ?
+                             out[c] * (255 - a) / 255 : 0;
+                    out[c] = sc + dc > 255 ? 255 : sc + dc;
+                }
+                out[3] = a + out[3] * (255 - a) / 255;
+            }
+            else {
+                memcpy(out, in, 4);
+            }
+            g2d_fake_write(dst, dst->left + x, dst->top + y, out);
+        }
+    }
+    return 0;
+}
+
+int g2d_finish(void *handle)
+{
+    return handle == &sG2d ? 0 : -1;
+}
+
+int g2d_fake_errors(void)
+{
+    return sErrors;
+}
+
+int g2d_fake_blits(void)
+{
+    return sBlits;
+}
+
+void g2d_fake_reset(void)
+{
+    sErrors = 0;
+    sBlits = 0;
+}
@@ -0,0 +1,411 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Virtual display composition against the software g2d: the float source
+ * crop of HWC 1.3, layers partly or fully outside of the output under every
+ * transform, blending, the NV12 write back, and set returning before the
+ * acquire fences signal. */
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sw_sync.h>
+#include "g2d.h"
+#include "hwc_context.h"
+#include "hwc_virtual.h"
+#include "imx_test.h"
+
+/* the reference output has this margin around the tested one, so that
+ * the same layer fits in it unclipped. */
+#define MARGIN 64
+
+/* g2d takes plane addresses as ints, the buffers must sit below 4 GB. */
+static void *test_alloc(size_t size)
+{
+#ifdef MAP_32BIT
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+#else
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#endif
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static private_handle_t *test_buffer(int width, int height, int format)
+{
+    int stride = ALIGN_PIXEL_16(width);
+    int size = stride * ALIGN_PIXEL_16(height) * 4;
+    void *base = test_alloc(size);
+    if (base == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    private_handle_t *hnd = new private_handle_t(-1, size, 0);
+    hnd->base = (int)(intptr_t)base;
+    hnd->phys = (unsigned long)(intptr_t)base;
+    hnd->format = format;
+    hnd->width = width;
+    hnd->height = height;
+    return hnd;
+}
+
+static void test_free(private_handle_t *hnd)
+{
+    munmap((void *)(intptr_t)hnd->base, hnd->size);
+    delete hnd;
+}
+
+static uint32_t *test_pixel(private_handle_t *hnd, int x, int y)
+{
+    return (uint32_t *)(intptr_t)hnd->base + y * ALIGN_PIXEL_16(hnd->width) + x;
+}
+
+/* every pixel of the source a different opaque color. */
+static void test_pattern(private_handle_t *hnd)
+{
+    for (int y = 0; y < hnd->height; y++) {
+        for (int x = 0; x < hnd->width; x++) {
+            *test_pixel(hnd, x, y) = 0xff000000 | (y << 8) | x;
+        }
+    }
+}
+
+static void test_fill(private_handle_t *hnd, uint32_t color)
+{
+    for (int y = 0; y < hnd->height; y++) {
+        for (int x = 0; x < hnd->width; x++) {
+            *test_pixel(hnd, x, y) = color;
+        }
+    }
+}
+
+static hwc_display_contents_1_t *test_list(private_handle_t *out, private_handle_t *fbt)
+{
+    size_t size = sizeof(hwc_display_contents_1_t) + 2 * sizeof(hwc_layer_1_t);
+    hwc_display_contents_1_t *list = (hwc_display_contents_1_t *)calloc(1, size);
+
+    list->retireFenceFd = -1;
+    list->outbuf = out;
+    list->outbufAcquireFenceFd = -1;
+    list->flags = HWC_GEOMETRY_CHANGED;
+    list->numHwLayers = 2;
+    for (int i = 0; i < 2; i++) {
+        hwc_layer_1_t *layer = &list->hwLayers[i];
+        layer->acquireFenceFd = -1;
+        layer->releaseFenceFd = -1;
+        layer->blending = HWC_BLENDING_NONE;
+        layer->planeAlpha = 0xff;
+    }
+    list->hwLayers[1].compositionType = HWC_FRAMEBUFFER_TARGET;
+    list->hwLayers[1].handle = fbt;
+    return list;
+}
+
+static bool test_signaled(int fence)
+{
+    struct pollfd pfd = { fence, POLLIN, 0 };
+    return poll(&pfd, 1, 0) > 0;
+}
+
+/* the fences set returned, waits for the retire one. the release fence
+ * of the layer is the same, once the output is written g2d is done with it. */
+static void test_retire(hwc_display_contents_1_t *list)
+{
+    int retire = list->retireFenceFd;
+    int release = list->hwLayers[0].releaseFenceFd;
+
+    CHECK(retire >= 0 && release >= 0, "fences %d %d", retire, release);
+    if (retire >= 0) {
+        CHECK(sync_wait(retire, 1000) == 0, "output never written");
+        close(retire);
+    }
+    if (release >= 0) {
+        CHECK(test_signaled(release), "layer released after the output");
+        close(release);
+    }
+    list->retireFenceFd = -1;
+    list->hwLayers[0].releaseFenceFd = -1;
+    if (list->hwLayers[1].releaseFenceFd >= 0) {
+        close(list->hwLayers[1].releaseFenceFd);
+        list->hwLayers[1].releaseFenceFd = -1;
+    }
+}
+
+static void test_compose(hwc_context_t *ctx, hwc_display_contents_1_t *list)
+{
+    list->hwLayers[0].compositionType = HWC_FRAMEBUFFER;
+    hwc_prepare_virtual(ctx, list);
+    CHECK(list->hwLayers[0].compositionType == HWC_OVERLAY, "layer left to gles");
+    CHECK(hwc_set_virtual(ctx, list) == 0, "set failed");
+    test_retire(list);
+}
+
+/* HWC 1.3 hands the crop in floats, they are rounded to the pixel. */
+static void test_float_crop(hwc_context_t *ctx)
+{
+    private_handle_t *src = test_buffer(8, 8, HAL_PIXEL_FORMAT_RGBA_8888);
+    private_handle_t *out = test_buffer(16, 16, HAL_PIXEL_FORMAT_RGBA_8888);
+    private_handle_t *fbt = test_buffer(16, 16, HAL_PIXEL_FORMAT_RGBA_8888);
+    hwc_display_contents_1_t *list = test_list(out, fbt);
+    hwc_layer_1_t *layer = &list->hwLayers[0];
+    const hwc_frect_t crop = { 3.6f, 0.4f, 7.6f, 4.4f };
+
+    // red top right quadrant, blue elsewhere
+    test_fill(src, 0xffff0000);
+    for (int y = 0; y < 4; y++) {
+        for (int x = 4; x < 8; x++) {
+            *test_pixel(src, x, y) = 0xff0000ff;
+        }
+    }
+    layer->handle = src;
+    layer->sourceCropf = crop;
+    layer->displayFrame.right = 16;
+    layer->displayFrame.bottom = 16;
+
+    g2d_fake_reset();
+    test_compose(ctx, list);
+    CHECK(g2d_fake_errors() == 0, "float crop read as integers");
+    int wrong = 0;
+    for (int y = 0; y < 16; y++) {
+        for (int x = 0; x < 16; x++) {
+            wrong += *test_pixel(out, x, y) != 0xff0000ff;
+        }
+    }
+    CHECK(wrong == 0, "%d pixels outside of the crop", wrong);
+
+    free(list);
+    test_free(src);
+    test_free(out);
+    test_free(fbt);
+}
+
+/* composes the layer into an output of width by height with its frame at
+ * x, y, and again into one with a margin all around that holds it whole.
+ * the first must be the window of the second. */
+static void test_clip(hwc_context_t *ctx, uint32_t transform, int width, int height,
+                      const hwc_rect_t &crop, int x, int y, int frameW, int frameH)
+{
+    private_handle_t *src = test_buffer(48, 40, HAL_PIXEL_FORMAT_RGBX_8888);
+    private_handle_t *out = test_buffer(width, height, HAL_PIXEL_FORMAT_RGBA_8888);
+    private_handle_t *ref = test_buffer(width + 2 * MARGIN, height + 2 * MARGIN,
+                                        HAL_PIXEL_FORMAT_RGBA_8888);
+    private_handle_t *fbt = test_buffer(width, height, HAL_PIXEL_FORMAT_RGBA_8888);
+    hwc_display_contents_1_t *list = test_list(out, fbt);
+    hwc_layer_1_t *layer = &list->hwLayers[0];
+
+    test_pattern(src);
+    layer->handle = src;
+    layer->transform = transform;
+    layer->sourceCropf.left = crop.left;
+    layer->sourceCropf.top = crop.top;
+    layer->sourceCropf.right = crop.right;
+    layer->sourceCropf.bottom = crop.bottom;
+    layer->displayFrame.left = x + MARGIN;
+    layer->displayFrame.top = y + MARGIN;
+    layer->displayFrame.right = x + frameW + MARGIN;
+    layer->displayFrame.bottom = y + frameH + MARGIN;
+    list->outbuf = ref;
+    test_compose(ctx, list);
+
+    g2d_fake_reset();
+    layer->displayFrame.left = x;
+    layer->displayFrame.top = y;
+    layer->displayFrame.right = x + frameW;
+    layer->displayFrame.bottom = y + frameH;
+    list->outbuf = out;
+    test_compose(ctx, list);
+
+    bool visible = x < width && y < height && x + frameW > 0 && y + frameH > 0;
+    CHECK(g2d_fake_errors() == 0, "transform %u frame %d,%d blit outside of the output",
+          transform, x, y);
+    CHECK(g2d_fake_blits() == (visible ? 1 : 0), "transform %u frame %d,%d %d blits",
+          transform, x, y, g2d_fake_blits());
+    int wrong = 0;
+    for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) {
+            wrong += *test_pixel(out, i, j) != *test_pixel(ref, i + MARGIN, j + MARGIN);
+        }
+    }
+    CHECK(wrong == 0, "transform %u frame %d,%d: %d pixels differ", transform, x, y, wrong);
+
+    free(list);
+    test_free(src);
+    test_free(out);
+    test_free(ref);
+    test_free(fbt);
+}
+
+static void test_clip_transforms(hwc_context_t *ctx)
+{
+    static const uint32_t transforms[] = {
+        0, HWC_TRANSFORM_FLIP_H, HWC_TRANSFORM_FLIP_V, HWC_TRANSFORM_ROT_180,
+        HWC_TRANSFORM_ROT_90, HWC_TRANSFORM_ROT_270,
+    };
+    // frames across each edge and corner, inside and fully outside
+    static const int offsets[][2] = {
+        { -10, 4 }, { 4, -7 }, { 30, 4 }, { 4, 20 }, { -5, -3 }, { 25, 18 },
+        { -40, -40 }, { 2, 2 }, { -100, 0 }, { 0, 60 },
+    };
+    const hwc_rect_t crop = { 5, 3, 37, 27 };
+
+    for (size_t t = 0; t < sizeof(transforms) / sizeof(transforms[0]); t++) {
+        bool swap = transforms[t] & HWC_TRANSFORM_ROT_90;
+        int frameW = swap ? 24 : 32;
+        int frameH = swap ? 32 : 24;
+        for (size_t o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++) {
+            test_clip(ctx, transforms[t], 48, 36, crop,
+                      offsets[o][0], offsets[o][1], frameW, frameH);
+        }
+        // scaled twice, clipped by an even amount of pixels
+        test_clip(ctx, transforms[t], 40, 30, crop, -8, -6, 2 * frameW, 2 * frameH);
+    }
+}
+
+/* a translucent premultiplied layer over the black the output is cleared to. */
+static void test_blend(hwc_context_t *ctx)
+{
+    private_handle_t *src = test_buffer(4, 4, HAL_PIXEL_FORMAT_RGBA_8888);
+    private_handle_t *out = test_buffer(4, 4, HAL_PIXEL_FORMAT_RGBA_8888);
+    private_handle_t *fbt = test_buffer(4, 4, HAL_PIXEL_FORMAT_RGBA_8888);
+    hwc_display_contents_1_t *list = test_list(out, fbt);
+    hwc_layer_1_t *layer = &list->hwLayers[0];
+
+    test_fill(src, 0xffffffff);
+    layer->handle = src;
+    layer->blending = HWC_BLENDING_PREMULT;
+    layer->planeAlpha = 0x80;
+    layer->sourceCropf.right = 4;
+    layer->sourceCropf.bottom = 4;
+    layer->displayFrame.right = 4;
+    layer->displayFrame.bottom = 4;
+    test_compose(ctx, list);
+
+    uint32_t pixel = *test_pixel(out, 1, 1);
+    CHECK((pixel & 0xff) == 0x80 && ((pixel >> 24) & 0xff) == 0xff,
+          "blended pixel %08x", pixel);
+
+    free(list);
+    test_free(src);
+    test_free(out);
+    test_free(fbt);
+}
+
+/* the encoder path: a single opaque layer written back as NV12, partly
+ * off the output. */
+static void test_nv12(hwc_context_t *ctx)
+{
+    private_handle_t *src = test_buffer(32, 32, HAL_PIXEL_FORMAT_RGBA_8888);
+    private_handle_t *out = test_buffer(32, 32, HAL_PIXEL_FORMAT_YCbCr_420_SP);
+    private_handle_t *fbt = test_buffer(32, 32, HAL_PIXEL_FORMAT_RGBA_8888);
+    hwc_display_contents_1_t *list = test_list(out, fbt);
+    hwc_layer_1_t *layer = &list->hwLayers[0];
+
+    test_fill(src, 0xffffffff);
+    layer->handle = src;
+    layer->sourceCropf.right = 32;
+    layer->sourceCropf.bottom = 32;
+    layer->displayFrame.left = 16;
+    layer->displayFrame.top = -16;
+    layer->displayFrame.right = 48;
+    layer->displayFrame.bottom = 16;
+    g2d_fake_reset();
+    test_compose(ctx, list);
+
+    uint8_t *luma = (uint8_t *)(intptr_t)out->base;
+    CHECK(g2d_fake_errors() == 0, "nv12 blit outside of the output");
+    CHECK(luma[0] == 16 && luma[20] == 235 && luma[20 * 32 + 20] == 16,
+          "luma %d %d %d", luma[0], luma[20], luma[20 * 32 + 20]);
+
+    free(list);
+    test_free(src);
+    test_free(out);
+    test_free(fbt);
+}
+
+/* set returns before the acquire fences of the layer and of the output
+ * signal, the output is written once they did. */
+static void test_fences(hwc_context_t *ctx)
+{
+    private_handle_t *src = test_buffer(8, 8, HAL_PIXEL_FORMAT_RGBA_8888);
+    private_handle_t *out = test_buffer(8, 8, HAL_PIXEL_FORMAT_RGBA_8888);
+    private_handle_t *fbt = test_buffer(8, 8, HAL_PIXEL_FORMAT_RGBA_8888);
+    hwc_display_contents_1_t *list = test_list(out, fbt);
+    hwc_layer_1_t *layer = &list->hwLayers[0];
+    int acquire[2], outbuf[2];
+
+    test_fill(src, 0xff00ff00);
+    test_fill(out, 0);
+    layer->handle = src;
+    layer->sourceCropf.right = 8;
+    layer->sourceCropf.bottom = 8;
+    layer->displayFrame.right = 8;
+    layer->displayFrame.bottom = 8;
+
+    // a fence is the read end of a pipe, it signals once the write end closes
+    if (pipe(acquire) != 0 || pipe(outbuf) != 0) {
+        CHECK(0, "no pipes");
+        return;
+    }
+    layer->compositionType = HWC_FRAMEBUFFER;
+    hwc_prepare_virtual(ctx, list);
+    layer->acquireFenceFd = acquire[0];
+    list->outbufAcquireFenceFd = outbuf[0];
+    int64_t start = imx_test_ns(CLOCK_MONOTONIC);
+    CHECK(hwc_set_virtual(ctx, list) == 0, "set failed");
+    int64_t took = imx_test_ns(CLOCK_MONOTONIC) - start;
+    CHECK(took < 100000000, "set waited %lld ms for the acquire fences",
+          (long long)(took / 1000000));
+    CHECK(layer->acquireFenceFd == -1 && list->outbufAcquireFenceFd == -1,
+          "acquire fences left to the caller");
+    CHECK(list->retireFenceFd >= 0 && !test_signaled(list->retireFenceFd),
+          "output retired before its acquire fences");
+    CHECK(*test_pixel(out, 0, 0) == 0, "output written before its acquire fences");
+
+    close(acquire[1]);
+    usleep(20000);
+    CHECK(!test_signaled(list->retireFenceFd), "output retired before its own fence");
+    close(outbuf[1]);
+    test_retire(list);
+    CHECK(*test_pixel(out, 0, 0) == 0xff00ff00 && *test_pixel(out, 7, 7) == 0xff00ff00,
+          "output 0x%08x", *test_pixel(out, 0, 0));
+
+    free(list);
+    test_free(src);
+    test_free(out);
+    test_free(fbt);
+}
+
+int main()
+{
+    // the context holds strong pointers, it is never constructed here
+    hwc_context_t *ctx = (hwc_context_t *)calloc(1, sizeof(*ctx));
+    ctx->device.common.version = HWC_DEVICE_API_VERSION_1_3;
+
+    test_float_crop(ctx);
+    test_clip_transforms(ctx);
+    test_blend(ctx);
+    test_nv12(ctx);
+    test_fences(ctx);
+
+    hwc_close_virtual(ctx);
+    free(ctx);
+    return imx_test_result("hwc_virtual_test");
+}
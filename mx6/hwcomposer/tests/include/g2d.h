@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* The g2d interface as the proprietary header declares it, implemented in
+ * software by g2d_fake.cpp for the host tests. Plane addresses are host
+ * pointers there. */
+#ifndef HWC_TEST_G2D_H
+#define HWC_TEST_G2D_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum g2d_format {
+    G2D_RGB565 = 0,
+    G2D_RGBA8888 = 1,
+    G2D_RGBX8888 = 2,
+    G2D_BGRA8888 = 3,
+    G2D_BGRX8888 = 4,
+    G2D_BGR565 = 5,
+    G2D_NV12 = 20,
+    G2D_I420 = 21,
+    G2D_YV12 = 22,
+    G2D_NV21 = 23,
+    G2D_YUYV = 24,
+};
+
+enum g2d_blend_func {
+    G2D_ZERO = 0,
+    G2D_ONE = 1,
+    G2D_SRC_ALPHA = 2,
+    G2D_ONE_MINUS_SRC_ALPHA = 3,
+    G2D_DST_ALPHA = 4,
+    G2D_ONE_MINUS_DST_ALPHA = 5,
+};
+
+enum g2d_cap_mode {
+    G2D_BLEND = 0,
+    G2D_DITHER = 1,
+    G2D_GLOBAL_ALPHA = 2,
+};
+
+enum g2d_rotation {
+    G2D_ROTATION_0 = 0,
+    G2D_ROTATION_90 = 1,
+    G2D_ROTATION_180 = 2,
+    G2D_ROTATION_270 = 3,
+    G2D_FLIP_H = 4,
+    G2D_FLIP_V = 5,
+};
+
+struct g2d_surface {
+    enum g2d_format format;
+    int planes[3];
+    int left;
+    int top;
+    int right;
+    int bottom;
+    int stride;
+    int width;
+    int height;
+    enum g2d_blend_func blendfunc;
+    int global_alpha;
+    int clrcolor;
+    enum g2d_rotation rot;
+};
+
+int g2d_open(void **handle);
+int g2d_close(void *handle);
+int g2d_clear(void *handle, struct g2d_surface *area);
+int g2d_blit(void *handle, struct g2d_surface *src, struct g2d_surface *dst);
+int g2d_enable(void *handle, enum g2d_cap_mode cap);
+int g2d_disable(void *handle, enum g2d_cap_mode cap);
+int g2d_finish(void *handle);
+
+/* checks of the fake: blits whose rectangles left their surface and
+ * blits done since the last reset. */
+int g2d_fake_errors(void);
+int g2d_fake_blits(void);
+void g2d_fake_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -21,20 +21,23 @@ ifeq ($(TARGET_HAVE_IMX_GRALLOC),true)
 include $(CLEAR_VARS)
 LOCAL_PRELINK_MODULE := false
 LOCAL_MODULE_PATH := $(TARGET_OUT_SHARED_LIBRARIES)/hw
-LOCAL_SHARED_LIBRARIES := liblog libcutils libGLESv1_CM libhardware libutils
+LOCAL_SHARED_LIBRARIES := liblog libcutils libGLESv1_CM libhardware libutils libsync
 
 LOCAL_SRC_FILES := 	\
 	gralloc.cpp 	\
 	framebuffer.cpp \
 	mapper.cpp
 
+LOCAL_STATIC_LIBRARIES := libimxcompose libimxfbflip
+LOCAL_C_INCLUDES += hardware/imx/libcompose hardware/imx/libfbflip
 LOCAL_MODULE := gralloc.$(TARGET_BOARD_PLATFORM)
 LOCAL_CFLAGS:= -DLOG_TAG=\"$(TARGET_BOARD_PLATFORM).gralloc\" -D_LINUX
 
 
-#ifeq ($(HAVE_FSL_EPDC_FB),true)
-#LOCAL_CFLAGS += -DFSL_EPDC_FB
-#endif
+ifeq ($(HAVE_FSL_EPDC_FB),true)
+LOCAL_SRC_FILES += fb_epdc.cpp
+LOCAL_CFLAGS += -DFSL_EPDC_FB
+endif
 
 ifeq ($(HAVE_FSL_IMX_IPU),true)
 LOCAL_CFLAGS += -DFSL_IMX_DISPLAY
@@ -44,9 +47,30 @@ else ifeq ($(HAVE_FSL_IMX_GPU2D),true)
 LOCAL_CFLAGS += -DFSL_IMX_DISPLAY
 endif
 
+ifeq ($(HAVE_FSL_IMX_GPU2D),true)
+LOCAL_SHARED_LIBRARIES += libg2d
+LOCAL_C_INCLUDES += device/fsl-proprietary/include
+LOCAL_CFLAGS += -DFSL_IMX_G2D
+endif
+
 LOCAL_MODULE_TAGS := eng
 
 include $(BUILD_SHARED_LIBRARY)
 endif
 
 
+
+# the EPDC partial updates against a fake panel, replaying
+# tests/epdc_posts.txt, run on the host:
+# out/host/<os>-<arch>/bin/epdc_test
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := 	\
+	fb_epdc.cpp	\
+	tests/epdc_test.cpp
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/tests/include hardware/imx/libimxtest
+LOCAL_CFLAGS := -DLOG_TAG=\"epdc\" -D_LINUX
+LOCAL_STATIC_LIBRARIES := libimxtest_host libcutils liblog
+LOCAL_LDLIBS := -lpthread
+LOCAL_MODULE := epdc_test
+LOCAL_MODULE_TAGS := optional
+include $(BUILD_HOST_EXECUTABLE)
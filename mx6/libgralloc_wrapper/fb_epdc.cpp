@@ -0,0 +1,392 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <cutils/log.h>
+
+#ifdef __ARM_NEON__
+#include <arm_neon.h>
+#endif
+
+#include "fb_epdc.h"
+
+/*****************************************************************************/
+
+#define EPDC_ID                 "mxc_epdc_fb"
+
+// waveform modes of the i.MX6SL panels
+#ifndef WAVEFORM_MODE_INIT
+#define WAVEFORM_MODE_INIT      0x0     /* screen goes to white */
+#define WAVEFORM_MODE_DU        0x1     /* grey to black or white, fast */
+#define WAVEFORM_MODE_GC16      0x2     /* 16 grey levels, flashing */
+#define WAVEFORM_MODE_GC4       0x3     /* 4 grey levels */
+#define WAVEFORM_MODE_A2        0x4     /* black and white animation */
+#endif
+
+// the screen is compared in tiles of this many pixels and lines
+#define EPDC_TILE_W             32
+#define EPDC_TILE_H             16
+// changed tile runs collected before merging
+#define EPDC_MAX_RECTS          64
+// posts closer than this are animation, served with A2
+#define EPDC_ANIM_INTERVAL_NS   200000000LL
+// partial GC16 updates before one is sent as full to clear ghosting
+#define EPDC_FULL_AFTER         32
+#define EPDC_SEND_RETRIES       10
+
+static int64_t fb_epdc_now()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static inline int64_t fb_epdc_area(const struct mxcfb_rect* r)
+{
+    return (int64_t)r->width * r->height;
+}
+
+static void fb_epdc_union(struct mxcfb_rect* out, const struct mxcfb_rect* a,
+        const struct mxcfb_rect* b)
+{
+    uint32_t left = a->left < b->left ? a->left : b->left;
+    uint32_t top = a->top < b->top ? a->top : b->top;
+    uint32_t right = a->left + a->width > b->left + b->width ?
+            a->left + a->width : b->left + b->width;
+    uint32_t bottom = a->top + a->height > b->top + b->height ?
+            a->top + a->height : b->top + b->height;
+
+    out->left = left;
+    out->top = top;
+    out->width = right - left;
+    out->height = bottom - top;
+}
+
+int fb_epdc_merge(struct mxcfb_rect* rects, int count, int max)
+{
+    while (count > 1) {
+        int64_t best = 0;
+        int bi = -1, bj = -1;
+        struct mxcfb_rect u;
+
+        // pick the pair whose union wastes the least area, overlapping
+        // and adjacent tiles come out at zero or below.
+        for (int i = 0; i < count; i++) {
+            for (int j = i + 1; j < count; j++) {
+                fb_epdc_union(&u, &rects[i], &rects[j]);
+                int64_t waste = fb_epdc_area(&u) -
+                        fb_epdc_area(&rects[i]) - fb_epdc_area(&rects[j]);
+                if (bi < 0 || waste < best) {
+                    best = waste;
+                    bi = i;
+                    bj = j;
+                }
+            }
+        }
+
+        if (count <= max && best > 0)
+            break;
+
+        fb_epdc_union(&rects[bi], &rects[bi], &rects[bj]);
+        rects[bj] = rects[--count];
+    }
+
+    return count;
+}
+
+/*****************************************************************************/
+
+static int fb_epdc_differs(const uint8_t* a, const uint8_t* b, size_t len)
+{
+#ifdef __ARM_NEON__
+    while (len >= 16) {
+        uint32x4_t x = vreinterpretq_u32_u8(veorq_u8(vld1q_u8(a), vld1q_u8(b)));
+        uint32x2_t r = vorr_u32(vget_low_u32(x), vget_high_u32(x));
+        if (vget_lane_u32(vpmax_u32(r, r), 0))
+            return 1;
+        a += 16;
+        b += 16;
+        len -= 16;
+    }
+#endif
+    return len && memcmp(a, b, len) != 0;
+}
+
+static int fb_epdc_add(struct mxcfb_rect* rects, int count,
+        uint32_t left, uint32_t top, uint32_t width, uint32_t height)
+{
+    if (count == EPDC_MAX_RECTS)
+        count = fb_epdc_merge(rects, count, EPDC_MAX_RECTS / 2);
+
+    rects[count].left = left;
+    rects[count].top = top;
+    rects[count].width = width;
+    rects[count].height = height;
+    return count + 1;
+}
+
+/* collects the runs of changed tiles, one band of tiles at a time */
+static int fb_epdc_diff(fb_epdc_t* epdc, private_module_t* m,
+        const uint8_t* frame, struct mxcfb_rect* rects)
+{
+    uint32_t bpp = m->info.bits_per_pixel >> 3;
+    uint32_t stride = m->finfo.line_length;
+    uint32_t x0 = 0, y0 = 0;
+    uint32_t x1 = m->info.xres, y1 = m->info.yres;
+    int count = 0;
+
+    if (epdc->hint.width && epdc->hint.height) {
+        x0 = epdc->hint.left;
+        y0 = epdc->hint.top;
+        x1 = x0 + epdc->hint.width < x1 ? x0 + epdc->hint.width : x1;
+        y1 = y0 + epdc->hint.height < y1 ? y0 + epdc->hint.height : y1;
+    }
+
+    for (uint32_t y = y0; y < y1; y += EPDC_TILE_H) {
+        uint32_t h = y1 - y < EPDC_TILE_H ? y1 - y : EPDC_TILE_H;
+        int64_t run = -1;
+        uint32_t x;
+
+        for (x = x0; x < x1; x += EPDC_TILE_W) {
+            uint32_t w = x1 - x < EPDC_TILE_W ? x1 - x : EPDC_TILE_W;
+            bool dirty = false;
+
+            for (uint32_t row = y; row < y + h && !dirty; row++) {
+                size_t offset = row * stride + x * bpp;
+                dirty = fb_epdc_differs(frame + offset, epdc->shadow + offset, w * bpp);
+            }
+
+            if (dirty && run < 0) {
+                run = x;
+            } else if (!dirty && run >= 0) {
+                count = fb_epdc_add(rects, count, run, y, x - run, h);
+                run = -1;
+            }
+        }
+        if (run >= 0)
+            count = fb_epdc_add(rects, count, run, y, x1 - run, h);
+    }
+
+    return count;
+}
+
+static void fb_epdc_copy(fb_epdc_t* epdc, private_module_t* m,
+        const uint8_t* frame, const struct mxcfb_rect* r)
+{
+    uint32_t bpp = m->info.bits_per_pixel >> 3;
+    uint32_t stride = m->finfo.line_length;
+
+    for (uint32_t row = r->top; row < r->top + r->height; row++) {
+        size_t offset = row * stride + r->left * bpp;
+        memcpy(epdc->shadow + offset, frame + offset, r->width * bpp);
+    }
+}
+
+static bool fb_epdc_mono_pixel(const uint8_t* p, uint32_t bpp)
+{
+    switch (bpp) {
+        case 1:
+            return *p == 0x00 || *p == 0xff;
+        case 2: {
+            uint16_t v = *(const uint16_t*)p;
+            return v == 0x0000 || v == 0xffff;
+        }
+        default: {
+            uint32_t v = *(const uint32_t*)p & 0xffffff;
+            return v == 0x000000 || v == 0xffffff;
+        }
+    }
+}
+
+/* text and line art only need the direct waveforms, anything with grey
+ * levels goes through GC16. */
+static uint32_t fb_epdc_waveform(private_module_t* m, const uint8_t* frame,
+        const struct mxcfb_rect* r, bool animating)
+{
+    uint32_t bpp = m->info.bits_per_pixel >> 3;
+    uint32_t stride = m->finfo.line_length;
+
+    for (uint32_t row = r->top; row < r->top + r->height; row++) {
+        const uint8_t* p = frame + row * stride + r->left * bpp;
+        for (uint32_t i = 0; i < r->width; i++, p += bpp) {
+            if (!fb_epdc_mono_pixel(p, bpp))
+                return WAVEFORM_MODE_GC16;
+        }
+    }
+
+    return animating ? WAVEFORM_MODE_A2 : WAVEFORM_MODE_DU;
+}
+
+static void fb_epdc_wait_oldest(fb_epdc_t* epdc, int fd)
+{
+    struct mxcfb_update_marker_data marker;
+
+    if (!epdc->pending)
+        return;
+
+    marker.update_marker = epdc->inflight[epdc->head];
+    marker.collision_test = 0;
+    if (ioctl(fd, MXCFB_WAIT_FOR_UPDATE_COMPLETE, &marker) < 0) {
+        ALOGW("epdc: wait for update %u failed: %s",
+                marker.update_marker, strerror(errno));
+    }
+    epdc->head = (epdc->head + 1) % EPDC_MAX_INFLIGHT;
+    epdc->pending--;
+}
+
+/* updates are not waited for, the driver keeps overlapping ones in
+ * order. only the oldest is waited for once too many are in flight. */
+static void fb_epdc_send(fb_epdc_t* epdc, int fd, const struct mxcfb_rect* r,
+        uint32_t waveform, uint32_t mode)
+{
+    struct mxcfb_update_data upd;
+
+    if (epdc->pending == EPDC_MAX_INFLIGHT)
+        fb_epdc_wait_oldest(epdc, fd);
+
+    if (++epdc->marker == 0)
+        epdc->marker = 1;
+
+    memset(&upd, 0, sizeof(upd));
+    upd.update_region = *r;
+    upd.waveform_mode = waveform;
+    upd.update_mode = mode;
+    upd.update_marker = epdc->marker;
+    upd.temp = TEMP_USE_AMBIENT;
+    upd.flags = 0;
+
+    int retry = 0;
+    while (ioctl(fd, MXCFB_SEND_UPDATE, &upd) < 0) {
+        // the driver runs out of update buffers under load.
+        if (++retry > EPDC_SEND_RETRIES) {
+            ALOGW("epdc: send update failed: %s", strerror(errno));
+            return;
+        }
+        if (epdc->pending)
+            fb_epdc_wait_oldest(epdc, fd);
+        else
+            usleep(2000);
+    }
+
+    epdc->inflight[(epdc->head + epdc->pending) % EPDC_MAX_INFLIGHT] = epdc->marker;
+    epdc->pending++;
+}
+
+/*****************************************************************************/
+
+int fb_epdc_init(fb_epdc_t* epdc, private_module_t* m)
+{
+    memset(epdc, 0, sizeof(*epdc));
+    if (strncmp(m->finfo.id, EPDC_ID, strlen(EPDC_ID)) != 0)
+        return -ENODEV;
+
+    int fd = m->framebuffer->fd;
+    __u32 mode = AUTO_UPDATE_MODE_REGION_MODE;
+    if (ioctl(fd, MXCFB_SET_AUTO_UPDATE_MODE, &mode) < 0) {
+        ALOGE("epdc: set auto update mode failed: %s", strerror(errno));
+        return -errno;
+    }
+
+    // snapshot copies the region at submit time, so a buffer can be
+    // posted again while its last update is still on the way.
+    __u32 scheme = UPDATE_SCHEME_SNAPSHOT;
+    if (ioctl(fd, MXCFB_SET_UPDATE_SCHEME, &scheme) < 0) {
+        ALOGW("epdc: set update scheme failed: %s", strerror(errno));
+    }
+
+    epdc->shadow = (uint8_t*)malloc(m->finfo.line_length * m->info.yres);
+    if (epdc->shadow == NULL)
+        return -ENOMEM;
+
+    epdc->needFull = 1;
+    epdc->enabled = 1;
+    ALOGI("epdc: partial updates enabled");
+    return 0;
+}
+
+void fb_epdc_deinit(fb_epdc_t* epdc, private_module_t* m)
+{
+    if (!epdc->enabled)
+        return;
+
+    while (epdc->pending)
+        fb_epdc_wait_oldest(epdc, m->framebuffer->fd);
+    free(epdc->shadow);
+    epdc->shadow = NULL;
+    epdc->enabled = 0;
+}
+
+void fb_epdc_set_rect(fb_epdc_t* epdc, int l, int t, int w, int h)
+{
+    epdc->hint.left = l;
+    epdc->hint.top = t;
+    epdc->hint.width = w;
+    epdc->hint.height = h;
+}
+
+void fb_epdc_update(fb_epdc_t* epdc, private_module_t* m, const void* vaddr)
+{
+    struct mxcfb_rect rects[EPDC_MAX_RECTS];
+    const uint8_t* frame = (const uint8_t*)vaddr;
+    const struct mxcfb_rect screen = { 0, 0, m->info.xres, m->info.yres };
+    int fd = m->framebuffer->fd;
+    int count;
+
+    int64_t now = fb_epdc_now();
+    bool animating = now - epdc->lastUpdate < EPDC_ANIM_INTERVAL_NS;
+    epdc->lastUpdate = now;
+
+    if (epdc->needFull) {
+        rects[0] = screen;
+        count = 1;
+    } else {
+        count = fb_epdc_diff(epdc, m, frame, rects);
+        count = fb_epdc_merge(rects, count, EPDC_MAX_REGIONS);
+    }
+    memset(&epdc->hint, 0, sizeof(epdc->hint));
+
+    int64_t area = 0;
+    for (int i = 0; i < count; i++)
+        area += fb_epdc_area(&rects[i]);
+
+    // most of the screen changed, one flashing update looks better than
+    // several partial ones.
+    if (epdc->needFull || area * 3 > fb_epdc_area(&screen) * 2) {
+        fb_epdc_copy(epdc, m, frame, &screen);
+        fb_epdc_send(epdc, fd, &screen, WAVEFORM_MODE_GC16, UPDATE_MODE_FULL);
+        epdc->needFull = 0;
+        epdc->partials = 0;
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        uint32_t waveform = fb_epdc_waveform(m, frame, &rects[i], animating);
+        uint32_t mode = UPDATE_MODE_PARTIAL;
+
+        if (waveform == WAVEFORM_MODE_GC16 && ++epdc->partials >= EPDC_FULL_AFTER) {
+            mode = UPDATE_MODE_FULL;
+            epdc->partials = 0;
+        }
+        fb_epdc_copy(epdc, m, frame, &rects[i]);
+        fb_epdc_send(epdc, fd, &rects[i], waveform, mode);
+    }
+}
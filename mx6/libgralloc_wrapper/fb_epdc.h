@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FB_EPDC_H_
+#define FB_EPDC_H_
+
+#include <stdint.h>
+#include <linux/mxcfb.h>
+
+#include "gralloc_priv.h"
+
+// update regions sent for one post, after merging
+#define EPDC_MAX_REGIONS    4
+// updates submitted to the driver and not known to be complete
+#define EPDC_MAX_INFLIGHT   8
+
+/*
+ * E-paper panels are only refreshed where an update is requested. Every
+ * post is compared against the last frame sent to the panel, the changed
+ * tiles are merged into a few regions and each region goes out with the
+ * waveform its content needs.
+ */
+struct fb_epdc_t {
+    int enabled;
+    uint8_t* shadow;
+    struct mxcfb_rect hint;
+    uint32_t marker;
+    uint32_t inflight[EPDC_MAX_INFLIGHT];
+    int head;
+    int pending;
+    int needFull;
+    int partials;
+    int64_t lastUpdate;
+};
+
+int fb_epdc_init(fb_epdc_t* epdc, private_module_t* m);
+void fb_epdc_deinit(fb_epdc_t* epdc, private_module_t* m);
+void fb_epdc_set_rect(fb_epdc_t* epdc, int l, int t, int w, int h);
+void fb_epdc_update(fb_epdc_t* epdc, private_module_t* m, const void* vaddr);
+
+/* merges rects in place until at most max are left, rects whose union
+ * adds no area are always merged. returns the new count. */
+int fb_epdc_merge(struct mxcfb_rect* rects, int count, int max);
+
+#endif /* FB_EPDC_H_ */
@@ -50,6 +50,14 @@
 
 #include <utils/String8.h>
 #include "gralloc_priv.h"
+#include "compose.h"
+#include "fb_flip.h"
+#ifdef FSL_IMX_G2D
+#include "g2d.h"
+#endif
+#ifdef FSL_EPDC_FB
+#include "fb_epdc.h"
+#endif
 /*****************************************************************************/
 
 // numbers of buffers for page flipping
@@ -69,6 +77,11 @@ struct fb_context_t {
     int mainDisp_fd;
     private_module_t* priv_m;
     int isMainDisp;
+    fb_flip_queue_t flip;
+    void* g2dHandle;
+#ifdef FSL_EPDC_FB
+    fb_epdc_t epdc;
+#endif
 };
 
 static int nr_framebuffers;
@@ -94,14 +107,226 @@ static int fb_setUpdateRect(struct framebuffer_device_t* dev,
     fb_context_t* ctx = (fb_context_t*)dev;
     private_module_t* m = reinterpret_cast<private_module_t*>(
             dev->common.module);
+#ifdef FSL_EPDC_FB
+    if (ctx->epdc.enabled) {
+        // limits the comparison of the next post to this rect
+        fb_epdc_set_rect(&ctx->epdc, l, t, w, h);
+        return 0;
+    }
+#endif
     m->info.reserved[0] = 0x54445055; // "UPDT";
     m->info.reserved[1] = (uint16_t)l | ((uint32_t)t << 16);
     m->info.reserved[2] = (uint16_t)(l+w) | ((uint32_t)(t+h) << 16);
     return 0;
 }
 
-static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
+/*****************************************************************************/
+
+static int fb_flip_pan(fb_flip_queue_t* q, fb_flip_t* flip)
+{
+    fb_context_t* ctx = (fb_context_t*)q->data;
+    private_module_t* m = reinterpret_cast<private_module_t*>(
+            ctx->device.common.module);
+
+    if (ioctl(m->framebuffer->fd, FBIOPAN_DISPLAY, &flip->info) == -1) {
+        ALOGW("FBIOPAN_DISPLAY failed: %s", strerror(errno));
+        m->base.unlock(&m->base, flip->buffer);
+        return -errno;
+    }
+
+    if (m->currentBuffer) {
+        m->base.unlock(&m->base, m->currentBuffer);
+    }
+    m->currentBuffer = flip->buffer;
+    return 0;
+}
+
+static void fb_flip_cancel(fb_flip_queue_t* q, fb_flip_t* flip)
+{
+    fb_context_t* ctx = (fb_context_t*)q->data;
+    private_module_t* m = reinterpret_cast<private_module_t*>(
+            ctx->device.common.module);
+
+    m->base.unlock(&m->base, flip->buffer);
+}
+
+static const fb_flip_ops_t sFlipOps = {
+    fb_flip_pan,
+    fb_flip_cancel,
+};
+
+static void fb_start_flips(fb_context_t* ctx, private_module_t* m)
+{
+    if (!(m->flags & PAGE_FLIP))
+        return;
+#ifdef FSL_EPDC_FB
+    // the panel has no vsync to wait for, fb_post sends the updates
+    // right after the pan instead.
+    if (ctx->epdc.enabled)
+        return;
+#endif
+
+    fb_flip_start(&ctx->flip, &sFlipOps, ctx, m->numBuffers, m->fps);
+}
+
+static int fb_queue_flip(fb_context_t* ctx, private_module_t* m,
+        buffer_handle_t buffer, int* releaseFence)
+{
+    private_handle_t const* hnd = reinterpret_cast<private_handle_t const*>(buffer);
+    void *vaddr = NULL;
+    fb_flip_t flip;
+
+    m->base.lock(&m->base, buffer,
+            private_module_t::PRIV_USAGE_LOCKED_FOR_POST,
+            0, 0, ALIGN_PIXEL(m->info.xres), ALIGN_PIXEL_128(m->info.yres), &vaddr);
+
+    const size_t offset = hnd->base - m->framebuffer->base;
+
+    memset(&flip, 0, sizeof(flip));
+    flip.buffer = buffer;
+    flip.info = m->info;
+    flip.info.activate = FB_ACTIVATE_VBL;
+    flip.info.yoffset = offset / m->finfo.line_length;
+    flip.posted = fb_flip_now();
+
+    return fb_flip_queue(&ctx->flip, &flip, releaseFence);
+}
+
+/*****************************************************************************/
+
+static int fb_bytes_per_pixel(int format)
+{
+    switch (format) {
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+            return 4;
+        case HAL_PIXEL_FORMAT_RGB_565:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+static int fb_format(private_module_t* m)
+{
+    if (m->info.bits_per_pixel != 32)
+        return HAL_PIXEL_FORMAT_RGB_565;
+    return m->info.red.offset == 0 ? HAL_PIXEL_FORMAT_RGBA_8888 :
+                                     HAL_PIXEL_FORMAT_BGRA_8888;
+}
+
+#ifdef FSL_IMX_G2D
+static int fb_g2d_format(int format)
 {
+    switch (format) {
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+            return G2D_RGBA8888;
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+            return G2D_RGBX8888;
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+            return G2D_BGRA8888;
+        case HAL_PIXEL_FORMAT_RGB_565:
+            return G2D_RGB565;
+        default:
+            return -1;
+    }
+}
+#endif
+
+/* G2D copy of a contiguous buffer into the front framebuffer, converting
+ * stride and pixel format on the way. */
+static int fb_blit_g2d(fb_context_t* ctx, private_module_t* m,
+        private_handle_t const* hnd)
+{
+#ifdef FSL_IMX_G2D
+    struct g2d_surface src, dst;
+    int format = fb_g2d_format(hnd->format);
+
+    if (!hnd->phys || format < 0) {
+        return -EINVAL;
+    }
+
+    if (ctx->g2dHandle == NULL && g2d_open(&ctx->g2dHandle) != 0) {
+        ALOGE("g2d_open failed, falling back to memcpy");
+        ctx->g2dHandle = NULL;
+        return -EINVAL;
+    }
+
+    memset(&src, 0, sizeof(src));
+    src.format = (enum g2d_format)format;
+    src.planes[0] = hnd->phys;
+    src.width = hnd->width;
+    src.height = hnd->height;
+    src.stride = ALIGN_PIXEL_16(hnd->width);
+    src.right = hnd->width < (int)m->info.xres ? hnd->width : m->info.xres;
+    src.bottom = hnd->height < (int)m->info.yres ? hnd->height : m->info.yres;
+    src.global_alpha = 0xff;
+
+    memset(&dst, 0, sizeof(dst));
+    if (m->info.bits_per_pixel == 32) {
+        dst.format = m->info.red.offset == 0 ? G2D_RGBA8888 : G2D_BGRA8888;
+    } else {
+        dst.format = G2D_RGB565;
+    }
+    dst.planes[0] = m->framebuffer->phys;
+    dst.width = m->info.xres;
+    dst.height = m->info.yres;
+    dst.stride = m->finfo.line_length / (m->info.bits_per_pixel >> 3);
+    dst.right = src.right;
+    dst.bottom = src.bottom;
+    dst.global_alpha = 0xff;
+
+    int err = g2d_blit(ctx->g2dHandle, &src, &dst);
+    g2d_finish(ctx->g2dHandle);
+    if (err != 0) {
+        ALOGW("g2d_blit failed %d", err);
+        return -EINVAL;
+    }
+
+    return 0;
+#else
+    return -ENODEV;
+#endif
+}
+
+/* last resort for buffers the 2D core can't read (ashmem), converts
+ * the pixels when the buffer format is not the framebuffer one. */
+static void fb_copy_cpu(private_module_t* m, private_handle_t const* hnd,
+        void* fb_vaddr, void* buffer_vaddr)
+{
+    size_t dst_stride = m->finfo.line_length;
+    size_t src_stride = ALIGN_PIXEL_16(hnd->width) * fb_bytes_per_pixel(hnd->format);
+    int format = fb_format(m);
+
+    if (src_stride == 0 || (src_stride == dst_stride && hnd->format == format)) {
+        memcpy(fb_vaddr, buffer_vaddr, m->finfo.line_length * ALIGN_PIXEL_128(m->info.yres));
+        return;
+    }
+
+    compose_image_t src, dst;
+    memset(&src, 0, sizeof(src));
+    src.format = hnd->format;
+    src.width = hnd->width;
+    src.height = hnd->height;
+    src.planes[0] = buffer_vaddr;
+    src.stride[0] = src_stride;
+
+    memset(&dst, 0, sizeof(dst));
+    dst.format = format;
+    dst.width = m->info.xres;
+    dst.height = m->info.yres;
+    dst.planes[0] = fb_vaddr;
+    dst.stride[0] = dst_stride;
+
+    compose_convert(&dst, &src);
+}
+
+int fb_post_fence(struct framebuffer_device_t* dev, buffer_handle_t buffer,
+        int* releaseFence)
+{
+    if (releaseFence)
+        *releaseFence = -1;
     if (!buffer)
         return -EINVAL;
 
@@ -110,6 +335,14 @@ static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
     private_handle_t const* hnd = reinterpret_cast<private_handle_t const*>(buffer);
     private_module_t* m = reinterpret_cast<private_module_t*>(
             dev->common.module);
+
+    if ((hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER) &&
+            ctx->flip.running) {
+        return fb_queue_flip(ctx, m, buffer, releaseFence);
+    }
+
+    // keep the copy path ordered behind any queued flip.
+    fb_flip_drain(&ctx->flip);
     if (m->currentBuffer) {
         m->base.unlock(&m->base, m->currentBuffer);
         m->currentBuffer = 0;
@@ -134,14 +367,17 @@ static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
         }
 
         m->currentBuffer = buffer;
+#ifdef FSL_EPDC_FB
+        if (ctx->epdc.enabled)
+            fb_epdc_update(&ctx->epdc, m, (const void*)hnd->base);
+#endif
         
-    } else {
-        // If we can't do the page_flip, just copy the buffer to the front 
-        // FIXME: use copybit HAL instead of memcpy
-        
+    } else if (fb_blit_g2d(ctx, m, hnd) != 0) {
+        // If we can't do the page_flip nor the blit, copy the buffer
+        // to the front.
         void* fb_vaddr;
         void* buffer_vaddr;
-        
+
         m->base.lock(&m->base, m->framebuffer, 
                 GRALLOC_USAGE_SW_WRITE_RARELY, 
                 0, 0, ALIGN_PIXEL(m->info.xres), ALIGN_PIXEL_128(m->info.yres),
@@ -152,15 +388,26 @@ static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
                 0, 0, ALIGN_PIXEL(m->info.xres), ALIGN_PIXEL_128(m->info.yres),
                 &buffer_vaddr);
 
-        memcpy(fb_vaddr, buffer_vaddr, m->finfo.line_length * ALIGN_PIXEL_128(m->info.yres));
+        fb_copy_cpu(m, hnd, fb_vaddr, buffer_vaddr);
 
         m->base.unlock(&m->base, buffer); 
         m->base.unlock(&m->base, m->framebuffer); 
     }
+
+#ifdef FSL_EPDC_FB
+    if (ctx->epdc.enabled &&
+            !(hnd->flags & private_handle_t::PRIV_FLAGS_FRAMEBUFFER))
+        fb_epdc_update(&ctx->epdc, m, (const void*)m->framebuffer->base);
+#endif
     
     return 0;
 }
 
+static int fb_post(struct framebuffer_device_t* dev, buffer_handle_t buffer)
+{
+    return fb_post_fence(dev, buffer, NULL);
+}
+
 static int fb_compositionComplete(struct framebuffer_device_t* dev)
 {
   //  glFinish();
@@ -423,7 +670,23 @@ static int unMapFrameBuffer(fb_context_t* ctx, struct private_module_t* module)
 static int fb_close(struct hw_device_t *dev)
 {
     fb_context_t* ctx = (fb_context_t*)dev;
-    if(ctx) free(ctx);
+    if(ctx) {
+        fb_flip_stop(&ctx->flip);
+#ifdef FSL_EPDC_FB
+        fb_epdc_deinit(&ctx->epdc, ctx->priv_m);
+#endif
+#ifdef FSL_IMX_G2D
+        if (ctx->g2dHandle != NULL)
+            g2d_close(ctx->g2dHandle);
+#endif
+        // hwc reopens an external display whose mode changed between
+        // plug cycles, release its mapping so it can be remapped.
+        if (!ctx->isMainDisp && ctx->priv_m != NULL &&
+            ctx->priv_m->framebuffer != NULL) {
+            unMapFrameBuffer(ctx, ctx->priv_m);
+        }
+        free(ctx);
+    }
     return 0;
 #if 0
     fb_context_t* ctx = (fb_context_t*)dev;
@@ -499,6 +762,11 @@ int fb_device_open(hw_module_t const* module, const char* name,
             status = mapFrameBuffer(m);
             if (status >= 0) {
                 fb_device_init(m, dev);
+#ifdef FSL_EPDC_FB
+                if (fb_epdc_init(&dev->epdc, m) == 0)
+                    dev->device.setUpdateRect = fb_setUpdateRect;
+#endif
+                fb_start_flips(dev, m);
             }
 
             dev->priv_m = m;
@@ -518,6 +786,7 @@ int fb_device_open(hw_module_t const* module, const char* name,
             status = mapFrameBufferWithFbid(priv_m, fbid);
             if (status >= 0) {
                 fb_device_init(priv_m, dev);
+                fb_start_flips(dev, priv_m);
             }
 
             dev->priv_m = priv_m;
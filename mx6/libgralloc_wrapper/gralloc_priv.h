@@ -39,6 +39,13 @@
     to 128 aligned will meet this request for all pixel format (RGB565,RGB888,etc.) */
 #define  ALIGN_PIXEL_128(x)  ((x+ 127) & ~127)
 
+/* perform of the gralloc module: posts a buffer to a framebuffer device
+ * of this gralloc like post and returns the fence signaled once the
+ * buffer is off screen again, or -1 when the post waited for it.
+ * perform(module, GRALLOC_MODULE_PERFORM_POST_FENCE,
+ *         framebuffer_device_t* dev, buffer_handle_t buffer, int* fence) */
+#define GRALLOC_MODULE_PERFORM_POST_FENCE 0x46500001
+
 /*****************************************************************************/
 
 struct private_module_t;
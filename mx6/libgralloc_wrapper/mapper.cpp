@@ -20,6 +20,7 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdarg.h>
 
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -116,3 +117,29 @@ int gralloc_unlock(gralloc_module_t const* module,
 
     return -EINVAL;
 }
+
+extern int fb_post_fence(struct framebuffer_device_t* dev,
+        buffer_handle_t buffer, int* releaseFence);
+
+int gralloc_perform(struct gralloc_module_t const* module,
+        int operation, ... )
+{
+    int err = -EINVAL;
+    va_list args;
+
+    va_start(args, operation);
+    switch (operation) {
+        case GRALLOC_MODULE_PERFORM_POST_FENCE: {
+            framebuffer_device_t* dev = va_arg(args, framebuffer_device_t*);
+            buffer_handle_t buffer = va_arg(args, buffer_handle_t);
+            int* releaseFence = va_arg(args, int*);
+            err = fb_post_fence(dev, buffer, releaseFence);
+            break;
+        }
+        default:
+            break;
+    }
+    va_end(args);
+
+    return err;
+}
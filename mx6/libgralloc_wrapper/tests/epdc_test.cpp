@@ -0,0 +1,452 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The EPDC partial updates against a fake panel. The ioctl of the
+ * framebuffer is answered here: a send copies its region of the frame to
+ * the panel at submit time, like the snapshot scheme, and an update is
+ * complete once waited for. The posts come from a script,
+ * tests/epdc_posts.txt, and after each one the panel has to show the
+ * frame with at most EPDC_MAX_REGIONS updates and the waveforms the
+ * script expects.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+#include <cutils/log.h>
+
+#include "fb_epdc.h"
+#include "imx_test.h"
+
+#define FAKE_FB_FD 1000
+
+// waveform modes of the i.MX6SL panels, as in fb_epdc.cpp
+#define WAVEFORM_DU     0x1
+#define WAVEFORM_GC16   0x2
+#define WAVEFORM_A2     0x4
+
+struct fake_update_t {
+    struct mxcfb_rect region;
+    uint32_t waveform;
+    uint32_t mode;
+};
+
+struct fake_panel_t {
+    uint32_t xres;
+    uint32_t yres;
+    uint32_t stride;
+    uint16_t* frame;
+    uint16_t* panel;
+    // updates sent and not waited for yet, oldest first
+    uint32_t inflight[64];
+    int pending;
+    int maxPending;
+    int busy;
+    int retries;
+    // updates sent since the start of the last post or flicker
+    fake_update_t sent[256];
+    int count;
+    int line;
+};
+
+static fake_panel_t sPanel;
+
+static void fake_send(const struct mxcfb_update_data* upd)
+{
+    const struct mxcfb_rect* r = &upd->update_region;
+
+    CHECK(r->width && r->height && r->left + r->width <= sPanel.xres &&
+          r->top + r->height <= sPanel.yres,
+          "line %d: update %ux%u at %u,%u outside the screen",
+          sPanel.line, r->width, r->height, r->left, r->top);
+    CHECK(upd->update_marker != 0, "line %d: update without a marker", sPanel.line);
+    for (int i = 0; i < sPanel.pending; i++) {
+        CHECK(sPanel.inflight[i] != upd->update_marker,
+              "line %d: marker %u reused while in flight", sPanel.line,
+              upd->update_marker);
+    }
+
+    for (uint32_t y = r->top; y < r->top + r->height && y < sPanel.yres; y++) {
+        uint32_t w = r->left + r->width <= sPanel.xres ? r->width : sPanel.xres - r->left;
+        memcpy(sPanel.panel + y * sPanel.xres + r->left,
+               sPanel.frame + y * sPanel.xres + r->left, w * 2);
+    }
+
+    if (sPanel.pending < (int)(sizeof(sPanel.inflight) / sizeof(sPanel.inflight[0])))
+        sPanel.inflight[sPanel.pending++] = upd->update_marker;
+    if (sPanel.pending > sPanel.maxPending)
+        sPanel.maxPending = sPanel.pending;
+
+    if (sPanel.count < (int)(sizeof(sPanel.sent) / sizeof(sPanel.sent[0]))) {
+        fake_update_t* u = &sPanel.sent[sPanel.count++];
+        u->region = *r;
+        u->waveform = upd->waveform_mode;
+        u->mode = upd->update_mode;
+    }
+}
+
+static int fake_wait(const struct mxcfb_update_marker_data* marker)
+{
+    if (!sPanel.pending) {
+        CHECK(false, "line %d: wait for %u with nothing in flight", sPanel.line,
+              marker->update_marker);
+        errno = EINVAL;
+        return -1;
+    }
+    // the driver completes in order, the oldest is the one worth waiting for
+    CHECK(marker->update_marker == sPanel.inflight[0],
+          "line %d: waits for %u, oldest in flight is %u", sPanel.line,
+          marker->update_marker, sPanel.inflight[0]);
+    memmove(sPanel.inflight, sPanel.inflight + 1, --sPanel.pending * sizeof(uint32_t));
+    return 0;
+}
+
+/* the framebuffer ioctls of fb_epdc.cpp end up here instead of libc */
+extern "C" int ioctl(int fd, unsigned long request, ...)
+{
+    va_list args;
+    va_start(args, request);
+    void* arg = va_arg(args, void*);
+    va_end(args);
+
+    if (fd != FAKE_FB_FD) {
+        errno = ENOTTY;
+        return -1;
+    }
+
+    switch (request) {
+        case MXCFB_SET_AUTO_UPDATE_MODE:
+            CHECK(*(__u32*)arg == AUTO_UPDATE_MODE_REGION_MODE, "auto update mode");
+            return 0;
+        case MXCFB_SET_UPDATE_SCHEME:
+            CHECK(*(__u32*)arg == UPDATE_SCHEME_SNAPSHOT, "update scheme");
+            return 0;
+        case MXCFB_SEND_UPDATE:
+            if (sPanel.busy) {
+                sPanel.busy--;
+                sPanel.retries++;
+                errno = EBUSY;
+                return -1;
+            }
+            fake_send((const struct mxcfb_update_data*)arg);
+            return 0;
+        case MXCFB_WAIT_FOR_UPDATE_COMPLETE:
+            return fake_wait((const struct mxcfb_update_marker_data*)arg);
+    }
+    errno = EINVAL;
+    return -1;
+}
+
+/*****************************************************************************/
+
+struct test_state_t {
+    private_module_t module;
+    private_handle_t* framebuffer;
+    fb_epdc_t epdc;
+    struct mxcfb_rect hint;
+};
+
+static uint16_t test_grey(int grey)
+{
+    return ((grey >> 3) << 11) | ((grey >> 2) << 5) | (grey >> 3);
+}
+
+static void test_fill(uint32_t l, uint32_t t, uint32_t w, uint32_t h, uint16_t c)
+{
+    for (uint32_t y = t; y < t + h && y < sPanel.yres; y++)
+        for (uint32_t x = l; x < l + w && x < sPanel.xres; x++)
+            sPanel.frame[y * sPanel.xres + x] = c;
+}
+
+static void test_stripes(uint32_t l, uint32_t t, uint32_t w, uint32_t h)
+{
+    for (uint32_t y = t; y < t + h; y++)
+        test_fill(l, y, w, 1, y & 1 ? 0xffff : 0x0000);
+}
+
+static void test_close(test_state_t* s)
+{
+    if (!s->framebuffer)
+        return;
+    fb_epdc_deinit(&s->epdc, &s->module);
+    CHECK(sPanel.pending == 0, "%d updates left in flight after deinit", sPanel.pending);
+    delete s->framebuffer;
+    s->framebuffer = NULL;
+    free(sPanel.frame);
+    free(sPanel.panel);
+}
+
+static int test_open(test_state_t* s, uint32_t xres, uint32_t yres)
+{
+    test_close(s);
+    memset(&sPanel, 0, sizeof(sPanel));
+    sPanel.xres = xres;
+    sPanel.yres = yres;
+    sPanel.stride = xres * 2;
+    sPanel.frame = (uint16_t*)malloc(xres * yres * 2);
+    sPanel.panel = (uint16_t*)malloc(xres * yres * 2);
+    memset(sPanel.frame, 0xff, xres * yres * 2);
+    // whatever the last boot left on the glass
+    memset(sPanel.panel, 0x55, xres * yres * 2);
+
+    memset(&s->module, 0, sizeof(s->module));
+    strcpy(s->module.finfo.id, "mxc_epdc_fb");
+    s->module.finfo.line_length = sPanel.stride;
+    s->module.info.xres = xres;
+    s->module.info.yres = yres;
+    s->module.info.bits_per_pixel = 16;
+    s->framebuffer = new private_handle_t(FAKE_FB_FD, sPanel.stride * yres,
+            private_handle_t::PRIV_FLAGS_FRAMEBUFFER);
+    s->module.framebuffer = s->framebuffer;
+    memset(&s->hint, 0, sizeof(s->hint));
+
+    return fb_epdc_init(&s->epdc, &s->module);
+}
+
+/* the panel shows the frame, within the hint of the post if it had one */
+static void test_check_panel(const struct mxcfb_rect* hint)
+{
+    uint32_t x0 = 0, y0 = 0, x1 = sPanel.xres, y1 = sPanel.yres;
+
+    if (hint->width && hint->height) {
+        x0 = hint->left;
+        y0 = hint->top;
+        x1 = x0 + hint->width;
+        y1 = y0 + hint->height;
+    }
+    for (uint32_t y = y0; y < y1; y++) {
+        for (uint32_t x = x0; x < x1; x++) {
+            if (sPanel.panel[y * sPanel.xres + x] != sPanel.frame[y * sPanel.xres + x]) {
+                CHECK(false, "line %d: panel differs from the frame at %u,%u",
+                      sPanel.line, x, y);
+                return;
+            }
+        }
+    }
+}
+
+static void test_post(test_state_t* s)
+{
+    int before = sPanel.count;
+
+    if (s->hint.width && s->hint.height)
+        fb_epdc_set_rect(&s->epdc, s->hint.left, s->hint.top, s->hint.width, s->hint.height);
+    fb_epdc_update(&s->epdc, &s->module, sPanel.frame);
+
+    CHECK(sPanel.count - before <= EPDC_MAX_REGIONS,
+          "line %d: %d updates for one post", sPanel.line, sPanel.count - before);
+    CHECK(sPanel.maxPending <= EPDC_MAX_INFLIGHT,
+          "line %d: %d updates in flight", sPanel.line, sPanel.maxPending);
+    test_check_panel(&s->hint);
+    memset(&s->hint, 0, sizeof(s->hint));
+}
+
+static uint32_t test_waveform(const char* name)
+{
+    if (!strcmp(name, "DU"))
+        return WAVEFORM_DU;
+    if (!strcmp(name, "GC16"))
+        return WAVEFORM_GC16;
+    if (!strcmp(name, "A2"))
+        return WAVEFORM_A2;
+    return 0;
+}
+
+static void test_expect(int updates, const char* waveform, int fulls)
+{
+    uint32_t wf = test_waveform(waveform);
+    int full = 0;
+
+    CHECK(sPanel.count == updates, "line %d: %d updates sent, expected %d",
+          sPanel.line, sPanel.count, updates);
+    for (int i = 0; i < sPanel.count; i++) {
+        CHECK(!wf || sPanel.sent[i].waveform == wf,
+              "line %d: update %d with waveform %u, expected %s", sPanel.line, i,
+              sPanel.sent[i].waveform, waveform);
+        if (sPanel.sent[i].mode == UPDATE_MODE_FULL)
+            full++;
+    }
+    CHECK(full == fulls, "line %d: %d full updates, expected %d", sPanel.line, full, fulls);
+}
+
+static int test_replay(const char* path)
+{
+    FILE* f = fopen(path, "r");
+    test_state_t s;
+    char buf[256];
+    int posts = 0;
+
+    CHECK(f != NULL, "%s: %s", path, strerror(errno));
+    if (!f)
+        return -1;
+
+    memset(&s, 0, sizeof(s));
+    while (fgets(buf, sizeof(buf), f)) {
+        char cmd[32], name[32];
+        unsigned a, b, c, d, e;
+
+        sPanel.line++;
+        if (sscanf(buf, "%31s", cmd) != 1 || cmd[0] == '#')
+            continue;
+
+        if (!strcmp(cmd, "screen") && sscanf(buf, "%*s %u %u", &a, &b) == 2) {
+            int line = sPanel.line;
+            int err = test_open(&s, a, b);
+            sPanel.line = line;
+            CHECK(err == 0, "line %d: fb_epdc_init failed: %d", line, err);
+        } else if (!s.framebuffer) {
+            CHECK(false, "line %d: %s before screen", sPanel.line, cmd);
+        } else if (!strcmp(cmd, "fill") &&
+                sscanf(buf, "%*s %u %u %u %u %u", &a, &b, &c, &d, &e) == 5) {
+            test_fill(a, b, c, d, test_grey(e));
+        } else if (!strcmp(cmd, "stripes") &&
+                sscanf(buf, "%*s %u %u %u %u", &a, &b, &c, &d) == 4) {
+            test_stripes(a, b, c, d);
+        } else if (!strcmp(cmd, "hint") &&
+                sscanf(buf, "%*s %u %u %u %u", &a, &b, &c, &d) == 4) {
+            s.hint.left = a;
+            s.hint.top = b;
+            s.hint.width = c;
+            s.hint.height = d;
+        } else if (!strcmp(cmd, "sleep") && sscanf(buf, "%*s %u", &a) == 1) {
+            usleep(a * 1000);
+        } else if (!strcmp(cmd, "post")) {
+            sPanel.count = 0;
+            test_post(&s);
+            posts++;
+        } else if (!strcmp(cmd, "flicker") &&
+                sscanf(buf, "%*s %u %u %u %u %u", &e, &a, &b, &c, &d) == 5) {
+            sPanel.count = 0;
+            for (unsigned i = 0; i < e; i++) {
+                test_fill(a, b, c, d, test_grey(i & 1 ? 160 : 96));
+                test_post(&s);
+                posts++;
+            }
+        } else if (!strcmp(cmd, "busy") && sscanf(buf, "%*s %u", &a) == 1) {
+            sPanel.busy = a;
+            sPanel.retries = 0;
+        } else if (!strcmp(cmd, "expect") &&
+                sscanf(buf, "%*s %u %31s %u", &a, name, &b) == 3) {
+            test_expect(a, name, b);
+            CHECK(sPanel.busy == 0, "line %d: %d sends never retried", sPanel.line,
+                  sPanel.busy);
+        } else {
+            CHECK(false, "line %d: cannot parse: %s", sPanel.line, buf);
+        }
+    }
+
+    fclose(f);
+    test_close(&s);
+    printf("%d posts replayed from %s\n", posts, path);
+    return 0;
+}
+
+/*****************************************************************************/
+
+static struct mxcfb_rect test_rect(uint32_t l, uint32_t t, uint32_t w, uint32_t h)
+{
+    struct mxcfb_rect r;
+    r.left = l;
+    r.top = t;
+    r.width = w;
+    r.height = h;
+    return r;
+}
+
+static bool test_covers(const struct mxcfb_rect* rects, int count, const struct mxcfb_rect* r)
+{
+    for (int i = 0; i < count; i++) {
+        if (rects[i].left <= r->left && rects[i].top <= r->top &&
+                rects[i].left + rects[i].width >= r->left + r->width &&
+                rects[i].top + rects[i].height >= r->top + r->height)
+            return true;
+    }
+    return false;
+}
+
+/* merging keeps every input covered, and adjacent tiles never cost a region */
+static void test_merge()
+{
+    struct mxcfb_rect in[8], rects[8];
+    int count;
+
+    // a run of tiles split over two bands is one region
+    in[0] = test_rect(64, 0, 96, 16);
+    in[1] = test_rect(64, 16, 96, 16);
+    memcpy(rects, in, sizeof(in));
+    count = fb_epdc_merge(rects, 2, EPDC_MAX_REGIONS);
+    CHECK(count == 1, "adjacent bands left in %d regions", count);
+    CHECK(test_covers(rects, count, &in[0]) && test_covers(rects, count, &in[1]),
+          "adjacent bands not covered");
+
+    // far apart spots stay apart while there are regions left
+    in[0] = test_rect(0, 0, 32, 16);
+    in[1] = test_rect(544, 784, 32, 16);
+    memcpy(rects, in, sizeof(in));
+    count = fb_epdc_merge(rects, 2, EPDC_MAX_REGIONS);
+    CHECK(count == 2, "two spots merged into %d regions", count);
+
+    // more spots than regions: the closest go together
+    for (int i = 0; i < 8; i++)
+        in[i] = test_rect((i % 4) * 160, (i / 4) * 400, 32, 16);
+    memcpy(rects, in, sizeof(in));
+    count = fb_epdc_merge(rects, 8, EPDC_MAX_REGIONS);
+    CHECK(count == EPDC_MAX_REGIONS, "8 spots merged into %d regions", count);
+    for (int i = 0; i < 8; i++)
+        CHECK(test_covers(rects, count, &in[i]), "spot %d not covered", i);
+    int64_t area = 0;
+    for (int i = 0; i < count; i++)
+        area += (int64_t)rects[i].width * rects[i].height;
+    CHECK(area < 600 * 800 / 4, "8 spots grew into %lld pixels", (long long)area);
+}
+
+/* anything but the EPDC framebuffer is left alone */
+static void test_not_epdc()
+{
+    test_state_t s;
+
+    memset(&s, 0, sizeof(s));
+    CHECK(test_open(&s, 64, 64) == 0, "open");
+    test_close(&s);
+
+    memset(&s, 0, sizeof(s));
+    test_open(&s, 64, 64);
+    fb_epdc_deinit(&s.epdc, &s.module);
+    strcpy(s.module.finfo.id, "DISP3 BG");
+    CHECK(fb_epdc_init(&s.epdc, &s.module) == -ENODEV, "init on a lcd framebuffer");
+    CHECK(!s.epdc.enabled, "enabled on a lcd framebuffer");
+    test_close(&s);
+}
+
+int main(int argc, char** argv)
+{
+    char path[PATH_MAX];
+
+    imx_test_path(path, sizeof(path), argc, argv, "mx6/libgralloc_wrapper/tests/epdc_posts.txt");
+
+    test_merge();
+    test_not_epdc();
+    test_replay(path);
+
+    return imx_test_result("epdc_test");
+}
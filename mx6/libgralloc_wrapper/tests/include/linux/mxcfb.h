@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2013 Freescale Semiconductor, Inc. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* the EPDC part of the mxc framebuffer header, for the host tests. */
+#ifndef GRALLOC_TEST_MXCFB_H
+#define GRALLOC_TEST_MXCFB_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define AUTO_UPDATE_MODE_REGION_MODE        0
+#define AUTO_UPDATE_MODE_AUTOMATIC_MODE     1
+
+#define UPDATE_SCHEME_SNAPSHOT              0
+#define UPDATE_SCHEME_QUEUE                 1
+#define UPDATE_SCHEME_QUEUE_AND_MERGE       2
+
+#define UPDATE_MODE_PARTIAL                 0x0
+#define UPDATE_MODE_FULL                    0x1
+
+#define TEMP_USE_AMBIENT                    0x1000
+
+struct mxcfb_rect {
+    __u32 top;
+    __u32 left;
+    __u32 width;
+    __u32 height;
+};
+
+struct mxcfb_alt_buffer_data {
+    __u32 phys_addr;
+    __u32 width;
+    __u32 height;
+    struct mxcfb_rect alt_update_region;
+};
+
+struct mxcfb_update_data {
+    struct mxcfb_rect update_region;
+    __u32 waveform_mode;
+    __u32 update_mode;
+    __u32 update_marker;
+    int temp;
+    unsigned int flags;
+    struct mxcfb_alt_buffer_data alt_buffer_data;
+};
+
+struct mxcfb_update_marker_data {
+    __u32 update_marker;
+    __u32 collision_test;
+};
+
+#define MXCFB_SET_AUTO_UPDATE_MODE      _IOW('F', 0x2D, __u32)
+#define MXCFB_SEND_UPDATE               _IOW('F', 0x2E, struct mxcfb_update_data)
+#define MXCFB_WAIT_FOR_UPDATE_COMPLETE  _IOWR('F', 0x2F, struct mxcfb_update_marker_data)
+#define MXCFB_SET_UPDATE_SCHEME         _IOW('F', 0x32, __u32)
+
+#endif